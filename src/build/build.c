@@ -1,274 +1,327 @@
+#define _POSIX_C_SOURCE 200809L
 #include "build.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 /* BUILD constants (only the ones we actually need) */
-#define BUILD_MAGIC       0x464C457F
 #define BUILDCLASS32      1
+#define BUILDCLASS64      2
 #define BUILDDATA2LSB     1
 #define EV_CURRENT      1
 #define ET_REL          1
 #define EM_386          3
+#define EM_X86_64       62
+#define EM_AARCH64      183
 #define SHN_UNDEF       0
+#define SHN_LORESERVE   0xFF00
 #define SHT_NULL        0
 #define SHT_PROGBITS    1
 #define SHT_NOBITS      8
 #define SHT_STRTAB      3
 #define SHT_SYMTAB      2
+#define SHT_RELA        4
 #define SHF_WRITE       (1 << 0)
 #define SHF_ALLOC       (1 << 1)
 #define SHF_EXECINSTR   (1 << 2)
+#define SHF_INFO_LINK   (1 << 6)
 #define STB_LOCAL       0
 #define STB_GLOBAL      1
 #define STT_NOTYPE      0
 #define STT_OBJECT      1
 #define STT_FUNC        2
 
-/* Standard BUILD32 types */
-typedef uint32_t Build32_Addr;
-typedef uint32_t Build32_Off;
-typedef uint16_t Build32_Half;
-typedef uint32_t Build32_Word;
-typedef int32_t  Build32_Sword;
-
-/* BUILD header */
-typedef struct {
-    unsigned char e_ident[16];
-    Build32_Half    e_type;
-    Build32_Half    e_machine;
-    Build32_Word    e_version;
-    Build32_Addr    e_entry;
-    Build32_Off     e_phoff;
-    Build32_Off     e_shoff;
-    Build32_Word    e_flags;
-    Build32_Half    e_ehsize;
-    Build32_Half    e_phentsize;
-    Build32_Half    e_phnum;
-    Build32_Half    e_shentsize;
-    Build32_Half    e_shnum;
-    Build32_Half    e_shstrndx;
-} Build32_Ehdr;
-
-/* Section header */
-typedef struct {
-    Build32_Word    sh_name;
-    Build32_Word    sh_type;
-    Build32_Word    sh_flags;
-    Build32_Addr    sh_addr;
-    Build32_Off     sh_offset;
-    Build32_Word    sh_size;
-    Build32_Word    sh_link;
-    Build32_Word    sh_info;
-    Build32_Word    sh_addralign;
-    Build32_Word    sh_entsize;
-} Build32_Shdr;
-
-/* Symbol table entry */
-typedef struct {
-    Build32_Word    st_name;
-    Build32_Addr    st_value;
-    Build32_Word    st_size;
-    unsigned char st_info;
-    unsigned char st_other;
-    Build32_Half    st_shndx;
-} Build32_Sym;
+/*
+ * Sizes of the records of each class.  They are serialized field by field
+ * in little-endian order, so no host structure layout is involved:
+ *   Ehdr  ident[16] type machine version entry phoff shoff flags ehsize
+ *         phentsize phnum shentsize shnum shstrndx
+ *   Shdr  name type flags addr offset size link info addralign entsize
+ *   Sym   ELF32: name value size info other shndx
+ *         ELF64: name info other shndx value size
+ *   Rela  offset info addend; info is sym << 8 | type in ELF32 and
+ *         sym << 32 | type in ELF64
+ */
+#define EHDR32_SIZE     52
+#define EHDR64_SIZE     64
+#define SHDR32_SIZE     40
+#define SHDR64_SIZE     64
+#define SYM32_SIZE      16
+#define SYM64_SIZE      24
+#define RELA32_SIZE     12
+#define RELA64_SIZE     24
 
 /* Internal representation of a section we are building */
 typedef struct {
-    char        name[32];        /* section name (limited to 31 chars) */
-    Build32_Word  type;            /* SHT_PROGBITS or SHT_NOBITS */
-    Build32_Word  flags;           /* SHF_ALLOC, SHF_EXECINSTR, etc. */
-    uint8_t    *data;            /* raw data (NULL for .bss) */
-    size_t      data_size;       /* size of data in bytes */
-    uint32_t    alignment;       /* alignment */
-    Build32_Word  name_offset;     /* offset in .shstrtab (filled later) */
-    size_t      file_offset;     /* where data begins in the file (filled later) */
+    uint32_t    name;            /* offset of the name in the name pool */
+    uint32_t    type;            /* SHT_PROGBITS, SHT_NOBITS, ... */
+    uint32_t    flags;           /* SHF_ALLOC, SHF_EXECINSTR, etc. */
+    const uint8_t *data;         /* raw data (NULL for .bss or zeros) */
+    uint64_t    size;            /* size of data in bytes */
+    uint32_t    alignment;       /* alignment in bytes */
+    uint32_t    reloc_count;     /* relocations against this section */
+    uint32_t    name_offset;     /* offset in .shstrtab (filled later) */
+    uint64_t    file_offset;     /* where data begins in the file (filled later) */
+    uint32_t    link;            /* linked section index (symtab -> strtab) */
+    uint32_t    info;            /* symtab: first global; rela: target */
+    uint32_t    entsize;         /* entry size for table sections */
 } SectionInfo;
 
 /* Internal symbol representation */
 typedef struct {
-    char        name[64];        /* symbol name */
-    Build32_Word  name_offset;     /* offset in .strtab */
-    Build32_Addr  value;
-    Build32_Word  size;
+    uint32_t    name;            /* offset of the name in the name pool */
+    uint32_t    name_offset;     /* offset in .strtab (filled later) */
+    uint64_t    value;
+    uint64_t    size;
     unsigned char bind;
     unsigned char type;
-    Build32_Half  shndx;
+    uint16_t    shndx;
 } SymbolInfo;
 
+/* Internal relocation representation */
+typedef struct {
+    uint32_t    section;         /* index of the section patched */
+    uint32_t    symbol;          /* index as returned by build__add_symbol() */
+    uint32_t    type;
+    uint64_t    offset;
+    int64_t     addend;
+} RelocationInfo;
+
 /* Top-level writer object */
 struct BuildObjectWriter {
     const char  *output_path;
-    FILE        *file;
+    bool         is64;
+    uint16_t     machine;        /* e_machine */
 
-    /* Sections we have added */
-    SectionInfo sections[BUILD_WRITER_MAX_SECTIONS];
-    int          section_count;
+    /* Sections we have added, then the .rela sections at finalize */
+    SectionInfo *sections;
+    uint32_t     section_count, section_capacity;
 
     /* Symbols we have added */
-    SymbolInfo   symbols[BUILD_WRITER_MAX_SYMBOLS];
-    int          symbol_count;
+    SymbolInfo  *symbols;
+    uint32_t     symbol_count, symbol_capacity;
 
-    /* Name of the entry point, if any */
-    char         entry_name[64];
-};
+    /* Relocations of all sections, in the order added */
+    RelocationInfo *relocations;
+    uint32_t     relocation_count, relocation_capacity;
 
-/* Helper: write a little-endian half-word to the file */
-static int write_le16(FILE *f, uint16_t val) {
-    uint8_t buf[2] = { val & 0xFF, (val >> 8) & 0xFF };
-    return fwrite(buf, 1, 2, f) == 2 ? 0 : -1;
-}
+    /* Every section and symbol name, each null-terminated */
+    char        *names;
+    size_t       names_size, names_capacity;
+
+    /* Name of the entry point, if any, in the name pool */
+    bool         has_entry;
+    uint32_t     entry_name;
+};
 
-/* Helper: write a little-endian word */
-static int write_le32(FILE *f, uint32_t val) {
-    uint8_t buf[4] = {
-        val & 0xFF,
-        (val >> 8) & 0xFF,
-        (val >> 16) & 0xFF,
-        (val >> 24) & 0xFF
-    };
-    return fwrite(buf, 1, 4, f) == 4 ? 0 : -1;
+/* A string table under construction: one slot per name placed in it */
+typedef struct {
+    const char  *string;
+    size_t       length;
+    uint32_t    *offset;         /* where the slot's offset is stored */
+} StringSlot;
+
+/* Make room for one more item of an array doubling as it grows */
+static bool reserve(void **items, uint32_t *capacity, uint32_t count, size_t item_size) {
+    if (count < *capacity) return true;
+    if (count == UINT32_MAX) return false;
+    uint32_t cap = *capacity ? (*capacity > UINT32_MAX / 2 ? UINT32_MAX : *capacity * 2) : 16;
+    void *grown = realloc(*items, (size_t)cap * item_size);
+    if (!grown) return false;
+    *items = grown;
+    *capacity = cap;
+    return true;
 }
 
-/* Write the BUILD ident bytes (first 16 bytes of header) */
-static int write_ident(FILE *f) {
-    unsigned char ident[16] = {0};
-    ident[0] = 0x7F;
-    ident[1] = 'E';
-    ident[2] = 'L';
-    ident[3] = 'F';
-    ident[4] = BUILDCLASS32;
-    ident[5] = BUILDDATA2LSB;
-    ident[6] = EV_CURRENT;
-    ident[7] = 0;               /* OS/ABI: System V */
-    ident[8] = 0;               /* ABI version */
-    /* bytes 9-15 are padding */
-    return fwrite(ident, 1, 16, f) == 16 ? 0 : -1;
+/* Copy the concatenation of prefix and name into the name pool; returns
+ * false when out of memory. */
+static bool add_name(BuildObjectWriter *w, const char *prefix, const char *name, uint32_t *offset) {
+    size_t plen = strlen(prefix), nlen = strlen(name);
+    size_t need = w->names_size + plen + nlen + 1;
+    if (need > UINT32_MAX) return false;
+    if (need > w->names_capacity) {
+        /* name may be a name of the pool itself */
+        bool pooled = w->names && name >= w->names && name < w->names + w->names_size;
+        size_t at = pooled ? (size_t)(name - w->names) : 0;
+        size_t cap = w->names_capacity ? w->names_capacity * 2 : 1024;
+        while (cap < need) cap *= 2;
+        char *grown = realloc(w->names, cap);
+        if (!grown) return false;
+        w->names = grown;
+        w->names_capacity = cap;
+        if (pooled) name = grown + at;
+    }
+    *offset = (uint32_t)w->names_size;
+    memcpy(w->names + w->names_size, prefix, plen);
+    memcpy(w->names + w->names_size + plen, name, nlen + 1);
+    w->names_size = need;
+    return true;
 }
 
-/* Compute the size of the .shstrtab section (names of all sections) */
-static size_t shstrtab_size(const SectionInfo *sections, int count) {
-    size_t total = 1;  /* first byte is always NUL */
-    for (int i = 0; i < count; i++) {
-        total += strlen(sections[i].name) + 1;
+/*
+ * Orders slots by their strings read backwards, longest first among equal
+ * tails, so every string directly follows the strings it is a suffix of.
+ */
+static int compare_tails(const void *a, const void *b) {
+    const StringSlot *x = a, *y = b;
+    size_t i = x->length, j = y->length;
+    while (i && j) {
+        unsigned char cx = (unsigned char)x->string[--i];
+        unsigned char cy = (unsigned char)y->string[--j];
+        if (cx != cy) return cx < cy ? 1 : -1;
     }
-    return total;
+    return i ? -1 : j ? 1 : 0;
 }
 
-/* Compute the size of the .strtab section (symbol names) */
-static size_t strtab_size(const SymbolInfo *syms, int count) {
+/*
+ * Lay out a string table for the slots and store each slot's offset.  Equal
+ * names share one copy and a name that ends another (".text" of
+ * ".rela.text") points into its tail.  Returns the table, with its size in
+ * *size, or NULL when out of memory.
+ */
+static char *build_string_table(StringSlot *slots, uint32_t count, uint64_t *size) {
+    qsort(slots, count, sizeof(StringSlot), compare_tails);
     size_t total = 1;
-    for (int i = 0; i < count; i++) {
-        total += strlen(syms[i].name) + 1;
+    for (uint32_t i = 0; i < count; i++) total += slots[i].length + 1;
+    char *table = malloc(total);
+    if (!table) return NULL;
+    table[0] = '\0';
+    size_t used = 1;
+    const StringSlot *kept = NULL;
+    uint32_t kept_offset = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        StringSlot *s = &slots[i];
+        if (s->length == 0) {
+            *s->offset = 0;
+        } else if (kept && s->length <= kept->length &&
+                   memcmp(kept->string + kept->length - s->length, s->string, s->length) == 0) {
+            *s->offset = kept_offset + (uint32_t)(kept->length - s->length);
+        } else {
+            memcpy(table + used, s->string, s->length + 1);
+            *s->offset = (uint32_t)used;
+            kept = s;
+            kept_offset = (uint32_t)used;
+            used += s->length + 1;
+        }
     }
-    return total;
+    *size = used;
+    return table;
 }
 
-/* Write the .shstrtab section and fill name_offset in each SectionInfo */
-static int write_shstrtab(FILE *f, SectionInfo *sections, int count,
-                          size_t *sizes, Build32_Off current_offset) {
-    /* First byte must be '\0' */
-    if (fputc('\0', f) == EOF) return -1;
-    size_t offset = 1;
-
-    for (int i = 0; i < count; i++) {
-        sections[i].name_offset = (Build32_Word)offset;
-        size_t len = strlen(sections[i].name) + 1;
-        if (fwrite(sections[i].name, 1, len, f) != len) return -1;
-        offset += len;
-    }
-    return 0;
+/* Helpers: store little-endian values, returning the next byte */
+static uint8_t *put16(uint8_t *p, uint16_t val) {
+    p[0] = val & 0xFF;
+    p[1] = (val >> 8) & 0xFF;
+    return p + 2;
 }
 
-/* Write the .strtab section and fill name_offset in each SymbolInfo */
-static int write_strtab(FILE *f, SymbolInfo *syms, int count) {
-    if (fputc('\0', f) == EOF) return -1;
-    size_t offset = 1;
+static uint8_t *put32(uint8_t *p, uint32_t val) {
+    for (int i = 0; i < 4; i++) p[i] = (val >> (8 * i)) & 0xFF;
+    return p + 4;
+}
 
-    for (int i = 0; i < count; i++) {
-        syms[i].name_offset = (Build32_Word)offset;
-        size_t len = strlen(syms[i].name) + 1;
-        if (fwrite(syms[i].name, 1, len, f) != len) return -1;
-        offset += len;
-    }
-    return 0;
+static uint8_t *put64(uint8_t *p, uint64_t val) {
+    for (int i = 0; i < 8; i++) p[i] = (val >> (8 * i)) & 0xFF;
+    return p + 8;
 }
 
-/* Write all section data blobs (except .shstrtab and .strtab) */
-static int write_section_data(FILE *f, SectionInfo *sections, int count,
-                              size_t *file_offsets) {
-    for (int i = 0; i < count; i++) {
-        /* For SHT_NOBITS (.bss) we write nothing, but the offset still points
-         * past the end of the previous section; file_offsets[i] already set. */
-        if (sections[i].type == SHT_PROGBITS && sections[i].data != NULL) {
-            if (fwrite(sections[i].data, 1, sections[i].data_size, f) != sections[i].data_size)
-                return -1;
-        }
-    }
-    return 0;
+/* An address, offset or size field: a word in ELF32, a xword in ELF64 */
+static uint8_t *put_word(const BuildObjectWriter *w, uint8_t *p, uint64_t val) {
+    return w->is64 ? put64(p, val) : put32(p, (uint32_t)val);
+}
+
+static uint64_t align_up(uint64_t offset, uint64_t alignment) {
+    return alignment > 1 ? (offset + alignment - 1) & ~(alignment - 1) : offset;
 }
 
 /* Write a single section header */
-static int write_section_header(FILE *f, const SectionInfo *sec) {
-    if (write_le32(f, sec->name_offset) != 0) return -1;
-    if (write_le32(f, sec->type) != 0) return -1;
-    if (write_le32(f, sec->flags) != 0) return -1;
-    if (write_le32(f, sec->sh_addr) != 0) return -1;      /* address 0 in relocatable */
-    if (write_le32(f, (uint32_t)sec->file_offset) != 0) return -1;
-    if (write_le32(f, (uint32_t)sec->data_size) != 0) return -1;
-    /* sh_link and sh_info are 0 for most sections, except symtab and strtab */
-    if (write_le32(f, 0) != 0) return -1;
-    if (write_le32(f, 0) != 0) return -1;
-    if (write_le32(f, sec->alignment) != 0) return -1;
-    if (write_le32(f, 0) != 0) return -1;  /* sh_entsize */
-    return 0;
+static uint8_t *put_section_header(const BuildObjectWriter *w, uint8_t *p, const SectionInfo *sec) {
+    p = put32(p, sec->name_offset);
+    p = put32(p, sec->type);
+    p = put_word(w, p, sec->flags);
+    p = put_word(w, p, 0);                          /* address 0 in relocatable */
+    p = put_word(w, p, sec->file_offset);
+    p = put_word(w, p, sec->size);
+    p = put32(p, sec->link);
+    p = put32(p, sec->info);
+    p = put_word(w, p, sec->alignment);
+    return put_word(w, p, sec->entsize);
 }
 
 /* Write one symbol table entry */
-static int write_symbol(FILE *f, const SymbolInfo *sym) {
-    if (write_le32(f, sym->name_offset) != 0) return -1;
-    if (write_le32(f, sym->value) != 0) return -1;
-    if (write_le32(f, sym->size) != 0) return -1;
-    unsigned char info = (sym->bind << 4) | (sym->type & 0xF);
-    if (fputc(info, f) == EOF) return -1;
-    if (fputc(0, f) == EOF) return -1;     /* st_other */
-    if (write_le16(f, sym->shndx) != 0) return -1;
-    return 0;
+static uint8_t *put_symbol(const BuildObjectWriter *w, uint8_t *p, const SymbolInfo *sym) {
+    unsigned char info = (unsigned char)((sym->bind << 4) | (sym->type & 0xF));
+    p = put32(p, sym->name_offset);
+    if (!w->is64) {
+        p = put32(p, (uint32_t)sym->value);
+        p = put32(p, (uint32_t)sym->size);
+    }
+    *p++ = info;
+    *p++ = 0;                                       /* st_other */
+    p = put16(p, sym->shndx);
+    if (w->is64) {
+        p = put64(p, sym->value);
+        p = put64(p, sym->size);
+    }
+    return p;
+}
+
+/* Write one relocation with addend; symbol is its final index */
+static uint8_t *put_relocation(const BuildObjectWriter *w, uint8_t *p, const RelocationInfo *rel,
+                               uint32_t symbol) {
+    if (w->is64) {
+        p = put64(p, rel->offset);
+        p = put64(p, ((uint64_t)symbol << 32) | rel->type);
+        return put64(p, (uint64_t)rel->addend);
+    }
+    p = put32(p, (uint32_t)rel->offset);
+    p = put32(p, (symbol << 8) | (rel->type & 0xFF));
+    return put32(p, (uint32_t)(int32_t)rel->addend);
 }
 
 /* Public API implementations */
 
-BuildObjectWriter* build__create(const char *output_path) {
+BuildObjectWriter* build__create(const char *output_path, BuildMachine machine) {
     BuildObjectWriter *w = calloc(1, sizeof(BuildObjectWriter));
     if (!w) return NULL;
     w->output_path = output_path;
+    switch (machine) {
+    case BUILD_MACHINE_I386:    w->machine = EM_386; break;
+    case BUILD_MACHINE_X86_64:  w->machine = EM_X86_64; w->is64 = true; break;
+    case BUILD_MACHINE_AARCH64: w->machine = EM_AARCH64; w->is64 = true; break;
+    default:
+        free(w);
+        return NULL;
+    }
 
     /* The first symbol (index 0) is always the undefined null symbol.
      * It is required by the BUILD standard. */
-    w->symbols[0].name[0] = '\0';
-    w->symbols[0].name_offset = 0;
-    w->symbols[0].value = 0;
-    w->symbols[0].size = 0;
-    w->symbols[0].bind = STB_LOCAL;
-    w->symbols[0].type = STT_NOTYPE;
-    w->symbols[0].shndx = SHN_UNDEF;
-    w->symbol_count = 1;
-
+    BuildSymbol null_symbol = { "", 0, 0, SHN_UNDEF, SYMBOL_LOCAL };
+    if (build__add_symbol(w, &null_symbol) != 0) {
+        build__destroy(w);
+        return NULL;
+    }
     return w;
 }
 
-uint8_t build__add_section(BuildObjectWriter *w, SectionType type,
-                         const char *name, const uint8_t *data,
-                         size_t data_size, uint32_t alignment) {
-    if (!w || w->section_count >= BUILD_WRITER_MAX_SECTIONS) return 0;
-    if (!name || strlen(name) > 31) return 0;
+uint32_t build__add_section(BuildObjectWriter *w, SectionType type,
+                            const char *name, const uint8_t *data,
+                            size_t data_size, uint32_t alignment) {
+    if (!w || !name) return 0;
+    /* Leave room for the null section, the tables and the reserved indices */
+    if (w->section_count + 4 >= SHN_LORESERVE) return 0;
+    if (alignment & (alignment - 1)) return 0;
+    if (!w->is64 && data_size > UINT32_MAX) return 0;
+    if (!reserve((void **)&w->sections, &w->section_capacity, w->section_count, sizeof(SectionInfo)))
+        return 0;
 
     SectionInfo *sec = &w->sections[w->section_count];
-    strncpy(sec->name, name, sizeof(sec->name) - 1);
-    sec->name[sizeof(sec->name) - 1] = '\0';
-
+    memset(sec, 0, sizeof(*sec));
     switch (type) {
     case SECTION_TEXT:
         sec->type = SHT_PROGBITS;
@@ -285,223 +338,331 @@ uint8_t build__add_section(BuildObjectWriter *w, SectionType type,
     default:
         return 0;
     }
+    if (!add_name(w, "", name, &sec->name)) return 0;
 
-    sec->alignment = alignment;
-    sec->data_size = data_size;
-
-    /* For SHT_NOBITS we do not store any data */
-    if (sec->type == SHT_PROGBITS) {
-        sec->data = malloc(data_size);
-        if (!sec->data) return 0;
-        if (data) {
-            memcpy(sec->data, data, data_size);
-        } else {
-            /* If no data pointer is given, fill with zeros */
-            memset(sec->data, 0, data_size);
-        }
-    } else {
-        sec->data = NULL;
-    }
+    sec->alignment = alignment ? alignment : 1;
+    sec->size = data_size;
+    /* For SHT_NOBITS we do not store any data; without a pointer the
+     * section reads as zeros, which the sized file already holds. */
+    sec->data = sec->type == SHT_PROGBITS ? data : NULL;
 
     w->section_count++;
     /* Section index: add 1 because the null section at index 0 will be
      * created automatically when we write the section header table. */
-    return (uint8_t)(w->section_count);  /* first user section has index 1 */
+    return w->section_count;  /* first user section has index 1 */
 }
 
 int build__add_symbol(BuildObjectWriter *w, const BuildSymbol *sym) {
-    if (!w || w->symbol_count >= BUILD_WRITER_MAX_SYMBOLS) return -1;
-    if (!sym || !sym->name || strlen(sym->name) > 63) return -1;
+    if (!w || !sym || !sym->name) return -1;
+    if (sym->section_index > w->section_count) return -1;
+    if (!w->is64 && (sym->value > UINT32_MAX || sym->size > UINT32_MAX)) return -1;
+    if (w->symbol_count > INT32_MAX - 1) return -1;
+    if (!reserve((void **)&w->symbols, &w->symbol_capacity, w->symbol_count, sizeof(SymbolInfo)))
+        return -1;
 
     SymbolInfo *si = &w->symbols[w->symbol_count];
-    strncpy(si->name, sym->name, sizeof(si->name) - 1);
-    si->name[sizeof(si->name) - 1] = '\0';
+    if (!add_name(w, "", sym->name, &si->name)) return -1;
+    si->name_offset = 0;
     si->value = sym->value;
     si->size = sym->size;
     si->bind = (sym->binding == SYMBOL_GLOBAL) ? STB_GLOBAL : STB_LOCAL;
     /* Guess type: function if section is text, otherwise object.
      * A more sophisticated writer would let the caller specify it. */
-    if (sym->section_index > 0 && sym->section_index <= (uint8_t)w->section_count) {
+    if (sym->section_index > 0) {
         SectionInfo *sec = &w->sections[sym->section_index - 1];
         si->type = (sec->flags & SHF_EXECINSTR) ? STT_FUNC : STT_OBJECT;
     } else {
         si->type = STT_NOTYPE;
     }
-    si->shndx = sym->section_index;
+    si->shndx = (uint16_t)sym->section_index;
 
-    int idx = w->symbol_count;
-    w->symbol_count++;
-    return idx;
+    return (int)w->symbol_count++;
+}
+
+int build__add_relocation(BuildObjectWriter *w, uint32_t section_index,
+                          const BuildRelocation *rel) {
+    if (!w || !rel) return -1;
+    if (section_index == 0 || section_index > w->section_count) return -1;
+    if (rel->symbol < 0 || (uint32_t)rel->symbol >= w->symbol_count) return -1;
+    if (!w->is64 && (rel->offset > UINT32_MAX || rel->type > 0xFF ||
+                     rel->addend < INT32_MIN || rel->addend > INT32_MAX)) return -1;
+    if (!reserve((void **)&w->relocations, &w->relocation_capacity, w->relocation_count,
+                 sizeof(RelocationInfo)))
+        return -1;
+
+    RelocationInfo *ri = &w->relocations[w->relocation_count++];
+    ri->section = section_index;
+    ri->offset = rel->offset;
+    ri->symbol = (uint32_t)rel->symbol;
+    ri->type = rel->type;
+    ri->addend = rel->addend;
+    w->sections[section_index - 1].reloc_count++;
+    return 0;
 }
 
 void build__set_entry(BuildObjectWriter *w, const char *entry_name) {
-    if (w && entry_name) {
-        strncpy(w->entry_name, entry_name, sizeof(w->entry_name) - 1);
-        w->entry_name[sizeof(w->entry_name) - 1] = '\0';
+    if (w && entry_name && add_name(w, "", entry_name, &w->entry_name))
+        w->has_entry = true;
+}
+
+/* Append a .rela section after the user sections for every section that
+ * has relocations. Their sh_link is set once the symbol table's index is
+ * known. Returns false when out of memory. */
+static bool add_relocation_sections(BuildObjectWriter *w) {
+    uint32_t user_count = w->section_count;
+    for (uint32_t i = 0; i < user_count; i++) {
+        uint32_t count = w->sections[i].reloc_count;
+        if (count == 0) continue;
+        if (!reserve((void **)&w->sections, &w->section_capacity, w->section_count, sizeof(SectionInfo)))
+            return false;
+        SectionInfo *sec = &w->sections[w->section_count];
+        memset(sec, 0, sizeof(*sec));
+        if (!add_name(w, ".rela", w->names + w->sections[i].name, &sec->name)) return false;
+        sec->type = SHT_RELA;
+        sec->flags = SHF_INFO_LINK;
+        sec->entsize = w->is64 ? RELA64_SIZE : RELA32_SIZE;
+        sec->size = (uint64_t)count * sec->entsize;
+        sec->alignment = w->is64 ? 8 : 4;
+        sec->info = i + 1;
+        w->section_count++;
     }
+    return true;
 }
 
-int build__finalize(BuildObjectWriter *w) {
-    if (!w) return -1;
+/*
+ * Map the file at path sized to size bytes for writing, or fall back to a
+ * zeroed buffer written out with a single write() by finish_output().
+ */
+static uint8_t *open_output(const char *path, uint64_t size, int *fd, bool *mapped) {
+    *fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (*fd < 0) {
+        perror("build__finalize: open");
+        return NULL;
+    }
+    if (ftruncate(*fd, (off_t)size) == 0) {
+        void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+        if (map != MAP_FAILED) {
+            *mapped = true;
+            return map;
+        }
+    }
+    *mapped = false;
+    uint8_t *buffer = calloc(1, size);
+    if (!buffer) {
+        close(*fd);
+        return NULL;
+    }
+    return buffer;
+}
 
-    w->file = fopen(w->output_path, "wb");
-    if (!w->file) {
-        perror("build__finalize: fopen");
-        free(w);
-        return -1;
+static int finish_output(uint8_t *image, uint64_t size, int fd, bool mapped) {
+    int result = 0;
+    if (mapped) {
+        if (munmap(image, size) != 0) result = -1;
+    } else {
+        const uint8_t *p = image;
+        uint64_t left = size;
+        while (left > 0) {
+            ssize_t n = write(fd, p, left);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                perror("build__finalize: write");
+                result = -1;
+                break;
+            }
+            p += n;
+            left -= (uint64_t)n;
+        }
+        free(image);
     }
+    if (close(fd) != 0) result = -1;
+    return result;
+}
+
+int build__finalize(BuildObjectWriter *w) {
+    if (!w) return -1;
+    int result = -1;
+    uint32_t *order = NULL;
+    StringSlot *slots = NULL;
+    char *strtab = NULL, *shstrtab = NULL;
 
-    /* The number of section headers includes:
+    /* The section header table holds:
      *   - the mandatory null section (index 0)
      *   - one for each user section
-     *   - .shstrtab
-     *   - .symtab
-     *   - .strtab
-     * So total sections = 1 (null) + user_sections + 3.
+     *   - one .rela section for each user section with relocations
+     *   - .symtab, .strtab and .shstrtab
      */
-    int user_count = w->section_count;
-    int total_sections = 1 + user_count + 3;  /* null, user, shstrtab, symtab, strtab */
-    int shstrtab_index = 1 + user_count;      /* .shstrtab section index */
-    int symtab_index   = 1 + user_count + 1;  /* .symtab */
-    int strtab_index   = 1 + user_count + 2;  /* .strtab */
+    if (!add_relocation_sections(w)) goto done;
+    uint32_t table_count = w->section_count;
+    uint32_t symtab_index   = 1 + table_count;
+    uint32_t strtab_index   = 1 + table_count + 1;
+    uint32_t shstrtab_index = 1 + table_count + 2;
+    uint32_t total_sections = 1 + table_count + 3;
+    if (total_sections >= SHN_LORESERVE) goto done;
 
-    /* Build dummy sections for the special string and symbol tables */
     SectionInfo special[3];
     memset(special, 0, sizeof(special));
-    strcpy(special[0].name, ".shstrtab");
-    special[0].type = SHT_STRTAB;
-    special[0].flags = 0;
-    special[0].data_size = shstrtab_size(w->sections, user_count);
-    special[0].alignment = 1;
-
-    strcpy(special[1].name, ".symtab");
-    special[1].type = SHT_SYMTAB;
-    special[1].flags = 0;
-    special[1].data_size = w->symbol_count * sizeof(Build32_Sym);
-    special[1].alignment = 4;
-    special[1].sh_link = strtab_index;  /* link to string table for symbols */
-
-    strcpy(special[2].name, ".strtab");
-    special[2].type = SHT_STRTAB;
-    special[2].flags = 0;
-    special[2].data_size = strtab_size(w->symbols, w->symbol_count);
-    special[2].alignment = 1;
+    if (!add_name(w, "", ".symtab", &special[0].name) ||
+        !add_name(w, "", ".strtab", &special[1].name) ||
+        !add_name(w, "", ".shstrtab", &special[2].name)) goto done;
+
+    /* Locals come first in the symbol table; order[] maps the index a
+     * symbol was added at to its place, keeping the order of each kind. */
+    order = malloc((size_t)w->symbol_count * sizeof(uint32_t));
+    slots = malloc(((size_t)w->symbol_count + total_sections) * sizeof(StringSlot));
+    if (!order || !slots) goto done;
+    uint32_t first_global = 0;
+    for (uint32_t i = 0; i < w->symbol_count; i++)
+        if (w->symbols[i].bind == STB_LOCAL) order[i] = first_global++;
+    uint32_t next_global = first_global;
+    for (uint32_t i = 0; i < w->symbol_count; i++)
+        if (w->symbols[i].bind != STB_LOCAL) order[i] = next_global++;
+
+    /* String tables with shared tails */
+    for (uint32_t i = 0; i < w->symbol_count; i++) {
+        const char *name = w->names + w->symbols[i].name;
+        slots[i] = (StringSlot){ name, strlen(name), &w->symbols[i].name_offset };
+    }
+    uint64_t strtab_size, shstrtab_size;
+    strtab = build_string_table(slots, w->symbol_count, &strtab_size);
+    if (!strtab) goto done;
+    uint32_t slot_count = 0;
+    for (uint32_t i = 0; i < table_count; i++) {
+        const char *name = w->names + w->sections[i].name;
+        slots[slot_count++] = (StringSlot){ name, strlen(name), &w->sections[i].name_offset };
+    }
+    for (int i = 0; i < 3; i++) {
+        const char *name = w->names + special[i].name;
+        slots[slot_count++] = (StringSlot){ name, strlen(name), &special[i].name_offset };
+    }
+    shstrtab = build_string_table(slots, slot_count, &shstrtab_size);
+    if (!shstrtab) goto done;
 
     /* Plan file layout:
      * 1. BUILD header
-     * 2. Section data (user sections in order, then .shstrtab, .symtab, .strtab)
+     * 2. Section data (user sections, .rela sections, .symtab, .strtab,
+     *    .shstrtab), each at its alignment
      * 3. Section header table at the end.
-     * We need to calculate file offsets for each section.
      */
-    /* Current offset after BUILD header */
-    size_t current_offset = sizeof(Build32_Ehdr);
-
-    /* For each user section, record its file offset, then advance */
-    for (int i = 0; i < user_count; i++) {
-        w->sections[i].file_offset = current_offset;
-        /* For SHT_NOBITS no data is written, but we still reserve no space */
-        if (w->sections[i].type == SHT_PROGBITS)
-            current_offset += w->sections[i].data_size;
+    uint32_t word = w->is64 ? 8 : 4;
+    uint64_t offset = w->is64 ? EHDR64_SIZE : EHDR32_SIZE;
+    for (uint32_t i = 0; i < table_count; i++) {
+        SectionInfo *sec = &w->sections[i];
+        if (sec->type == SHT_RELA) sec->link = symtab_index;
+        /* For SHT_NOBITS no data is written and no space reserved */
+        if (sec->type == SHT_NOBITS) {
+            sec->file_offset = offset;
+            continue;
+        }
+        offset = align_up(offset, sec->alignment);
+        sec->file_offset = offset;
+        offset += sec->size;
     }
 
-    /* Now the three special sections */
-    special[0].file_offset = current_offset;
-    current_offset += special[0].data_size;  /* .shstrtab data */
-    special[1].file_offset = current_offset;
-    current_offset += special[1].data_size;  /* .symtab data */
-    special[2].file_offset = current_offset;
-    current_offset += special[2].data_size;  /* .strtab data */
+    special[0].type = SHT_SYMTAB;
+    special[0].entsize = w->is64 ? SYM64_SIZE : SYM32_SIZE;
+    special[0].size = (uint64_t)w->symbol_count * special[0].entsize;
+    special[0].alignment = word;
+    special[0].link = strtab_index;     /* link to string table for symbols */
+    special[0].info = first_global;     /* one greater than the last local */
+    special[1].type = SHT_STRTAB;
+    special[1].size = strtab_size;
+    special[1].alignment = 1;
+    special[2].type = SHT_STRTAB;
+    special[2].size = shstrtab_size;
+    special[2].alignment = 1;
+    for (int i = 0; i < 3; i++) {
+        offset = align_up(offset, special[i].alignment);
+        special[i].file_offset = offset;
+        offset += special[i].size;
+    }
 
     /* Section header table will be written at this offset */
-    size_t shoff = current_offset;
+    uint64_t shoff = align_up(offset, word);
+    uint32_t shentsize = w->is64 ? SHDR64_SIZE : SHDR32_SIZE;
+    uint64_t file_size = shoff + (uint64_t)total_sections * shentsize;
+    if (!w->is64 && file_size > UINT32_MAX) goto done;
 
     /* Determine entry point value: look for the symbol named as entry */
-    Build32_Addr entry = 0;
-    if (w->entry_name[0] != '\0') {
-        for (int i = 0; i < w->symbol_count; i++) {
-            if (strcmp(w->symbols[i].name, w->entry_name) == 0) {
+    uint64_t entry = 0;
+    if (w->has_entry) {
+        for (uint32_t i = 0; i < w->symbol_count; i++) {
+            if (strcmp(w->names + w->symbols[i].name, w->names + w->entry_name) == 0) {
                 entry = w->symbols[i].value;
                 break;
             }
         }
     }
 
-    /* Write BUILD header */
-    if (write_ident(w->file) != 0) goto fail;
-    if (write_le16(w->file, ET_REL) != 0) goto fail;  /* relocatable */
-    if (write_le16(w->file, EM_386) != 0) goto fail;
-    if (write_le32(w->file, EV_CURRENT) != 0) goto fail;
-    if (write_le32(w->file, entry) != 0) goto fail;   /* e_entry */
-    if (write_le32(w->file, 0) != 0) goto fail;       /* e_phoff (no program header) */
-    if (write_le32(w->file, (uint32_t)shoff) != 0) goto fail; /* e_shoff */
-    if (write_le32(w->file, 0) != 0) goto fail;       /* e_flags */
-    if (write_le16(w->file, sizeof(Build32_Ehdr)) != 0) goto fail; /* e_ehsize */
-    if (write_le16(w->file, 0) != 0) goto fail;       /* e_phentsize */
-    if (write_le16(w->file, 0) != 0) goto fail;       /* e_phnum */
-    if (write_le16(w->file, sizeof(Build32_Shdr)) != 0) goto fail; /* e_shentsize */
-    if (write_le16(w->file, (Build32_Half)total_sections) != 0) goto fail; /* e_shnum */
-    if (write_le16(w->file, (Build32_Half)shstrtab_index) != 0) goto fail; /* e_shstrndx */
-
-    /* Write user section data */
-    if (write_section_data(w->file, w->sections, user_count, NULL) != 0) goto fail;
-
-    /* Write .shstrtab data */
-    if (write_shstrtab(w->file, w->sections, user_count, NULL, 0) != 0) goto fail;
-
-    /* Write .symtab data: each symbol as Build32_Sym */
-    for (int i = 0; i < w->symbol_count; i++) {
-        if (write_symbol(w->file, &w->symbols[i]) != 0) goto fail;
-    }
-
-    /* Write .strtab data */
-    if (write_strtab(w->file, w->symbols, w->symbol_count) != 0) goto fail;
-
-    /* Now write the section header table:
-     * First the null section header (all zeros) */
-    Build32_Shdr null_shdr;
-    memset(&null_shdr, 0, sizeof(null_shdr));
-    if (fwrite(&null_shdr, sizeof(null_shdr), 1, w->file) != 1) goto fail;
-
-    /* Then user section headers. Their name_offset is already set by
-     * write_shstrtab() (they point into .shstrtab). */
-    for (int i = 0; i < user_count; i++) {
-        if (write_section_header(w->file, &w->sections[i]) != 0) goto fail;
-    }
-
-    /* Headers for .shstrtab, .symtab, .strtab */
-    /* .shstrtab */
-    if (write_section_header(w->file, &special[0]) != 0) goto fail;
-    /* .symtab: need to set sh_link and sh_info properly.
-     * sh_link points to the associated string table.
-     * sh_info = index of the first non-local symbol (one greater than
-     * the number of local symbols). */
-    {
-        /* Count local symbols (including the null symbol if local) */
-        int first_global = 0;
-        while (first_global < w->symbol_count &&
-               w->symbols[first_global].bind == STB_LOCAL)
-            first_global++;
-        special[1].sh_link = strtab_index;
-        special[1].sh_info = first_global;
-        special[1].sh_entsize = sizeof(Build32_Sym);  /* entsize for symtab */
-        if (write_section_header(w->file, &special[1]) != 0) goto fail;
+    int fd;
+    bool mapped;
+    uint8_t *image = open_output(w->output_path, file_size, &fd, &mapped);
+    if (!image) goto done;
+
+    /* BUILD header */
+    uint8_t *p = image;
+    memcpy(p, "\x7F" "ELF", 4);
+    p[4] = w->is64 ? BUILDCLASS64 : BUILDCLASS32;
+    p[5] = BUILDDATA2LSB;
+    p[6] = EV_CURRENT;
+    /* OS/ABI System V, ABI version 0 and padding stay zero */
+    p += 16;
+    p = put16(p, ET_REL);                           /* relocatable */
+    p = put16(p, w->machine);
+    p = put32(p, EV_CURRENT);
+    p = put_word(w, p, entry);                      /* e_entry */
+    p = put_word(w, p, 0);                          /* e_phoff (no program header) */
+    p = put_word(w, p, shoff);                      /* e_shoff */
+    p = put32(p, 0);                                /* e_flags */
+    p = put16(p, w->is64 ? EHDR64_SIZE : EHDR32_SIZE);
+    p = put16(p, 0);                                /* e_phentsize */
+    p = put16(p, 0);                                /* e_phnum */
+    p = put16(p, (uint16_t)shentsize);
+    p = put16(p, (uint16_t)total_sections);
+    put16(p, (uint16_t)shstrtab_index);
+
+    /* Section data; a section without data reads as the zeros already there */
+    for (uint32_t i = 0; i < table_count; i++) {
+        const SectionInfo *sec = &w->sections[i];
+        if (sec->type == SHT_PROGBITS && sec->data)
+            memcpy(image + sec->file_offset, sec->data, sec->size);
     }
-    /* .strtab */
-    if (write_section_header(w->file, &special[2]) != 0) goto fail;
-
-    fclose(w->file);
-    /* Free any allocated section data */
-    for (int i = 0; i < user_count; i++) {
-        free(w->sections[i].data);
+    for (uint32_t i = 0; i < table_count; i++) {
+        const SectionInfo *sec = &w->sections[i];
+        if (sec->type != SHT_RELA) continue;
+        p = image + sec->file_offset;
+        for (uint32_t r = 0; r < w->relocation_count; r++) {
+            const RelocationInfo *ri = &w->relocations[r];
+            if (ri->section == sec->info) p = put_relocation(w, p, ri, order[ri->symbol]);
+        }
     }
-    free(w);
-    return 0;
+    for (uint32_t i = 0; i < w->symbol_count; i++)
+        put_symbol(w, image + special[0].file_offset + (uint64_t)order[i] * special[0].entsize,
+                   &w->symbols[i]);
+    memcpy(image + special[1].file_offset, strtab, strtab_size);
+    memcpy(image + special[2].file_offset, shstrtab, shstrtab_size);
+
+    /* Section headers; the null section header is all zeros */
+    p = image + shoff + shentsize;
+    for (uint32_t i = 0; i < table_count; i++) p = put_section_header(w, p, &w->sections[i]);
+    for (int i = 0; i < 3; i++) p = put_section_header(w, p, &special[i]);
+
+    result = finish_output(image, file_size, fd, mapped);
+
+done:
+    free(order);
+    free(slots);
+    free(strtab);
+    free(shstrtab);
+    build__destroy(w);
+    return result;
+}
 
-fail:
-    fclose(w->file);
-    for (int i = 0; i < user_count; i++) {
-        free(w->sections[i].data);
-    }
+void build__destroy(BuildObjectWriter *w) {
+    if (!w) return;
+    free(w->sections);
+    free(w->symbols);
+    free(w->relocations);
+    free(w->names);
     free(w);
-    return -1;
 }
@@ -7,10 +7,13 @@
 /* Opaque handle to an object file under construction */
 typedef struct BuildObjectWriter BuildObjectWriter;
 
-/* Maximum number of sections we support in a single object */
-#define BUILD_WRITER_MAX_SECTIONS 16
-/* Maximum number of symbols */
-#define BUILD_WRITER_MAX_SYMBOLS  256
+/* Target machine; selects the ELF class and e_machine.
+ * i386 objects are ELF32, the others ELF64. */
+typedef enum {
+    BUILD_MACHINE_I386,
+    BUILD_MACHINE_X86_64,
+    BUILD_MACHINE_AARCH64
+} BuildMachine;
 
 /* Section types */
 typedef enum {
@@ -28,37 +31,57 @@ typedef enum {
 /* Description of a single symbol to be placed in the symbol table */
 typedef struct {
     const char *name;        /* symbol name (must be null-terminated) */
-    uint32_t    value;       /* address or offset within the section */
-    uint32_t    size;        /* size of the object in bytes */
-    uint8_t     section_index; /* index of the section (0 = UNDEF) */
+    uint64_t    value;       /* address or offset within the section */
+    uint64_t    size;        /* size of the object in bytes */
+    uint32_t    section_index; /* index of the section (0 = UNDEF) */
     SymbolBinding binding;   /* local or global */
 } BuildSymbol;
 
-/* Create a new object writer instance. The file will be written to
- * output_path when build__finalize() is called. Returns NULL on error.
+/* A field of a section the linker patches with the value of a symbol */
+typedef struct {
+    uint64_t offset;         /* of the field within the section */
+    int      symbol;         /* index returned by build__add_symbol() */
+    uint32_t type;           /* machine-specific relocation type */
+    int64_t  addend;         /* constant added to the symbol's value */
+} BuildRelocation;
+
+/* Create a new object writer instance for the given machine. The file
+ * will be written to output_path when build__finalize() is called.
+ * Returns NULL on error.
  */
-BuildObjectWriter* build__create(const char *output_path);
+BuildObjectWriter* build__create(const char *output_path, BuildMachine machine);
 
 /* Add a new section to the object file.
  * type      - kind of section (text, data, bss)
  * name      - section name (e.g., ".text", ".data", ".bss"); will be copied
- * data      - pointer to the raw bytes for the section (NULL for .bss)
+ * data      - pointer to the raw bytes for the section (NULL for .bss or
+ *             for zeros); not copied, it must stay valid until
+ *             build__finalize() or build__destroy()
  * data_size - number of bytes (section size); for .bss this is the
  *             amount of zero-initialized space required
- * alignment - power-of-two alignment (e.g., 4 means 16-byte aligned)
+ * alignment - alignment in bytes, a power of two (e.g., 16)
  * Returns the section index (1-based) that can be used in symbol
  * definitions, or 0 on error.
  */
-uint8_t build__add_section(BuildObjectWriter *w, SectionType type,
-                         const char *name, const uint8_t *data,
-                         size_t data_size, uint32_t alignment);
+uint32_t build__add_section(BuildObjectWriter *w, SectionType type,
+                            const char *name, const uint8_t *data,
+                            size_t data_size, uint32_t alignment);
 
-/* Add a symbol definition to the symbol table.
- * Returns the symbol index (0-based) in the symbol table, or -1 on error.
- * The first symbol (index 0) is always the undefined symbol placeholder.
+/* Add a symbol definition to the symbol table. Symbols may be added in
+ * any order; locals are written before globals.
+ * Returns the symbol index (0-based) to use in relocations, or -1 on
+ * error. The first symbol (index 0) is always the undefined symbol
+ * placeholder.
  */
 int build__add_symbol(BuildObjectWriter *w, const BuildSymbol *sym);
 
+/* Add a relocation against the section with the given index. Relocations
+ * of a section go to a .rela section of their own.
+ * Returns 0 on success, -1 on error.
+ */
+int build__add_relocation(BuildObjectWriter *w, uint32_t section_index,
+                          const BuildRelocation *rel);
+
 /* Set the entry point symbol name. If non-NULL, the symbol's value
  * will be used as the BUILD entry point. This is optional.
  */
@@ -70,4 +93,9 @@ void build__set_entry(BuildObjectWriter *w, const char *entry_name);
  */
 int build__finalize(BuildObjectWriter *w);
 
+/* Free a writer without writing anything, e.g. after an error while
+ * adding sections, symbols or relocations. Accepts NULL.
+ */
+void build__destroy(BuildObjectWriter *w);
+
 #endif
@@ -0,0 +1,330 @@
+#include "aarch64.h"
+#include <stdarg.h>
+#include <string.h>
+
+const char *const aarch64__mnemonics[A64_OPCODE_COUNT] = {
+    [A64_MOV] = "mov", [A64_MOVZ] = "movz", [A64_MOVN] = "movn", [A64_MOVK] = "movk",
+    [A64_ADD] = "add", [A64_SUB] = "sub", [A64_ADD_LSL] = "add",
+    [A64_MUL] = "mul", [A64_MADD] = "madd", [A64_MSUB] = "msub", [A64_SDIV] = "sdiv",
+    [A64_AND] = "and", [A64_ORR] = "orr", [A64_EOR] = "eor",
+    [A64_LSLV] = "lsl", [A64_LSRV] = "lsr", [A64_ASRV] = "asr",
+    [A64_LSL] = "lsl", [A64_LSR] = "lsr", [A64_ASR] = "asr",
+    [A64_NEG] = "neg", [A64_MVN] = "mvn",
+    [A64_SXTB] = "sxtb", [A64_SXTH] = "sxth", [A64_SXTW] = "sxtw", [A64_UXTB] = "uxtb",
+    [A64_CMP] = "cmp", [A64_CMN] = "cmn", [A64_CSEL] = "csel", [A64_CSET] = "cset",
+    [A64_B] = "b", [A64_BCOND] = "b.", [A64_CBZ] = "cbz", [A64_CBNZ] = "cbnz",
+    [A64_BL] = "bl", [A64_RET] = "ret", [A64_SVC] = "svc",
+    [A64_LDR] = "ldr", [A64_LDRSB] = "ldrsb", [A64_LDRSH] = "ldrsh", [A64_LDRSW] = "ldrsw",
+    [A64_STR] = "str", [A64_STP_PRE] = "stp", [A64_LDP_POST] = "ldp",
+    [A64_ADRP] = "adrp", [A64_ADD_LO12] = "add", [A64_LEA] = "lea",
+    [A64_FMOV] = "fmov", [A64_FMOV_IMM] = "fmov",
+    [A64_FADD] = "fadd", [A64_FSUB] = "fsub", [A64_FMUL] = "fmul", [A64_FDIV] = "fdiv",
+    [A64_FNEG] = "fneg", [A64_FCMP] = "fcmp", [A64_FCSEL] = "fcsel",
+    [A64_SCVTF] = "scvtf", [A64_FCVTZS] = "fcvtzs", [A64_FCVT] = "fcvt",
+};
+
+/* x14-x17 stay out: they reload spilled operands and hold what frame
+ * lowering materializes.  x18 is the platform's, x29 and x30 the frame
+ * record's. */
+static const uint32_t allocatable_gprs[] = {
+    A64_X(0), A64_X(1), A64_X(2), A64_X(3), A64_X(4), A64_X(5), A64_X(6), A64_X(7),
+    A64_X(8), A64_X(9), A64_X(10), A64_X(11), A64_X(12), A64_X(13),
+    A64_X(19), A64_X(20), A64_X(21), A64_X(22), A64_X(23), A64_X(24), A64_X(25), A64_X(26),
+    A64_X(27), A64_X(28)
+};
+static const uint32_t allocatable_fprs[] = {
+    A64_D(0), A64_D(1), A64_D(2), A64_D(3), A64_D(4), A64_D(5), A64_D(6), A64_D(7),
+    A64_D(16), A64_D(17), A64_D(18), A64_D(19), A64_D(20), A64_D(21), A64_D(22), A64_D(23),
+    A64_D(24), A64_D(25), A64_D(26), A64_D(27), A64_D(28),
+    A64_D(8), A64_D(9), A64_D(10), A64_D(11), A64_D(12), A64_D(13), A64_D(14), A64_D(15)
+};
+
+#define BIT(r) (UINT64_C(1) << (r))
+/* x19-x28, and the low halves of v8-v15. */
+#define CALLEE_SAVED (((BIT(29) - 1) & ~(BIT(19) - 1)) | (((BIT(16) - 1) & ~(BIT(8) - 1)) << MIR_FIRST_FPR))
+
+const CodegenTarget codegen__aarch64 = {
+    .name = "aarch64",
+    .allocatable = { allocatable_gprs, allocatable_fprs },
+    .allocatable_count = { sizeof allocatable_gprs / sizeof *allocatable_gprs,
+                           sizeof allocatable_fprs / sizeof *allocatable_fprs },
+    .scratch = { { A64_X16, A64_X17, A64_X14 }, { A64_D(29), A64_D(30), A64_D(31) } },
+    .scratch_count = { 3, 3 },
+    /* x0-x18 and the link register; every FPR but v8-v15. */
+    .caller_saved = ((BIT(19) - 1) | BIT(A64_X30)) |
+                    ((~UINT64_C(0) << MIR_FIRST_FPR) & ~CALLEE_SAVED),
+    .select = aarch64__select,
+    .spill = aarch64__spill,
+    .address = aarch64__address,
+    .rematerialize = aarch64__rematerialize,
+    .lower_frame = aarch64__lower_frame,
+    .print_header = aarch64__print_header,
+    .print_function = aarch64__print_function,
+    .assemble = aarch64__assemble,
+    .machine = BUILD_MACHINE_AARCH64,
+};
+
+/* ------------------------------------------------------------- immediates */
+
+uint32_t aarch64__imm_parts(uint64_t value, A64ImmPart parts[4]) {
+    uint32_t zeros = 0, ones = 0;
+    for (uint32_t h = 0; h < 4; h++) {
+        uint16_t half = (uint16_t)(value >> (16 * h));
+        zeros += half == 0;
+        ones += half == 0xffff;
+    }
+    /* movn when more halves are all ones: they then come for free. */
+    bool inverted = ones > zeros;
+    uint16_t skip = inverted ? 0xffff : 0;
+    uint32_t n = 0;
+    for (uint32_t h = 0; h < 4; h++) {
+        uint16_t half = (uint16_t)(value >> (16 * h));
+        if (half == skip) continue;
+        if (n == 0) parts[n++] = (A64ImmPart){ inverted ? A64_MOVN : A64_MOVZ, inverted ? (uint16_t)~half : half, (uint8_t)(16 * h) };
+        else parts[n++] = (A64ImmPart){ A64_MOVK, half, (uint8_t)(16 * h) };
+    }
+    if (n == 0) parts[n++] = (A64ImmPart){ inverted ? A64_MOVN : A64_MOVZ, 0, 0 };
+    return n;
+}
+
+bool aarch64__logical_imm(uint64_t value, uint32_t *field) {
+    if (value == 0 || value == ~UINT64_C(0)) return false;
+    /* The smallest element the value repeats. */
+    uint32_t size = 64;
+    while (size > 2) {
+        uint32_t half = size / 2;
+        uint64_t mask = (UINT64_C(1) << half) - 1;
+        if ((value & mask) != ((value >> half) & mask)) break;
+        size = half;
+    }
+    uint64_t mask = size == 64 ? ~UINT64_C(0) : (UINT64_C(1) << size) - 1;
+    uint64_t elt = value & mask;
+    uint32_t ones = (uint32_t)__builtin_popcountll(elt);
+    uint64_t run = (UINT64_C(1) << ones) - 1;
+    /* A run of ones, rotated. */
+    for (uint32_t r = 0; r < size; r++) {
+        uint64_t rotated = r ? ((elt >> r) | (elt << (size - r))) & mask : elt;
+        if (rotated != run) continue;
+        uint32_t immr = (size - r) % size;
+        uint32_t imms = ((~(size - 1) << 1) & 0x3f) | (ones - 1);
+        *field = (size == 64 ? 1u << 12 : 0) | immr << 6 | imms;
+        return true;
+    }
+    return false;
+}
+
+bool aarch64__fp_imm(double value, uint32_t *field) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    if (bits & ((UINT64_C(1) << 48) - 1)) return false;
+    uint32_t exp = (uint32_t)(bits >> 52) & 0x7ff;
+    uint32_t b = (exp >> 9) & 1;
+    /* The exponent is NOT(b):b x8:cd. */
+    if (((exp >> 10) & 1) == b) return false;
+    if (((exp >> 2) & 0xff) != (b ? 0xffu : 0)) return false;
+    *field = (uint32_t)(bits >> 63) << 7 | b << 6 | (exp & 3) << 4 | ((uint32_t)(bits >> 48) & 0xf);
+    return true;
+}
+
+bool aarch64__offset_ok(int64_t disp, uint8_t size) {
+    if (disp >= -256 && disp <= 255) return true;
+    return disp >= 0 && disp % size == 0 && disp / size <= 4095;
+}
+
+/* ------------------------------------------------------------------ frame */
+
+static MirMem object_mem(uint32_t object) {
+    MirMem m = mir__mem_base(MIR_NO_REG, 0);
+    m.frame = object + 1;
+    return m;
+}
+
+static MirInst *make(MirFunction *mf, A64Opcode op, uint8_t count, ...) {
+    MirInst *inst = mir__inst_new(mf, op, count);
+    if (!inst) return NULL;
+    va_list ap;
+    va_start(ap, count);
+    for (uint8_t i = 0; i < count; i++) inst->ops[i] = va_arg(ap, MirOperand);
+    va_end(ap);
+    return inst;
+}
+
+MirInst *aarch64__spill(MirFunction *mf, uint32_t reg, uint32_t object, bool load) {
+    MirOperand r = mir__reg(reg, 8, load ? MIR_DEF : MIR_USE);
+    return make(mf, load ? A64_LDR : A64_STR, 2, r, mir__mem(object_mem(object), 8));
+}
+
+MirInst *aarch64__address(MirFunction *mf, uint32_t dst, const MirMem *mem) {
+    return make(mf, A64_LEA, 2, mir__reg(dst, 8, MIR_DEF), mir__mem(*mem, 8));
+}
+
+/* A constant of one movz or movn, an fmov immediate or the address
+ * of a frame object or symbol; none of them sets the flags. */
+MirInst *aarch64__rematerialize(MirFunction *mf, const MirInst *def, uint32_t reg) {
+    if (def->count < 2 || def->ops[0].kind != MIR_OPERAND_REG || def->ops[0].flags != MIR_DEF) return NULL;
+    switch ((A64Opcode)def->opcode) {
+        case A64_MOVZ: case A64_MOVN: case A64_FMOV_IMM:
+            break;
+        case A64_LEA:
+            if (def->ops[1].mem.base != MIR_NO_REG || def->ops[1].mem.index != MIR_NO_REG) return NULL;
+            break;
+        default:
+            return NULL;
+    }
+    MirInst *inst = mir__inst_new(mf, def->opcode, def->count);
+    if (!inst) return NULL;
+    memcpy(inst->ops, def->ops, def->count * sizeof(MirOperand));
+    inst->ops[0].reg = reg;
+    return inst;
+}
+
+static void note_saved(uint32_t *reg, uint8_t flags, void *ctx) {
+    MirFunction *mf = ctx;
+    if ((flags & MIR_DEF) && mir__is_preg(*reg) && (CALLEE_SAVED & BIT(*reg))) mf->saved_regs |= BIT(*reg);
+}
+
+/* Instructions go in before `at`, or at the end of the block. */
+typedef struct {
+    MirFunction *mf;
+    MirBlock    *mb;
+    MirInst     *at;
+} Cursor;
+
+static void put(Cursor *c, MirInst *inst) {
+    if (!inst) return;
+    if (c->at) mir__inst_insert_before(c->mb, c->at, inst);
+    else mir__inst_append(c->mb, inst);
+}
+
+static void put_imm(Cursor *c, uint32_t reg, int64_t value) {
+    A64ImmPart parts[4];
+    uint32_t n = aarch64__imm_parts((uint64_t)value, parts);
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t flags = parts[i].opcode == A64_MOVK ? MIR_USE | MIR_DEF : MIR_DEF;
+        put(c, make(c->mf, parts[i].opcode, 3, mir__reg(reg, 8, flags), mir__imm(parts[i].imm),
+                    mir__imm(parts[i].shift)));
+    }
+}
+
+/* dst = src + value, through the address temp where no immediate holds it. */
+static void put_add(Cursor *c, uint32_t dst, uint32_t src, int64_t value) {
+    if (value == 0) {
+        if (dst != src) put(c, make(c->mf, A64_MOV, 2, mir__reg(dst, 8, MIR_DEF), mir__reg(src, 8, MIR_USE)));
+        return;
+    }
+    if (value > -4096 && value < 4096) {
+        put(c, make(c->mf, value > 0 ? A64_ADD : A64_SUB, 3, mir__reg(dst, 8, MIR_DEF), mir__reg(src, 8, MIR_USE),
+                    mir__imm(value > 0 ? value : -value)));
+        return;
+    }
+    put_imm(c, A64_ADDR_TEMP, value);
+    put(c, make(c->mf, A64_ADD, 3, mir__reg(dst, 8, MIR_DEF), mir__reg(src, 8, MIR_USE),
+                mir__reg(A64_ADDR_TEMP, 8, MIR_USE)));
+}
+
+static uint8_t log2_scale(uint8_t scale) {
+    return scale >= 8 ? 3 : scale >= 4 ? 2 : scale >= 2 ? 1 : 0;
+}
+
+/* The instructions computing an address, in place of the lea. */
+static void expand_lea(Cursor *c, uint32_t dst, const MirMem *m) {
+    if (m->symbol) {
+        put(c, make(c->mf, A64_ADRP, 2, mir__reg(dst, 8, MIR_DEF), mir__symbol(m->symbol)));
+        put(c, make(c->mf, A64_ADD_LO12, 3, mir__reg(dst, 8, MIR_DEF), mir__reg(dst, 8, MIR_USE),
+                    mir__symbol(m->symbol)));
+        if (m->index != MIR_NO_REG)
+            put(c, make(c->mf, A64_ADD_LSL, 4, mir__reg(dst, 8, MIR_DEF), mir__reg(dst, 8, MIR_USE),
+                        mir__reg(m->index, 8, MIR_USE), mir__imm(log2_scale(m->scale))));
+        put_add(c, dst, dst, m->disp);
+        return;
+    }
+    if (m->index != MIR_NO_REG) {
+        put(c, make(c->mf, A64_ADD_LSL, 4, mir__reg(dst, 8, MIR_DEF), mir__reg(m->base, 8, MIR_USE),
+                    mir__reg(m->index, 8, MIR_USE), mir__imm(log2_scale(m->scale))));
+        put_add(c, dst, dst, m->disp);
+        return;
+    }
+    put_add(c, dst, m->base, m->disp);
+}
+
+/* Resolve frame objects and bring displacements no instruction holds
+ * into the address temp. */
+static void legalize(MirFunction *mf, MirBlock *mb, MirInst *inst) {
+    Cursor c = { mf, mb, inst };
+    for (uint8_t i = 0; i < inst->count; i++) {
+        MirOperand *op = &inst->ops[i];
+        if (op->kind != MIR_OPERAND_MEM) continue;
+        MirMem *m = &op->mem;
+        if (m->frame) {
+            m->disp += mf->objects[m->frame - 1].offset;
+            m->frame = 0;
+            if (m->base == MIR_NO_REG) m->base = A64_X29;
+        }
+        if (inst->opcode == A64_LEA || m->index != MIR_NO_REG || aarch64__offset_ok(m->disp, op->size)) continue;
+        put_imm(&c, A64_ADDR_TEMP, m->disp);
+        m->index = A64_ADDR_TEMP;
+        m->scale = 1;
+        m->disp = 0;
+    }
+    if (inst->opcode == A64_LEA) {
+        expand_lea(&c, inst->ops[0].reg, &inst->ops[1].mem);
+        mir__inst_remove(mb, inst);
+    }
+}
+
+/*
+ * Frame objects go below x29 in the order they were made, each at its
+ * alignment; the frame is rounded to 16 bytes so sp stays aligned.  The
+ * callee-saved registers the body writes get objects of their own, stored
+ * after the prologue and reloaded before each return, which then unwinds
+ * the frame record.
+ */
+void aarch64__lower_frame(MirFunction *mf) {
+    mf->saved_regs = 0;
+    for (uint32_t b = 0; b < mf->block_count; b++)
+        for (MirInst *inst = mf->blocks[b]->first; inst; inst = inst->next)
+            mir__inst_for_each_reg(inst, note_saved, mf);
+    uint32_t save_object[MIR_FIRST_VREG];
+    for (uint32_t r = 0; r < MIR_FIRST_VREG; r++)
+        if (mf->saved_regs & BIT(r)) save_object[r] = mir__frame_object(mf, 8, 8);
+    if (mf->oom) return;
+
+    uint64_t size = 0;
+    for (uint32_t i = 0; i < mf->object_count; i++) {
+        MirFrameObject *obj = &mf->objects[i];
+        size = (size + obj->size + obj->align - 1) & ~(uint64_t)(obj->align - 1);
+        obj->offset = -(int32_t)size;
+    }
+    mf->frame_size = (uint32_t)((size + 15) & ~UINT64_C(15));
+
+    for (uint32_t b = 0; b < mf->block_count; b++) {
+        MirBlock *mb = mf->blocks[b];
+        for (MirInst *inst = mb->first; inst; inst = inst->next) {
+            if (!(inst->flags & MIR_INST_RETURN)) continue;
+            Cursor c = { mf, mb, inst };
+            for (uint32_t r = 0; r < MIR_FIRST_VREG; r++)
+                if (mf->saved_regs & BIT(r))
+                    put(&c, make(mf, A64_LDR, 2, mir__reg(r, 8, MIR_DEF), mir__mem(object_mem(save_object[r]), 8)));
+            put(&c, make(mf, A64_MOV, 2, mir__reg(A64_SP, 8, MIR_DEF), mir__reg(A64_X29, 8, MIR_USE)));
+            put(&c, make(mf, A64_LDP_POST, 3, mir__reg(A64_X29, 8, MIR_DEF), mir__reg(A64_X30, 8, MIR_DEF),
+                         mir__imm(16)));
+        }
+    }
+
+    MirBlock *entry = mf->blocks[0];
+    Cursor c = { mf, entry, entry->first };
+    put(&c, make(mf, A64_STP_PRE, 3, mir__reg(A64_X29, 8, MIR_USE), mir__reg(A64_X30, 8, MIR_USE), mir__imm(-16)));
+    put(&c, make(mf, A64_MOV, 2, mir__reg(A64_X29, 8, MIR_DEF), mir__reg(A64_SP, 8, MIR_USE)));
+    if (mf->frame_size) put_add(&c, A64_SP, A64_SP, -(int64_t)mf->frame_size);
+    for (uint32_t r = 0; r < MIR_FIRST_VREG; r++)
+        if (mf->saved_regs & BIT(r))
+            put(&c, make(mf, A64_STR, 2, mir__reg(r, 8, MIR_USE), mir__mem(object_mem(save_object[r]), 8)));
+
+    for (uint32_t b = 0; b < mf->block_count; b++) {
+        MirBlock *mb = mf->blocks[b];
+        for (MirInst *inst = mb->first, *next; inst; inst = next) {
+            next = inst->next;
+            legalize(mf, mb, inst);
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef AARCH64_H
+#define AARCH64_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "../codegen.h"
+
+/*
+ * AArch64 backend, AAPCS64.  Operands follow assembler order, destination
+ * first; implicit operands come last.  Every function keeps the frame
+ * record at x29: frame objects sit below it and stack parameters above,
+ * and the body only moves sp around calls with stack arguments and for
+ * dynamic allocas.
+ *
+ * Memory operands are either base + disp or base + index << shift, with
+ * the index scaled by 1 or by the size accessed; frame lowering brings
+ * displacements the instruction cannot hold into x15.  x16, x17 and x14
+ * reload spilled operands, so none of the four is allocated.
+ */
+
+enum {
+    A64_X0, A64_X8 = 8, A64_X14 = 14, A64_X15, A64_X16, A64_X17,
+    A64_X19 = 19, A64_X29 = 29, A64_X30, A64_SP,
+    A64_D0 = MIR_FIRST_FPR
+};
+
+#define A64_X(n) ((uint32_t)(n))
+#define A64_D(n) (A64_D0 + (n))
+
+/* Holds displacements and immediates frame lowering materializes. */
+#define A64_ADDR_TEMP A64_X15
+
+/* Condition codes, numbered as their encodings. */
+enum {
+    A64_CC_EQ, A64_CC_NE, A64_CC_HS, A64_CC_LO, A64_CC_MI, A64_CC_PL, A64_CC_VS, A64_CC_VC,
+    A64_CC_HI, A64_CC_LS, A64_CC_GE, A64_CC_LT, A64_CC_GT, A64_CC_LE, A64_CC_AL
+};
+
+#define A64_CC_INVERT(cc) ((cc) ^ 1)
+
+/* ELF relocation types of the symbols encoded instructions refer to. */
+#define A64_R_ADR_PREL_PG_HI21  275
+#define A64_R_ADD_ABS_LO12_NC   277
+#define A64_R_JUMP26            282
+#define A64_R_CALL26            283
+
+/* Pads code between functions and before aligned blocks. */
+#define A64_NOP_WORD 0xD503201F
+
+typedef enum {
+    A64_MOV,            /* register to register, also to and from sp; a copy, flagged MIR_INST_COPY */
+    A64_MOVZ, A64_MOVN, A64_MOVK,   /* dst, imm16, shift */
+    A64_ADD, A64_SUB,               /* dst, a, register or 12-bit immediate */
+    A64_ADD_LSL,                    /* dst = a + (b << imm) */
+    A64_MUL, A64_MADD, A64_MSUB,    /* madd and msub: dst = c +/- a * b */
+    A64_SDIV,
+    A64_AND, A64_ORR, A64_EOR,      /* dst, a, register or bitmask immediate */
+    A64_LSLV, A64_LSRV, A64_ASRV,
+    A64_LSL, A64_LSR, A64_ASR,      /* by an immediate */
+    A64_NEG, A64_MVN,
+    A64_SXTB, A64_SXTH, A64_SXTW, A64_UXTB,
+    A64_CMP, A64_CMN,               /* a, register or 12-bit immediate */
+    A64_CSEL, A64_CSET,
+    A64_B, A64_BCOND, A64_CBZ, A64_CBNZ, A64_BL, A64_RET,
+    A64_SVC,
+    A64_LDR,            /* zero-extending by size: ldrb, ldrh, ldr w, ldr x; ldr s or d to an FPR */
+    A64_LDRSB, A64_LDRSH, A64_LDRSW,
+    A64_STR,
+    A64_STP_PRE,        /* stp a, b, [sp, #imm]! */
+    A64_LDP_POST,       /* ldp a, b, [sp], #imm */
+    A64_ADRP, A64_ADD_LO12,
+    A64_LEA,            /* dst = the address of a memory operand, expanded by frame lowering */
+    A64_FMOV,           /* between FPRs, or the bits between a GPR and an FPR */
+    A64_FMOV_IMM,       /* an 8-bit floating-point immediate */
+    A64_FADD, A64_FSUB, A64_FMUL, A64_FDIV, A64_FNEG,
+    A64_FCMP,           /* a, register or immediate 0 */
+    A64_FCSEL,
+    A64_SCVTF, A64_FCVTZS,
+    A64_FCVT,           /* between single and double, by the operand sizes */
+    A64_OPCODE_COUNT
+} A64Opcode;
+
+extern const char *const aarch64__mnemonics[A64_OPCODE_COUNT];
+
+/* A 64-bit constant as movz or movn followed by movk, at most four. */
+typedef struct {
+    uint16_t opcode;
+    uint16_t imm;
+    uint8_t  shift;
+} A64ImmPart;
+
+uint32_t aarch64__imm_parts(uint64_t value, A64ImmPart parts[4]);
+/* The N:immr:imms field of a logical immediate, or false if not one. */
+bool     aarch64__logical_imm(uint64_t value, uint32_t *field);
+/* The imm8 field of an fmov immediate, or false if not one. */
+bool     aarch64__fp_imm(double value, uint32_t *field);
+/* Whether an unscaled or scaled immediate offset can address size bytes. */
+bool     aarch64__offset_ok(int64_t disp, uint8_t size);
+
+/* The instruction word of a lowered instruction.  Block operands are
+ * resolved through block_pc, by block id; symbols, and the blocks a b
+ * reaches in the function's other part, encode as 0, left to
+ * relocations. */
+bool     aarch64__encode(const MirInst *inst, uint64_t pc, const uint64_t *block_pc, uint32_t *word);
+/* Where a block starts after code up to pc, padded to its alignment. */
+uint64_t aarch64__block_start(const MirBlock *mb, uint64_t pc);
+/* Place the blocks of mf into block_pc, by block id: from the function
+ * start, or CODEGEN_COLD_PC plus from the start of its cold part.  Returns
+ * the size of the function's code and sets cold_size to that of the cold
+ * part. */
+uint64_t aarch64__layout(const MirFunction *mf, uint64_t *block_pc, uint64_t *cold_size);
+/* Append the words of mf to code and cold, see CodegenTarget.assemble: bl
+ * and b to a symbol take CALL26 and JUMP26 relocations, as does a b
+ * between the two parts of the function, and adrp and its :lo12: add the
+ * page and page offset of their symbol. */
+bool     aarch64__assemble(const MirFunction *mf, CodegenCode *code, CodegenCode *cold, CodegenExtent *extent);
+
+MirFunction *aarch64__select(CodegenModule *cm, IrFunction *func);
+MirInst     *aarch64__spill(MirFunction *mf, uint32_t reg, uint32_t object, bool load);
+MirInst     *aarch64__address(MirFunction *mf, uint32_t dst, const MirMem *mem);
+MirInst     *aarch64__rematerialize(MirFunction *mf, const MirInst *def, uint32_t reg);
+void         aarch64__lower_frame(MirFunction *mf);
+void         aarch64__print_header(FILE *out, const CodegenModule *cm, const char *source);
+void         aarch64__print_function(FILE *out, const CodegenModule *cm, const MirFunction *mf);
+
+#endif
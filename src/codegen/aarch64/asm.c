@@ -0,0 +1,186 @@
+#include "aarch64.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Assembly for the GNU assembler and llvm-mc.  Block labels are .L labels
+ * named after their function, local to the object file.  With
+ * --debug-info=compile every instruction carries its word from
+ * aarch64__encode, to hold the assembler's encoding against. */
+
+static const char *const cond_names[16] = {
+    "eq", "ne", "hs", "lo", "mi", "pl", "vs", "vc", "hi", "ls", "ge", "lt", "gt", "le", "al", "nv"
+};
+
+static void print_reg(FILE *out, uint32_t reg, uint8_t size) {
+    if (reg >= MIR_FIRST_VREG) fprintf(out, "v%" PRIu32, reg - MIR_FIRST_VREG);
+    else if (reg >= MIR_FIRST_FPR) fprintf(out, "%c%" PRIu32, size == 4 ? 's' : 'd', reg - MIR_FIRST_FPR);
+    else if (reg == A64_SP) fputs(size == 4 ? "wsp" : "sp", out);
+    else fprintf(out, "%c%" PRIu32, size == 8 ? 'x' : 'w', reg);
+}
+
+static void print_mem(FILE *out, const MirMem *m, uint8_t size) {
+    fputc('[', out);
+    if (m->symbol) fputs(m->symbol, out);
+    else if (m->frame) fprintf(out, "frame%" PRIu32, m->frame - 1);
+    else print_reg(out, m->base, 8);
+    if (m->index != MIR_NO_REG) {
+        fputs(", ", out);
+        print_reg(out, m->index, 8);
+        if (m->scale > 1) fprintf(out, ", lsl #%d", size == 8 ? 3 : size == 4 ? 2 : 1);
+    }
+    if (m->disp) fprintf(out, ", #%" PRId32, m->disp);
+    fputc(']', out);
+}
+
+static bool unscaled(const MirMem *m, uint8_t size) {
+    return m->index == MIR_NO_REG && !(m->disp >= 0 && m->disp % size == 0 && m->disp / size <= 4095);
+}
+
+static void print_load_store(FILE *out, const MirInst *inst) {
+    const MirOperand *r = &inst->ops[0], *m = &inst->ops[1];
+    bool fpr = r->reg >= MIR_FIRST_FPR && r->reg < MIR_FIRST_VREG;
+    bool store = inst->opcode == A64_STR, u = unscaled(&m->mem, m->size);
+    const char *suffix = "";
+    uint8_t width = m->size == 8 ? 8 : 4;
+    switch (inst->opcode) {
+        case A64_LDRSB: suffix = "sb"; width = 8; break;
+        case A64_LDRSH: suffix = "sh"; width = 8; break;
+        case A64_LDRSW: suffix = "sw"; width = 8; break;
+        default:
+            if (!fpr) suffix = m->size == 1 ? "b" : m->size == 2 ? "h" : "";
+            break;
+    }
+    fprintf(out, "%s%s%s ", store ? "st" : "ld", u ? "ur" : "r", suffix);
+    print_reg(out, r->reg, fpr ? m->size : width);
+    fputs(", ", out);
+    print_mem(out, &m->mem, m->size);
+}
+
+/* The value of an fmov imm8 field. */
+static double fp_imm_value(uint32_t imm8) {
+    double frac = 1.0 + (double)(imm8 & 0xf) / 16.0;
+    int exp = (int)((imm8 >> 4) & 3);
+    exp = (imm8 & 0x40) ? exp - 3 : exp + 1;
+    double v = frac;
+    for (int i = 0; i < exp; i++) v *= 2.0;
+    for (int i = 0; i > exp; i--) v /= 2.0;
+    return (imm8 & 0x80) ? -v : v;
+}
+
+static void print_inst(FILE *out, const MirFunction *mf, const MirInst *inst) {
+    const MirOperand *ops = inst->ops;
+    fputs("\t", out);
+    switch ((A64Opcode)inst->opcode) {
+        case A64_LDR: case A64_LDRSB: case A64_LDRSH: case A64_LDRSW: case A64_STR:
+            print_load_store(out, inst);
+            return;
+        case A64_STP_PRE:
+            fprintf(out, "stp x29, x30, [sp, #%" PRId64 "]!", ops[2].imm);
+            return;
+        case A64_LDP_POST:
+            fprintf(out, "ldp x29, x30, [sp], #%" PRId64, ops[2].imm);
+            return;
+        case A64_ADD_LO12:
+            fputs("add ", out);
+            print_reg(out, ops[0].reg, 8);
+            fputs(", ", out);
+            print_reg(out, ops[1].reg, 8);
+            fprintf(out, ", :lo12:%s", ops[2].symbol);
+            return;
+        case A64_FMOV_IMM:
+            fputs("fmov ", out);
+            print_reg(out, ops[0].reg, 8);
+            fprintf(out, ", #%.8f", fp_imm_value((uint32_t)ops[1].imm));
+            return;
+        case A64_FCMP:
+            if (ops[1].kind == MIR_OPERAND_IMM) {
+                fputs("fcmp ", out);
+                print_reg(out, ops[0].reg, 8);
+                fputs(", #0.0", out);
+                return;
+            }
+            fputs("fcmp", out);
+            break;
+        case A64_BCOND:
+            fprintf(out, "b.%s", cond_names[inst->cond & 15]);
+            break;
+        default:
+            fputs(aarch64__mnemonics[inst->opcode], out);
+            break;
+    }
+    bool first = true;
+    for (uint8_t i = 0; i < inst->count; i++) {
+        const MirOperand *op = &inst->ops[i];
+        if (op->kind == MIR_OPERAND_NONE || (op->flags & MIR_IMPLICIT)) continue;
+        /* The shift of movz, movn, movk and of a shifted add. */
+        bool shift = i == 2 && (inst->opcode == A64_MOVZ || inst->opcode == A64_MOVN || inst->opcode == A64_MOVK);
+        shift |= i == 3 && inst->opcode == A64_ADD_LSL;
+        if (shift) {
+            if (op->imm) fprintf(out, ", lsl #%" PRId64, op->imm);
+            continue;
+        }
+        fputs(first ? " " : ", ", out);
+        first = false;
+        switch (op->kind) {
+            case MIR_OPERAND_REG:    print_reg(out, op->reg, op->size); break;
+            case MIR_OPERAND_IMM:    fprintf(out, "#%" PRId64, op->imm); break;
+            case MIR_OPERAND_MEM:    print_mem(out, &op->mem, op->size); break;
+            case MIR_OPERAND_BLOCK:  fprintf(out, ".L%s_%" PRIu32, mf->name, op->block->id); break;
+            case MIR_OPERAND_SYMBOL: fputs(op->symbol, out); break;
+            default: break;
+        }
+    }
+    if (inst->opcode == A64_CSEL || inst->opcode == A64_FCSEL || inst->opcode == A64_CSET)
+        fprintf(out, ", %s", cond_names[inst->cond & 15]);
+}
+
+void aarch64__print_header(FILE *out, const CodegenModule *cm, const char *source) {
+    fprintf(out, "// %s\n", source ? source : "<module>");
+    fputs("\t.arch armv8-a\n\t.text\n", out);
+    for (uint32_t i = 0; i < cm->mod->func_count; i++) {
+        const IrFunction *func = cm->mod->functions[i];
+        if (!func->is_internal) fprintf(out, "\t.globl %s\n", func->name);
+    }
+    /* Undefined symbols are external to the GNU assembler; these are
+     * listed for the reader. */
+    for (uint32_t i = 0; i < cm->extern_count; i++) fprintf(out, "// extern %s\n", cm->externs[i]);
+}
+
+void aarch64__print_function(FILE *out, const CodegenModule *cm, const MirFunction *mf) {
+    uint64_t *block_pc = NULL, cold_size;
+    if (cm->opts->debug) {
+        block_pc = malloc((mf->block_count ? mf->block_count : 1) * sizeof(uint64_t));
+        if (block_pc) aarch64__layout(mf, block_pc, &cold_size);
+    }
+    fprintf(out, "\n\t.p2align 4\n\t.type %s, %%function\n%s:\n", mf->name, mf->name);
+    /* The function's code, then its cold blocks in a section of their own */
+    bool has_cold = false;
+    uint64_t end[2] = { 0, CODEGEN_COLD_PC };
+    for (int part = 0; part < 2; part++) {
+        for (uint32_t b = 0; b < mf->block_count; b++) {
+            const MirBlock *mb = mf->blocks[b];
+            if (mb->cold != part) continue;
+            if (part && !has_cold) {
+                fprintf(out, "\t.size %s, .-%s\n", mf->name, mf->name);
+                fprintf(out, "\t.section %s,\"ax\",%%progbits\n", LAYOUT_COLD_SECTION);
+            }
+            has_cold |= part;
+            uint64_t *pc = &end[part];
+            if (b > 0) {
+                *pc = aarch64__block_start(mb, *pc);
+                if (mb->align > 1) fprintf(out, "\t.p2align %d\n", __builtin_ctz(mb->align));
+                fprintf(out, ".L%s_%" PRIu32 ":\n", mf->name, mb->id);
+            }
+            for (const MirInst *inst = mb->first; inst; inst = inst->next, *pc += 4) {
+                print_inst(out, mf, inst);
+                uint32_t word;
+                if (block_pc && aarch64__encode(inst, *pc, block_pc, &word)) fprintf(out, "\t// %08" PRIx32, word);
+                fputc('\n', out);
+            }
+        }
+    }
+    if (has_cold) fputs("\t.text\n", out);
+    else fprintf(out, "\t.size %s, .-%s\n", mf->name, mf->name);
+    free(block_pc);
+}
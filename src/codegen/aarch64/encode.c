@@ -0,0 +1,320 @@
+#include "aarch64.h"
+#include <inttypes.h>
+#include <stdlib.h>
+
+/*
+ * Instruction words of lowered AArch64 code, 64-bit forms throughout but
+ * for the 32-bit views loads, stores and fmov take from operand sizes.
+ * Every lowered instruction is one word, so block addresses are four
+ * times the instructions before them.
+ */
+
+static uint32_t rn(const MirOperand *op) {
+    return op->reg >= MIR_FIRST_FPR ? op->reg - MIR_FIRST_FPR : op->reg & 31;
+}
+
+static bool is_sp(const MirOperand *op) {
+    return op->kind == MIR_OPERAND_REG && op->reg == A64_SP;
+}
+
+static bool is_fpr_op(const MirOperand *op) {
+    return op->kind == MIR_OPERAND_REG && op->reg >= MIR_FIRST_FPR;
+}
+
+/* Whether op is a block in the other part of the function from pc. */
+static bool other_part(const MirOperand *op, uint64_t pc, const uint64_t *block_pc) {
+    return op->kind == MIR_OPERAND_BLOCK && ((block_pc[op->block->id] ^ pc) & CODEGEN_COLD_PC);
+}
+
+/* Branch displacement in words, or false if beyond bits of reach.  Only
+ * the 26 bits of b reach the other part, through a relocation. */
+static bool branch_offset(const MirOperand *op, uint64_t pc, const uint64_t *block_pc, uint32_t bits, uint32_t *out) {
+    if (op->kind == MIR_OPERAND_SYMBOL || (bits == 26 && other_part(op, pc, block_pc))) {
+        *out = 0;
+        return true;
+    }
+    if (op->kind != MIR_OPERAND_BLOCK || other_part(op, pc, block_pc)) return false;
+    int64_t words = ((int64_t)block_pc[op->block->id] - (int64_t)pc) / 4;
+    int64_t limit = INT64_C(1) << (bits - 1);
+    if (words < -limit || words >= limit) return false;
+    *out = (uint32_t)words & ((UINT32_C(1) << bits) - 1);
+    return true;
+}
+
+/* Loads and stores: the unsigned-offset opcode of each form. */
+static uint32_t load_store_base(const MirInst *inst, uint8_t size, bool fpr) {
+    bool load = inst->opcode != A64_STR;
+    if (fpr) return size == 4 ? (load ? 0xBD400000 : 0xBD000000) : (load ? 0xFD400000 : 0xFD000000);
+    switch (inst->opcode) {
+        case A64_LDRSB: return 0x39800000;
+        case A64_LDRSH: return 0x79800000;
+        case A64_LDRSW: return 0xB9800000;
+        default: break;
+    }
+    switch (size) {
+        case 1:  return load ? 0x39400000 : 0x39000000;
+        case 2:  return load ? 0x79400000 : 0x79000000;
+        case 4:  return load ? 0xB9400000 : 0xB9000000;
+        default: return load ? 0xF9400000 : 0xF9000000;
+    }
+}
+
+static bool encode_load_store(const MirInst *inst, uint32_t *word) {
+    const MirOperand *r = &inst->ops[0], *m = &inst->ops[1];
+    if (m->kind != MIR_OPERAND_MEM || m->mem.frame || m->mem.symbol || m->mem.base == MIR_NO_REG) return false;
+    uint8_t size = m->size;
+    uint32_t op = load_store_base(inst, size, is_fpr_op(r));
+    uint32_t base = m->mem.base & 31, rt = rn(r);
+    if (m->mem.index != MIR_NO_REG) {
+        if (m->mem.disp || (m->mem.scale != 1 && m->mem.scale != size)) return false;
+        uint32_t shift = m->mem.scale > 1 ? 1 : 0;
+        *word = (op & ~0x01000000u) | 0x00206800 | (m->mem.index & 31) << 16 | shift << 12 | base << 5 | rt;
+        return true;
+    }
+    int64_t disp = m->mem.disp;
+    if (disp >= 0 && disp % size == 0 && disp / size <= 4095) {
+        *word = op | (uint32_t)(disp / size) << 10 | base << 5 | rt;
+        return true;
+    }
+    if (disp < -256 || disp > 255) return false;
+    *word = (op & ~0x01000000u) | ((uint32_t)disp & 0x1ff) << 12 | base << 5 | rt;
+    return true;
+}
+
+/* add and sub: immediate, shifted register, or extended register where
+ * sp takes the place of a register. */
+static bool encode_add_sub(const MirInst *inst, bool sub, uint32_t shift, uint32_t *word) {
+    const MirOperand *d = &inst->ops[0], *a = &inst->ops[1], *b = &inst->ops[2];
+    uint32_t s = sub ? 0x40000000 : 0;
+    if (b->kind == MIR_OPERAND_IMM) {
+        if (b->imm < 0 || b->imm > 4095) return false;
+        *word = 0x91000000 | s | (uint32_t)b->imm << 10 | rn(a) << 5 | rn(d);
+        return true;
+    }
+    if (is_sp(d) || is_sp(a)) {
+        if (shift > 4) return false;
+        *word = 0x8B206000 | s | rn(b) << 16 | shift << 10 | rn(a) << 5 | rn(d);
+        return true;
+    }
+    *word = 0x8B000000 | s | rn(b) << 16 | shift << 10 | rn(a) << 5 | rn(d);
+    return true;
+}
+
+static bool encode_logical(const MirInst *inst, uint32_t reg_op, uint32_t imm_op, uint32_t *word) {
+    const MirOperand *d = &inst->ops[0], *a = &inst->ops[1], *b = &inst->ops[2];
+    if (b->kind == MIR_OPERAND_IMM) {
+        uint32_t field;
+        if (!aarch64__logical_imm((uint64_t)b->imm, &field)) return false;
+        *word = imm_op | field << 10 | rn(a) << 5 | rn(d);
+        return true;
+    }
+    *word = reg_op | rn(b) << 16 | rn(a) << 5 | rn(d);
+    return true;
+}
+
+/* rd, rn and rm at their usual places. */
+static uint32_t three(uint32_t op, const MirInst *inst) {
+    return op | rn(&inst->ops[2]) << 16 | rn(&inst->ops[1]) << 5 | rn(&inst->ops[0]);
+}
+
+static uint32_t two(uint32_t op, const MirInst *inst) {
+    return op | rn(&inst->ops[1]) << 5 | rn(&inst->ops[0]);
+}
+
+bool aarch64__encode(const MirInst *inst, uint64_t pc, const uint64_t *block_pc, uint32_t *word) {
+    const MirOperand *ops = inst->ops;
+    uint32_t off;
+    switch ((A64Opcode)inst->opcode) {
+        case A64_MOV:
+            if (is_sp(&ops[0]) || is_sp(&ops[1])) *word = two(0x91000000, inst);
+            else *word = 0xAA0003E0 | rn(&ops[1]) << 16 | rn(&ops[0]);
+            return true;
+        case A64_MOVZ: case A64_MOVN: case A64_MOVK: {
+            static const uint32_t op[] = { [A64_MOVZ] = 0xD2800000, [A64_MOVN] = 0x92800000, [A64_MOVK] = 0xF2800000 };
+            *word = op[inst->opcode] | (uint32_t)(ops[2].imm / 16) << 21 | ((uint32_t)ops[1].imm & 0xffff) << 5 | rn(&ops[0]);
+            return true;
+        }
+        case A64_ADD:     return encode_add_sub(inst, false, 0, word);
+        case A64_SUB:     return encode_add_sub(inst, true, 0, word);
+        case A64_ADD_LSL: return encode_add_sub(inst, false, (uint32_t)ops[3].imm, word);
+        case A64_ADD_LO12:
+            *word = two(0x91000000, inst);
+            return true;
+        case A64_MUL:  *word = three(0x9B007C00, inst); return true;
+        case A64_MADD: case A64_MSUB:
+            *word = three(inst->opcode == A64_MADD ? 0x9B000000 : 0x9B008000, inst) | rn(&ops[3]) << 10;
+            return true;
+        case A64_SDIV: *word = three(0x9AC00C00, inst); return true;
+        case A64_AND:  return encode_logical(inst, 0x8A000000, 0x92000000, word);
+        case A64_ORR:  return encode_logical(inst, 0xAA000000, 0xB2000000, word);
+        case A64_EOR:  return encode_logical(inst, 0xCA000000, 0xD2000000, word);
+        case A64_LSLV: *word = three(0x9AC02000, inst); return true;
+        case A64_LSRV: *word = three(0x9AC02400, inst); return true;
+        case A64_ASRV: *word = three(0x9AC02800, inst); return true;
+        case A64_LSL: {
+            uint32_t sh = (uint32_t)ops[2].imm & 63;
+            *word = two(0xD3400000, inst) | ((64 - sh) & 63) << 16 | (63 - sh) << 10;
+            return true;
+        }
+        case A64_LSR: case A64_ASR:
+            *word = two(inst->opcode == A64_LSR ? 0xD340FC00 : 0x9340FC00, inst) | ((uint32_t)ops[2].imm & 63) << 16;
+            return true;
+        case A64_NEG:  *word = 0xCB0003E0 | rn(&ops[1]) << 16 | rn(&ops[0]); return true;
+        case A64_MVN:  *word = 0xAA2003E0 | rn(&ops[1]) << 16 | rn(&ops[0]); return true;
+        case A64_SXTB: *word = two(0x93401C00, inst); return true;
+        case A64_SXTH: *word = two(0x93403C00, inst); return true;
+        case A64_SXTW: *word = two(0x93407C00, inst); return true;
+        case A64_UXTB: *word = two(0x53001C00, inst); return true;
+        case A64_CMP: case A64_CMN: {
+            uint32_t s = inst->opcode == A64_CMP ? 0x40000000 : 0;
+            if (ops[1].kind == MIR_OPERAND_IMM) {
+                if (ops[1].imm < 0 || ops[1].imm > 4095) return false;
+                *word = 0xB100001F | s | (uint32_t)ops[1].imm << 10 | rn(&ops[0]) << 5;
+            } else {
+                *word = 0xAB00001F | s | rn(&ops[1]) << 16 | rn(&ops[0]) << 5;
+            }
+            return true;
+        }
+        case A64_CSEL:  *word = three(0x9A800000, inst) | (uint32_t)inst->cond << 12; return true;
+        case A64_FCSEL: *word = three(0x1E600C00, inst) | (uint32_t)inst->cond << 12; return true;
+        case A64_CSET:  *word = 0x9A9F07E0 | (uint32_t)(A64_CC_INVERT(inst->cond)) << 12 | rn(&ops[0]); return true;
+        case A64_B: case A64_BL:
+            if (!branch_offset(&ops[0], pc, block_pc, 26, &off)) return false;
+            *word = (inst->opcode == A64_B ? 0x14000000 : 0x94000000) | off;
+            return true;
+        case A64_BCOND:
+            if (!branch_offset(&ops[0], pc, block_pc, 19, &off)) return false;
+            *word = 0x54000000 | off << 5 | inst->cond;
+            return true;
+        case A64_CBZ: case A64_CBNZ:
+            if (!branch_offset(&ops[1], pc, block_pc, 19, &off)) return false;
+            *word = (inst->opcode == A64_CBZ ? 0xB4000000 : 0xB5000000) | off << 5 | rn(&ops[0]);
+            return true;
+        case A64_RET: *word = 0xD65F03C0; return true;
+        case A64_SVC: *word = 0xD4000001 | ((uint32_t)ops[0].imm & 0xffff) << 5; return true;
+        case A64_LDR: case A64_LDRSB: case A64_LDRSH: case A64_LDRSW: case A64_STR:
+            return encode_load_store(inst, word);
+        case A64_STP_PRE: case A64_LDP_POST:
+            *word = (inst->opcode == A64_STP_PRE ? 0xA9800000 : 0xA8C00000) |
+                    ((uint32_t)(ops[2].imm / 8) & 0x7f) << 15 | rn(&ops[1]) << 10 | A64_SP << 5 | rn(&ops[0]);
+            return true;
+        case A64_ADRP: *word = 0x90000000 | rn(&ops[0]); return true;
+        case A64_FMOV: {
+            bool to_fpr = is_fpr_op(&ops[0]), from_fpr = is_fpr_op(&ops[1]);
+            bool single = ops[0].size == 4;
+            if (to_fpr && from_fpr) *word = two(single ? 0x1E204000 : 0x1E604000, inst);
+            else if (to_fpr) *word = two(single ? 0x1E270000 : 0x9E670000, inst);
+            else *word = two(single ? 0x1E260000 : 0x9E660000, inst);
+            return true;
+        }
+        case A64_FMOV_IMM: *word = 0x1E601000 | ((uint32_t)ops[1].imm & 0xff) << 13 | rn(&ops[0]); return true;
+        case A64_FADD: *word = three(0x1E602800, inst); return true;
+        case A64_FSUB: *word = three(0x1E603800, inst); return true;
+        case A64_FMUL: *word = three(0x1E600800, inst); return true;
+        case A64_FDIV: *word = three(0x1E601800, inst); return true;
+        case A64_FNEG: *word = two(0x1E614000, inst); return true;
+        case A64_FCMP:
+            if (ops[1].kind == MIR_OPERAND_IMM) *word = 0x1E602008 | rn(&ops[0]) << 5;
+            else *word = 0x1E602000 | rn(&ops[1]) << 16 | rn(&ops[0]) << 5;
+            return true;
+        case A64_SCVTF:  *word = two(0x9E620000, inst); return true;
+        case A64_FCVTZS: *word = two(0x9E780000, inst); return true;
+        case A64_FCVT:   *word = two(ops[0].size == 4 ? 0x1E624000 : 0x1E22C000, inst); return true;
+        default:
+            return false;
+    }
+}
+
+uint64_t aarch64__block_start(const MirBlock *mb, uint64_t pc) {
+    if (mb->id == 0 || mb->align <= 1) return pc;
+    return (pc + mb->align - 1) & ~(uint64_t)(mb->align - 1);
+}
+
+uint64_t aarch64__layout(const MirFunction *mf, uint64_t *block_pc, uint64_t *cold_size) {
+    /* The next free offset of the function's code and of its cold part */
+    uint64_t end[2] = { 0, CODEGEN_COLD_PC };
+    for (uint32_t b = 0; b < mf->block_count; b++) {
+        uint64_t *pc = &end[mf->blocks[b]->cold];
+        *pc = aarch64__block_start(mf->blocks[b], *pc);
+        block_pc[b] = *pc;
+        for (const MirInst *inst = mf->blocks[b]->first; inst; inst = inst->next) *pc += 4;
+    }
+    *cold_size = end[1] - CODEGEN_COLD_PC;
+    return end[0];
+}
+
+/* Fill n bytes, a multiple of four, with nop words. */
+static void put_nops(uint8_t *at, uint64_t n) {
+    for (uint64_t i = 0; i + 4 <= n; i += 4)
+        for (int b = 0; b < 4; b++) at[i + b] = (uint8_t)(A64_NOP_WORD >> (8 * b));
+}
+
+/* The relocation of the symbol inst refers to, 0 for none. */
+static uint32_t symbol_reloc(const MirInst *inst, const char **symbol) {
+    switch ((A64Opcode)inst->opcode) {
+        case A64_BL:
+        case A64_B:
+            if (inst->ops[0].kind != MIR_OPERAND_SYMBOL) return 0;
+            *symbol = inst->ops[0].symbol;
+            return inst->opcode == A64_BL ? A64_R_CALL26 : A64_R_JUMP26;
+        case A64_ADRP:
+            *symbol = inst->ops[1].symbol;
+            return A64_R_ADR_PREL_PG_HI21;
+        case A64_ADD_LO12:
+            *symbol = inst->ops[2].symbol;
+            return A64_R_ADD_ABS_LO12_NC;
+        default:
+            return 0;
+    }
+}
+
+/* size bytes at the end of code, from a multiple of 16 padded with nops
+ * that is set in base; NULL when out of memory. */
+static uint8_t *append(CodegenCode *code, uint64_t size, uint64_t *base) {
+    *base = (code->size + 15) & ~UINT64_C(15);
+    uint8_t *at = codegen__code_grow(code, *base - code->size + size);
+    if (!at) return NULL;
+    put_nops(at, (uint64_t)(code->bytes + *base - at));
+    return code->bytes + *base;
+}
+
+bool aarch64__assemble(const MirFunction *mf, CodegenCode *code, CodegenCode *cold, CodegenExtent *extent) {
+    uint64_t *block_pc = malloc((mf->block_count ? mf->block_count : 1) * sizeof(uint64_t));
+    if (!block_pc) return false;
+    uint64_t cold_size, size = aarch64__layout(mf, block_pc, &cold_size);
+    /* The function's code and its cold part, by MirBlock.cold */
+    CodegenCode *part[2] = { code, cold };
+    uint64_t base[2] = { 0, cold->size }, done[2] = { 0, 0 };
+    bool ok = append(code, size, &base[0]) != NULL;
+    if (ok && cold_size) ok = append(cold, cold_size, &base[1]) != NULL;
+    *extent = (CodegenExtent){ base[0], base[0] + size, base[1], base[1] + cold_size };
+    uint32_t count = 0;
+    for (uint32_t b = 0; ok && b < mf->block_count; b++) {
+        const MirBlock *mb = mf->blocks[b];
+        CodegenCode *out = part[mb->cold];
+        uint64_t pc = block_pc[b], offset = pc & ~CODEGEN_COLD_PC;
+        put_nops(out->bytes + base[mb->cold] + done[mb->cold], offset - done[mb->cold]);
+        for (const MirInst *inst = mb->first; ok && inst; inst = inst->next, pc += 4, offset += 4, count++) {
+            uint32_t word;
+            if (!aarch64__encode(inst, pc, block_pc, &word)) {
+                code->failed = inst;
+                ok = false;
+                break;
+            }
+            uint8_t *at = out->bytes + base[mb->cold] + offset;
+            for (int i = 0; i < 4; i++) at[i] = (uint8_t)(word >> (8 * i));
+            const char *symbol;
+            uint32_t type = symbol_reloc(inst, &symbol);
+            if (type) ok = codegen__code_reloc(out, base[mb->cold] + offset, symbol, type, 0);
+            else if (inst->opcode == A64_B && other_part(&inst->ops[0], pc, block_pc))
+                ok = codegen__block_reloc(out, base[mb->cold] + offset, mf, block_pc[inst->ops[0].block->id],
+                                          A64_R_JUMP26, 0);
+        }
+        done[mb->cold] = offset;
+    }
+    if (ok && code->debug)
+        fprintf(code->debug, "assemble %s: %" PRIu64 " bytes, %" PRIu64 " cold, %u instructions\n", mf->name, size,
+                cold_size, count);
+    free(block_pc);
+    return ok;
+}
@@ -0,0 +1,1192 @@
+#include "aarch64.h"
+#include "../../ir/analysis/analysis.h"
+#include "../../ir/interp/interp.h"
+#include "../../errhandler/errhandler.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Instruction selection for AArch64.  Each IR instruction becomes a few
+ * machine instructions over virtual registers, and three patterns are
+ * covered as one: a GEP whose only uses are addresses of loads, stores and
+ * other GEPs folds into their memory operands, a compare whose single use
+ * is the branch or select right after it sets the flags they test, and a
+ * multiply whose single use is an add or subtract in its block becomes
+ * madd or msub.
+ */
+
+/* Where AAPCS64 passes an argument. */
+typedef struct {
+    bool     real;
+    uint32_t reg;                   /* MIR_NO_REG when on the stack */
+    uint32_t stack;                 /* 8-byte slot above sp at the call */
+} ArgPlace;
+
+typedef struct {
+    CodegenModule  *cm;
+    IrFunction     *func;
+    MirFunction    *mf;
+    LowerFunction   lf;
+    MirBlock       *mb;             /* block being filled */
+    MirBlock      **block_of;       /* by IR block id */
+    const MirBlock *next;           /* block laid out after the IR block's last in
+                                       its section, or NULL */
+    uint32_t       *vreg;           /* by value: parameters, then temps; MIR_NO_REG until used */
+    uint32_t       *frame_of;       /* by temp: frame object + 1 of a static alloca */
+    uint8_t        *covered;        /* by temp: selected as part of its user */
+    uint16_t        line, column;
+} Isel;
+
+/* --------------------------------------------------------------- emission */
+
+static MirOperand use(uint32_t reg)  { return mir__reg(reg, 8, MIR_USE); }
+static MirOperand def(uint32_t reg)  { return mir__reg(reg, 8, MIR_DEF); }
+static MirOperand both(uint32_t reg) { return mir__reg(reg, 8, MIR_USE | MIR_DEF); }
+
+static MirOperand sized(MirOperand op, uint8_t size) {
+    op.size = size;
+    return op;
+}
+
+static MirOperand implicit(MirOperand op) {
+    op.flags |= MIR_IMPLICIT;
+    return op;
+}
+
+static MirOperand mem(MirMem m, uint8_t size) { return mir__mem(m, size); }
+
+/* Append an instruction with count operands to the current block. */
+static MirInst *ins(Isel *s, A64Opcode op, uint8_t count, ...) {
+    MirInst *inst = mir__inst_new(s->mf, op, count);
+    if (!inst) return NULL;
+    va_list ap;
+    va_start(ap, count);
+    for (uint8_t i = 0; i < count; i++) inst->ops[i] = va_arg(ap, MirOperand);
+    va_end(ap);
+    inst->line = s->line;
+    inst->column = s->column;
+    mir__inst_append(s->mb, inst);
+    return inst;
+}
+
+static void ins_cc(Isel *s, A64Opcode op, int cc, uint8_t count, MirOperand a, MirOperand b, MirOperand c) {
+    MirInst *inst = count == 1 ? ins(s, op, 1, a) : count == 2 ? ins(s, op, 2, a, b) : ins(s, op, 3, a, b, c);
+    if (inst) inst->cond = (uint8_t)cc;
+}
+
+static uint32_t new_reg(Isel *s, bool real) {
+    return mir__vreg_new(s->mf, real ? MIR_FPR : MIR_GPR);
+}
+
+static bool is_fpr(const Isel *s, uint32_t reg) {
+    return mir__vreg_class(s->mf, reg) == MIR_FPR;
+}
+
+static void copy(Isel *s, uint32_t dst, uint32_t src) {
+    if (dst == src) return;
+    MirInst *inst = ins(s, is_fpr(s, dst) ? A64_FMOV : A64_MOV, 2, def(dst), use(src));
+    if (inst) inst->flags |= MIR_INST_COPY;
+}
+
+static void jump(Isel *s, MirBlock *to) {
+    MirInst *inst = ins(s, A64_B, 1, mir__block(to));
+    if (inst) inst->flags |= MIR_INST_JUMP;
+}
+
+static void load_imm(Isel *s, uint32_t reg, int64_t v) {
+    A64ImmPart parts[4];
+    uint32_t n = aarch64__imm_parts((uint64_t)v, parts);
+    for (uint32_t i = 0; i < n; i++)
+        ins(s, (A64Opcode)parts[i].opcode, 3, parts[i].opcode == A64_MOVK ? both(reg) : def(reg),
+            mir__imm(parts[i].imm), mir__imm(parts[i].shift));
+}
+
+static bool fits_int32(int64_t v) {
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+/* ----------------------------------------------------------------- values */
+
+static bool is_local(const Isel *s, const IrValue *v) {
+    return v && ((v->kind == IR_VALUE_PARAM && v->id < s->func->param_count) ||
+                 (v->kind == IR_VALUE_TEMP && v->id < s->lf.temp_count));
+}
+
+static uint32_t index_of(const Isel *s, const IrValue *v) {
+    return v->kind == IR_VALUE_PARAM ? v->id : s->func->param_count + v->id;
+}
+
+static bool value_real(const Isel *s, const IrValue *v) {
+    return v && lower__is_real(&s->lf, v);
+}
+
+/* The virtual register holding a parameter or temp. */
+static uint32_t local_reg(Isel *s, const IrValue *v) {
+    uint32_t i = index_of(s, v);
+    if (s->vreg[i] == MIR_NO_REG) s->vreg[i] = new_reg(s, value_real(s, v));
+    return s->vreg[i];
+}
+
+static bool const_int(const IrValue *v, int64_t *out) {
+    if (!v) {
+        *out = 0;
+        return true;
+    }
+    switch (v->kind) {
+        case IR_VALUE_CONST_INT:    *out = v->const_data.int_val; return true;
+        case IR_VALUE_CONST_CHAR:   *out = (unsigned char)v->const_data.char_val; return true;
+        case IR_VALUE_CONST_REAL:   *out = (int64_t)v->const_data.real_val; return true;
+        case IR_VALUE_STRUCT_FIELD: *out = lower__field_offset(v); return true;
+        default: return false;
+    }
+}
+
+/* A constant add, sub and cmp take as a 12-bit immediate, negated if need be. */
+static bool arith_imm(const IrValue *v, int64_t *out) {
+    return const_int(v, out) && *out > -4096 && *out < 4096;
+}
+
+static bool is_function(const Isel *s, const char *name) {
+    return lower__find_function(&s->cm->lm, name) != UINT32_MAX;
+}
+
+static MirMem frame_mem(uint32_t object) {
+    MirMem m = mir__mem_base(MIR_NO_REG, 0);
+    m.frame = object + 1;
+    return m;
+}
+
+static MirMem symbol_mem(const char *name) {
+    MirMem m = mir__mem_base(MIR_NO_REG, 0);
+    m.symbol = name;
+    return m;
+}
+
+static MirMem address_of(Isel *s, const IrValue *ptr);
+
+/* dst = address of m, or a copy when m is a register alone. */
+static void lea(Isel *s, uint32_t dst, MirMem m) {
+    if (m.base != MIR_NO_REG && m.index == MIR_NO_REG && !m.disp && !m.frame && !m.symbol) copy(s, dst, m.base);
+    else ins(s, A64_LEA, 2, def(dst), mem(m, 8));
+}
+
+/* A register holding the address of m. */
+static uint32_t address_reg(Isel *s, MirMem m) {
+    if (m.base != MIR_NO_REG && m.index == MIR_NO_REG && !m.disp && !m.frame && !m.symbol) return m.base;
+    uint32_t reg = new_reg(s, false);
+    lea(s, reg, m);
+    return reg;
+}
+
+/*
+ * A register holding v as a real or an integer, converted like the
+ * interpreter where v is of the other class.
+ */
+static uint32_t value_reg(Isel *s, const IrValue *v, bool real) {
+    uint32_t reg;
+    bool have_real = false;
+    if (v && v->kind == IR_VALUE_CONST_REAL && real) {
+        double d = v->const_data.real_val;
+        uint32_t field;
+        reg = new_reg(s, true);
+        if (aarch64__fp_imm(d, &field)) {
+            ins(s, A64_FMOV_IMM, 2, def(reg), mir__imm(field));
+        } else {
+            uint64_t bits;
+            memcpy(&bits, &d, sizeof bits);
+            uint32_t g = new_reg(s, false);
+            load_imm(s, g, (int64_t)bits);
+            ins(s, A64_FMOV, 2, def(reg), use(g));
+        }
+        return reg;
+    }
+    int64_t c;
+    if (const_int(v, &c)) {
+        reg = new_reg(s, false);
+        load_imm(s, reg, c);
+    } else if (v->kind == IR_VALUE_GLOBAL_SYMBOL && v->name) {
+        if (!is_function(s, v->name)) codegen__add_extern(s->cm, v->name);
+        reg = new_reg(s, false);
+        lea(s, reg, symbol_mem(v->name));
+    } else if (v->kind == IR_VALUE_TEMP && v->id < s->lf.temp_count &&
+               (s->frame_of[v->id] || s->covered[v->id])) {
+        reg = new_reg(s, false);
+        lea(s, reg, address_of(s, v));
+    } else if (is_local(s, v)) {
+        reg = local_reg(s, v);
+        have_real = value_real(s, v);
+    } else {
+        reg = new_reg(s, false);
+        load_imm(s, reg, 0);
+    }
+    if (have_real == real) return reg;
+    uint32_t out = new_reg(s, real);
+    ins(s, real ? A64_SCVTF : A64_FCVTZS, 2, def(out), use(reg));
+    return out;
+}
+
+/* -------------------------------------------------------------- addresses */
+
+/* Add reg * scale to m, computing what m cannot hold: one index, shifted
+ * by at most 3. */
+static void add_index(Isel *s, MirMem *m, uint32_t reg, uint64_t scale) {
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+        uint32_t factor = new_reg(s, false), scaled = new_reg(s, false);
+        load_imm(s, factor, (int64_t)scale);
+        ins(s, A64_MUL, 3, def(scaled), use(reg), use(factor));
+        reg = scaled;
+        scale = 1;
+    }
+    if (m->index != MIR_NO_REG) *m = mir__mem_base(address_reg(s, *m), 0);
+    if (m->base == MIR_NO_REG && !m->frame && !m->symbol && scale == 1) {
+        m->base = reg;
+        return;
+    }
+    m->index = reg;
+    m->scale = (uint8_t)scale;
+}
+
+static void add_disp(Isel *s, MirMem *m, int64_t off) {
+    int64_t disp = (int64_t)m->disp + off;
+    if (fits_int32(disp)) {
+        m->disp = (int32_t)disp;
+        return;
+    }
+    uint32_t reg = new_reg(s, false);
+    load_imm(s, reg, off);
+    add_index(s, m, reg, 1);
+}
+
+static MirMem gep_address(Isel *s, const IrInstruction *gep) {
+    MirMem m = address_of(s, gep->operand1);
+    uint32_t scale = lower__gep_scale(gep);
+    const IrGepExtra *extra = gep->extra;
+    uint32_t n = 1 + (extra ? extra->index_count : 0);
+    for (uint32_t i = 0; i < n; i++) {
+        const IrValue *idx = i == 0 ? gep->operand2 : extra->indices[i - 1];
+        int64_t c;
+        if (!idx) continue;
+        if (idx->kind == IR_VALUE_STRUCT_FIELD) add_disp(s, &m, lower__field_offset(idx));
+        else if (const_int(idx, &c)) add_disp(s, &m, (int64_t)((uint64_t)c * scale));
+        else add_index(s, &m, value_reg(s, idx, false), scale);
+    }
+    return m;
+}
+
+/* The memory a pointer value points at. */
+static MirMem address_of(Isel *s, const IrValue *ptr) {
+    if (ptr && ptr->kind == IR_VALUE_TEMP && ptr->id < s->lf.temp_count) {
+        if (s->frame_of[ptr->id]) return frame_mem(s->frame_of[ptr->id] - 1);
+        if (s->covered[ptr->id]) return gep_address(s, lower__def(&s->lf, ptr));
+    }
+    if (ptr && ptr->kind == IR_VALUE_GLOBAL_SYMBOL && ptr->name) {
+        if (!is_function(s, ptr->name)) codegen__add_extern(s->cm, ptr->name);
+        return symbol_mem(ptr->name);
+    }
+    return mir__mem_base(value_reg(s, ptr, false), 0);
+}
+
+/*
+ * m as a load or store of size bytes takes it: base or frame object plus
+ * a displacement, or base plus an index shifted by 0 or by the size.
+ * Symbols and anything else are computed first.
+ */
+static MirMem access(Isel *s, MirMem m, uint8_t size) {
+    if (m.index == MIR_NO_REG) return m.symbol ? mir__mem_base(address_reg(s, m), 0) : m;
+    if (m.disp || m.frame || m.symbol) {
+        MirMem anchor = m;
+        anchor.index = MIR_NO_REG;
+        anchor.scale = 1;
+        MirMem indexed = mir__mem_base(address_reg(s, anchor), 0);
+        indexed.index = m.index;
+        indexed.scale = m.scale;
+        m = indexed;
+    }
+    if (m.scale != 1 && m.scale != size) return mir__mem_base(address_reg(s, m), 0);
+    return m;
+}
+
+/* ------------------------------------------------------------------ flags */
+
+static bool is_compare(IrOpcode op) {
+    return op >= IR_EQ && op <= IR_GE;
+}
+
+/* Set the flags for cmp and return the condition true when it holds. */
+static int compare_flags(Isel *s, const IrInstruction *cmp) {
+    IrOpcode op = (IrOpcode)cmp->opcode;
+    if (value_real(s, cmp->operand1) || value_real(s, cmp->operand2)) {
+        uint32_t a = value_reg(s, cmp->operand1, true);
+        const IrValue *bv = cmp->operand2;
+        if (bv && bv->kind == IR_VALUE_CONST_REAL && bv->const_data.real_val == 0.0)
+            ins(s, A64_FCMP, 2, use(a), mir__imm(0));
+        else
+            ins(s, A64_FCMP, 2, use(a), use(value_reg(s, bv, true)));
+        /* mi and ls rather than lt and le: those hold when unordered. */
+        static const int cc[] = {
+            [IR_EQ] = A64_CC_EQ, [IR_NEQ] = A64_CC_NE, [IR_LT] = A64_CC_MI,
+            [IR_LE] = A64_CC_LS, [IR_GT] = A64_CC_GT, [IR_GE] = A64_CC_GE,
+        };
+        return cc[op];
+    }
+    static const int cc[] = {
+        [IR_EQ] = A64_CC_EQ, [IR_NEQ] = A64_CC_NE, [IR_LT] = A64_CC_LT,
+        [IR_LE] = A64_CC_LE, [IR_GT] = A64_CC_GT, [IR_GE] = A64_CC_GE,
+    };
+    static const int swapped[] = {
+        [IR_EQ] = A64_CC_EQ, [IR_NEQ] = A64_CC_NE, [IR_LT] = A64_CC_GT,
+        [IR_LE] = A64_CC_GE, [IR_GT] = A64_CC_LT, [IR_GE] = A64_CC_LE,
+    };
+    const IrValue *av = cmp->operand1, *bv = cmp->operand2;
+    int result = cc[op];
+    int64_t c;
+    if (arith_imm(av, &c) && !arith_imm(bv, &c)) {
+        const IrValue *t = av;
+        av = bv;
+        bv = t;
+        result = swapped[op];
+    }
+    uint32_t a = value_reg(s, av, false);
+    if (!arith_imm(bv, &c)) ins(s, A64_CMP, 2, use(a), use(value_reg(s, bv, false)));
+    else if (c < 0) ins(s, A64_CMN, 2, use(a), mir__imm(-c));
+    else ins(s, A64_CMP, 2, use(a), mir__imm(c));
+    return result;
+}
+
+/* The temp's defining compare when it was left to its user. */
+static const IrInstruction *covered_compare(const Isel *s, const IrValue *v) {
+    if (!v || v->kind != IR_VALUE_TEMP || v->id >= s->lf.temp_count || !s->covered[v->id]) return NULL;
+    const IrInstruction *def = lower__def(&s->lf, v);
+    return def && is_compare((IrOpcode)def->opcode) ? def : NULL;
+}
+
+/* Set the flags for the truth of cond. */
+static int truth_flags(Isel *s, const IrValue *cond) {
+    const IrInstruction *cmp = covered_compare(s, cond);
+    if (cmp) return compare_flags(s, cmp);
+    if (value_real(s, cond)) ins(s, A64_FCMP, 2, use(value_reg(s, cond, true)), mir__imm(0));
+    else ins(s, A64_CMP, 2, use(value_reg(s, cond, false)), mir__imm(0));
+    return A64_CC_NE;
+}
+
+/* ------------------------------------------------------------ instructions */
+
+/* The register an instruction's result goes to, or a throwaway one for a
+ * result nothing names. */
+static uint32_t result_reg(Isel *s, const IrInstruction *inst, bool real) {
+    if (is_local(s, inst->result) && value_real(s, inst->result) == real) return local_reg(s, inst->result);
+    return new_reg(s, real);
+}
+
+/* Move reg, of class real, into the result where the result is of the
+ * other class, keeping the bits. */
+static void finish(Isel *s, const IrInstruction *inst, uint32_t reg, bool real) {
+    if (!is_local(s, inst->result) || value_real(s, inst->result) == real) return;
+    ins(s, A64_FMOV, 2, def(local_reg(s, inst->result)), use(reg));
+}
+
+/* The multiply left to the add or subtract using v. */
+static const IrInstruction *covered_mul(const Isel *s, const IrValue *v) {
+    if (!v || v->kind != IR_VALUE_TEMP || v->id >= s->lf.temp_count || !s->covered[v->id]) return NULL;
+    const IrInstruction *def = lower__def(&s->lf, v);
+    return def && def->opcode == IR_MUL ? def : NULL;
+}
+
+/* r = acc +/- the covered multiply mul. */
+static void fuse(Isel *s, uint32_t r, const IrInstruction *mul, const IrValue *acc, bool sub) {
+    uint32_t a = value_reg(s, mul->operand1, false), b = value_reg(s, mul->operand2, false);
+    uint32_t c = value_reg(s, acc, false);
+    ins(s, sub ? A64_MSUB : A64_MADD, 4, def(r), use(a), use(b), use(c));
+}
+
+/* r = a + c or a - c for a constant c add and sub take. */
+static void add_imm(Isel *s, uint32_t r, uint32_t a, int64_t c, bool sub) {
+    if (c < 0) {
+        c = -c;
+        sub = !sub;
+    }
+    ins(s, sub ? A64_SUB : A64_ADD, 3, def(r), use(a), mir__imm(c));
+}
+
+static void select_int_binary(Isel *s, const IrInstruction *inst, IrOpcode op, uint32_t r) {
+    const IrValue *av = inst->operand1, *bv = inst->operand2;
+    int64_t c;
+    switch (op) {
+        case IR_ADD: {
+            const IrInstruction *mul;
+            if ((mul = covered_mul(s, av))) {
+                fuse(s, r, mul, bv, false);
+                return;
+            }
+            if ((mul = covered_mul(s, bv))) {
+                fuse(s, r, mul, av, false);
+                return;
+            }
+            if (arith_imm(av, &c) && !arith_imm(bv, &c)) {
+                const IrValue *t = av;
+                av = bv;
+                bv = t;
+            }
+            uint32_t a = value_reg(s, av, false);
+            if (arith_imm(bv, &c)) add_imm(s, r, a, c, false);
+            else ins(s, A64_ADD, 3, def(r), use(a), use(value_reg(s, bv, false)));
+            return;
+        }
+        case IR_SUB: {
+            const IrInstruction *mul = covered_mul(s, bv);
+            if (mul) {
+                fuse(s, r, mul, av, true);
+                return;
+            }
+            if (const_int(av, &c) && c == 0 && !const_int(bv, &c)) {
+                ins(s, A64_NEG, 2, def(r), use(value_reg(s, bv, false)));
+                return;
+            }
+            uint32_t a = value_reg(s, av, false);
+            if (arith_imm(bv, &c)) add_imm(s, r, a, c, true);
+            else ins(s, A64_SUB, 3, def(r), use(a), use(value_reg(s, bv, false)));
+            return;
+        }
+        case IR_MUL:
+            ins(s, A64_MUL, 3, def(r), use(value_reg(s, av, false)), use(value_reg(s, bv, false)));
+            return;
+        case IR_AND: case IR_OR: case IR_XOR: {
+            static const A64Opcode ops[] = { [IR_AND] = A64_AND, [IR_OR] = A64_ORR, [IR_XOR] = A64_EOR };
+            uint32_t field;
+            if (const_int(av, &c) && aarch64__logical_imm((uint64_t)c, &field)) {
+                const IrValue *t = av;
+                av = bv;
+                bv = t;
+            }
+            uint32_t a = value_reg(s, av, false);
+            if (const_int(bv, &c) && aarch64__logical_imm((uint64_t)c, &field))
+                ins(s, ops[op], 3, def(r), use(a), mir__imm(c));
+            else
+                ins(s, ops[op], 3, def(r), use(a), use(value_reg(s, bv, false)));
+            return;
+        }
+        case IR_SHL: case IR_SHR: case IR_SAR: {
+            uint32_t a = value_reg(s, av, false);
+            if (const_int(bv, &c)) {
+                A64Opcode x = op == IR_SHL ? A64_LSL : op == IR_SHR ? A64_LSR : A64_ASR;
+                ins(s, x, 3, def(r), use(a), mir__imm(c & 63));
+            } else {
+                A64Opcode x = op == IR_SHL ? A64_LSLV : op == IR_SHR ? A64_LSRV : A64_ASRV;
+                ins(s, x, 3, def(r), use(a), use(value_reg(s, bv, false)));
+            }
+            return;
+        }
+        case IR_DIV: case IR_MOD: {
+            uint32_t a = value_reg(s, av, false), b = value_reg(s, bv, false);
+            if (op == IR_DIV) {
+                ins(s, A64_SDIV, 3, def(r), use(a), use(b));
+            } else {
+                uint32_t q = new_reg(s, false);
+                ins(s, A64_SDIV, 3, def(q), use(a), use(b));
+                ins(s, A64_MSUB, 4, def(r), use(q), use(b), use(a));
+            }
+            return;
+        }
+        default: {
+            int cc = compare_flags(s, inst);
+            ins_cc(s, A64_CSET, cc, 1, def(r), mir__imm(0), mir__imm(0));
+            return;
+        }
+    }
+}
+
+static void emit_libcall(Isel *s, const char *name, const uint32_t *args, uint32_t n);
+
+static void select_real_binary(Isel *s, const IrInstruction *inst, IrOpcode op) {
+    uint32_t a = value_reg(s, inst->operand1, true), b = value_reg(s, inst->operand2, true);
+    uint32_t r = result_reg(s, inst, true);
+    switch (op) {
+        case IR_ADD: ins(s, A64_FADD, 3, def(r), use(a), use(b)); break;
+        case IR_SUB: ins(s, A64_FSUB, 3, def(r), use(a), use(b)); break;
+        case IR_MUL: ins(s, A64_FMUL, 3, def(r), use(a), use(b)); break;
+        case IR_DIV: ins(s, A64_FDIV, 3, def(r), use(a), use(b)); break;
+        case IR_MOD: {
+            uint32_t args[2] = { a, b };
+            emit_libcall(s, "fmod", args, 2);
+            copy(s, r, A64_D(0));
+            break;
+        }
+        default: break;
+    }
+    finish(s, inst, r, true);
+}
+
+static void select_binary(Isel *s, const IrInstruction *inst) {
+    IrOpcode op = (IrOpcode)inst->opcode;
+    bool real = op <= IR_GE && (value_real(s, inst->operand1) || value_real(s, inst->operand2));
+    if (real && !is_compare(op)) {
+        select_real_binary(s, inst, op);
+        return;
+    }
+    uint32_t r = result_reg(s, inst, false);
+    select_int_binary(s, inst, op, r);
+    finish(s, inst, r, false);
+}
+
+static void select_unary(Isel *s, const IrInstruction *inst) {
+    if (inst->opcode == IR_NEG && value_real(s, inst->operand1)) {
+        uint32_t r = result_reg(s, inst, true);
+        ins(s, A64_FNEG, 2, def(r), use(value_reg(s, inst->operand1, true)));
+        finish(s, inst, r, true);
+        return;
+    }
+    uint32_t r = result_reg(s, inst, false);
+    ins(s, inst->opcode == IR_NOT ? A64_MVN : A64_NEG, 2, def(r), use(value_reg(s, inst->operand1, false)));
+    finish(s, inst, r, false);
+}
+
+static void select_load(Isel *s, const IrInstruction *inst) {
+    LowerAccess acc = lower__access(&s->lf, inst->operand1);
+    uint8_t size = !acc.typed ? 8 : (uint8_t)acc.size;
+    MirMem m = access(s, address_of(s, inst->operand1), size);
+    if (size == 8) {
+        bool real = value_real(s, inst->result);
+        ins(s, A64_LDR, 2, def(result_reg(s, inst, real)), mem(m, 8));
+    } else if (acc.is_real) {
+        uint32_t single = new_reg(s, true), r = result_reg(s, inst, true);
+        ins(s, A64_LDR, 2, sized(def(single), 4), mem(m, 4));
+        ins(s, A64_FCVT, 2, def(r), sized(use(single), 4));
+        finish(s, inst, r, true);
+    } else {
+        uint32_t r = result_reg(s, inst, false);
+        A64Opcode op = !acc.is_signed ? A64_LDR : size == 1 ? A64_LDRSB : size == 2 ? A64_LDRSH : A64_LDRSW;
+        ins(s, op, 2, def(r), mem(m, size));
+        finish(s, inst, r, false);
+    }
+}
+
+static void select_store(Isel *s, const IrInstruction *inst) {
+    LowerAccess acc = lower__access(&s->lf, inst->operand1);
+    const IrValue *v = inst->operand2;
+    bool real = acc.typed ? acc.is_real : value_real(s, v);
+    uint8_t size = acc.typed ? (uint8_t)acc.size : 8;
+    uint32_t x = value_reg(s, v, real);
+    if (real && size == 4) {
+        uint32_t single = new_reg(s, true);
+        ins(s, A64_FCVT, 2, sized(def(single), 4), use(x));
+        x = single;
+    }
+    MirMem m = access(s, address_of(s, inst->operand1), size);
+    ins(s, A64_STR, 2, use(x), mem(m, size));
+}
+
+static void select_alloca(Isel *s, const IrInstruction *inst) {
+    if (!is_local(s, inst->result) || inst->result->kind != IR_VALUE_TEMP) return;
+    if (s->frame_of[inst->result->id]) return;
+    /* Below the frame, until the function returns. */
+    uint32_t size = new_reg(s, false), rounded = new_reg(s, false), r = result_reg(s, inst, false);
+    ins(s, A64_ADD, 3, def(size), use(value_reg(s, inst->operand1, false)), mir__imm(15));
+    ins(s, A64_AND, 3, def(rounded), use(size), mir__imm(-16));
+    ins(s, A64_SUB, 3, def(A64_SP), use(A64_SP), use(rounded));
+    copy(s, r, A64_SP);
+    s->mf->dynamic_stack = true;
+}
+
+static void select_cast(Isel *s, const IrInstruction *inst) {
+    const Type *t = inst->result->type_info;
+    DataType to = ir__datatype_of(t);
+    uint32_t size = ir__type_size(t);
+    if (to == TYPE_REAL) {
+        uint32_t r = result_reg(s, inst, true), v = value_reg(s, inst->operand1, true);
+        if (size == 4) {
+            uint32_t single = new_reg(s, true);
+            ins(s, A64_FCVT, 2, sized(def(single), 4), use(v));
+            ins(s, A64_FCVT, 2, def(r), sized(use(single), 4));
+        } else {
+            copy(s, r, v);
+        }
+        finish(s, inst, r, true);
+        return;
+    }
+    uint32_t r = result_reg(s, inst, false), v = value_reg(s, inst->operand1, false);
+    if (to == TYPE_CHAR) ins(s, A64_UXTB, 2, sized(def(r), 4), sized(use(v), 4));
+    else if (to == TYPE_INT && size == 1) ins(s, A64_SXTB, 2, def(r), sized(use(v), 4));
+    else if (to == TYPE_INT && size == 2) ins(s, A64_SXTH, 2, def(r), sized(use(v), 4));
+    else if (to == TYPE_INT && size == 4) ins(s, A64_SXTW, 2, def(r), sized(use(v), 4));
+    else copy(s, r, v);
+    finish(s, inst, r, false);
+}
+
+static void select_select(Isel *s, const IrInstruction *inst) {
+    if (!is_local(s, inst->result)) return;
+    bool real = value_real(s, inst->result);
+    const IrSelectExtra *sel = inst->extra;
+    /* Both values first: nothing may come between the flags and csel. */
+    uint32_t f = value_reg(s, sel->false_value, real), t = value_reg(s, inst->operand2, real);
+    int cc = truth_flags(s, inst->operand1);
+    ins_cc(s, real ? A64_FCSEL : A64_CSEL, cc, 3, def(local_reg(s, inst->result)), use(t), use(f));
+}
+
+/* AAPCS64 placement of arguments of the given classes. */
+static void place_args(const bool *real, uint32_t n, ArgPlace *places) {
+    uint32_t ints = 0, reals = 0, stack = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        places[i] = (ArgPlace){ real[i], MIR_NO_REG, 0 };
+        if (real[i] && reals < 8) places[i].reg = A64_D(reals++);
+        else if (!real[i] && ints < 8) places[i].reg = A64_X(ints++);
+        else places[i].stack = stack++;
+    }
+}
+
+/* bl name with the registers the arguments are in, after the values are
+ * where place_args put them. */
+static void emit_bl(Isel *s, const char *name, const ArgPlace *places, uint32_t n) {
+    uint32_t regs = 0;
+    for (uint32_t i = 0; i < n; i++) regs += places[i].reg != MIR_NO_REG;
+    MirInst *call = mir__inst_new(s->mf, A64_BL, (uint8_t)(1 + regs));
+    if (call) {
+        call->ops[0] = mir__symbol(name);
+        for (uint32_t i = 0, k = 1; i < n; i++)
+            if (places[i].reg != MIR_NO_REG) call->ops[k++] = implicit(use(places[i].reg));
+        call->flags |= MIR_INST_CALL;
+        call->line = s->line;
+        call->column = s->column;
+        mir__inst_append(s->mb, call);
+    }
+    s->mf->has_calls = true;
+}
+
+/*
+ * Call name with args placed by class: the values first, then the stack
+ * area, then the argument registers, so no fixed register is live while
+ * another value is computed.  The result, of class ret_real, goes to the
+ * instruction's result.
+ */
+static void emit_call(Isel *s, const IrInstruction *inst, const char *name,
+                      const IrValue *const *args, const bool *real, uint32_t n, bool ret_real) {
+    ArgPlace *places = malloc((n ? n : 1) * sizeof(ArgPlace));
+    uint32_t *vals = malloc((n ? n : 1) * sizeof(uint32_t));
+    int64_t *imms = malloc((n ? n : 1) * sizeof(int64_t));
+    if (!places || !vals || !imms) {
+        free(places);
+        free(vals);
+        free(imms);
+        s->mf->oom = true;
+        return;
+    }
+    place_args(real, n, places);
+    uint32_t stack = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        /* Constants for registers are loaded straight into them. */
+        vals[i] = MIR_NO_REG;
+        if (places[i].reg != MIR_NO_REG && !real[i] && const_int(args[i], &imms[i])) continue;
+        vals[i] = value_reg(s, args[i], real[i]);
+        if (places[i].reg == MIR_NO_REG) stack++;
+    }
+    int64_t area = (int64_t)((stack * 8 + 15) & ~15U);
+    if (area) ins(s, A64_SUB, 3, def(A64_SP), use(A64_SP), mir__imm(area));
+    for (uint32_t i = 0; i < n; i++) {
+        if (places[i].reg != MIR_NO_REG) continue;
+        ins(s, A64_STR, 2, use(vals[i]), mem(mir__mem_base(A64_SP, (int32_t)places[i].stack * 8), 8));
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (places[i].reg == MIR_NO_REG) continue;
+        if (vals[i] == MIR_NO_REG) load_imm(s, places[i].reg, imms[i]);
+        else copy(s, places[i].reg, vals[i]);
+    }
+    emit_bl(s, name, places, n);
+    if (area) ins(s, A64_ADD, 3, def(A64_SP), use(A64_SP), mir__imm(area));
+    if (is_local(s, inst->result)) {
+        uint32_t r = result_reg(s, inst, ret_real);
+        copy(s, r, ret_real ? A64_D(0) : A64_X(0));
+        finish(s, inst, r, ret_real);
+    }
+    free(places);
+    free(vals);
+    free(imms);
+}
+
+/* A runtime routine taking reals in registers; the result stays in d0. */
+static void emit_libcall(Isel *s, const char *name, const uint32_t *args, uint32_t n) {
+    ArgPlace places[8];
+    bool real[8] = { true, true, true, true, true, true, true, true };
+    place_args(real, n, places);
+    for (uint32_t i = 0; i < n; i++) copy(s, places[i].reg, args[i]);
+    codegen__add_extern(s->cm, name);
+    emit_bl(s, name, places, n);
+}
+
+/* `signal` is the system call itself, laid out as svc.hp has it: the
+ * service in x8, arguments in x0-x5. */
+static void select_signal(Isel *s, const IrValue *const *args, uint32_t argc) {
+    static const uint32_t regs[7] = { A64_X8, A64_X(0), A64_X(1), A64_X(2), A64_X(3), A64_X(4), A64_X(5) };
+    uint32_t n = argc < 7 ? argc : 7;
+    uint32_t vals[7];
+    int64_t imms[7];
+    for (uint32_t i = 0; i < n; i++)
+        vals[i] = const_int(args[i], &imms[i]) ? MIR_NO_REG : value_reg(s, args[i], false);
+    for (uint32_t i = 0; i < n; i++) {
+        if (vals[i] == MIR_NO_REG) load_imm(s, regs[i], imms[i]);
+        else copy(s, regs[i], vals[i]);
+    }
+    MirInst *svc = mir__inst_new(s->mf, A64_SVC, (uint8_t)(n + 2));
+    if (!svc) return;
+    uint8_t k = 0;
+    svc->ops[k++] = mir__imm(0);
+    svc->ops[k++] = implicit(n > 1 ? both(A64_X(0)) : def(A64_X(0)));
+    for (uint32_t i = 0; i < n; i++)
+        if (regs[i] != A64_X(0)) svc->ops[k++] = implicit(use(regs[i]));
+    svc->count = k;
+    svc->line = s->line;
+    svc->column = s->column;
+    mir__inst_append(s->mb, svc);
+}
+
+static void select_call(Isel *s, const IrInstruction *inst) {
+    const IrCallExtra *call = inst->extra;
+    const IrValue *const *args = call ? (const IrValue *const *)call->args : NULL;
+    uint32_t argc = call ? call->arg_count : 0;
+    const char *name = inst->operand1 && inst->operand1->kind == IR_VALUE_GLOBAL_SYMBOL
+                     ? inst->operand1->name : NULL;
+    uint32_t f = lower__callee(&s->cm->lm, inst);
+    if (f != UINT32_MAX) {
+        const IrFunction *callee = s->cm->mod->functions[f];
+        uint32_t n = callee->param_count;
+        const IrValue **vals = malloc((n ? n : 1) * sizeof(IrValue *));
+        bool *real = malloc(n ? n : 1);
+        if (vals && real) {
+            for (uint32_t i = 0; i < n; i++) {
+                vals[i] = i < argc ? args[i] : NULL;
+                real[i] = lower__param_is_real(callee, i);
+            }
+            emit_call(s, inst, callee->name, vals, real, n, lower__returns_real(callee));
+        } else {
+            s->mf->oom = true;
+        }
+        free(vals);
+        free(real);
+        return;
+    }
+    if (name && strcmp(name, IR_RUNTIME_SIGNAL) == 0) {
+        select_signal(s, args, argc);
+        return;
+    }
+    if (name && strcmp(name, IR_RUNTIME_HALT) == 0) {
+        InterpServices svc = interp__services(s->cm->opts->target_arch);
+        load_imm(s, A64_X8, (int64_t)svc.exit_group);
+        load_imm(s, A64_X(0), 0);
+        ins(s, A64_SVC, 3, mir__imm(0), implicit(both(A64_X(0))), implicit(use(A64_X8)));
+        return;
+    }
+    if (!name) {
+        errhandler__report_error(ERROR_CODE_CODEGEN_UNSUPPORTED, s->line, (uint8_t)s->column, "codegen",
+                                 "Indirect call in %s", s->func->name);
+        return;
+    }
+    /* The runtime and anything else defined elsewhere: arguments by class. */
+    uint32_t n = argc < 16 ? argc : 16;
+    bool real[16];
+    for (uint32_t i = 0; i < n; i++) real[i] = value_real(s, args[i]);
+    codegen__add_extern(s->cm, name);
+    emit_call(s, inst, name, args, real, n, value_real(s, inst->result));
+}
+
+/*
+ * A loop over i from 0 to count in blocks of its own: the current block
+ * branches past it when count is 0, and what follows the loop goes to
+ * the block after it.  Returns the loop block, with s->mb left on it.
+ */
+static MirBlock *open_loop(Isel *s, uint32_t i, uint32_t count, MirBlock **rest) {
+    uint32_t at = s->mb->id + 1;
+    MirBlock *loop = mir__block_insert(s->mf, at, NULL);
+    MirBlock *after = mir__block_insert(s->mf, at + 1, NULL);
+    if (!loop || !after) return NULL;
+    loop->loop_depth = s->mb->loop_depth + 1;
+    after->loop_depth = s->mb->loop_depth;
+    after->exec_count = s->mb->exec_count;
+    loop->cold = after->cold = s->mb->cold;
+    load_imm(s, i, 0);
+    ins(s, A64_CBZ, 2, use(count), mir__block(after));
+    s->mb = loop;
+    *rest = after;
+    return loop;
+}
+
+static void close_loop(Isel *s, MirBlock *loop, MirBlock *rest, uint32_t i, uint32_t count) {
+    ins(s, A64_ADD, 3, def(i), use(i), mir__imm(1));
+    ins(s, A64_CMP, 2, use(i), use(count));
+    ins_cc(s, A64_BCOND, A64_CC_NE, 1, mir__block(loop), mir__imm(0), mir__imm(0));
+    s->mb = rest;
+}
+
+static void select_mem(Isel *s, const IrInstruction *inst) {
+    const IrMemExtra *extra = inst->extra;
+    uint32_t count = value_reg(s, extra->count, false);
+    uint32_t dst = value_reg(s, inst->operand1, false);
+    uint32_t i = new_reg(s, false);
+    MirBlock *loop, *rest;
+    if (inst->opcode == IR_MEMCPY) {
+        /* Byte by byte upwards, like the loop it replaced. */
+        uint32_t src = value_reg(s, inst->operand2, false);
+        uint32_t bytes = count;
+        if (extra->elem_size != 1) {
+            uint32_t size = new_reg(s, false);
+            bytes = new_reg(s, false);
+            load_imm(s, size, extra->elem_size);
+            ins(s, A64_MUL, 3, def(bytes), use(count), use(size));
+        }
+        if (!(loop = open_loop(s, i, bytes, &rest))) return;
+        uint32_t byte = new_reg(s, false);
+        MirMem from = mir__mem_base(src, 0), to = mir__mem_base(dst, 0);
+        from.index = to.index = i;
+        ins(s, A64_LDR, 2, def(byte), mem(from, 1));
+        ins(s, A64_STR, 2, use(byte), mem(to, 1));
+        close_loop(s, loop, rest, i, bytes);
+        return;
+    }
+    uint32_t value;
+    if (value_real(s, inst->operand2)) {
+        uint32_t x = value_reg(s, inst->operand2, true);
+        value = new_reg(s, false);
+        if (extra->elem_size == 4) {
+            uint32_t single = new_reg(s, true);
+            ins(s, A64_FCVT, 2, sized(def(single), 4), use(x));
+            ins(s, A64_FMOV, 2, sized(def(value), 4), sized(use(single), 4));
+        } else {
+            ins(s, A64_FMOV, 2, def(value), use(x));
+        }
+    } else {
+        value = value_reg(s, inst->operand2, false);
+    }
+    uint8_t size = (uint8_t)extra->elem_size;
+    uint32_t elems = count;
+    if (size != 1 && size != 2 && size != 4 && size != 8) {
+        /* Only zero fills come in other sizes. */
+        uint32_t factor = new_reg(s, false);
+        elems = new_reg(s, false);
+        load_imm(s, factor, size);
+        ins(s, A64_MUL, 3, def(elems), use(count), use(factor));
+        size = 1;
+    }
+    if (!(loop = open_loop(s, i, elems, &rest))) return;
+    MirMem to = mir__mem_base(dst, 0);
+    to.index = i;
+    to.scale = size;
+    ins(s, A64_STR, 2, use(value), mem(to, size));
+    close_loop(s, loop, rest, i, elems);
+}
+
+static void select_return(Isel *s, const IrValue *value) {
+    bool real = lower__returns_real(s->func);
+    if (real) {
+        copy(s, A64_D(0), value_reg(s, value ? value : NULL, true));
+    } else if (value) {
+        int64_t c;
+        if (const_int(value, &c)) load_imm(s, A64_X(0), c);
+        else copy(s, A64_X(0), value_reg(s, value, false));
+    } else {
+        load_imm(s, A64_X(0), 0);
+    }
+    MirInst *ret = ins(s, A64_RET, 1, implicit(use(real ? A64_D(0) : A64_X(0))));
+    if (ret) ret->flags |= MIR_INST_RETURN;
+}
+
+static bool has_phis(const IrBasicBlock *bb) {
+    return bb->first_inst && bb->first_inst->opcode == IR_PHI;
+}
+
+/* Copies the phis of `to` need on the edge from `from`.  They happen at
+ * once, so when one reads what another writes all go through new
+ * registers first. */
+static void edge_copies(Isel *s, const IrBasicBlock *from, const IrBasicBlock *to) {
+    uint32_t n = 0;
+    for (const IrInstruction *p = to->first_inst; p && p->opcode == IR_PHI; p = p->next) n++;
+    if (n == 0) return;
+    struct { uint32_t dst, src; } *moves = malloc(n * sizeof(*moves));
+    if (!moves) {
+        s->mf->oom = true;
+        return;
+    }
+    uint32_t k = 0;
+    for (const IrInstruction *p = to->first_inst; p && p->opcode == IR_PHI; p = p->next) {
+        const IrPhiExtra *phi = p->extra;
+        if (!is_local(s, p->result)) continue;
+        for (uint32_t i = 0; i < phi->count; i++) {
+            if (phi->blocks[i] != from) continue;
+            moves[k].dst = local_reg(s, p->result);
+            moves[k].src = value_reg(s, phi->values[i], value_real(s, p->result));
+            k++;
+            break;
+        }
+    }
+    bool overlap = false;
+    for (uint32_t i = 0; i < k && !overlap; i++)
+        for (uint32_t j = 0; j < k; j++)
+            if (i != j && moves[j].src == moves[i].dst) overlap = true;
+    if (overlap) {
+        for (uint32_t i = 0; i < k; i++) {
+            uint32_t t = new_reg(s, is_fpr(s, moves[i].dst));
+            copy(s, t, moves[i].src);
+            moves[i].src = t;
+        }
+    }
+    for (uint32_t i = 0; i < k; i++) copy(s, moves[i].dst, moves[i].src);
+    free(moves);
+}
+
+/* The block a branch from `from` to `to` jumps to: `to` itself, or a new
+ * block making the phi copies of that edge. */
+static MirBlock *edge_target(Isel *s, const IrBasicBlock *from, const IrBasicBlock *to) {
+    MirBlock *target = s->block_of[to->id];
+    if (!has_phis(to)) return target;
+    MirBlock *edge = mir__block_add(s->mf, NULL);
+    if (!edge) return target;
+    edge->loop_depth = target->loop_depth;
+    edge->exec_count = target->exec_count;
+    edge->cold = target->cold || s->mb->cold;
+    MirBlock *saved = s->mb;
+    s->mb = edge;
+    edge_copies(s, from, to);
+    jump(s, target);
+    s->mb = saved;
+    return edge;
+}
+
+/* The block a conditional branch to `to` names: `to` itself, or, when it
+ * is in the other section, a block of this one holding a b to it.  Only
+ * b has a relocation that reaches another section. */
+static MirBlock *cond_target(Isel *s, MirBlock *to) {
+    if (to->cold == s->mb->cold) return to;
+    MirBlock *stub = mir__block_add(s->mf, NULL);
+    if (!stub) return to;
+    stub->loop_depth = to->loop_depth;
+    stub->exec_count = to->exec_count;
+    stub->cold = s->mb->cold;
+    MirBlock *saved = s->mb;
+    s->mb = stub;
+    jump(s, to);
+    s->mb = saved;
+    return stub;
+}
+
+static void select_brcond(Isel *s, const IrInstruction *inst) {
+    const IrCondBranchExtra *br = inst->extra;
+    const IrValue *cond = inst->operand1;
+    /* An integer tested for itself needs no flags: cbz and cbnz. */
+    if (!covered_compare(s, cond) && !value_real(s, cond)) {
+        uint32_t r = value_reg(s, cond, false);
+        MirBlock *t = edge_target(s, inst->parent, br->true_target);
+        MirBlock *f = edge_target(s, inst->parent, br->false_target);
+        if (t == s->next) {
+            ins(s, A64_CBZ, 2, use(r), mir__block(cond_target(s, f)));
+            return;
+        }
+        ins(s, A64_CBNZ, 2, use(r), mir__block(cond_target(s, t)));
+        if (f != s->next) jump(s, f);
+        return;
+    }
+    int cc = truth_flags(s, cond);
+    MirBlock *t = edge_target(s, inst->parent, br->true_target);
+    MirBlock *f = edge_target(s, inst->parent, br->false_target);
+    if (t == s->next) {
+        ins_cc(s, A64_BCOND, A64_CC_INVERT(cc), 1, mir__block(cond_target(s, f)), mir__imm(0), mir__imm(0));
+        return;
+    }
+    ins_cc(s, A64_BCOND, cc, 1, mir__block(cond_target(s, t)), mir__imm(0), mir__imm(0));
+    if (f != s->next) jump(s, f);
+}
+
+static void select_instruction(Isel *s, const IrInstruction *inst) {
+    IrOpcode op = (IrOpcode)inst->opcode;
+    s->line = inst->line;
+    s->column = inst->column;
+    if (inst->result && inst->result->kind == IR_VALUE_TEMP && inst->result->id < s->lf.temp_count &&
+        s->covered[inst->result->id])
+        return;
+    switch (op) {
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+        case IR_EQ: case IR_NEQ: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        case IR_AND: case IR_OR: case IR_XOR: case IR_SHL: case IR_SHR: case IR_SAR:
+            if (inst->result) select_binary(s, inst);
+            return;
+        case IR_NEG: case IR_NOT:
+            if (inst->result) select_unary(s, inst);
+            return;
+        case IR_LOAD:   if (inst->result) select_load(s, inst); return;
+        case IR_STORE:  select_store(s, inst); return;
+        case IR_ALLOCA: select_alloca(s, inst); return;
+        case IR_GEP:
+            if (is_local(s, inst->result)) lea(s, result_reg(s, inst, false), gep_address(s, inst));
+            return;
+        case IR_CAST:   if (inst->result) select_cast(s, inst); return;
+        case IR_CALL:   select_call(s, inst); return;
+        case IR_SELECT: select_select(s, inst); return;
+        case IR_RET:    select_return(s, inst->operand1); return;
+        case IR_BR: {
+            const IrBasicBlock *to = inst->operand1 ? inst->operand1->const_data.block : NULL;
+            if (!to) {
+                select_return(s, NULL);
+                return;
+            }
+            edge_copies(s, inst->parent, to);
+            if (s->block_of[to->id] != s->next) jump(s, s->block_of[to->id]);
+            return;
+        }
+        case IR_BRCOND: select_brcond(s, inst); return;
+        case IR_MEMSET: case IR_MEMCPY: select_mem(s, inst); return;
+        case IR_PHI: case IR_NOP:
+            return;
+        default:
+            errhandler__report_error(ERROR_CODE_CODEGEN_UNSUPPORTED, inst->line, (uint8_t)inst->column, "codegen",
+                                     "Cannot select opcode %u in %s", (unsigned)op, s->func->name);
+            return;
+    }
+}
+
+/* -------------------------------------------------------------- functions */
+
+static bool only_addressed(const IrValue *v) {
+    if (!v->uses) return false;
+    for (const IrUse *u = v->uses; u; u = u->next) {
+        uint16_t op = u->user->opcode;
+        if ((op != IR_LOAD && op != IR_STORE && op != IR_GEP) || u->slot != &u->user->operand1) return false;
+    }
+    return true;
+}
+
+/* A compare used once, by the branch or select that follows it. */
+static bool feeds_flags(const IrInstruction *cmp) {
+    const IrUse *u = cmp->result->uses;
+    if (!u || u->next || u->user != cmp->next || u->slot != &u->user->operand1) return false;
+    return u->user->opcode == IR_BRCOND || u->user->opcode == IR_SELECT;
+}
+
+/* An integer multiply used once, by an add or as what a subtract takes
+ * away, in its own block and not beside another fused multiply. */
+static bool feeds_madd(const Isel *s, const IrInstruction *mul) {
+    if (value_real(s, mul->operand1) || value_real(s, mul->operand2)) return false;
+    const IrUse *u = mul->result->uses;
+    if (!u || u->next || u->user->parent != mul->parent) return false;
+    const IrInstruction *user = u->user;
+    if (value_real(s, user->operand1) || value_real(s, user->operand2)) return false;
+    if (user->opcode == IR_SUB) return u->slot == &user->operand2;
+    if (user->opcode != IR_ADD) return false;
+    const IrValue *other = u->slot == &user->operand1 ? user->operand2 : user->operand1;
+    return !covered_mul(s, other);
+}
+
+/* Frame objects for allocas of a known size and the patterns selected
+ * with their users. */
+static void plan(Isel *s) {
+    for (uint32_t b = 0; b < s->func->block_count; b++) {
+        for (const IrInstruction *inst = s->func->all_blocks[b]->first_inst; inst; inst = inst->next) {
+            if (!inst->result || inst->result->kind != IR_VALUE_TEMP || inst->result->id >= s->lf.temp_count)
+                continue;
+            uint32_t t = inst->result->id;
+            if (inst->opcode == IR_ALLOCA) {
+                const IrValue *size = inst->operand1, *align = inst->operand2;
+                int64_t bytes;
+                if (!size) bytes = lower__slot_bytes(inst->result, UINT32_MAX);
+                else if (size->kind == IR_VALUE_CONST_INT && size->const_data.int_val >= 0 &&
+                         size->const_data.int_val <= INT32_MAX) bytes = size->const_data.int_val;
+                else continue;
+                int64_t a = align && align->kind == IR_VALUE_CONST_INT ? align->const_data.int_val : 8;
+                if (a < 8 || a > 16 || (a & (a - 1))) a = a > 16 ? 16 : 8;
+                s->frame_of[t] = mir__frame_object(s->mf, (uint32_t)bytes, (uint32_t)a) + 1;
+            } else if (inst->opcode == IR_GEP) {
+                s->covered[t] = only_addressed(inst->result);
+            } else if (is_compare((IrOpcode)inst->opcode)) {
+                s->covered[t] = feeds_flags(inst);
+            } else if (inst->opcode == IR_MUL) {
+                s->covered[t] = feeds_madd(s, inst);
+            }
+        }
+    }
+}
+
+/* Copy the parameters from where the convention passes them. */
+static void select_params(Isel *s) {
+    uint32_t n = s->func->param_count;
+    bool *real = calloc(n ? n : 1, sizeof(bool));
+    ArgPlace *places = calloc(n ? n : 1, sizeof(ArgPlace));
+    if (!real || !places) {
+        s->mf->oom = true;
+        free(real);
+        free(places);
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++) real[i] = lower__param_is_real(s->func, i);
+    place_args(real, n, places);
+    for (uint32_t i = 0; i < n; i++) {
+        const IrValue *p = s->func->parameters[i];
+        if (!p || p->uses == NULL) continue;
+        uint32_t v = local_reg(s, p);
+        if (places[i].reg != MIR_NO_REG) {
+            copy(s, v, places[i].reg);
+        } else {
+            /* Above the frame record. */
+            MirMem m = mir__mem_base(A64_X29, 16 + (int32_t)places[i].stack * 8);
+            ins(s, A64_LDR, 2, def(v), mem(m, 8));
+        }
+    }
+    free(real);
+    free(places);
+}
+
+MirFunction *aarch64__select(CodegenModule *cm, IrFunction *func) {
+    Isel s = { .cm = cm, .func = func };
+    if (!lower__function_init(&s.lf, &cm->lm, func)) return NULL;
+    s.mf = mir__function_create(func);
+    uint32_t values = func->param_count + s.lf.temp_count;
+    uint32_t temps = s.lf.temp_count ? s.lf.temp_count : 1;
+    s.block_of = calloc(func->next_block_id ? func->next_block_id : 1, sizeof(MirBlock *));
+    s.vreg = malloc((values ? values : 1) * sizeof(uint32_t));
+    s.frame_of = calloc(temps, sizeof(uint32_t));
+    s.covered = calloc(temps, 1);
+    const IrLoopInfo *loops = analysis__loops(func);
+    bool ok = s.mf && s.block_of && s.vreg && s.frame_of && s.covered;
+    if (ok) {
+        for (uint32_t i = 0; i < values; i++) s.vreg[i] = MIR_NO_REG;
+        plan(&s);
+        /* A block of its own for the parameters, then the IR's in layout
+         * order. */
+        MirBlock *entry = mir__block_add(s.mf, NULL);
+        for (uint32_t b = 0; b < func->block_count; b++) {
+            IrBasicBlock *bb = func->all_blocks[b];
+            MirBlock *mb = mir__block_add(s.mf, bb);
+            if (!mb) break;
+            if (loops) mb->loop_depth = analysis__loop_depth(loops, bb);
+            s.block_of[bb->id] = mb;
+        }
+        ok = entry && !s.mf->oom;
+        if (ok) {
+            s.mb = entry;
+            select_params(&s);
+            if (func->entry_block && s.block_of[func->entry_block->id] != s.mf->blocks[1])
+                jump(&s, s.block_of[func->entry_block->id]);
+            for (uint32_t b = 0; b < func->block_count && !s.mf->oom; b++) {
+                IrBasicBlock *bb = func->all_blocks[b];
+                s.mb = s.block_of[bb->id];
+                s.next = b + 1 < func->block_count ? s.block_of[func->all_blocks[b + 1]->id] : NULL;
+                /* The cold blocks go to a section of their own: none is
+                 * fallen into from a hot block, or out of into one. */
+                if (s.next && s.next->cold != s.mb->cold) s.next = NULL;
+                for (const IrInstruction *inst = bb->first_inst; inst; inst = inst->next)
+                    select_instruction(&s, inst);
+                /* A block without a terminator returns. */
+                const IrInstruction *last = bb->last_inst;
+                if (!last || (last->opcode != IR_BR && last->opcode != IR_BRCOND && last->opcode != IR_RET))
+                    select_return(&s, NULL);
+            }
+            ok = !s.mf->oom;
+        }
+    }
+    if (!ok) errhandler__report_error(ERROR_CODE_CODEGEN_MEMORY_ALLOCATION, 0, 0, "codegen",
+                                      "Out of memory selecting instructions for %s", func->name);
+    free(s.block_of);
+    free(s.vreg);
+    free(s.frame_of);
+    free(s.covered);
+    lower__function_fini(&s.lf);
+    if (!ok) {
+        mir__function_destroy(s.mf);
+        return NULL;
+    }
+    return s.mf;
+}
@@ -0,0 +1,368 @@
+#include "codegen.h"
+#include "regalloc/regalloc.h"
+#include "../errhandler/errhandler.h"
+#include "../utils/scheduler.h"
+#include <stdlib.h>
+#include <string.h>
+
+const CodegenTarget *codegen__target(const char *target_arch) {
+    if (!target_arch) {
+#if defined(__x86_64__) || defined(_M_X64)
+        return &codegen__x86_64;
+#elif defined(__aarch64__) || defined(_M_ARM64)
+        return &codegen__aarch64;
+#else
+        return NULL;
+#endif
+    }
+    if (strcmp(target_arch, "x86_64") == 0 || strcmp(target_arch, "amd64") == 0) return &codegen__x86_64;
+    if (strcmp(target_arch, "aarch64") == 0 || strcmp(target_arch, "arm") == 0) return &codegen__aarch64;
+    return NULL;
+}
+
+void codegen__add_extern(CodegenModule *cm, const char *name) {
+    for (uint32_t i = 0; i < cm->extern_count; i++)
+        if (strcmp(cm->externs[i], name) == 0) return;
+    if (cm->extern_count == cm->extern_capacity) {
+        uint32_t cap = cm->extern_capacity ? cm->extern_capacity * 2 : 8;
+        const char **grown = realloc(cm->externs, cap * sizeof(const char *));
+        if (!grown) return;
+        cm->externs = grown;
+        cm->extern_capacity = cap;
+    }
+    cm->externs[cm->extern_count++] = name;
+}
+
+/* Select, allocate and lay out one function; NULL once reported. */
+static MirFunction *compile_function(CodegenModule *cm, IrFunction *func, RegallocStats *stats) {
+    MirFunction *mf = cm->target->select(cm, func);
+    if (!mf) return NULL;
+    if (!regalloc__linear_scan(mf, cm->target, stats)) {
+        errhandler__report_error(ERROR_CODE_CODEGEN_REGALLOC, 0, 0, "codegen",
+                                 "Cannot allocate registers for %s", func->name);
+        mir__function_destroy(mf);
+        return NULL;
+    }
+    cm->target->lower_frame(mf);
+    if (mf->oom) {
+        errhandler__report_error(ERROR_CODE_CODEGEN_MEMORY_ALLOCATION, 0, 0, "codegen",
+                                 "Out of memory laying out the frame of %s", func->name);
+        mir__function_destroy(mf);
+        return NULL;
+    }
+    return mf;
+}
+
+/* One function's trip through the backend, and what it reported.  The
+ * module is copied with an extern list of its own, merged afterwards. */
+typedef struct {
+    CodegenModule  cm;
+    IrFunction    *func;
+    MirFunction   *mf;
+    RegallocStats  stats;
+    ErrorBuffer   *errors;
+} FunctionJob;
+
+static void compile_function_task(void *arg, uint32_t worker) {
+    (void)worker;
+    FunctionJob *job = arg;
+    job->errors = errhandler__buffer_begin();
+    job->mf = compile_function(&job->cm, job->func, &job->stats);
+    errhandler__buffer_end(job->errors);
+}
+
+/* The target and the lowering state of a module; false once reported. */
+static bool open_module(CodegenModule *cm, IrModule *mod, const CodegenOptions *opts) {
+    *cm = (CodegenModule){ .mod = mod, .opts = opts };
+    cm->target = codegen__target(opts->target_arch);
+    if (!cm->target) {
+        errhandler__report_error(ERROR_CODE_CODEGEN_NO_TARGET, 0, 0, "codegen",
+                                 "No native code generator for target %s",
+                                 opts->target_arch ? opts->target_arch : "of this host");
+        return false;
+    }
+    if (!lower__module_init(&cm->lm, mod)) {
+        errhandler__report_error(ERROR_CODE_CODEGEN_MEMORY_ALLOCATION, 0, 0, "codegen",
+                                 "Out of memory preparing code generation");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Every function of the module compiled, in module order; NULL once
+ * reported.  The functions are compiled on opts->threads threads, then
+ * their diagnostics, the --debug-info=compile report and the externs they
+ * use are taken in module order, so the output is the same whatever order
+ * they ran in.
+ */
+static MirFunction **compile_module(CodegenModule *cm) {
+    uint32_t count = cm->mod->func_count;
+    uint32_t threads = cm->opts->threads ? cm->opts->threads : u__cpu_count();
+    if (threads > count) threads = count ? count : 1;
+    MirFunction **funcs = calloc(count ? count : 1, sizeof(MirFunction *));
+    FunctionJob *jobs = calloc(count ? count : 1, sizeof(FunctionJob));
+    UScheduler *sched = funcs && jobs ? u__scheduler_create(threads) : NULL;
+    if (!sched) {
+        errhandler__report_error(ERROR_CODE_CODEGEN_MEMORY_ALLOCATION, 0, 0, "codegen",
+                                 "Out of memory preparing code generation");
+        free(funcs);
+        free(jobs);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        jobs[i].cm = (CodegenModule){ .mod = cm->mod, .lm = cm->lm, .target = cm->target, .opts = cm->opts };
+        jobs[i].func = cm->mod->functions[i];
+        if (!u__scheduler_submit(sched, compile_function_task, &jobs[i]))
+            compile_function_task(&jobs[i], 0);
+    }
+    u__scheduler_wait(sched);
+    u__scheduler_destroy(sched);
+    bool ok = true;
+    for (uint32_t i = 0; i < count; i++) {
+        FunctionJob *job = &jobs[i];
+        errhandler__buffer_commit(job->errors);
+        funcs[i] = job->mf;
+        ok &= funcs[i] != NULL;
+        for (uint32_t e = 0; e < job->cm.extern_count; e++) codegen__add_extern(cm, job->cm.externs[e]);
+        free(job->cm.externs);
+        if (job->mf && cm->opts->debug)
+            fprintf(cm->opts->debug, "codegen %s: %u blocks, %u vregs, %u spill slots, %u spills, %u reloads, "
+                    "%u remats, %u saved around calls, %u-byte frame\n",
+                    job->func->name, job->mf->block_count, job->mf->vreg_count, job->stats.spill_slots,
+                    job->stats.spills, job->stats.reloads, job->stats.remats, job->stats.split,
+                    job->mf->frame_size);
+    }
+    free(jobs);
+    if (ok) return funcs;
+    for (uint32_t i = 0; i < count; i++) mir__function_destroy(funcs[i]);
+    free(funcs);
+    return NULL;
+}
+
+static void close_module(CodegenModule *cm, MirFunction **funcs) {
+    for (uint32_t i = 0; funcs && i < cm->mod->func_count; i++) mir__function_destroy(funcs[i]);
+    free(funcs);
+    free(cm->externs);
+    lower__module_fini(&cm->lm);
+}
+
+bool codegen__write_assembly(IrModule *mod, const CodegenOptions *opts, const char *source, FILE *out) {
+    CodegenModule cm;
+    if (!open_module(&cm, mod, opts)) return false;
+    /* Every function first: the header lists the symbols they use. */
+    MirFunction **funcs = compile_module(&cm);
+    if (funcs) {
+        cm.target->print_header(out, &cm, source);
+        for (uint32_t i = 0; i < mod->func_count; i++) cm.target->print_function(out, &cm, funcs[i]);
+    }
+    close_module(&cm, funcs);
+    return funcs != NULL;
+}
+
+uint8_t *codegen__code_grow(CodegenCode *code, uint64_t n) {
+    if (code->size + n > code->capacity) {
+        uint64_t cap = code->capacity ? code->capacity * 2 : 4096;
+        while (cap < code->size + n) cap *= 2;
+        uint8_t *grown = realloc(code->bytes, cap);
+        if (!grown) return NULL;
+        code->bytes = grown;
+        code->capacity = cap;
+    }
+    uint8_t *at = code->bytes + code->size;
+    code->size += n;
+    return at;
+}
+
+bool codegen__code_reloc(CodegenCode *code, uint64_t offset, const char *symbol, uint32_t type, int64_t addend) {
+    if (code->reloc_count == code->reloc_capacity) {
+        uint32_t cap = code->reloc_capacity ? code->reloc_capacity * 2 : 64;
+        CodegenReloc *grown = realloc(code->relocs, cap * sizeof(CodegenReloc));
+        if (!grown) return false;
+        code->relocs = grown;
+        code->reloc_capacity = cap;
+    }
+    code->relocs[code->reloc_count++] = (CodegenReloc){ offset, symbol, type, addend };
+    return true;
+}
+
+bool codegen__block_reloc(CodegenCode *code, uint64_t offset, const MirFunction *mf, uint64_t pc,
+                          uint32_t type, int64_t addend) {
+    if (!codegen__code_reloc(code, offset, mf->name, type, (int64_t)(pc & ~CODEGEN_COLD_PC) + addend))
+        return false;
+    code->relocs[code->reloc_count - 1].cold = (pc & CODEGEN_COLD_PC) != 0;
+    return true;
+}
+
+/* The sections and symbols of an object being written: by function, the
+ * section and symbol of its code and of its cold part, 0 and -1 for a
+ * function without one; then those of the externs. */
+typedef struct {
+    const CodegenModule *cm;
+    BuildObjectWriter   *w;
+    const CodegenExtent *extent;
+    uint32_t            *sections, *cold_sections;
+    int                 *symbols, *cold_symbols;
+} ObjectLayout;
+
+/* The symbol index of a relocation's symbol: a function of the module,
+ * its cold part, or one of the externs; -1 for none. */
+static int symbol_index(const ObjectLayout *o, const CodegenReloc *r) {
+    const CodegenModule *cm = o->cm;
+    uint32_t f = lower__find_function(&cm->lm, r->symbol);
+    if (f != UINT32_MAX) return r->cold ? o->cold_symbols[f] : o->symbols[f];
+    for (uint32_t i = 0; !r->cold && i < cm->extern_count; i++)
+        if (strcmp(cm->externs[i], r->symbol) == 0) return o->symbols[cm->mod->func_count + i];
+    return -1;
+}
+
+/* The section of function i's code, or with cold of its cold part, from
+ * start to end of code: a section of its own with -ffunction-sections,
+ * else the one shared by every function; 0 when the writer fails. */
+static uint32_t function_section(const ObjectLayout *o, const CodegenCode *code, uint32_t i, bool cold,
+                                 uint32_t *shared) {
+    const char *prefix = cold ? LAYOUT_COLD_SECTION : ".text";
+    if (!o->cm->opts->function_sections) {
+        if (!*shared) *shared = build__add_section(o->w, SECTION_TEXT, prefix, code->bytes, code->size, 16);
+        return *shared;
+    }
+    uint64_t start = cold ? o->extent[i].cold_start : o->extent[i].start;
+    uint64_t end = cold ? o->extent[i].cold_end : o->extent[i].end;
+    const char *name = o->cm->mod->functions[i]->name;
+    size_t len = strlen(prefix) + strlen(name) + 2;
+    char *section = malloc(len);
+    if (!section) return 0;
+    snprintf(section, len, "%s.%s", prefix, name);
+    uint32_t index = build__add_section(o->w, SECTION_TEXT, section, code->bytes + start, end - start, 16);
+    free(section);
+    return index;
+}
+
+/* The symbol of function i's cold part, a local <name>.cold; -1 when the
+ * writer fails. */
+static int cold_symbol(const ObjectLayout *o, uint32_t i) {
+    const CodegenExtent *e = &o->extent[i];
+    const char *name = o->cm->mod->functions[i]->name;
+    size_t len = strlen(name) + sizeof ".cold";
+    char *cold = malloc(len);
+    if (!cold) return -1;
+    snprintf(cold, len, "%s.cold", name);
+    uint64_t value = o->cm->opts->function_sections ? 0 : e->cold_start;
+    BuildSymbol sym = { cold, value, e->cold_end - e->cold_start, o->cold_sections[i], SYMBOL_LOCAL };
+    int index = build__add_symbol(o->w, &sym);
+    free(cold);
+    return index;
+}
+
+/* The relocations of code, the functions' code or with cold their cold
+ * parts.  They come in the order of the functions holding them. */
+static bool add_relocations(const ObjectLayout *o, const CodegenCode *code, bool cold) {
+    uint32_t count = o->cm->mod->func_count, f = 0;
+    for (uint32_t i = 0; i < code->reloc_count; i++) {
+        const CodegenReloc *r = &code->relocs[i];
+        while (f + 1 < count && r->offset >= (cold ? o->extent[f].cold_end : o->extent[f].end)) f++;
+        uint64_t start = cold ? o->extent[f].cold_start : o->extent[f].start;
+        uint64_t offset = o->cm->opts->function_sections ? r->offset - start : r->offset;
+        BuildRelocation rel = { offset, symbol_index(o, r), r->type, r->addend };
+        if (rel.symbol < 0 || build__add_relocation(o->w, cold ? o->cold_sections[f] : o->sections[f], &rel) != 0)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Locals come first in an ELF symbol table, so the internal functions and
+ * the cold parts are added before the public functions and the undefined
+ * externs after them.  With function sections each relocation goes to the
+ * section of the function holding it, at an offset from the function's
+ * start.
+ */
+static bool write_object(const CodegenModule *cm, const CodegenCode *code, const CodegenCode *cold,
+                         const CodegenExtent *extent, const char *path) {
+    const IrModule *mod = cm->mod;
+    size_t count = mod->func_count ? mod->func_count : 1;
+    ObjectLayout o = { cm, build__create(path, cm->target->machine), extent,
+                       calloc(count, sizeof(uint32_t)), calloc(count, sizeof(uint32_t)),
+                       malloc(((size_t)mod->func_count + cm->extern_count + 1) * sizeof(int)),
+                       malloc(count * sizeof(int)) };
+    bool ok = o.w && o.sections && o.cold_sections && o.symbols && o.cold_symbols;
+    uint32_t text = 0, cold_text = 0;
+    for (uint32_t i = 0; ok && i < mod->func_count; i++) {
+        bool has_cold = extent[i].cold_end > extent[i].cold_start;
+        o.sections[i] = function_section(&o, code, i, false, &text);
+        if (has_cold) o.cold_sections[i] = function_section(&o, cold, i, true, &cold_text);
+        ok = o.sections[i] != 0 && (!has_cold || o.cold_sections[i] != 0);
+    }
+    for (int pass = 0; ok && pass < 2; pass++) {
+        for (uint32_t i = 0; ok && i < mod->func_count; i++) {
+            const IrFunction *func = mod->functions[i];
+            if (pass == 0) {
+                o.cold_symbols[i] = o.cold_sections[i] ? cold_symbol(&o, i) : -1;
+                ok = !o.cold_sections[i] || o.cold_symbols[i] >= 0;
+            }
+            if (func->is_internal != (pass == 0)) continue;
+            uint64_t value = cm->opts->function_sections ? 0 : extent[i].start;
+            BuildSymbol sym = { func->name, value, extent[i].end - extent[i].start, o.sections[i],
+                                func->is_internal ? SYMBOL_LOCAL : SYMBOL_GLOBAL };
+            o.symbols[i] = build__add_symbol(o.w, &sym);
+            ok = o.symbols[i] >= 0;
+        }
+    }
+    for (uint32_t i = 0; ok && i < cm->extern_count; i++) {
+        BuildSymbol sym = { cm->externs[i], 0, 0, 0, SYMBOL_GLOBAL };
+        o.symbols[mod->func_count + i] = build__add_symbol(o.w, &sym);
+        ok = o.symbols[mod->func_count + i] >= 0;
+    }
+    ok = ok && add_relocations(&o, code, false) && add_relocations(&o, cold, true);
+    free(o.sections);
+    free(o.cold_sections);
+    free(o.symbols);
+    free(o.cold_symbols);
+    if (!ok) {
+        build__destroy(o.w);
+        return false;
+    }
+    return build__finalize(o.w) == 0;
+}
+
+bool codegen__write_object(IrModule *mod, const CodegenOptions *opts, const char *path) {
+    CodegenModule cm;
+    if (!open_module(&cm, mod, opts)) return false;
+    if (!cm.target->assemble) {
+        errhandler__report_error(ERROR_CODE_CODEGEN_NO_TARGET, 0, 0, "codegen",
+                                 "No integrated assembler for target %s; use -S", cm.target->name);
+        close_module(&cm, NULL);
+        return false;
+    }
+    MirFunction **funcs = compile_module(&cm);
+    CodegenExtent *extent = calloc(mod->func_count ? mod->func_count : 1, sizeof(CodegenExtent));
+    CodegenCode code = { .debug = opts->debug }, cold = { .debug = opts->debug };
+    bool ok = funcs != NULL;
+    if (ok && !extent) {
+        errhandler__report_error(ERROR_CODE_CODEGEN_MEMORY_ALLOCATION, 0, 0, "codegen",
+                                 "Out of memory assembling %s", path);
+        ok = false;
+    }
+    for (uint32_t i = 0; ok && i < mod->func_count; i++) {
+        if (cm.target->assemble(funcs[i], &code, &cold, &extent[i])) continue;
+        if (code.failed)
+            errhandler__report_error(ERROR_CODE_CODEGEN_ENCODING, code.failed->line, (uint8_t)code.failed->column,
+                                     "codegen", "Cannot encode a %s instruction in %s",
+                                     cm.target->name, funcs[i]->name);
+        else
+            errhandler__report_error(ERROR_CODE_CODEGEN_MEMORY_ALLOCATION, 0, 0, "codegen",
+                                     "Out of memory assembling %s", funcs[i]->name);
+        ok = false;
+    }
+    if (ok && !write_object(&cm, &code, &cold, extent, path)) {
+        errhandler__report_error(ERROR_CODE_IO_WRITE, 0, 0, "file", "Cannot write object file: %s", path);
+        ok = false;
+    }
+    free(code.bytes);
+    free(code.relocs);
+    free(cold.bytes);
+    free(cold.relocs);
+    free(extent);
+    close_module(&cm, funcs);
+    return ok;
+}
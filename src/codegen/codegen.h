@@ -0,0 +1,143 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "../ir/ir.h"
+#include "../ir/lower/lower.h"
+#include "../ir/layout/layout.h"
+#include "mir/mir.h"
+#include "../build/build.h"
+
+/*
+ * Native code generation.  For each function of an optimised module the
+ * target's instruction selector covers the IR with machine instructions
+ * over virtual registers (src/codegen/<target>), the register allocator
+ * maps those onto the target's registers and spill slots
+ * (src/codegen/regalloc), frame lowering adds the prologue and epilogue,
+ * and the printer writes the result as assembly for fasm.
+ */
+
+typedef struct CodegenTarget CodegenTarget;
+
+#define CODEGEN_MAX_SCRATCH 3
+
+typedef struct {
+    const char *target_arch;        /* --tarch value, NULL for the host */
+    FILE       *debug;              /* per-function report for --debug-info=compile, or NULL */
+    bool        function_sections;  /* -ffunction-sections: a .text.<name> per function */
+    bool        data_sections;      /* -fdata-sections: a .data.<name> per data object;
+                                       none are emitted yet */
+    uint32_t    threads;            /* functions compiled at once, 0 for one per processor */
+} CodegenOptions;
+
+/* State shared by the functions of one module. */
+typedef struct {
+    IrModule            *mod;
+    LowerModule          lm;
+    const CodegenTarget *target;
+    const CodegenOptions *opts;
+    const char         **externs;   /* symbols used but not defined, interned */
+    uint32_t             extern_count, extern_capacity;
+} CodegenModule;
+
+/* A symbol the code refers to, to be relocated by the linker. */
+typedef struct {
+    uint64_t    offset;             /* of the field in the code */
+    const char *symbol;
+    uint32_t    type;               /* the target's ELF relocation type */
+    int64_t     addend;
+    bool        cold;               /* the cold part of function `symbol`, whose
+                                       symbol is <symbol>.cold */
+} CodegenReloc;
+
+/* The bit the offsets of cold blocks carry while a function is laid out:
+ * they go to LAYOUT_COLD_SECTION, apart from the rest, and a branch
+ * between the two parts is left to the linker, against the function's
+ * symbol or its .cold one. */
+#define CODEGEN_COLD_PC (UINT64_C(1) << 62)
+
+/* Where a function went: [start, end) of the module's code, and its cold
+ * blocks [cold_start, cold_end) of the cold code, empty if it has none. */
+typedef struct {
+    uint64_t start, end, cold_start, cold_end;
+} CodegenExtent;
+
+/* The machine code of a module, as the integrated assembler builds it. */
+typedef struct {
+    uint8_t        *bytes;
+    uint64_t        size, capacity;
+    CodegenReloc   *relocs;
+    uint32_t        reloc_count, reloc_capacity;
+    FILE           *debug;          /* per-function report, or NULL */
+    const MirInst  *failed;         /* the instruction with no encoding, if any */
+} CodegenCode;
+
+struct CodegenTarget {
+    const char *name;
+
+    /* Registers the allocator may hand out, in order of preference, and
+     * those of each class it keeps back to reload spilled operands: as
+     * many as one instruction reads registers of that class. */
+    const uint32_t *allocatable[MIR_CLASS_COUNT];
+    uint32_t        allocatable_count[MIR_CLASS_COUNT];
+    uint32_t        scratch[MIR_CLASS_COUNT][CODEGEN_MAX_SCRATCH];
+    uint32_t        scratch_count[MIR_CLASS_COUNT];
+    uint64_t        caller_saved;   /* by physical register number */
+
+    /* Select instructions for func; NULL once reported. */
+    MirFunction *(*select)(CodegenModule *cm, IrFunction *func);
+    /* Load or store all of reg from or to frame object `object`. */
+    MirInst *(*spill)(MirFunction *mf, uint32_t reg, uint32_t object, bool load);
+    /* dst = address of mem. */
+    MirInst *(*address)(MirFunction *mf, uint32_t dst, const MirMem *mem);
+    /* An instruction setting reg to what def sets its register to, from
+     * constants alone and leaving everything else, the flags included,
+     * untouched; NULL if def is not one that can be repeated like that. */
+    MirInst *(*rematerialize)(MirFunction *mf, const MirInst *def, uint32_t reg);
+    /* Lay out the frame and add the prologue and epilogues, after allocation. */
+    void     (*lower_frame)(MirFunction *mf);
+    void     (*print_header)(FILE *out, const CodegenModule *cm, const char *source);
+    void     (*print_function)(FILE *out, const CodegenModule *cm, const MirFunction *mf);
+    /* Append the machine code of mf to code and that of its cold blocks
+     * to cold, each padded to the alignment of a function, and set
+     * extent to where they went; false when out of memory or
+     * code->failed has no encoding.  NULL for a target without an
+     * integrated assembler. */
+    bool     (*assemble)(const MirFunction *mf, CodegenCode *code, CodegenCode *cold, CodegenExtent *extent);
+    /* The machine of the objects it writes. */
+    BuildMachine machine;
+};
+
+extern const CodegenTarget codegen__x86_64;
+extern const CodegenTarget codegen__aarch64;
+
+/* The target for a --tarch value, NULL for the host; NULL if there is no
+ * backend for it. */
+const CodegenTarget *codegen__target(const char *target_arch);
+
+/* Note name as a symbol the module uses but does not define. */
+void codegen__add_extern(CodegenModule *cm, const char *name);
+
+/* n more bytes at the end of code, NULL when out of memory. */
+uint8_t *codegen__code_grow(CodegenCode *code, uint64_t n);
+bool     codegen__code_reloc(CodegenCode *code, uint64_t offset, const char *symbol, uint32_t type, int64_t addend);
+/* A relocation for a branch of mf at offset of code to its block at pc,
+ * in either part of the function. */
+bool     codegen__block_reloc(CodegenCode *code, uint64_t offset, const MirFunction *mf, uint64_t pc,
+                              uint32_t type, int64_t addend);
+
+/* Compile every function of mod and write the assembly to out.  source
+ * names the input in the header.  Returns false once an error has been
+ * reported. */
+bool codegen__write_assembly(IrModule *mod, const CodegenOptions *opts, const char *source, FILE *out);
+
+/* Compile every function of mod and write a relocatable object to path
+ * through the target's integrated assembler: the functions in .text,
+ * each a symbol of its own, their cold blocks in .text.cold under
+ * <name>.cold, and the symbols they use undefined.  Returns false once an
+ * error has been reported. */
+bool codegen__write_object(IrModule *mod, const CodegenOptions *opts, const char *path);
+
+#endif
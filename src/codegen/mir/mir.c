@@ -0,0 +1,209 @@
+#include "mir.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Grow *array of elements of size bytes to hold one more. */
+static bool reserve(void **array, uint32_t *capacity, uint32_t count, size_t size) {
+    if (count < *capacity) return true;
+    uint32_t cap = *capacity ? *capacity * 2 : 16;
+    void *grown = realloc(*array, cap * size);
+    if (!grown) return false;
+    *array = grown;
+    *capacity = cap;
+    return true;
+}
+
+MirFunction *mir__function_create(const IrFunction *ir) {
+    MirFunction *mf = calloc(1, sizeof(MirFunction));
+    if (!mf) return NULL;
+    mf->ir = ir;
+    mf->name = ir->name;
+    mf->has_profile = ir->has_profile;
+    return mf;
+}
+
+void mir__function_destroy(MirFunction *mf) {
+    if (!mf) return;
+    u__arena_release(&mf->arena);
+    free(mf->blocks);
+    free(mf->vreg_class);
+    free(mf->objects);
+    free(mf);
+}
+
+MirBlock *mir__block_add(MirFunction *mf, const IrBasicBlock *ir) {
+    MirBlock *mb = u__arena_alloc(&mf->arena, sizeof(MirBlock));
+    if (!mb || !reserve((void **)&mf->blocks, &mf->block_capacity, mf->block_count, sizeof(MirBlock *))) {
+        mf->oom = true;
+        return NULL;
+    }
+    mb->id = mf->block_count;
+    mb->ir = ir;
+    if (ir) {
+        mb->align = ir->align;
+        mb->exec_count = ir->exec_count;
+        mb->cold = ir->is_cold && !ir->function->entry_block->is_cold;
+    }
+    mf->blocks[mf->block_count++] = mb;
+    return mb;
+}
+
+MirBlock *mir__block_insert(MirFunction *mf, uint32_t at, const IrBasicBlock *ir) {
+    MirBlock *mb = mir__block_add(mf, ir);
+    if (!mb || at >= mb->id) return mb;
+    memmove(&mf->blocks[at + 1], &mf->blocks[at], (mf->block_count - 1 - at) * sizeof(MirBlock *));
+    mf->blocks[at] = mb;
+    for (uint32_t i = at; i < mf->block_count; i++) mf->blocks[i]->id = i;
+    return mb;
+}
+
+uint32_t mir__vreg_new(MirFunction *mf, uint8_t cls) {
+    if (!reserve((void **)&mf->vreg_class, &mf->vreg_capacity, mf->vreg_count, 1)) {
+        mf->oom = true;
+        return MIR_FIRST_VREG;
+    }
+    mf->vreg_class[mf->vreg_count] = cls;
+    return MIR_FIRST_VREG + mf->vreg_count++;
+}
+
+uint8_t mir__vreg_class(const MirFunction *mf, uint32_t vreg) {
+    if (!mir__is_vreg(vreg)) return vreg >= MIR_FIRST_FPR ? MIR_FPR : MIR_GPR;
+    return mf->vreg_class[vreg - MIR_FIRST_VREG];
+}
+
+uint32_t mir__frame_object(MirFunction *mf, uint32_t size, uint32_t align) {
+    if (!reserve((void **)&mf->objects, &mf->object_capacity, mf->object_count, sizeof(MirFrameObject))) {
+        mf->oom = true;
+        return 0;
+    }
+    mf->objects[mf->object_count] = (MirFrameObject){ size ? size : 1, align ? align : 1, 0 };
+    return mf->object_count++;
+}
+
+MirInst *mir__inst_new(MirFunction *mf, uint16_t opcode, uint8_t count) {
+    MirInst *inst = u__arena_alloc(&mf->arena, sizeof(MirInst) + count * sizeof(MirOperand));
+    if (!inst) {
+        mf->oom = true;
+        return NULL;
+    }
+    inst->opcode = opcode;
+    inst->count = count;
+    return inst;
+}
+
+void mir__inst_append(MirBlock *mb, MirInst *inst) {
+    inst->prev = mb->last;
+    inst->next = NULL;
+    if (mb->last) mb->last->next = inst;
+    else mb->first = inst;
+    mb->last = inst;
+}
+
+void mir__inst_insert_before(MirBlock *mb, MirInst *pos, MirInst *inst) {
+    if (!pos) {
+        mir__inst_append(mb, inst);
+        return;
+    }
+    inst->next = pos;
+    inst->prev = pos->prev;
+    if (pos->prev) pos->prev->next = inst;
+    else mb->first = inst;
+    pos->prev = inst;
+}
+
+void mir__inst_insert_after(MirBlock *mb, MirInst *pos, MirInst *inst) {
+    if (!pos) {
+        inst->prev = NULL;
+        inst->next = mb->first;
+        if (mb->first) mb->first->prev = inst;
+        else mb->last = inst;
+        mb->first = inst;
+        return;
+    }
+    inst->prev = pos;
+    inst->next = pos->next;
+    if (pos->next) pos->next->prev = inst;
+    else mb->last = inst;
+    pos->next = inst;
+}
+
+void mir__inst_remove(MirBlock *mb, MirInst *inst) {
+    if (inst->prev) inst->prev->next = inst->next;
+    else mb->first = inst->next;
+    if (inst->next) inst->next->prev = inst->prev;
+    else mb->last = inst->prev;
+    inst->prev = inst->next = NULL;
+}
+
+MirOperand mir__reg(uint32_t reg, uint8_t size, uint8_t flags) {
+    MirOperand op = { .kind = MIR_OPERAND_REG, .flags = flags, .size = size };
+    op.reg = reg;
+    return op;
+}
+
+MirOperand mir__imm(int64_t imm) {
+    MirOperand op = { .kind = MIR_OPERAND_IMM, .size = 8 };
+    op.imm = imm;
+    return op;
+}
+
+MirOperand mir__mem(MirMem mem, uint8_t size) {
+    MirOperand op = { .kind = MIR_OPERAND_MEM, .size = size };
+    op.mem = mem;
+    return op;
+}
+
+MirOperand mir__block(MirBlock *mb) {
+    MirOperand op = { .kind = MIR_OPERAND_BLOCK };
+    op.block = mb;
+    return op;
+}
+
+MirOperand mir__symbol(const char *name) {
+    MirOperand op = { .kind = MIR_OPERAND_SYMBOL };
+    op.symbol = name;
+    return op;
+}
+
+MirMem mir__mem_base(uint32_t base, int32_t disp) {
+    return (MirMem){ base, MIR_NO_REG, disp, 0, NULL, 1 };
+}
+
+void mir__inst_for_each_reg(MirInst *inst, MirRegFn fn, void *ctx) {
+    for (uint8_t i = 0; i < inst->count; i++) {
+        MirOperand *op = &inst->ops[i];
+        if (op->kind == MIR_OPERAND_REG) {
+            fn(&op->reg, op->flags, ctx);
+        } else if (op->kind == MIR_OPERAND_MEM) {
+            if (op->mem.base != MIR_NO_REG) fn(&op->mem.base, MIR_USE, ctx);
+            if (op->mem.index != MIR_NO_REG) fn(&op->mem.index, MIR_USE, ctx);
+        }
+    }
+}
+
+uint32_t mir__successors(const MirFunction *mf, const MirBlock *mb, MirBlock **out, uint32_t max) {
+    uint32_t n = 0;
+    bool falls = true;
+    for (const MirInst *inst = mb->first; inst; inst = inst->next) {
+        for (uint8_t i = 0; i < inst->count; i++) {
+            if (inst->ops[i].kind != MIR_OPERAND_BLOCK) continue;
+            MirBlock *to = inst->ops[i].block;
+            bool seen = false;
+            for (uint32_t k = 0; k < n && k < max; k++) seen |= out[k] == to;
+            if (seen) continue;
+            if (n < max) out[n] = to;
+            n++;
+        }
+        if (inst->flags & (MIR_INST_JUMP | MIR_INST_RETURN)) falls = false;
+    }
+    if (falls && mb->id + 1 < mf->block_count) {
+        MirBlock *next = mf->blocks[mb->id + 1];
+        bool seen = false;
+        for (uint32_t k = 0; k < n && k < max; k++) seen |= out[k] == next;
+        if (!seen) {
+            if (n < max) out[n] = next;
+            n++;
+        }
+    }
+    return n;
+}
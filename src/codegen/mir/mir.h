@@ -0,0 +1,172 @@
+#ifndef MIR_H
+#define MIR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "../../ir/ir.h"
+#include "../../utils/arena.h"
+
+/*
+ * Machine IR: the instructions of one target, before and after register
+ * allocation.  Instruction selection turns each IrFunction into a
+ * MirFunction whose opcodes belong to the target; the register allocator,
+ * frame lowering and the printers and encoders only walk the operands.
+ *
+ * Registers share one numbering: physical registers of the target come
+ * first, general-purpose ones from 0 and floating-point ones from
+ * MIR_FIRST_FPR, and virtual registers start at MIR_FIRST_VREG.  Before
+ * allocation every value of the function is a virtual register and
+ * physical ones appear only where the ABI or an instruction fixes them.
+ */
+
+#define MIR_FIRST_FPR   32
+#define MIR_FIRST_VREG  64
+#define MIR_NO_REG      UINT32_MAX
+
+#define mir__is_vreg(r) ((r) != MIR_NO_REG && (r) >= MIR_FIRST_VREG)
+#define mir__is_preg(r) ((r) < MIR_FIRST_VREG)
+
+/* Register classes. */
+enum { MIR_GPR, MIR_FPR, MIR_CLASS_COUNT };
+
+typedef enum {
+    MIR_OPERAND_NONE,
+    MIR_OPERAND_REG,
+    MIR_OPERAND_IMM,
+    MIR_OPERAND_MEM,
+    MIR_OPERAND_BLOCK,
+    MIR_OPERAND_SYMBOL
+} MirOperandKind;
+
+/* How an instruction touches a register operand.  Implicit operands are
+ * registers the instruction fixes, such as the dividend of a division;
+ * they are neither printed nor encoded. */
+#define MIR_USE         0x01
+#define MIR_DEF         0x02
+#define MIR_IMPLICIT    0x04
+
+/*
+ * Memory at base + index * scale + disp, where either register may be
+ * absent.  An address inside a frame object names the object, which frame
+ * lowering turns into an offset from the frame pointer; a symbol makes the
+ * address relative to that symbol.
+ */
+typedef struct {
+    uint32_t    base, index;
+    int32_t     disp;
+    uint32_t    frame;              /* frame object + 1, 0 for none */
+    const char *symbol;
+    uint8_t     scale;
+} MirMem;
+
+typedef struct MirBlock MirBlock;
+
+typedef struct {
+    uint8_t kind;                   /* MirOperandKind */
+    uint8_t flags;                  /* MIR_USE, MIR_DEF, MIR_IMPLICIT */
+    uint8_t size;                   /* bytes of a register or of the memory accessed */
+    union {
+        uint32_t    reg;
+        int64_t     imm;
+        MirMem      mem;
+        MirBlock   *block;
+        const char *symbol;
+    };
+} MirOperand;
+
+/* The instruction calls out: every register the target's convention does
+ * not preserve is clobbered. */
+#define MIR_INST_CALL   0x01
+/* A copy between two registers of the same class, which allocation may
+ * drop once both end up in one register. */
+#define MIR_INST_COPY   0x02
+/* Leaves the function; frame lowering puts the epilogue before it. */
+#define MIR_INST_RETURN 0x04
+/* An unconditional jump: control never falls past it. */
+#define MIR_INST_JUMP   0x08
+
+typedef struct MirInst {
+    struct MirInst *prev, *next;
+    uint16_t        opcode;         /* the target's */
+    uint8_t         cond;           /* condition code of the target, for the opcodes that take one */
+    uint8_t         flags;          /* MIR_INST_* */
+    uint8_t         count;          /* operands */
+    uint16_t        line, column;   /* source position, 0 if synthesised */
+    MirOperand      ops[];
+} MirInst;
+
+struct MirBlock {
+    MirInst            *first, *last;
+    uint32_t            id;         /* position in MirFunction.blocks */
+    uint32_t            align;      /* start alignment in bytes, 0 if none */
+    uint32_t            loop_depth; /* 0 outside loops */
+    uint64_t            exec_count; /* profiled executions, 0 if unknown */
+    bool                cold;       /* emitted into the cold section; see mir__block_add() */
+    const IrBasicBlock *ir;         /* NULL for blocks made by selection */
+};
+
+/* A stack object: a static alloca, a spill slot or a save area.  Frame
+ * lowering assigns offsets below the frame pointer. */
+typedef struct {
+    uint32_t size, align;
+    int32_t  offset;                /* of its lowest byte from the frame pointer */
+} MirFrameObject;
+
+typedef struct {
+    const char       *name;
+    const IrFunction *ir;
+    UArena            arena;        /* instructions and blocks */
+    MirBlock        **blocks;       /* in layout order; blocks[0] is the entry */
+    uint32_t          block_count, block_capacity;
+    uint8_t          *vreg_class;   /* by vreg - MIR_FIRST_VREG */
+    uint32_t          vreg_count, vreg_capacity;
+    MirFrameObject   *objects;
+    uint32_t          object_count, object_capacity;
+    uint32_t          frame_size;   /* bytes below the frame pointer, once lowered */
+    uint64_t          saved_regs;   /* callee-saved registers the body writes */
+    bool              has_calls;
+    bool              dynamic_stack;/* moves the stack pointer in its body */
+    bool              has_profile;
+    bool              oom;
+} MirFunction;
+
+MirFunction *mir__function_create(const IrFunction *ir);
+void         mir__function_destroy(MirFunction *mf);
+
+/* A new block at the end.  It is cold when ir is a block layout marked
+ * is_cold, unless the whole function is: that stays in one piece. */
+MirBlock    *mir__block_add(MirFunction *mf, const IrBasicBlock *ir);
+/* A new block at position at, moving the blocks from there on down. */
+MirBlock    *mir__block_insert(MirFunction *mf, uint32_t at, const IrBasicBlock *ir);
+uint32_t     mir__vreg_new(MirFunction *mf, uint8_t cls);
+uint8_t      mir__vreg_class(const MirFunction *mf, uint32_t vreg);
+/* Index of a new frame object. */
+uint32_t     mir__frame_object(MirFunction *mf, uint32_t size, uint32_t align);
+
+/* An instruction with count operands, all NONE, not yet in a block. */
+MirInst     *mir__inst_new(MirFunction *mf, uint16_t opcode, uint8_t count);
+void         mir__inst_append(MirBlock *mb, MirInst *inst);
+void         mir__inst_insert_before(MirBlock *mb, MirInst *pos, MirInst *inst);
+void         mir__inst_insert_after(MirBlock *mb, MirInst *pos, MirInst *inst);
+void         mir__inst_remove(MirBlock *mb, MirInst *inst);
+
+/* Operand constructors. */
+MirOperand   mir__reg(uint32_t reg, uint8_t size, uint8_t flags);
+MirOperand   mir__imm(int64_t imm);
+MirOperand   mir__mem(MirMem mem, uint8_t size);
+MirOperand   mir__block(MirBlock *mb);
+MirOperand   mir__symbol(const char *name);
+MirMem       mir__mem_base(uint32_t base, int32_t disp);
+
+/* Visit every register an instruction reads or writes, memory addresses
+ * included; flags say how it is touched.  reg may be rewritten. */
+typedef void (*MirRegFn)(uint32_t *reg, uint8_t flags, void *ctx);
+void         mir__inst_for_each_reg(MirInst *inst, MirRegFn fn, void *ctx);
+
+/* Blocks a block may branch to, through MIR_OPERAND_BLOCK operands of its
+ * instructions; fills up to max and returns how many there are.  A block
+ * that does not end in a jump or a return also falls into the next one. */
+uint32_t     mir__successors(const MirFunction *mf, const MirBlock *mb, MirBlock **out, uint32_t max);
+
+#endif
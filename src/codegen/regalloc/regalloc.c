@@ -0,0 +1,739 @@
+#include "regalloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Where each virtual register lives: a physical register, or the frame
+ * object it is spilled to.  A register saved around calls has both. */
+typedef struct {
+    const CodegenTarget *target;
+    MirFunction         *mf;
+    uint32_t            *assigned;      /* by vreg - MIR_FIRST_VREG; MIR_NO_REG if spilled */
+    uint32_t            *slot;          /* frame object of a spilled or saved vreg */
+    MirInst            **remat;         /* by vreg: its only definition, if it can be remade */
+    RegallocStats       *stats;
+    bool                 failed;
+} Rewriter;
+
+/* Spilled registers of the instruction being rewritten and the scratch
+ * register each one was given. */
+typedef struct {
+    Rewriter *rw;
+    uint32_t  vreg[8], scratch[8];
+    uint8_t   flags[8];
+    uint32_t  count;
+    uint32_t  used[MIR_CLASS_COUNT];    /* scratch registers handed out per class */
+} Operands;
+
+static bool spilled(const Rewriter *rw, uint32_t reg) {
+    return mir__is_vreg(reg) && rw->assigned[reg - MIR_FIRST_VREG] == MIR_NO_REG;
+}
+
+static void count_spilled(uint32_t *reg, uint8_t flags, void *ctx) {
+    Operands *ops = ctx;
+    if (!spilled(ops->rw, *reg)) return;
+    for (uint32_t i = 0; i < ops->count; i++) {
+        if (ops->vreg[i] == *reg) {
+            ops->flags[i] |= flags;
+            return;
+        }
+    }
+    if (ops->count == 8) {
+        ops->rw->failed = true;
+        return;
+    }
+    ops->vreg[ops->count] = *reg;
+    ops->scratch[ops->count] = MIR_NO_REG;
+    ops->flags[ops->count++] = flags;
+}
+
+/* Replace allocated registers by their physical register and spilled ones
+ * by the scratch register they were given. */
+static void replace(uint32_t *reg, uint8_t flags, void *ctx) {
+    (void)flags;
+    Operands *ops = ctx;
+    if (!mir__is_vreg(*reg)) return;
+    uint32_t preg = ops->rw->assigned[*reg - MIR_FIRST_VREG];
+    if (preg != MIR_NO_REG) {
+        *reg = preg;
+        return;
+    }
+    for (uint32_t i = 0; i < ops->count; i++) {
+        if (ops->vreg[i] == *reg && ops->scratch[i] != MIR_NO_REG) {
+            *reg = ops->scratch[i];
+            return;
+        }
+    }
+}
+
+static uint32_t take_scratch(Operands *ops, uint32_t i) {
+    Rewriter *rw = ops->rw;
+    uint8_t cls = mir__vreg_class(rw->mf, ops->vreg[i]);
+    if (ops->used[cls] == rw->target->scratch_count[cls]) {
+        /* A register only written can share one read before it. */
+        for (uint32_t k = 0; k < ops->count && !(ops->flags[i] & MIR_USE); k++) {
+            if (k == i || ops->scratch[k] == MIR_NO_REG || !(ops->flags[k] & MIR_USE)) continue;
+            if (mir__vreg_class(rw->mf, ops->vreg[k]) != cls) continue;
+            ops->scratch[i] = ops->scratch[k];
+            return ops->scratch[i];
+        }
+        rw->failed = true;
+        return MIR_NO_REG;
+    }
+    ops->scratch[i] = rw->target->scratch[cls][ops->used[cls]++];
+    return ops->scratch[i];
+}
+
+/* preg = vreg, from its slot or remade. */
+static MirInst *fetch(Rewriter *rw, uint32_t preg, uint32_t vreg) {
+    const MirInst *def = rw->remat[vreg - MIR_FIRST_VREG];
+    MirInst *inst = def ? rw->target->rematerialize(rw->mf, def, preg)
+                        : rw->target->spill(rw->mf, preg, rw->slot[vreg - MIR_FIRST_VREG], true);
+    if (!inst) return NULL;
+    if (def) rw->stats->remats++;
+    else rw->stats->reloads++;
+    return inst;
+}
+
+static void reload(Rewriter *rw, MirBlock *mb, MirInst *before, uint32_t preg, uint32_t vreg) {
+    MirInst *ld = fetch(rw, preg, vreg);
+    if (!ld) return;
+    ld->line = before->line;
+    ld->column = before->column;
+    mir__inst_insert_before(mb, before, ld);
+}
+
+/* After last, which becomes the store; returns the store.  A register
+ * that is remade is never stored. */
+static MirInst *store(Rewriter *rw, MirBlock *mb, MirInst *after, uint32_t preg, uint32_t vreg) {
+    if (rw->remat[vreg - MIR_FIRST_VREG]) return after;
+    MirInst *st = rw->target->spill(rw->mf, preg, rw->slot[vreg - MIR_FIRST_VREG], false);
+    if (!st) return after;
+    st->line = after->line;
+    st->column = after->column;
+    mir__inst_insert_after(mb, after, st);
+    rw->stats->spills++;
+    return st;
+}
+
+static uint32_t find(const Operands *ops, uint32_t vreg) {
+    for (uint32_t i = 0; i < ops->count; i++)
+        if (ops->vreg[i] == vreg) return i;
+    return UINT32_MAX;
+}
+
+/*
+ * An address whose spilled registers would leave too few scratch
+ * registers for the rest: reload them, compute the address into the first
+ * and address through that alone.
+ */
+static void fold_address(Operands *ops, MirBlock *mb, MirInst *inst) {
+    Rewriter *rw = ops->rw;
+    for (uint8_t k = 0; k < inst->count; k++) {
+        MirOperand *op = &inst->ops[k];
+        if (op->kind != MIR_OPERAND_MEM) continue;
+        MirMem *m = &op->mem;
+        if (!spilled(rw, m->base) && !spilled(rw, m->index)) continue;
+        uint32_t regs[2] = { m->base, m->index };
+        for (int j = 0; j < 2; j++) {
+            uint32_t i = find(ops, regs[j]);
+            if (!spilled(rw, regs[j]) || ops->scratch[i] != MIR_NO_REG) continue;
+            reload(rw, mb, inst, take_scratch(ops, i), regs[j]);
+        }
+        MirMem addr = *m;
+        if (mir__is_vreg(addr.base)) addr.base = spilled(rw, addr.base) ? ops->scratch[find(ops, addr.base)]
+                                                                         : rw->assigned[addr.base - MIR_FIRST_VREG];
+        if (mir__is_vreg(addr.index)) addr.index = spilled(rw, addr.index) ? ops->scratch[find(ops, addr.index)]
+                                                                             : rw->assigned[addr.index - MIR_FIRST_VREG];
+        uint32_t dst = ops->rw->target->scratch[MIR_GPR][0];
+        MirInst *lea = rw->target->address(rw->mf, dst, &addr);
+        if (!lea) return;
+        mir__inst_insert_before(mb, inst, lea);
+        *m = mir__mem_base(dst, 0);
+        /* The registers of the address are no longer operands unless the
+         * instruction reads them elsewhere, and only the scratch register
+         * holding the address stays taken. */
+        for (uint32_t i = 0; i < ops->count; i++) {
+            if (ops->vreg[i] != regs[0] && ops->vreg[i] != regs[1]) continue;
+            bool elsewhere = false;
+            for (uint8_t o = 0; o < inst->count; o++) {
+                const MirOperand *other = &inst->ops[o];
+                if (other->kind == MIR_OPERAND_REG && other->reg == ops->vreg[i]) elsewhere = true;
+                if (other->kind == MIR_OPERAND_MEM && o != k &&
+                    (other->mem.base == ops->vreg[i] || other->mem.index == ops->vreg[i])) elsewhere = true;
+            }
+            if (!elsewhere) ops->vreg[i] = MIR_NO_REG;
+        }
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < ops->count; i++) {
+            if (ops->vreg[i] == MIR_NO_REG) continue;
+            ops->vreg[kept] = ops->vreg[i];
+            ops->flags[kept] = ops->flags[i];
+            ops->scratch[kept] = MIR_NO_REG;
+            kept++;
+        }
+        ops->count = kept;
+        ops->used[MIR_GPR] = 1;
+        return;
+    }
+}
+
+static void rewrite_inst(Rewriter *rw, MirBlock *mb, MirInst *inst) {
+    /* The definition of a spilled constant goes: each read remakes it. */
+    if (inst->count && inst->ops[0].kind == MIR_OPERAND_REG && spilled(rw, inst->ops[0].reg) &&
+        rw->remat[inst->ops[0].reg - MIR_FIRST_VREG] == inst) {
+        mir__inst_remove(mb, inst);
+        return;
+    }
+    Operands ops = { .rw = rw };
+    mir__inst_for_each_reg(inst, count_spilled, &ops);
+    if (rw->failed) return;
+    /* A copy to or from a spilled register is the store or load itself. */
+    if ((inst->flags & MIR_INST_COPY) && ops.count == 1 && inst->count == 2) {
+        uint32_t dst = inst->ops[0].reg, src = inst->ops[1].reg;
+        if (spilled(rw, dst) != spilled(rw, src)) {
+            bool load = spilled(rw, src);
+            uint32_t other = load ? dst : src;
+            if (mir__is_vreg(other)) other = rw->assigned[other - MIR_FIRST_VREG];
+            MirInst *repl = load ? fetch(rw, other, src)
+                                 : rw->target->spill(rw->mf, other, rw->slot[dst - MIR_FIRST_VREG], false);
+            if (!repl) return;
+            repl->line = inst->line;
+            repl->column = inst->column;
+            mir__inst_insert_before(mb, inst, repl);
+            mir__inst_remove(mb, inst);
+            if (!load) rw->stats->spills++;
+            return;
+        }
+    }
+    uint32_t gprs = 0;
+    for (uint32_t i = 0; i < ops.count; i++)
+        if (mir__vreg_class(rw->mf, ops.vreg[i]) == MIR_GPR && (ops.flags[i] & MIR_USE)) gprs++;
+    if (gprs > rw->target->scratch_count[MIR_GPR]) fold_address(&ops, mb, inst);
+    /* Registers read first, so those only written can share theirs. */
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t i = 0; i < ops.count && !rw->failed; i++) {
+            if (ops.scratch[i] != MIR_NO_REG || ((ops.flags[i] & MIR_USE) != 0) != (pass == 0)) continue;
+            uint32_t preg = take_scratch(&ops, i);
+            if (preg != MIR_NO_REG && (ops.flags[i] & MIR_USE)) reload(rw, mb, inst, preg, ops.vreg[i]);
+        }
+    }
+    if (rw->failed) return;
+    MirInst *last = inst;
+    for (uint32_t i = 0; i < ops.count; i++)
+        if (ops.flags[i] & MIR_DEF) last = store(rw, mb, last, ops.scratch[i], ops.vreg[i]);
+    mir__inst_for_each_reg(inst, replace, &ops);
+    if ((inst->flags & MIR_INST_COPY) && inst->count == 2 && inst->ops[0].reg == inst->ops[1].reg)
+        mir__inst_remove(mb, inst);
+}
+
+
+/* -------------------------------------------------------------- liveness */
+
+/* Positions where a register holds a value, ascending once built:
+ * instruction k reads its operands at 2k and writes its results at 2k + 1,
+ * counting through the blocks in layout order. */
+typedef struct {
+    uint32_t from, to;              /* [from, to) */
+} Range;
+
+typedef struct {
+    Range   *ranges;
+    uint32_t count, capacity;
+    uint64_t weight;                /* of the loads and stores spilling would add */
+    uint64_t call_weight;           /* of saving it around the calls it lives across */
+    uint32_t hint;                  /* register a copy ties it to, MIR_NO_REG if none */
+    uint32_t defs;
+    MirInst *def;                   /* the last definition met */
+} Interval;
+
+/* A virtual register live across a call. */
+typedef struct {
+    MirBlock *mb;
+    MirInst  *call;
+    uint32_t  vreg;
+} Crossing;
+
+typedef struct {
+    MirFunction         *mf;
+    const CodegenTarget *target;
+    uint32_t             regs;          /* physical registers, then virtual ones */
+    uint32_t             words;         /* per register set */
+    uint64_t            *live_in, *live_out;    /* by block */
+    Interval            *iv;            /* by register */
+    Interval             clobbered[MIR_FIRST_VREG];     /* by calls, where nothing else holds it */
+    Crossing            *cross;
+    uint32_t             cross_count, cross_capacity;
+    bool                 oom;
+} Scan;
+
+#define SET_HAS(set, r) (((set)[(r) >> 6] >> ((r) & 63)) & 1)
+#define SET_ADD(set, r) ((set)[(r) >> 6] |= UINT64_C(1) << ((r) & 63))
+#define SET_DEL(set, r) ((set)[(r) >> 6] &= ~(UINT64_C(1) << ((r) & 63)))
+
+static bool grow(void **items, uint32_t *capacity, uint32_t count, size_t size) {
+    if (count < *capacity) return true;
+    uint32_t cap = *capacity ? *capacity * 2 : 4;
+    void *grown = realloc(*items, cap * size);
+    if (!grown) return false;
+    *items = grown;
+    *capacity = cap;
+    return true;
+}
+
+/* Ranges come in from the end of the function backwards, so a new one
+ * starts at or before the lowest so far and merges with it if they meet. */
+static void add_range(Scan *s, Interval *iv, uint32_t from, uint32_t to) {
+    if (iv->count) {
+        Range *low = &iv->ranges[iv->count - 1];
+        if (to >= low->from) {
+            if (from < low->from) low->from = from;
+            if (to > low->to) low->to = to;
+            return;
+        }
+    }
+    if (!grow((void **)&iv->ranges, &iv->capacity, iv->count, sizeof(Range))) {
+        s->oom = true;
+        return;
+    }
+    iv->ranges[iv->count++] = (Range){ from, to };
+}
+
+/* A definition at pos of a register live after it: its value starts there. */
+static void define(Scan *s, Interval *iv, uint32_t pos, bool live) {
+    if (live && iv->count) iv->ranges[iv->count - 1].from = pos;
+    else add_range(s, iv, pos, pos + 1);
+}
+
+/* The registers an instruction touches, uses and definitions apart. */
+typedef struct {
+    uint32_t reg[32];
+    uint8_t  flags[32];
+    uint32_t count;
+    bool     overflow;
+} Touched;
+
+static void collect(uint32_t *reg, uint8_t flags, void *ctx) {
+    Touched *t = ctx;
+    if (*reg == MIR_NO_REG || !(flags & (MIR_USE | MIR_DEF))) return;
+    if (t->count == 32) {
+        t->overflow = true;
+        return;
+    }
+    t->reg[t->count] = *reg;
+    t->flags[t->count++] = flags;
+}
+
+static uint64_t block_weight(const MirFunction *mf, const MirBlock *mb) {
+    if (mf->has_profile) return mb->exec_count + 1;
+    uint32_t depth = mb->loop_depth < 8 ? mb->loop_depth : 8;
+    return UINT64_C(1) << (3 * depth);
+}
+
+/* Registers read before being written in each block, and those written,
+ * then live-in and live-out sets to a fixed point. */
+static void solve_liveness(Scan *s) {
+    MirFunction *mf = s->mf;
+    uint32_t w = s->words, n = mf->block_count;
+    uint64_t *gen = calloc((size_t)n * w, sizeof(uint64_t));
+    uint64_t *kill = calloc((size_t)n * w, sizeof(uint64_t));
+    MirBlock **succ = malloc((n ? n : 1) * sizeof(MirBlock *));
+    if (!gen || !kill || !succ) {
+        s->oom = true;
+        goto done;
+    }
+    for (uint32_t b = 0; b < n; b++) {
+        uint64_t *g = gen + (size_t)b * w, *k = kill + (size_t)b * w;
+        for (MirInst *inst = mf->blocks[b]->first; inst; inst = inst->next) {
+            Touched t = { .count = 0 };
+            mir__inst_for_each_reg(inst, collect, &t);
+            s->oom |= t.overflow;
+            for (uint32_t i = 0; i < t.count; i++)
+                if ((t.flags[i] & MIR_USE) && !SET_HAS(k, t.reg[i])) SET_ADD(g, t.reg[i]);
+            for (uint32_t i = 0; i < t.count; i++)
+                if (t.flags[i] & MIR_DEF) SET_ADD(k, t.reg[i]);
+            if (inst->flags & MIR_INST_CALL) k[0] |= s->target->caller_saved;
+        }
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (uint32_t b = n; b-- > 0;) {
+            uint64_t *in = s->live_in + (size_t)b * w, *out = s->live_out + (size_t)b * w;
+            uint32_t m = mir__successors(mf, mf->blocks[b], succ, n);
+            for (uint32_t i = 0; i < m && i < n; i++) {
+                const uint64_t *sin = s->live_in + (size_t)succ[i]->id * w;
+                for (uint32_t j = 0; j < w; j++) out[j] |= sin[j];
+            }
+            const uint64_t *g = gen + (size_t)b * w, *k = kill + (size_t)b * w;
+            for (uint32_t j = 0; j < w; j++) {
+                uint64_t v = g[j] | (out[j] & ~k[j]);
+                if (v != in[j]) {
+                    in[j] = v;
+                    changed = true;
+                }
+            }
+        }
+    }
+done:
+    free(gen);
+    free(kill);
+    free(succ);
+}
+
+/* Ranges ascending, once the walk that built them backwards is done. */
+static void reverse(Interval *iv) {
+    for (uint32_t i = 0, j = iv->count; i + 1 < j; i++, j--) {
+        Range tmp = iv->ranges[i];
+        iv->ranges[i] = iv->ranges[j - 1];
+        iv->ranges[j - 1] = tmp;
+    }
+}
+
+/*
+ * Walk each block backwards from what is live out of it: a read extends
+ * the register's range back to the start of the block, a write cuts it
+ * there.  Calls end the caller-saved registers and note the virtual ones
+ * live across them.
+ */
+static void build_intervals(Scan *s) {
+    MirFunction *mf = s->mf;
+    uint32_t w = s->words, end = 0;
+    for (uint32_t b = 0; b < mf->block_count; b++)
+        for (const MirInst *inst = mf->blocks[b]->first; inst; inst = inst->next) end++;
+    uint64_t *live = malloc((w ? w : 1) * sizeof(uint64_t));
+    if (!live) {
+        s->oom = true;
+        return;
+    }
+    for (uint32_t b = mf->block_count; b-- > 0 && !s->oom;) {
+        MirBlock *mb = mf->blocks[b];
+        uint32_t last = end;
+        for (const MirInst *inst = mb->first; inst; inst = inst->next) end--;
+        uint32_t from = 2 * end, to = 2 * last;
+        uint64_t weight = block_weight(mf, mb);
+        memcpy(live, s->live_out + (size_t)b * w, w * sizeof(uint64_t));
+        for (uint32_t r = 0; r < s->regs; r++)
+            if (SET_HAS(live, r)) add_range(s, &s->iv[r], from, to);
+        uint32_t k = last;
+        for (MirInst *inst = mb->last; inst; inst = inst->prev) {
+            k--;
+            Touched t = { .count = 0 };
+            mir__inst_for_each_reg(inst, collect, &t);
+            s->oom |= t.overflow;
+            if (inst->flags & MIR_INST_CALL) {
+                for (uint32_t r = MIR_FIRST_VREG; r < s->regs; r++) {
+                    if (!SET_HAS(live, r)) continue;
+                    if (!grow((void **)&s->cross, &s->cross_capacity, s->cross_count, sizeof(Crossing))) {
+                        s->oom = true;
+                        break;
+                    }
+                    s->cross[s->cross_count++] = (Crossing){ mb, inst, r };
+                    s->iv[r].call_weight += 2 * weight;
+                }
+                for (uint32_t r = 0; r < MIR_FIRST_VREG; r++) {
+                    if (!(s->target->caller_saved >> r & 1)) continue;
+                    if (SET_HAS(live, r)) define(s, &s->iv[r], 2 * k + 1, true);
+                    else add_range(s, &s->clobbered[r], 2 * k + 1, 2 * k + 2);
+                    SET_DEL(live, r);
+                }
+            }
+            for (uint32_t i = 0; i < t.count; i++) {
+                if (!(t.flags[i] & MIR_DEF)) continue;
+                uint32_t r = t.reg[i];
+                define(s, &s->iv[r], 2 * k + 1, SET_HAS(live, r));
+                SET_DEL(live, r);
+                if (mir__is_vreg(r)) {
+                    s->iv[r].weight += weight;
+                    s->iv[r].defs++;
+                    s->iv[r].def = inst;
+                }
+            }
+            for (uint32_t i = 0; i < t.count; i++) {
+                if (!(t.flags[i] & MIR_USE)) continue;
+                uint32_t r = t.reg[i];
+                add_range(s, &s->iv[r], from, 2 * k + 1);
+                SET_ADD(live, r);
+                if (mir__is_vreg(r)) s->iv[r].weight += weight;
+            }
+            if ((inst->flags & MIR_INST_COPY) && inst->count == 2) {
+                uint32_t dst = inst->ops[0].reg, src = inst->ops[1].reg;
+                if (mir__is_vreg(dst) && s->iv[dst].hint == MIR_NO_REG) s->iv[dst].hint = src;
+                if (mir__is_vreg(src) && s->iv[src].hint == MIR_NO_REG) s->iv[src].hint = dst;
+            }
+        }
+    }
+    free(live);
+    for (uint32_t r = 0; r < s->regs; r++) {
+        reverse(&s->iv[r]);
+        if (r < MIR_FIRST_VREG) reverse(&s->clobbered[r]);
+    }
+}
+
+/* ------------------------------------------------------------ assignment */
+
+/* Positions a physical register is taken over: by a virtual register, or
+ * fixed by instructions naming the register itself.  Sorted and disjoint. */
+#define HELD_FIXED MIR_NO_REG
+
+typedef struct {
+    uint32_t from, to, holder;
+} Stretch;
+
+typedef struct {
+    Stretch *items;
+    uint32_t count, capacity;
+} Holders;
+
+typedef struct {
+    Scan     *scan;
+    Holders   held[MIR_FIRST_VREG];
+    uint32_t *assigned;             /* the rewriter's */
+    uint8_t  *saved;                /* by vreg: stored and reloaded around calls */
+    uint32_t *seen, stamp;          /* holders counted in an eviction */
+    bool      oom;
+} Alloc;
+
+/* The first stretch ending after pos. */
+static uint32_t first_after(const Holders *h, uint32_t pos) {
+    uint32_t lo = 0, hi = h->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (h->items[mid].to <= pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static bool meets(const Interval *a, const Interval *b) {
+    uint32_t i = 0, j = 0;
+    while (i < a->count && j < b->count) {
+        if (a->ranges[i].to <= b->ranges[j].from) i++;
+        else if (b->ranges[j].to <= a->ranges[i].from) j++;
+        else return true;
+    }
+    return false;
+}
+
+/* Whether preg is free over iv; the calls clobbering it do not count for
+ * a register saved around them. */
+static bool is_free(const Alloc *a, uint32_t preg, const Interval *iv, bool around_calls) {
+    if (!around_calls && meets(iv, &a->scan->clobbered[preg])) return false;
+    const Holders *h = &a->held[preg];
+    for (uint32_t i = 0; i < iv->count; i++) {
+        uint32_t k = first_after(h, iv->ranges[i].from);
+        if (k < h->count && h->items[k].from < iv->ranges[i].to) return false;
+    }
+    return true;
+}
+
+/* What spilling the holders of preg over iv would add to what they cost
+ * now; UINT64_MAX where the register is fixed or clobbered. */
+static uint64_t eviction_cost(Alloc *a, uint32_t preg, const Interval *iv) {
+    if (meets(iv, &a->scan->clobbered[preg])) return UINT64_MAX;
+    const Holders *h = &a->held[preg];
+    uint64_t cost = 0;
+    a->stamp++;
+    for (uint32_t i = 0; i < iv->count; i++) {
+        for (uint32_t k = first_after(h, iv->ranges[i].from);
+             k < h->count && h->items[k].from < iv->ranges[i].to; k++) {
+            uint32_t holder = h->items[k].holder;
+            if (holder == HELD_FIXED) return UINT64_MAX;
+            if (a->seen[holder - MIR_FIRST_VREG] == a->stamp) continue;
+            a->seen[holder - MIR_FIRST_VREG] = a->stamp;
+            const Interval *other = &a->scan->iv[holder];
+            uint64_t now = a->saved[holder - MIR_FIRST_VREG] ? other->call_weight : 0;
+            cost += other->weight > now ? other->weight - now : 0;
+        }
+    }
+    return cost;
+}
+
+static void hold(Alloc *a, uint32_t preg, const Interval *iv, uint32_t holder) {
+    Holders *h = &a->held[preg];
+    for (uint32_t i = 0; i < iv->count; i++) {
+        if (!grow((void **)&h->items, &h->capacity, h->count, sizeof(Stretch))) {
+            a->oom = true;
+            return;
+        }
+        uint32_t k = first_after(h, iv->ranges[i].from);
+        memmove(&h->items[k + 1], &h->items[k], (h->count - k) * sizeof(Stretch));
+        h->items[k] = (Stretch){ iv->ranges[i].from, iv->ranges[i].to, holder };
+        h->count++;
+    }
+}
+
+/* Spill whatever holds preg over iv. */
+static void evict(Alloc *a, uint32_t preg, const Interval *iv) {
+    Holders *h = &a->held[preg];
+    for (uint32_t i = 0; i < iv->count; i++) {
+        uint32_t k;
+        while ((k = first_after(h, iv->ranges[i].from)) < h->count && h->items[k].from < iv->ranges[i].to) {
+            uint32_t holder = h->items[k].holder, kept = 0;
+            for (uint32_t j = 0; j < h->count; j++)
+                if (h->items[j].holder != holder) h->items[kept++] = h->items[j];
+            h->count = kept;
+            a->assigned[holder - MIR_FIRST_VREG] = MIR_NO_REG;
+            a->saved[holder - MIR_FIRST_VREG] = 0;
+        }
+    }
+}
+
+static bool allocatable(const CodegenTarget *target, uint8_t cls, uint32_t preg) {
+    for (uint32_t k = 0; k < target->allocatable_count[cls]; k++)
+        if (target->allocatable[cls][k] == preg) return true;
+    return false;
+}
+
+/*
+ * Registers in order of where they start.  A register is taken when free,
+ * the one its copy is tied to first; otherwise the cheapest of saving it
+ * around calls, evicting the holders of a register and spilling it wins.
+ */
+static void assign(Alloc *a, const uint64_t *order, uint32_t count) {
+    const CodegenTarget *target = a->scan->target;
+    for (uint32_t i = 0; i < count && !a->oom; i++) {
+        uint32_t vreg = MIR_FIRST_VREG + (uint32_t)order[i];
+        const Interval *iv = &a->scan->iv[vreg];
+        uint8_t cls = mir__vreg_class(a->scan->mf, vreg);
+        const uint32_t *regs = target->allocatable[cls];
+        uint32_t n = target->allocatable_count[cls], preg = MIR_NO_REG;
+        uint32_t hint = iv->hint;
+        if (mir__is_vreg(hint)) hint = a->assigned[hint - MIR_FIRST_VREG];
+        if (hint != MIR_NO_REG && allocatable(target, cls, hint) && is_free(a, hint, iv, false)) preg = hint;
+        for (uint32_t k = 0; k < n && preg == MIR_NO_REG; k++)
+            if (is_free(a, regs[k], iv, false)) preg = regs[k];
+        if (preg == MIR_NO_REG) {
+            uint64_t best = iv->weight;
+            bool save = false;
+            if (iv->call_weight && iv->call_weight < best) {
+                for (uint32_t k = 0; k < n && !save; k++) {
+                    if (!is_free(a, regs[k], iv, true)) continue;
+                    preg = regs[k];
+                    best = iv->call_weight;
+                    save = true;
+                }
+            }
+            uint32_t victim = MIR_NO_REG;
+            for (uint32_t k = 0; k < n; k++) {
+                uint64_t cost = eviction_cost(a, regs[k], iv);
+                if (cost >= best) continue;
+                best = cost;
+                victim = regs[k];
+            }
+            if (victim != MIR_NO_REG) {
+                evict(a, victim, iv);
+                preg = victim;
+                save = false;
+            }
+            a->saved[vreg - MIR_FIRST_VREG] = save;
+        }
+        if (preg == MIR_NO_REG) continue;
+        hold(a, preg, iv, vreg);
+        a->assigned[vreg - MIR_FIRST_VREG] = preg;
+    }
+}
+
+/* A register kept in a caller-saved register across a call: stored before
+ * it, unless it is remade, and back after it. */
+static void save_around(Rewriter *rw, const Crossing *c) {
+    uint32_t v = c->vreg - MIR_FIRST_VREG, preg = rw->assigned[v];
+    if (!rw->remat[v]) {
+        MirInst *st = rw->target->spill(rw->mf, preg, rw->slot[v], false);
+        if (!st) return;
+        st->line = c->call->line;
+        st->column = c->call->column;
+        mir__inst_insert_before(c->mb, c->call, st);
+        rw->stats->spills++;
+    }
+    MirInst *ld = fetch(rw, preg, c->vreg);
+    if (!ld) return;
+    ld->line = c->call->line;
+    ld->column = c->call->column;
+    mir__inst_insert_after(c->mb, c->call, ld);
+}
+
+static int compare_order(const void *x, const void *y) {
+    uint64_t a = *(const uint64_t *)x, b = *(const uint64_t *)y;
+    return a < b ? -1 : a > b;
+}
+
+bool regalloc__linear_scan(MirFunction *mf, const CodegenTarget *target, RegallocStats *stats) {
+    uint32_t n = mf->vreg_count;
+    Scan s = { .mf = mf, .target = target, .regs = MIR_FIRST_VREG + n };
+    s.words = (s.regs + 63) / 64;
+    size_t sets = (size_t)(mf->block_count ? mf->block_count : 1) * s.words;
+    s.live_in = calloc(sets, sizeof(uint64_t));
+    s.live_out = calloc(sets, sizeof(uint64_t));
+    s.iv = calloc(s.regs, sizeof(Interval));
+    Rewriter rw = { target, mf, NULL, NULL, NULL, stats, false };
+    rw.assigned = malloc((n ? n : 1) * sizeof(uint32_t));
+    rw.slot = calloc(n ? n : 1, sizeof(uint32_t));
+    rw.remat = calloc(n ? n : 1, sizeof(MirInst *));
+    Alloc a = { .scan = &s, .assigned = rw.assigned };
+    a.saved = calloc(n ? n : 1, 1);
+    a.seen = calloc(n ? n : 1, sizeof(uint32_t));
+    uint64_t *order = malloc((n ? n : 1) * sizeof(uint64_t));
+    bool ok = s.live_in && s.live_out && s.iv && rw.assigned && rw.slot && rw.remat && a.saved && a.seen && order;
+    if (ok) {
+        for (uint32_t r = 0; r < s.regs; r++) s.iv[r].hint = MIR_NO_REG;
+        solve_liveness(&s);
+        if (!s.oom) build_intervals(&s);
+        ok = !s.oom;
+    }
+    if (ok) {
+        uint32_t count = 0;
+        for (uint32_t v = 0; v < n; v++) {
+            Interval *iv = &s.iv[MIR_FIRST_VREG + v];
+            rw.assigned[v] = MIR_NO_REG;
+            if (!iv->count) continue;
+            /* Remade where read, a spilled constant costs no store and a
+             * cheap load. */
+            if (iv->defs == 1 && target->rematerialize &&
+                target->rematerialize(mf, iv->def, MIR_FIRST_VREG + v)) {
+                rw.remat[v] = iv->def;
+                iv->weight = iv->weight / 2 + 1;
+            }
+            order[count++] = (uint64_t)iv->ranges[0].from << 32 | v;
+        }
+        qsort(order, count, sizeof(uint64_t), compare_order);
+        for (uint32_t r = 0; r < MIR_FIRST_VREG && !a.oom; r++) hold(&a, r, &s.iv[r], HELD_FIXED);
+        assign(&a, order, count);
+        ok = !a.oom;
+    }
+    if (ok) {
+        for (uint32_t v = 0; v < n; v++) {
+            if (!s.iv[MIR_FIRST_VREG + v].count || rw.remat[v]) continue;
+            if (rw.assigned[v] != MIR_NO_REG && !a.saved[v]) continue;
+            rw.slot[v] = mir__frame_object(mf, 8, 8);
+            stats->spill_slots++;
+        }
+        for (uint32_t b = 0; b < mf->block_count && !rw.failed; b++) {
+            MirBlock *mb = mf->blocks[b];
+            for (MirInst *inst = mb->first, *next; inst && !rw.failed; inst = next) {
+                next = inst->next;
+                rewrite_inst(&rw, mb, inst);
+            }
+        }
+        for (uint32_t v = 0; v < n; v++) stats->split += rw.assigned[v] != MIR_NO_REG && a.saved[v];
+        for (uint32_t i = 0; i < s.cross_count && !rw.failed; i++) {
+            uint32_t v = s.cross[i].vreg - MIR_FIRST_VREG;
+            if (rw.assigned[v] != MIR_NO_REG && a.saved[v]) save_around(&rw, &s.cross[i]);
+        }
+        ok = !rw.failed && !mf->oom;
+    }
+    for (uint32_t r = 0; s.iv && r < s.regs; r++) free(s.iv[r].ranges);
+    for (uint32_t r = 0; r < MIR_FIRST_VREG; r++) {
+        free(s.clobbered[r].ranges);
+        free(a.held[r].items);
+    }
+    free(s.iv);
+    free(s.live_in);
+    free(s.live_out);
+    free(s.cross);
+    free(rw.assigned);
+    free(rw.slot);
+    free(rw.remat);
+    free(a.saved);
+    free(a.seen);
+    free(order);
+    return ok;
+}
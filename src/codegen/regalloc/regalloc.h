@@ -0,0 +1,35 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../codegen.h"
+
+typedef struct {
+    uint32_t spill_slots;           /* frame objects holding virtual registers */
+    uint32_t spills, reloads;       /* stores and loads inserted */
+    uint32_t remats;                /* constants remade instead of reloaded */
+    uint32_t split;                 /* registers saved and restored around calls */
+} RegallocStats;
+
+/*
+ * Linear-scan allocation of the virtual registers of mf.  Liveness over
+ * the blocks gives each register the ranges of instructions where it holds
+ * a value; virtual registers are visited in order of where they start and
+ * each takes a register of its class free over all its ranges.  When none
+ * is, one living across calls may take a caller-saved register and be
+ * stored before and reloaded after each of them, or holders that are
+ * cheaper to spill give up their register; otherwise it is spilled itself.
+ * Spill costs count the loads and stores spilling would add, weighted by
+ * the profiled count or the loop depth of their blocks, and constants are
+ * remade where they are read instead of living in a slot.
+ *
+ * Spilled registers are reloaded into the target's scratch registers
+ * before each instruction that reads them and stored after each that
+ * writes them; an address with more spilled registers than scratch
+ * registers left is computed into a scratch register first.  Returns
+ * false when an instruction cannot be rewritten.
+ */
+bool regalloc__linear_scan(MirFunction *mf, const CodegenTarget *target, RegallocStats *stats);
+
+#endif
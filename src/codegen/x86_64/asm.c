@@ -0,0 +1,149 @@
+#include "x86_64.h"
+#include <inttypes.h>
+#include <stdlib.h>
+
+/* Assembly for fasm: `format ELF64`, Intel operand order, size keywords on
+ * memory operands and rip-relative symbol addresses.  Block labels start
+ * with a dot, which makes them local to the function label before them.
+ * With --debug-info=compile every instruction carries its bytes from
+ * x86_64__encode, symbol fields left zero, to hold fasm's against. */
+
+static const char *const gpr64[16] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+static const char *const gpr32[16] = {
+    "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+    "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
+};
+static const char *const gpr16[16] = {
+    "ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+    "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"
+};
+static const char *const gpr8[16] = {
+    "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"
+};
+static const char *const cond_names[16] = {
+    "o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g"
+};
+
+static void print_reg(FILE *out, uint32_t reg, uint8_t size) {
+    if (reg >= MIR_FIRST_VREG) {
+        fprintf(out, "v%" PRIu32, reg - MIR_FIRST_VREG);
+    } else if (reg >= MIR_FIRST_FPR) {
+        fprintf(out, "xmm%" PRIu32, reg - MIR_FIRST_FPR);
+    } else {
+        const char *const *names = size == 1 ? gpr8 : size == 2 ? gpr16 : size == 4 ? gpr32 : gpr64;
+        fputs(names[reg & 15], out);
+    }
+}
+
+static const char *size_name(uint8_t size) {
+    switch (size) {
+        case 1: return "byte";
+        case 2: return "word";
+        case 4: return "dword";
+        case 16: return "dqword";
+        default: return "qword";
+    }
+}
+
+static void print_mem(FILE *out, const MirMem *m, uint8_t size, bool sized) {
+    if (sized) fprintf(out, "%s ", size_name(size));
+    fputc('[', out);
+    bool any = false;
+    if (m->symbol) {
+        fputs(m->symbol, out);
+        any = true;
+    }
+    if (m->base != MIR_NO_REG) {
+        if (any) fputc('+', out);
+        print_reg(out, m->base, 8);
+        any = true;
+    }
+    if (m->index != MIR_NO_REG) {
+        if (any) fputc('+', out);
+        print_reg(out, m->index, 8);
+        if (m->scale > 1) fprintf(out, "*%u", m->scale);
+        any = true;
+    }
+    if (m->frame) {
+        if (any) fputc('+', out);
+        fprintf(out, "frame%" PRIu32, m->frame - 1);
+        any = true;
+    }
+    if (m->disp || !any) fprintf(out, any ? "%+" PRId32 : "%" PRId32, m->disp);
+    fputc(']', out);
+}
+
+static void print_inst(FILE *out, const MirInst *inst) {
+    const char *name = x86_64__mnemonics[inst->opcode];
+    fputs("    ", out);
+    if (inst->opcode == X86_MOVSX && inst->count == 2 && inst->ops[1].size == 4) fputs("movsxd", out);
+    else fputs(name, out);
+    if (inst->opcode == X86_SETCC || inst->opcode == X86_CMOVCC || inst->opcode == X86_JCC)
+        fputs(cond_names[inst->cond & 15], out);
+    bool first = true;
+    for (uint8_t i = 0; i < inst->count; i++) {
+        const MirOperand *op = &inst->ops[i];
+        if (op->kind == MIR_OPERAND_NONE || (op->flags & MIR_IMPLICIT)) continue;
+        fputs(first ? " " : ", ", out);
+        first = false;
+        switch (op->kind) {
+            case MIR_OPERAND_REG:    print_reg(out, op->reg, op->size); break;
+            case MIR_OPERAND_IMM:    fprintf(out, "%" PRId64, op->imm); break;
+            case MIR_OPERAND_MEM:    print_mem(out, &op->mem, op->size, inst->opcode != X86_LEA); break;
+            case MIR_OPERAND_BLOCK:  fprintf(out, ".L%" PRIu32, op->block->id); break;
+            case MIR_OPERAND_SYMBOL: fputs(op->symbol, out); break;
+            default: break;
+        }
+    }
+}
+
+void x86_64__print_header(FILE *out, const CodegenModule *cm, const char *source) {
+    fprintf(out, "; %s\n", source ? source : "<module>");
+    fputs("format ELF64\n\n", out);
+    fputs("section '.text' executable align 16\n\n", out);
+    for (uint32_t i = 0; i < cm->mod->func_count; i++) {
+        const IrFunction *func = cm->mod->functions[i];
+        if (!func->is_internal) fprintf(out, "public %s\n", func->name);
+    }
+    for (uint32_t i = 0; i < cm->extern_count; i++) fprintf(out, "extrn %s\n", cm->externs[i]);
+}
+
+void x86_64__print_function(FILE *out, const CodegenModule *cm, const MirFunction *mf) {
+    X86Layout layout;
+    bool bytes = cm->opts->debug && x86_64__layout(mf, &layout);
+    fprintf(out, "\nalign 16\n%s:\n", mf->name);
+    /* The function's code, then its cold blocks in a section of their own */
+    bool has_cold = false;
+    for (int part = 0; part < 2; part++) {
+        uint32_t i = 0;
+        for (uint32_t b = 0; b < mf->block_count; b++) {
+            const MirBlock *mb = mf->blocks[b];
+            if (mb->cold != part) {
+                for (const MirInst *inst = mb->first; inst; inst = inst->next) i++;
+                continue;
+            }
+            if (part && !has_cold) fprintf(out, "\nsection '%s' executable align 16\n\n", LAYOUT_COLD_SECTION);
+            has_cold |= part;
+            if (b > 0) {
+                if (mb->align > 1) fprintf(out, "align %" PRIu32 "\n", mb->align);
+                fprintf(out, ".L%" PRIu32 ":\n", mb->id);
+            }
+            uint64_t pc = bytes ? layout.block_pc[b] : 0;
+            for (const MirInst *inst = mb->first; inst; inst = inst->next, i++) {
+                print_inst(out, inst);
+                uint8_t code[X86_MAX_INST_BYTES];
+                X86Fixup fixup;
+                uint32_t n = bytes ? x86_64__encode(inst, pc, layout.block_pc, layout.near[i], code, &fixup) : 0;
+                for (uint32_t k = 0; k < n; k++) fprintf(out, k ? " %02x" : "\t; %02x", code[k]);
+                fputc('\n', out);
+                pc += n;
+            }
+        }
+    }
+    if (has_cold) fputs("\nsection '.text' executable align 16\n", out);
+    if (bytes) x86_64__layout_free(&layout);
+}
@@ -0,0 +1,555 @@
+#include "x86_64.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Machine code of lowered x86-64 instructions, the bytes fasm assembles
+ * the printer's text to, give or take the choice between equivalent
+ * forms.  Symbols are left to the linker as relocations: a memory operand
+ * with a symbol alone is rip-relative, and calls and jumps to symbols take
+ * the PLT form.  Branches to blocks are rel8 or rel32 as the layout says;
+ * those between a function's code and its cold part are rel32 fixups.
+ */
+
+#define NONE UINT32_MAX
+
+typedef struct {
+    uint8_t  *out;
+    uint32_t  n;
+    X86Fixup *fixup;
+    bool      rip;                  /* the fixup is rip-relative to the end of the instruction */
+    int32_t   disp;
+} Enc;
+
+static void put(Enc *e, uint8_t b) {
+    if (e->n < X86_MAX_INST_BYTES) e->out[e->n] = b;
+    e->n++;
+}
+
+static void put_le(Enc *e, uint64_t v, uint32_t bytes) {
+    for (uint32_t i = 0; i < bytes; i++) put(e, (uint8_t)(v >> (8 * i)));
+}
+
+static void put_opcode(Enc *e, uint32_t opcode) {
+    if (opcode > 0xFFFF) put(e, (uint8_t)(opcode >> 16));
+    if (opcode > 0xFF) put(e, (uint8_t)(opcode >> 8));
+    put(e, (uint8_t)opcode);
+}
+
+static bool fits8(int64_t v) {
+    return v >= INT8_MIN && v <= INT8_MAX;
+}
+
+static bool fits32(int64_t v) {
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+static bool is_gpr(const MirOperand *op) {
+    return op->kind == MIR_OPERAND_REG && op->reg < 16;
+}
+
+static bool is_xmm(const MirOperand *op) {
+    return op->kind == MIR_OPERAND_REG && op->reg >= MIR_FIRST_FPR && op->reg < MIR_FIRST_FPR + 16;
+}
+
+/* The 4-bit number of a register operand. */
+static uint32_t num(const MirOperand *op) {
+    return op->reg >= MIR_FIRST_FPR ? op->reg - MIR_FIRST_FPR : op->reg;
+}
+
+/* spl, bpl, sil and dil exist only with a REX prefix. */
+static bool needs_rex(const MirOperand *op) {
+    return is_gpr(op) && op->size == 1 && op->reg >= 4 && op->reg < 8;
+}
+
+static void note_fixup(Enc *e, uint32_t type, const char *symbol, int64_t addend) {
+    e->fixup->symbol = symbol;
+    e->fixup->offset = e->n;
+    e->fixup->type = type;
+    e->fixup->addend = addend;
+}
+
+/*
+ * [legacy prefix] [REX] opcode ModRM [SIB] [displacement] with reg in the
+ * ModRM reg field, a register number or an opcode extension, and rm a
+ * register or memory operand.  rex forces an empty REX prefix for the
+ * byte registers that need one.
+ */
+static bool modrm(Enc *e, uint8_t legacy, bool w, uint32_t opcode, uint32_t reg, const MirOperand *rm, bool rex) {
+    uint8_t prefix = 0x40 | (w ? 8 : 0) | (reg & 8 ? 4 : 0);
+    uint32_t base = NONE, index = NONE;
+    const MirMem *m = &rm->mem;
+    if (rm->kind == MIR_OPERAND_REG) {
+        if (!is_gpr(rm) && !is_xmm(rm)) return false;
+        if (num(rm) & 8) prefix |= 1;
+        rex |= needs_rex(rm);
+    } else if (rm->kind == MIR_OPERAND_MEM) {
+        if (m->frame) return false;
+        if (m->base != MIR_NO_REG) {
+            if (m->base >= 16) return false;
+            base = m->base;
+            if (base & 8) prefix |= 1;
+        }
+        if (m->index != MIR_NO_REG) {
+            if (m->index >= 16 || m->index == X86_RSP) return false;
+            index = m->index;
+            if (index & 8) prefix |= 2;
+        }
+    } else {
+        return false;
+    }
+    if (legacy) put(e, legacy);
+    if (prefix != 0x40 || rex) put(e, prefix);
+    put_opcode(e, opcode);
+    reg &= 7;
+    if (rm->kind == MIR_OPERAND_REG) {
+        put(e, (uint8_t)(0xC0 | reg << 3 | (num(rm) & 7)));
+        return true;
+    }
+    if (m->symbol && base == NONE && index == NONE) {
+        put(e, (uint8_t)(0x05 | reg << 3));
+        note_fixup(e, X86_R_PC32, m->symbol, 0);
+        e->rip = true;
+        e->disp = m->disp;
+        put_le(e, 0, 4);
+        return true;
+    }
+    uint8_t ss = m->scale == 8 ? 3 : m->scale == 4 ? 2 : m->scale == 2 ? 1 : 0;
+    uint8_t sib_index = (uint8_t)((index == NONE ? 4 : index & 7) << 3);
+    if (base == NONE) {
+        /* No base: SIB base 101 with mod 00 takes a disp32. */
+        put(e, (uint8_t)(0x04 | reg << 3));
+        put(e, (uint8_t)(ss << 6 | sib_index | 5));
+        if (m->symbol) note_fixup(e, X86_R_32S, m->symbol, m->disp);
+        put_le(e, m->symbol ? 0 : (uint32_t)m->disp, 4);
+        return true;
+    }
+    /* rbp and r13 as a base always take a displacement. */
+    uint8_t mod = m->symbol ? 2 : m->disp == 0 && (base & 7) != 5 ? 0 : fits8(m->disp) ? 1 : 2;
+    bool sib = index != NONE || (base & 7) == 4;
+    put(e, (uint8_t)(mod << 6 | reg << 3 | (sib ? 4 : base & 7)));
+    if (sib) put(e, (uint8_t)(ss << 6 | sib_index | (base & 7)));
+    if (mod == 1) put(e, (uint8_t)m->disp);
+    if (mod == 2) {
+        if (m->symbol) note_fixup(e, X86_R_32S, m->symbol, m->disp);
+        put_le(e, m->symbol ? 0 : (uint32_t)m->disp, 4);
+    }
+    return true;
+}
+
+/* The operand-size prefix of an integer operation of size bytes, if any. */
+static uint8_t opsize(uint8_t size) {
+    return size == 2 ? 0x66 : 0;
+}
+
+static void put_imm(Enc *e, int64_t imm, uint8_t size) {
+    put_le(e, (uint64_t)imm, size == 1 ? 1 : size == 2 ? 2 : 4);
+}
+
+/* add, or, and, sub, xor and cmp: ext is the opcode extension of the
+ * immediate forms and the row of the others. */
+static bool alu(Enc *e, uint32_t ext, const MirOperand *d, const MirOperand *s) {
+    uint8_t size = d->size;
+    bool w = size == 8, byte = size == 1;
+    if (s->kind == MIR_OPERAND_IMM) {
+        if (d->kind != MIR_OPERAND_REG && d->kind != MIR_OPERAND_MEM) return false;
+        if (!byte && fits8(s->imm)) {
+            if (!modrm(e, opsize(size), w, 0x83, ext, d, false)) return false;
+            put(e, (uint8_t)s->imm);
+            return true;
+        }
+        if (!fits32(s->imm)) return false;
+        if (!modrm(e, opsize(size), w, byte ? 0x80 : 0x81, ext, d, false)) return false;
+        put_imm(e, s->imm, size);
+        return true;
+    }
+    if (is_gpr(s) && (is_gpr(d) || d->kind == MIR_OPERAND_MEM))
+        return modrm(e, opsize(size), w, ext * 8 + (byte ? 0 : 1), num(s), d, needs_rex(s));
+    if (is_gpr(d) && s->kind == MIR_OPERAND_MEM)
+        return modrm(e, opsize(size), w, ext * 8 + (byte ? 2 : 3), num(d), s, needs_rex(d));
+    return false;
+}
+
+static bool mov(Enc *e, const MirOperand *d, const MirOperand *s) {
+    uint8_t size = d->size;
+    bool w = size == 8, byte = size == 1;
+    if (s->kind == MIR_OPERAND_IMM) {
+        if (is_gpr(d)) {
+            /* mov r32, imm32 zero-extends; only other 64-bit values need more. */
+            int64_t v = s->imm;
+            if (size == 8 && (v < 0 || v > UINT32_MAX) && fits32(v)) {
+                if (!modrm(e, 0, true, 0xC7, 0, d, false)) return false;
+                put_le(e, (uint64_t)v, 4);
+                return true;
+            }
+            bool wide = size == 8 && (v < 0 || v > UINT32_MAX);
+            if (opsize(size)) put(e, opsize(size));
+            if (wide || (d->reg & 8) || (byte && needs_rex(d))) put(e, (uint8_t)(0x40 | (wide ? 8 : 0) | (d->reg & 8 ? 1 : 0)));
+            put(e, (uint8_t)((byte ? 0xB0 : 0xB8) + (d->reg & 7)));
+            put_le(e, (uint64_t)v, wide ? 8 : size == 8 ? 4 : byte ? 1 : size);
+            return true;
+        }
+        if (d->kind != MIR_OPERAND_MEM || !fits32(s->imm)) return false;
+        if (!modrm(e, opsize(size), w, byte ? 0xC6 : 0xC7, 0, d, false)) return false;
+        put_imm(e, s->imm, size);
+        return true;
+    }
+    if (is_gpr(s) && (is_gpr(d) || d->kind == MIR_OPERAND_MEM))
+        return modrm(e, opsize(size), w, byte ? 0x88 : 0x89, num(s), d, needs_rex(s));
+    if (is_gpr(d) && s->kind == MIR_OPERAND_MEM)
+        return modrm(e, opsize(size), w, byte ? 0x8A : 0x8B, num(d), s, needs_rex(d));
+    return false;
+}
+
+/* neg, not and idiv: F7 (F6 for bytes) with an opcode extension. */
+static bool unary(Enc *e, uint32_t ext, const MirOperand *op) {
+    return modrm(e, opsize(op->size), op->size == 8, op->size == 1 ? 0xF6 : 0xF7, ext, op, false);
+}
+
+static bool shift(Enc *e, uint32_t ext, const MirOperand *d, const MirOperand *s) {
+    bool w = d->size == 8, byte = d->size == 1;
+    if (s->kind == MIR_OPERAND_REG) {
+        if (s->reg != X86_RCX) return false;
+        return modrm(e, opsize(d->size), w, byte ? 0xD2 : 0xD3, ext, d, false);
+    }
+    if (s->kind != MIR_OPERAND_IMM) return false;
+    if (s->imm == 1) return modrm(e, opsize(d->size), w, byte ? 0xD0 : 0xD1, ext, d, false);
+    if (!modrm(e, opsize(d->size), w, byte ? 0xC0 : 0xC1, ext, d, false)) return false;
+    put(e, (uint8_t)s->imm);
+    return true;
+}
+
+/* A scalar SSE operation: xmm register destination, xmm or memory source. */
+static bool sse(Enc *e, uint8_t legacy, uint32_t opcode, const MirOperand *d, const MirOperand *s) {
+    if (!is_xmm(d) || (!is_xmm(s) && s->kind != MIR_OPERAND_MEM)) return false;
+    return modrm(e, legacy, false, opcode, num(d), s, false);
+}
+
+/* movsd and movss: loads and copies are 0F 10, stores 0F 11. */
+static bool sse_move(Enc *e, uint8_t legacy, const MirOperand *d, const MirOperand *s) {
+    if (d->kind == MIR_OPERAND_MEM) return is_xmm(s) && modrm(e, legacy, false, 0x0F11, num(s), d, false);
+    return sse(e, legacy, 0x0F10, d, s);
+}
+
+/* movq and movd between a general and an xmm register. */
+static bool move_gx(Enc *e, bool w, const MirOperand *d, const MirOperand *s) {
+    if (is_xmm(d) && (is_gpr(s) || s->kind == MIR_OPERAND_MEM)) return modrm(e, 0x66, w, 0x0F6E, num(d), s, false);
+    if (is_xmm(s) && (is_gpr(d) || d->kind == MIR_OPERAND_MEM)) return modrm(e, 0x66, w, 0x0F7E, num(s), d, false);
+    return false;
+}
+
+static bool branch(Enc *e, const MirInst *inst, uint64_t pc, const uint64_t *block_pc, bool near) {
+    const MirOperand *to = &inst->ops[0];
+    bool jcc = inst->opcode == X86_JCC;
+    uint8_t cc = inst->cond & 15;
+    if (to->kind == MIR_OPERAND_SYMBOL) {
+        if (jcc) put_opcode(e, 0x0F80u + cc);
+        else put(e, 0xE9);
+        note_fixup(e, X86_R_PLT32, to->symbol, -4);
+        put_le(e, 0, 4);
+        return true;
+    }
+    if (to->kind != MIR_OPERAND_BLOCK) return false;
+    if (block_pc && ((block_pc[to->block->id] ^ pc) & CODEGEN_COLD_PC)) {
+        if (!near) return false;
+        if (jcc) put_opcode(e, 0x0F80u + cc);
+        else put(e, 0xE9);
+        note_fixup(e, X86_R_PC32, NULL, -4);
+        e->fixup->block = to->block;
+        put_le(e, 0, 4);
+        return true;
+    }
+    uint32_t len = near ? (jcc ? 6 : 5) : 2;
+    int64_t rel = block_pc ? (int64_t)block_pc[to->block->id] - (int64_t)(pc + len) : 0;
+    if (!near) {
+        if (!fits8(rel)) return false;
+        put(e, jcc ? (uint8_t)(0x70 + cc) : 0xEB);
+        put(e, (uint8_t)rel);
+        return true;
+    }
+    if (jcc) put_opcode(e, 0x0F80u + cc);
+    else put(e, 0xE9);
+    put_le(e, (uint64_t)rel, 4);
+    return true;
+}
+
+static bool encode(Enc *e, const MirInst *inst, uint64_t pc, const uint64_t *block_pc, bool near) {
+    const MirOperand *ops = inst->ops, *d = &ops[0], *s = &ops[1];
+    switch ((X86Opcode)inst->opcode) {
+        case X86_MOV:   return mov(e, d, s);
+        case X86_ADD:   return alu(e, 0, d, s);
+        case X86_OR:    return alu(e, 1, d, s);
+        case X86_AND:   return alu(e, 4, d, s);
+        case X86_SUB:   return alu(e, 5, d, s);
+        case X86_XOR:   return alu(e, 6, d, s);
+        case X86_CMP:   return alu(e, 7, d, s);
+        case X86_TEST:
+            if (s->kind == MIR_OPERAND_IMM) {
+                if (!fits32(s->imm) || !modrm(e, opsize(d->size), d->size == 8, d->size == 1 ? 0xF6 : 0xF7, 0, d, false))
+                    return false;
+                put_imm(e, s->imm, d->size);
+                return true;
+            }
+            if (!is_gpr(s)) return false;
+            return modrm(e, opsize(d->size), d->size == 8, d->size == 1 ? 0x84 : 0x85, num(s), d, needs_rex(s));
+        case X86_MOVSX: case X86_MOVZX: {
+            if (!is_gpr(d)) return false;
+            bool sx = inst->opcode == X86_MOVSX;
+            uint32_t opcode = s->size == 1 ? (sx ? 0x0FBE : 0x0FB6) : s->size == 2 ? (sx ? 0x0FBF : 0x0FB7)
+                            : sx && s->size == 4 ? 0x63 : 0;
+            if (!opcode) return false;
+            return modrm(e, 0, d->size == 8, opcode, num(d), s, false);
+        }
+        case X86_LEA:
+            if (!is_gpr(d) || s->kind != MIR_OPERAND_MEM) return false;
+            return modrm(e, 0, d->size == 8, 0x8D, num(d), s, false);
+        case X86_IMUL:
+            if (!is_gpr(d)) return false;
+            return modrm(e, 0, d->size == 8, 0x0FAF, num(d), s, false);
+        case X86_IMUL3: {
+            const MirOperand *imm = &ops[2];
+            if (!is_gpr(d) || imm->kind != MIR_OPERAND_IMM || !fits32(imm->imm)) return false;
+            bool small = fits8(imm->imm);
+            if (!modrm(e, 0, d->size == 8, small ? 0x6B : 0x69, num(d), s, false)) return false;
+            put_le(e, (uint64_t)imm->imm, small ? 1 : 4);
+            return true;
+        }
+        case X86_NEG:   return unary(e, 3, d);
+        case X86_NOT:   return unary(e, 2, d);
+        case X86_IDIV:  return unary(e, 7, d);
+        case X86_SHL:   return shift(e, 4, d, s);
+        case X86_SHR:   return shift(e, 5, d, s);
+        case X86_SAR:   return shift(e, 7, d, s);
+        case X86_CQO:
+            put(e, 0x48);
+            put(e, 0x99);
+            return true;
+        case X86_SETCC:
+            return modrm(e, 0, false, 0x0F90u + (inst->cond & 15), 0, d, false);
+        case X86_CMOVCC:
+            if (!is_gpr(d)) return false;
+            return modrm(e, 0, d->size == 8, 0x0F40u + (inst->cond & 15), num(d), s, false);
+        case X86_JMP: case X86_JCC:
+            return branch(e, inst, pc, block_pc, near);
+        case X86_CALL:
+            if (d->kind != MIR_OPERAND_SYMBOL) return false;
+            put(e, 0xE8);
+            note_fixup(e, X86_R_PLT32, d->symbol, -4);
+            put_le(e, 0, 4);
+            return true;
+        case X86_RET:
+            put(e, 0xC3);
+            return true;
+        case X86_PUSH: case X86_POP:
+            if (!is_gpr(d)) return false;
+            if (d->reg & 8) put(e, 0x41);
+            put(e, (uint8_t)((inst->opcode == X86_PUSH ? 0x50 : 0x58) + (d->reg & 7)));
+            return true;
+        case X86_LEAVE:
+            put(e, 0xC9);
+            return true;
+        case X86_SYSCALL:
+            put_opcode(e, 0x0F05);
+            return true;
+        case X86_REP_STOSB: put_opcode(e, 0xF3AA); return true;
+        case X86_REP_STOSW: put_opcode(e, 0x66F3AB); return true;
+        case X86_REP_STOSD: put_opcode(e, 0xF3AB); return true;
+        case X86_REP_STOSQ: put_opcode(e, 0xF348AB); return true;
+        case X86_REP_MOVSB: put_opcode(e, 0xF3A4); return true;
+        case X86_MOVSD:     return sse_move(e, 0xF2, d, s);
+        case X86_MOVSS:     return sse_move(e, 0xF3, d, s);
+        case X86_MOVQ:
+            if (is_xmm(d) && is_xmm(s)) return modrm(e, 0xF3, false, 0x0F7E, num(d), s, false);
+            return move_gx(e, true, d, s);
+        case X86_MOVD:      return move_gx(e, false, d, s);
+        case X86_MOVDQU:
+            if (d->kind == MIR_OPERAND_MEM) return is_xmm(s) && modrm(e, 0xF3, false, 0x0F7F, num(s), d, false);
+            return sse(e, 0xF3, 0x0F6F, d, s);
+        case X86_PUNPCKLQDQ: return sse(e, 0x66, 0x0F6C, d, s);
+        case X86_ADDSD:     return sse(e, 0xF2, 0x0F58, d, s);
+        case X86_SUBSD:     return sse(e, 0xF2, 0x0F5C, d, s);
+        case X86_MULSD:     return sse(e, 0xF2, 0x0F59, d, s);
+        case X86_DIVSD:     return sse(e, 0xF2, 0x0F5E, d, s);
+        case X86_UCOMISD:   return sse(e, 0x66, 0x0F2E, d, s);
+        case X86_XORPD:     return sse(e, 0x66, 0x0F57, d, s);
+        case X86_CVTSD2SS:  return sse(e, 0xF2, 0x0F5A, d, s);
+        case X86_CVTSS2SD:  return sse(e, 0xF3, 0x0F5A, d, s);
+        case X86_CVTSI2SD:
+            if (!is_xmm(d) || (!is_gpr(s) && s->kind != MIR_OPERAND_MEM)) return false;
+            return modrm(e, 0xF2, s->size == 8, 0x0F2A, num(d), s, false);
+        case X86_CVTTSD2SI:
+            if (!is_gpr(d) || (!is_xmm(s) && s->kind != MIR_OPERAND_MEM)) return false;
+            return modrm(e, 0xF2, d->size == 8, 0x0F2C, num(d), s, false);
+        default:
+            return false;
+    }
+}
+
+uint32_t x86_64__encode(const MirInst *inst, uint64_t pc, const uint64_t *block_pc, bool near,
+                        uint8_t *out, X86Fixup *fixup) {
+    Enc e = { .out = out, .fixup = fixup };
+    fixup->symbol = NULL;
+    fixup->block = NULL;
+    if (!encode(&e, inst, pc, block_pc, near) || e.n > X86_MAX_INST_BYTES) return 0;
+    /* rip points past the immediate that may follow the displacement. */
+    if (e.rip) fixup->addend = (int64_t)e.disp - (int64_t)(e.n - fixup->offset);
+    return e.n;
+}
+
+/* The multi-byte nops of the optimisation manuals, up to 9 bytes each. */
+static const uint8_t nops[9][9] = {
+    { 0x90 },
+    { 0x66, 0x90 },
+    { 0x0F, 0x1F, 0x00 },
+    { 0x0F, 0x1F, 0x40, 0x00 },
+    { 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+    { 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+    { 0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00 },
+    { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+};
+
+void x86_64__nops(uint8_t *out, uint64_t n) {
+    while (n) {
+        uint32_t k = n > 9 ? 9 : (uint32_t)n;
+        memcpy(out, nops[k - 1], k);
+        out += k;
+        n -= k;
+    }
+}
+
+static bool is_block_branch(const MirInst *inst) {
+    return (inst->opcode == X86_JMP || inst->opcode == X86_JCC) && inst->ops[0].kind == MIR_OPERAND_BLOCK;
+}
+
+static uint64_t block_start(const MirBlock *mb, uint64_t pc) {
+    if (mb->id == 0 || mb->align <= 1) return pc;
+    return (pc + mb->align - 1) & ~(uint64_t)(mb->align - 1);
+}
+
+/*
+ * Every branch starts short.  Each pass places the blocks after the
+ * current lengths and turns the short branches that no longer reach into
+ * near ones; branches only grow, so the passes stop once none has to.
+ */
+bool x86_64__layout(const MirFunction *mf, X86Layout *layout) {
+    memset(layout, 0, sizeof *layout);
+    uint32_t count = 0;
+    for (uint32_t b = 0; b < mf->block_count; b++)
+        for (const MirInst *inst = mf->blocks[b]->first; inst; inst = inst->next) count++;
+    layout->block_pc = malloc((mf->block_count ? mf->block_count : 1) * sizeof(uint64_t));
+    layout->near = calloc(count ? count : 1, 1);
+    uint8_t *length = malloc(count ? count : 1);
+    if (!layout->block_pc || !layout->near || !length) {
+        free(length);
+        x86_64__layout_free(layout);
+        return false;
+    }
+    uint8_t bytes[X86_MAX_INST_BYTES];
+    X86Fixup fixup;
+    uint32_t i = 0;
+    for (uint32_t b = 0; b < mf->block_count; b++) {
+        for (const MirInst *inst = mf->blocks[b]->first; inst; inst = inst->next, i++) {
+            length[i] = (uint8_t)x86_64__encode(inst, 0, NULL, false, bytes, &fixup);
+            if (!length[i]) {
+                layout->failed = inst;
+                free(length);
+                return false;
+            }
+            if (is_block_branch(inst)) layout->branch_count++;
+        }
+    }
+    bool grown;
+    do {
+        grown = false;
+        layout->passes++;
+        /* The next free offset of the function's code and of its cold part */
+        uint64_t end[2] = { 0, CODEGEN_COLD_PC };
+        for (uint32_t b = 0, k = 0; b < mf->block_count; b++) {
+            uint64_t *pc = &end[mf->blocks[b]->cold];
+            *pc = block_start(mf->blocks[b], *pc);
+            layout->block_pc[b] = *pc;
+            for (const MirInst *inst = mf->blocks[b]->first; inst; inst = inst->next) *pc += length[k++];
+        }
+        layout->size = end[0];
+        layout->cold_size = end[1] - CODEGEN_COLD_PC;
+        i = 0;
+        for (uint32_t b = 0; b < mf->block_count; b++) {
+            uint64_t pc = layout->block_pc[b];
+            for (const MirInst *inst = mf->blocks[b]->first; inst; inst = inst->next, i++) {
+                pc += length[i];
+                if (layout->near[i] || !is_block_branch(inst)) continue;
+                if (fits8((int64_t)layout->block_pc[inst->ops[0].block->id] - (int64_t)pc)) continue;
+                layout->near[i] = 1;
+                length[i] = inst->opcode == X86_JCC ? 6 : 5;
+                layout->near_count++;
+                grown = true;
+            }
+        }
+    } while (grown);
+    free(length);
+    return true;
+}
+
+void x86_64__layout_free(X86Layout *layout) {
+    free(layout->block_pc);
+    free(layout->near);
+    layout->block_pc = NULL;
+    layout->near = NULL;
+}
+
+/* size bytes at the end of code, from a multiple of 16 padded with nops
+ * that is set in base; NULL when out of memory. */
+static uint8_t *append(CodegenCode *code, uint64_t size, uint64_t *base) {
+    *base = (code->size + 15) & ~UINT64_C(15);
+    uint8_t *at = codegen__code_grow(code, *base - code->size + size);
+    if (!at) return NULL;
+    x86_64__nops(at, (uint64_t)(code->bytes + *base - at));
+    return code->bytes + *base;
+}
+
+bool x86_64__assemble(const MirFunction *mf, CodegenCode *code, CodegenCode *cold, CodegenExtent *extent) {
+    X86Layout layout;
+    if (!x86_64__layout(mf, &layout)) {
+        code->failed = layout.failed;
+        return false;
+    }
+    /* The function's code and its cold part, by MirBlock.cold */
+    CodegenCode *part[2] = { code, cold };
+    uint64_t base[2] = { 0, cold->size }, done[2] = { 0, 0 };
+    bool ok = append(code, layout.size, &base[0]) != NULL;
+    if (ok && layout.cold_size) ok = append(cold, layout.cold_size, &base[1]) != NULL;
+    *extent = (CodegenExtent){ base[0], base[0] + layout.size, base[1], base[1] + layout.cold_size };
+    uint32_t i = 0;
+    for (uint32_t b = 0; ok && b < mf->block_count; b++) {
+        const MirBlock *mb = mf->blocks[b];
+        CodegenCode *out = part[mb->cold];
+        uint64_t pc = layout.block_pc[b], offset = pc & ~CODEGEN_COLD_PC;
+        x86_64__nops(out->bytes + base[mb->cold] + done[mb->cold], offset - done[mb->cold]);
+        for (const MirInst *inst = mb->first; ok && inst; inst = inst->next, i++) {
+            X86Fixup fixup;
+            uint8_t *at = out->bytes + base[mb->cold] + offset;
+            uint32_t n = x86_64__encode(inst, pc, layout.block_pc, layout.near[i], at, &fixup);
+            if (!n) {
+                code->failed = inst;
+                ok = false;
+            } else if (fixup.symbol) {
+                ok = codegen__code_reloc(out, base[mb->cold] + offset + fixup.offset, fixup.symbol, fixup.type,
+                                         fixup.addend);
+            } else if (fixup.block) {
+                ok = codegen__block_reloc(out, base[mb->cold] + offset + fixup.offset, mf,
+                                          layout.block_pc[fixup.block->id], fixup.type, fixup.addend);
+            }
+            pc += n;
+            offset += n;
+        }
+        done[mb->cold] = offset;
+    }
+    if (ok && code->debug)
+        fprintf(code->debug, "assemble %s: %" PRIu64 " bytes, %" PRIu64 " cold, %u of %u branches near "
+                "after %u passes\n", mf->name, layout.size, layout.cold_size, layout.near_count,
+                layout.branch_count, layout.passes);
+    x86_64__layout_free(&layout);
+    return ok;
+}
@@ -0,0 +1,1182 @@
+#include "x86_64.h"
+#include "../../ir/analysis/analysis.h"
+#include "../../ir/interp/interp.h"
+#include "../../errhandler/errhandler.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Instruction selection for x86-64.  Each IR instruction becomes a few
+ * machine instructions over virtual registers, and two patterns are
+ * covered as one: a GEP whose only uses are addresses of loads, stores and
+ * other GEPs folds into their memory operands, and a compare whose single
+ * use is the branch or select right after it sets the flags they test.
+ */
+
+static const uint32_t int_arg_regs[6] = { X86_RDI, X86_RSI, X86_RDX, X86_RCX, X86_R8, X86_R9 };
+
+/* Where the System V convention passes an argument. */
+typedef struct {
+    bool     real;
+    uint32_t reg;                   /* MIR_NO_REG when on the stack */
+    uint32_t stack;                 /* 8-byte slot above the return address */
+} ArgPlace;
+
+/* How the flags of a real compare hold its outcome besides the condition:
+ * unordered operands set the parity flag. */
+enum { PARITY_NONE, PARITY_TRUE, PARITY_FALSE };
+
+typedef struct {
+    CodegenModule  *cm;
+    IrFunction     *func;
+    MirFunction    *mf;
+    LowerFunction   lf;
+    MirBlock       *mb;             /* block being filled */
+    MirBlock      **block_of;       /* by IR block id */
+    const MirBlock *next;           /* block laid out after mb in its section, or NULL */
+    uint32_t       *vreg;           /* by value: parameters, then temps; MIR_NO_REG until used */
+    uint32_t       *frame_of;       /* by temp: frame object + 1 of a static alloca */
+    uint8_t        *covered;        /* by temp: selected as part of its user */
+    uint16_t        line, column;
+} Isel;
+
+/* --------------------------------------------------------------- emission */
+
+static MirOperand use(uint32_t reg)  { return mir__reg(reg, 8, MIR_USE); }
+static MirOperand def(uint32_t reg)  { return mir__reg(reg, 8, MIR_DEF); }
+static MirOperand both(uint32_t reg) { return mir__reg(reg, 8, MIR_USE | MIR_DEF); }
+
+static MirOperand sized(MirOperand op, uint8_t size) {
+    op.size = size;
+    return op;
+}
+
+static MirOperand implicit(MirOperand op) {
+    op.flags |= MIR_IMPLICIT;
+    return op;
+}
+
+static MirOperand mem(MirMem m, uint8_t size) { return mir__mem(m, size); }
+
+/* Append an instruction with count operands to the current block. */
+static MirInst *ins(Isel *s, X86Opcode op, uint8_t count, ...) {
+    MirInst *inst = mir__inst_new(s->mf, op, count);
+    if (!inst) return NULL;
+    va_list ap;
+    va_start(ap, count);
+    for (uint8_t i = 0; i < count; i++) inst->ops[i] = va_arg(ap, MirOperand);
+    va_end(ap);
+    inst->line = s->line;
+    inst->column = s->column;
+    mir__inst_append(s->mb, inst);
+    return inst;
+}
+
+static MirInst *ins_cc(Isel *s, X86Opcode op, int cc, uint8_t count, MirOperand a, MirOperand b) {
+    MirInst *inst = count == 1 ? ins(s, op, 1, a) : ins(s, op, 2, a, b);
+    if (inst) inst->cond = (uint8_t)cc;
+    return inst;
+}
+
+static uint32_t new_reg(Isel *s, bool real) {
+    return mir__vreg_new(s->mf, real ? MIR_FPR : MIR_GPR);
+}
+
+static bool is_fpr(const Isel *s, uint32_t reg) {
+    return mir__vreg_class(s->mf, reg) == MIR_FPR;
+}
+
+static void copy(Isel *s, uint32_t dst, uint32_t src) {
+    if (dst == src) return;
+    MirInst *inst = ins(s, is_fpr(s, dst) ? X86_MOVSD : X86_MOV, 2, def(dst), use(src));
+    if (inst) inst->flags |= MIR_INST_COPY;
+}
+
+static void jump(Isel *s, MirBlock *to) {
+    MirInst *inst = ins(s, X86_JMP, 1, mir__block(to));
+    if (inst) inst->flags |= MIR_INST_JUMP;
+}
+
+static bool fits_int32(int64_t v) {
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+static void load_imm(Isel *s, uint32_t reg, int64_t v) {
+    if (v == 0) ins(s, X86_XOR, 2, sized(def(reg), 4), sized(mir__reg(reg, 4, 0), 4));
+    else ins(s, X86_MOV, 2, def(reg), mir__imm(v));
+}
+
+/* ----------------------------------------------------------------- values */
+
+static bool is_local(const Isel *s, const IrValue *v) {
+    return v && ((v->kind == IR_VALUE_PARAM && v->id < s->func->param_count) ||
+                 (v->kind == IR_VALUE_TEMP && v->id < s->lf.temp_count));
+}
+
+static uint32_t index_of(const Isel *s, const IrValue *v) {
+    return v->kind == IR_VALUE_PARAM ? v->id : s->func->param_count + v->id;
+}
+
+static bool value_real(const Isel *s, const IrValue *v) {
+    return v && lower__is_real(&s->lf, v);
+}
+
+/* The virtual register holding a parameter or temp. */
+static uint32_t local_reg(Isel *s, const IrValue *v) {
+    uint32_t i = index_of(s, v);
+    if (s->vreg[i] == MIR_NO_REG) s->vreg[i] = new_reg(s, value_real(s, v));
+    return s->vreg[i];
+}
+
+static bool const_int(const IrValue *v, int64_t *out) {
+    if (!v) {
+        *out = 0;
+        return true;
+    }
+    switch (v->kind) {
+        case IR_VALUE_CONST_INT:    *out = v->const_data.int_val; return true;
+        case IR_VALUE_CONST_CHAR:   *out = (unsigned char)v->const_data.char_val; return true;
+        case IR_VALUE_CONST_REAL:   *out = (int64_t)v->const_data.real_val; return true;
+        case IR_VALUE_STRUCT_FIELD: *out = lower__field_offset(v); return true;
+        default: return false;
+    }
+}
+
+static bool is_function(const Isel *s, const char *name) {
+    return lower__find_function(&s->cm->lm, name) != UINT32_MAX;
+}
+
+static MirMem frame_mem(uint32_t object) {
+    MirMem m = mir__mem_base(MIR_NO_REG, 0);
+    m.frame = object + 1;
+    return m;
+}
+
+static MirMem symbol_mem(const char *name) {
+    MirMem m = mir__mem_base(MIR_NO_REG, 0);
+    m.symbol = name;
+    return m;
+}
+
+static MirMem address_of(Isel *s, const IrValue *ptr);
+
+/* dst = address of m, or a copy when m is a register alone. */
+static void lea(Isel *s, uint32_t dst, MirMem m) {
+    if (m.base != MIR_NO_REG && m.index == MIR_NO_REG && !m.disp && !m.frame && !m.symbol) copy(s, dst, m.base);
+    else ins(s, X86_LEA, 2, def(dst), mem(m, 8));
+}
+
+static uint32_t value_reg(Isel *s, const IrValue *v, bool real);
+
+/* v as a general register or, when it fits, a 32-bit immediate. */
+static MirOperand value_operand(Isel *s, const IrValue *v) {
+    int64_t c;
+    if (const_int(v, &c) && fits_int32(c)) return mir__imm(c);
+    return use(value_reg(s, v, false));
+}
+
+/*
+ * A register holding v as a real or an integer, converted like the
+ * interpreter where v is of the other class.
+ */
+static uint32_t value_reg(Isel *s, const IrValue *v, bool real) {
+    uint32_t reg;
+    bool have_real = false;
+    if (v && v->kind == IR_VALUE_CONST_REAL && real) {
+        double d = v->const_data.real_val;
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof bits);
+        reg = new_reg(s, true);
+        if (bits == 0) {
+            ins(s, X86_XORPD, 2, def(reg), mir__reg(reg, 8, 0));
+        } else {
+            uint32_t g = new_reg(s, false);
+            ins(s, X86_MOV, 2, def(g), mir__imm((int64_t)bits));
+            ins(s, X86_MOVQ, 2, def(reg), use(g));
+        }
+        return reg;
+    }
+    int64_t c;
+    if (const_int(v, &c)) {
+        reg = new_reg(s, false);
+        load_imm(s, reg, c);
+    } else if (v->kind == IR_VALUE_GLOBAL_SYMBOL && v->name) {
+        if (!is_function(s, v->name)) codegen__add_extern(s->cm, v->name);
+        reg = new_reg(s, false);
+        ins(s, X86_LEA, 2, def(reg), mem(symbol_mem(v->name), 8));
+    } else if (v->kind == IR_VALUE_TEMP && v->id < s->lf.temp_count &&
+               (s->frame_of[v->id] || s->covered[v->id])) {
+        reg = new_reg(s, false);
+        lea(s, reg, address_of(s, v));
+    } else if (is_local(s, v)) {
+        reg = local_reg(s, v);
+        have_real = value_real(s, v);
+    } else {
+        reg = new_reg(s, false);
+        load_imm(s, reg, 0);
+    }
+    if (have_real == real) return reg;
+    uint32_t out = new_reg(s, real);
+    ins(s, real ? X86_CVTSI2SD : X86_CVTTSD2SI, 2, def(out), use(reg));
+    return out;
+}
+
+/* -------------------------------------------------------------- addresses */
+
+/* Add reg * scale to the index of m, computing what m cannot hold. */
+static void add_index(Isel *s, MirMem *m, uint32_t reg, uint64_t scale) {
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+        uint32_t scaled = new_reg(s, false);
+        if (scale <= INT32_MAX) {
+            ins(s, X86_IMUL3, 3, def(scaled), use(reg), mir__imm((int64_t)scale));
+        } else {
+            load_imm(s, scaled, (int64_t)scale);
+            ins(s, X86_IMUL, 2, both(scaled), use(reg));
+        }
+        reg = scaled;
+        scale = 1;
+    }
+    /* rip-relative addresses take no index. */
+    if (m->index != MIR_NO_REG || m->symbol) {
+        uint32_t base = new_reg(s, false);
+        lea(s, base, *m);
+        *m = mir__mem_base(base, 0);
+    }
+    if (m->base == MIR_NO_REG && !m->frame && scale == 1) {
+        m->base = reg;
+        return;
+    }
+    m->index = reg;
+    m->scale = (uint8_t)scale;
+}
+
+static void add_disp(Isel *s, MirMem *m, int64_t off) {
+    int64_t disp = (int64_t)m->disp + off;
+    if (fits_int32(disp)) {
+        m->disp = (int32_t)disp;
+        return;
+    }
+    uint32_t reg = new_reg(s, false);
+    load_imm(s, reg, off);
+    add_index(s, m, reg, 1);
+}
+
+static MirMem gep_address(Isel *s, const IrInstruction *gep) {
+    MirMem m = address_of(s, gep->operand1);
+    uint32_t scale = lower__gep_scale(gep);
+    const IrGepExtra *extra = gep->extra;
+    uint32_t n = 1 + (extra ? extra->index_count : 0);
+    for (uint32_t i = 0; i < n; i++) {
+        const IrValue *idx = i == 0 ? gep->operand2 : extra->indices[i - 1];
+        int64_t c;
+        if (!idx) continue;
+        if (idx->kind == IR_VALUE_STRUCT_FIELD) add_disp(s, &m, lower__field_offset(idx));
+        else if (const_int(idx, &c)) add_disp(s, &m, (int64_t)((uint64_t)c * scale));
+        else add_index(s, &m, value_reg(s, idx, false), scale);
+    }
+    return m;
+}
+
+/* The memory a pointer value points at. */
+static MirMem address_of(Isel *s, const IrValue *ptr) {
+    if (ptr && ptr->kind == IR_VALUE_TEMP && ptr->id < s->lf.temp_count) {
+        if (s->frame_of[ptr->id]) return frame_mem(s->frame_of[ptr->id] - 1);
+        if (s->covered[ptr->id]) return gep_address(s, lower__def(&s->lf, ptr));
+    }
+    if (ptr && ptr->kind == IR_VALUE_GLOBAL_SYMBOL && ptr->name) {
+        if (!is_function(s, ptr->name)) codegen__add_extern(s->cm, ptr->name);
+        return symbol_mem(ptr->name);
+    }
+    return mir__mem_base(value_reg(s, ptr, false), 0);
+}
+
+/* ------------------------------------------------------------------ flags */
+
+static bool is_compare(IrOpcode op) {
+    return op >= IR_EQ && op <= IR_GE;
+}
+
+/* Set the flags for cmp and return the condition true when it holds. */
+static int compare_flags(Isel *s, const IrInstruction *cmp, int *parity) {
+    IrOpcode op = (IrOpcode)cmp->opcode;
+    *parity = PARITY_NONE;
+    if (value_real(s, cmp->operand1) || value_real(s, cmp->operand2)) {
+        uint32_t a = value_reg(s, cmp->operand1, true), b = value_reg(s, cmp->operand2, true);
+        /* a < b is b > a, so every ordering is an above test, false when
+         * unordered. */
+        if (op == IR_LT || op == IR_LE) ins(s, X86_UCOMISD, 2, use(b), use(a));
+        else ins(s, X86_UCOMISD, 2, use(a), use(b));
+        switch (op) {
+            case IR_EQ:  *parity = PARITY_FALSE; return X86_CC_E;
+            case IR_NEQ: *parity = PARITY_TRUE;  return X86_CC_NE;
+            case IR_LT: case IR_GT: return X86_CC_A;
+            default: return X86_CC_AE;
+        }
+    }
+    static const int cc[] = {
+        [IR_EQ] = X86_CC_E, [IR_NEQ] = X86_CC_NE, [IR_LT] = X86_CC_L,
+        [IR_LE] = X86_CC_LE, [IR_GT] = X86_CC_G, [IR_GE] = X86_CC_GE,
+    };
+    static const int swapped[] = {
+        [IR_EQ] = X86_CC_E, [IR_NEQ] = X86_CC_NE, [IR_LT] = X86_CC_G,
+        [IR_LE] = X86_CC_GE, [IR_GT] = X86_CC_L, [IR_GE] = X86_CC_LE,
+    };
+    MirOperand a = value_operand(s, cmp->operand1), b = value_operand(s, cmp->operand2);
+    int result = cc[op];
+    if (a.kind == MIR_OPERAND_IMM && b.kind == MIR_OPERAND_IMM) {
+        a = use(value_reg(s, cmp->operand1, false));
+    } else if (a.kind == MIR_OPERAND_IMM) {
+        MirOperand t = a;
+        a = b;
+        b = t;
+        result = swapped[op];
+    }
+    if (b.kind == MIR_OPERAND_IMM && b.imm == 0) ins(s, X86_TEST, 2, a, a);
+    else ins(s, X86_CMP, 2, a, b);
+    return result;
+}
+
+/* The temp's defining compare when it was left to its user. */
+static const IrInstruction *covered_compare(const Isel *s, const IrValue *v) {
+    if (!v || v->kind != IR_VALUE_TEMP || v->id >= s->lf.temp_count || !s->covered[v->id]) return NULL;
+    const IrInstruction *def = lower__def(&s->lf, v);
+    return def && is_compare((IrOpcode)def->opcode) ? def : NULL;
+}
+
+/* Set the flags for the truth of cond. */
+static int truth_flags(Isel *s, const IrValue *cond, int *parity) {
+    const IrInstruction *cmp = covered_compare(s, cond);
+    if (cmp) return compare_flags(s, cmp, parity);
+    *parity = PARITY_NONE;
+    if (value_real(s, cond)) {
+        uint32_t x = value_reg(s, cond, true), zero = new_reg(s, true);
+        ins(s, X86_XORPD, 2, def(zero), mir__reg(zero, 8, 0));
+        ins(s, X86_UCOMISD, 2, use(x), use(zero));
+        *parity = PARITY_TRUE;
+        return X86_CC_NE;
+    }
+    uint32_t r = value_reg(s, cond, false);
+    ins(s, X86_TEST, 2, use(r), use(r));
+    return X86_CC_NE;
+}
+
+/* dst = 1 if the condition holds, else 0. */
+static void materialize(Isel *s, uint32_t dst, int cc, int parity) {
+    uint32_t byte = new_reg(s, false);
+    ins_cc(s, X86_SETCC, cc, 1, sized(def(byte), 1), mir__imm(0));
+    if (parity != PARITY_NONE) {
+        uint32_t p = new_reg(s, false);
+        ins_cc(s, X86_SETCC, parity == PARITY_TRUE ? X86_CC_P : X86_CC_NP, 1, sized(def(p), 1), mir__imm(0));
+        ins(s, parity == PARITY_TRUE ? X86_OR : X86_AND, 2, sized(both(byte), 1), sized(use(p), 1));
+    }
+    ins(s, X86_MOVZX, 2, def(dst), sized(use(byte), 1));
+}
+
+/* ------------------------------------------------------------ instructions */
+
+/* The register an instruction's result goes to, or a throwaway one for a
+ * result nothing names. */
+static uint32_t result_reg(Isel *s, const IrInstruction *inst, bool real) {
+    if (is_local(s, inst->result) && value_real(s, inst->result) == real) return local_reg(s, inst->result);
+    return new_reg(s, real);
+}
+
+/* Move reg, of class real, into the result where the result is of the
+ * other class, keeping the bits. */
+static void finish(Isel *s, const IrInstruction *inst, uint32_t reg, bool real) {
+    if (!is_local(s, inst->result) || value_real(s, inst->result) == real) return;
+    ins(s, X86_MOVQ, 2, def(local_reg(s, inst->result)), use(reg));
+}
+
+static void select_int_binary(Isel *s, const IrInstruction *inst, IrOpcode op, uint32_t r) {
+    MirOperand a = value_operand(s, inst->operand1), b = value_operand(s, inst->operand2);
+    switch (op) {
+        case IR_ADD: case IR_MUL:
+            if (a.kind == MIR_OPERAND_IMM && b.kind == MIR_OPERAND_IMM) {
+                a = use(value_reg(s, inst->operand1, false));
+            } else if (a.kind == MIR_OPERAND_IMM) {
+                MirOperand t = a;
+                a = b;
+                b = t;
+            }
+            if (op == IR_MUL) {
+                if (b.kind == MIR_OPERAND_IMM) {
+                    ins(s, X86_IMUL3, 3, def(r), a, b);
+                } else {
+                    copy(s, r, a.reg);
+                    ins(s, X86_IMUL, 2, both(r), b);
+                }
+            } else {
+                MirMem m = mir__mem_base(a.reg, 0);
+                if (b.kind == MIR_OPERAND_IMM) m.disp = (int32_t)b.imm;
+                else m.index = b.reg;
+                lea(s, r, m);
+            }
+            return;
+        case IR_SUB: case IR_AND: case IR_OR: case IR_XOR: {
+            static const X86Opcode ops[] = {
+                [IR_SUB] = X86_SUB, [IR_AND] = X86_AND, [IR_OR] = X86_OR, [IR_XOR] = X86_XOR,
+            };
+            if (a.kind == MIR_OPERAND_IMM) load_imm(s, r, a.imm);
+            else copy(s, r, a.reg);
+            ins(s, ops[op], 2, both(r), b);
+            return;
+        }
+        case IR_SHL: case IR_SHR: case IR_SAR: {
+            X86Opcode x = op == IR_SHL ? X86_SHL : op == IR_SHR ? X86_SHR : X86_SAR;
+            if (b.kind != MIR_OPERAND_IMM) copy(s, X86_RCX, b.reg);
+            if (a.kind == MIR_OPERAND_IMM) load_imm(s, r, a.imm);
+            else copy(s, r, a.reg);
+            if (b.kind == MIR_OPERAND_IMM) ins(s, x, 2, both(r), sized(mir__imm(b.imm & 63), 1));
+            else ins(s, x, 2, both(r), sized(use(X86_RCX), 1));
+            return;
+        }
+        case IR_DIV: case IR_MOD: {
+            uint32_t divisor = b.kind == MIR_OPERAND_IMM ? value_reg(s, inst->operand2, false) : b.reg;
+            if (a.kind == MIR_OPERAND_IMM) load_imm(s, X86_RAX, a.imm);
+            else copy(s, X86_RAX, a.reg);
+            ins(s, X86_CQO, 2, implicit(def(X86_RDX)), implicit(use(X86_RAX)));
+            ins(s, X86_IDIV, 3, use(divisor), implicit(both(X86_RAX)), implicit(both(X86_RDX)));
+            copy(s, r, op == IR_DIV ? X86_RAX : X86_RDX);
+            return;
+        }
+        default: {
+            int parity;
+            int cc = compare_flags(s, inst, &parity);
+            materialize(s, r, cc, parity);
+            return;
+        }
+    }
+}
+
+static void select_real_binary(Isel *s, const IrInstruction *inst, IrOpcode op) {
+    uint32_t a = value_reg(s, inst->operand1, true), b = value_reg(s, inst->operand2, true);
+    uint32_t r = result_reg(s, inst, true);
+    switch (op) {
+        case IR_ADD: copy(s, r, a); ins(s, X86_ADDSD, 2, both(r), use(b)); break;
+        case IR_SUB: copy(s, r, a); ins(s, X86_SUBSD, 2, both(r), use(b)); break;
+        case IR_MUL: copy(s, r, a); ins(s, X86_MULSD, 2, both(r), use(b)); break;
+        case IR_DIV: copy(s, r, a); ins(s, X86_DIVSD, 2, both(r), use(b)); break;
+        case IR_MOD: {
+            codegen__add_extern(s->cm, "fmod");
+            copy(s, X86_XMM(0), a);
+            copy(s, X86_XMM(1), b);
+            MirInst *call = ins(s, X86_CALL, 3, mir__symbol("fmod"),
+                                implicit(use(X86_XMM(0))), implicit(use(X86_XMM(1))));
+            if (call) call->flags |= MIR_INST_CALL;
+            s->mf->has_calls = true;
+            copy(s, r, X86_XMM(0));
+            break;
+        }
+        default: break;
+    }
+    finish(s, inst, r, true);
+}
+
+static void select_binary(Isel *s, const IrInstruction *inst) {
+    IrOpcode op = (IrOpcode)inst->opcode;
+    bool real = op <= IR_GE && (value_real(s, inst->operand1) || value_real(s, inst->operand2));
+    if (real && !is_compare(op)) {
+        select_real_binary(s, inst, op);
+        return;
+    }
+    uint32_t r = result_reg(s, inst, false);
+    select_int_binary(s, inst, op, r);
+    finish(s, inst, r, false);
+}
+
+static void select_unary(Isel *s, const IrInstruction *inst) {
+    if (inst->opcode == IR_NEG && value_real(s, inst->operand1)) {
+        uint32_t a = value_reg(s, inst->operand1, true), sign = new_reg(s, false), mask = new_reg(s, true);
+        uint32_t r = result_reg(s, inst, true);
+        ins(s, X86_MOV, 2, def(sign), mir__imm(INT64_MIN));
+        ins(s, X86_MOVQ, 2, def(mask), use(sign));
+        copy(s, r, a);
+        ins(s, X86_XORPD, 2, both(r), use(mask));
+        finish(s, inst, r, true);
+        return;
+    }
+    uint32_t r = result_reg(s, inst, false);
+    copy(s, r, value_reg(s, inst->operand1, false));
+    ins(s, inst->opcode == IR_NOT ? X86_NOT : X86_NEG, 1, both(r));
+    finish(s, inst, r, false);
+}
+
+static void select_load(Isel *s, const IrInstruction *inst) {
+    LowerAccess acc = lower__access(&s->lf, inst->operand1);
+    MirMem m = address_of(s, inst->operand1);
+    if (!acc.typed || acc.size == 8) {
+        bool real = value_real(s, inst->result);
+        ins(s, real ? X86_MOVSD : X86_MOV, 2, def(result_reg(s, inst, real)), mem(m, 8));
+    } else if (acc.is_real) {
+        uint32_t r = result_reg(s, inst, true);
+        ins(s, X86_CVTSS2SD, 2, def(r), mem(m, 4));
+        finish(s, inst, r, true);
+    } else {
+        uint32_t r = result_reg(s, inst, false);
+        if (acc.size == 4 && !acc.is_signed) ins(s, X86_MOV, 2, sized(def(r), 4), mem(m, 4));
+        else ins(s, acc.is_signed ? X86_MOVSX : X86_MOVZX, 2, def(r), mem(m, acc.size));
+        finish(s, inst, r, false);
+    }
+}
+
+static void select_store(Isel *s, const IrInstruction *inst) {
+    LowerAccess acc = lower__access(&s->lf, inst->operand1);
+    const IrValue *v = inst->operand2;
+    bool real = acc.typed ? acc.is_real : value_real(s, v);
+    uint8_t size = acc.typed ? acc.size : 8;
+    if (real) {
+        uint32_t x = value_reg(s, v, true);
+        MirMem m = address_of(s, inst->operand1);
+        if (size == 4) {
+            uint32_t single = new_reg(s, true);
+            ins(s, X86_CVTSD2SS, 2, def(single), use(x));
+            ins(s, X86_MOVSS, 2, mem(m, 4), use(single));
+        } else {
+            ins(s, X86_MOVSD, 2, mem(m, 8), use(x));
+        }
+        return;
+    }
+    MirOperand val = value_operand(s, v);
+    MirMem m = address_of(s, inst->operand1);
+    if (val.kind == MIR_OPERAND_IMM) {
+        /* Only the bytes stored count. */
+        if (size == 1) val.imm = (int8_t)val.imm;
+        else if (size == 2) val.imm = (int16_t)val.imm;
+    }
+    ins(s, X86_MOV, 2, mem(m, size), sized(val, val.kind == MIR_OPERAND_IMM ? 8 : size));
+}
+
+static void select_alloca(Isel *s, const IrInstruction *inst) {
+    if (!is_local(s, inst->result) || inst->result->kind != IR_VALUE_TEMP) return;
+    if (s->frame_of[inst->result->id]) return;
+    /* Below the frame, until the function returns. */
+    uint32_t size = new_reg(s, false), r = result_reg(s, inst, false);
+    copy(s, size, value_reg(s, inst->operand1, false));
+    ins(s, X86_ADD, 2, both(size), mir__imm(15));
+    ins(s, X86_AND, 2, both(size), mir__imm(-16));
+    ins(s, X86_SUB, 2, both(X86_RSP), use(size));
+    copy(s, r, X86_RSP);
+    s->mf->dynamic_stack = true;
+}
+
+static void select_cast(Isel *s, const IrInstruction *inst) {
+    const Type *t = inst->result->type_info;
+    DataType to = ir__datatype_of(t);
+    uint32_t size = ir__type_size(t);
+    if (to == TYPE_REAL) {
+        uint32_t r = result_reg(s, inst, true);
+        copy(s, r, value_reg(s, inst->operand1, true));
+        if (size == 4) {
+            ins(s, X86_CVTSD2SS, 2, def(r), use(r));
+            ins(s, X86_CVTSS2SD, 2, def(r), use(r));
+        }
+        finish(s, inst, r, true);
+        return;
+    }
+    uint32_t r = result_reg(s, inst, false), v = value_reg(s, inst->operand1, false);
+    if (to == TYPE_CHAR) ins(s, X86_MOVZX, 2, def(r), sized(use(v), 1));
+    else if (to == TYPE_INT && (size == 1 || size == 2 || size == 4)) ins(s, X86_MOVSX, 2, def(r), sized(use(v), (uint8_t)size));
+    else copy(s, r, v);
+    finish(s, inst, r, false);
+}
+
+static void select_select(Isel *s, const IrInstruction *inst) {
+    if (!is_local(s, inst->result)) return;
+    bool real = value_real(s, inst->result);
+    const IrSelectExtra *sel = inst->extra;
+    /* Both values first: nothing may come between the flags and cmov. */
+    uint32_t r = new_reg(s, false), taken;
+    if (real) {
+        uint32_t f = value_reg(s, sel->false_value, true), t = value_reg(s, inst->operand2, true);
+        taken = new_reg(s, false);
+        ins(s, X86_MOVQ, 2, def(r), use(f));
+        ins(s, X86_MOVQ, 2, def(taken), use(t));
+    } else {
+        MirOperand f = value_operand(s, sel->false_value);
+        taken = value_reg(s, inst->operand2, false);
+        if (f.kind == MIR_OPERAND_IMM) load_imm(s, r, f.imm);
+        else copy(s, r, f.reg);
+    }
+    int parity;
+    int cc = truth_flags(s, inst->operand1, &parity);
+    if (parity != PARITY_NONE) {
+        uint32_t truth = new_reg(s, false);
+        materialize(s, truth, cc, parity);
+        ins(s, X86_TEST, 2, use(truth), use(truth));
+        cc = X86_CC_NE;
+    }
+    ins_cc(s, X86_CMOVCC, cc, 2, both(r), use(taken));
+    if (real) ins(s, X86_MOVQ, 2, def(local_reg(s, inst->result)), use(r));
+    else copy(s, local_reg(s, inst->result), r);
+}
+
+/* System V placement of arguments of the given classes. */
+static void place_args(const bool *real, uint32_t n, ArgPlace *places) {
+    uint32_t ints = 0, reals = 0, stack = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        places[i] = (ArgPlace){ real[i], MIR_NO_REG, 0 };
+        if (real[i] && reals < 8) places[i].reg = X86_XMM(reals++);
+        else if (!real[i] && ints < 6) places[i].reg = int_arg_regs[ints++];
+        else places[i].stack = stack++;
+    }
+}
+
+/*
+ * Call name with args placed by class: the values first, then the stack
+ * area, then the argument registers, so no fixed register is live while
+ * another value is computed.  The result, of class ret_real, goes to the
+ * instruction's result.
+ */
+static void emit_call(Isel *s, const IrInstruction *inst, const char *name,
+                      const IrValue *const *args, const bool *real, uint32_t n, bool ret_real) {
+    ArgPlace *places = malloc((n ? n : 1) * sizeof(ArgPlace));
+    MirOperand *vals = malloc((n ? n : 1) * sizeof(MirOperand));
+    if (!places || !vals) {
+        free(places);
+        free(vals);
+        s->mf->oom = true;
+        return;
+    }
+    place_args(real, n, places);
+    uint32_t stack = 0, regs = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        vals[i] = real[i] ? use(value_reg(s, args[i], true)) : value_operand(s, args[i]);
+        if (places[i].reg == MIR_NO_REG) stack++;
+        else regs++;
+    }
+    int64_t area = (int64_t)((stack * 8 + 15) & ~15U);
+    if (area) ins(s, X86_SUB, 2, both(X86_RSP), mir__imm(area));
+    for (uint32_t i = 0; i < n; i++) {
+        if (places[i].reg != MIR_NO_REG) continue;
+        MirOperand slot = mem(mir__mem_base(X86_RSP, (int32_t)places[i].stack * 8), 8);
+        ins(s, real[i] ? X86_MOVSD : X86_MOV, 2, slot, vals[i]);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (places[i].reg == MIR_NO_REG) continue;
+        if (vals[i].kind == MIR_OPERAND_IMM) load_imm(s, places[i].reg, vals[i].imm);
+        else copy(s, places[i].reg, vals[i].reg);
+    }
+    MirInst *call = mir__inst_new(s->mf, X86_CALL, (uint8_t)(1 + regs));
+    if (call) {
+        call->ops[0] = mir__symbol(name);
+        for (uint32_t i = 0, k = 1; i < n; i++)
+            if (places[i].reg != MIR_NO_REG) call->ops[k++] = implicit(use(places[i].reg));
+        call->flags |= MIR_INST_CALL;
+        call->line = s->line;
+        call->column = s->column;
+        mir__inst_append(s->mb, call);
+    }
+    s->mf->has_calls = true;
+    if (area) ins(s, X86_ADD, 2, both(X86_RSP), mir__imm(area));
+    if (is_local(s, inst->result)) {
+        uint32_t r = result_reg(s, inst, ret_real);
+        copy(s, r, ret_real ? X86_XMM(0) : X86_RAX);
+        finish(s, inst, r, ret_real);
+    }
+    free(places);
+    free(vals);
+}
+
+/* `signal` is the system call itself: the service in rax, arguments in
+ * rdi, rsi, rdx, r10, r8 and r9. */
+static void select_signal(Isel *s, const IrValue *const *args, uint32_t argc) {
+    static const uint32_t regs[7] = { X86_RAX, X86_RDI, X86_RSI, X86_RDX, X86_R10, X86_R8, X86_R9 };
+    uint32_t n = argc < 7 ? argc : 7;
+    MirOperand vals[7];
+    for (uint32_t i = 0; i < n; i++) vals[i] = value_operand(s, args[i]);
+    /* r10 last: it is the target's scratch register. */
+    static const uint32_t order[7] = { 0, 1, 2, 3, 5, 6, 4 };
+    for (uint32_t k = 0; k < 7; k++) {
+        uint32_t i = order[k];
+        if (i >= n) continue;
+        if (vals[i].kind == MIR_OPERAND_IMM) load_imm(s, regs[i], vals[i].imm);
+        else copy(s, regs[i], vals[i].reg);
+    }
+    MirInst *sys = mir__inst_new(s->mf, X86_SYSCALL, (uint8_t)(n + 3));
+    if (!sys) return;
+    uint8_t k = 0;
+    sys->ops[k++] = implicit(n ? both(X86_RAX) : def(X86_RAX));
+    for (uint32_t i = 1; i < n; i++) sys->ops[k++] = implicit(use(regs[i]));
+    sys->ops[k++] = implicit(def(X86_RCX));
+    sys->ops[k++] = implicit(def(X86_R11));
+    sys->count = k;
+    sys->line = s->line;
+    sys->column = s->column;
+    mir__inst_append(s->mb, sys);
+}
+
+static void select_call(Isel *s, const IrInstruction *inst) {
+    const IrCallExtra *call = inst->extra;
+    const IrValue *const *args = call ? (const IrValue *const *)call->args : NULL;
+    uint32_t argc = call ? call->arg_count : 0;
+    const char *name = inst->operand1 && inst->operand1->kind == IR_VALUE_GLOBAL_SYMBOL
+                     ? inst->operand1->name : NULL;
+    uint32_t f = lower__callee(&s->cm->lm, inst);
+    if (f != UINT32_MAX) {
+        const IrFunction *callee = s->cm->mod->functions[f];
+        uint32_t n = callee->param_count;
+        const IrValue **vals = malloc((n ? n : 1) * sizeof(IrValue *));
+        bool *real = malloc(n ? n : 1);
+        if (vals && real) {
+            for (uint32_t i = 0; i < n; i++) {
+                vals[i] = i < argc ? args[i] : NULL;
+                real[i] = lower__param_is_real(callee, i);
+            }
+            emit_call(s, inst, callee->name, vals, real, n, lower__returns_real(callee));
+        } else {
+            s->mf->oom = true;
+        }
+        free(vals);
+        free(real);
+        return;
+    }
+    if (name && strcmp(name, IR_RUNTIME_SIGNAL) == 0) {
+        select_signal(s, args, argc);
+        return;
+    }
+    if (name && strcmp(name, IR_RUNTIME_HALT) == 0) {
+        InterpServices svc = interp__services(s->cm->opts->target_arch);
+        load_imm(s, X86_RAX, (int64_t)svc.exit_group);
+        load_imm(s, X86_RDI, 0);
+        ins(s, X86_SYSCALL, 4, implicit(both(X86_RAX)), implicit(use(X86_RDI)),
+            implicit(def(X86_RCX)), implicit(def(X86_R11)));
+        return;
+    }
+    if (!name) {
+        errhandler__report_error(ERROR_CODE_CODEGEN_UNSUPPORTED, s->line, (uint8_t)s->column, "codegen",
+                                 "Indirect call in %s", s->func->name);
+        return;
+    }
+    /* The runtime and anything else defined elsewhere: arguments by class. */
+    uint32_t n = argc < 16 ? argc : 16;
+    bool real[16];
+    for (uint32_t i = 0; i < n; i++) real[i] = value_real(s, args[i]);
+    codegen__add_extern(s->cm, name);
+    emit_call(s, inst, name, args, real, n, value_real(s, inst->result));
+}
+
+/* Fills of at most this many bytes with a constant count are stored
+ * inline; longer or unknown ones take rep stos. */
+#define INLINE_FILL_MAX 128
+
+/* The low size bytes of v repeated across 64 bits. */
+static uint64_t splat(uint64_t v, uint32_t size) {
+    if (size >= 8) return v;
+    uint64_t unit = v & ((UINT64_C(1) << (8 * size)) - 1);
+    uint64_t out = 0;
+    for (uint32_t i = 0; i < 8; i += size) out |= unit << (8 * i);
+    return out;
+}
+
+/* The 64-bit pattern of a fill with a constant value. */
+static bool fill_pattern(const IrValue *v, uint32_t elem_size, uint64_t *out) {
+    int64_t c;
+    if (elem_size != 1 && elem_size != 2 && elem_size != 4 && elem_size != 8) {
+        /* Only zero fills come in other sizes. */
+        *out = 0;
+        return true;
+    }
+    if (v->kind == IR_VALUE_CONST_REAL) {
+        if (elem_size == 4) {
+            float f = (float)v->const_data.real_val;
+            uint32_t bits;
+            memcpy(&bits, &f, sizeof bits);
+            *out = splat(bits, 4);
+        } else {
+            memcpy(out, &v->const_data.real_val, sizeof *out);
+        }
+        return elem_size == 4 || elem_size == 8;
+    }
+    if (v->kind != IR_VALUE_CONST_INT && v->kind != IR_VALUE_CONST_CHAR) return false;
+    if (!const_int(v, &c)) return false;
+    *out = splat((uint64_t)c, elem_size);
+    return true;
+}
+
+/*
+ * A fill of a constant number of bytes stored inline: 16-byte movdqu
+ * stores of the pattern broadcast into xmm0, then a movq and narrower
+ * movs for the tail.  Unless known gives the pattern, value holds one
+ * element in a general register.
+ */
+static void inline_fill(Isel *s, uint32_t dst, uint32_t value, bool known, uint64_t pattern,
+                        uint32_t elem_size, uint32_t bytes) {
+    uint32_t g = new_reg(s, false);
+    if (known) {
+        load_imm(s, g, (int64_t)pattern);
+    } else if (elem_size == 8) {
+        copy(s, g, value);
+    } else {
+        /* Zero-extend the element, then multiply it into every lane. */
+        if (elem_size == 4) ins(s, X86_MOV, 2, sized(def(g), 4), sized(use(value), 4));
+        else ins(s, X86_MOVZX, 2, def(g), sized(use(value), (uint8_t)elem_size));
+        uint32_t lanes = new_reg(s, false);
+        load_imm(s, lanes, (int64_t)splat(1, elem_size));
+        ins(s, X86_IMUL, 2, both(g), use(lanes));
+    }
+    uint32_t off = 0;
+    if (bytes >= 16) {
+        /* A physical register: a spill would keep only its low half. */
+        uint32_t x = X86_XMM(0);
+        if (known && pattern == 0) {
+            ins(s, X86_XORPD, 2, def(x), mir__reg(x, 8, 0));
+        } else {
+            ins(s, X86_MOVQ, 2, def(x), use(g));
+            ins(s, X86_PUNPCKLQDQ, 2, both(x), use(x));
+        }
+        for (; bytes - off >= 16; off += 16)
+            ins(s, X86_MOVDQU, 2, mem(mir__mem_base(dst, (int32_t)off), 16), use(x));
+        if (bytes - off >= 8) {
+            ins(s, X86_MOVQ, 2, mem(mir__mem_base(dst, (int32_t)off), 8), use(x));
+            off += 8;
+        }
+    }
+    for (uint8_t size = 8; size >= 1; size /= 2)
+        for (; bytes - off >= size; off += size)
+            ins(s, X86_MOV, 2, mem(mir__mem_base(dst, (int32_t)off), size), sized(use(g), size));
+}
+
+static void select_mem(Isel *s, const IrInstruction *inst) {
+    const IrMemExtra *extra = inst->extra;
+    int64_t n = 0;
+    bool inline_count = inst->opcode == IR_MEMSET && extra->count &&
+                        extra->count->kind == IR_VALUE_CONST_INT && const_int(extra->count, &n) &&
+                        (n <= 0 || (uint64_t)n <= INLINE_FILL_MAX / extra->elem_size);
+    if (inline_count && n <= 0) return;
+    uint32_t count = inline_count ? MIR_NO_REG : value_reg(s, extra->count, false);
+    uint32_t dst = value_reg(s, inst->operand1, false);
+    if (inst->opcode == IR_MEMCPY) {
+        /* Byte by byte upwards, like the loop it replaced: the loop did
+         * not prove source and destination apart, so the copy is never
+         * split into wider loads and stores. */
+        uint32_t src = value_reg(s, inst->operand2, false);
+        uint32_t bytes = new_reg(s, false);
+        if (extra->elem_size == 1) copy(s, bytes, count);
+        else ins(s, X86_IMUL3, 3, def(bytes), use(count), mir__imm(extra->elem_size));
+        copy(s, X86_RDI, dst);
+        copy(s, X86_RSI, src);
+        copy(s, X86_RCX, bytes);
+        ins(s, X86_REP_MOVSB, 3, implicit(both(X86_RDI)), implicit(both(X86_RSI)), implicit(both(X86_RCX)));
+        return;
+    }
+    uint64_t pattern = 0;
+    bool known = inline_count && fill_pattern(inst->operand2, extra->elem_size, &pattern);
+    uint32_t value = MIR_NO_REG;
+    if (known) {
+        /* The pattern is loaded as it is stored. */
+    } else if (value_real(s, inst->operand2)) {
+        uint32_t x = value_reg(s, inst->operand2, true);
+        value = new_reg(s, false);
+        if (extra->elem_size == 4) {
+            uint32_t single = new_reg(s, true);
+            ins(s, X86_CVTSD2SS, 2, def(single), use(x));
+            ins(s, X86_MOVD, 2, sized(def(value), 4), use(single));
+        } else {
+            ins(s, X86_MOVQ, 2, def(value), use(x));
+        }
+    } else {
+        value = value_reg(s, inst->operand2, false);
+    }
+    if (inline_count) {
+        inline_fill(s, dst, value, known, pattern, extra->elem_size, (uint32_t)n * extra->elem_size);
+        return;
+    }
+    X86Opcode op;
+    uint32_t elems = count;
+    switch (extra->elem_size) {
+        case 1: op = X86_REP_STOSB; break;
+        case 2: op = X86_REP_STOSW; break;
+        case 4: op = X86_REP_STOSD; break;
+        case 8: op = X86_REP_STOSQ; break;
+        default:
+            /* Only zero fills come in other sizes. */
+            op = X86_REP_STOSB;
+            elems = new_reg(s, false);
+            ins(s, X86_IMUL3, 3, def(elems), use(count), mir__imm(extra->elem_size));
+            break;
+    }
+    copy(s, X86_RDI, dst);
+    copy(s, X86_RCX, elems);
+    copy(s, X86_RAX, value);
+    ins(s, op, 3, implicit(both(X86_RDI)), implicit(both(X86_RCX)), implicit(use(X86_RAX)));
+}
+
+static void select_return(Isel *s, const IrValue *value) {
+    bool real = lower__returns_real(s->func);
+    if (real) {
+        if (value) copy(s, X86_XMM(0), value_reg(s, value, true));
+        else ins(s, X86_XORPD, 2, def(X86_XMM(0)), mir__reg(X86_XMM(0), 8, 0));
+    } else if (value) {
+        MirOperand v = value_operand(s, value);
+        if (v.kind == MIR_OPERAND_IMM) load_imm(s, X86_RAX, v.imm);
+        else copy(s, X86_RAX, v.reg);
+    } else {
+        load_imm(s, X86_RAX, 0);
+    }
+    MirInst *ret = ins(s, X86_RET, 1, implicit(use(real ? X86_XMM(0) : X86_RAX)));
+    if (ret) ret->flags |= MIR_INST_RETURN;
+}
+
+static bool has_phis(const IrBasicBlock *bb) {
+    return bb->first_inst && bb->first_inst->opcode == IR_PHI;
+}
+
+/* Copies the phis of `to` need on the edge from `from`.  They happen at
+ * once, so when one reads what another writes all go through new
+ * registers first. */
+static void edge_copies(Isel *s, const IrBasicBlock *from, const IrBasicBlock *to) {
+    uint32_t n = 0;
+    for (const IrInstruction *p = to->first_inst; p && p->opcode == IR_PHI; p = p->next) n++;
+    if (n == 0) return;
+    struct { uint32_t dst, src; } *moves = malloc(n * sizeof(*moves));
+    if (!moves) {
+        s->mf->oom = true;
+        return;
+    }
+    uint32_t k = 0;
+    for (const IrInstruction *p = to->first_inst; p && p->opcode == IR_PHI; p = p->next) {
+        const IrPhiExtra *phi = p->extra;
+        if (!is_local(s, p->result)) continue;
+        for (uint32_t i = 0; i < phi->count; i++) {
+            if (phi->blocks[i] != from) continue;
+            moves[k].dst = local_reg(s, p->result);
+            moves[k].src = value_reg(s, phi->values[i], value_real(s, p->result));
+            k++;
+            break;
+        }
+    }
+    bool overlap = false;
+    for (uint32_t i = 0; i < k && !overlap; i++)
+        for (uint32_t j = 0; j < k; j++)
+            if (i != j && moves[j].src == moves[i].dst) overlap = true;
+    if (overlap) {
+        for (uint32_t i = 0; i < k; i++) {
+            uint32_t t = new_reg(s, is_fpr(s, moves[i].dst));
+            copy(s, t, moves[i].src);
+            moves[i].src = t;
+        }
+    }
+    for (uint32_t i = 0; i < k; i++) copy(s, moves[i].dst, moves[i].src);
+    free(moves);
+}
+
+/* The block a branch from `from` to `to` jumps to: `to` itself, or a new
+ * block making the phi copies of that edge. */
+static MirBlock *edge_target(Isel *s, const IrBasicBlock *from, const IrBasicBlock *to) {
+    MirBlock *target = s->block_of[to->id];
+    if (!has_phis(to)) return target;
+    MirBlock *edge = mir__block_add(s->mf, NULL);
+    if (!edge) return target;
+    edge->loop_depth = target->loop_depth;
+    edge->exec_count = target->exec_count;
+    edge->cold = target->cold || s->mb->cold;
+    MirBlock *saved = s->mb;
+    s->mb = edge;
+    edge_copies(s, from, to);
+    jump(s, target);
+    s->mb = saved;
+    return edge;
+}
+
+static void select_brcond(Isel *s, const IrInstruction *inst) {
+    const IrCondBranchExtra *br = inst->extra;
+    int parity;
+    int cc = truth_flags(s, inst->operand1, &parity);
+    MirBlock *t = edge_target(s, inst->parent, br->true_target);
+    MirBlock *f = edge_target(s, inst->parent, br->false_target);
+    if (parity == PARITY_NONE && t == s->next) {
+        ins_cc(s, X86_JCC, X86_CC_INVERT(cc), 1, mir__block(f), mir__imm(0));
+        return;
+    }
+    if (parity == PARITY_FALSE) ins_cc(s, X86_JCC, X86_CC_P, 1, mir__block(f), mir__imm(0));
+    ins_cc(s, X86_JCC, cc, 1, mir__block(t), mir__imm(0));
+    if (parity == PARITY_TRUE) ins_cc(s, X86_JCC, X86_CC_P, 1, mir__block(t), mir__imm(0));
+    if (f != s->next) jump(s, f);
+}
+
+static void select_instruction(Isel *s, const IrInstruction *inst) {
+    IrOpcode op = (IrOpcode)inst->opcode;
+    s->line = inst->line;
+    s->column = inst->column;
+    if (inst->result && inst->result->kind == IR_VALUE_TEMP && inst->result->id < s->lf.temp_count &&
+        s->covered[inst->result->id])
+        return;
+    switch (op) {
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+        case IR_EQ: case IR_NEQ: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        case IR_AND: case IR_OR: case IR_XOR: case IR_SHL: case IR_SHR: case IR_SAR:
+            if (inst->result) select_binary(s, inst);
+            return;
+        case IR_NEG: case IR_NOT:
+            if (inst->result) select_unary(s, inst);
+            return;
+        case IR_LOAD:   if (inst->result) select_load(s, inst); return;
+        case IR_STORE:  select_store(s, inst); return;
+        case IR_ALLOCA: select_alloca(s, inst); return;
+        case IR_GEP:
+            if (is_local(s, inst->result)) lea(s, result_reg(s, inst, false), gep_address(s, inst));
+            return;
+        case IR_CAST:   if (inst->result) select_cast(s, inst); return;
+        case IR_CALL:   select_call(s, inst); return;
+        case IR_SELECT: select_select(s, inst); return;
+        case IR_RET:    select_return(s, inst->operand1); return;
+        case IR_BR: {
+            const IrBasicBlock *to = inst->operand1 ? inst->operand1->const_data.block : NULL;
+            if (!to) {
+                select_return(s, NULL);
+                return;
+            }
+            edge_copies(s, inst->parent, to);
+            if (s->block_of[to->id] != s->next) jump(s, s->block_of[to->id]);
+            return;
+        }
+        case IR_BRCOND: select_brcond(s, inst); return;
+        case IR_MEMSET: case IR_MEMCPY: select_mem(s, inst); return;
+        case IR_PHI: case IR_NOP:
+            return;
+        default:
+            errhandler__report_error(ERROR_CODE_CODEGEN_UNSUPPORTED, inst->line, (uint8_t)inst->column, "codegen",
+                                     "Cannot select opcode %u in %s", (unsigned)op, s->func->name);
+            return;
+    }
+}
+
+/* -------------------------------------------------------------- functions */
+
+static bool only_addressed(const IrValue *v) {
+    if (!v->uses) return false;
+    for (const IrUse *u = v->uses; u; u = u->next) {
+        uint16_t op = u->user->opcode;
+        if ((op != IR_LOAD && op != IR_STORE && op != IR_GEP) || u->slot != &u->user->operand1) return false;
+    }
+    return true;
+}
+
+/* A compare used once, by the branch or select that follows it. */
+static bool feeds_flags(const Isel *s, const IrInstruction *cmp) {
+    const IrUse *u = cmp->result->uses;
+    if (!u || u->next || u->user != cmp->next || u->slot != &u->user->operand1) return false;
+    if (u->user->opcode == IR_BRCOND) return true;
+    /* cmov tests one condition, which unordered real equality is not. */
+    bool real = value_real(s, cmp->operand1) || value_real(s, cmp->operand2);
+    return u->user->opcode == IR_SELECT && !(real && (cmp->opcode == IR_EQ || cmp->opcode == IR_NEQ));
+}
+
+/* Frame objects for allocas of a known size and the patterns selected
+ * with their users. */
+static void plan(Isel *s) {
+    for (uint32_t b = 0; b < s->func->block_count; b++) {
+        for (const IrInstruction *inst = s->func->all_blocks[b]->first_inst; inst; inst = inst->next) {
+            if (!inst->result || inst->result->kind != IR_VALUE_TEMP || inst->result->id >= s->lf.temp_count)
+                continue;
+            uint32_t t = inst->result->id;
+            if (inst->opcode == IR_ALLOCA) {
+                const IrValue *size = inst->operand1, *align = inst->operand2;
+                int64_t bytes;
+                if (!size) bytes = lower__slot_bytes(inst->result, UINT32_MAX);
+                else if (size->kind == IR_VALUE_CONST_INT && size->const_data.int_val >= 0 &&
+                         size->const_data.int_val <= INT32_MAX) bytes = size->const_data.int_val;
+                else continue;
+                int64_t a = align && align->kind == IR_VALUE_CONST_INT ? align->const_data.int_val : 8;
+                if (a < 8 || a > 16 || (a & (a - 1))) a = a > 16 ? 16 : 8;
+                s->frame_of[t] = mir__frame_object(s->mf, (uint32_t)bytes, (uint32_t)a) + 1;
+            } else if (inst->opcode == IR_GEP) {
+                s->covered[t] = only_addressed(inst->result);
+            } else if (is_compare((IrOpcode)inst->opcode)) {
+                s->covered[t] = feeds_flags(s, inst);
+            }
+        }
+    }
+}
+
+/* Copy the parameters from where the convention passes them. */
+static void select_params(Isel *s) {
+    uint32_t n = s->func->param_count;
+    bool *real = calloc(n ? n : 1, sizeof(bool));
+    ArgPlace *places = calloc(n ? n : 1, sizeof(ArgPlace));
+    if (!real || !places) {
+        s->mf->oom = true;
+        free(real);
+        free(places);
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++) real[i] = lower__param_is_real(s->func, i);
+    place_args(real, n, places);
+    for (uint32_t i = 0; i < n; i++) {
+        const IrValue *p = s->func->parameters[i];
+        if (!p || p->uses == NULL) continue;
+        uint32_t v = local_reg(s, p);
+        if (places[i].reg != MIR_NO_REG) {
+            copy(s, v, places[i].reg);
+        } else {
+            MirMem m = mir__mem_base(X86_RBP, 16 + (int32_t)places[i].stack * 8);
+            ins(s, is_fpr(s, v) ? X86_MOVSD : X86_MOV, 2, def(v), mem(m, 8));
+        }
+    }
+    free(real);
+    free(places);
+}
+
+MirFunction *x86_64__select(CodegenModule *cm, IrFunction *func) {
+    Isel s = { .cm = cm, .func = func };
+    if (!lower__function_init(&s.lf, &cm->lm, func)) return NULL;
+    s.mf = mir__function_create(func);
+    uint32_t values = func->param_count + s.lf.temp_count;
+    uint32_t temps = s.lf.temp_count ? s.lf.temp_count : 1;
+    s.block_of = calloc(func->next_block_id ? func->next_block_id : 1, sizeof(MirBlock *));
+    s.vreg = malloc((values ? values : 1) * sizeof(uint32_t));
+    s.frame_of = calloc(temps, sizeof(uint32_t));
+    s.covered = calloc(temps, 1);
+    const IrLoopInfo *loops = analysis__loops(func);
+    bool ok = s.mf && s.block_of && s.vreg && s.frame_of && s.covered;
+    if (ok) {
+        for (uint32_t i = 0; i < values; i++) s.vreg[i] = MIR_NO_REG;
+        plan(&s);
+        /* A block of its own for the parameters, then the IR's in layout
+         * order. */
+        MirBlock *entry = mir__block_add(s.mf, NULL);
+        for (uint32_t b = 0; b < func->block_count; b++) {
+            IrBasicBlock *bb = func->all_blocks[b];
+            MirBlock *mb = mir__block_add(s.mf, bb);
+            if (!mb) break;
+            if (loops) mb->loop_depth = analysis__loop_depth(loops, bb);
+            s.block_of[bb->id] = mb;
+        }
+        ok = entry && !s.mf->oom;
+        if (ok) {
+            s.mb = entry;
+            select_params(&s);
+            if (func->entry_block && s.block_of[func->entry_block->id] != s.mf->blocks[1])
+                jump(&s, s.block_of[func->entry_block->id]);
+            for (uint32_t b = 0; b < func->block_count && !s.mf->oom; b++) {
+                IrBasicBlock *bb = func->all_blocks[b];
+                s.mb = s.block_of[bb->id];
+                s.next = b + 1 < func->block_count ? s.block_of[func->all_blocks[b + 1]->id] : NULL;
+                /* The cold blocks go to a section of their own: none is
+                 * fallen into from a hot block, or out of into one. */
+                if (s.next && s.next->cold != s.mb->cold) s.next = NULL;
+                for (const IrInstruction *inst = bb->first_inst; inst; inst = inst->next)
+                    select_instruction(&s, inst);
+                /* A block without a terminator returns. */
+                const IrInstruction *last = bb->last_inst;
+                if (!last || (last->opcode != IR_BR && last->opcode != IR_BRCOND && last->opcode != IR_RET))
+                    select_return(&s, NULL);
+            }
+            ok = !s.mf->oom;
+        }
+    }
+    if (!ok) errhandler__report_error(ERROR_CODE_CODEGEN_MEMORY_ALLOCATION, 0, 0, "codegen",
+                                      "Out of memory selecting instructions for %s", func->name);
+    free(s.block_of);
+    free(s.vreg);
+    free(s.frame_of);
+    free(s.covered);
+    lower__function_fini(&s.lf);
+    if (!ok) {
+        mir__function_destroy(s.mf);
+        return NULL;
+    }
+    return s.mf;
+}
@@ -0,0 +1,200 @@
+#include "x86_64.h"
+#include <string.h>
+
+const char *const x86_64__mnemonics[X86_OPCODE_COUNT] = {
+    [X86_MOV] = "mov", [X86_MOVSX] = "movsx", [X86_MOVZX] = "movzx", [X86_LEA] = "lea",
+    [X86_ADD] = "add", [X86_SUB] = "sub", [X86_IMUL] = "imul", [X86_AND] = "and",
+    [X86_OR] = "or", [X86_XOR] = "xor", [X86_IMUL3] = "imul",
+    [X86_CMP] = "cmp", [X86_TEST] = "test", [X86_NEG] = "neg", [X86_NOT] = "not",
+    [X86_SHL] = "shl", [X86_SHR] = "shr", [X86_SAR] = "sar",
+    [X86_CQO] = "cqo", [X86_IDIV] = "idiv",
+    [X86_SETCC] = "set", [X86_CMOVCC] = "cmov", [X86_JMP] = "jmp", [X86_JCC] = "j",
+    [X86_CALL] = "call", [X86_RET] = "ret", [X86_PUSH] = "push", [X86_POP] = "pop",
+    [X86_LEAVE] = "leave", [X86_SYSCALL] = "syscall",
+    [X86_REP_STOSB] = "rep stosb", [X86_REP_STOSW] = "rep stosw", [X86_REP_STOSD] = "rep stosd",
+    [X86_REP_STOSQ] = "rep stosq", [X86_REP_MOVSB] = "rep movsb",
+    [X86_MOVSD] = "movsd", [X86_MOVSS] = "movss", [X86_MOVQ] = "movq", [X86_MOVD] = "movd",
+    [X86_MOVDQU] = "movdqu", [X86_PUNPCKLQDQ] = "punpcklqdq",
+    [X86_ADDSD] = "addsd", [X86_SUBSD] = "subsd", [X86_MULSD] = "mulsd", [X86_DIVSD] = "divsd",
+    [X86_UCOMISD] = "ucomisd", [X86_XORPD] = "xorpd",
+    [X86_CVTSI2SD] = "cvtsi2sd", [X86_CVTTSD2SI] = "cvttsd2si",
+    [X86_CVTSD2SS] = "cvtsd2ss", [X86_CVTSS2SD] = "cvtss2sd",
+};
+
+/* r10 and r11, xmm14 and xmm15 stay out: they reload spilled operands. */
+static const uint32_t allocatable_gprs[] = {
+    X86_RAX, X86_RCX, X86_RDX, X86_RSI, X86_RDI, X86_R8, X86_R9,
+    X86_RBX, X86_R12, X86_R13, X86_R14, X86_R15
+};
+static const uint32_t allocatable_fprs[] = {
+    X86_XMM(0), X86_XMM(1), X86_XMM(2), X86_XMM(3), X86_XMM(4), X86_XMM(5), X86_XMM(6),
+    X86_XMM(7), X86_XMM(8), X86_XMM(9), X86_XMM(10), X86_XMM(11), X86_XMM(12), X86_XMM(13)
+};
+
+#define BIT(r) (UINT64_C(1) << (r))
+#define CALLEE_SAVED (BIT(X86_RBX) | BIT(X86_R12) | BIT(X86_R13) | BIT(X86_R14) | BIT(X86_R15))
+
+const CodegenTarget codegen__x86_64 = {
+    .name = "x86_64",
+    .allocatable = { allocatable_gprs, allocatable_fprs },
+    .allocatable_count = { sizeof allocatable_gprs / sizeof *allocatable_gprs,
+                           sizeof allocatable_fprs / sizeof *allocatable_fprs },
+    .scratch = { { X86_R11, X86_R10 }, { X86_XMM(14), X86_XMM(15) } },
+    .scratch_count = { 2, 2 },
+    /* Everything but rbx, rsp, rbp and r12-r15; every xmm register. */
+    .caller_saved = ((BIT(16) - 1) & ~(CALLEE_SAVED | BIT(X86_RSP) | BIT(X86_RBP))) |
+                    ((BIT(16) - 1) << MIR_FIRST_FPR),
+    .select = x86_64__select,
+    .spill = x86_64__spill,
+    .address = x86_64__address,
+    .rematerialize = x86_64__rematerialize,
+    .lower_frame = x86_64__lower_frame,
+    .print_header = x86_64__print_header,
+    .print_function = x86_64__print_function,
+    .assemble = x86_64__assemble,
+    .machine = BUILD_MACHINE_X86_64,
+};
+
+static MirMem object_mem(uint32_t object) {
+    MirMem m = mir__mem_base(MIR_NO_REG, 0);
+    m.frame = object + 1;
+    return m;
+}
+
+MirInst *x86_64__spill(MirFunction *mf, uint32_t reg, uint32_t object, bool load) {
+    bool fpr = mir__vreg_class(mf, reg) == MIR_FPR;
+    MirInst *inst = mir__inst_new(mf, fpr ? X86_MOVSD : X86_MOV, 2);
+    if (!inst) return NULL;
+    MirOperand r = mir__reg(reg, 8, load ? MIR_DEF : MIR_USE);
+    MirOperand m = mir__mem(object_mem(object), 8);
+    inst->ops[0] = load ? r : m;
+    inst->ops[1] = load ? m : r;
+    return inst;
+}
+
+MirInst *x86_64__address(MirFunction *mf, uint32_t dst, const MirMem *mem) {
+    MirInst *inst = mir__inst_new(mf, X86_LEA, 2);
+    if (!inst) return NULL;
+    inst->ops[0] = mir__reg(dst, 8, MIR_DEF);
+    inst->ops[1] = mir__mem(*mem, 8);
+    return inst;
+}
+
+/* A constant, a zeroing xor or the address of a frame object or symbol,
+ * remade as a mov, xorpd or lea: none of them touches the flags. */
+MirInst *x86_64__rematerialize(MirFunction *mf, const MirInst *def, uint32_t reg) {
+    if (def->count != 2 || def->ops[0].kind != MIR_OPERAND_REG || def->ops[0].flags != MIR_DEF) return NULL;
+    const MirOperand *src = &def->ops[1];
+    MirOperand from;
+    X86Opcode op = (X86Opcode)def->opcode;
+    switch (op) {
+        case X86_MOV:
+            if (src->kind != MIR_OPERAND_IMM) return NULL;
+            from = *src;
+            break;
+        case X86_XOR:
+            if (src->kind != MIR_OPERAND_REG || src->reg != def->ops[0].reg) return NULL;
+            op = X86_MOV;
+            from = mir__imm(0);
+            break;
+        case X86_XORPD:
+            if (src->kind != MIR_OPERAND_REG || src->reg != def->ops[0].reg) return NULL;
+            from = mir__reg(reg, 8, 0);
+            break;
+        case X86_LEA:
+            if (src->kind != MIR_OPERAND_MEM || src->mem.base != MIR_NO_REG || src->mem.index != MIR_NO_REG) return NULL;
+            from = *src;
+            break;
+        default:
+            return NULL;
+    }
+    MirInst *inst = mir__inst_new(mf, op, 2);
+    if (!inst) return NULL;
+    inst->ops[0] = mir__reg(reg, def->ops[0].size, MIR_DEF);
+    inst->ops[1] = from;
+    return inst;
+}
+
+static void note_saved(uint32_t *reg, uint8_t flags, void *ctx) {
+    MirFunction *mf = ctx;
+    if ((flags & MIR_DEF) && mir__is_preg(*reg) && (CALLEE_SAVED & BIT(*reg))) mf->saved_regs |= BIT(*reg);
+}
+
+static MirInst *make(MirFunction *mf, X86Opcode op, uint8_t count, MirOperand a, MirOperand b) {
+    MirInst *inst = mir__inst_new(mf, op, count);
+    if (!inst) return NULL;
+    if (count > 0) inst->ops[0] = a;
+    if (count > 1) inst->ops[1] = b;
+    return inst;
+}
+
+/*
+ * Frame objects go below rbp in the order they were made, each at its
+ * alignment; the frame is rounded to 16 bytes so rsp stays aligned for
+ * calls.  The callee-saved registers the body writes get objects of their
+ * own, stored after the prologue and reloaded before each `leave`.
+ */
+void x86_64__lower_frame(MirFunction *mf) {
+    mf->saved_regs = 0;
+    for (uint32_t b = 0; b < mf->block_count; b++)
+        for (MirInst *inst = mf->blocks[b]->first; inst; inst = inst->next)
+            mir__inst_for_each_reg(inst, note_saved, mf);
+    uint32_t save_object[16];
+    for (uint32_t r = 0; r < 16; r++)
+        if (mf->saved_regs & BIT(r)) save_object[r] = mir__frame_object(mf, 8, 8);
+    if (mf->oom) return;
+
+    uint64_t size = 0;
+    for (uint32_t i = 0; i < mf->object_count; i++) {
+        MirFrameObject *obj = &mf->objects[i];
+        size = (size + obj->size + obj->align - 1) & ~(uint64_t)(obj->align - 1);
+        obj->offset = -(int32_t)size;
+    }
+    mf->frame_size = (uint32_t)((size + 15) & ~UINT64_C(15));
+
+    for (uint32_t b = 0; b < mf->block_count; b++) {
+        MirBlock *mb = mf->blocks[b];
+        for (MirInst *inst = mb->first, *next; inst; inst = next) {
+            next = inst->next;
+            for (uint8_t i = 0; i < inst->count; i++) {
+                MirMem *m = &inst->ops[i].mem;
+                if (inst->ops[i].kind != MIR_OPERAND_MEM || !m->frame) continue;
+                m->disp += mf->objects[m->frame - 1].offset;
+                m->frame = 0;
+                if (m->base == MIR_NO_REG) m->base = X86_RBP;
+                else if (m->index == MIR_NO_REG) m->index = X86_RBP;
+            }
+            if (!(inst->flags & MIR_INST_RETURN)) continue;
+            for (uint32_t r = 0; r < 16; r++) {
+                if (!(mf->saved_regs & BIT(r))) continue;
+                MirMem m = mir__mem_base(X86_RBP, mf->objects[save_object[r]].offset);
+                MirInst *restore = make(mf, X86_MOV, 2, mir__reg(r, 8, MIR_DEF), mir__mem(m, 8));
+                if (restore) mir__inst_insert_before(mb, inst, restore);
+            }
+            MirInst *leave = make(mf, X86_LEAVE, 0, mir__imm(0), mir__imm(0));
+            if (leave) mir__inst_insert_before(mb, inst, leave);
+        }
+    }
+
+    MirBlock *entry = mf->blocks[0];
+    MirInst *at = NULL;
+    MirInst *prologue[3] = {
+        make(mf, X86_PUSH, 1, mir__reg(X86_RBP, 8, MIR_USE), mir__imm(0)),
+        make(mf, X86_MOV, 2, mir__reg(X86_RBP, 8, MIR_DEF), mir__reg(X86_RSP, 8, MIR_USE)),
+        mf->frame_size ? make(mf, X86_SUB, 2, mir__reg(X86_RSP, 8, MIR_USE | MIR_DEF), mir__imm(mf->frame_size))
+                       : NULL,
+    };
+    for (int i = 0; i < 3; i++) {
+        if (!prologue[i]) continue;
+        mir__inst_insert_after(entry, at, prologue[i]);
+        at = prologue[i];
+    }
+    for (uint32_t r = 0; r < 16; r++) {
+        if (!(mf->saved_regs & BIT(r))) continue;
+        MirMem m = mir__mem_base(X86_RBP, mf->objects[save_object[r]].offset);
+        MirInst *save = make(mf, X86_MOV, 2, mir__mem(m, 8), mir__reg(r, 8, MIR_USE));
+        if (!save) continue;
+        mir__inst_insert_after(entry, at, save);
+        at = save;
+    }
+}
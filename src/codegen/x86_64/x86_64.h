@@ -0,0 +1,115 @@
+#ifndef X86_64_H
+#define X86_64_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "../codegen.h"
+
+/*
+ * x86-64 backend, System V ABI.  Operands of an instruction follow Intel
+ * order, destination first; implicit operands come last.  Every function
+ * keeps a frame pointer: frame objects are addressed from rbp, and the
+ * body only moves rsp around calls with stack arguments and for dynamic
+ * allocas, which keeps it 16-byte aligned at every call.
+ */
+
+enum {
+    X86_RAX, X86_RCX, X86_RDX, X86_RBX, X86_RSP, X86_RBP, X86_RSI, X86_RDI,
+    X86_R8, X86_R9, X86_R10, X86_R11, X86_R12, X86_R13, X86_R14, X86_R15,
+    X86_XMM0 = MIR_FIRST_FPR
+};
+
+#define X86_XMM(n) (X86_XMM0 + (n))
+
+/* Condition codes, numbered as the encodings of jcc, setcc and cmovcc. */
+enum {
+    X86_CC_O, X86_CC_NO, X86_CC_B, X86_CC_AE, X86_CC_E, X86_CC_NE, X86_CC_BE, X86_CC_A,
+    X86_CC_S, X86_CC_NS, X86_CC_P, X86_CC_NP, X86_CC_L, X86_CC_GE, X86_CC_LE, X86_CC_G
+};
+
+#define X86_CC_INVERT(cc) ((cc) ^ 1)
+
+typedef enum {
+    X86_MOV,            /* also a copy, flagged MIR_INST_COPY */
+    X86_MOVSX,          /* movsx, or movsxd from 4 bytes */
+    X86_MOVZX,
+    X86_LEA,
+    X86_ADD, X86_SUB, X86_IMUL, X86_AND, X86_OR, X86_XOR,
+    X86_IMUL3,          /* dst = src * imm */
+    X86_CMP, X86_TEST,
+    X86_NEG, X86_NOT,
+    X86_SHL, X86_SHR, X86_SAR,
+    X86_CQO, X86_IDIV,
+    X86_SETCC, X86_CMOVCC,
+    X86_JMP, X86_JCC,
+    X86_CALL, X86_RET,
+    X86_PUSH, X86_POP, X86_LEAVE,
+    X86_SYSCALL,
+    X86_REP_STOSB, X86_REP_STOSW, X86_REP_STOSD, X86_REP_STOSQ, X86_REP_MOVSB,
+    X86_MOVSD,          /* scalar double between xmm registers and memory */
+    X86_MOVSS,
+    X86_MOVQ,           /* 64 bits between a general register and an xmm register */
+    X86_MOVD,           /* the low 32 bits */
+    X86_MOVDQU,         /* 16 bytes between an xmm register and memory */
+    X86_PUNPCKLQDQ,     /* both halves of an xmm register from the low 64 bits */
+    X86_ADDSD, X86_SUBSD, X86_MULSD, X86_DIVSD,
+    X86_UCOMISD, X86_XORPD,
+    X86_CVTSI2SD, X86_CVTTSD2SI, X86_CVTSD2SS, X86_CVTSS2SD,
+    X86_OPCODE_COUNT
+} X86Opcode;
+
+extern const char *const x86_64__mnemonics[X86_OPCODE_COUNT];
+
+/* ELF relocation types of the symbols encoded instructions refer to. */
+#define X86_R_PC32      2
+#define X86_R_PLT32     4
+#define X86_R_32S       11
+
+#define X86_MAX_INST_BYTES 15
+
+/* A symbol an encoded instruction leaves to the linker: the 4-byte field
+ * at offset from the start of the instruction. */
+typedef struct {
+    const char *symbol;             /* NULL if none */
+    const MirBlock *block;          /* or else a block of the function's other part */
+    uint32_t    offset;
+    uint32_t    type;               /* X86_R_* */
+    int64_t     addend;
+} X86Fixup;
+
+/* Where the blocks of a function go and which branches to blocks take
+ * their rel32 form, by instruction in layout order. */
+typedef struct {
+    uint64_t       *block_pc;       /* by block id, from the function start, or
+                                       CODEGEN_COLD_PC plus from its cold part's */
+    uint8_t        *near;
+    uint64_t        size, cold_size;
+    uint32_t        branch_count, near_count, passes;
+    const MirInst  *failed;         /* the instruction with no encoding, if any */
+} X86Layout;
+
+MirFunction *x86_64__select(CodegenModule *cm, IrFunction *func);
+MirInst     *x86_64__spill(MirFunction *mf, uint32_t reg, uint32_t object, bool load);
+MirInst     *x86_64__address(MirFunction *mf, uint32_t dst, const MirMem *mem);
+MirInst     *x86_64__rematerialize(MirFunction *mf, const MirInst *def, uint32_t reg);
+void         x86_64__lower_frame(MirFunction *mf);
+void         x86_64__print_header(FILE *out, const CodegenModule *cm, const char *source);
+void         x86_64__print_function(FILE *out, const CodegenModule *cm, const MirFunction *mf);
+
+/* The bytes of inst at pc with the blocks at block_pc, or at 0 when
+ * block_pc is NULL; a branch to a block is rel32 when near and rel8
+ * otherwise, and one to the function's other part is a rel32 fixup.
+ * Returns the length, 0 when inst has no encoding or a short branch does
+ * not reach. */
+uint32_t     x86_64__encode(const MirInst *inst, uint64_t pc, const uint64_t *block_pc, bool near,
+                            uint8_t *out, X86Fixup *fixup);
+/* Branch relaxation of a lowered function; false when out of memory or
+ * an instruction has no encoding. */
+bool         x86_64__layout(const MirFunction *mf, X86Layout *layout);
+void         x86_64__layout_free(X86Layout *layout);
+/* n bytes of nops. */
+void         x86_64__nops(uint8_t *out, uint64_t n);
+bool         x86_64__assemble(const MirFunction *mf, CodegenCode *code, CodegenCode *cold, CodegenExtent *extent);
+
+#endif
@@ -69,6 +69,16 @@ static ErrorManager em = {
 /* Current source filename, copied when set. */
 static char* current_filename = NULL;
 
+/*
+ * A diagnostics buffer is an ErrorManager of its own; only its entry arrays
+ * are used.  While one is set on a thread, that thread's reports go there.
+ */
+struct ErrorBuffer {
+    ErrorManager entries;
+};
+
+static _Thread_local ErrorBuffer* active_buffer = NULL;
+
 static bool ensure_capacity(ErrorEntry** array, uint32_t* capacity,
                             uint32_t count);
 static void add_error_entry(ErrorLevel level, uint16_t error_code,
@@ -181,9 +191,10 @@ static void add_error_entry(ErrorLevel level, uint16_t error_code,
     }
 
     bool is_warning = (level == ERROR_LEVEL_WARNING);
-    ErrorEntry** array = is_warning ? &em.warning_entries : &em.error_entries;
-    uint32_t* count    = is_warning ? &em.warning_count    : &em.error_count;
-    uint32_t* cap      = is_warning ? &em.warning_capacity : &em.error_capacity;
+    ErrorManager* target = active_buffer ? &active_buffer->entries : &em;
+    ErrorEntry** array = is_warning ? &target->warning_entries : &target->error_entries;
+    uint32_t* count    = is_warning ? &target->warning_count    : &target->error_count;
+    uint32_t* cap      = is_warning ? &target->warning_capacity : &target->error_capacity;
 
     if (!ensure_capacity(array, cap, *count)) {
         return; /* allocation failure – entry is lost, but we survive */
@@ -526,6 +537,8 @@ void errhandler__print_warnings(void) {
 bool errhandler__has_errors(void) {
     if (em.error_count > 0) return true;
     if (em.warnings_as_errors && em.warning_count > 0) return true;
+    if (active_buffer && active_buffer->entries.error_count > 0) return true;
+    if (active_buffer && em.warnings_as_errors && active_buffer->entries.warning_count > 0) return true;
     return false;
 }
 
@@ -624,3 +637,43 @@ void errhandler__set_warnings_as_errors(bool enable) {
 void errhandler__set_suppress_warnings(bool suppress) {
     em.suppress_warnings = suppress;
 }
+
+ErrorBuffer* errhandler__buffer_begin(void) {
+    ErrorBuffer* buffer = (ErrorBuffer*)calloc(1, sizeof(ErrorBuffer));
+    active_buffer = buffer;
+    return buffer;
+}
+
+void errhandler__buffer_end(ErrorBuffer* buffer) {
+    if (active_buffer == buffer) active_buffer = NULL;
+}
+
+/*
+ * Move the entries of one buffered array onto the end of a global one.  The
+ * owned strings change hands, so only the arrays themselves are freed.
+ */
+static void append_entries(ErrorEntry** array, uint32_t* count, uint32_t* capacity,
+                           const ErrorEntry* entries, uint32_t entry_count) {
+    for (uint32_t i = 0; i < entry_count; i++) {
+        if (!ensure_capacity(array, capacity, *count)) {
+            free(entries[i].message);
+            free(entries[i].filename);
+            free(entries[i].source_line_copy);
+            continue;
+        }
+        (*array)[(*count)++] = entries[i];
+    }
+}
+
+void errhandler__buffer_commit(ErrorBuffer* buffer) {
+    if (!buffer) return;
+    errhandler__buffer_end(buffer);
+    ErrorManager* b = &buffer->entries;
+    append_entries(&em.error_entries, &em.error_count, &em.error_capacity,
+                   b->error_entries, b->error_count);
+    append_entries(&em.warning_entries, &em.warning_count, &em.warning_capacity,
+                   b->warning_entries, b->warning_count);
+    free(b->error_entries);
+    free(b->warning_entries);
+    free(buffer);
+}
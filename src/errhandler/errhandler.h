@@ -159,6 +159,21 @@ void errhandler__set_warnings_as_errors(bool enable);
  */
 void errhandler__set_suppress_warnings(bool suppress);
 
+/*
+ * Diagnostics buffer for work running on several threads.  Between
+ * errhandler__buffer_begin and errhandler__buffer_end, everything the
+ * calling thread reports is collected in the returned buffer instead of the
+ * global lists; errhandler__buffer_commit later appends it to them and frees
+ * it.  Committing buffers in a fixed order gives the same output whatever
+ * order the work ran in.  Returns NULL if the buffer cannot be allocated, in
+ * which case reports go straight to the global lists as usual.
+ */
+typedef struct ErrorBuffer ErrorBuffer;
+
+ErrorBuffer* errhandler__buffer_begin(void);
+void errhandler__buffer_end(ErrorBuffer* buffer);
+void errhandler__buffer_commit(ErrorBuffer* buffer);
+
 #define ERROR_CODE_SYNTAX_GENERIC               0x7A00
 #define ERROR_CODE_SYNTAX_UNEXPECTED_TOKEN      0x7A01
 #define ERROR_CODE_SYNTAX_UNEXPECTED_EOF        0x7A02
@@ -216,6 +231,7 @@ void errhandler__set_suppress_warnings(bool suppress);
 #define ERROR_CODE_IR_UNSUPPORTED_NODE          0xB104
 #define ERROR_CODE_IR_MEMORY_ALLOCATION         0xB105
 #define ERROR_CODE_IR_INVALID_ARGUMENT          0xB106
+#define ERROR_CODE_IR_MULTIPLE_DEFINITION       0xB107
 
 #define ERROR_CODE_COM_FAILCREATE               0xFF00
 
@@ -230,6 +246,17 @@ void errhandler__set_suppress_warnings(bool suppress);
 #define ERROR_CODE_RUNTIME_DIV_BY_ZERO          0x2300
 #define ERROR_CODE_RUNTIME_OUT_OF_BOUNDS        0x2301
 #define ERROR_CODE_RUNTIME_OVERFLOW             0x2302
+#define ERROR_CODE_RUNTIME_NO_ENTRY             0x2303
+#define ERROR_CODE_RUNTIME_UNDEFINED_CALL       0x2304
+#define ERROR_CODE_RUNTIME_UNSUPPORTED          0x2305
+#define ERROR_CODE_RUNTIME_STACK_OVERFLOW       0x2306
+#define ERROR_CODE_RUNTIME_NO_JIT               0x2307
+
+#define ERROR_CODE_CODEGEN_NO_TARGET            0xC000
+#define ERROR_CODE_CODEGEN_UNSUPPORTED          0xC001
+#define ERROR_CODE_CODEGEN_MEMORY_ALLOCATION    0xC002
+#define ERROR_CODE_CODEGEN_REGALLOC             0xC003
+#define ERROR_CODE_CODEGEN_ENCODING             0xC004
 
 #define ERROR_CODE_IO_FILE_NOT_FOUND            0x8200
 #define ERROR_CODE_IO_DOUBLE_FILE               0x8201
@@ -0,0 +1,220 @@
+#include "alias.h"
+#include "../../errhandler/errhandler.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Deepest pointer chain (GEPs and casts) followed back to its base. */
+#define ALIAS_MAX_CHAIN 16
+
+typedef struct {
+    const IrValue *key;
+    IrInstruction *def;
+    bool           escaped;
+} DefSlot;
+
+struct AliasInfo {
+    DefSlot  *slots;
+    uint32_t  capacity;     /* power of two */
+};
+
+static uint32_t hash_value(const IrValue *v, uint32_t mask) {
+    uintptr_t p = (uintptr_t)v;
+    return (uint32_t)((p >> 4) * 2654435761u) & mask;
+}
+
+static DefSlot *find_slot(const AliasInfo *ai, const IrValue *v) {
+    uint32_t mask = ai->capacity - 1;
+    for (uint32_t i = hash_value(v, mask);; i = (i + 1) & mask) {
+        DefSlot *s = &ai->slots[i];
+        if (s->key == v || !s->key) return s;
+    }
+}
+
+static IrInstruction *def_of(const AliasInfo *ai, const IrValue *v) {
+    if (!v || v->kind != IR_VALUE_TEMP) return NULL;
+    DefSlot *s = find_slot(ai, v);
+    return s->key ? s->def : NULL;
+}
+
+static bool path_push_index(MemLoc *loc, IrValue *idx, int64_t *buf, uint8_t *len) {
+    if (!idx) return true;
+    if (idx->kind == IR_VALUE_CONST_INT) buf[(*len)++] = idx->const_data.int_val;
+    else if (idx->kind == IR_VALUE_STRUCT_FIELD) buf[(*len)++] = idx->const_data.field_index;
+    else { loc->path_known = false; return false; }
+    return true;
+}
+
+/* Walk GEPs and casts back to the base object.  Indices are collected
+ * outermost-first and reversed at the end so the path reads base-out. */
+static void decompose(const AliasInfo *ai, IrValue *ptr, MemLoc *loc) {
+    int64_t rev[ALIAS_MAX_PATH];
+    uint8_t rev_len = 0;
+    memset(loc, 0, sizeof(*loc));
+    loc->path_known = true;
+    loc->access_type = TYPE_UNKNOWN;
+    IrValue *p = ptr;
+    for (uint32_t depth = 0; p && depth < ALIAS_MAX_CHAIN; depth++) {
+        if (p->kind == IR_VALUE_GLOBAL_SYMBOL) {
+            loc->kind = MEMLOC_GLOBAL;
+            loc->base = p;
+            break;
+        }
+        IrInstruction *def = def_of(ai, p);
+        if (def && def->opcode == IR_ALLOCA) {
+            loc->kind = MEMLOC_STACK;
+            loc->base = p;
+            break;
+        }
+        if (def && def->opcode == IR_GEP) {
+            IrValue *idx[1 + ALIAS_MAX_PATH];
+            uint32_t n = 0;
+            IrGepExtra *gep = def->extra;
+            uint32_t total = 1 + (gep ? gep->index_count : 0);
+            if (total + rev_len > ALIAS_MAX_PATH) loc->path_known = false;
+            if (loc->path_known) {
+                idx[n++] = def->operand2;
+                for (uint32_t i = 0; gep && i < gep->index_count; i++) idx[n++] = gep->indices[i];
+                for (uint32_t i = n; i-- > 0 && loc->path_known;)
+                    path_push_index(loc, idx[i], rev, &rev_len);
+            }
+            p = def->operand1;
+            continue;
+        }
+        if (def && def->opcode == IR_CAST) {
+            loc->path_known = false;
+            p = def->operand1;
+            continue;
+        }
+        loc->kind = MEMLOC_UNKNOWN;
+        loc->base = p;
+        break;
+    }
+    if (!loc->base) { loc->kind = MEMLOC_UNKNOWN; loc->path_known = false; }
+    if (loc->path_known) {
+        loc->path_len = rev_len;
+        for (uint8_t i = 0; i < rev_len; i++) loc->path[i] = rev[rev_len - 1 - i];
+    }
+}
+
+typedef struct {
+    AliasInfo     *ai;
+    IrInstruction *inst;
+} EscapeScan;
+
+/* Any use of a stack address other than as the pointer of a load, store
+ * or memory intrinsic, or as the base of a GEP or cast, lets it escape. */
+static void mark_escape(IrValue **slot, void *ctx) {
+    EscapeScan *scan = ctx;
+    IrInstruction *inst = scan->inst;
+    if (slot == &inst->operand1 &&
+        (inst->opcode == IR_LOAD || inst->opcode == IR_STORE ||
+         inst->opcode == IR_GEP || inst->opcode == IR_CAST ||
+         inst->opcode == IR_MEMSET || inst->opcode == IR_MEMCPY))
+        return;
+    if (slot == &inst->operand2 && inst->opcode == IR_MEMCPY) return;
+    if ((*slot)->kind != IR_VALUE_TEMP) return;
+    MemLoc loc;
+    decompose(scan->ai, *slot, &loc);
+    if (loc.kind != MEMLOC_STACK) return;
+    DefSlot *s = find_slot(scan->ai, loc.base);
+    if (s->key) s->escaped = true;
+}
+
+AliasInfo *alias__analyze(IrFunction *func) {
+    if (!func) return NULL;
+    uint32_t inst_count = 0;
+    for (uint32_t i = 0; i < func->block_count; i++)
+        for (IrInstruction *inst = func->all_blocks[i]->first_inst; inst; inst = inst->next)
+            if (inst->result) inst_count++;
+    AliasInfo *ai = calloc(1, sizeof(AliasInfo));
+    if (!ai) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "alias",
+                                 "Failed to allocate alias info");
+        return NULL;
+    }
+    ai->capacity = 16;
+    while (ai->capacity < inst_count * 2) ai->capacity *= 2;
+    ai->slots = calloc(ai->capacity, sizeof(DefSlot));
+    if (!ai->slots) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "alias",
+                                 "Failed to allocate definition table");
+        free(ai);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < func->block_count; i++)
+        for (IrInstruction *inst = func->all_blocks[i]->first_inst; inst; inst = inst->next) {
+            if (!inst->result || inst->result->kind != IR_VALUE_TEMP) continue;
+            DefSlot *s = find_slot(ai, inst->result);
+            s->key = inst->result;
+            s->def = inst;
+        }
+    EscapeScan scan = { ai, NULL };
+    for (uint32_t i = 0; i < func->block_count; i++)
+        for (IrInstruction *inst = func->all_blocks[i]->first_inst; inst; inst = inst->next) {
+            scan.inst = inst;
+            ir__inst_for_each_operand(inst, mark_escape, &scan);
+        }
+    return ai;
+}
+
+void alias__destroy(AliasInfo *ai) {
+    if (!ai) return;
+    free(ai->slots);
+    free(ai);
+}
+
+MemLoc alias__inst_location(const AliasInfo *ai, const IrInstruction *inst) {
+    MemLoc loc;
+    memset(&loc, 0, sizeof(loc));
+    loc.access_type = TYPE_UNKNOWN;
+    if (!ai || !inst || (inst->opcode != IR_LOAD && inst->opcode != IR_STORE) || !inst->operand1)
+        return loc;
+    IrValue *ptr = inst->operand1;
+    decompose(ai, ptr, &loc);
+    /* The declared type is authoritative: an alloca's type_info describes
+     * the slot, any other pointer's describes the pointer itself.  A stored
+     * value may carry its own type across an implicit conversion, so only
+     * loads fall back to the type of the value they produce. */
+    IrInstruction *def = def_of(ai, ptr);
+    if (def && def->opcode == IR_ALLOCA) loc.access_type = ir__datatype_of(ptr->type_info);
+    else loc.access_type = ir__element_datatype(ptr->type_info);
+    if (loc.access_type == TYPE_UNKNOWN && inst->opcode == IR_LOAD && inst->result)
+        loc.access_type = inst->result->type;
+    return loc;
+}
+
+IrInstruction *alias__definition(const AliasInfo *ai, const IrValue *v) {
+    return ai ? def_of(ai, v) : NULL;
+}
+
+bool alias__is_private(const AliasInfo *ai, const MemLoc *loc) {
+    if (!ai || !loc || loc->kind != MEMLOC_STACK) return false;
+    DefSlot *s = find_slot(ai, loc->base);
+    return s->key && !s->escaped;
+}
+
+static bool same_base(const MemLoc *a, const MemLoc *b) {
+    if (a->base == b->base) return true;
+    return a->kind == MEMLOC_GLOBAL && a->base->name == b->base->name;
+}
+
+static bool scalar_class(DataType t) { return t == TYPE_INT || t == TYPE_REAL; }
+
+AliasResult alias__query(const AliasInfo *ai, const MemLoc *a, const MemLoc *b) {
+    if (!a->base || !b->base) return ALIAS_MAY;
+    /* Int<N> and Real<N> objects never overlap. */
+    if (scalar_class(a->access_type) && scalar_class(b->access_type) &&
+        a->access_type != b->access_type)
+        return ALIAS_NO;
+    if (a->kind != b->kind) {
+        if (a->kind != MEMLOC_UNKNOWN && b->kind != MEMLOC_UNKNOWN) return ALIAS_NO;
+        const MemLoc *known = a->kind == MEMLOC_UNKNOWN ? b : a;
+        return alias__is_private(ai, known) ? ALIAS_NO : ALIAS_MAY;
+    }
+    if (!same_base(a, b)) return a->kind == MEMLOC_UNKNOWN ? ALIAS_MAY : ALIAS_NO;
+    if (!a->path_known || !b->path_known) return ALIAS_MAY;
+    uint8_t n = a->path_len < b->path_len ? a->path_len : b->path_len;
+    for (uint8_t i = 0; i < n; i++)
+        if (a->path[i] != b->path[i]) return ALIAS_NO;
+    return a->path_len == b->path_len ? ALIAS_MUST : ALIAS_MAY;
+}
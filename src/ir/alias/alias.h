@@ -0,0 +1,53 @@
+#ifndef ALIAS_H
+#define ALIAS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../ir.h"
+
+/* Deepest chain of constant GEP indices tracked per location. */
+#define ALIAS_MAX_PATH 4
+
+typedef enum { ALIAS_NO, ALIAS_MAY, ALIAS_MUST } AliasResult;
+
+/* What a pointer is ultimately based on. */
+typedef enum {
+    MEMLOC_UNKNOWN,     /* parameter, loaded pointer, call result, ...   */
+    MEMLOC_STACK,       /* an alloca of this function                    */
+    MEMLOC_GLOBAL       /* a module-level symbol                         */
+} MemLocKind;
+
+/* An abstract memory location: base object plus constant field path. */
+typedef struct MemLoc {
+    MemLocKind  kind;
+    IrValue    *base;
+    int64_t     path[ALIAS_MAX_PATH];
+    uint8_t     path_len;
+    bool        path_known;     /* false once a variable index is seen   */
+    DataType    access_type;    /* TYPE_UNKNOWN disables type-based rules */
+} MemLoc;
+
+typedef struct AliasInfo AliasInfo;
+
+/*
+ * Per-function alias analysis.  Records the defining instruction of every
+ * pointer temp and which allocas have their address taken (stored, passed
+ * to a call, returned, merged through a phi or select); the rest are private
+ * to the function and cannot be touched through any other pointer or call.
+ */
+AliasInfo  *alias__analyze(IrFunction *func);
+void        alias__destroy(AliasInfo *ai);
+
+/* Location accessed by a load or store; the kind is MEMLOC_UNKNOWN with a
+ * NULL base for anything else. */
+MemLoc      alias__inst_location(const AliasInfo *ai, const IrInstruction *inst);
+
+AliasResult alias__query(const AliasInfo *ai, const MemLoc *a, const MemLoc *b);
+
+/* Instruction that defines temp v, or NULL for non-temps. */
+IrInstruction *alias__definition(const AliasInfo *ai, const IrValue *v);
+
+/* True if loc is a stack slot whose address never escapes the function. */
+bool        alias__is_private(const AliasInfo *ai, const MemLoc *loc);
+
+#endif
@@ -0,0 +1,412 @@
+#include "analysis.h"
+#include "../../errhandler/errhandler.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct IrAnalysisCache {
+    IrDomTree       *dominators;
+    IrLoopInfo      *loops;
+    IrLiveness      *liveness;
+    IrAnalysisStats  stats;
+};
+
+static const char *const analysis_names[IR_ANALYSIS_COUNT] = {
+    "dominators", "loops", "liveness"
+};
+
+const char *analysis__name(IrAnalysisKind kind) {
+    return kind < IR_ANALYSIS_COUNT ? analysis_names[kind] : "unknown";
+}
+
+static void *report_oom(const char *what) {
+    errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "analysis",
+                             "Failed to allocate %s", what);
+    return NULL;
+}
+
+static IrAnalysisCache *cache_of(IrFunction *func) {
+    if (!func->analyses) {
+        func->analyses = u__arena_alloc(&func->arena, sizeof(IrAnalysisCache));
+        if (!func->analyses) return report_oom("analysis cache");
+    }
+    return func->analyses;
+}
+
+/* ---------------------------------------------------------------- dominators */
+
+static void dom_free(IrDomTree *dt) {
+    if (!dt) return;
+    free(dt->rpo); free(dt->order); free(dt->idom);
+    free(dt);
+}
+
+/* Depth-first search from the entry; blocks are numbered in postorder and
+ * then reversed. */
+static bool dom_order(IrFunction *func, IrDomTree *dt) {
+    uint32_t bc = func->block_count;
+    IrBasicBlock **stack = malloc(bc * sizeof(IrBasicBlock *));
+    uint32_t *pos = malloc(bc * sizeof(uint32_t));
+    if (!stack || !pos) { free(stack); free(pos); return false; }
+    for (uint32_t i = 0; i < dt->id_bound; i++) dt->order[i] = UINT32_MAX;
+    uint32_t top = 0, n = 0;
+    stack[top] = func->entry_block; pos[top++] = 0;
+    dt->order[func->entry_block->id] = 0;
+    while (top > 0) {
+        IrBasicBlock *bb = stack[top - 1];
+        if (pos[top - 1] >= bb->succ_count) { dt->rpo[n++] = bb; top--; continue; }
+        IrBasicBlock *s = bb->successors[pos[top - 1]++];
+        if (dt->order[s->id] == UINT32_MAX) {
+            dt->order[s->id] = 0;
+            stack[top] = s; pos[top++] = 0;
+        }
+    }
+    free(stack); free(pos);
+    for (uint32_t i = 0; i < n / 2; i++) {
+        IrBasicBlock *t = dt->rpo[i];
+        dt->rpo[i] = dt->rpo[n - 1 - i];
+        dt->rpo[n - 1 - i] = t;
+    }
+    for (uint32_t i = 0; i < n; i++) dt->order[dt->rpo[i]->id] = i;
+    dt->count = n;
+    return true;
+}
+
+static IrBasicBlock *intersect(const IrDomTree *dt, IrBasicBlock *a, IrBasicBlock *b) {
+    while (a != b) {
+        while (dt->order[a->id] > dt->order[b->id]) a = dt->idom[a->id];
+        while (dt->order[b->id] > dt->order[a->id]) b = dt->idom[b->id];
+    }
+    return a;
+}
+
+/* Cooper, Harvey and Kennedy's iteration over reverse postorder. */
+static IrDomTree *dom_compute(IrFunction *func) {
+    IrDomTree *dt = calloc(1, sizeof(IrDomTree));
+    if (!dt) return report_oom("dominator tree");
+    dt->id_bound = func->next_block_id;
+    dt->rpo = malloc((func->block_count ? func->block_count : 1) * sizeof(IrBasicBlock *));
+    dt->order = malloc((dt->id_bound ? dt->id_bound : 1) * sizeof(uint32_t));
+    dt->idom = calloc(dt->id_bound ? dt->id_bound : 1, sizeof(IrBasicBlock *));
+    if (!dt->rpo || !dt->order || !dt->idom || !dom_order(func, dt)) {
+        dom_free(dt);
+        return report_oom("dominator tree");
+    }
+    IrBasicBlock *entry = func->entry_block;
+    dt->idom[entry->id] = entry;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t i = 1; i < dt->count; i++) {
+            IrBasicBlock *bb = dt->rpo[i], *idom = NULL;
+            for (uint32_t j = 0; j < bb->pred_count; j++) {
+                IrBasicBlock *p = bb->predecessors[j];
+                if (!dt->idom[p->id]) continue;
+                idom = idom ? intersect(dt, p, idom) : p;
+            }
+            if (idom != dt->idom[bb->id]) { dt->idom[bb->id] = idom; changed = true; }
+        }
+    }
+    dt->idom[entry->id] = NULL;
+    return dt;
+}
+
+bool analysis__dominates(const IrDomTree *dt, const IrBasicBlock *a, const IrBasicBlock *b) {
+    if (!dt || !a || !b || a->id >= dt->id_bound || b->id >= dt->id_bound) return false;
+    if (dt->order[a->id] == UINT32_MAX || dt->order[b->id] == UINT32_MAX) return false;
+    /* Dominators come earlier in reverse postorder. */
+    while (b && dt->order[b->id] > dt->order[a->id]) b = dt->idom[b->id];
+    return b == a;
+}
+
+/* --------------------------------------------------------------------- loops */
+
+static void loops_free(IrLoopInfo *li) {
+    if (!li) return;
+    for (uint32_t i = 0; i < li->loop_count; i++) free(li->loops[i].blocks);
+    free(li->loops); free(li->innermost);
+    free(li);
+}
+
+/* Walk predecessors back from the latches of h.  Unreachable blocks that
+ * branch into the body are included, so that they share its weight. */
+static bool natural_loop
+    ( const IrDomTree *dt
+    , IrLoop *loop
+    , bool *in_loop
+    , IrBasicBlock **work
+) {
+    IrBasicBlock *h = loop->header;
+    uint32_t n = 0, top = 0;
+    work[n++] = h;
+    in_loop[h->id] = true;
+    for (uint32_t i = 0; i < h->pred_count; i++) {
+        IrBasicBlock *p = h->predecessors[i];
+        if (!in_loop[p->id] && analysis__dominates(dt, h, p)) { in_loop[p->id] = true; work[n++] = p; }
+    }
+    while (top + 1 < n) {
+        IrBasicBlock *bb = work[++top];
+        for (uint32_t i = 0; i < bb->pred_count; i++) {
+            IrBasicBlock *p = bb->predecessors[i];
+            if (!in_loop[p->id]) { in_loop[p->id] = true; work[n++] = p; }
+        }
+    }
+    for (uint32_t i = 0; i < n; i++) in_loop[work[i]->id] = false;
+    loop->blocks = malloc(n * sizeof(IrBasicBlock *));
+    if (!loop->blocks) return false;
+    memcpy(loop->blocks, work, n * sizeof(IrBasicBlock *));
+    loop->block_count = n;
+    return true;
+}
+
+/* A back edge runs to a block that dominates its source.  Headers are taken
+ * in reverse postorder, so an enclosing loop is built before the loops
+ * inside it and is the innermost loop its inner headers belong to. */
+static IrLoopInfo *loops_compute(IrFunction *func, const IrDomTree *dt) {
+    IrLoopInfo *li = calloc(1, sizeof(IrLoopInfo));
+    if (!li) return report_oom("loop info");
+    uint32_t ids = dt->id_bound ? dt->id_bound : 1;
+    li->id_bound = dt->id_bound;
+    li->innermost = calloc(ids, sizeof(IrLoop *));
+    li->loops = calloc(dt->count ? dt->count : 1, sizeof(IrLoop));
+    bool *in_loop = calloc(ids, sizeof(bool));
+    IrBasicBlock **work = malloc((func->block_count ? func->block_count : 1) * sizeof(IrBasicBlock *));
+    bool ok = li->innermost && li->loops && in_loop && work;
+    for (uint32_t i = 0; ok && i < dt->count; i++) {
+        IrBasicBlock *h = dt->rpo[i];
+        bool header = false;
+        for (uint32_t j = 0; j < h->pred_count && !header; j++)
+            header = analysis__dominates(dt, h, h->predecessors[j]);
+        if (!header) continue;
+        IrLoop *loop = &li->loops[li->loop_count];
+        loop->header = h;
+        if (!natural_loop(dt, loop, in_loop, work)) { ok = false; break; }
+        li->loop_count++;
+        loop->parent = li->innermost[h->id];
+        loop->depth = loop->parent ? loop->parent->depth + 1 : 1;
+        for (uint32_t j = 0; j < loop->block_count; j++) li->innermost[loop->blocks[j]->id] = loop;
+    }
+    free(in_loop); free(work);
+    if (!ok) {
+        loops_free(li);
+        return report_oom("loop info");
+    }
+    return li;
+}
+
+uint32_t analysis__loop_depth(const IrLoopInfo *li, const IrBasicBlock *bb) {
+    if (!li || !bb || bb->id >= li->id_bound || !li->innermost[bb->id]) return 0;
+    return li->innermost[bb->id]->depth;
+}
+
+const IrLoop *analysis__loop_of_header(const IrLoopInfo *li, const IrBasicBlock *bb) {
+    if (!li || !bb || bb->id >= li->id_bound) return NULL;
+    const IrLoop *loop = li->innermost[bb->id];
+    return loop && loop->header == bb ? loop : NULL;
+}
+
+/* ------------------------------------------------------------------ liveness */
+
+static void liveness_free(IrLiveness *lv) {
+    if (!lv) return;
+    free(lv->live_in); free(lv->live_out);
+    free(lv);
+}
+
+static uint32_t live_bit(const IrLiveness *lv, const IrValue *v) {
+    if (!v) return UINT32_MAX;
+    if (v->kind == IR_VALUE_PARAM) return v->id < lv->param_count ? v->id : UINT32_MAX;
+    if (v->kind == IR_VALUE_TEMP) return v->id < lv->temp_count ? lv->param_count + v->id : UINT32_MAX;
+    return UINT32_MAX;
+}
+
+static bool bit_test(const uint64_t *set, uint32_t bit) {
+    return (set[bit / 64] >> (bit % 64)) & 1;
+}
+
+static void bit_set(uint64_t *set, uint32_t bit) {
+    set[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+/* Upward-exposed uses and definitions of one block. */
+typedef struct {
+    const IrLiveness *lv;
+    uint64_t         *use, *def;
+} LocalSets;
+
+static void note_use(IrValue **slot, void *ctx) {
+    LocalSets *s = ctx;
+    uint32_t bit = live_bit(s->lv, *slot);
+    if (bit != UINT32_MAX && !bit_test(s->def, bit)) bit_set(s->use, bit);
+}
+
+static IrLiveness *liveness_compute(IrFunction *func, const IrDomTree *dt) {
+    IrLiveness *lv = calloc(1, sizeof(IrLiveness));
+    if (!lv) return report_oom("liveness");
+    lv->param_count = func->param_count;
+    lv->temp_count = func->next_temp_id;
+    lv->id_bound = dt->id_bound;
+    lv->words = (lv->param_count + lv->temp_count + 63) / 64;
+    size_t set_words = (size_t)lv->words * (lv->id_bound ? lv->id_bound : 1);
+    size_t set_bytes = (set_words ? set_words : 1) * sizeof(uint64_t);
+    lv->live_in = calloc(1, set_bytes);
+    lv->live_out = calloc(1, set_bytes);
+    uint64_t *use = calloc(1, set_bytes), *def = calloc(1, set_bytes);
+    uint64_t *phi_out = calloc(1, set_bytes);   /* phi operands flowing out of the block */
+    if (!lv->live_in || !lv->live_out || !use || !def || !phi_out) {
+        free(use); free(def); free(phi_out);
+        liveness_free(lv);
+        return report_oom("liveness");
+    }
+    uint32_t w = lv->words;
+    for (uint32_t i = 0; i < dt->count; i++) {
+        IrBasicBlock *bb = dt->rpo[i];
+        LocalSets s = { lv, use + (size_t)bb->id * w, def + (size_t)bb->id * w };
+        for (IrInstruction *inst = bb->first_inst; inst; inst = inst->next) {
+            if (inst->opcode == IR_PHI && inst->extra) {
+                IrPhiExtra *phi = inst->extra;
+                for (uint32_t j = 0; j < phi->count; j++) {
+                    uint32_t bit = live_bit(lv, phi->values[j]);
+                    if (bit != UINT32_MAX && phi->blocks[j] && phi->blocks[j]->id < lv->id_bound)
+                        bit_set(phi_out + (size_t)phi->blocks[j]->id * w, bit);
+                }
+            } else {
+                ir__inst_for_each_operand(inst, note_use, &s);
+            }
+            uint32_t bit = live_bit(lv, inst->result);
+            if (bit != UINT32_MAX) bit_set(s.def, bit);
+        }
+    }
+    /* Backward problem: visit blocks in postorder until nothing changes. */
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t i = dt->count; i-- > 0;) {
+            IrBasicBlock *bb = dt->rpo[i];
+            size_t at = (size_t)bb->id * w;
+            uint64_t *in = lv->live_in + at, *out = lv->live_out + at;
+            for (uint32_t k = 0; k < w; k++) {
+                uint64_t o = phi_out[at + k];
+                for (uint32_t j = 0; j < bb->succ_count; j++)
+                    o |= lv->live_in[(size_t)bb->successors[j]->id * w + k];
+                uint64_t n = use[at + k] | (o & ~def[at + k]);
+                if (o != out[k] || n != in[k]) { out[k] = o; in[k] = n; changed = true; }
+            }
+        }
+    }
+    free(use); free(def); free(phi_out);
+    return lv;
+}
+
+static bool live_in_set(const IrLiveness *lv, const uint64_t *sets, const IrBasicBlock *bb, const IrValue *v) {
+    if (!lv || !bb || bb->id >= lv->id_bound) return false;
+    uint32_t bit = live_bit(lv, v);
+    return bit != UINT32_MAX && bit_test(sets + (size_t)bb->id * lv->words, bit);
+}
+
+bool analysis__live_in(const IrLiveness *lv, const IrBasicBlock *bb, const IrValue *v) {
+    return lv && live_in_set(lv, lv->live_in, bb, v);
+}
+
+bool analysis__live_out(const IrLiveness *lv, const IrBasicBlock *bb, const IrValue *v) {
+    return lv && live_in_set(lv, lv->live_out, bb, v);
+}
+
+/* ------------------------------------------------------------------- manager */
+
+/* Blocks created since a result was computed mean the CFG changed without
+ * the pass reporting it; recompute rather than trust the result. */
+static bool covers(IrFunction *func, uint32_t id_bound) {
+    return id_bound == func->next_block_id;
+}
+
+const IrDomTree *analysis__dominators(IrFunction *func) {
+    if (!func || !func->entry_block) return NULL;
+    IrAnalysisCache *c = cache_of(func);
+    if (!c) return NULL;
+    if (c->dominators && covers(func, c->dominators->id_bound)) {
+        c->stats.hits[IR_ANALYSIS_DOMINATORS]++;
+        return c->dominators;
+    }
+    analysis__invalidate(func, IR_PRESERVE_ALL & ~(1u << IR_ANALYSIS_DOMINATORS));
+    c->stats.misses[IR_ANALYSIS_DOMINATORS]++;
+    c->dominators = dom_compute(func);
+    return c->dominators;
+}
+
+const IrLoopInfo *analysis__loops(IrFunction *func) {
+    if (!func || !func->entry_block) return NULL;
+    IrAnalysisCache *c = cache_of(func);
+    if (!c) return NULL;
+    if (c->loops && covers(func, c->loops->id_bound)) {
+        c->stats.hits[IR_ANALYSIS_LOOPS]++;
+        return c->loops;
+    }
+    const IrDomTree *dt = analysis__dominators(func);
+    if (!dt) return NULL;
+    analysis__invalidate(func, IR_PRESERVE_ALL & ~(1u << IR_ANALYSIS_LOOPS));
+    c->stats.misses[IR_ANALYSIS_LOOPS]++;
+    c->loops = loops_compute(func, dt);
+    return c->loops;
+}
+
+const IrLiveness *analysis__liveness(IrFunction *func) {
+    if (!func || !func->entry_block) return NULL;
+    IrAnalysisCache *c = cache_of(func);
+    if (!c) return NULL;
+    if (c->liveness && covers(func, c->liveness->id_bound)) {
+        c->stats.hits[IR_ANALYSIS_LIVENESS]++;
+        return c->liveness;
+    }
+    const IrDomTree *dt = analysis__dominators(func);
+    if (!dt) return NULL;
+    analysis__invalidate(func, IR_PRESERVE_ALL & ~(1u << IR_ANALYSIS_LIVENESS));
+    c->stats.misses[IR_ANALYSIS_LIVENESS]++;
+    c->liveness = liveness_compute(func, dt);
+    return c->liveness;
+}
+
+void analysis__invalidate(IrFunction *func, IrPreserved preserved) {
+    if (!func || !func->analyses) return;
+    IrAnalysisCache *c = func->analyses;
+    /* Loops are derived from dominators. */
+    if (!(preserved & (1u << IR_ANALYSIS_DOMINATORS))) preserved &= ~(1u << IR_ANALYSIS_LOOPS);
+    if (c->dominators && !(preserved & (1u << IR_ANALYSIS_DOMINATORS))) {
+        dom_free(c->dominators);
+        c->dominators = NULL;
+        c->stats.invalidations[IR_ANALYSIS_DOMINATORS]++;
+    }
+    if (c->loops && !(preserved & (1u << IR_ANALYSIS_LOOPS))) {
+        loops_free(c->loops);
+        c->loops = NULL;
+        c->stats.invalidations[IR_ANALYSIS_LOOPS]++;
+    }
+    if (c->liveness && !(preserved & (1u << IR_ANALYSIS_LIVENESS))) {
+        liveness_free(c->liveness);
+        c->liveness = NULL;
+        c->stats.invalidations[IR_ANALYSIS_LIVENESS]++;
+    }
+}
+
+void analysis__release(IrFunction *func) {
+    if (!func || !func->analyses) return;
+    IrAnalysisCache *c = func->analyses;
+    dom_free(c->dominators);
+    loops_free(c->loops);
+    liveness_free(c->liveness);
+    /* The cache itself lives in the function arena. */
+    func->analyses = NULL;
+}
+
+void analysis__module_stats(const IrModule *mod, IrAnalysisStats *out) {
+    memset(out, 0, sizeof(*out));
+    if (!mod) return;
+    for (uint32_t i = 0; i < mod->func_count; i++) {
+        const IrAnalysisCache *c = mod->functions[i]->analyses;
+        if (!c) continue;
+        for (uint32_t k = 0; k < IR_ANALYSIS_COUNT; k++) {
+            out->hits[k] += c->stats.hits[k];
+            out->misses[k] += c->stats.misses[k];
+            out->invalidations[k] += c->stats.invalidations[k];
+        }
+    }
+}
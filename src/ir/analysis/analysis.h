@@ -0,0 +1,102 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../ir.h"
+
+/* Analyses the manager caches per function. */
+typedef enum {
+    IR_ANALYSIS_DOMINATORS,
+    IR_ANALYSIS_LOOPS,
+    IR_ANALYSIS_LIVENESS,
+    IR_ANALYSIS_COUNT
+} IrAnalysisKind;
+
+/* What a pass left valid, as a set of (1 << IrAnalysisKind) bits. */
+typedef uint32_t IrPreserved;
+
+#define IR_PRESERVE_NONE    0u
+/* Blocks and edges unchanged: dominators and loops still hold. */
+#define IR_PRESERVE_CFG     ((1u << IR_ANALYSIS_DOMINATORS) | (1u << IR_ANALYSIS_LOOPS))
+#define IR_PRESERVE_ALL     ((1u << IR_ANALYSIS_COUNT) - 1)
+
+/* Per-block arrays below are indexed by block id, up to id_bound. */
+
+/* Dominator tree of the blocks reachable from the entry. */
+typedef struct IrDomTree {
+    IrBasicBlock **rpo;         /* reachable blocks in reverse postorder */
+    uint32_t       count;
+    uint32_t       id_bound;
+    uint32_t      *order;       /* position in rpo, UINT32_MAX if unreachable */
+    IrBasicBlock **idom;        /* immediate dominator, NULL for the entry */
+} IrDomTree;
+
+/* Natural loop: a header and every block that reaches one of its back
+ * edges without passing through it. */
+typedef struct IrLoop {
+    IrBasicBlock  *header;
+    struct IrLoop *parent;      /* innermost enclosing loop, NULL if none */
+    uint32_t       depth;       /* 1 for an outermost loop */
+    IrBasicBlock **blocks;      /* header first */
+    uint32_t       block_count;
+} IrLoop;
+
+typedef struct IrLoopInfo {
+    IrLoop    *loops;           /* an enclosing loop comes before its inner loops */
+    uint32_t   loop_count;
+    uint32_t   id_bound;
+    IrLoop   **innermost;       /* innermost loop containing the block, or NULL */
+} IrLoopInfo;
+
+/* Temps and parameters live on entry to and exit from each block.  Phi
+ * operands are live out of the predecessor they come from, not live into
+ * the block of the phi. */
+typedef struct IrLiveness {
+    uint32_t   words;           /* 64-bit words per set */
+    uint32_t   id_bound;
+    uint32_t   param_count;     /* parameters take the first bits, temps follow */
+    uint32_t   temp_count;      /* temps created later are never live */
+    uint64_t  *live_in;         /* words per block */
+    uint64_t  *live_out;
+} IrLiveness;
+
+/* Cache lookups over the life of the functions counted. */
+typedef struct IrAnalysisStats {
+    uint64_t hits[IR_ANALYSIS_COUNT];
+    uint64_t misses[IR_ANALYSIS_COUNT];         /* computed, cold or invalidated */
+    uint64_t invalidations[IR_ANALYSIS_COUNT];  /* cached results dropped */
+} IrAnalysisStats;
+
+/*
+ * Analysis manager.  Each function caches its analyses, computed on first
+ * request and returned as is until a pass reports, through
+ * analysis__invalidate, that it did not preserve them.  Loops are built on
+ * dominators and are dropped with them.  Results are owned by the cache:
+ * they stay valid until the next invalidation and must not be changed.
+ * A function's cache is only touched by the thread optimising it.
+ *
+ * The getters return NULL, after reporting an error, if memory runs out.
+ */
+const IrDomTree  *analysis__dominators(IrFunction *func);
+const IrLoopInfo *analysis__loops(IrFunction *func);
+const IrLiveness *analysis__liveness(IrFunction *func);
+
+/* Drop every cached analysis of func not in preserved. */
+void analysis__invalidate(IrFunction *func, IrPreserved preserved);
+
+/* Free func's cache; called when the function is destroyed. */
+void analysis__release(IrFunction *func);
+
+bool analysis__dominates(const IrDomTree *dt, const IrBasicBlock *a, const IrBasicBlock *b);
+uint32_t analysis__loop_depth(const IrLoopInfo *li, const IrBasicBlock *bb);
+/* The loop headed by bb, or NULL if bb is not a loop header. */
+const IrLoop *analysis__loop_of_header(const IrLoopInfo *li, const IrBasicBlock *bb);
+bool analysis__live_in(const IrLiveness *lv, const IrBasicBlock *bb, const IrValue *v);
+bool analysis__live_out(const IrLiveness *lv, const IrBasicBlock *bb, const IrValue *v);
+
+const char *analysis__name(IrAnalysisKind kind);
+/* Sum the lookup counts of every function of mod. */
+void analysis__module_stats(const IrModule *mod, IrAnalysisStats *out);
+
+#endif
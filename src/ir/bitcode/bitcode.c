@@ -0,0 +1,999 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bitcode.h"
+#include "../../errhandler/errhandler.h"
+#include "../../utils/str_utils.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BITCODE_MAGIC   "PXBC"
+#define BITCODE_VERSION 1
+
+/* Operand tags, in the low bits of an operand reference. */
+#define REF_NONE    0
+#define REF_TEMP    1
+#define REF_PARAM   2
+#define REF_VALUE   3
+#define REF_LABEL   4
+#define REF_SHIFT   3
+
+#define TYPE_FLAG_REFERENCE 1
+#define TYPE_FLAG_ARRAY     2
+
+#define FUNC_FLAG_PROFILE   1
+#define FUNC_FLAG_INTERNAL  2
+
+/* ------------------------------------------------------------------ writing */
+
+typedef struct {
+    uint8_t *data;
+    size_t   size, capacity;
+    bool     ok;
+} Buf;
+
+static void buf_put(Buf *b, const void *data, size_t len) {
+    if (!b->ok) return;
+    if (b->size + len > b->capacity) {
+        size_t cap = b->capacity ? b->capacity : 4096;
+        while (cap < b->size + len) cap *= 2;
+        uint8_t *grown = realloc(b->data, cap);
+        if (!grown) { b->ok = false; return; }
+        b->data = grown;
+        b->capacity = cap;
+    }
+    memcpy(b->data + b->size, data, len);
+    b->size += len;
+}
+
+static void put_uleb(Buf *b, uint64_t v) {
+    uint8_t bytes[10];
+    size_t n = 0;
+    do {
+        uint8_t byte = v & 0x7F;
+        v >>= 7;
+        if (v) byte |= 0x80;
+        bytes[n++] = byte;
+    } while (v);
+    buf_put(b, bytes, n);
+}
+
+static void put_sleb(Buf *b, int64_t v) {
+    put_uleb(b, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void put_u64(Buf *b, uint64_t v) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++) bytes[i] = (uint8_t)(v >> (i * 8));
+    buf_put(b, bytes, 8);
+}
+
+/* Open addressing from a non-zero 64-bit key to an index. */
+typedef struct {
+    uint64_t *keys;
+    uint32_t *slots;            /* index + 1, 0 if empty */
+    uint32_t  count, capacity;
+} IndexMap;
+
+static uint32_t mix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    return (uint32_t)k;
+}
+
+static bool map_grow(IndexMap *m) {
+    uint32_t cap = m->capacity ? m->capacity * 2 : 64;
+    uint64_t *keys = calloc(cap, sizeof(uint64_t));
+    uint32_t *slots = calloc(cap, sizeof(uint32_t));
+    if (!keys || !slots) { free(keys); free(slots); return false; }
+    for (uint32_t i = 0; i < m->capacity; i++) {
+        if (!m->slots[i]) continue;
+        uint32_t j = mix(m->keys[i]) & (cap - 1);
+        while (slots[j]) j = (j + 1) & (cap - 1);
+        keys[j] = m->keys[i];
+        slots[j] = m->slots[i];
+    }
+    free(m->keys); free(m->slots);
+    m->keys = keys; m->slots = slots; m->capacity = cap;
+    return true;
+}
+
+/* Slot of key, which is empty if key is absent; UINT32_MAX if out of memory. */
+static uint32_t map_find(IndexMap *m, uint64_t key) {
+    if (m->count * 2 >= m->capacity && !map_grow(m)) return UINT32_MAX;
+    uint32_t i = mix(key) & (m->capacity - 1);
+    while (m->slots[i] && m->keys[i] != key) i = (i + 1) & (m->capacity - 1);
+    return i;
+}
+
+static void map_free(IndexMap *m) { free(m->keys); free(m->slots); }
+
+typedef struct {
+    uint32_t name;              /* string reference */
+    uint8_t  pointer_level, flags, width;
+} TypeEntry;
+
+typedef struct {
+    Buf              body;
+    const char     **strings;
+    uint32_t         string_count, string_capacity;
+    IndexMap         string_by_hash;    /* chained through string_next on collisions */
+    uint32_t        *string_next;
+    TypeEntry       *types;
+    uint32_t         type_count, type_capacity;
+    IndexMap         type_by_ptr, type_by_key;
+    const IrValue  **values;
+    uint32_t         value_count, value_capacity;
+    IndexMap         value_by_ptr;
+    /* Per function being written. */
+    const IrValue  **temps;             /* by temp id */
+    uint32_t        *block_pos;         /* by block id: position in all_blocks */
+    const IrFunction *func;
+    bool             ok;
+} Writer;
+
+static bool grow(void **items, uint32_t *capacity, size_t elem) {
+    uint32_t cap = *capacity ? *capacity * 2 : 16;
+    void *grown = realloc(*items, cap * elem);
+    if (!grown) return false;
+    *items = grown;
+    *capacity = cap;
+    return true;
+}
+
+static uint64_t hash_string(const char *s) {
+    uint64_t h = 14695981039346656037ULL;
+    for (; *s; s++) { h ^= (unsigned char)*s; h *= 1099511628211ULL; }
+    return h | 1;
+}
+
+/* Reference to str in the string table, added on first use. */
+static uint32_t string_ref(Writer *w, const char *str) {
+    if (!str || !w->ok) return 0;
+    uint64_t h = hash_string(str);
+    uint32_t slot = map_find(&w->string_by_hash, h);
+    if (slot == UINT32_MAX) { w->ok = false; return 0; }
+    uint32_t first = w->string_by_hash.slots[slot];
+    for (uint32_t i = first; i; i = w->string_next[i - 1])
+        if (strcmp(w->strings[i - 1], str) == 0) return i;
+    if (w->string_count >= w->string_capacity) {
+        uint32_t cap = w->string_capacity;
+        if (!grow((void **)&w->strings, &w->string_capacity, sizeof(char *)) ||
+            !grow((void **)&w->string_next, &cap, sizeof(uint32_t))) {
+            w->ok = false;
+            return 0;
+        }
+    }
+    w->strings[w->string_count] = str;
+    w->string_next[w->string_count] = first;
+    uint32_t ref = ++w->string_count;
+    if (!first) { w->string_by_hash.keys[slot] = h; w->string_by_hash.count++; }
+    w->string_by_hash.slots[slot] = ref;
+    return ref;
+}
+
+/* Types from the AST are not shared, so they are merged by content. */
+static uint32_t type_ref(Writer *w, const Type *t) {
+    if (!t || !w->ok) return 0;
+    uint32_t slot = map_find(&w->type_by_ptr, (uintptr_t)t);
+    if (slot == UINT32_MAX) { w->ok = false; return 0; }
+    if (w->type_by_ptr.slots[slot]) return w->type_by_ptr.slots[slot];
+    TypeEntry e = {
+        string_ref(w, t->name), t->pointer_level,
+        (uint8_t)((t->is_reference ? TYPE_FLAG_REFERENCE : 0) | (t->is_array ? TYPE_FLAG_ARRAY : 0)),
+        t->size_in_bytes
+    };
+    uint64_t key = ((uint64_t)e.name << 32) | ((uint64_t)e.pointer_level << 16) |
+                   ((uint64_t)e.flags << 8) | e.width;
+    uint32_t kslot = map_find(&w->type_by_key, key + 1);
+    if (kslot == UINT32_MAX) { w->ok = false; return 0; }
+    uint32_t ref = w->type_by_key.slots[kslot];
+    if (!ref) {
+        if (w->type_count >= w->type_capacity &&
+            !grow((void **)&w->types, &w->type_capacity, sizeof(TypeEntry))) {
+            w->ok = false;
+            return 0;
+        }
+        w->types[w->type_count] = e;
+        ref = ++w->type_count;
+        w->type_by_key.keys[kslot] = key + 1;
+        w->type_by_key.slots[kslot] = ref;
+        w->type_by_key.count++;
+    }
+    /* map_find may have grown the pointer map since slot was taken. */
+    slot = map_find(&w->type_by_ptr, (uintptr_t)t);
+    if (slot == UINT32_MAX) { w->ok = false; return 0; }
+    w->type_by_ptr.keys[slot] = (uintptr_t)t;
+    w->type_by_ptr.slots[slot] = ref;
+    w->type_by_ptr.count++;
+    return ref;
+}
+
+static uint32_t value_index(Writer *w, const IrValue *v) {
+    uint32_t slot = map_find(&w->value_by_ptr, (uintptr_t)v);
+    if (slot == UINT32_MAX) { w->ok = false; return 0; }
+    if (w->value_by_ptr.slots[slot]) return w->value_by_ptr.slots[slot] - 1;
+    if (w->value_count >= w->value_capacity &&
+        !grow((void **)&w->values, &w->value_capacity, sizeof(IrValue *))) {
+        w->ok = false;
+        return 0;
+    }
+    w->values[w->value_count] = v;
+    w->value_by_ptr.keys[slot] = (uintptr_t)v;
+    w->value_by_ptr.slots[slot] = ++w->value_count;
+    w->value_by_ptr.count++;
+    /* Register what the entry refers to before the tables are written. */
+    type_ref(w, v->type_info);
+    if (v->kind == IR_VALUE_GLOBAL_SYMBOL) string_ref(w, v->name);
+    return w->value_count - 1;
+}
+
+static uint64_t operand_ref(Writer *w, const IrValue *v) {
+    if (!v) return REF_NONE;
+    switch (v->kind) {
+        case IR_VALUE_TEMP:  return ((uint64_t)v->id << REF_SHIFT) | REF_TEMP;
+        case IR_VALUE_PARAM: return ((uint64_t)v->id << REF_SHIFT) | REF_PARAM;
+        case IR_VALUE_LABEL: {
+            const IrBasicBlock *bb = v->const_data.block;
+            if (bb->function != w->func || bb->id >= w->func->next_block_id ||
+                w->block_pos[bb->id] == UINT32_MAX)
+                break;
+            return ((uint64_t)w->block_pos[bb->id] << REF_SHIFT) | REF_LABEL;
+        }
+        case IR_VALUE_CONST_INT: case IR_VALUE_CONST_REAL: case IR_VALUE_CONST_CHAR:
+        case IR_VALUE_GLOBAL_SYMBOL: case IR_VALUE_STRUCT_FIELD:
+            return ((uint64_t)value_index(w, v) << REF_SHIFT) | REF_VALUE;
+        default:
+            break;
+    }
+    if (w->ok)
+        errhandler__report_error(ERROR_CODE_IR_INVALID_ARGUMENT, 0, 0, "bitcode",
+                                 "Cannot encode operand of kind %d in function %s",
+                                 v->kind, w->func->name);
+    w->ok = false;
+    return REF_NONE;
+}
+
+static void note_temp(IrValue **slot, void *ctx) {
+    Writer *w = ctx;
+    const IrValue *v = *slot;
+    if (v->kind == IR_VALUE_TEMP && v->id < w->func->next_temp_id) w->temps[v->id] = v;
+}
+
+static void put_block_pos(Writer *w, const IrBasicBlock *bb) {
+    if (!bb || bb->id >= w->func->next_block_id || w->block_pos[bb->id] == UINT32_MAX) {
+        w->ok = false;
+        return;
+    }
+    put_uleb(&w->body, w->block_pos[bb->id]);
+}
+
+static void write_instruction(Writer *w, const IrInstruction *inst) {
+    Buf *b = &w->body;
+    put_uleb(b, inst->opcode);
+    put_uleb(b, inst->line);
+    put_uleb(b, inst->column);
+    put_uleb(b, operand_ref(w, inst->result));
+    put_uleb(b, operand_ref(w, inst->operand1));
+    put_uleb(b, operand_ref(w, inst->operand2));
+    put_uleb(b, inst->extra != NULL);
+    if (!inst->extra) return;
+    switch (inst->opcode) {
+        case IR_CALL: {
+            const IrCallExtra *call = inst->extra;
+            put_uleb(b, call->arg_count);
+            for (uint32_t i = 0; i < call->arg_count; i++) put_uleb(b, operand_ref(w, call->args[i]));
+            break;
+        }
+        case IR_GEP: {
+            const IrGepExtra *gep = inst->extra;
+            put_uleb(b, gep->index_count);
+            for (uint32_t i = 0; i < gep->index_count; i++) put_uleb(b, operand_ref(w, gep->indices[i]));
+            break;
+        }
+        case IR_PHI: {
+            const IrPhiExtra *phi = inst->extra;
+            put_uleb(b, phi->count);
+            for (uint32_t i = 0; i < phi->count; i++) {
+                put_uleb(b, operand_ref(w, phi->values[i]));
+                put_block_pos(w, phi->blocks[i]);
+            }
+            break;
+        }
+        case IR_BRCOND: {
+            const IrCondBranchExtra *br = inst->extra;
+            put_block_pos(w, br->true_target);
+            put_block_pos(w, br->false_target);
+            break;
+        }
+        case IR_SELECT:
+            put_uleb(b, operand_ref(w, ((const IrSelectExtra *)inst->extra)->false_value));
+            break;
+        case IR_MEMSET: case IR_MEMCPY: {
+            const IrMemExtra *mem = inst->extra;
+            put_uleb(b, operand_ref(w, mem->count));
+            put_uleb(b, mem->elem_size);
+            break;
+        }
+        default:
+            w->ok = false;
+            break;
+    }
+}
+
+static void write_function(Writer *w, const IrFunction *func) {
+    Buf *b = &w->body;
+    w->func = func;
+    w->temps = calloc(func->next_temp_id ? func->next_temp_id : 1, sizeof(IrValue *));
+    w->block_pos = malloc((func->next_block_id ? func->next_block_id : 1) * sizeof(uint32_t));
+    if (!w->temps || !w->block_pos) { w->ok = false; goto done; }
+    for (uint32_t i = 0; i < func->next_block_id; i++) w->block_pos[i] = UINT32_MAX;
+    for (uint32_t i = 0; i < func->block_count; i++) {
+        const IrBasicBlock *bb = func->all_blocks[i];
+        if (bb->id >= func->next_block_id) { w->ok = false; goto done; }
+        w->block_pos[bb->id] = i;
+        for (IrInstruction *inst = bb->first_inst; inst; inst = inst->next) {
+            if (inst->result) note_temp(&inst->result, w);
+            ir__inst_for_each_operand(inst, note_temp, w);
+        }
+    }
+
+    put_uleb(b, func->return_type);
+    put_uleb(b, type_ref(w, func->return_type_info));
+    put_uleb(b, func->param_count);
+    for (uint32_t i = 0; i < func->param_count; i++) {
+        const IrValue *p = func->parameters[i];
+        put_uleb(b, p->type);
+        put_uleb(b, type_ref(w, p->type_info));
+        put_uleb(b, string_ref(w, p->name));
+    }
+    put_uleb(b, (func->has_profile ? FUNC_FLAG_PROFILE : 0) | (func->is_internal ? FUNC_FLAG_INTERNAL : 0));
+    put_uleb(b, func->next_temp_id);
+    put_uleb(b, func->next_block_id);
+    uint32_t temp_count = 0;
+    for (uint32_t i = 0; i < func->next_temp_id; i++) temp_count += w->temps[i] != NULL;
+    put_uleb(b, temp_count);
+    for (uint32_t i = 0; i < func->next_temp_id; i++) {
+        if (!w->temps[i]) continue;
+        put_uleb(b, i);
+        put_uleb(b, w->temps[i]->type);
+        put_uleb(b, type_ref(w, w->temps[i]->type_info));
+    }
+    put_uleb(b, func->block_count);
+    put_block_pos(w, func->entry_block);
+    for (uint32_t i = 0; i < func->block_count; i++) {
+        const IrBasicBlock *bb = func->all_blocks[i];
+        put_uleb(b, bb->id);
+        put_uleb(b, string_ref(w, bb->label));
+        put_uleb(b, bb->align);
+        put_uleb(b, bb->is_cold);
+        put_uleb(b, bb->exec_count);
+    }
+    /* Both edge lists, so their order survives. */
+    for (uint32_t i = 0; i < func->block_count; i++) {
+        const IrBasicBlock *bb = func->all_blocks[i];
+        put_uleb(b, bb->succ_count);
+        for (uint32_t j = 0; j < bb->succ_count; j++) put_block_pos(w, bb->successors[j]);
+        put_uleb(b, bb->pred_count);
+        for (uint32_t j = 0; j < bb->pred_count; j++) put_block_pos(w, bb->predecessors[j]);
+    }
+    for (uint32_t i = 0; i < func->block_count && w->ok; i++) {
+        const IrBasicBlock *bb = func->all_blocks[i];
+        uint32_t count = 0;
+        for (IrInstruction *inst = bb->first_inst; inst; inst = inst->next) count++;
+        put_uleb(b, count);
+        for (IrInstruction *inst = bb->first_inst; inst; inst = inst->next) write_instruction(w, inst);
+    }
+done:
+    free(w->temps);
+    free(w->block_pos);
+    w->temps = NULL;
+    w->block_pos = NULL;
+}
+
+static void write_tables(Writer *w, const IrModule *mod, Buf *head,
+                         const uint64_t *offsets, const uint32_t *names) {
+    buf_put(head, BITCODE_MAGIC, 4);
+    uint8_t version = BITCODE_VERSION;
+    buf_put(head, &version, 1);
+    put_uleb(head, w->string_count);
+    for (uint32_t i = 0; i < w->string_count; i++) {
+        size_t len = strlen(w->strings[i]);
+        put_uleb(head, len);
+        buf_put(head, w->strings[i], len);
+    }
+    put_uleb(head, w->type_count);
+    for (uint32_t i = 0; i < w->type_count; i++) {
+        put_uleb(head, w->types[i].name);
+        put_uleb(head, w->types[i].pointer_level);
+        put_uleb(head, w->types[i].flags);
+        put_uleb(head, w->types[i].width);
+    }
+    put_uleb(head, w->value_count);
+    for (uint32_t i = 0; i < w->value_count; i++) {
+        const IrValue *v = w->values[i];
+        put_uleb(head, v->kind);
+        put_uleb(head, v->type);
+        put_uleb(head, type_ref(w, v->type_info));
+        switch (v->kind) {
+            case IR_VALUE_CONST_INT:  put_sleb(head, v->const_data.int_val); break;
+            case IR_VALUE_CONST_REAL: {
+                uint64_t bits;
+                memcpy(&bits, &v->const_data.real_val, sizeof(bits));
+                put_u64(head, bits);
+                break;
+            }
+            case IR_VALUE_CONST_CHAR:    put_uleb(head, (unsigned char)v->const_data.char_val); break;
+            case IR_VALUE_GLOBAL_SYMBOL: put_uleb(head, string_ref(w, v->name)); break;
+            default:                     put_uleb(head, v->const_data.field_index); break;
+        }
+    }
+    const IrProfileLayout *layout = mod->profile;
+    put_uleb(head, layout != NULL);
+    if (layout) {
+        put_uleb(head, string_ref(w, layout->path));
+        put_uleb(head, layout->func_count);
+        for (uint32_t i = 0; i < layout->func_count; i++) {
+            put_uleb(head, string_ref(w, layout->funcs[i].name));
+            put_u64(head, layout->funcs[i].checksum);
+            put_uleb(head, layout->funcs[i].first_counter);
+            put_uleb(head, layout->funcs[i].block_count);
+        }
+        put_uleb(head, layout->counter_count);
+    }
+    put_uleb(head, mod->func_count);
+    for (uint32_t i = 0; i < mod->func_count; i++) {
+        put_uleb(head, names[i]);
+        put_uleb(head, offsets[i]);
+        put_uleb(head, offsets[i + 1] - offsets[i]);
+    }
+}
+
+bool ir__write_bitcode(const IrModule *mod, const char *path) {
+    if (!mod || !path) return false;
+    Writer w;
+    memset(&w, 0, sizeof(w));
+    w.ok = w.body.ok = true;
+    Buf head = { NULL, 0, 0, true };
+    uint64_t *offsets = malloc((mod->func_count + 1) * sizeof(uint64_t));
+    uint32_t *names = malloc((mod->func_count ? mod->func_count : 1) * sizeof(uint32_t));
+    if (!offsets || !names) w.ok = false;
+    for (uint32_t i = 0; i < mod->func_count && w.ok; i++) {
+        offsets[i] = w.body.size;
+        names[i] = string_ref(&w, mod->functions[i]->name);
+        write_function(&w, mod->functions[i]);
+    }
+    if (w.ok) {
+        offsets[mod->func_count] = w.body.size;
+        /* The profile strings must be in the table before it is written. */
+        if (mod->profile) {
+            string_ref(&w, mod->profile->path);
+            for (uint32_t i = 0; i < mod->profile->func_count; i++)
+                string_ref(&w, mod->profile->funcs[i].name);
+        }
+        write_tables(&w, mod, &head, offsets, names);
+    }
+    bool ok = w.ok && w.body.ok && head.ok;
+    if (!ok) {
+        errhandler__report_error(ERROR_CODE_IO_WRITE, 0, 0, "bitcode",
+                                 "Failed to encode bitcode for %s", path);
+    } else {
+        FILE *f = fopen(path, "wb");
+        if (!f) {
+            errhandler__report_error(ERROR_CODE_IO_WRITE, 0, 0, "bitcode",
+                                     "Cannot open bitcode for writing: %s", path);
+            ok = false;
+        } else {
+            ok = fwrite(head.data, 1, head.size, f) == head.size &&
+                 fwrite(w.body.data, 1, w.body.size, f) == w.body.size;
+            if (fclose(f) != 0) ok = false;
+            if (!ok)
+                errhandler__report_error(ERROR_CODE_IO_WRITE, 0, 0, "bitcode",
+                                         "Failed to write bitcode: %s", path);
+        }
+    }
+    free(head.data); free(w.body.data);
+    free(w.strings); free(w.string_next); map_free(&w.string_by_hash);
+    free(w.types); map_free(&w.type_by_ptr); map_free(&w.type_by_key);
+    free(w.values); map_free(&w.value_by_ptr);
+    free(offsets); free(names);
+    return ok;
+}
+
+/* ------------------------------------------------------------------ reading */
+
+typedef struct {
+    uint32_t    name;           /* string reference */
+    uint64_t    offset, size;
+    IrFunction *loaded;
+} BitcodeFunc;
+
+struct IrBitcode {
+    IrModule       *mod;
+    char           *path;
+    const uint8_t  *map;
+    size_t          map_size;
+    const uint8_t  *bodies;
+    size_t          bodies_size;
+    uint32_t        string_count;
+    const uint8_t **string_data;    /* into the mapping, not terminated */
+    uint32_t       *string_len;
+    const char    **interned;       /* filled on first use */
+    uint32_t        type_count;
+    Type          **types;
+    uint32_t        value_count;
+    IrValue       **values;
+    uint32_t        func_count;
+    BitcodeFunc    *funcs;
+};
+
+typedef struct {
+    const uint8_t *p, *end;
+    bool           ok;
+} Reader;
+
+static uint64_t get_uleb(Reader *r) {
+    uint64_t v = 0;
+    for (unsigned shift = 0; r->ok; shift += 7) {
+        if (r->p >= r->end || shift > 63) { r->ok = false; break; }
+        uint8_t byte = *r->p++;
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    return v;
+}
+
+static int64_t get_sleb(Reader *r) {
+    uint64_t v = get_uleb(r);
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint64_t get_u64(Reader *r) {
+    uint64_t v = 0;
+    if (r->end - r->p < 8) { r->ok = false; return 0; }
+    for (int b = 0; b < 8; b++) v |= (uint64_t)*r->p++ << (b * 8);
+    return v;
+}
+
+/* A count of items taking at least min_bytes each, checked against what is
+ * left so that a corrupt count cannot ask for a huge allocation. */
+static uint32_t get_count(Reader *r, size_t min_bytes) {
+    uint64_t n = get_uleb(r);
+    if (!r->ok || n > UINT32_MAX || n * min_bytes > (uint64_t)(r->end - r->p)) {
+        r->ok = false;
+        return 0;
+    }
+    return (uint32_t)n;
+}
+
+/* Interned copy of string i, made on first use; NULL if memory runs out. */
+static const char *string_at(IrBitcode *bc, uint32_t i) {
+    if (!bc->interned[i]) {
+        char *tmp = u__strdup((const char *)bc->string_data[i], bc->string_len[i]);
+        if (!tmp) return NULL;
+        bc->interned[i] = ir__module_intern(bc->mod, tmp);
+        free(tmp);
+    }
+    return bc->interned[i];
+}
+
+static const char *get_string(IrBitcode *bc, Reader *r) {
+    uint64_t ref = get_uleb(r);
+    if (!r->ok || ref == 0) return NULL;
+    const char *s = ref <= bc->string_count ? string_at(bc, (uint32_t)ref - 1) : NULL;
+    if (!s) r->ok = false;
+    return s;
+}
+
+static Type *get_type(IrBitcode *bc, Reader *r) {
+    uint64_t ref = get_uleb(r);
+    if (!r->ok || ref == 0) return NULL;
+    if (ref > bc->type_count) { r->ok = false; return NULL; }
+    return bc->types[ref - 1];
+}
+
+static bool read_tables(IrBitcode *bc, Reader *r) {
+    if (r->end - r->p < 5 || memcmp(r->p, BITCODE_MAGIC, 4) != 0 || r->p[4] != BITCODE_VERSION)
+        return false;
+    r->p += 5;
+    bc->string_count = get_count(r, 1);
+    bc->string_data = calloc(bc->string_count ? bc->string_count : 1, sizeof(uint8_t *));
+    bc->string_len = calloc(bc->string_count ? bc->string_count : 1, sizeof(uint32_t));
+    bc->interned = calloc(bc->string_count ? bc->string_count : 1, sizeof(char *));
+    if (!r->ok || !bc->string_data || !bc->string_len || !bc->interned) return false;
+    for (uint32_t i = 0; i < bc->string_count; i++) {
+        uint64_t len = get_uleb(r);
+        if (!r->ok || len > (uint64_t)(r->end - r->p) || len >= UINT32_MAX) return false;
+        bc->string_data[i] = r->p;
+        bc->string_len[i] = (uint32_t)len;
+        r->p += len;
+    }
+    bc->type_count = get_count(r, 4);
+    bc->types = calloc(bc->type_count ? bc->type_count : 1, sizeof(Type *));
+    if (!r->ok || !bc->types) return false;
+    for (uint32_t i = 0; i < bc->type_count; i++) {
+        Type t;
+        memset(&t, 0, sizeof(t));
+        t.name = (char *)get_string(bc, r);
+        t.pointer_level = (uint8_t)get_uleb(r);
+        uint64_t flags = get_uleb(r);
+        t.is_reference = (flags & TYPE_FLAG_REFERENCE) != 0;
+        t.is_array = (flags & TYPE_FLAG_ARRAY) != 0;
+        t.size_in_bytes = (uint8_t)get_uleb(r);
+        if (!r->ok || !(bc->types[i] = ir__module_type(bc->mod, &t))) return false;
+    }
+    bc->value_count = get_count(r, 4);
+    bc->values = calloc(bc->value_count ? bc->value_count : 1, sizeof(IrValue *));
+    if (!r->ok || !bc->values) return false;
+    for (uint32_t i = 0; i < bc->value_count; i++) {
+        uint64_t kind = get_uleb(r), type = get_uleb(r);
+        Type *info = get_type(bc, r);
+        IrValue *v = NULL;
+        switch (kind) {
+            case IR_VALUE_CONST_INT:  v = ir__value_const_int(bc->mod, get_sleb(r)); break;
+            case IR_VALUE_CONST_REAL: {
+                uint64_t bits = get_u64(r);
+                double d;
+                memcpy(&d, &bits, sizeof(d));
+                v = ir__value_const_real(bc->mod, d);
+                break;
+            }
+            case IR_VALUE_CONST_CHAR: v = ir__value_const_char(bc->mod, (char)get_uleb(r)); break;
+            case IR_VALUE_GLOBAL_SYMBOL: {
+                const char *name = get_string(bc, r);
+                if (r->ok && name) v = ir__value_global(bc->mod, name, (DataType)type, info);
+                break;
+            }
+            case IR_VALUE_STRUCT_FIELD: v = ir__value_struct_field(bc->mod, (uint32_t)get_uleb(r)); break;
+            default: break;
+        }
+        if (!r->ok || !v) return false;
+        bc->values[i] = v;
+    }
+    if (get_uleb(r) && r->ok) {
+        IrProfileLayout *layout = calloc(1, sizeof(IrProfileLayout));
+        if (!layout) return false;
+        const char *path = get_string(bc, r);
+        layout->path = path ? u__strdup_safe(path) : NULL;
+        layout->func_count = get_count(r, 11);
+        layout->funcs = calloc(layout->func_count ? layout->func_count : 1, sizeof(IrProfileFunc));
+        bool ok = r->ok && layout->path && layout->funcs;
+        for (uint32_t i = 0; ok && i < layout->func_count; i++) {
+            const char *name = get_string(bc, r);
+            layout->funcs[i].name = u__strdup_safe(name ? name : "");
+            layout->funcs[i].checksum = get_u64(r);
+            layout->funcs[i].first_counter = (uint32_t)get_uleb(r);
+            layout->funcs[i].block_count = (uint32_t)get_uleb(r);
+            ok = r->ok && layout->funcs[i].name;
+        }
+        layout->counter_count = (uint32_t)get_uleb(r);
+        /* Merged modules keep the first layout they were given. */
+        if (ok && r->ok && !bc->mod->profile) {
+            bc->mod->profile = layout;
+        } else {
+            for (uint32_t i = 0; i < layout->func_count; i++) free(layout->funcs[i].name);
+            free(layout->funcs); free(layout->path); free(layout);
+            if (!ok || !r->ok) return false;
+        }
+    }
+    bc->func_count = get_count(r, 3);
+    bc->funcs = calloc(bc->func_count ? bc->func_count : 1, sizeof(BitcodeFunc));
+    if (!r->ok || !bc->funcs) return false;
+    for (uint32_t i = 0; i < bc->func_count; i++) {
+        uint64_t name = get_uleb(r);
+        bc->funcs[i].offset = get_uleb(r);
+        bc->funcs[i].size = get_uleb(r);
+        if (!r->ok || name == 0 || name > bc->string_count) return false;
+        bc->funcs[i].name = (uint32_t)name;
+    }
+    bc->bodies = r->p;
+    bc->bodies_size = (size_t)(r->end - r->p);
+    for (uint32_t i = 0; i < bc->func_count; i++)
+        if (bc->funcs[i].offset > bc->bodies_size ||
+            bc->funcs[i].size > bc->bodies_size - bc->funcs[i].offset)
+            return false;
+    return true;
+}
+
+/* State for decoding one function body. */
+typedef struct {
+    IrBitcode     *bc;
+    Reader         r;
+    IrFunction    *func;
+    IrValue      **temps;           /* by id */
+    uint32_t       temp_bound;
+    IrBasicBlock **blocks;          /* in emission order */
+    uint32_t       block_count;
+} Loader;
+
+static IrValue *get_operand(Loader *l) {
+    uint64_t ref = get_uleb(&l->r);
+    if (!l->r.ok) return NULL;
+    uint64_t index = ref >> REF_SHIFT;
+    IrValue *v = NULL;
+    switch (ref & ((1u << REF_SHIFT) - 1)) {
+        case REF_NONE:  if (index == 0) return NULL; break;
+        case REF_TEMP:  if (index < l->temp_bound) v = l->temps[index]; break;
+        case REF_PARAM: if (index < l->func->param_count) v = l->func->parameters[index]; break;
+        case REF_VALUE: if (index < l->bc->value_count) v = l->bc->values[index]; break;
+        case REF_LABEL: if (index < l->block_count) v = ir__value_label(l->blocks[index]); break;
+        default: break;
+    }
+    if (!v) l->r.ok = false;
+    return v;
+}
+
+static IrBasicBlock *get_block(Loader *l) {
+    uint64_t pos = get_uleb(&l->r);
+    if (!l->r.ok || pos >= l->block_count) { l->r.ok = false; return NULL; }
+    return l->blocks[pos];
+}
+
+static IrValue **get_operands(Loader *l, uint32_t count) {
+    IrValue **list = u__arena_alloc(&l->func->arena, (count ? count : 1) * sizeof(IrValue *));
+    if (!list) { l->r.ok = false; return NULL; }
+    for (uint32_t i = 0; i < count; i++) list[i] = get_operand(l);
+    return list;
+}
+
+static IrInstruction *read_instruction(Loader *l) {
+    Reader *r = &l->r;
+    IrFunction *func = l->func;
+    uint64_t op = get_uleb(r), line = get_uleb(r), column = get_uleb(r);
+    IrValue *res = get_operand(l), *op1 = get_operand(l), *op2 = get_operand(l);
+    bool has_extra = get_uleb(r) != 0;
+    if (!r->ok || op > IR_MEMCPY) { r->ok = false; return NULL; }
+    IrInstruction *inst = NULL;
+    if (!has_extra) {
+        inst = ir__inst_create(func, (IrOpcode)op, res, op1, op2);
+    } else if (op == IR_CALL) {
+        uint32_t argc = get_count(r, 1);
+        IrValue **args = get_operands(l, argc);
+        if (r->ok) inst = ir__inst_create_call(func, res, op1, args, argc);
+    } else if (op == IR_SELECT) {
+        IrValue *fv = get_operand(l);
+        if (r->ok) inst = ir__inst_create_select(func, res, op1, op2, fv);
+    } else if (op == IR_MEMSET || op == IR_MEMCPY) {
+        IrValue *count = get_operand(l);
+        uint32_t elem_size = (uint32_t)get_uleb(r);
+        if (r->ok) inst = ir__inst_create_mem(func, (IrOpcode)op, op1, op2, count, elem_size);
+    } else if (op == IR_GEP) {
+        IrGepExtra *gep = u__arena_alloc(&func->arena, sizeof(IrGepExtra));
+        if (!gep) { r->ok = false; return NULL; }
+        gep->index_count = get_count(r, 1);
+        gep->indices = get_operands(l, gep->index_count);
+        if (r->ok && (inst = ir__inst_create(func, IR_GEP, res, op1, op2))) inst->extra = gep;
+    } else if (op == IR_PHI) {
+        IrPhiExtra *phi = u__arena_alloc(&func->arena, sizeof(IrPhiExtra));
+        if (!phi) { r->ok = false; return NULL; }
+        phi->count = get_count(r, 2);
+        phi->values = u__arena_alloc(&func->arena, (phi->count ? phi->count : 1) * sizeof(IrValue *));
+        phi->blocks = u__arena_alloc(&func->arena, (phi->count ? phi->count : 1) * sizeof(IrBasicBlock *));
+        if (!phi->values || !phi->blocks) { r->ok = false; return NULL; }
+        for (uint32_t i = 0; i < phi->count; i++) {
+            phi->values[i] = get_operand(l);
+            phi->blocks[i] = get_block(l);
+        }
+        if (r->ok && (inst = ir__inst_create(func, IR_PHI, res, op1, op2))) inst->extra = phi;
+    } else if (op == IR_BRCOND) {
+        IrCondBranchExtra *br = u__arena_alloc(&func->arena, sizeof(IrCondBranchExtra));
+        if (!br) { r->ok = false; return NULL; }
+        br->true_target = get_block(l);
+        br->false_target = get_block(l);
+        if (r->ok && (inst = ir__inst_create(func, IR_BRCOND, res, op1, op2))) inst->extra = br;
+    } else {
+        r->ok = false;
+    }
+    if (!inst) { r->ok = false; return NULL; }
+    inst->line = (uint16_t)line;
+    inst->column = (uint16_t)column;
+    return inst;
+}
+
+/* Edges are linked in successor order, which fills the predecessor lists
+ * with the right blocks; a second pass puts those back in written order. */
+static bool read_edges(Loader *l) {
+    Reader *r = &l->r;
+    const uint8_t *start = r->p;
+    for (uint32_t i = 0; i < l->block_count && r->ok; i++) {
+        IrBasicBlock *bb = l->blocks[i];
+        uint32_t succs = get_count(r, 1);
+        for (uint32_t j = 0; j < succs && r->ok; j++) {
+            IrBasicBlock *s = get_block(l);
+            if (s) ir__block_link(bb, s);
+        }
+        if (r->ok && bb->succ_count != succs) r->ok = false;
+        uint32_t preds = get_count(r, 1);
+        for (uint32_t j = 0; j < preds && r->ok; j++) get_block(l);
+    }
+    r->p = start;
+    for (uint32_t i = 0; i < l->block_count && r->ok; i++) {
+        IrBasicBlock *bb = l->blocks[i];
+        uint32_t succs = get_count(r, 1);
+        for (uint32_t j = 0; j < succs && r->ok; j++) get_block(l);
+        uint32_t preds = get_count(r, 1);
+        if (r->ok && preds != bb->pred_count) r->ok = false;
+        for (uint32_t j = 0; j < preds && r->ok; j++) bb->predecessors[j] = get_block(l);
+    }
+    return r->ok;
+}
+
+static bool read_blocks(Loader *l, IrBuilder *b) {
+    Reader *r = &l->r;
+    IrFunction *func = l->func;
+    uint32_t next_block_id = func->next_block_id;
+    l->block_count = get_count(r, 5);
+    uint64_t entry = get_uleb(r);
+    if (!r->ok || l->block_count == 0 || entry >= l->block_count) return false;
+    l->blocks = calloc(l->block_count, sizeof(IrBasicBlock *));
+    if (!l->blocks) return false;
+    for (uint32_t i = 0; i < l->block_count && r->ok; i++) {
+        uint64_t id = get_uleb(r);
+        const char *label = get_string(l->bc, r);
+        if (!r->ok || id >= next_block_id) return false;
+        IrBasicBlock *bb;
+        if (i == entry) {
+            bb = func->entry_block;
+            bb->label = label ? label : bb->label;
+        } else {
+            func->next_block_id = (uint32_t)id;
+            bb = ir__builder_add_block(b, label, false);
+            if (!bb) return false;
+        }
+        bb->id = (uint32_t)id;
+        bb->align = (uint32_t)get_uleb(r);
+        bb->is_cold = get_uleb(r) != 0;
+        bb->exec_count = get_uleb(r);
+        l->blocks[i] = bb;
+    }
+    func->next_block_id = next_block_id;
+    if (!r->ok || func->block_count != l->block_count) return false;
+    memcpy(func->all_blocks, l->blocks, l->block_count * sizeof(IrBasicBlock *));
+    return true;
+}
+
+static bool read_body(Loader *l, IrBuilder *b) {
+    Reader *r = &l->r;
+    IrFunction *func = l->func;
+    for (uint32_t i = 0; i < func->param_count && r->ok; i++) {
+        uint64_t type = get_uleb(r);
+        Type *info = get_type(l->bc, r);
+        const char *name = get_string(l->bc, r);
+        IrValue *p = r->ok ? ir__value_param(func, i, (DataType)type, info) : NULL;
+        if (!p) return false;
+        p->name = name;
+        func->parameters[i] = p;
+    }
+    uint64_t flags = get_uleb(r);
+    func->has_profile = (flags & FUNC_FLAG_PROFILE) != 0;
+    func->is_internal = (flags & FUNC_FLAG_INTERNAL) != 0;
+    uint64_t next_temp_id = get_uleb(r), next_block_id = get_uleb(r);
+    if (!r->ok || next_temp_id > UINT32_MAX || next_block_id > UINT32_MAX) return false;
+    l->temp_bound = (uint32_t)next_temp_id;
+    l->temps = calloc(l->temp_bound ? l->temp_bound : 1, sizeof(IrValue *));
+    if (!l->temps) return false;
+    uint32_t temp_count = get_count(r, 3);
+    for (uint32_t i = 0; i < temp_count && r->ok; i++) {
+        uint64_t id = get_uleb(r), type = get_uleb(r);
+        Type *info = get_type(l->bc, r);
+        if (!r->ok || id >= l->temp_bound || l->temps[id]) return false;
+        func->next_temp_id = (uint32_t)id;
+        if (!(l->temps[id] = ir__value_temp(func, (DataType)type, info))) return false;
+    }
+    func->next_temp_id = l->temp_bound;
+    func->next_block_id = (uint32_t)next_block_id;
+    if (!r->ok || !read_blocks(l, b) || !read_edges(l)) return false;
+    for (uint32_t i = 0; i < l->block_count && r->ok; i++) {
+        uint32_t count = get_count(r, 7);
+        for (uint32_t j = 0; j < count && r->ok; j++) {
+            IrInstruction *inst = read_instruction(l);
+            if (inst) ir__inst_append(l->blocks[i], inst);
+        }
+    }
+    return r->ok && r->p == r->end;
+}
+
+static IrFunction *load_function(IrBitcode *bc, uint32_t index) {
+    BitcodeFunc *bf = &bc->funcs[index];
+    Loader l;
+    memset(&l, 0, sizeof(l));
+    l.bc = bc;
+    l.r = (Reader){ bc->bodies + bf->offset, bc->bodies + bf->offset + bf->size, true };
+    Reader *r = &l.r;
+    const char *name = string_at(bc, bf->name - 1);
+    uint64_t return_type = get_uleb(r);
+    Type *return_info = get_type(bc, r);
+    uint32_t param_count = get_count(r, 3);
+    IrBuilder *b = r->ok && name ? ir__builder_create(NULL) : NULL;
+    if (!b) return NULL;
+    b->module = bc->mod;
+    l.func = ir__builder_start_function(b, name, (DataType)return_type, return_info, param_count);
+    bool ok = l.func && read_body(&l, b);
+    ir__builder_destroy(b);
+    free(l.temps);
+    free(l.blocks);
+    if (!ok && l.func) {
+        ir__module_remove_function(bc->mod, l.func);
+        l.func = NULL;
+    }
+    if (!ok)
+        errhandler__report_error(ERROR_CODE_IO_READ, 0, 0, "bitcode",
+                                 "Malformed function %s in %s", name ? name : "?", bc->path);
+    return l.func;
+}
+
+IrBitcode *ir__read_bitcode(const char *path, IrModule *mod) {
+    if (!path || !mod) return NULL;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        errhandler__report_error(ERROR_CODE_IO_READ, 0, 0, "bitcode",
+                                 "Cannot open bitcode: %s", path);
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    IrBitcode *bc = calloc(1, sizeof(IrBitcode));
+    if (bc) {
+        bc->mod = mod;
+        bc->path = u__strdup_safe(path);
+        if (map != MAP_FAILED) { bc->map = map; bc->map_size = size; }
+    } else if (map != MAP_FAILED) {
+        munmap(map, size);
+    }
+    Reader r = { bc ? bc->map : NULL, bc && bc->map ? bc->map + size : NULL, true };
+    if (!bc || !bc->path || !bc->map || !read_tables(bc, &r)) {
+        errhandler__report_error(ERROR_CODE_IO_READ, 0, 0, "bitcode",
+                                 "Malformed or unreadable bitcode: %s", path);
+        ir__bitcode_close(bc);
+        return NULL;
+    }
+    return bc;
+}
+
+uint32_t ir__bitcode_function_count(const IrBitcode *bc) {
+    return bc ? bc->func_count : 0;
+}
+
+const char *ir__bitcode_function_name(IrBitcode *bc, uint32_t index) {
+    if (!bc || index >= bc->func_count) return NULL;
+    return string_at(bc, bc->funcs[index].name - 1);
+}
+
+uint32_t ir__bitcode_find_function(IrBitcode *bc, const char *name) {
+    if (!bc || !name) return UINT32_MAX;
+    size_t len = strlen(name);
+    for (uint32_t i = 0; i < bc->func_count; i++) {
+        uint32_t s = bc->funcs[i].name - 1;
+        if (bc->string_len[s] == len && memcmp(bc->string_data[s], name, len) == 0) return i;
+    }
+    return UINT32_MAX;
+}
+
+IrFunction *ir__bitcode_load_function(IrBitcode *bc, uint32_t index) {
+    if (!bc || index >= bc->func_count) return NULL;
+    if (!bc->funcs[index].loaded) bc->funcs[index].loaded = load_function(bc, index);
+    return bc->funcs[index].loaded;
+}
+
+bool ir__bitcode_load_all(IrBitcode *bc) {
+    if (!bc) return false;
+    for (uint32_t i = 0; i < bc->func_count; i++)
+        if (!ir__bitcode_load_function(bc, i)) return false;
+    return true;
+}
+
+void ir__bitcode_close(IrBitcode *bc) {
+    if (!bc) return;
+    if (bc->map) munmap((void *)bc->map, bc->map_size);
+    free(bc->path);
+    free(bc->string_data); free(bc->string_len); free(bc->interned);
+    free(bc->types); free(bc->values); free(bc->funcs);
+    free(bc);
+}
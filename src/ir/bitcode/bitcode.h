@@ -0,0 +1,64 @@
+#ifndef BITCODE_H
+#define BITCODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../ir.h"
+
+/* Conventional extension of bitcode files. */
+#define BITCODE_EXTENSION ".pxbc"
+
+/*
+ * Binary IR.  A bitcode file holds one module: a string table, the types
+ * and module-unique values (constants, globals, struct fields) the IR
+ * refers to, the profile layout of an instrumented module, and a directory
+ * of functions with the offset and size of each body, so a reader can
+ * materialise any function without decoding the others.
+ *
+ * File format (little endian; every number is ULEB128 unless marked):
+ *
+ *     "PXBC" version:u8
+ *     strings    count, per string: len bytes
+ *     types      count, per type: name pointer_level flags(1 ref, 2 array) width
+ *     values     count, per value: kind type type_ref payload
+ *                  (int: zigzag, real: u64 bits, char, global: name, field)
+ *     profile    0, or 1 path functions, per function:
+ *                  name checksum:u64 first_counter blocks; then counters
+ *     functions  count, per function: name offset size
+ *     bodies     function bodies, offsets counted from here
+ *
+ * String and type references are index + 1, 0 standing for NULL.  A body
+ * is its signature, its flags (1 profiled, 2 internal), its temps, its
+ * blocks in emission order with their edges, then each block's
+ * instructions.  Operands are (index << 3) | tag with tag 0 none, 1 temp
+ * id, 2 parameter, 3 module value, 4 block label.
+ *
+ * Temp and block ids are kept, so IR read back prints exactly as written.
+ * Types are read back as module-owned copies (ir__module_type).
+ */
+
+/* An open bitcode file: mapped, its tables decoded, bodies loaded on demand. */
+typedef struct IrBitcode IrBitcode;
+
+/* Write mod to path; false after reporting an error. */
+bool ir__write_bitcode(const IrModule *mod, const char *path);
+
+/*
+ * Map path and decode its tables into mod, typically a fresh
+ * ir__module_create(NULL).  Functions are only decoded when loaded, and
+ * are appended to mod in load order.  Not thread safe.  Returns NULL after
+ * reporting an error.
+ */
+IrBitcode  *ir__read_bitcode(const char *path, IrModule *mod);
+uint32_t    ir__bitcode_function_count(const IrBitcode *bc);
+const char *ir__bitcode_function_name(IrBitcode *bc, uint32_t index);
+/* Index of the function called name, or UINT32_MAX. */
+uint32_t    ir__bitcode_find_function(IrBitcode *bc, const char *name);
+/* Materialise one function (once; later calls return the same function). */
+IrFunction *ir__bitcode_load_function(IrBitcode *bc, uint32_t index);
+/* Materialise every function still on disk, in directory order. */
+bool        ir__bitcode_load_all(IrBitcode *bc);
+/* Unmap the file.  Functions already loaded stay in the module. */
+void        ir__bitcode_close(IrBitcode *bc);
+
+#endif
@@ -0,0 +1,86 @@
+#include "consteval.h"
+#include "../interp/interp.h"
+#include "../analysis/analysis.h"
+#include "../remark/remark.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* The module function inst calls directly, or NULL. */
+static const IrFunction *callee_of(const IrModule *mod, const IrInstruction *inst) {
+    const IrValue *target = inst->operand1;
+    if (!target || target->kind != IR_VALUE_GLOBAL_SYMBOL) return NULL;
+    for (uint32_t i = 0; i < mod->func_count; i++)
+        if (mod->functions[i]->name == target->name) return mod->functions[i];
+    return NULL;
+}
+
+static bool constant_argument(const IrValue *v, InterpValue *out) {
+    if (!v) return false;
+    switch (v->kind) {
+        case IR_VALUE_CONST_INT:  *out = (InterpValue){ false, v->const_data.int_val, 0.0 }; return true;
+        case IR_VALUE_CONST_CHAR: *out = (InterpValue){ false, (unsigned char)v->const_data.char_val, 0.0 }; return true;
+        case IR_VALUE_CONST_REAL: *out = (InterpValue){ true, 0, v->const_data.real_val }; return true;
+        default:                  return false;
+    }
+}
+
+/* Constant of the callee's return type holding r. */
+static IrValue *result_constant(IrModule *mod, const IrFunction *callee, const InterpValue *r) {
+    switch (ir__datatype_of(callee->return_type_info)) {
+        case TYPE_REAL: return ir__value_const_real(mod, r->is_real ? r->r : (double)r->i);
+        case TYPE_CHAR: return ir__value_const_char(mod, (char)r->i);
+        default:        return ir__value_const_int(mod, r->is_real ? (int64_t)r->r : r->i);
+    }
+}
+
+/* Evaluate inst if it can be; returns its value or NULL. */
+static IrValue *evaluate(IrInterp **in, IrModule *mod, const IrInstruction *inst) {
+    const IrFunction *callee = callee_of(mod, inst);
+    const IrCallExtra *call = inst->extra;
+    if (!callee || !inst->result || !call) return NULL;
+    InterpValue *args = malloc((call->arg_count ? call->arg_count : 1) * sizeof(InterpValue));
+    if (!args) return NULL;
+    bool constant = true;
+    for (uint32_t i = 0; i < call->arg_count && constant; i++)
+        constant = constant_argument(call->args[i], &args[i]);
+    IrValue *value = NULL;
+    if (constant) {
+        if (!*in) {
+            InterpOptions opts = { true, INTERP_CONST_EVAL_FUEL, NULL };
+            *in = interp__create(mod, &opts);
+        }
+        InterpValue r;
+        if (*in && interp__call(*in, callee, args, call->arg_count, &r) == INTERP_RETURNED)
+            value = result_constant(mod, callee, &r);
+    }
+    free(args);
+    return value;
+}
+
+uint32_t consteval__fold_module(IrModule *mod) {
+    IrInterp *in = NULL;
+    uint32_t folded = 0;
+    for (uint32_t f = 0; f < mod->func_count; f++) {
+        IrFunction *func = mod->functions[f];
+        bool changed = false;
+        for (uint32_t b = 0; b < func->block_count; b++) {
+            IrInstruction *next;
+            for (IrInstruction *inst = func->all_blocks[b]->first_inst; inst; inst = next) {
+                next = inst->next;
+                if (inst->opcode != IR_CALL || !(inst->flags & IR_INST_CONST_INIT)) continue;
+                IrValue *value = evaluate(&in, mod, inst);
+                if (!value) continue;
+                char buf[64];
+                remark__emit("consteval", inst, "evaluated call to '%s' at compile time: %s",
+                             inst->operand1->name, ir__value_format(buf, sizeof buf, value));
+                ir__replace_all_uses_with(inst->result, value);
+                ir__inst_destroy(inst);
+                folded++;
+                changed = true;
+            }
+        }
+        if (changed) analysis__invalidate(func, IR_PRESERVE_CFG);
+    }
+    interp__destroy(in);
+    return folded;
+}
@@ -0,0 +1,22 @@
+#ifndef CONSTEVAL_H
+#define CONSTEVAL_H
+
+#include <stdint.h>
+#include "../ir.h"
+
+/*
+ * Compile-time evaluation of const initializers.  A call marked
+ * IR_INST_CONST_INIT whose arguments are all constants and whose callee is
+ * defined in the module is run in a sandboxed interpreter; when it returns
+ * within INTERP_CONST_EVAL_FUEL steps, its result is replaced by the
+ * constant and the call removed.  A sandboxed callee cannot reach anything
+ * but its own locals, so a call that finishes has no other effect.  Calls
+ * that trap, run out of steps or need the runtime are left to run as
+ * usual.
+ *
+ * Each call folded is reported under -Rpass=consteval.  Returns the number
+ * of calls folded.
+ */
+uint32_t consteval__fold_module(IrModule *mod);
+
+#endif
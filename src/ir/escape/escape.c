@@ -0,0 +1,314 @@
+#include "escape.h"
+#include "../alias/alias.h"
+#include "../remark/remark.h"
+#include "../../errhandler/errhandler.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Alignment given to a converted slot when alloc's is not a constant. */
+#define ESCAPE_DEFAULT_ALIGN 16
+/* Deepest select/phi chain followed when bounding an allocation size. */
+#define ESCAPE_MAX_SIZE_DEPTH 4
+
+typedef struct {
+    IrValue **items;
+    uint32_t  count, capacity;
+} ValueSet;
+
+/* One alloc call being considered, with every value known to hold its
+ * address (exact), to point inside it (derived), and the local slots that
+ * hold nothing but its address. */
+typedef struct {
+    IrFunction    *func;
+    AliasInfo     *ai;
+    IrInstruction *site;
+    ValueSet       exact, derived, slots;
+    bool           escapes;
+} Candidate;
+
+static bool value_set_contains(const ValueSet *set, const IrValue *v) {
+    for (uint32_t i = 0; i < set->count; i++)
+        if (set->items[i] == v) return true;
+    return false;
+}
+
+static bool value_set_add(ValueSet *set, IrValue *v) {
+    if (value_set_contains(set, v)) return false;
+    if (set->count >= set->capacity) {
+        uint32_t new_cap = set->capacity ? set->capacity * 2 : 8;
+        IrValue **new_items = realloc(set->items, new_cap * sizeof(IrValue *));
+        if (!new_items) {
+            errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "escape",
+                                     "Failed to grow value set");
+            return false;
+        }
+        set->items = new_items;
+        set->capacity = new_cap;
+    }
+    set->items[set->count++] = v;
+    return true;
+}
+
+static bool bounded_size(const AliasInfo *ai, const IrValue *v, uint32_t depth, uint64_t *out) {
+    if (!v || depth > ESCAPE_MAX_SIZE_DEPTH) return false;
+    if (v->kind == IR_VALUE_CONST_INT) {
+        if (v->const_data.int_val < 0) return false;
+        *out = (uint64_t)v->const_data.int_val;
+        return true;
+    }
+    IrInstruction *def = alias__definition(ai, v);
+    if (!def) return false;
+    uint64_t a = 0, b = 0;
+    switch (def->opcode) {
+        case IR_SELECT: {
+            IrSelectExtra *sel = def->extra;
+            if (!sel || !bounded_size(ai, def->operand2, depth + 1, &a) ||
+                !bounded_size(ai, sel->false_value, depth + 1, &b))
+                return false;
+            *out = a > b ? a : b;
+            return true;
+        }
+        case IR_PHI: {
+            IrPhiExtra *phi = def->extra;
+            if (!phi || phi->count == 0) return false;
+            *out = 0;
+            for (uint32_t i = 0; i < phi->count; i++) {
+                if (!bounded_size(ai, phi->values[i], depth + 1, &a)) return false;
+                if (a > *out) *out = a;
+            }
+            return true;
+        }
+        case IR_CAST:
+            return bounded_size(ai, def->operand1, depth + 1, out);
+        default:
+            return false;
+    }
+}
+
+static bool tracked(const Candidate *c, const IrValue *v) {
+    return v && (value_set_contains(&c->exact, v) || value_set_contains(&c->derived, v));
+}
+
+typedef struct {
+    Candidate     *cand;
+    IrInstruction *inst;
+} UseScan;
+
+/* Fallback for instructions with no specific rule: any use escapes. */
+static void use_escapes(IrValue **slot, void *ctx) {
+    UseScan *scan = ctx;
+    if (tracked(scan->cand, *slot) || value_set_contains(&scan->cand->slots, *slot))
+        scan->cand->escapes = true;
+}
+
+static bool is_local_slot(const Candidate *c, const IrValue *ptr) {
+    IrInstruction *def = alias__definition(c->ai, ptr);
+    return def && def->opcode == IR_ALLOCA;
+}
+
+/* Classify every use of the candidate's address.  Returns true if any set
+ * grew, so the caller iterates until a fixed point. */
+static bool scan_uses(Candidate *c, IrInstruction *inst) {
+    bool changed = false;
+    switch (inst->opcode) {
+        case IR_LOAD:
+            if (value_set_contains(&c->slots, inst->operand1) && inst->result)
+                changed = value_set_add(&c->exact, inst->result);
+            return changed;
+        case IR_STORE:
+            if (value_set_contains(&c->slots, inst->operand2) ||
+                value_set_contains(&c->derived, inst->operand2)) {
+                c->escapes = true;
+            } else if (value_set_contains(&c->exact, inst->operand2)) {
+                if (!is_local_slot(c, inst->operand1)) c->escapes = true;
+                else changed = value_set_add(&c->slots, inst->operand1);
+            } else if (value_set_contains(&c->slots, inst->operand1)) {
+                c->escapes = true;      /* the slot holds something else too */
+            }
+            return changed;
+        case IR_GEP:
+        case IR_CAST:
+            if (value_set_contains(&c->slots, inst->operand1)) { c->escapes = true; return false; }
+            if (inst->opcode == IR_GEP) {
+                IrGepExtra *gep = inst->extra;
+                if (tracked(c, inst->operand2)) c->escapes = true;
+                for (uint32_t i = 0; gep && i < gep->index_count; i++)
+                    if (tracked(c, gep->indices[i])) c->escapes = true;
+            }
+            if (tracked(c, inst->operand1) && inst->result) {
+                bool exact = inst->opcode == IR_CAST && value_set_contains(&c->exact, inst->operand1);
+                changed = value_set_add(exact ? &c->exact : &c->derived, inst->result);
+            }
+            return changed;
+        case IR_MEMSET:
+        case IR_MEMCPY: {
+            IrMemExtra *mem = inst->extra;
+            if (value_set_contains(&c->slots, inst->operand1) ||
+                value_set_contains(&c->slots, inst->operand2) ||
+                (mem && tracked(c, mem->count)))
+                c->escapes = true;
+            /* The source of a copy is read through, not stored. */
+            if (inst->opcode == IR_MEMSET && tracked(c, inst->operand2)) c->escapes = true;
+            return false;
+        }
+        case IR_CALL:
+            if (inst == c->site) return false;
+            if (ir__inst_is_call_to(inst, IR_RUNTIME_FREE)) {
+                IrCallExtra *call = inst->extra;
+                for (uint32_t i = 0; call && i < call->arg_count; i++)
+                    if (value_set_contains(&c->derived, call->args[i]) ||
+                        value_set_contains(&c->slots, call->args[i]))
+                        c->escapes = true;
+                return false;
+            }
+            break;
+        default:
+            break;
+    }
+    UseScan scan = { c, inst };
+    ir__inst_for_each_operand(inst, use_escapes, &scan);
+    return false;
+}
+
+static bool does_not_escape(Candidate *c) {
+    value_set_add(&c->exact, c->site->result);
+    bool changed;
+    do {
+        changed = false;
+        for (uint32_t i = 0; i < c->func->block_count && !c->escapes; i++)
+            for (IrInstruction *inst = c->func->all_blocks[i]->first_inst;
+                 inst && !c->escapes; inst = inst->next)
+                if (scan_uses(c, inst)) changed = true;
+    } while (changed && !c->escapes);
+    return !c->escapes;
+}
+
+static bool is_free_of(const Candidate *c, const IrInstruction *inst) {
+    if (!ir__inst_is_call_to(inst, IR_RUNTIME_FREE)) return false;
+    IrCallExtra *call = inst->extra;
+    return call && call->arg_count == 1 && value_set_contains(&c->exact, call->args[0]);
+}
+
+/* Scan to the end of a block: 1 if the allocation is freed, -1 if the
+ * function returns or the allocation runs again first, 0 otherwise. */
+static int scan_path(const Candidate *c, const IrInstruction *inst) {
+    for (; inst; inst = inst->next) {
+        if (inst == c->site || inst->opcode == IR_RET) return -1;
+        if (is_free_of(c, inst)) return 1;
+    }
+    return 0;
+}
+
+static bool freed_on_all_paths(const Candidate *c) {
+    IrBasicBlock *start = c->site->parent;
+    int r = scan_path(c, c->site->next);
+    if (r != 0) return r > 0;
+    if (start->succ_count == 0) return false;
+
+    uint32_t n = c->func->next_block_id;
+    bool *visited = calloc(n ? n : 1, sizeof(bool));
+    IrBasicBlock **stack = malloc((c->func->block_count + 1) * sizeof(IrBasicBlock *));
+    if (!visited || !stack) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "escape",
+                                 "Failed to allocate path search state");
+        free(visited); free(stack);
+        return false;
+    }
+    uint32_t top = 0;
+    bool ok = true;
+    for (uint32_t i = 0; i < start->succ_count; i++) {
+        IrBasicBlock *s = start->successors[i];
+        if (s->id < n && !visited[s->id]) { visited[s->id] = true; stack[top++] = s; }
+    }
+    while (top > 0 && ok) {
+        IrBasicBlock *bb = stack[--top];
+        r = scan_path(c, bb->first_inst);
+        if (r > 0) continue;
+        if (r < 0 || bb->succ_count == 0) { ok = false; break; }
+        for (uint32_t i = 0; i < bb->succ_count; i++) {
+            IrBasicBlock *s = bb->successors[i];
+            if (s->id < n && !visited[s->id]) { visited[s->id] = true; stack[top++] = s; }
+        }
+    }
+    free(visited);
+    free(stack);
+    return ok;
+}
+
+static void convert(Candidate *c, uint64_t bytes) {
+    IrCallExtra *call = c->site->extra;
+    IrValue *align = call->args[1];
+    if (!align || align->kind != IR_VALUE_CONST_INT || align->const_data.int_val <= 0)
+        align = ir__value_const_int(c->func->module, ESCAPE_DEFAULT_ALIGN);
+    IrValue *ptr = c->site->result;
+    IrInstruction *slot = ir__inst_create(c->func, IR_ALLOCA, ptr,
+                                         ir__value_const_int(c->func->module, (int64_t)bytes), align);
+    if (!slot) return;
+    slot->line = c->site->line;
+    slot->column = c->site->column;
+
+    char name[32];
+    remark__emit("heap2stack", c->site, "moved %llu-byte allocation %s in '%s' to the stack",
+                 (unsigned long long)bytes, ir__value_format(name, sizeof(name), ptr), c->func->name);
+
+    IrBasicBlock *entry = c->func->entry_block;
+    if (entry->first_inst) ir__inst_insert_before(entry->first_inst, slot);
+    else ir__inst_append(entry, slot);
+    ir__inst_destroy(c->site);
+
+    for (uint32_t i = 0; i < c->func->block_count; i++) {
+        IrInstruction *next;
+        for (IrInstruction *inst = c->func->all_blocks[i]->first_inst; inst; inst = next) {
+            next = inst->next;
+            if (is_free_of(c, inst)) ir__inst_destroy(inst);
+        }
+    }
+}
+
+uint32_t escape__heap_to_stack(IrFunction *func, uint64_t max_bytes) {
+    if (!func || !func->entry_block) return 0;
+    uint32_t site_count = 0;
+    for (uint32_t i = 0; i < func->block_count; i++)
+        for (IrInstruction *inst = func->all_blocks[i]->first_inst; inst; inst = inst->next)
+            if (ir__inst_is_call_to(inst, IR_RUNTIME_ALLOC) && inst->result) site_count++;
+    if (site_count == 0) return 0;
+
+    IrInstruction **sites = malloc(site_count * sizeof(IrInstruction *));
+    if (!sites) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "escape",
+                                 "Failed to allocate allocation site list");
+        return 0;
+    }
+    site_count = 0;
+    for (uint32_t i = 0; i < func->block_count; i++)
+        for (IrInstruction *inst = func->all_blocks[i]->first_inst; inst; inst = inst->next)
+            if (ir__inst_is_call_to(inst, IR_RUNTIME_ALLOC) && inst->result) sites[site_count++] = inst;
+
+    uint32_t converted = 0;
+    AliasInfo *ai = alias__analyze(func);
+    for (uint32_t s = 0; s < site_count && ai; s++) {
+        IrCallExtra *call = sites[s]->extra;
+        uint64_t bytes = 0;
+        if (!call || call->arg_count < 2 || !bounded_size(ai, call->args[0], 0, &bytes) ||
+            bytes == 0 || bytes > max_bytes)
+            continue;
+        Candidate c;
+        memset(&c, 0, sizeof(c));
+        c.func = func;
+        c.ai = ai;
+        c.site = sites[s];
+        if (does_not_escape(&c) && freed_on_all_paths(&c)) {
+            convert(&c, bytes);
+            converted++;
+            /* The site's definition changed under the alias tables. */
+            alias__destroy(ai);
+            ai = alias__analyze(func);
+        }
+        free(c.exact.items);
+        free(c.derived.items);
+        free(c.slots.items);
+    }
+    alias__destroy(ai);
+    free(sites);
+    return converted;
+}
@@ -0,0 +1,26 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+#include <stdint.h>
+#include "../ir.h"
+
+/* Largest allocation moved to the stack, in bytes. */
+#define ESCAPE_DEFAULT_MAX_BYTES 1024
+
+/*
+ * Heap-to-stack conversion.  An alloc(size, align) call is replaced by an
+ * alloca in the entry block, and its matching free calls are deleted, when
+ *
+ *   - size is a constant, or a select/phi over constants, of at most
+ *     max_bytes;
+ *   - the address never escapes: it is only dereferenced, offset, freed,
+ *     or kept in private local slots that hold nothing else;
+ *   - every path from the allocation reaches a free of it before the
+ *     function returns or the allocation runs again.
+ *
+ * Each converted site is reported under -Rpass=heap2stack.  Returns the
+ * number of allocations converted.
+ */
+uint32_t escape__heap_to_stack(IrFunction *func, uint64_t max_bytes);
+
+#endif
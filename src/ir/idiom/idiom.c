@@ -0,0 +1,368 @@
+#include "idiom.h"
+#include "../alias/alias.h"
+#include "../analysis/analysis.h"
+#include "../remark/remark.h"
+#include "../../errhandler/errhandler.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Address arithmetic in the body: the destination and, for a copy, the source. */
+#define IDIOM_MAX_GEPS 2
+
+typedef struct {
+    IrValue **items;
+    uint32_t  count, capacity;
+} ValueSet;
+
+/* One candidate loop.  pre jumps to header, which tests the induction
+ * variable and either enters body or leaves to exit. */
+typedef struct {
+    IrFunction    *func;
+    AliasInfo     *ai;
+    IrBasicBlock  *pre, *header, *body, *exit;
+    IrValue       *slot;        /* private slot holding the induction variable */
+    IrValue       *limit;
+    IrValue       *next;        /* induction variable plus one */
+    ValueSet       iv;          /* loads of slot before it is updated */
+    ValueSet       defined;     /* every value defined inside the loop */
+    IrInstruction *geps[IDIOM_MAX_GEPS];
+    uint32_t       gep_count;
+    IrInstruction *src_load, *elem_store;
+    bool           updated;
+} Loop;
+
+static bool value_set_contains(const ValueSet *set, const IrValue *v) {
+    for (uint32_t i = 0; i < set->count; i++)
+        if (set->items[i] == v) return true;
+    return false;
+}
+
+static bool value_set_add(ValueSet *set, IrValue *v) {
+    if (value_set_contains(set, v)) return true;
+    if (set->count >= set->capacity) {
+        uint32_t new_cap = set->capacity ? set->capacity * 2 : 8;
+        IrValue **new_items = realloc(set->items, new_cap * sizeof(IrValue *));
+        if (!new_items) {
+            errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "idiom",
+                                     "Failed to grow value set");
+            return false;
+        }
+        set->items = new_items;
+        set->capacity = new_cap;
+    }
+    set->items[set->count++] = v;
+    return true;
+}
+
+static bool is_private_slot(const Loop *l, IrValue *ptr) {
+    IrInstruction *def = alias__definition(l->ai, ptr);
+    if (!def || def->opcode != IR_ALLOCA) return false;
+    MemLoc loc;
+    memset(&loc, 0, sizeof(loc));
+    loc.kind = MEMLOC_STACK;
+    loc.base = ptr;
+    return alias__is_private(l->ai, &loc);
+}
+
+/* Defined before the loop, or reloaded each iteration from a slot the loop
+ * never writes (the only slot it writes is the induction variable). */
+static bool is_invariant(const Loop *l, IrValue *v) {
+    if (!v || v->kind == IR_VALUE_LABEL || v->kind == IR_VALUE_NONE) return false;
+    if (v->kind != IR_VALUE_TEMP || !value_set_contains(&l->defined, v)) return true;
+    IrInstruction *def = alias__definition(l->ai, v);
+    return def && def->opcode == IR_LOAD && def->operand1 != l->slot &&
+           is_private_slot(l, def->operand1);
+}
+
+static IrInstruction *gep_of(const Loop *l, const IrValue *v) {
+    for (uint32_t i = 0; i < l->gep_count; i++)
+        if (l->geps[i]->result == v) return l->geps[i];
+    return NULL;
+}
+
+static bool shape_matches(Loop *l, IrBasicBlock *header) {
+    if (header->pred_count != 2 || header == l->func->entry_block) return false;
+    IrInstruction *br = ir__block_terminator(header);
+    if (!br || br->opcode != IR_BRCOND || !br->extra) return false;
+    IrCondBranchExtra *targets = br->extra;
+    IrBasicBlock *body = targets->true_target, *exit = targets->false_target;
+    if (!body || !exit || body == exit || body == header || exit == header) return false;
+    if (body->pred_count != 1 || body->succ_count != 1 || body->successors[0] != header) return false;
+    IrInstruction *back = ir__block_terminator(body);
+    if (!back || back->opcode != IR_BR) return false;
+    IrBasicBlock *pre = header->predecessors[0] == body ? header->predecessors[1]
+                                                        : header->predecessors[0];
+    if (pre == body || pre == exit || pre->succ_count != 1) return false;
+    IrInstruction *jmp = ir__block_terminator(pre);
+    if (!jmp || jmp->opcode != IR_BR) return false;
+    for (IrInstruction *inst = exit->first_inst; inst; inst = inst->next)
+        if (inst->opcode == IR_PHI) return false;
+    l->pre = pre; l->header = header; l->body = body; l->exit = exit;
+    return true;
+}
+
+/* Header: loads of private slots, the exit test and the branch. */
+static bool scan_header(Loop *l) {
+    IrInstruction *br = ir__block_terminator(l->header);
+    IrInstruction *cmp = alias__definition(l->ai, br->operand1);
+    if (!cmp || cmp->parent != l->header || cmp->opcode != IR_LT) return false;
+    IrInstruction *iv = alias__definition(l->ai, cmp->operand1);
+    if (!iv || iv->parent != l->header || iv->opcode != IR_LOAD ||
+        !is_private_slot(l, iv->operand1) || iv->result->type != TYPE_INT)
+        return false;
+    l->slot = iv->operand1;
+    l->limit = cmp->operand2;
+    for (IrInstruction *inst = l->header->first_inst; inst; inst = inst->next) {
+        if (inst == cmp || inst == br || inst->opcode == IR_NOP) continue;
+        if (inst->opcode != IR_LOAD || !is_private_slot(l, inst->operand1)) return false;
+        if (inst->operand1 == l->slot && !value_set_add(&l->iv, inst->result)) return false;
+    }
+    return true;
+}
+
+/* Body: one element store through p[i], optionally fed by one load of
+ * s[i], and the increment of the induction variable. */
+static bool scan_body(Loop *l) {
+    for (IrInstruction *inst = l->body->first_inst; inst; inst = inst->next) {
+        switch (inst->opcode) {
+            case IR_NOP:
+            case IR_BR:
+                break;
+            case IR_LOAD:
+                if (is_private_slot(l, inst->operand1)) {
+                    if (inst->operand1 == l->slot &&
+                        (l->updated || !value_set_add(&l->iv, inst->result)))
+                        return false;
+                } else if (gep_of(l, inst->operand1) && !l->src_load) {
+                    l->src_load = inst;
+                } else {
+                    return false;
+                }
+                break;
+            case IR_GEP:
+                if (inst->extra || l->gep_count >= IDIOM_MAX_GEPS) return false;
+                if (!value_set_contains(&l->iv, inst->operand2)) return false;
+                l->geps[l->gep_count++] = inst;
+                break;
+            case IR_ADD: {
+                IrValue *a = inst->operand1, *b = inst->operand2;
+                if (l->next) return false;
+                if (b && b->kind != IR_VALUE_CONST_INT) { IrValue *t = a; a = b; b = t; }
+                if (!b || b->kind != IR_VALUE_CONST_INT || b->const_data.int_val != 1 ||
+                    !value_set_contains(&l->iv, a))
+                    return false;
+                l->next = inst->result;
+                break;
+            }
+            case IR_STORE:
+                if (inst->operand1 == l->slot) {
+                    if (l->updated || !l->next || inst->operand2 != l->next) return false;
+                    l->updated = true;
+                } else if (gep_of(l, inst->operand1) && !l->elem_store) {
+                    l->elem_store = inst;
+                } else {
+                    return false;
+                }
+                break;
+            default:
+                return false;
+        }
+    }
+    return l->updated && l->elem_store;
+}
+
+typedef struct {
+    const ValueSet *defined;
+    bool            used;
+} UseScan;
+
+static void check_use(IrValue **slot, void *ctx) {
+    UseScan *scan = ctx;
+    if (value_set_contains(scan->defined, *slot)) scan->used = true;
+}
+
+/* Values computed by the loop disappear with it. */
+static bool used_outside(const Loop *l) {
+    UseScan scan = { &l->defined, false };
+    for (uint32_t i = 0; i < l->func->block_count && !scan.used; i++) {
+        IrBasicBlock *bb = l->func->all_blocks[i];
+        if (bb == l->header || bb == l->body) continue;
+        for (IrInstruction *inst = bb->first_inst; inst && !scan.used; inst = inst->next)
+            ir__inst_for_each_operand(inst, check_use, &scan);
+    }
+    return scan.used;
+}
+
+/* An invariant loaded inside the loop is reloaded in the preheader. */
+static IrValue *materialize(const Loop *l, IrValue *v, IrInstruction *pos) {
+    if (v->kind != IR_VALUE_TEMP || !value_set_contains(&l->defined, v)) return v;
+    IrInstruction *def = alias__definition(l->ai, v);
+    IrValue *copy = ir__value_temp(l->func, v->type, v->type_info);
+    IrInstruction *ld = ir__inst_create(l->func, IR_LOAD, copy, def->operand1, NULL);
+    if (!ld) return NULL;
+    ir__inst_insert_before(pos, ld);
+    return copy;
+}
+
+static IrValue *emit_before(IrInstruction *pos, IrInstruction *inst) {
+    if (!inst) return NULL;
+    ir__inst_insert_before(pos, inst);
+    return inst->result;
+}
+
+/* The constant the preheader last stored to the induction variable, if
+ * any.  The slot is private, so only a direct store writes it. */
+static bool known_start(const Loop *l, const IrInstruction *pos, int64_t *out) {
+    for (const IrInstruction *inst = pos->prev; inst; inst = inst->prev) {
+        if (inst->opcode == IR_CALL || inst->opcode == IR_MEMSET || inst->opcode == IR_MEMCPY) return false;
+        if (inst->opcode != IR_STORE || inst->operand1 != l->slot) continue;
+        if (!inst->operand2 || inst->operand2->kind != IR_VALUE_CONST_INT) return false;
+        *out = inst->operand2->const_data.int_val;
+        return true;
+    }
+    return false;
+}
+
+static bool replace_loop(Loop *l, IrInstruction *dst_gep, IrInstruction *src_gep, IrValue *fill, uint32_t elem_size) {
+    IrFunction *func = l->func;
+    IrInstruction *pos = ir__block_terminator(l->pre);
+    IrValue *iv = l->iv.items[0];
+
+    /* count = n > i ? n - i : 0, so a loop that never runs stays a no-op.
+     * With both bounds known it is a constant, which the code generators
+     * expand inline when small. */
+    IrValue *start, *runs, *count, *limit = l->limit, *final = NULL;
+    int64_t first;
+    if (l->limit->kind == IR_VALUE_CONST_INT && known_start(l, pos, &first)) {
+        int64_t n = l->limit->const_data.int_val;
+        start = ir__value_const_int(func->module, first);
+        runs = ir__value_const_int(func->module, n > first);
+        count = ir__value_const_int(func->module, n > first ? n - first : 0);
+        final = ir__value_const_int(func->module, n > first ? n : first);
+    } else {
+        start = emit_before(pos, ir__inst_create(func, IR_LOAD,
+            ir__value_temp(func, iv->type, iv->type_info), l->slot, NULL));
+        limit = materialize(l, l->limit, pos);
+        if (!start || !limit) return false;
+        runs = emit_before(pos, ir__inst_create(func, IR_GT,
+            ir__value_temp(func, TYPE_INT, NULL), limit, start));
+        IrValue *span = emit_before(pos, ir__inst_create(func, IR_SUB,
+            ir__value_temp(func, iv->type, iv->type_info), limit, start));
+        if (!runs || !span) return false;
+        count = emit_before(pos, ir__inst_create_select(func,
+            ir__value_temp(func, iv->type, iv->type_info), runs, span, ir__value_const_int(func->module, 0)));
+    }
+    IrValue *dst_base = materialize(l, dst_gep->operand1, pos);
+    if (!count || !dst_base) return false;
+    IrValue *dst = emit_before(pos, ir__inst_create(func, IR_GEP,
+        ir__value_temp(func, TYPE_POINTER, dst_base->type_info), dst_base, start));
+    IrValue *src = fill ? materialize(l, fill, pos) : NULL;
+    if (src_gep) {
+        IrValue *src_base = materialize(l, src_gep->operand1, pos);
+        if (!src_base) return false;
+        src = emit_before(pos, ir__inst_create(func, IR_GEP,
+            ir__value_temp(func, TYPE_POINTER, src_base->type_info), src_base, start));
+    }
+    if (!dst || !src) return false;
+    IrInstruction *mem = ir__inst_create_mem(func, src_gep ? IR_MEMCPY : IR_MEMSET, dst, src, count, elem_size);
+    if (!mem) return false;
+    mem->line = l->elem_store->line;
+    mem->column = l->elem_store->column;
+    ir__inst_insert_before(pos, mem);
+    if (!final)
+        final = emit_before(pos, ir__inst_create_select(func,
+            ir__value_temp(func, iv->type, iv->type_info), runs, limit, start));
+    IrInstruction *st = final ? ir__inst_create(func, IR_STORE, NULL, l->slot, final) : NULL;
+    if (!st) return false;
+    ir__inst_insert_before(pos, st);
+
+    remark__emit("loop-idiom", l->elem_store, "replaced %s loop in '%s' with %s of %u-byte elements",
+                 src_gep ? "copy" : "fill", func->name, src_gep ? "memcpy" : "memset", elem_size);
+
+    IrInstruction *jmp = ir__inst_create(func, IR_BR, NULL, ir__value_label(l->exit), NULL);
+    if (!jmp) return false;
+    ir__inst_destroy(pos);
+    ir__inst_append(l->pre, jmp);
+    ir__block_unlink(l->pre, l->header);
+    ir__block_link(l->pre, l->exit);
+    ir__function_remove_block(func, l->body);
+    ir__function_remove_block(func, l->header);
+    return true;
+}
+
+/* Classify the loop as a fill or a copy and check every operand the
+ * replacement needs is available in the preheader. */
+static bool match_idiom
+    ( Loop *l
+    , IrInstruction **dst_gep
+    , IrInstruction **src_gep
+    , IrValue **fill
+    , uint32_t *elem_size
+) {
+    IrBasicBlock *blocks[2] = { l->header, l->body };
+    for (int i = 0; i < 2; i++)
+        for (IrInstruction *inst = blocks[i]->first_inst; inst; inst = inst->next)
+            if (inst->result && !value_set_add(&l->defined, inst->result)) return false;
+    if (!scan_header(l) || !scan_body(l) || !is_invariant(l, l->limit)) return false;
+
+    *dst_gep = gep_of(l, l->elem_store->operand1);
+    if (l->src_load && l->elem_store->operand2 == l->src_load->result) {
+        *src_gep = gep_of(l, l->src_load->operand1);
+        if (*src_gep == *dst_gep || l->gep_count != 2) return false;
+    } else {
+        *fill = l->elem_store->operand2;
+        if (l->src_load || l->gep_count != 1 || !is_invariant(l, *fill)) return false;
+    }
+    for (uint32_t i = 0; i < l->gep_count; i++)
+        if (!is_invariant(l, l->geps[i]->operand1)) return false;
+
+    *elem_size = ir__pointee_size((*dst_gep)->operand1->type_info);
+    if (*src_gep && ir__pointee_size((*src_gep)->operand1->type_info) != *elem_size) return false;
+    /* A fill repeats one scalar; only zero has the same bytes at any width. */
+    bool zero = *fill && (*fill)->kind == IR_VALUE_CONST_INT && (*fill)->const_data.int_val == 0;
+    if (*fill && !zero && *elem_size != 1 && *elem_size != 2 && *elem_size != 4 && *elem_size != 8)
+        return false;
+    return !used_outside(l);
+}
+
+static bool try_replace(IrFunction *func, AliasInfo *ai, IrBasicBlock *header) {
+    Loop l;
+    memset(&l, 0, sizeof(l));
+    l.func = func;
+    l.ai = ai;
+    IrInstruction *dst_gep = NULL, *src_gep = NULL;
+    IrValue *fill = NULL;
+    uint32_t elem_size = 0;
+    bool done = shape_matches(&l, header) &&
+                match_idiom(&l, &dst_gep, &src_gep, &fill, &elem_size) &&
+                replace_loop(&l, dst_gep, src_gep, fill, elem_size);
+    free(l.iv.items);
+    free(l.defined.items);
+    return done;
+}
+
+uint32_t idiom__run_function(IrFunction *func) {
+    if (!func) return 0;
+    uint32_t replaced = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        const IrLoopInfo *loops = analysis__loops(func);
+        if (!loops) return replaced;
+        AliasInfo *ai = alias__analyze(func);
+        if (!ai) return replaced;
+        for (uint32_t i = 0; i < func->block_count; i++) {
+            IrBasicBlock *bb = func->all_blocks[i];
+            if (!analysis__loop_of_header(loops, bb)) continue;
+            if (try_replace(func, ai, bb)) {
+                /* The loop's blocks are gone. */
+                analysis__invalidate(func, IR_PRESERVE_NONE);
+                replaced++;
+                changed = true;
+                break;
+            }
+        }
+        alias__destroy(ai);
+    }
+    return replaced;
+}
@@ -0,0 +1,23 @@
+#ifndef IDIOM_H
+#define IDIOM_H
+
+#include <stdint.h>
+#include "../ir.h"
+
+/*
+ * Loop idiom recognition.  Replaces counted loops of the shape
+ *
+ *     H: i' = load I; c = lt i', n; brcond c ? B : E
+ *     B: p[i'] = v;  i = i' + 1; br H          (fill)
+ *     B: d[i'] = s[i']; i = i' + 1; br H       (copy)
+ *
+ * where I is a private slot, and n, v, p, d and s are loop invariant, by a
+ * single memset or memcpy of max(n - i, 0) elements in the preheader.  The
+ * loop is removed and I is left holding its final value.
+ *
+ * Each loop replaced is reported under -Rpass=loop-idiom.  Returns the
+ * number of loops replaced.
+ */
+uint32_t idiom__run_function(IrFunction *func);
+
+#endif
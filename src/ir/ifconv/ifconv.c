@@ -0,0 +1,347 @@
+#include "ifconv.h"
+#include "../profile/profile.h"
+#include "../../errhandler/errhandler.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Maximum number of distinct local slots one arm may store to. */
+#define IFCONV_MAX_STORES 8
+/* A profiled branch going one way at least this often (per mille) is
+ * predicted well enough that executing both arms only costs time. */
+#define IFCONV_BIASED_PERMILLE 990
+
+typedef struct {
+    IrValue *ptr;
+    IrValue *value;
+} ArmStore;
+
+/* One side of a conditional branch.  bb is NULL for the empty side of a
+ * triangle, where control flows straight from the head to the merge block. */
+typedef struct {
+    IrBasicBlock *bb;
+    ArmStore      stores[IFCONV_MAX_STORES];
+    uint32_t      store_count;
+    uint32_t      cost;
+} IfArm;
+
+typedef struct {
+    IrValue **items;
+    uint32_t  count, capacity;
+} ValueSet;
+
+static bool value_set_contains(const ValueSet *set, const IrValue *v) {
+    for (uint32_t i = 0; i < set->count; i++)
+        if (set->items[i] == v) return true;
+    return false;
+}
+
+static void value_set_add(ValueSet *set, IrValue *v) {
+    if (set->count >= set->capacity) {
+        uint32_t new_cap = set->capacity ? set->capacity * 2 : 16;
+        IrValue **new_items = realloc(set->items, new_cap * sizeof(IrValue *));
+        if (!new_items) {
+            errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "ifconv",
+                                     "Failed to grow value set");
+            return;
+        }
+        set->items = new_items;
+        set->capacity = new_cap;
+    }
+    set->items[set->count++] = v;
+}
+
+/* Stack slots never trap and are private to the function, so loads from
+ * them may be speculated and stores to them may be made unconditional. */
+static void collect_local_slots(IrFunction *func, ValueSet *slots) {
+    for (uint32_t i = 0; i < func->block_count; i++)
+        for (IrInstruction *inst = func->all_blocks[i]->first_inst; inst; inst = inst->next)
+            if (inst->opcode == IR_ALLOCA && inst->result)
+                value_set_add(slots, inst->result);
+}
+
+static ArmStore *arm_find_store(IfArm *arm, const IrValue *ptr) {
+    for (uint32_t i = 0; i < arm->store_count; i++)
+        if (arm->stores[i].ptr == ptr) return &arm->stores[i];
+    return NULL;
+}
+
+/* Check that an arm block can be executed unconditionally and record the
+ * last value it stores to each local slot. */
+static bool analyze_arm(IfArm *arm, IrBasicBlock *bb, IrBasicBlock *merge, const ValueSet *slots) {
+    memset(arm, 0, sizeof(*arm));
+    arm->bb = bb;
+    if (!bb) return true;
+    if (bb->pred_count != 1 || bb->succ_count != 1 || bb->successors[0] != merge) return false;
+    IrInstruction *term = ir__block_terminator(bb);
+    if (!term || term->opcode != IR_BR) return false;
+    for (IrInstruction *inst = bb->first_inst; inst != term; inst = inst->next) {
+        switch (inst->opcode) {
+            case IR_NOP:
+                break;
+            case IR_STORE: {
+                if (!value_set_contains(slots, inst->operand1)) return false;
+                ArmStore *st = arm_find_store(arm, inst->operand1);
+                if (!st) {
+                    if (arm->store_count >= IFCONV_MAX_STORES) return false;
+                    st = &arm->stores[arm->store_count++];
+                    st->ptr = inst->operand1;
+                }
+                st->value = inst->operand2;
+                break;
+            }
+            case IR_LOAD:
+                /* A hoisted load would no longer observe an earlier store of
+                 * the same arm, since stores are sunk below every load. */
+                if (!value_set_contains(slots, inst->operand1)) return false;
+                if (arm_find_store(arm, inst->operand1)) return false;
+                arm->cost++;
+                break;
+            case IR_ADD: case IR_SUB: case IR_MUL: case IR_NEG:
+            case IR_EQ: case IR_NEQ: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+            case IR_AND: case IR_OR: case IR_XOR: case IR_SHL: case IR_SHR: case IR_SAR:
+            case IR_NOT: case IR_CAST: case IR_GEP: case IR_SELECT:
+                arm->cost++;
+                break;
+            default:
+                /* Division may trap; calls, allocas, phis and nested
+                 * terminators all have effects that cannot be speculated. */
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool phi_find_entry(IrPhiExtra *phi, IrBasicBlock *bb, uint32_t *out_index) {
+    for (uint32_t i = 0; i < phi->count; i++)
+        if (phi->blocks[i] == bb) { *out_index = i; return true; }
+    return false;
+}
+
+/* Every phi of the merge block needs an incoming value for both paths. */
+static bool merge_phis_convertible(IrBasicBlock *merge, IrBasicBlock *true_pred, IrBasicBlock *false_pred) {
+    for (IrInstruction *inst = merge->first_inst; inst; inst = inst->next) {
+        if (inst->opcode != IR_PHI) continue;
+        uint32_t idx;
+        if (!phi_find_entry(inst->extra, true_pred, &idx)) return false;
+        if (!phi_find_entry(inst->extra, false_pred, &idx)) return false;
+    }
+    return true;
+}
+
+static void hoist_arm(IfArm *arm, IrInstruction *pos) {
+    if (!arm->bb) return;
+    IrInstruction *term = ir__block_terminator(arm->bb);
+    IrInstruction *inst = arm->bb->first_inst;
+    while (inst && inst != term) {
+        IrInstruction *next = inst->next;
+        if (inst->opcode == IR_STORE || inst->opcode == IR_NOP) {
+            ir__inst_destroy(inst);
+        } else {
+            ir__inst_unlink(inst);
+            ir__inst_insert_before(pos, inst);
+        }
+        inst = next;
+    }
+}
+
+static IrValue *emit_select_before(IrInstruction *pos, IrValue *cond, IrValue *tv, IrValue *fv) {
+    IrFunction *func = pos->parent->function;
+    IrValue *res = ir__value_temp(func, tv->type, tv->type_info);
+    IrInstruction *sel = ir__inst_create_select(func, res, cond, tv, fv);
+    if (!sel) return NULL;
+    ir__inst_insert_before(pos, sel);
+    return res;
+}
+
+/* Sink the arm stores below the hoisted code as one select+store per slot.
+ * A slot stored on one path only keeps its old value on the other. */
+static void emit_merged_stores(IfArm *t, IfArm *e, IrValue *cond, IrInstruction *pos) {
+    IrFunction *func = pos->parent->function;
+    IfArm *arms[2] = { t, e };
+    for (int side = 0; side < 2; side++) {
+        for (uint32_t i = 0; i < arms[side]->store_count; i++) {
+            IrValue *ptr = arms[side]->stores[i].ptr;
+            if (side == 1 && arm_find_store(t, ptr)) continue;
+            ArmStore *ts = arm_find_store(t, ptr);
+            ArmStore *es = arm_find_store(e, ptr);
+            IrValue *known = ts ? ts->value : es->value;
+            IrValue *old = NULL;
+            if (!ts || !es) {
+                old = ir__value_temp(func, known->type, known->type_info);
+                IrInstruction *ld = ir__inst_create(func, IR_LOAD, old, ptr, NULL);
+                if (!ld) return;
+                ir__inst_insert_before(pos, ld);
+            }
+            IrValue *sel = emit_select_before(pos, cond, ts ? ts->value : old, es ? es->value : old);
+            if (!sel) return;
+            IrInstruction *st = ir__inst_create(func, IR_STORE, NULL, ptr, sel);
+            if (!st) return;
+            ir__inst_insert_before(pos, st);
+        }
+    }
+}
+
+/* Turn the merge block phis into selects placed in the head block. */
+static void convert_merge_phis
+    ( IrBasicBlock *merge
+    , IrBasicBlock *head
+    , IrBasicBlock *true_pred
+    , IrBasicBlock *false_pred
+    , IrValue *cond
+    , IrInstruction *pos
+) {
+    IrInstruction *inst = merge->first_inst;
+    while (inst) {
+        IrInstruction *next = inst->next;
+        if (inst->opcode == IR_PHI) {
+            IrPhiExtra *phi = inst->extra;
+            uint32_t ti = 0, fi = 0;
+            phi_find_entry(phi, true_pred, &ti);
+            phi_find_entry(phi, false_pred, &fi);
+            IrValue *tv = phi->values[ti], *fv = phi->values[fi];
+            if (phi->count == 2) {
+                /* The phi merges exactly these two paths: a select defining
+                 * the same result replaces it, so its users need no rewriting. */
+                IrInstruction *sel = ir__inst_create_select(head->function, inst->result, cond, tv, fv);
+                if (!sel) return;
+                ir__inst_insert_before(pos, sel);
+                ir__inst_destroy(inst);
+            } else {
+                IrValue *sel = emit_select_before(pos, cond, tv, fv);
+                if (!sel) return;
+                uint32_t keep = ti < fi ? ti : fi, drop = ti < fi ? fi : ti;
+                phi->values[keep] = sel;
+                phi->blocks[keep] = head;
+                memmove(&phi->values[drop], &phi->values[drop + 1], (phi->count - drop - 1) * sizeof(IrValue *));
+                memmove(&phi->blocks[drop], &phi->blocks[drop + 1], (phi->count - drop - 1) * sizeof(IrBasicBlock *));
+                phi->count--;
+                ir__inst_update_uses(inst);
+            }
+        }
+        inst = next;
+    }
+}
+
+static bool block_has_phi(const IrBasicBlock *bb) {
+    for (IrInstruction *inst = bb->first_inst; inst; inst = inst->next)
+        if (inst->opcode == IR_PHI) return true;
+    return false;
+}
+
+static bool branch_is_biased(const IrFunction *func, const IrBasicBlock *head,
+                             const IrBasicBlock *tbb, const IrBasicBlock *fbb) {
+    if (!func->has_profile || head->exec_count == 0) return false;
+    uint64_t t = profile__edge_count(head, tbb), f = profile__edge_count(head, fbb);
+    uint64_t hot = t > f ? t : f;
+    return t + f > 0 && hot * 1000 >= (t + f) * IFCONV_BIASED_PERMILLE;
+}
+
+static bool try_convert(IrFunction *func, IrBasicBlock *head, const ValueSet *slots, uint32_t threshold) {
+    IrInstruction *br = ir__block_terminator(head);
+    if (!br || br->opcode != IR_BRCOND || !br->extra) return false;
+    IrCondBranchExtra *targets = br->extra;
+    IrBasicBlock *tbb = targets->true_target, *fbb = targets->false_target;
+    if (!tbb || !fbb || tbb == fbb || tbb == head || fbb == head) return false;
+    if (branch_is_biased(func, head, tbb, fbb)) return false;
+
+    IrBasicBlock *merge = NULL;
+    IrBasicBlock *t_arm = NULL, *f_arm = NULL;
+    if (tbb->succ_count == 1 && fbb->succ_count == 1 && tbb->successors[0] == fbb->successors[0] &&
+        tbb->pred_count == 1 && fbb->pred_count == 1) {
+        merge = tbb->successors[0];                 /* diamond */
+        t_arm = tbb; f_arm = fbb;
+    } else if (tbb->succ_count == 1 && tbb->successors[0] == fbb && tbb->pred_count == 1) {
+        merge = fbb; t_arm = tbb;                   /* triangle, false arm empty */
+    } else if (fbb->succ_count == 1 && fbb->successors[0] == tbb && fbb->pred_count == 1) {
+        merge = tbb; f_arm = fbb;                   /* triangle, true arm empty */
+    } else {
+        return false;
+    }
+    if (merge == head || merge == func->entry_block) return false;
+    if ((t_arm && block_has_phi(t_arm)) || (f_arm && block_has_phi(f_arm))) return false;
+
+    IfArm t, e;
+    if (!analyze_arm(&t, t_arm, merge, slots) || !analyze_arm(&e, f_arm, merge, slots)) return false;
+    uint32_t cost = t.cost + e.cost;
+    for (uint32_t i = 0; i < t.store_count; i++) if (!arm_find_store(&e, t.stores[i].ptr)) cost++;
+    for (uint32_t i = 0; i < e.store_count; i++) if (!arm_find_store(&t, e.stores[i].ptr)) cost++;
+    if (cost > threshold) return false;
+
+    IrBasicBlock *true_pred = t_arm ? t_arm : head;
+    IrBasicBlock *false_pred = f_arm ? f_arm : head;
+    if (!merge_phis_convertible(merge, true_pred, false_pred)) return false;
+
+    IrValue *cond = br->operand1;
+    hoist_arm(&t, br);
+    hoist_arm(&e, br);
+    emit_merged_stores(&t, &e, cond, br);
+    convert_merge_phis(merge, head, true_pred, false_pred, cond, br);
+
+    ir__block_unlink(head, tbb);
+    ir__block_unlink(head, fbb);
+    ir__inst_destroy(br);
+    if (t_arm) ir__function_remove_block(func, t_arm);
+    if (f_arm) ir__function_remove_block(func, f_arm);
+    IrInstruction *jmp = ir__inst_create(func, IR_BR, NULL, ir__value_label(merge), NULL);
+    if (!jmp) return true;
+    ir__inst_append(head, jmp);
+    ir__block_link(head, merge);
+    return true;
+}
+
+/* Fold a block into its only predecessor when that predecessor jumps to it
+ * unconditionally, so that nested conversions see one straight-line arm. */
+static bool merge_into_predecessor(IrFunction *func, IrBasicBlock *bb) {
+    if (bb == func->entry_block || bb->pred_count != 1) return false;
+    IrBasicBlock *pred = bb->predecessors[0];
+    if (pred == bb || pred->succ_count != 1) return false;
+    IrInstruction *br = ir__block_terminator(pred);
+    if (!br || br->opcode != IR_BR || block_has_phi(bb)) return false;
+    ir__inst_destroy(br);
+    while (bb->first_inst) {
+        IrInstruction *inst = bb->first_inst;
+        ir__inst_unlink(inst);
+        ir__inst_append(pred, inst);
+    }
+    ir__block_unlink(pred, bb);
+    while (bb->succ_count > 0) {
+        IrBasicBlock *succ = bb->successors[0];
+        ir__block_unlink(bb, succ);
+        ir__block_link(pred, succ);
+        for (IrInstruction *inst = succ->first_inst; inst; inst = inst->next) {
+            if (inst->opcode != IR_PHI) continue;
+            IrPhiExtra *phi = inst->extra;
+            for (uint32_t i = 0; i < phi->count; i++)
+                if (phi->blocks[i] == bb) phi->blocks[i] = pred;
+        }
+    }
+    ir__function_remove_block(func, bb);
+    return true;
+}
+
+uint32_t ifconv__run_function(IrFunction *func, uint32_t threshold) {
+    if (!func) return 0;
+    ValueSet slots = {0};
+    collect_local_slots(func, &slots);
+    uint32_t converted = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t i = 0; i < func->block_count; i++) {
+            if (try_convert(func, func->all_blocks[i], &slots, threshold)) {
+                converted++;
+                changed = true;
+                break;
+            }
+        }
+        if (changed) continue;
+        for (uint32_t i = 0; i < func->block_count; i++) {
+            if (merge_into_predecessor(func, func->all_blocks[i])) {
+                changed = true;
+                break;
+            }
+        }
+    }
+    free(slots.items);
+    return converted;
+}
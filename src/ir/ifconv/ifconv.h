@@ -0,0 +1,25 @@
+#ifndef IFCONV_H
+#define IFCONV_H
+
+#include <stdint.h>
+#include "../ir.h"
+
+/* Default limit on the number of instructions speculated out of the arms of
+ * one conditional branch.  Beyond this, executing both arms costs more than
+ * an occasional branch mispredict. */
+#define IFCONV_DEFAULT_THRESHOLD 6
+
+/*
+ * If-conversion.  Flattens small side-effect-free diamonds
+ *
+ *     H: brcond c ? T : E    T: ...; br M    E: ...; br M
+ *
+ * and triangles (one arm empty) into straight-line code in H: the arm
+ * instructions are hoisted, stores to local slots become an unconditional
+ * store of a select, and phis in the merge block become selects.
+ *
+ * Returns the number of branches removed from the function.
+ */
+uint32_t ifconv__run_function(IrFunction *func, uint32_t threshold);
+
+#endif
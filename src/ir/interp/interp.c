@@ -0,0 +1,1187 @@
+#define _POSIX_C_SOURCE 200809L
+#include "interp.h"
+#include "../profile/profile.h"
+#include "../lower/lower.h"
+#include "../../errhandler/errhandler.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__GNUC__)
+#define INTERP_THREADED 1       /* dispatch through computed goto */
+#endif
+
+/* Interpreter stacks: register slots, bytes of locals, call depth. */
+#define REG_STACK_SLOTS     (1U << 21)
+#define MEM_STACK_BYTES     (8U << 20)
+#define MAX_CALL_DEPTH      (1U << 16)
+/* The same for a sandbox, which only runs small compile-time calls. */
+#define SANDBOX_REG_SLOTS   (1U << 16)
+#define SANDBOX_MEM_BYTES   (256U << 10)
+#define SANDBOX_CALL_DEPTH  (1U << 10)
+
+#define FRAME_ALIGN 16
+#define NO_REG      UINT32_MAX
+/* Registers of constants are only known once a function is decoded; until
+ * then they are numbered from this bit. */
+#define CONST_TAG   0x80000000U
+
+/* Which of a, b, c, d are registers. */
+#define RA 1
+#define RB 2
+#define RC 4
+#define RD 8
+
+/*
+ * Bytecode operations; a is the destination unless noted.  LDX and STX are
+ * the checked loads and stores of a sandbox, with the plain operation in d.
+ */
+#define INTERP_OPS(X)                                                       \
+    X(MOV, RA|RB) X(ADD, RA|RB|RC) X(SUB, RA|RB|RC) X(MUL, RA|RB|RC)        \
+    X(DIV, RA|RB|RC) X(MOD, RA|RB|RC) X(NEG, RA|RB)                         \
+    X(AND, RA|RB|RC) X(OR, RA|RB|RC) X(XOR, RA|RB|RC) X(SHL, RA|RB|RC)      \
+    X(SHR, RA|RB|RC) X(SAR, RA|RB|RC) X(NOT, RA|RB)                         \
+    X(EQ, RA|RB|RC) X(NE, RA|RB|RC) X(LT, RA|RB|RC) X(LE, RA|RB|RC)         \
+    X(GT, RA|RB|RC) X(GE, RA|RB|RC)                                         \
+    X(FADD, RA|RB|RC) X(FSUB, RA|RB|RC) X(FMUL, RA|RB|RC)                   \
+    X(FDIV, RA|RB|RC) X(FMOD, RA|RB|RC) X(FNEG, RA|RB)                      \
+    X(FEQ, RA|RB|RC) X(FNE, RA|RB|RC) X(FLT, RA|RB|RC) X(FLE, RA|RB|RC)     \
+    X(FGT, RA|RB|RC) X(FGE, RA|RB|RC)                                       \
+    X(ITOF, RA|RB) X(FTOI, RA|RB) X(FROUND, RA|RB) X(FBITS4, RA|RB)         \
+    X(SEXT, RA|RB) X(ZEXT, RA|RB)                                           \
+    X(LD8, RA|RB) X(LD4, RA|RB) X(LD2, RA|RB) X(LD1, RA|RB)                 \
+    X(LDU1, RA|RB) X(LDF4, RA|RB)                                           \
+    X(ST8, RA|RB) X(ST4, RA|RB) X(ST2, RA|RB) X(ST1, RA|RB) X(STF4, RA|RB)  \
+    X(LDX, RA|RB) X(STX, RA|RB)                                             \
+    X(ADDR, RA) X(ALLOCA, RA|RB) X(GEP, RA|RB|RC) X(GEPI, RA|RB)            \
+    X(SELECT, RA|RB|RC|RD)                                                  \
+    X(JMP, 0) X(JCC, RA) X(CALL, 0) X(RET, RA) X(RETV, 0)                   \
+    X(MEMSET, RA|RB|RC) X(MEMCPY, RA|RB|RC)                                 \
+    X(ALLOC, RA|RB|RC) X(REALLOC, RA|RB|RC) X(FREE, RA)                     \
+    X(SIGNAL, 0) X(HALT, 0) X(PROFDUMP, 0) X(TRAP, 0)
+
+typedef enum {
+#define OP_ENUM(name, regs) OP_##name,
+    INTERP_OPS(OP_ENUM)
+#undef OP_ENUM
+    OP_COUNT
+} InterpOp;
+
+static const uint8_t op_registers[OP_COUNT] = {
+#define OP_REGS(name, regs) regs,
+    INTERP_OPS(OP_REGS)
+#undef OP_REGS
+};
+
+/* Why a TRAP instruction was emitted; its a operand. */
+enum { TRAP_UNSUPPORTED, TRAP_UNDEFINED, TRAP_SANDBOX };
+
+/*
+ * One bytecode instruction.  op is the address of its handler (the
+ * operation number without computed goto); jumps hold instruction indices
+ * of their function; CALL holds the callee in b, its arguments at c in the
+ * function's argument list and their number in d.
+ */
+typedef struct {
+    const void *op;
+    uint32_t    a, b, c, d;
+} Insn;
+
+typedef struct {
+    uint16_t line, column;
+} InsnPos;
+
+/* A decoded function. */
+typedef struct {
+    const IrFunction *func;
+    Insn       *insns;
+    InsnPos    *pos;            /* source position of each instruction */
+    uint32_t    insn_count;
+    uint32_t    entry;
+    uint32_t   *args;           /* argument registers of calls and signals */
+    const char **names;         /* callees the module does not define */
+    uint64_t   *consts;
+    uint32_t    const_base, const_count;
+    uint32_t    reg_count;      /* params, temps, scratch, then constants */
+    uint32_t    frame_bytes;    /* locals with a size known when decoding */
+    uint32_t    param_count;
+    bool        returns_real;
+    bool        decoded, failed;
+} Code;
+
+typedef struct {
+    Code        *code;
+    const Insn  *ret;           /* where the caller resumes */
+    uint64_t    *regs;
+    uint8_t     *mem;           /* this frame's locals */
+    uint8_t     *sp;            /* memory stack top before the frame */
+    uint32_t     result;        /* caller register of the return value */
+} Frame;
+
+static const InterpServices services_generic = { 63, 64, 93, 94 };
+static const InterpServices services_x86_64  = { 0, 1, 60, 231 };
+static const InterpServices services_x86     = { 3, 4, 1, 252 };
+
+struct IrInterp {
+    IrModule          *mod;
+    InterpOptions      opts;
+    InterpServices     services;
+    const void *const *handlers;
+    Code              *codes;           /* per module function, decoded lazily */
+    LowerModule        lm;
+    uint64_t          *counters;        /* IR_RUNTIME_PROFILE_COUNTERS */
+    uint64_t          *regs;
+    uint32_t           reg_slots;
+    uint8_t           *mem;
+    size_t             mem_bytes;
+    Frame             *frames;
+    uint32_t           max_depth;
+    uint64_t           steps;
+    char               trap[160];       /* last trap, for the caller */
+};
+
+static InterpStatus execute(IrInterp *in, Frame *base, uint64_t *result, const void *const **handlers);
+
+static uint64_t real_bits(double r) {
+    uint64_t u;
+    memcpy(&u, &r, sizeof u);
+    return u;
+}
+
+static double bits_real(uint64_t u) {
+    double r;
+    memcpy(&r, &u, sizeof r);
+    return r;
+}
+
+InterpServices interp__services(const char *arch) {
+    if (!arch) {
+#if defined(__x86_64__) || defined(_M_X64)
+        return services_x86_64;
+#elif defined(__i386__) || defined(_M_IX86)
+        return services_x86;
+#else
+        return services_generic;
+#endif
+    }
+    if (strcmp(arch, "x86_64") == 0 || strcmp(arch, "amd64") == 0) return services_x86_64;
+    if (strcmp(arch, "x86") == 0 || strcmp(arch, "i386") == 0) return services_x86;
+    return services_generic;
+}
+
+/* ----------------------------------------------------------------- decoding */
+
+typedef struct {
+    IrInterp         *in;
+    Code             *code;
+    const IrFunction *func;
+    LowerFunction     lf;
+    uint32_t          scratch;          /* scratch registers handed out */
+    Insn             *insns;
+    InsnPos          *pos;
+    uint32_t          count, capacity;
+    uint32_t         *args;
+    uint32_t          arg_count, arg_capacity;
+    const char      **names;
+    uint32_t          name_count, name_capacity;
+    uint64_t         *consts;
+    uint32_t          const_count, const_capacity;
+    uint32_t         *const_slots;      /* hash of constants: index + 1 */
+    uint32_t          const_slot_count;
+    uint32_t         *block_pc;         /* start of each block by id */
+    struct Fixup { uint32_t insn; uint8_t field; const IrBasicBlock *block; } *fixups;
+    uint32_t          fixup_count, fixup_capacity;
+    InsnPos           at;               /* position of the instruction decoded */
+    bool              oom;
+} Decoder;
+
+static bool grow(void **items, uint32_t *capacity, uint32_t needed, size_t size) {
+    if (needed <= *capacity) return true;
+    uint32_t cap = *capacity ? *capacity : 16;
+    while (cap < needed) cap *= 2;
+    void *p = realloc(*items, (size_t)cap * size);
+    if (!p) return false;
+    *items = p;
+    *capacity = cap;
+    return true;
+}
+
+static uint32_t emit(Decoder *d, InterpOp op, uint32_t a, uint32_t b, uint32_t c, uint32_t e) {
+    uint32_t cap = d->capacity;
+    if (!grow((void **)&d->insns, &cap, d->count + 1, sizeof(Insn)) ||
+        (cap != d->capacity && !grow((void **)&d->pos, &d->capacity, cap, sizeof(InsnPos)))) {
+        d->oom = true;
+        return 0;
+    }
+    Insn *i = &d->insns[d->count];
+    i->op = d->in->handlers[op];
+    i->a = a; i->b = b; i->c = c; i->d = e;
+    d->pos[d->count] = d->at;
+    return d->count++;
+}
+
+static uint32_t new_scratch(Decoder *d) {
+    return d->func->param_count + d->lf.temp_count + d->scratch++;
+}
+
+static uint64_t hash_bits(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* Register holding the constant bits; equal bits share one register. */
+static uint32_t const_reg(Decoder *d, uint64_t bits) {
+    if (d->const_count * 2 >= d->const_slot_count) {
+        uint32_t n = d->const_slot_count ? d->const_slot_count * 2 : 64;
+        uint32_t *slots = calloc(n, sizeof(uint32_t));
+        if (!slots) { d->oom = true; return CONST_TAG; }
+        for (uint32_t i = 0; i < d->const_count; i++) {
+            uint32_t h = (uint32_t)hash_bits(d->consts[i]) & (n - 1);
+            while (slots[h]) h = (h + 1) & (n - 1);
+            slots[h] = i + 1;
+        }
+        free(d->const_slots);
+        d->const_slots = slots;
+        d->const_slot_count = n;
+    }
+    uint32_t mask = d->const_slot_count - 1;
+    uint32_t h = (uint32_t)hash_bits(bits) & mask;
+    while (d->const_slots[h]) {
+        uint32_t k = d->const_slots[h] - 1;
+        if (d->consts[k] == bits) return CONST_TAG | k;
+        h = (h + 1) & mask;
+    }
+    if (!grow((void **)&d->consts, &d->const_capacity, d->const_count + 1, sizeof(uint64_t))) {
+        d->oom = true;
+        return CONST_TAG;
+    }
+    d->consts[d->const_count] = bits;
+    d->const_slots[h] = d->const_count + 1;
+    return CONST_TAG | d->const_count++;
+}
+
+static bool value_is_real(const Decoder *d, const IrValue *v) {
+    return lower__is_real(&d->lf, v);
+}
+
+static uint32_t value_reg(const Decoder *d, const IrValue *v) {
+    return v->kind == IR_VALUE_PARAM ? v->id : d->func->param_count + v->id;
+}
+
+static uint32_t dest_reg(Decoder *d, const IrValue *v) {
+    if (v && v->kind == IR_VALUE_TEMP && v->id < d->lf.temp_count) return value_reg(d, v);
+    return new_scratch(d);
+}
+
+/* Register holding v as a real or an integer, converting if needed. */
+static uint32_t operand(Decoder *d, const IrValue *v, bool want_real) {
+    if (!v) return const_reg(d, 0);
+    switch (v->kind) {
+        case IR_VALUE_CONST_INT:
+            return const_reg(d, want_real ? real_bits((double)v->const_data.int_val)
+                                          : (uint64_t)v->const_data.int_val);
+        case IR_VALUE_CONST_CHAR: {
+            int64_t c = (unsigned char)v->const_data.char_val;
+            return const_reg(d, want_real ? real_bits((double)c) : (uint64_t)c);
+        }
+        case IR_VALUE_CONST_REAL:
+            return const_reg(d, want_real ? real_bits(v->const_data.real_val)
+                                          : (uint64_t)(int64_t)v->const_data.real_val);
+        case IR_VALUE_GLOBAL_SYMBOL:
+            if (v->name && strcmp(v->name, IR_RUNTIME_PROFILE_COUNTERS) == 0)
+                return const_reg(d, (uint64_t)(uintptr_t)d->in->counters);
+            return const_reg(d, 0);
+        case IR_VALUE_STRUCT_FIELD:
+            return const_reg(d, (uint64_t)v->const_data.field_index * 8);
+        case IR_VALUE_PARAM:
+        case IR_VALUE_TEMP: {
+            if (v->kind == IR_VALUE_TEMP && v->id >= d->lf.temp_count) return const_reg(d, 0);
+            uint32_t r = value_reg(d, v);
+            bool real = value_is_real(d, v);
+            if (real == want_real) return r;
+            uint32_t s = new_scratch(d);
+            emit(d, want_real ? OP_ITOF : OP_FTOI, s, r, 0, 0);
+            return s;
+        }
+        default:
+            return const_reg(d, 0);
+    }
+}
+
+/* Integer register that is non-zero when v is. */
+static uint32_t truth(Decoder *d, const IrValue *v) {
+    if (!value_is_real(d, v)) return operand(d, v, false);
+    uint32_t s = new_scratch(d);
+    emit(d, OP_FNE, s, operand(d, v, true), const_reg(d, real_bits(0.0)), 0);
+    return s;
+}
+
+static const IrInstruction *phi_of(const IrBasicBlock *bb, const IrInstruction *inst) {
+    inst = inst ? inst->next : bb->first_inst;
+    return inst && inst->opcode == IR_PHI ? inst : NULL;
+}
+
+/* Moves the phis of to need on the edge from `from`.  They happen at
+ * once, so when one reads what another writes all go through scratch. */
+static void emit_edge_moves(Decoder *d, const IrBasicBlock *from, const IrBasicBlock *to) {
+    uint32_t n = 0;
+    for (const IrInstruction *p = phi_of(to, NULL); p; p = phi_of(to, p)) n++;
+    if (n == 0) return;
+    uint32_t *dst = malloc(n * 2 * sizeof(uint32_t));
+    if (!dst) { d->oom = true; return; }
+    uint32_t *src = dst + n, k = 0;
+    for (const IrInstruction *p = phi_of(to, NULL); p; p = phi_of(to, p)) {
+        const IrPhiExtra *phi = p->extra;
+        if (!p->result || p->result->kind != IR_VALUE_TEMP || p->result->id >= d->lf.temp_count) continue;
+        for (uint32_t i = 0; i < phi->count; i++) {
+            if (phi->blocks[i] != from) continue;
+            dst[k] = value_reg(d, p->result);
+            src[k] = operand(d, phi->values[i], d->lf.temp_real[p->result->id]);
+            k++;
+            break;
+        }
+    }
+    bool overlap = false;
+    for (uint32_t i = 0; i < k && !overlap; i++)
+        for (uint32_t j = 0; j < k; j++)
+            if (i != j && src[j] == dst[i]) { overlap = true; break; }
+    if (overlap) {
+        for (uint32_t i = 0; i < k; i++) {
+            uint32_t s = new_scratch(d);
+            emit(d, OP_MOV, s, src[i], 0, 0);
+            src[i] = s;
+        }
+    }
+    for (uint32_t i = 0; i < k; i++)
+        if (src[i] != dst[i]) emit(d, OP_MOV, dst[i], src[i], 0, 0);
+    free(dst);
+}
+
+static void add_fixup(Decoder *d, uint32_t insn, uint8_t field, const IrBasicBlock *block) {
+    if (!grow((void **)&d->fixups, &d->fixup_capacity, d->fixup_count + 1, sizeof(*d->fixups))) {
+        d->oom = true;
+        return;
+    }
+    d->fixups[d->fixup_count++] = (struct Fixup){ insn, field, block };
+}
+
+static bool has_phis(const IrBasicBlock *bb) {
+    return bb->first_inst && bb->first_inst->opcode == IR_PHI;
+}
+
+static uint32_t add_args(Decoder *d, const IrValue *const *values, uint32_t count, const IrFunction *callee) {
+    uint32_t first = d->arg_count;
+    uint32_t *regs = malloc((count ? count : 1) * sizeof(uint32_t));
+    if (!regs) { d->oom = true; return first; }
+    for (uint32_t i = 0; i < count; i++) {
+        bool real = callee && i < callee->param_count && callee->parameters[i]->type == TYPE_REAL;
+        regs[i] = operand(d, values[i], real);
+    }
+    if (!grow((void **)&d->args, &d->arg_capacity, d->arg_count + count, sizeof(uint32_t))) {
+        d->oom = true;
+    } else {
+        memcpy(d->args + d->arg_count, regs, count * sizeof(uint32_t));
+        d->arg_count += count;
+    }
+    free(regs);
+    return first;
+}
+
+static uint32_t add_name(Decoder *d, const char *name) {
+    if (!grow((void **)&d->names, &d->name_capacity, d->name_count + 1, sizeof(char *))) {
+        d->oom = true;
+        return 0;
+    }
+    d->names[d->name_count] = name;
+    return d->name_count++;
+}
+
+static InterpOp load_op(LowerAccess acc) {
+    if (!acc.typed || acc.size == 8) return OP_LD8;
+    if (acc.is_real) return OP_LDF4;
+    switch (acc.size) {
+        case 4: return OP_LD4;
+        case 2: return OP_LD2;
+        default: return acc.is_signed ? OP_LD1 : OP_LDU1;
+    }
+}
+
+static InterpOp store_op(LowerAccess acc) {
+    if (!acc.typed || acc.size == 8) return OP_ST8;
+    if (acc.is_real) return OP_STF4;
+    switch (acc.size) {
+        case 4: return OP_ST4;
+        case 2: return OP_ST2;
+        default: return OP_ST1;
+    }
+}
+
+static void emit_access(Decoder *d, InterpOp op, uint32_t a, uint32_t b) {
+    if (d->in->opts.sandboxed) emit(d, op >= OP_LD8 && op <= OP_LDF4 ? OP_LDX : OP_STX, a, b, 0, op);
+    else emit(d, op, a, b, 0, 0);
+}
+
+static void decode_alloca(Decoder *d, const IrInstruction *inst) {
+    uint32_t dst = dest_reg(d, inst->result);
+    const IrValue *size = inst->operand1, *align = inst->operand2;
+    uint64_t bytes;
+    if (!size) {
+        bytes = inst->result ? lower__slot_bytes(inst->result, MEM_STACK_BYTES) : 8;
+    } else if (size->kind == IR_VALUE_CONST_INT && size->const_data.int_val >= 0 &&
+               (uint64_t)size->const_data.int_val <= MEM_STACK_BYTES) {
+        bytes = (uint64_t)size->const_data.int_val;
+    } else {
+        emit(d, OP_ALLOCA, dst, operand(d, size, false), 0, 0);
+        return;
+    }
+    uint64_t a = align && align->kind == IR_VALUE_CONST_INT ? (uint64_t)align->const_data.int_val : 8;
+    if (a < 8 || a > FRAME_ALIGN || (a & (a - 1))) a = a > FRAME_ALIGN ? FRAME_ALIGN : 8;
+    uint64_t offset = ((uint64_t)d->code->frame_bytes + a - 1) & ~(a - 1);
+    if (offset + bytes > MEM_STACK_BYTES) {
+        emit(d, OP_ALLOCA, dst, const_reg(d, bytes), 0, 0);
+        return;
+    }
+    d->code->frame_bytes = (uint32_t)(offset + (bytes ? bytes : 1));
+    emit(d, OP_ADDR, dst, 0, 0, (uint32_t)offset);
+}
+
+static void decode_gep(Decoder *d, const IrInstruction *inst) {
+    uint32_t dst = dest_reg(d, inst->result);
+    uint64_t scale = lower__gep_scale(inst);
+    uint32_t base = operand(d, inst->operand1, false);
+    const IrGepExtra *extra = inst->extra;
+    uint32_t n = 1 + (extra ? extra->index_count : 0);
+    for (uint32_t i = 0; i < n; i++) {
+        const IrValue *idx = i == 0 ? inst->operand2 : extra->indices[i - 1];
+        int64_t off = 0;
+        bool fixed = true;
+        if (!idx) off = 0;
+        else if (idx->kind == IR_VALUE_STRUCT_FIELD) off = lower__field_offset(idx);
+        else if (idx->kind == IR_VALUE_CONST_INT) off = idx->const_data.int_val * (int64_t)scale;
+        else fixed = false;
+        if (fixed && off >= INT32_MIN && off <= INT32_MAX)
+            emit(d, OP_GEPI, dst, base, 0, (uint32_t)(int32_t)off);
+        else
+            emit(d, OP_GEP, dst, base, operand(d, idx, false), (uint32_t)scale);
+        base = dst;
+    }
+}
+
+static void decode_cast(Decoder *d, const IrInstruction *inst) {
+    uint32_t dst = dest_reg(d, inst->result);
+    const Type *t = inst->result->type_info;
+    DataType to = ir__datatype_of(t);
+    if (to == TYPE_REAL) {
+        emit(d, OP_MOV, dst, operand(d, inst->operand1, true), 0, 0);
+        if (ir__type_size(t) == 4) emit(d, OP_FROUND, dst, dst, 0, 0);
+        return;
+    }
+    emit(d, OP_MOV, dst, operand(d, inst->operand1, false), 0, 0);
+    if (to == TYPE_CHAR) {
+        emit(d, OP_ZEXT, dst, dst, 0, 1);
+    } else if (to == TYPE_INT) {
+        uint32_t size = ir__type_size(t);
+        if (size == 1 || size == 2 || size == 4) emit(d, OP_SEXT, dst, dst, 0, size);
+    }
+}
+
+static void decode_call(Decoder *d, const IrInstruction *inst) {
+    const IrCallExtra *call = inst->extra;
+    const IrValue *const *argv = (const IrValue *const *)call->args;
+    uint32_t argc = call->arg_count;
+    const char *name = inst->operand1 && inst->operand1->kind == IR_VALUE_GLOBAL_SYMBOL
+                     ? inst->operand1->name : NULL;
+    uint32_t f = lower__callee(&d->in->lm, inst);
+    if (f != UINT32_MAX) {
+        uint32_t first = add_args(d, argv, argc, d->in->mod->functions[f]);
+        uint32_t dst = inst->result ? dest_reg(d, inst->result) : NO_REG;
+        emit(d, OP_CALL, dst, f, first, argc);
+        return;
+    }
+    bool sandboxed = d->in->opts.sandboxed;
+    if (name && strcmp(name, IR_RUNTIME_ALLOC) == 0 && !sandboxed) {
+        emit(d, OP_ALLOC, dest_reg(d, inst->result), operand(d, argc > 0 ? argv[0] : NULL, false),
+             operand(d, argc > 1 ? argv[1] : NULL, false), 0);
+    } else if (name && strcmp(name, IR_RUNTIME_REALLOC) == 0 && !sandboxed) {
+        emit(d, OP_REALLOC, dest_reg(d, inst->result), operand(d, argc > 0 ? argv[0] : NULL, false),
+             operand(d, argc > 1 ? argv[1] : NULL, false), 0);
+    } else if (name && strcmp(name, IR_RUNTIME_FREE) == 0 && !sandboxed) {
+        emit(d, OP_FREE, operand(d, argc > 0 ? argv[0] : NULL, false), 0, 0, 0);
+    } else if (name && strcmp(name, IR_RUNTIME_SIGNAL) == 0 && !sandboxed) {
+        uint32_t first = add_args(d, argv, argc, NULL);
+        emit(d, OP_SIGNAL, 0, 0, first, argc);
+    } else if (name && strcmp(name, IR_RUNTIME_HALT) == 0 && !sandboxed) {
+        emit(d, OP_HALT, 0, 0, 0, 0);
+    } else if (name && strcmp(name, IR_RUNTIME_PROFILE_DUMP) == 0 && !sandboxed) {
+        emit(d, OP_PROFDUMP, 0, 0, 0, 0);
+    } else if (sandboxed) {
+        emit(d, OP_TRAP, TRAP_SANDBOX, 0, 0, 0);
+    } else {
+        emit(d, OP_TRAP, TRAP_UNDEFINED, add_name(d, name ? name : "?"), 0, 0);
+    }
+}
+
+static void decode_instruction(Decoder *d, const IrInstruction *inst) {
+    static const InterpOp int_ops[] = {
+        [IR_ADD] = OP_ADD, [IR_SUB] = OP_SUB, [IR_MUL] = OP_MUL, [IR_DIV] = OP_DIV, [IR_MOD] = OP_MOD,
+        [IR_EQ] = OP_EQ, [IR_NEQ] = OP_NE, [IR_LT] = OP_LT, [IR_LE] = OP_LE, [IR_GT] = OP_GT,
+        [IR_GE] = OP_GE, [IR_AND] = OP_AND, [IR_OR] = OP_OR, [IR_XOR] = OP_XOR, [IR_SHL] = OP_SHL,
+        [IR_SHR] = OP_SHR, [IR_SAR] = OP_SAR,
+    };
+    static const InterpOp real_ops[] = {
+        [IR_ADD] = OP_FADD, [IR_SUB] = OP_FSUB, [IR_MUL] = OP_FMUL, [IR_DIV] = OP_FDIV, [IR_MOD] = OP_FMOD,
+        [IR_EQ] = OP_FEQ, [IR_NEQ] = OP_FNE, [IR_LT] = OP_FLT, [IR_LE] = OP_FLE, [IR_GT] = OP_FGT,
+        [IR_GE] = OP_FGE,
+    };
+    d->at.line = inst->line;
+    d->at.column = inst->column;
+    IrOpcode op = (IrOpcode)inst->opcode;
+    switch (op) {
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+        case IR_EQ: case IR_NEQ: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        case IR_AND: case IR_OR: case IR_XOR: case IR_SHL: case IR_SHR: case IR_SAR: {
+            if (!inst->result) return;
+            bool real = op <= IR_GE && (value_is_real(d, inst->operand1) || value_is_real(d, inst->operand2));
+            uint32_t a = operand(d, inst->operand1, real), b = operand(d, inst->operand2, real);
+            emit(d, real ? real_ops[op] : int_ops[op], dest_reg(d, inst->result), a, b, 0);
+            return;
+        }
+        case IR_NEG: case IR_NOT: {
+            if (!inst->result) return;
+            bool real = op == IR_NEG && value_is_real(d, inst->operand1);
+            uint32_t a = operand(d, inst->operand1, real);
+            emit(d, op == IR_NOT ? OP_NOT : real ? OP_FNEG : OP_NEG, dest_reg(d, inst->result), a, 0, 0);
+            return;
+        }
+        case IR_LOAD: {
+            if (!inst->result) return;
+            uint32_t ptr = operand(d, inst->operand1, false);
+            emit_access(d, load_op(lower__access(&d->lf, inst->operand1)), dest_reg(d, inst->result), ptr);
+            return;
+        }
+        case IR_STORE: {
+            LowerAccess acc = lower__access(&d->lf, inst->operand1);
+            bool real = acc.typed ? acc.is_real : value_is_real(d, inst->operand2);
+            uint32_t ptr = operand(d, inst->operand1, false);
+            emit_access(d, store_op(acc), ptr, operand(d, inst->operand2, real));
+            return;
+        }
+        case IR_ALLOCA: decode_alloca(d, inst); return;
+        case IR_GEP:    decode_gep(d, inst); return;
+        case IR_CAST:   if (inst->result) decode_cast(d, inst); return;
+        case IR_CALL:   decode_call(d, inst); return;
+        case IR_SELECT: {
+            if (!inst->result) return;
+            bool real = d->lf.temp_real[inst->result->id];
+            const IrSelectExtra *sel = inst->extra;
+            uint32_t c = truth(d, inst->operand1);
+            uint32_t t = operand(d, inst->operand2, real), f = operand(d, sel->false_value, real);
+            emit(d, OP_SELECT, dest_reg(d, inst->result), c, t, f);
+            return;
+        }
+        case IR_RET:
+            if (inst->operand1) emit(d, OP_RET, operand(d, inst->operand1, d->code->returns_real), 0, 0, 0);
+            else emit(d, OP_RETV, 0, 0, 0, 0);
+            return;
+        case IR_BR: {
+            const IrBasicBlock *to = inst->operand1 ? inst->operand1->const_data.block : NULL;
+            if (!to) { emit(d, OP_RETV, 0, 0, 0, 0); return; }
+            emit_edge_moves(d, inst->parent, to);
+            add_fixup(d, emit(d, OP_JMP, 0, 0, 0, 0), 'a', to);
+            return;
+        }
+        case IR_BRCOND: {
+            const IrCondBranchExtra *br = inst->extra;
+            uint32_t c = truth(d, inst->operand1);
+            uint32_t j = emit(d, OP_JCC, c, 0, 0, 0);
+            add_fixup(d, j, 'b', br->true_target);
+            add_fixup(d, j, 'c', br->false_target);
+            return;
+        }
+        case IR_MEMSET: case IR_MEMCPY: {
+            const IrMemExtra *mem = inst->extra;
+            uint32_t dst = operand(d, inst->operand1, false);
+            uint32_t val;
+            if (op == IR_MEMSET && value_is_real(d, inst->operand2) && mem->elem_size == 4) {
+                val = new_scratch(d);
+                emit(d, OP_FBITS4, val, operand(d, inst->operand2, true), 0, 0);
+            } else {
+                val = operand(d, inst->operand2, op == IR_MEMSET && value_is_real(d, inst->operand2));
+            }
+            emit(d, op == IR_MEMSET ? OP_MEMSET : OP_MEMCPY, dst, val, operand(d, mem->count, false), mem->elem_size);
+            return;
+        }
+        case IR_PHI: case IR_NOP:
+            return;
+        default:
+            emit(d, OP_TRAP, TRAP_UNSUPPORTED, op, 0, 0);
+            return;
+    }
+}
+
+/* Conditional branches to blocks with phis go through a stub that makes
+ * the moves of that edge. */
+static void emit_branch_stubs(Decoder *d, const IrBasicBlock *bb, uint32_t first_fixup) {
+    uint32_t end = d->fixup_count;
+    for (uint32_t i = first_fixup; i < end; i++) {
+        struct Fixup f = d->fixups[i];
+        if (f.field == 'a' || !has_phis(f.block)) continue;
+        uint32_t stub = d->count;
+        emit_edge_moves(d, bb, f.block);
+        add_fixup(d, emit(d, OP_JMP, 0, 0, 0, 0), 'a', f.block);
+        if (f.field == 'b') d->insns[f.insn].b = stub;
+        else d->insns[f.insn].c = stub;
+        d->fixups[i].block = NULL;
+    }
+}
+
+static bool decode_blocks(Decoder *d) {
+    const IrFunction *func = d->func;
+    d->block_pc = malloc((func->next_block_id ? func->next_block_id : 1) * sizeof(uint32_t));
+    if (!d->block_pc) return false;
+    for (uint32_t b = 0; b < func->block_count && !d->oom; b++) {
+        const IrBasicBlock *bb = func->all_blocks[b];
+        if (bb->id < func->next_block_id) d->block_pc[bb->id] = d->count;
+        uint32_t first_fixup = d->fixup_count;
+        for (const IrInstruction *inst = bb->first_inst; inst; inst = inst->next)
+            decode_instruction(d, inst);
+        const IrInstruction *term = ir__block_terminator(bb);
+        if (!term) {
+            emit(d, OP_RETV, 0, 0, 0, 0);
+        } else if (term->opcode == IR_BR && d->fixup_count > first_fixup && b + 1 < func->block_count &&
+                   d->fixups[d->fixup_count - 1].block == func->all_blocks[b + 1] &&
+                   d->insns[d->count - 1].op == d->in->handlers[OP_JMP]) {
+            /* Falls through into the next block. */
+            d->count--;
+            d->fixup_count--;
+        }
+        emit_branch_stubs(d, bb, first_fixup);
+    }
+    if (d->oom) return false;
+    for (uint32_t i = 0; i < d->fixup_count; i++) {
+        struct Fixup f = d->fixups[i];
+        if (!f.block) continue;
+        uint32_t pc = f.block->id < func->next_block_id ? d->block_pc[f.block->id] : 0;
+        if (f.field == 'a') d->insns[f.insn].a = pc;
+        else if (f.field == 'b') d->insns[f.insn].b = pc;
+        else d->insns[f.insn].c = pc;
+    }
+    d->code->entry = func->entry_block && func->entry_block->id < func->next_block_id
+                   ? d->block_pc[func->entry_block->id] : 0;
+    return true;
+}
+
+/* Give constants their registers, after the scratch ones. */
+static void place_constants(Decoder *d) {
+    uint32_t base = d->func->param_count + d->lf.temp_count + d->scratch;
+    for (uint32_t i = 0; i < d->count; i++) {
+        Insn *insn = &d->insns[i];
+        const void *op = insn->op;
+        uint8_t regs = 0;
+        for (uint32_t k = 0; k < OP_COUNT; k++)
+            if (d->in->handlers[k] == op) { regs = op_registers[k]; break; }
+        if ((regs & RA) && insn->a != NO_REG && (insn->a & CONST_TAG)) insn->a = base + (insn->a & ~CONST_TAG);
+        if ((regs & RB) && (insn->b & CONST_TAG)) insn->b = base + (insn->b & ~CONST_TAG);
+        if ((regs & RC) && (insn->c & CONST_TAG)) insn->c = base + (insn->c & ~CONST_TAG);
+        if ((regs & RD) && (insn->d & CONST_TAG)) insn->d = base + (insn->d & ~CONST_TAG);
+    }
+    for (uint32_t i = 0; i < d->arg_count; i++)
+        if (d->args[i] & CONST_TAG) d->args[i] = base + (d->args[i] & ~CONST_TAG);
+    d->code->const_base = base;
+    d->code->const_count = d->const_count;
+    d->code->reg_count = base + d->const_count;
+}
+
+static bool decode_function(IrInterp *in, Code *code) {
+    if (code->decoded) return true;
+    if (code->failed) return false;
+    const IrFunction *func = code->func;
+    Decoder d = { .in = in, .code = code, .func = func };
+    bool ok = lower__function_init(&d.lf, &in->lm, func);
+    if (ok) {
+        code->param_count = func->param_count;
+        code->returns_real = lower__returns_real(func);
+        ok = decode_blocks(&d) && !d.oom;
+    }
+    if (ok) place_constants(&d);
+    lower__function_fini(&d.lf);
+    free(d.const_slots);
+    free(d.block_pc);
+    free(d.fixups);
+    if (!ok) {
+        free(d.insns); free(d.pos); free(d.args); free(d.names); free(d.consts);
+        code->failed = true;
+        if (!in->opts.sandboxed)
+            errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "interp",
+                                     "Failed to decode function '%s'", func->name);
+        return false;
+    }
+    code->insns = d.insns;
+    code->pos = d.pos;
+    code->insn_count = d.count;
+    code->args = d.args;
+    code->names = d.names;
+    code->consts = d.consts;
+    code->decoded = true;
+    return true;
+}
+
+/* ---------------------------------------------------------------- execution */
+
+static void set_trap(IrInterp *in, uint16_t code, const Code *fn, const Insn *ip, const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(in->trap, sizeof in->trap, format, ap);
+    va_end(ap);
+    if (in->opts.sandboxed) return;
+    const InsnPos *pos = fn && ip ? &fn->pos[ip - fn->insns] : NULL;
+    errhandler__report_error(code, pos ? pos->line : 0, pos ? (uint8_t)pos->column : 0, "interp",
+                             "%s (in '%s')", in->trap, fn ? fn->func->name : "?");
+}
+
+static bool in_locals(const IrInterp *in, const uint8_t *sp, uint64_t addr, uint64_t size) {
+    uintptr_t lo = (uintptr_t)in->mem, hi = (uintptr_t)sp;
+    return addr >= lo && addr <= hi && size <= hi - addr;
+}
+
+bool interp__service
+    ( const InterpServices *services
+    , const uint64_t *args
+    , uint32_t argc
+    , bool *exited
+    , int64_t *status
+) {
+    uint64_t nr = argc > 0 ? args[0] : 0;
+    uint64_t a0 = argc > 1 ? args[1] : 0, a1 = argc > 2 ? args[2] : 0, a2 = argc > 3 ? args[3] : 0;
+    if (nr == services->exit || nr == services->exit_group) {
+        *exited = true;
+        *status = (int64_t)a0;
+        return true;
+    }
+    if (nr == services->write) {
+        fflush(stdout);
+        return write((int)a0, (const void *)(uintptr_t)a1, (size_t)a2) >= 0 || true;
+    }
+    if (nr == services->read) {
+        return read((int)a0, (void *)(uintptr_t)a1, (size_t)a2) >= 0 || true;
+    }
+    return false;
+}
+
+static InterpStatus execute(IrInterp *in, Frame *base, uint64_t *result, const void *const **handlers) {
+#ifdef INTERP_THREADED
+#define HANDLER(name, regs) &&L_##name,
+#else
+#define HANDLER(name, regs) (const void *)(uintptr_t)OP_##name,
+#endif
+    static const void *const table[OP_COUNT] = { INTERP_OPS(HANDLER) };
+#undef HANDLER
+    if (handlers) {
+        *handlers = table;
+        return INTERP_RETURNED;
+    }
+
+    Frame *fp = base;
+    Frame *const frame_end = in->frames + in->max_depth;
+    uint64_t *R = fp->regs;
+    uint64_t *const reg_end = in->regs + in->reg_slots;
+    uint8_t *sp = fp->mem + fp->code->frame_bytes;
+    sp = in->mem + (((uintptr_t)(sp - in->mem) + FRAME_ALIGN - 1) & ~(uintptr_t)(FRAME_ALIGN - 1));
+    uint8_t *const mem_end = in->mem + in->mem_bytes;
+    const Insn *pc = fp->code->insns + fp->code->entry;
+    const Insn *ip = pc;
+    uint64_t fuel = in->opts.fuel ? in->opts.fuel : UINT64_MAX;
+    const uint64_t initial_fuel = fuel;
+    InterpStatus status = INTERP_RETURNED;
+    bool exited = false;
+    int64_t exit_status = 0;
+
+#define A       (ip->a)
+#define B       (ip->b)
+#define C       (ip->c)
+#define D       (ip->d)
+#define SR(x)   ((int64_t)R[x])
+#define FR(x)   bits_real(R[x])
+#define PTR(x)  ((uint8_t *)(uintptr_t)R[x])
+#define TRAP(err, ...) do { set_trap(in, err, fp->code, ip, __VA_ARGS__); status = INTERP_TRAPPED; goto done; } while (0)
+#ifdef INTERP_THREADED
+#define OP(name)    L_##name
+#define NEXT()      do { ip = pc++; goto *ip->op; } while (0)
+#else
+#define OP(name)    case OP_##name
+#define NEXT()      goto dispatch
+#endif
+
+#ifdef INTERP_THREADED
+    NEXT();
+#else
+dispatch:
+    ip = pc++;
+    switch ((InterpOp)(uintptr_t)ip->op) {
+#endif
+    OP(MOV):    R[A] = R[B]; NEXT();
+    OP(ADD):    R[A] = R[B] + R[C]; NEXT();
+    OP(SUB):    R[A] = R[B] - R[C]; NEXT();
+    OP(MUL):    R[A] = R[B] * R[C]; NEXT();
+    OP(DIV):
+        if (R[C] == 0) TRAP(ERROR_CODE_RUNTIME_DIV_BY_ZERO, "Division by zero");
+        R[A] = SR(C) == -1 ? 0 - R[B] : (uint64_t)(SR(B) / SR(C));
+        NEXT();
+    OP(MOD):
+        if (R[C] == 0) TRAP(ERROR_CODE_RUNTIME_DIV_BY_ZERO, "Division by zero");
+        R[A] = SR(C) == -1 ? 0 : (uint64_t)(SR(B) % SR(C));
+        NEXT();
+    OP(NEG):    R[A] = 0 - R[B]; NEXT();
+    OP(AND):    R[A] = R[B] & R[C]; NEXT();
+    OP(OR):     R[A] = R[B] | R[C]; NEXT();
+    OP(XOR):    R[A] = R[B] ^ R[C]; NEXT();
+    OP(SHL):    R[A] = R[B] << (R[C] & 63); NEXT();
+    OP(SHR):    R[A] = R[B] >> (R[C] & 63); NEXT();
+    OP(SAR):    R[A] = (uint64_t)(SR(B) >> (R[C] & 63)); NEXT();
+    OP(NOT):    R[A] = ~R[B]; NEXT();
+    OP(EQ):     R[A] = R[B] == R[C]; NEXT();
+    OP(NE):     R[A] = R[B] != R[C]; NEXT();
+    OP(LT):     R[A] = SR(B) < SR(C); NEXT();
+    OP(LE):     R[A] = SR(B) <= SR(C); NEXT();
+    OP(GT):     R[A] = SR(B) > SR(C); NEXT();
+    OP(GE):     R[A] = SR(B) >= SR(C); NEXT();
+    OP(FADD):   R[A] = real_bits(FR(B) + FR(C)); NEXT();
+    OP(FSUB):   R[A] = real_bits(FR(B) - FR(C)); NEXT();
+    OP(FMUL):   R[A] = real_bits(FR(B) * FR(C)); NEXT();
+    OP(FDIV):   R[A] = real_bits(FR(B) / FR(C)); NEXT();
+    OP(FMOD):   R[A] = real_bits(fmod(FR(B), FR(C))); NEXT();
+    OP(FNEG):   R[A] = real_bits(-FR(B)); NEXT();
+    OP(FEQ):    R[A] = FR(B) == FR(C); NEXT();
+    OP(FNE):    R[A] = FR(B) != FR(C); NEXT();
+    OP(FLT):    R[A] = FR(B) < FR(C); NEXT();
+    OP(FLE):    R[A] = FR(B) <= FR(C); NEXT();
+    OP(FGT):    R[A] = FR(B) > FR(C); NEXT();
+    OP(FGE):    R[A] = FR(B) >= FR(C); NEXT();
+    OP(ITOF):   R[A] = real_bits((double)SR(B)); NEXT();
+    OP(FTOI): {
+        double r = FR(B);
+        R[A] = r != r ? 0 : r >= 9223372036854775807.0 ? (uint64_t)INT64_MAX
+             : r <= -9223372036854775808.0 ? (uint64_t)INT64_MIN : (uint64_t)(int64_t)r;
+        NEXT();
+    }
+    OP(FROUND): R[A] = real_bits((double)(float)FR(B)); NEXT();
+    OP(FBITS4): { float f = (float)FR(B); uint32_t u; memcpy(&u, &f, 4); R[A] = u; NEXT(); }
+    OP(SEXT): {
+        unsigned shift = 64 - D * 8;
+        R[A] = (uint64_t)((int64_t)(R[B] << shift) >> shift);
+        NEXT();
+    }
+    OP(ZEXT):   R[A] = R[B] & ((UINT64_C(1) << (D * 8)) - 1); NEXT();
+    OP(LD8):    memcpy(&R[A], PTR(B), 8); NEXT();
+    OP(LD4):    { int32_t v; memcpy(&v, PTR(B), 4); R[A] = (uint64_t)(int64_t)v; NEXT(); }
+    OP(LD2):    { int16_t v; memcpy(&v, PTR(B), 2); R[A] = (uint64_t)(int64_t)v; NEXT(); }
+    OP(LD1):    R[A] = (uint64_t)(int64_t)(int8_t)*PTR(B); NEXT();
+    OP(LDU1):   R[A] = *PTR(B); NEXT();
+    OP(LDF4):   { float v; memcpy(&v, PTR(B), 4); R[A] = real_bits(v); NEXT(); }
+    OP(ST8):    memcpy(PTR(A), &R[B], 8); NEXT();
+    OP(ST4):    { uint32_t v = (uint32_t)R[B]; memcpy(PTR(A), &v, 4); NEXT(); }
+    OP(ST2):    { uint16_t v = (uint16_t)R[B]; memcpy(PTR(A), &v, 2); NEXT(); }
+    OP(ST1):    *PTR(A) = (uint8_t)R[B]; NEXT();
+    OP(STF4):   { float v = (float)FR(B); memcpy(PTR(A), &v, 4); NEXT(); }
+    OP(LDX): {
+        static const uint8_t width[] = { [OP_LD8] = 8, [OP_LD4] = 4, [OP_LD2] = 2, [OP_LD1] = 1,
+                                         [OP_LDU1] = 1, [OP_LDF4] = 4 };
+        if (!in_locals(in, sp, R[B], width[D])) TRAP(ERROR_CODE_RUNTIME_OUT_OF_BOUNDS, "Load outside the stack");
+        uint8_t *p = PTR(B);
+        switch ((InterpOp)D) {
+            case OP_LD4:  { int32_t v; memcpy(&v, p, 4); R[A] = (uint64_t)(int64_t)v; break; }
+            case OP_LD2:  { int16_t v; memcpy(&v, p, 2); R[A] = (uint64_t)(int64_t)v; break; }
+            case OP_LD1:  R[A] = (uint64_t)(int64_t)(int8_t)*p; break;
+            case OP_LDU1: R[A] = *p; break;
+            case OP_LDF4: { float v; memcpy(&v, p, 4); R[A] = real_bits(v); break; }
+            default:      memcpy(&R[A], p, 8); break;
+        }
+        NEXT();
+    }
+    OP(STX): {
+        static const uint8_t width[] = { [OP_ST8] = 8, [OP_ST4] = 4, [OP_ST2] = 2, [OP_ST1] = 1,
+                                         [OP_STF4] = 4 };
+        if (!in_locals(in, sp, R[A], width[D])) TRAP(ERROR_CODE_RUNTIME_OUT_OF_BOUNDS, "Store outside the stack");
+        uint8_t *p = PTR(A);
+        switch ((InterpOp)D) {
+            case OP_ST4:  { uint32_t v = (uint32_t)R[B]; memcpy(p, &v, 4); break; }
+            case OP_ST2:  { uint16_t v = (uint16_t)R[B]; memcpy(p, &v, 2); break; }
+            case OP_ST1:  *p = (uint8_t)R[B]; break;
+            case OP_STF4: { float v = (float)FR(B); memcpy(p, &v, 4); break; }
+            default:      memcpy(p, &R[B], 8); break;
+        }
+        NEXT();
+    }
+    OP(ADDR):   R[A] = (uint64_t)(uintptr_t)(fp->mem + D); NEXT();
+    OP(ALLOCA): {
+        uint64_t size = (R[B] + FRAME_ALIGN - 1) & ~(uint64_t)(FRAME_ALIGN - 1);
+        if (R[B] > (uint64_t)(mem_end - sp) || size > (uint64_t)(mem_end - sp))
+            TRAP(ERROR_CODE_RUNTIME_STACK_OVERFLOW, "Stack overflow allocating %llu bytes", (unsigned long long)R[B]);
+        R[A] = (uint64_t)(uintptr_t)sp;
+        sp += size;
+        NEXT();
+    }
+    OP(GEP):    R[A] = R[B] + R[C] * D; NEXT();
+    OP(GEPI):   R[A] = R[B] + (uint64_t)(int64_t)(int32_t)D; NEXT();
+    OP(SELECT): R[A] = R[B] ? R[C] : R[D]; NEXT();
+    OP(JMP):
+        if (--fuel == 0) goto out_of_fuel;
+        pc = fp->code->insns + A;
+        NEXT();
+    OP(JCC):
+        if (--fuel == 0) goto out_of_fuel;
+        pc = fp->code->insns + (R[A] ? B : C);
+        NEXT();
+    OP(CALL): {
+        Code *callee = &in->codes[B];
+        if (!callee->decoded && !decode_function(in, callee))
+            TRAP(ERROR_CODE_IR_MEMORY_ALLOCATION, "Cannot decode '%s'", callee->func->name);
+        if (--fuel == 0) goto out_of_fuel;
+        uint64_t *nr = R + fp->code->reg_count;
+        uint8_t *mem = sp;
+        if (fp + 1 == frame_end || callee->reg_count > (size_t)(reg_end - nr) ||
+            callee->frame_bytes > (size_t)(mem_end - mem))
+            TRAP(ERROR_CODE_RUNTIME_STACK_OVERFLOW, "Stack overflow calling '%s'", callee->func->name);
+        const uint32_t *args = fp->code->args + C;
+        uint32_t n = D < callee->param_count ? D : callee->param_count;
+        for (uint32_t i = 0; i < n; i++) nr[i] = R[args[i]];
+        for (uint32_t i = n; i < callee->param_count; i++) nr[i] = 0;
+        if (callee->const_count) memcpy(nr + callee->const_base, callee->consts, callee->const_count * sizeof(uint64_t));
+        fp++;
+        fp->code = callee;
+        fp->ret = pc;
+        fp->regs = nr;
+        fp->mem = mem;
+        fp->sp = sp;
+        fp->result = A;
+        sp = mem + ((callee->frame_bytes + FRAME_ALIGN - 1) & ~(uint32_t)(FRAME_ALIGN - 1));
+        R = nr;
+        pc = callee->insns + callee->entry;
+        NEXT();
+    }
+    OP(RET): {
+        uint64_t v = R[A];
+        sp = fp->sp;
+        if (fp == base) { *result = v; goto done; }
+        uint32_t res = fp->result;
+        pc = fp->ret;
+        fp--;
+        R = fp->regs;
+        if (res != NO_REG) R[res] = v;
+        NEXT();
+    }
+    OP(RETV): {
+        sp = fp->sp;
+        if (fp == base) { *result = 0; goto done; }
+        uint32_t res = fp->result;
+        pc = fp->ret;
+        fp--;
+        R = fp->regs;
+        if (res != NO_REG) R[res] = 0;
+        NEXT();
+    }
+    OP(MEMSET): {
+        uint64_t count = R[C], size = D;
+        if (in->opts.sandboxed && (count > MEM_STACK_BYTES || !in_locals(in, sp, R[A], count * size)))
+            TRAP(ERROR_CODE_RUNTIME_OUT_OF_BOUNDS, "memset outside the stack");
+        uint8_t *p = PTR(A);
+        uint64_t v = R[B];
+        if (size == 1 || v == 0) memset(p, (int)(uint8_t)v, count * size);
+        else for (uint64_t i = 0; i < count; i++) memcpy(p + i * size, &v, size > 8 ? 8 : size);
+        NEXT();
+    }
+    OP(MEMCPY): {
+        uint64_t bytes = R[C] * D;
+        if (in->opts.sandboxed && (R[C] > MEM_STACK_BYTES || !in_locals(in, sp, R[A], bytes) ||
+                                   !in_locals(in, sp, R[B], bytes)))
+            TRAP(ERROR_CODE_RUNTIME_OUT_OF_BOUNDS, "memcpy outside the stack");
+        /* Ascending copy, like the loop it replaced, even when overlapping. */
+        uint8_t *dst = PTR(A);
+        const uint8_t *src = PTR(B);
+        if (dst <= src || dst >= src + bytes) memmove(dst, src, bytes);
+        else for (uint64_t i = 0; i < bytes; i++) dst[i] = src[i];
+        NEXT();
+    }
+    OP(ALLOC): {
+        uint64_t size = R[B] ? R[B] : 1, align = R[C];
+        void *p;
+        if (align > 16 && (align & (align - 1)) == 0) {
+            p = aligned_alloc(align, (size + align - 1) & ~(align - 1));
+            if (p) memset(p, 0, size);
+        } else {
+            p = calloc(1, size);
+        }
+        R[A] = (uint64_t)(uintptr_t)p;
+        NEXT();
+    }
+    OP(REALLOC): R[A] = (uint64_t)(uintptr_t)realloc(PTR(B), R[C] ? R[C] : 1); NEXT();
+    OP(FREE):   free(PTR(A)); NEXT();
+    OP(SIGNAL): {
+        uint64_t args[8] = { 0 };
+        uint32_t n = D < 8 ? D : 8;
+        for (uint32_t i = 0; i < n; i++) args[i] = R[fp->code->args[C + i]];
+        if (!interp__service(&in->services, args, n, &exited, &exit_status))
+            TRAP(ERROR_CODE_RUNTIME_UNSUPPORTED, "Unsupported service %llu", (unsigned long long)args[0]);
+        if (exited) goto done;
+        NEXT();
+    }
+    OP(HALT):
+        exited = true;
+        exit_status = 0;
+        goto done;
+    OP(PROFDUMP):
+        if (in->mod->profile) profile__write(in->mod, in->counters);
+        NEXT();
+    OP(TRAP):
+        if (A == TRAP_UNDEFINED)
+            TRAP(ERROR_CODE_RUNTIME_UNDEFINED_CALL, "Call to undefined function '%s'", fp->code->names[B]);
+        if (A == TRAP_SANDBOX)
+            TRAP(ERROR_CODE_RUNTIME_UNSUPPORTED, "Not allowed at compile time");
+        TRAP(ERROR_CODE_RUNTIME_UNSUPPORTED, "Unsupported IR opcode %u", B);
+#ifndef INTERP_THREADED
+    default:
+        TRAP(ERROR_CODE_RUNTIME_UNSUPPORTED, "Bad bytecode");
+    }
+#endif
+
+out_of_fuel:
+    status = INTERP_OUT_OF_FUEL;
+    snprintf(in->trap, sizeof in->trap, "Evaluation ran out of steps");
+done:
+    in->steps += initial_fuel - fuel;
+    if (exited) {
+        *result = (uint64_t)exit_status;
+        return INTERP_EXITED;
+    }
+    return status;
+#undef A
+#undef B
+#undef C
+#undef D
+#undef SR
+#undef FR
+#undef PTR
+#undef TRAP
+#undef OP
+#undef NEXT
+}
+
+/* ---------------------------------------------------------------- interface */
+
+IrInterp *interp__create(IrModule *mod, const InterpOptions *opts) {
+    IrInterp *in = calloc(1, sizeof(IrInterp));
+    if (!in) goto fail;
+    in->mod = mod;
+    if (opts) in->opts = *opts;
+    in->services = interp__services(in->opts.target_arch);
+    execute(NULL, NULL, NULL, &in->handlers);
+    uint32_t n = mod->func_count;
+    in->codes = calloc(n ? n : 1, sizeof(Code));
+    if (!in->codes || !lower__module_init(&in->lm, mod)) goto fail;
+    for (uint32_t i = 0; i < n; i++) in->codes[i].func = mod->functions[i];
+    if (mod->profile) {
+        in->counters = calloc(mod->profile->counter_count ? mod->profile->counter_count : 1, sizeof(uint64_t));
+        if (!in->counters) goto fail;
+    }
+    bool sandboxed = in->opts.sandboxed;
+    in->reg_slots = sandboxed ? SANDBOX_REG_SLOTS : REG_STACK_SLOTS;
+    in->mem_bytes = sandboxed ? SANDBOX_MEM_BYTES : MEM_STACK_BYTES;
+    in->max_depth = sandboxed ? SANDBOX_CALL_DEPTH : MAX_CALL_DEPTH;
+    in->regs = malloc(in->reg_slots * sizeof(uint64_t));
+    in->mem = aligned_alloc(FRAME_ALIGN, in->mem_bytes);
+    in->frames = malloc(in->max_depth * sizeof(Frame));
+    if (!in->regs || !in->mem || !in->frames) goto fail;
+    return in;
+fail:
+    errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "interp",
+                             "Failed to allocate the interpreter");
+    interp__destroy(in);
+    return NULL;
+}
+
+void interp__destroy(IrInterp *in) {
+    if (!in) return;
+    if (in->codes) {
+        for (uint32_t i = 0; i < in->mod->func_count; i++) {
+            Code *c = &in->codes[i];
+            free(c->insns); free(c->pos); free(c->args); free(c->names); free(c->consts);
+        }
+    }
+    free(in->codes);
+    lower__module_fini(&in->lm);
+    free(in->counters);
+    free(in->regs);
+    free(in->mem);
+    free(in->frames);
+    free(in);
+}
+
+InterpStatus interp__call
+    ( IrInterp *in
+    , const IrFunction *func
+    , const InterpValue *args
+    , uint32_t argc
+    , InterpValue *result
+) {
+    uint32_t index = lower__find_function(&in->lm, func->name);
+    if (index == UINT32_MAX || in->mod->functions[index] != func) {
+        set_trap(in, ERROR_CODE_RUNTIME_UNDEFINED_CALL, NULL, NULL,
+                 "'%s' is not a function of the module", func->name);
+        return INTERP_TRAPPED;
+    }
+    Code *code = &in->codes[index];
+    if (!decode_function(in, code)) return INTERP_TRAPPED;
+    if (code->reg_count > in->reg_slots || code->frame_bytes > in->mem_bytes) {
+        set_trap(in, ERROR_CODE_RUNTIME_STACK_OVERFLOW, NULL, NULL, "Stack overflow calling '%s'", func->name);
+        return INTERP_TRAPPED;
+    }
+    uint64_t *regs = in->regs;
+    for (uint32_t i = 0; i < code->param_count; i++) {
+        bool real = func->parameters[i]->type == TYPE_REAL;
+        if (i >= argc) regs[i] = 0;
+        else if (real) regs[i] = real_bits(args[i].is_real ? args[i].r : (double)args[i].i);
+        else regs[i] = args[i].is_real ? (uint64_t)(int64_t)args[i].r : (uint64_t)args[i].i;
+    }
+    if (code->const_count) memcpy(regs + code->const_base, code->consts, code->const_count * sizeof(uint64_t));
+    Frame *base = in->frames;
+    *base = (Frame){ code, NULL, regs, in->mem, in->mem, NO_REG };
+    uint64_t bits = 0;
+    InterpStatus status = execute(in, base, &bits, NULL);
+    if (result) {
+        bool real = status == INTERP_RETURNED && code->returns_real;
+        result->is_real = real;
+        result->r = real ? bits_real(bits) : 0.0;
+        result->i = real ? 0 : (int64_t)bits;
+    }
+    return status;
+}
+
+uint64_t interp__steps(const IrInterp *in) {
+    return in ? in->steps : 0;
+}
+
+int interp__run_main(IrModule *mod, const char *target_arch, uint64_t *steps) {
+    const IrFunction *entry = NULL;
+    for (uint32_t i = 0; i < mod->func_count && !entry; i++)
+        if (strcmp(mod->functions[i]->name, "main") == 0) entry = mod->functions[i];
+    if (!entry) {
+        errhandler__report_error(ERROR_CODE_RUNTIME_NO_ENTRY, 0, 0, "interp",
+                                 "No 'main' function to run");
+        return -1;
+    }
+    InterpOptions opts = { false, 0, target_arch };
+    IrInterp *in = interp__create(mod, &opts);
+    if (!in) return -1;
+    InterpValue result;
+    InterpStatus status = interp__call(in, entry, NULL, 0, &result);
+    if (steps) *steps = interp__steps(in);
+    interp__destroy(in);
+    fflush(stdout);
+    if (status != INTERP_RETURNED && status != INTERP_EXITED) return -1;
+    return (int)(result.is_real ? (int64_t)result.r : result.i) & 0xFF;
+}
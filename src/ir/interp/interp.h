@@ -0,0 +1,100 @@
+#ifndef INTERP_H
+#define INTERP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../ir.h"
+
+/*
+ * IR interpreter.  Each function is decoded, on its first call, into a
+ * register bytecode: every parameter, temp and constant of the function
+ * has a slot in its frame, constants are copied in on entry, phis become
+ * moves on the edges into their block, and each instruction holds the
+ * address of its handler, so dispatch is one indirect jump (computed goto
+ * under GCC and Clang, a switch elsewhere).  Calls between IR functions
+ * use frames on the interpreter's own stacks, never the C stack.
+ *
+ * Values are 64 bits: integers and pointers as integers, Real as a
+ * double.  Pointers are host addresses.  Locals live on a separate memory
+ * stack, `alloc` and friends use the C heap, and `signal` goes through a
+ * small shim that understands the read, write, exit and exit_group
+ * services of the target (Linux numbering, x86-64 or the generic one used
+ * by AArch64), with the service number as the first argument.
+ *
+ * A sandboxed interpreter, used to evaluate calls at compile time, only
+ * lets a program touch its own locals: loads and stores are checked, and
+ * runtime calls, calls to functions outside the module and traps all stop
+ * the evaluation quietly instead of being reported.
+ */
+
+/* Steps, taken branches and calls, a compile-time evaluation may run. */
+#define INTERP_CONST_EVAL_FUEL (1U << 20)
+
+typedef struct IrInterp IrInterp;
+
+typedef struct {
+    bool        sandboxed;
+    uint64_t    fuel;           /* steps before giving up, 0 for no limit */
+    const char *target_arch;    /* service numbering for signal, NULL for the host */
+} InterpOptions;
+
+typedef enum {
+    INTERP_RETURNED,            /* the function returned */
+    INTERP_EXITED,              /* the program called exit or halt */
+    INTERP_TRAPPED,             /* a runtime error, reported unless sandboxed */
+    INTERP_OUT_OF_FUEL
+} InterpStatus;
+
+/* An argument or result; is_real selects the member. */
+typedef struct {
+    bool    is_real;
+    int64_t i;
+    double  r;
+} InterpValue;
+
+IrInterp    *interp__create(IrModule *mod, const InterpOptions *opts);
+void         interp__destroy(IrInterp *in);
+
+/*
+ * Call func, a function of the interpreter's module, with argc arguments,
+ * converted to the parameter types.  On INTERP_RETURNED result holds the
+ * return value (0 for a Void function); on INTERP_EXITED result.i is the
+ * exit status.
+ */
+InterpStatus interp__call
+    ( IrInterp *in
+    , const IrFunction *func
+    , const InterpValue *args
+    , uint32_t argc
+    , InterpValue *result
+);
+
+/* Service numbers of the `signal` shim for a target. */
+typedef struct {
+    uint64_t read, write, exit, exit_group;
+} InterpServices;
+
+/* Numbering for target_arch, or for the host when it is NULL. */
+InterpServices interp__services(const char *target_arch);
+
+/*
+ * Run the service args[0] with the arguments that follow.  Returns false
+ * for a service the shim does not provide; sets *exited and *status when
+ * the service ends the program.  Shared with the JIT's runtime.
+ */
+bool         interp__service
+    ( const InterpServices *services
+    , const uint64_t *args
+    , uint32_t argc
+    , bool *exited
+    , int64_t *status
+);
+
+/* Steps run so far, over every call. */
+uint64_t     interp__steps(const IrInterp *in);
+
+/* Run main and return the program's exit status, or -1 after reporting
+ * that it could not run to the end. */
+int          interp__run_main(IrModule *mod, const char *target_arch, uint64_t *steps);
+
+#endif
@@ -0,0 +1,712 @@
+#include "ipa.h"
+#include "../analysis/analysis.h"
+#include "../remark/remark.h"
+#include "../../errhandler/errhandler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Functions of a module by interned name, for resolving callees. */
+typedef struct {
+    const char *name;
+    uint32_t    index;          /* position in mod->functions */
+} FuncEntry;
+
+typedef struct {
+    FuncEntry *entries;
+    uint32_t   count;
+} FuncIndex;
+
+static int compare_entries(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)((const FuncEntry *)a)->name;
+    uintptr_t y = (uintptr_t)((const FuncEntry *)b)->name;
+    return x < y ? -1 : x > y;
+}
+
+static bool index_build(FuncIndex *ix, const IrModule *mod) {
+    ix->count = mod->func_count;
+    ix->entries = malloc((ix->count ? ix->count : 1) * sizeof(FuncEntry));
+    if (!ix->entries) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "ipa",
+                                 "Failed to index module functions");
+        return false;
+    }
+    for (uint32_t i = 0; i < ix->count; i++) {
+        ix->entries[i].name = mod->functions[i]->name;
+        ix->entries[i].index = i;
+    }
+    qsort(ix->entries, ix->count, sizeof(FuncEntry), compare_entries);
+    return true;
+}
+
+/* Position of the function a global symbol names, or UINT32_MAX.  Names
+ * are interned in the module pool, so they compare by address. */
+static uint32_t index_find(const FuncIndex *ix, const IrValue *v) {
+    if (!v || v->kind != IR_VALUE_GLOBAL_SYMBOL) return UINT32_MAX;
+    FuncEntry key = { v->name, 0 };
+    const FuncEntry *e = bsearch(&key, ix->entries, ix->count, sizeof(FuncEntry), compare_entries);
+    return e ? e->index : UINT32_MAX;
+}
+
+/* Callee of inst if it is a direct call to a function of the module. */
+static uint32_t direct_callee(const FuncIndex *ix, const IrInstruction *inst) {
+    return inst->opcode == IR_CALL ? index_find(ix, inst->operand1) : UINT32_MAX;
+}
+
+static bool is_constant(const IrValue *v) {
+    return v && (v->kind == IR_VALUE_CONST_INT || v->kind == IR_VALUE_CONST_REAL ||
+                 v->kind == IR_VALUE_CONST_CHAR || v->kind == IR_VALUE_GLOBAL_SYMBOL);
+}
+
+static uint32_t function_size(const IrFunction *func) {
+    uint32_t size = 0;
+    for (uint32_t i = 0; i < func->block_count; i++)
+        for (const IrInstruction *inst = func->all_blocks[i]->first_inst; inst; inst = inst->next)
+            size++;
+    return size;
+}
+
+/* Per function facts gathered in one walk over the module. */
+typedef struct {
+    uint32_t sites;             /* direct calls */
+    bool     address_taken;     /* named other than as a callee */
+    bool     mismatched;        /* called with the wrong number of arguments */
+} CallFacts;
+
+typedef struct {
+    const FuncIndex *ix;
+    IrInstruction   *inst;
+    CallFacts       *facts;
+} RefScan;
+
+static void note_reference(IrValue **slot, void *ctx) {
+    RefScan *scan = ctx;
+    if (slot == &scan->inst->operand1 && scan->inst->opcode == IR_CALL) return;
+    uint32_t target = index_find(scan->ix, *slot);
+    if (target != UINT32_MAX) scan->facts[target].address_taken = true;
+}
+
+static CallFacts *gather_call_facts(const IrModule *mod, const FuncIndex *ix) {
+    CallFacts *facts = calloc(mod->func_count ? mod->func_count : 1, sizeof(CallFacts));
+    if (!facts) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "ipa",
+                                 "Failed to allocate call graph facts");
+        return NULL;
+    }
+    RefScan scan = { ix, NULL, facts };
+    for (uint32_t f = 0; f < mod->func_count; f++) {
+        const IrFunction *func = mod->functions[f];
+        for (uint32_t b = 0; b < func->block_count; b++) {
+            for (IrInstruction *inst = func->all_blocks[b]->first_inst; inst; inst = inst->next) {
+                uint32_t callee = direct_callee(ix, inst);
+                if (callee != UINT32_MAX) {
+                    const IrCallExtra *call = inst->extra;
+                    facts[callee].sites++;
+                    if ((call ? call->arg_count : 0) != mod->functions[callee]->param_count)
+                        facts[callee].mismatched = true;
+                }
+                scan.inst = inst;
+                ir__inst_for_each_operand(inst, note_reference, &scan);
+            }
+        }
+    }
+    return facts;
+}
+
+uint32_t ipa__internalize(IrModule *mod, const char *const *exported, uint32_t count) {
+    if (!mod) return 0;
+    uint32_t marked = 0;
+    for (uint32_t i = 0; i < mod->func_count; i++) {
+        IrFunction *func = mod->functions[i];
+        bool keep = false;
+        for (uint32_t j = 0; j < count && !keep; j++) keep = strcmp(func->name, exported[j]) == 0;
+        if (!keep && !func->is_internal) {
+            func->is_internal = true;
+            marked++;
+        }
+    }
+    return marked;
+}
+
+/* ---------------------------------------------------- dead functions */
+
+typedef struct {
+    const FuncIndex *ix;
+    bool            *live;
+    uint32_t        *worklist;
+    uint32_t         count;
+} LiveScan;
+
+static void mark_referenced(IrValue **slot, void *ctx) {
+    LiveScan *scan = ctx;
+    uint32_t target = index_find(scan->ix, *slot);
+    if (target == UINT32_MAX || scan->live[target]) return;
+    scan->live[target] = true;
+    scan->worklist[scan->count++] = target;
+}
+
+uint32_t ipa__remove_dead_functions(IrModule *mod) {
+    if (!mod || mod->func_count == 0) return 0;
+    FuncIndex ix;
+    if (!index_build(&ix, mod)) return 0;
+    LiveScan scan = { &ix, calloc(mod->func_count, sizeof(bool)),
+                      malloc(mod->func_count * sizeof(uint32_t)), 0 };
+    uint32_t removed = 0;
+    if (!scan.live || !scan.worklist) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "ipa",
+                                 "Failed to allocate dead function worklist");
+        goto done;
+    }
+    for (uint32_t i = 0; i < mod->func_count; i++) {
+        if (mod->functions[i]->is_internal) continue;
+        scan.live[i] = true;
+        scan.worklist[scan.count++] = i;
+    }
+    while (scan.count > 0) {
+        const IrFunction *func = mod->functions[scan.worklist[--scan.count]];
+        for (uint32_t b = 0; b < func->block_count; b++)
+            for (IrInstruction *inst = func->all_blocks[b]->first_inst; inst; inst = inst->next)
+                ir__inst_for_each_operand(inst, mark_referenced, &scan);
+    }
+    for (uint32_t i = mod->func_count; i-- > 0;) {
+        if (scan.live[i]) continue;
+        ir__module_remove_function(mod, mod->functions[i]);
+        removed++;
+    }
+done:
+    free(scan.live);
+    free(scan.worklist);
+    free(ix.entries);
+    return removed;
+}
+
+/* ------------------------------------------------ constant propagation */
+
+/* The constant every return of func yields, or NULL. */
+static IrValue *returned_constant(const IrFunction *func) {
+    IrValue *result = NULL;
+    for (uint32_t b = 0; b < func->block_count; b++) {
+        const IrBasicBlock *bb = func->all_blocks[b];
+        const IrInstruction *term = ir__block_terminator(bb);
+        if (!term) {
+            if (bb->succ_count == 0) return NULL;   /* falls off the end */
+            continue;
+        }
+        if (term->opcode != IR_RET) continue;
+        if (!is_constant(term->operand1) || (result && result != term->operand1)) return NULL;
+        result = term->operand1;
+    }
+    return result;
+}
+
+uint32_t ipa__propagate_constants(IrModule *mod) {
+    if (!mod || mod->func_count == 0) return 0;
+    FuncIndex ix;
+    if (!index_build(&ix, mod)) return 0;
+    uint32_t n = mod->func_count, replaced = 0;
+    CallFacts *facts = gather_call_facts(mod, &ix);
+    /* Per function, the argument passed at every call to each parameter:
+     * NULL before the first call, args[i] while they agree, conflict after. */
+    IrValue ***args = calloc(n, sizeof(IrValue **));
+    IrValue  **returned = calloc(n, sizeof(IrValue *));
+    IrValue conflict;
+    if (!facts || !args || !returned) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "ipa",
+                                 "Failed to allocate constant propagation state");
+        goto done;
+    }
+    for (uint32_t f = 0; f < n; f++) {
+        const IrFunction *func = mod->functions[f];
+        if (!func->is_internal || facts[f].address_taken || facts[f].mismatched || !facts[f].sites)
+            continue;
+        if (func->param_count && !(args[f] = calloc(func->param_count, sizeof(IrValue *)))) {
+            errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "ipa",
+                                     "Failed to allocate constant propagation state");
+            goto done;
+        }
+        returned[f] = returned_constant(func);
+    }
+    for (uint32_t f = 0; f < n; f++) {
+        const IrFunction *func = mod->functions[f];
+        for (uint32_t b = 0; b < func->block_count; b++) {
+            for (IrInstruction *inst = func->all_blocks[b]->first_inst; inst; inst = inst->next) {
+                uint32_t callee = direct_callee(&ix, inst);
+                if (callee == UINT32_MAX || !args[callee]) continue;
+                const IrCallExtra *call = inst->extra;
+                for (uint32_t i = 0; i < mod->functions[callee]->param_count; i++) {
+                    IrValue *arg = call->args[i];
+                    IrValue **seen = &args[callee][i];
+                    if (!is_constant(arg)) *seen = &conflict;
+                    else if (!*seen) *seen = arg;
+                    else if (*seen != arg) *seen = &conflict;
+                }
+            }
+        }
+    }
+    for (uint32_t f = 0; f < n; f++) {
+        IrFunction *func = mod->functions[f];
+        if (!args[f]) continue;
+        bool changed = false;
+        for (uint32_t i = 0; i < func->param_count; i++) {
+            IrValue *param = func->parameters[i];
+            if (!args[f][i] || args[f][i] == &conflict || !param->uses) continue;
+            ir__replace_all_uses_with(param, args[f][i]);
+            replaced++;
+            changed = true;
+        }
+        if (changed) analysis__invalidate(func, IR_PRESERVE_CFG);
+    }
+    for (uint32_t f = 0; f < n; f++) {
+        IrFunction *func = mod->functions[f];
+        bool changed = false;
+        for (uint32_t b = 0; b < func->block_count; b++) {
+            for (IrInstruction *inst = func->all_blocks[b]->first_inst; inst; inst = inst->next) {
+                uint32_t callee = direct_callee(&ix, inst);
+                if (callee == UINT32_MAX || !returned[callee] || !inst->result || !inst->result->uses)
+                    continue;
+                ir__replace_all_uses_with(inst->result, returned[callee]);
+                replaced++;
+                changed = true;
+            }
+        }
+        if (changed) analysis__invalidate(func, IR_PRESERVE_CFG);
+    }
+done:
+    if (args) for (uint32_t f = 0; f < n; f++) free(args[f]);
+    free(args);
+    free(returned);
+    free(facts);
+    free(ix.entries);
+    return replaced;
+}
+
+/* ------------------------------------------------------------ inlining */
+
+/* Copy of one callee body being made inside a caller. */
+typedef struct {
+    IrFunction     *caller;
+    IrFunction     *callee;
+    IrValue       **args;
+    IrValue       **temps;          /* by callee temp id */
+    IrBasicBlock  **blocks;         /* by callee block id */
+    bool            ok;
+} InlineMap;
+
+static IrBasicBlock *map_block(InlineMap *m, IrBasicBlock *bb);
+
+static IrValue *map_value(InlineMap *m, IrValue *v) {
+    if (!v) return NULL;
+    switch (v->kind) {
+        case IR_VALUE_TEMP:
+            if (v->id >= m->callee->next_temp_id) break;
+            if (!m->temps[v->id] && !(m->temps[v->id] = ir__value_temp(m->caller, v->type, v->type_info)))
+                m->ok = false;
+            return m->temps[v->id];
+        case IR_VALUE_PARAM:
+            if (v->id >= m->callee->param_count) break;
+            return m->args[v->id];
+        case IR_VALUE_LABEL: {
+            IrBasicBlock *bb = map_block(m, v->const_data.block);
+            IrValue *label = bb ? ir__value_label(bb) : NULL;
+            if (!label) m->ok = false;
+            return label;
+        }
+        default:
+            return v;
+    }
+    m->ok = false;
+    return NULL;
+}
+
+static IrBasicBlock *map_block(InlineMap *m, IrBasicBlock *bb) {
+    if (bb && bb->function == m->callee && bb->id < m->callee->next_block_id && m->blocks[bb->id])
+        return m->blocks[bb->id];
+    m->ok = false;
+    return NULL;
+}
+
+static IrValue **map_values(InlineMap *m, IrValue **values, uint32_t count) {
+    IrValue **copy = u__arena_alloc(&m->caller->arena, (count ? count : 1) * sizeof(IrValue *));
+    if (!copy) { m->ok = false; return NULL; }
+    for (uint32_t i = 0; i < count; i++) copy[i] = map_value(m, values[i]);
+    return copy;
+}
+
+/* A copy of inst with its operands mapped; returns are handled by the caller. */
+static IrInstruction *clone_instruction(InlineMap *m, const IrInstruction *inst) {
+    IrFunction *caller = m->caller;
+    IrValue *res = map_value(m, inst->result);
+    IrValue *op1 = map_value(m, inst->operand1);
+    IrValue *op2 = map_value(m, inst->operand2);
+    IrInstruction *copy = NULL;
+    if (!inst->extra) {
+        copy = ir__inst_create(caller, inst->opcode, res, op1, op2);
+    } else if (inst->opcode == IR_CALL) {
+        const IrCallExtra *call = inst->extra;
+        IrValue **args = map_values(m, call->args, call->arg_count);
+        if (args) copy = ir__inst_create_call(caller, res, op1, args, call->arg_count);
+    } else if (inst->opcode == IR_SELECT) {
+        IrValue *fv = map_value(m, ((const IrSelectExtra *)inst->extra)->false_value);
+        copy = ir__inst_create_select(caller, res, op1, op2, fv);
+    } else if (inst->opcode == IR_MEMSET || inst->opcode == IR_MEMCPY) {
+        const IrMemExtra *mem = inst->extra;
+        copy = ir__inst_create_mem(caller, inst->opcode, op1, op2, map_value(m, mem->count), mem->elem_size);
+    } else if (inst->opcode == IR_GEP) {
+        const IrGepExtra *gep = inst->extra;
+        IrGepExtra *extra = u__arena_alloc(&caller->arena, sizeof(IrGepExtra));
+        if (extra) {
+            extra->index_count = gep->index_count;
+            extra->indices = map_values(m, gep->indices, gep->index_count);
+            if ((copy = ir__inst_create(caller, IR_GEP, res, op1, op2))) copy->extra = extra;
+        }
+    } else if (inst->opcode == IR_PHI) {
+        const IrPhiExtra *phi = inst->extra;
+        IrPhiExtra *extra = u__arena_alloc(&caller->arena, sizeof(IrPhiExtra));
+        IrBasicBlock **blocks = u__arena_alloc(&caller->arena, (phi->count ? phi->count : 1) * sizeof(IrBasicBlock *));
+        if (extra && blocks) {
+            extra->count = phi->count;
+            extra->values = map_values(m, phi->values, phi->count);
+            extra->blocks = blocks;
+            for (uint32_t i = 0; i < phi->count; i++) blocks[i] = map_block(m, phi->blocks[i]);
+            if ((copy = ir__inst_create(caller, IR_PHI, res, op1, op2))) copy->extra = extra;
+        }
+    } else if (inst->opcode == IR_BRCOND) {
+        const IrCondBranchExtra *br = inst->extra;
+        IrCondBranchExtra *extra = u__arena_alloc(&caller->arena, sizeof(IrCondBranchExtra));
+        if (extra) {
+            extra->true_target = map_block(m, br->true_target);
+            extra->false_target = map_block(m, br->false_target);
+            if ((copy = ir__inst_create(caller, IR_BRCOND, res, op1, op2))) copy->extra = extra;
+        }
+    }
+    if (!copy) { m->ok = false; return NULL; }
+    copy->line = inst->line;
+    copy->column = inst->column;
+    return copy;
+}
+
+static IrBasicBlock *add_block(IrFunction *func, const char *prefix, const char *label) {
+    char name[128];
+    snprintf(name, sizeof(name), "%s.%s", prefix, label);
+    return ir__function_add_block(func, name);
+}
+
+static IrInstruction *create_branch(IrFunction *func, IrBasicBlock *from, IrBasicBlock *to) {
+    IrValue *label = ir__value_label(to);
+    IrInstruction *br = label ? ir__inst_create(func, IR_BR, NULL, label, NULL) : NULL;
+    if (!br) return NULL;
+    ir__inst_append(from, br);
+    ir__block_link(from, to);
+    return br;
+}
+
+/* Phis of bb that take a value from old take it from new instead. */
+static void retarget_phis(IrBasicBlock *bb, IrBasicBlock *old, IrBasicBlock *new_pred) {
+    for (IrInstruction *inst = bb->first_inst; inst && inst->opcode == IR_PHI; inst = inst->next) {
+        IrPhiExtra *phi = inst->extra;
+        for (uint32_t i = 0; phi && i < phi->count; i++)
+            if (phi->blocks[i] == old) phi->blocks[i] = new_pred;
+    }
+}
+
+/* Move the instructions after call, and the outgoing edges, to a new block. */
+static IrBasicBlock *split_after(IrFunction *func, IrInstruction *call, const char *prefix) {
+    IrBasicBlock *bb = call->parent;
+    IrBasicBlock *cont = add_block(func, prefix, "ret");
+    if (!cont) return NULL;
+    cont->is_cold = bb->is_cold;
+    cont->exec_count = bb->exec_count;
+    while (call->next) {
+        IrInstruction *inst = call->next;
+        ir__inst_unlink(inst);
+        ir__inst_append(cont, inst);
+    }
+    while (bb->succ_count > 0) {
+        IrBasicBlock *succ = bb->successors[0];
+        ir__block_unlink(bb, succ);
+        ir__block_link(cont, succ);
+        retarget_phis(succ, bb, cont);
+    }
+    return cont;
+}
+
+/* Allocas of a constant size go to the caller's entry block, so a call in
+ * a loop does not grow the frame on every iteration. */
+static void hoist_allocas(IrFunction *caller, IrInstruction **allocas, uint32_t count) {
+    IrInstruction *anchor = caller->entry_block->first_inst;
+    for (uint32_t i = 0; i < count; i++) {
+        IrInstruction *inst = allocas[i];
+        if ((inst->operand1 && !is_constant(inst->operand1)) ||
+            (inst->operand2 && !is_constant(inst->operand2)) || inst == anchor)
+            continue;
+        ir__inst_unlink(inst);
+        if (anchor) ir__inst_insert_before(anchor, inst);
+        else ir__inst_append(caller->entry_block, inst);
+    }
+}
+
+static bool inline_call(IrFunction *caller, IrInstruction *call, IrFunction *callee) {
+    IrBasicBlock *bb = call->parent;
+    IrValue *result = call->result;
+    InlineMap m = { caller, callee, ((IrCallExtra *)call->extra)->args,
+                    calloc(callee->next_temp_id ? callee->next_temp_id : 1, sizeof(IrValue *)),
+                    calloc(callee->next_block_id ? callee->next_block_id : 1, sizeof(IrBasicBlock *)),
+                    true };
+    IrValue **ret_values = malloc(callee->block_count * sizeof(IrValue *));
+    IrBasicBlock **ret_blocks = malloc(callee->block_count * sizeof(IrBasicBlock *));
+    IrInstruction **allocas = NULL;
+    uint32_t ret_count = 0, alloca_count = 0, alloca_capacity = 0;
+    IrBasicBlock *cont = NULL;
+    if (!m.temps || !m.blocks || !ret_values || !ret_blocks) m.ok = false;
+    /* Counts of the copy are the callee's scaled to this call site. */
+    uint64_t entry_count = callee->entry_block->exec_count;
+    bool scale = caller->has_profile && callee->has_profile && entry_count > 0;
+    for (uint32_t i = 0; i < callee->block_count && m.ok; i++) {
+        IrBasicBlock *cb = callee->all_blocks[i];
+        IrBasicBlock *nb = add_block(caller, callee->name, cb->label);
+        if (!nb) { m.ok = false; break; }
+        nb->is_cold = cb->is_cold;
+        if (scale) nb->exec_count = (uint64_t)((double)cb->exec_count * bb->exec_count / entry_count);
+        m.blocks[cb->id] = nb;
+    }
+    if (m.ok) {
+        remark__emit("inline", call, "inlined '%s' into '%s'", callee->name, caller->name);
+        cont = split_after(caller, call, callee->name);
+        if (!cont) m.ok = false;
+    }
+    for (uint32_t i = 0; i < callee->block_count && m.ok; i++) {
+        IrBasicBlock *cb = callee->all_blocks[i];
+        IrBasicBlock *nb = m.blocks[cb->id];
+        for (uint32_t j = 0; j < cb->succ_count && m.ok; j++) {
+            IrBasicBlock *succ = map_block(&m, cb->successors[j]);
+            if (succ) ir__block_link(nb, succ);
+        }
+        for (const IrInstruction *inst = cb->first_inst; inst && m.ok; inst = inst->next) {
+            if (inst->opcode == IR_RET) {
+                ret_values[ret_count] = map_value(&m, inst->operand1);
+                ret_blocks[ret_count++] = nb;
+                if (!create_branch(caller, nb, cont)) m.ok = false;
+                break;
+            }
+            IrInstruction *copy = clone_instruction(&m, inst);
+            if (!copy) break;
+            ir__inst_append(nb, copy);
+            if (copy->opcode == IR_ALLOCA) {
+                if (alloca_count >= alloca_capacity) {
+                    uint32_t cap = alloca_capacity ? alloca_capacity * 2 : 8;
+                    IrInstruction **grown = realloc(allocas, cap * sizeof(IrInstruction *));
+                    if (!grown) { m.ok = false; break; }
+                    allocas = grown;
+                    alloca_capacity = cap;
+                }
+                allocas[alloca_count++] = copy;
+            }
+        }
+        /* A block that ends without a terminator returns nothing. */
+        if (m.ok && !ir__block_terminator(nb) && cb->succ_count == 0) {
+            ret_values[ret_count] = NULL;
+            ret_blocks[ret_count++] = nb;
+            if (!create_branch(caller, nb, cont)) m.ok = false;
+        }
+    }
+    if (m.ok) {
+        ir__inst_destroy(call);
+        if (!create_branch(caller, bb, m.blocks[callee->entry_block->id])) m.ok = false;
+    }
+    if (m.ok && result && result->uses) {
+        IrValue *zero = ir__value_const_int(caller->module, 0);
+        bool same = true;
+        for (uint32_t i = 0; i < ret_count; i++) {
+            if (!ret_values[i]) ret_values[i] = zero;
+            same = same && ret_values[i] == ret_values[0];
+        }
+        if (ret_count == 0 || same) {
+            ir__replace_all_uses_with(result, ret_count ? ret_values[0] : zero);
+        } else {
+            IrPhiExtra *phi = u__arena_alloc(&caller->arena, sizeof(IrPhiExtra));
+            IrInstruction *inst = ir__inst_create(caller, IR_PHI, result, NULL, NULL);
+            IrValue **values = u__arena_alloc(&caller->arena, ret_count * sizeof(IrValue *));
+            IrBasicBlock **blocks = u__arena_alloc(&caller->arena, ret_count * sizeof(IrBasicBlock *));
+            if (!phi || !inst || !values || !blocks) {
+                m.ok = false;
+            } else {
+                memcpy(values, ret_values, ret_count * sizeof(IrValue *));
+                memcpy(blocks, ret_blocks, ret_count * sizeof(IrBasicBlock *));
+                phi->values = values;
+                phi->blocks = blocks;
+                phi->count = ret_count;
+                inst->extra = phi;
+                if (cont->first_inst) ir__inst_insert_before(cont->first_inst, inst);
+                else ir__inst_append(cont, inst);
+            }
+        }
+    }
+    if (m.ok) hoist_allocas(caller, allocas, alloca_count);
+    if (!m.ok)
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "ipa",
+                                 "Failed to inline '%s' into '%s'", callee->name, caller->name);
+    free(m.temps);
+    free(m.blocks);
+    free(ret_values);
+    free(ret_blocks);
+    free(allocas);
+    return m.ok;
+}
+
+/* Operands the copy cannot express make a function unsuitable to inline. */
+static bool can_inline(const IrFunction *callee) {
+    for (uint32_t b = 0; b < callee->block_count; b++) {
+        for (const IrInstruction *inst = callee->all_blocks[b]->first_inst; inst; inst = inst->next) {
+            const IrValue *ops[3] = { inst->result, inst->operand1, inst->operand2 };
+            for (int i = 0; i < 3; i++)
+                if (ops[i] && (ops[i]->kind == IR_VALUE_NONE || ops[i]->kind == IR_VALUE_STRUCT_INIT))
+                    return false;
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    IrModule   *mod;
+    FuncIndex   ix;
+    CallFacts  *facts;
+    uint32_t   *size;
+    uint8_t    *state;          /* 0 unvisited, 1 on the walk's stack, 2 done */
+    uint32_t    threshold;
+    uint32_t    inlined;
+    /* Explicit stack of the walk: function, block and last instruction scanned. */
+    uint32_t       *stack;
+    uint32_t       *block;
+    IrInstruction **cursor;
+} Inliner;
+
+/*
+ * Under a profile a call the training run never reached is left alone, and
+ * one reached at least IPA_HOT_CALL_RATIO times per entry of its caller
+ * may inline a callee IPA_HOT_INLINE_FACTOR times the threshold.
+ */
+static bool worth_inlining(const Inliner *in, uint32_t caller, const IrInstruction *call, uint32_t callee) {
+    const IrFunction *f = in->mod->functions[callee];
+    const IrFunction *from = in->mod->functions[caller];
+    if (in->state[callee] != 2 || in->facts[callee].mismatched) return false;
+    if (in->size[caller] + in->size[callee] > IPA_MAX_INLINED_FUNCTION_SIZE) return false;
+    uint32_t threshold = in->threshold;
+    if (from->has_profile) {
+        uint64_t site = call->parent->exec_count, entry = from->entry_block->exec_count;
+        if (site == 0) return false;
+        if (entry > 0 && site / entry >= IPA_HOT_CALL_RATIO) threshold *= IPA_HOT_INLINE_FACTOR;
+    }
+    bool small = in->size[callee] <= threshold;
+    bool single = f->is_internal && !in->facts[callee].address_taken && in->facts[callee].sites == 1 &&
+                  in->size[callee] <= IPA_SINGLE_SITE_INLINE_LIMIT;
+    return (small || single) && can_inline(f);
+}
+
+/* Inline the chosen calls of one function; calls in the copies are not
+ * considered again. */
+static bool inline_into(Inliner *in, uint32_t caller) {
+    IrFunction *func = in->mod->functions[caller];
+    IrInstruction **sites = NULL;
+    uint32_t count = 0, capacity = 0;
+    for (uint32_t b = 0; b < func->block_count; b++) {
+        for (IrInstruction *inst = func->all_blocks[b]->first_inst; inst; inst = inst->next) {
+            uint32_t callee = direct_callee(&in->ix, inst);
+            if (callee == UINT32_MAX || callee == caller) continue;
+            if (count >= capacity) {
+                uint32_t cap = capacity ? capacity * 2 : 8;
+                IrInstruction **grown = realloc(sites, cap * sizeof(IrInstruction *));
+                if (!grown) {
+                    free(sites);
+                    errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "ipa",
+                                             "Failed to collect call sites");
+                    return false;
+                }
+                sites = grown;
+                capacity = cap;
+            }
+            sites[count++] = inst;
+        }
+    }
+    bool ok = true, changed = false;
+    for (uint32_t i = 0; i < count && ok; i++) {
+        uint32_t callee = direct_callee(&in->ix, sites[i]);
+        if (!worth_inlining(in, caller, sites[i], callee)) continue;
+        ok = inline_call(func, sites[i], in->mod->functions[callee]);
+        in->size[caller] += in->size[callee];
+        in->inlined++;
+        changed = true;
+    }
+    if (changed) analysis__invalidate(func, IR_PRESERVE_NONE);
+    free(sites);
+    return ok;
+}
+
+/* The first call of the function on top of the stack, after the cursor,
+ * to a function not yet visited; UINT32_MAX once its body is scanned. */
+static uint32_t next_unvisited_callee(Inliner *in, uint32_t depth) {
+    const IrFunction *func = in->mod->functions[in->stack[depth]];
+    while (in->block[depth] < func->block_count) {
+        IrInstruction *inst = in->cursor[depth] ? in->cursor[depth]->next
+                                                : func->all_blocks[in->block[depth]]->first_inst;
+        for (; inst; inst = inst->next) {
+            uint32_t callee = direct_callee(&in->ix, inst);
+            if (callee != UINT32_MAX && in->state[callee] == 0) {
+                in->cursor[depth] = inst;
+                return callee;
+            }
+        }
+        in->cursor[depth] = NULL;
+        in->block[depth]++;
+    }
+    return UINT32_MAX;
+}
+
+/* Post-order walk of the call graph from root: a function is inlined into
+ * once every callee outside its cycle is done. */
+static bool visit(Inliner *in, uint32_t root) {
+    uint32_t depth = 0;
+    in->stack[0] = root;
+    in->block[0] = 0;
+    in->cursor[0] = NULL;
+    in->state[root] = 1;
+    while (true) {
+        uint32_t next = next_unvisited_callee(in, depth);
+        if (next != UINT32_MAX) {
+            in->state[next] = 1;
+            depth++;
+            in->stack[depth] = next;
+            in->block[depth] = 0;
+            in->cursor[depth] = NULL;
+            continue;
+        }
+        uint32_t f = in->stack[depth];
+        bool ok = inline_into(in, f);
+        in->state[f] = 2;
+        if (!ok || depth == 0) return ok;
+        depth--;
+    }
+}
+
+uint32_t ipa__inline(IrModule *mod, uint32_t threshold) {
+    if (!mod || mod->func_count == 0) return 0;
+    uint32_t n = mod->func_count;
+    Inliner in = { mod, { NULL, 0 }, NULL, calloc(n, sizeof(uint32_t)), calloc(n, 1), threshold, 0,
+                   malloc(n * sizeof(uint32_t)), malloc(n * sizeof(uint32_t)),
+                   malloc(n * sizeof(IrInstruction *)) };
+    if (!in.size || !in.state || !in.stack || !in.block || !in.cursor) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "ipa",
+                                 "Failed to allocate inliner state");
+    } else if (index_build(&in.ix, mod) && (in.facts = gather_call_facts(mod, &in.ix))) {
+        for (uint32_t i = 0; i < n; i++) in.size[i] = function_size(mod->functions[i]);
+        for (uint32_t i = 0; i < n; i++)
+            if (in.state[i] == 0 && !visit(&in, i)) break;
+    }
+    free(in.ix.entries);
+    free(in.facts);
+    free(in.size);
+    free(in.state);
+    free(in.stack);
+    free(in.block);
+    free(in.cursor);
+    return in.inlined;
+}
@@ -0,0 +1,55 @@
+#ifndef IPA_H
+#define IPA_H
+
+#include <stdint.h>
+#include "../ir.h"
+
+/* Largest callee, in instructions, inlined at any call site. */
+#define IPA_DEFAULT_INLINE_THRESHOLD 40
+/* Largest internal callee inlined into its only call site, which then
+ * leaves the callee dead. */
+#define IPA_SINGLE_SITE_INLINE_LIMIT 400
+/* Inlining stops adding to a caller once it reaches this size. */
+#define IPA_MAX_INLINED_FUNCTION_SIZE 4000
+/* Under -fprofile-use, a call executed at least this many times per entry
+ * of its caller is hot, and inlines callees up to IPA_HOT_INLINE_FACTOR
+ * times the threshold. */
+#define IPA_HOT_CALL_RATIO 4
+#define IPA_HOT_INLINE_FACTOR 4
+
+/*
+ * Interprocedural passes over a whole module.  They see every caller of an
+ * internal function only when the module is the whole program, which is
+ * what -flto links; they run serially, before the function pipeline.
+ */
+
+/* Mark every function not named in exported internal.  Returns the number
+ * of functions marked. */
+uint32_t ipa__internalize(IrModule *mod, const char *const *exported, uint32_t count);
+
+/* Remove internal functions that no exported function calls or takes the
+ * address of, directly or indirectly.  Returns the number removed. */
+uint32_t ipa__remove_dead_functions(IrModule *mod);
+
+/*
+ * Interprocedural constant propagation.  A parameter of an internal
+ * function whose address is never taken is replaced by a constant when
+ * every call passes that constant, and the result of every call to such a
+ * function is replaced by the constant it always returns.  Returns the
+ * number of parameters and call results replaced.
+ */
+uint32_t ipa__propagate_constants(IrModule *mod);
+
+/*
+ * Inline calls to functions of the module, callees before callers, so a
+ * callee is copied with its own calls already inlined; calls within a
+ * cycle of the call graph are left alone.  A callee is inlined when it has
+ * at most threshold instructions, or when it is internal, called once and
+ * under IPA_SINGLE_SITE_INLINE_LIMIT.  Under -fprofile-use hot calls take a
+ * larger threshold and calls never executed are not inlined.  Each inlined
+ * call is reported under -Rpass=inline.  Returns the number of calls
+ * inlined.
+ */
+uint32_t ipa__inline(IrModule *mod, uint32_t threshold);
+
+#endif
@@ -1,11 +1,16 @@
+#define _POSIX_C_SOURCE 200809L
 #include "ir.h"
+#include "analysis/analysis.h"
 #include "../errhandler/errhandler.h"
 #include "../utils/str_utils.h"
 #include "../utils/memory_utils.h"
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#define IR_POOL_INITIAL_SLOTS 256
+
 static void *ir_alloc(size_t size) {
     void *p = calloc(1, size);
     if (!p) errhandler__report_error(ERROR_CODE_MEMORY_ALLOCATION, 0, 0, "ir", "IR memory allocation failed");
@@ -13,6 +18,12 @@ static void *ir_alloc(size_t size) {
 }
 static void ir_free(void *p) { free(p); }
 
+static void *arena_alloc(UArena *arena, size_t size) {
+    void *p = u__arena_alloc(arena, size);
+    if (!p) errhandler__report_error(ERROR_CODE_MEMORY_ALLOCATION, 0, 0, "ir", "IR memory allocation failed");
+    return p;
+}
+
 static bool grow_ptr_array(void ***array, uint32_t *count, uint32_t *capacity) {
     uint32_t new_cap = (*capacity == 0) ? 4 : (*capacity * 2);
     void **new_arr = realloc(*array, new_cap * sizeof(void *));
@@ -31,43 +42,292 @@ static bool grow_ptr_array(void ***array, uint32_t *count, uint32_t *capacity) {
     return true;
 }
 
+/* Module-wide storage shared by every function: interned strings, the
+ * unique constant, field and global values, and types owned by the module.
+ * Functions are optimised in parallel, so every access holds the lock. */
+struct IrPool {
+    pthread_mutex_t lock;
+    UArena          arena;
+    const char    **strings;            /* open addressing, capacity a power of two */
+    uint32_t        string_count, string_capacity;
+    IrValue       **values;
+    uint32_t        value_count, value_capacity;
+    Type          **types;              /* few distinct types; searched linearly */
+    uint32_t        type_count, type_capacity;
+};
+
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t hash_string(const char *s) {
+    return hash_bytes(14695981039346656037ULL, s, strlen(s));
+}
+
+/* Bits that tell two unique values of the same kind and type apart. */
+static uint64_t value_bits(const IrValue *v) {
+    uint64_t bits = 0;
+    switch (v->kind) {
+        case IR_VALUE_CONST_INT: bits = (uint64_t)v->const_data.int_val; break;
+        case IR_VALUE_CONST_REAL: memcpy(&bits, &v->const_data.real_val, sizeof(bits)); break;
+        case IR_VALUE_CONST_CHAR: bits = (unsigned char)v->const_data.char_val; break;
+        case IR_VALUE_STRUCT_FIELD: bits = v->const_data.field_index; break;
+        case IR_VALUE_GLOBAL_SYMBOL: bits = (uint64_t)(uintptr_t)v->name; break;
+        default: break;
+    }
+    return bits;
+}
+
+static uint64_t hash_value(const IrValue *v) {
+    uint64_t h = 14695981039346656037ULL;
+    uint64_t bits = value_bits(v);
+    uintptr_t info = (uintptr_t)v->type_info;
+    h = hash_bytes(h, &v->kind, 1);
+    h = hash_bytes(h, &v->type, 1);
+    h = hash_bytes(h, &bits, sizeof(bits));
+    return hash_bytes(h, &info, sizeof(info));
+}
+
+static bool same_value(const IrValue *a, const IrValue *b) {
+    return a->kind == b->kind && a->type == b->type && a->type_info == b->type_info &&
+           value_bits(a) == value_bits(b);
+}
+
+/* Double a table and reinsert its entries; hash() gives an entry's hash. */
+static bool rehash(void ***slots, uint32_t *capacity, uint64_t (*hash)(const void *)) {
+    uint32_t new_cap = *capacity ? *capacity * 2 : IR_POOL_INITIAL_SLOTS;
+    void **grown = calloc(new_cap, sizeof(void *));
+    if (!grown) {
+        errhandler__report_error(ERROR_CODE_MEMORY_ALLOCATION, 0, 0, "ir", "Failed to grow IR pool");
+        return false;
+    }
+    for (uint32_t i = 0; i < *capacity; i++) {
+        if (!(*slots)[i]) continue;
+        uint32_t j = (uint32_t)hash((*slots)[i]) & (new_cap - 1);
+        while (grown[j]) j = (j + 1) & (new_cap - 1);
+        grown[j] = (*slots)[i];
+    }
+    free(*slots);
+    *slots = grown;
+    *capacity = new_cap;
+    return true;
+}
+
+static uint64_t hash_string_entry(const void *s) { return hash_string(s); }
+static uint64_t hash_value_entry(const void *v) { return hash_value(v); }
+
+static IrPool *pool_create(void) {
+    IrPool *pool = ir_alloc(sizeof(IrPool));
+    if (pool) pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+static void pool_destroy(IrPool *pool) {
+    if (!pool) return;
+    pthread_mutex_destroy(&pool->lock);
+    u__arena_release(&pool->arena);
+    free(pool->strings);
+    free(pool->values);
+    free(pool->types);
+    free(pool);
+}
+
+static const char *pool_intern_locked(IrPool *pool, const char *str) {
+    if (pool->string_count * 2 >= pool->string_capacity &&
+        !rehash((void ***)&pool->strings, &pool->string_capacity, hash_string_entry))
+        return NULL;
+    uint32_t mask = pool->string_capacity - 1;
+    uint32_t i = (uint32_t)hash_string(str) & mask;
+    for (; pool->strings[i]; i = (i + 1) & mask)
+        if (strcmp(pool->strings[i], str) == 0) return pool->strings[i];
+    char *copy = u__arena_strdup(&pool->arena, str);
+    if (!copy) {
+        errhandler__report_error(ERROR_CODE_MEMORY_ALLOCATION, 0, 0, "ir", "Failed to intern '%s'", str);
+        return NULL;
+    }
+    pool->strings[i] = copy;
+    pool->string_count++;
+    return copy;
+}
+
+/* The module's single copy of str. */
+static const char *intern(IrModule *mod, const char *str) {
+    if (!mod || !mod->pool || !str) return NULL;
+    pthread_mutex_lock(&mod->pool->lock);
+    const char *s = pool_intern_locked(mod->pool, str);
+    pthread_mutex_unlock(&mod->pool->lock);
+    return s;
+}
+
+const char *ir__module_intern(IrModule *mod, const char *str) { return intern(mod, str); }
+
+static bool same_type(const Type *a, const Type *b) {
+    return a->name == b->name && a->pointer_level == b->pointer_level &&
+           a->is_reference == b->is_reference && a->is_array == b->is_array &&
+           a->size_in_bytes == b->size_in_bytes;
+}
+
+/* Only the fields the IR reads are kept; the name is interned, so equal
+ * types compare field by field. */
+Type *ir__module_type(IrModule *mod, const Type *type_info) {
+    if (!type_info) return NULL;
+    Type key;
+    memset(&key, 0, sizeof(key));
+    key.name = (char *)intern(mod, type_info->name);
+    if (type_info->name && !key.name) return NULL;
+    key.pointer_level = type_info->pointer_level;
+    key.is_reference = type_info->is_reference;
+    key.is_array = type_info->is_array;
+    key.size_in_bytes = type_info->size_in_bytes;
+    IrPool *pool = mod->pool;
+    Type *t = NULL;
+    pthread_mutex_lock(&pool->lock);
+    for (uint32_t i = 0; i < pool->type_count && !t; i++)
+        if (same_type(pool->types[i], &key)) t = pool->types[i];
+    if (!t && (pool->type_count < pool->type_capacity ||
+               grow_ptr_array((void ***)&pool->types, &pool->type_count, &pool->type_capacity)) &&
+        (t = arena_alloc(&pool->arena, sizeof(Type)))) {
+        *t = key;
+        pool->types[pool->type_count++] = t;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return t;
+}
+
+/* The module's value equal to *key, created from it on first use. */
+static IrValue *unique_value(IrModule *mod, const IrValue *key) {
+    if (!mod || !mod->pool) return NULL;
+    IrPool *pool = mod->pool;
+    IrValue *v = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->value_count * 2 < pool->value_capacity ||
+        rehash((void ***)&pool->values, &pool->value_capacity, hash_value_entry)) {
+        uint32_t mask = pool->value_capacity - 1;
+        uint32_t i = (uint32_t)hash_value(key) & mask;
+        while (pool->values[i] && !same_value(pool->values[i], key)) i = (i + 1) & mask;
+        v = pool->values[i];
+        if (!v && (v = arena_alloc(&pool->arena, sizeof(IrValue)))) {
+            *v = *key;
+            pool->values[i] = v;
+            pool->value_count++;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return v;
+}
+
+/* Heap bytes held by the module's IR: arenas, pool tables and block lists. */
+size_t ir__module_bytes(const IrModule *mod) {
+    if (!mod) return 0;
+    size_t bytes = sizeof(IrModule) + mod->func_capacity * sizeof(IrFunction *);
+    if (mod->pool) {
+        bytes += sizeof(IrPool) + mod->pool->arena.reserved;
+        bytes += (size_t)mod->pool->string_capacity * sizeof(char *);
+        bytes += (size_t)mod->pool->value_capacity * sizeof(IrValue *);
+        bytes += (size_t)mod->pool->type_capacity * sizeof(Type *);
+    }
+    for (uint32_t i = 0; i < mod->func_count; i++) {
+        const IrFunction *f = mod->functions[i];
+        bytes += sizeof(IrFunction) + f->arena.reserved + f->block_capacity * sizeof(IrBasicBlock *);
+    }
+    return bytes;
+}
+
 static IrBasicBlock *create_block(IrFunction *func, const char *name) {
-    IrBasicBlock *bb = ir_alloc(sizeof(IrBasicBlock));
+    IrBasicBlock *bb = arena_alloc(&func->arena, sizeof(IrBasicBlock));
     if (!bb) return NULL;
-    snprintf(bb->label, sizeof(bb->label), "%s", name ? name : "");
+    bb->label = intern(func->module, name ? name : "");
+    if (!bb->label) return NULL;
     bb->id = func->next_block_id++;
     bb->function = func;
-    if (func->block_count >= func->block_capacity) {
-        if (!grow_ptr_array((void ***)&func->all_blocks, &func->block_count, &func->block_capacity)) {
-            ir_free(bb);
-            return NULL;
-        }
-    } else if (func->all_blocks == NULL) {
-        func->block_capacity = 4;
-        func->all_blocks = ir_alloc(4 * sizeof(IrBasicBlock *));
-        if (!func->all_blocks) { ir_free(bb); return NULL; }
-    }
+    bb->predecessors = bb->pred_inline;
+    bb->successors = bb->succ_inline;
+    bb->pred_capacity = bb->succ_capacity = IR_BLOCK_INLINE_EDGES;
+    if (func->block_count >= func->block_capacity &&
+        !grow_ptr_array((void ***)&func->all_blocks, &func->block_count, &func->block_capacity))
+        return NULL;
     func->all_blocks[func->block_count++] = bb;
     return bb;
 }
 
-static bool add_predecessor(IrBasicBlock *bb, IrBasicBlock *pred) {
-    if (bb->pred_count >= bb->pred_capacity)
-        if (!grow_ptr_array((void ***)&bb->predecessors, &bb->pred_count, &bb->pred_capacity))
-            return false;
-    bb->predecessors[bb->pred_count++] = pred;
-    return true;
-}
-static bool add_successor(IrBasicBlock *bb, IrBasicBlock *succ) {
-    if (bb->succ_count >= bb->succ_capacity)
-        if (!grow_ptr_array((void ***)&bb->successors, &bb->succ_count, &bb->succ_capacity))
-            return false;
-    bb->successors[bb->succ_count++] = succ;
+/* Edge lists start in the block's inline storage and move to the arena
+ * when they outgrow it; the array left behind is not reused. */
+static bool add_edge(IrFunction *func, IrBasicBlock ***edges, uint32_t *count, uint32_t *capacity,
+                     IrBasicBlock *bb) {
+    if (*count >= *capacity) {
+        IrBasicBlock **grown = arena_alloc(&func->arena, *capacity * 2 * sizeof(IrBasicBlock *));
+        if (!grown) return false;
+        memcpy(grown, *edges, *count * sizeof(IrBasicBlock *));
+        *edges = grown;
+        *capacity *= 2;
+    }
+    (*edges)[(*count)++] = bb;
     return true;
 }
+
 static void link_blocks(IrBasicBlock *from, IrBasicBlock *to) {
-    add_successor(from, to);
-    add_predecessor(to, from);
+    IrFunction *func = from->function;
+    add_edge(func, &from->successors, &from->succ_count, &from->succ_capacity, to);
+    add_edge(func, &to->predecessors, &to->pred_count, &to->pred_capacity, from);
+}
+
+static bool tracks_uses(const IrValue *v) {
+    return v && (v->kind == IR_VALUE_TEMP || v->kind == IR_VALUE_PARAM);
+}
+
+static void use_link(IrUse *use, IrValue *value) {
+    use->value = value;
+    use->prev = NULL;
+    use->next = value->uses;
+    if (value->uses) value->uses->prev = use;
+    value->uses = use;
+}
+
+static void use_unlink(IrUse *use) {
+    if (use->prev) use->prev->next = use->next;
+    else use->value->uses = use->next;
+    if (use->next) use->next->prev = use->prev;
+}
+
+/* Take use off its user's chain and keep it for the next add_use. */
+static void use_release(IrUse *use) {
+    IrInstruction *user = use->user;
+    IrUse **link = &user->uses;
+    while (*link != use) link = &(*link)->next_in_user;
+    *link = use->next_in_user;
+    IrFunction *func = user->parent->function;
+    use->next_in_user = func->free_uses;
+    func->free_uses = use;
+}
+
+static void add_use(IrValue **slot, void *ctx) {
+    IrInstruction *inst = ctx;
+    if (!tracks_uses(*slot)) return;
+    IrFunction *func = inst->parent->function;
+    IrUse *use = func->free_uses;
+    if (use) func->free_uses = use->next_in_user;
+    else if (!(use = arena_alloc(&func->arena, sizeof(IrUse)))) return;
+    use->user = inst;
+    use->slot = slot;
+    use->next_in_user = inst->uses;
+    inst->uses = use;
+    use_link(use, *slot);
+}
+
+static void add_uses(IrInstruction *inst) {
+    ir__inst_for_each_operand(inst, add_use, inst);
+}
+
+static void drop_uses(IrInstruction *inst) {
+    while (inst->uses) {
+        use_unlink(inst->uses);
+        use_release(inst->uses);
+    }
 }
 
 static void append_instruction(IrBasicBlock *bb, IrInstruction *inst) {
@@ -76,97 +336,174 @@ static void append_instruction(IrBasicBlock *bb, IrInstruction *inst) {
     else { bb->first_inst = inst; inst->prev = NULL; }
     bb->last_inst = inst;
     inst->next = NULL;
+    add_uses(inst);
 }
 
-static IrValue *new_ir_value(IrValueKind kind, DataType type, Type *type_info) {
-    IrValue *v = ir_alloc(sizeof(IrValue));
+static IrValue *new_ir_value(IrFunction *func, IrValueKind kind, DataType type, Type *type_info) {
+    IrValue *v = arena_alloc(&func->arena, sizeof(IrValue));
     if (!v) return NULL;
-    v->kind = kind; v->type = type; v->type_info = type_info; v->name[0] = '\0';
+    v->kind = kind; v->type = type; v->type_info = type_info;
     return v;
 }
 
 IrValue *ir__value_temp(IrFunction *func, DataType type, Type *type_info) {
-    IrValue *v = new_ir_value(IR_VALUE_TEMP, type, type_info);
+    IrValue *v = new_ir_value(func, IR_VALUE_TEMP, type, type_info);
     if (!v) return NULL;
     v->id = func->next_temp_id++;
-    snprintf(v->name, sizeof(v->name), "%%t%u", v->id);
     return v;
 }
 
-IrValue *ir__value_const_int(int64_t val) {
-    IrValue *v = new_ir_value(IR_VALUE_CONST_INT, TYPE_INT, NULL);
-    if (!v) return NULL;
-    v->const_data.int_val = val;
-    snprintf(v->name, sizeof(v->name), "%lld", (long long)val);
-    return v;
+IrValue *ir__value_const_int(IrModule *mod, int64_t val) {
+    IrValue key = { .kind = IR_VALUE_CONST_INT, .type = TYPE_INT };
+    key.const_data.int_val = val;
+    return unique_value(mod, &key);
 }
 
-IrValue *ir__value_const_real(double val) {
-    IrValue *v = new_ir_value(IR_VALUE_CONST_REAL, TYPE_REAL, NULL);
-    if (!v) return NULL;
-    v->const_data.real_val = val;
-    snprintf(v->name, sizeof(v->name), "%.6g", val);
-    return v;
+IrValue *ir__value_const_real(IrModule *mod, double val) {
+    IrValue key = { .kind = IR_VALUE_CONST_REAL, .type = TYPE_REAL };
+    key.const_data.real_val = val;
+    return unique_value(mod, &key);
 }
 
-IrValue *ir__value_const_char(char val) {
-    IrValue *v = new_ir_value(IR_VALUE_CONST_CHAR, TYPE_CHAR, NULL);
-    if (!v) return NULL;
-    v->const_data.char_val = val;
-    snprintf(v->name, sizeof(v->name), "'%c'", val);
-    return v;
+IrValue *ir__value_const_char(IrModule *mod, char val) {
+    IrValue key = { .kind = IR_VALUE_CONST_CHAR, .type = TYPE_CHAR };
+    key.const_data.char_val = val;
+    return unique_value(mod, &key);
 }
 
-IrValue *ir__value_global(const char *name, DataType type, Type *type_info) {
-    IrValue *v = new_ir_value(IR_VALUE_GLOBAL_SYMBOL, type, type_info);
-    if (!v) return NULL;
-    strncpy(v->name, name, sizeof(v->name)-1);
-    return v;
+IrValue *ir__value_global(IrModule *mod, const char *name, DataType type, Type *type_info) {
+    IrValue key = { .kind = IR_VALUE_GLOBAL_SYMBOL, .type = type, .type_info = type_info };
+    key.name = intern(mod, name);
+    return key.name ? unique_value(mod, &key) : NULL;
 }
 
+/* Parameters print as %p<index> unless the builder names them. */
 IrValue *ir__value_param(IrFunction *func, uint32_t index, DataType type, Type *type_info) {
-    IrValue *v = new_ir_value(IR_VALUE_PARAM, type, type_info);
+    IrValue *v = new_ir_value(func, IR_VALUE_PARAM, type, type_info);
     if (!v) return NULL;
     v->id = index;
-    snprintf(v->name, sizeof(v->name), "%%p%u", index);
     return v;
 }
 
+/* Coarse class of a declared type; pointers of any kind collapse to TYPE_POINTER. */
+DataType ir__datatype_of(const Type *type_info) {
+    if (!type_info || !type_info->name) return TYPE_UNKNOWN;
+    if (type_info->pointer_level > 0 || type_info->is_reference) return TYPE_POINTER;
+    if (type_info->is_array) return TYPE_ARRAY;
+    if (strcmp(type_info->name, "Int") == 0)  return TYPE_INT;
+    if (strcmp(type_info->name, "Real") == 0) return TYPE_REAL;
+    if (strcmp(type_info->name, "Char") == 0) return TYPE_CHAR;
+    return TYPE_UNKNOWN;
+}
+
+/* Class of the element a pointer type points to. */
+DataType ir__element_datatype(const Type *ptr_info) {
+    if (!ptr_info || ptr_info->pointer_level == 0) return TYPE_UNKNOWN;
+    if (ptr_info->pointer_level > 1) return TYPE_POINTER;
+    if (!ptr_info->name) return TYPE_UNKNOWN;
+    if (strcmp(ptr_info->name, "Int") == 0)  return TYPE_INT;
+    if (strcmp(ptr_info->name, "Real") == 0) return TYPE_REAL;
+    if (strcmp(ptr_info->name, "Char") == 0) return TYPE_CHAR;
+    return TYPE_UNKNOWN;
+}
+
+/* Bytes taken by the base (non-pointer) part of a type.  The width in
+ * angle brackets is in bytes: Int<1> is a byte, Real<4> a single float. */
+static uint32_t base_type_size(const Type *t) {
+    if (t->size_in_bytes) return t->size_in_bytes;
+    if (t->name && strcmp(t->name, "Char") == 0) return 1;
+    return 8;
+}
+
+uint32_t ir__type_size(const Type *type_info) {
+    if (!type_info) return 8;
+    if (type_info->pointer_level > 0 || type_info->is_reference) return 8;
+    return base_type_size(type_info);
+}
+
+/* Element size a GEP on a pointer of this type scales its index by;
+ * 8 when the type is unknown. */
+uint32_t ir__pointee_size(const Type *ptr_info) {
+    if (!ptr_info || ptr_info->pointer_level > 1) return 8;
+    return base_type_size(ptr_info);
+}
+
+/* One label value per block, shared by every branch to it. */
 IrValue *ir__value_label(IrBasicBlock *block) {
-    IrValue *v = new_ir_value(IR_VALUE_LABEL, TYPE_LABEL, NULL);
+    if (block->label_value) return block->label_value;
+    IrValue *v = new_ir_value(block->function, IR_VALUE_LABEL, TYPE_LABEL, NULL);
     if (!v) return NULL;
-    strncpy(v->name, block->label, sizeof(v->name)-1);
+    v->const_data.block = block;
+    v->name = block->label;
+    block->label_value = v;
     return v;
 }
 
-IrValue *ir__value_struct_field(uint32_t index) {
-    IrValue *v = new_ir_value(IR_VALUE_STRUCT_FIELD, TYPE_INT, NULL);
-    if (!v) return NULL;
-    v->const_data.field_index = index;
-    snprintf(v->name, sizeof(v->name), "field%u", index);
-    return v;
+IrValue *ir__value_struct_field(IrModule *mod, uint32_t index) {
+    IrValue key = { .kind = IR_VALUE_STRUCT_FIELD, .type = TYPE_INT };
+    key.const_data.field_index = index;
+    return unique_value(mod, &key);
 }
 
-void ir__value_free(IrValue *val) { ir_free(val); }
+/* Text of a value as the IR printer shows it. */
+const char *ir__value_format(char *buf, size_t size, const IrValue *v) {
+    if (!v) { snprintf(buf, size, "void"); return buf; }
+    switch (v->kind) {
+        case IR_VALUE_TEMP: snprintf(buf, size, "%%t%u", v->id); break;
+        case IR_VALUE_PARAM:
+            if (v->name) snprintf(buf, size, "%s", v->name);
+            else snprintf(buf, size, "%%p%u", v->id);
+            break;
+        case IR_VALUE_LABEL: case IR_VALUE_GLOBAL_SYMBOL: snprintf(buf, size, "%s", v->name); break;
+        case IR_VALUE_CONST_INT: snprintf(buf, size, "%lld", (long long)v->const_data.int_val); break;
+        case IR_VALUE_CONST_REAL: snprintf(buf, size, "%.6g", v->const_data.real_val); break;
+        case IR_VALUE_CONST_CHAR: snprintf(buf, size, "'%c'", v->const_data.char_val); break;
+        case IR_VALUE_STRUCT_FIELD: snprintf(buf, size, "field%u", v->const_data.field_index); break;
+        default: snprintf(buf, size, "?");
+    }
+    return buf;
+}
 
-static IrInstruction *emit_instruction
-    ( IrBuilder *b
+static IrInstruction *new_instruction
+    ( IrFunction *func
     , IrOpcode op
     , IrValue *res
     , IrValue *op1
     , IrValue *op2
 ) {
-    if (!b || !b->current_block) {
-        errhandler__report_error(ERROR_CODE_IR_INVALID_INSTR, 0, 0, "ir", "No current block");
-        return NULL;
-    }
-    IrInstruction *inst = ir_alloc(sizeof(IrInstruction));
+    IrInstruction *inst = arena_alloc(&func->arena, sizeof(IrInstruction));
+    if (!inst) return NULL;
+    inst->opcode = op; inst->result = res; inst->operand1 = op1; inst->operand2 = op2;
+    return inst;
+}
+
+/* Function of the builder's insertion point, or NULL after reporting that
+ * there is none. */
+static IrFunction *builder_function(IrBuilder *b) {
+    if (b && b->current_block) return b->current_function;
+    errhandler__report_error(ERROR_CODE_IR_INVALID_INSTR, 0, 0, "ir", "No current block");
+    return NULL;
+}
+
+/* Append a finished instruction at the insertion point. */
+static IrInstruction *emit_created(IrBuilder *b, IrInstruction *inst) {
     if (!inst) return NULL;
-    inst->opcode = op; inst->result = res; inst->operand1 = op1; inst->operand2 = op2; inst->extra = NULL;
+    inst->line = b->line; inst->column = b->column;
     append_instruction(b->current_block, inst);
     return inst;
 }
 
+static IrInstruction *emit_instruction
+    ( IrBuilder *b
+    , IrOpcode op
+    , IrValue *res
+    , IrValue *op1
+    , IrValue *op2
+) {
+    IrFunction *func = builder_function(b);
+    return func ? emit_created(b, new_instruction(func, op, res, op1, op2)) : NULL;
+}
+
 IrInstruction *ir__emit_op2(IrBuilder *b, IrOpcode op, IrValue *result, IrValue *op1, IrValue *op2) {
     return emit_instruction(b, op, result, op1, op2);
 }
@@ -196,13 +533,14 @@ IrInstruction *ir__emit_brcond
     , IrBasicBlock *true_bb
     , IrBasicBlock *false_bb
 ) {
-    IrValue *true_val = ir__value_label(true_bb);
-    IrInstruction *inst = emit_instruction(b, IR_BRCOND, NULL, cond, true_val);
-    if (!inst) return NULL;
-    IrCondBranchExtra *extra = ir_alloc(sizeof(IrCondBranchExtra));
-    if (!extra) { ir_free(inst); return NULL; }
+    IrFunction *func = builder_function(b);
+    if (!func) return NULL;
+    IrInstruction *inst = new_instruction(func, IR_BRCOND, NULL, cond, ir__value_label(true_bb));
+    IrCondBranchExtra *extra = arena_alloc(&func->arena, sizeof(IrCondBranchExtra));
+    if (!inst || !extra) return NULL;
     extra->true_target = true_bb; extra->false_target = false_bb;
     inst->extra = extra;
+    emit_created(b, inst);
     link_blocks(b->current_block, true_bb);
     link_blocks(b->current_block, false_bb);
     return inst;
@@ -219,15 +557,9 @@ IrInstruction *ir__emit_call
     , IrValue **args
     , uint32_t arg_count
 ) {
-    IrInstruction *inst = emit_instruction(b, IR_CALL, result, callee, NULL);
-    if (!inst) return NULL;
-    IrCallExtra *extra = ir_alloc(sizeof(IrCallExtra));
-    if (!extra) { ir_free(inst); return NULL; }
-    extra->arg_count = arg_count;
-    extra->args = ir_alloc(sizeof(IrValue *) * arg_count);
-    if (!extra->args) { ir_free(extra); ir_free(inst); return NULL; }
-    memcpy(extra->args, args, sizeof(IrValue *) * arg_count);
-    inst->extra = extra;
+    IrFunction *func = builder_function(b);
+    IrInstruction *inst = func ? emit_created(b, ir__inst_create_call(func, result, callee, args, arg_count)) : NULL;
+    if (inst && b->const_init) inst->flags |= IR_INST_CONST_INIT;
     return inst;
 }
 
@@ -238,24 +570,19 @@ IrInstruction *ir__emit_phi
     , IrBasicBlock **blocks
     , uint32_t count
 ) {
-    IrInstruction *inst = emit_instruction(b, IR_PHI, result, NULL, NULL);
-    if (!inst) return NULL;
-    IrPhiExtra *extra = ir_alloc(sizeof(IrPhiExtra));
-    if (!extra) { ir_free(inst); return NULL; }
-    extra->values = ir_alloc(sizeof(IrValue *) * count);
-    extra->blocks = ir_alloc(sizeof(IrBasicBlock *) * count);
-    if (!extra->values || !extra->blocks) {
-        ir_free(extra->values);
-        ir_free(extra->blocks);
-        ir_free(extra);
-        ir_free(inst);
-        return NULL;
-    }
+    IrFunction *func = builder_function(b);
+    if (!func) return NULL;
+    IrInstruction *inst = new_instruction(func, IR_PHI, result, NULL, NULL);
+    IrPhiExtra *extra = arena_alloc(&func->arena, sizeof(IrPhiExtra));
+    if (!inst || !extra) return NULL;
+    extra->values = arena_alloc(&func->arena, sizeof(IrValue *) * count);
+    extra->blocks = arena_alloc(&func->arena, sizeof(IrBasicBlock *) * count);
+    if (!extra->values || !extra->blocks) return NULL;
     memcpy(extra->values, values, sizeof(IrValue *) * count);
     memcpy(extra->blocks, blocks, sizeof(IrBasicBlock *) * count);
     extra->count = count;
     inst->extra = extra;
-    return inst;
+    return emit_created(b, inst);
 }
 IrInstruction *ir__emit_alloca
     ( IrBuilder *b
@@ -263,7 +590,10 @@ IrInstruction *ir__emit_alloca
     , DataType pointee_type
     , Type *pointee_info
 ) {
-    (void)pointee_type; (void)pointee_info;
+    (void)pointee_type;
+    /* The slot's type_info describes what it holds; alias analysis and
+     * loads through it rely on that. */
+    if (result && pointee_info) result->type_info = pointee_info;
     return ir__emit_op1(b, IR_ALLOCA, result, NULL);
 }
 
@@ -275,18 +605,18 @@ IrInstruction *ir__emit_gep
     , uint32_t index_count
 ) {
     if (!indices || index_count == 0) return NULL;
-    IrInstruction *inst = emit_instruction(b, IR_GEP, result, base, indices[0]);
-    if (!inst) return NULL;
-    if (index_count > 1) {
-        IrGepExtra *extra = ir_alloc(sizeof(IrGepExtra));
-        if (!extra) { ir_free(inst); return NULL; }
-        extra->index_count = index_count - 1;
-        extra->indices = ir_alloc(sizeof(IrValue *) * extra->index_count);
-        if (!extra->indices) { ir_free(extra); ir_free(inst); return NULL; }
-        memcpy(extra->indices, indices + 1, sizeof(IrValue *) * extra->index_count);
-        inst->extra = extra;
-    }
-    return inst;
+    if (index_count == 1) return emit_instruction(b, IR_GEP, result, base, indices[0]);
+    IrFunction *func = builder_function(b);
+    if (!func) return NULL;
+    IrInstruction *inst = new_instruction(func, IR_GEP, result, base, indices[0]);
+    IrGepExtra *extra = arena_alloc(&func->arena, sizeof(IrGepExtra));
+    if (!inst || !extra) return NULL;
+    extra->index_count = index_count - 1;
+    extra->indices = arena_alloc(&func->arena, sizeof(IrValue *) * extra->index_count);
+    if (!extra->indices) return NULL;
+    memcpy(extra->indices, indices + 1, sizeof(IrValue *) * extra->index_count);
+    inst->extra = extra;
+    return emit_created(b, inst);
 }
 
 IrInstruction *ir__emit_cast
@@ -300,8 +630,230 @@ IrInstruction *ir__emit_cast
     return ir__emit_op1(b, IR_CAST, result, src);
 }
 
+IrInstruction *ir__emit_select
+    ( IrBuilder *b
+    , IrValue *result
+    , IrValue *cond
+    , IrValue *true_val
+    , IrValue *false_val
+) {
+    IrFunction *func = builder_function(b);
+    return func ? emit_created(b, ir__inst_create_select(func, result, cond, true_val, false_val)) : NULL;
+}
+
 IrInstruction *ir__emit_nop(IrBuilder *b) { return emit_instruction(b, IR_NOP, NULL, NULL, NULL); }
 
+IrInstruction *ir__inst_create
+    ( IrFunction *func
+    , IrOpcode op
+    , IrValue *result
+    , IrValue *op1
+    , IrValue *op2
+) {
+    return new_instruction(func, op, result, op1, op2);
+}
+
+IrInstruction *ir__inst_create_select
+    ( IrFunction *func
+    , IrValue *result
+    , IrValue *cond
+    , IrValue *true_val
+    , IrValue *false_val
+) {
+    IrInstruction *inst = new_instruction(func, IR_SELECT, result, cond, true_val);
+    IrSelectExtra *extra = arena_alloc(&func->arena, sizeof(IrSelectExtra));
+    if (!inst || !extra) return NULL;
+    extra->false_value = false_val;
+    inst->extra = extra;
+    return inst;
+}
+
+IrInstruction *ir__inst_create_mem
+    ( IrFunction *func
+    , IrOpcode op
+    , IrValue *dst
+    , IrValue *src
+    , IrValue *count
+    , uint32_t elem_size
+) {
+    IrInstruction *inst = new_instruction(func, op, NULL, dst, src);
+    IrMemExtra *extra = arena_alloc(&func->arena, sizeof(IrMemExtra));
+    if (!inst || !extra) return NULL;
+    extra->count = count;
+    extra->elem_size = elem_size;
+    inst->extra = extra;
+    return inst;
+}
+
+IrInstruction *ir__inst_create_call
+    ( IrFunction *func
+    , IrValue *result
+    , IrValue *callee
+    , IrValue **args
+    , uint32_t arg_count
+) {
+    IrInstruction *inst = new_instruction(func, IR_CALL, result, callee, NULL);
+    IrCallExtra *extra = arena_alloc(&func->arena, sizeof(IrCallExtra));
+    if (!inst || !extra) return NULL;
+    if (arg_count) {
+        extra->args = arena_alloc(&func->arena, sizeof(IrValue *) * arg_count);
+        if (!extra->args) return NULL;
+        memcpy(extra->args, args, sizeof(IrValue *) * arg_count);
+    }
+    extra->arg_count = arg_count;
+    inst->extra = extra;
+    return inst;
+}
+
+void ir__inst_insert_before(IrInstruction *pos, IrInstruction *inst) {
+    IrBasicBlock *bb = pos->parent;
+    inst->parent = bb;
+    inst->prev = pos->prev;
+    inst->next = pos;
+    if (pos->prev) pos->prev->next = inst;
+    else bb->first_inst = inst;
+    pos->prev = inst;
+    add_uses(inst);
+}
+
+void ir__inst_append(IrBasicBlock *bb, IrInstruction *inst) { append_instruction(bb, inst); }
+
+void ir__inst_unlink(IrInstruction *inst) {
+    IrBasicBlock *bb = inst->parent;
+    if (!bb) return;
+    drop_uses(inst);
+    if (inst->prev) inst->prev->next = inst->next;
+    else bb->first_inst = inst->next;
+    if (inst->next) inst->next->prev = inst->prev;
+    else bb->last_inst = inst->prev;
+    inst->prev = inst->next = NULL;
+    inst->parent = NULL;
+}
+
+/* The instruction's memory belongs to the function arena and is reclaimed
+ * with the module; destroying it only takes it out of its block. */
+void ir__inst_destroy(IrInstruction *inst) {
+    if (!inst) return;
+    ir__inst_unlink(inst);
+}
+
+bool ir__opcode_is_terminator(IrOpcode op) {
+    return op == IR_BR || op == IR_BRCOND || op == IR_RET;
+}
+
+/* Visit every value operand slot of inst; branch labels are skipped. */
+void ir__inst_for_each_operand(IrInstruction *inst, IrOperandFn fn, void *ctx) {
+    if (!inst || !fn) return;
+    if (inst->operand1 && inst->operand1->kind != IR_VALUE_LABEL) fn(&inst->operand1, ctx);
+    if (inst->operand2 && inst->operand2->kind != IR_VALUE_LABEL) fn(&inst->operand2, ctx);
+    if (!inst->extra) return;
+    if (inst->opcode == IR_CALL) {
+        IrCallExtra *call = inst->extra;
+        for (uint32_t i = 0; i < call->arg_count; i++) if (call->args[i]) fn(&call->args[i], ctx);
+    } else if (inst->opcode == IR_GEP) {
+        IrGepExtra *gep = inst->extra;
+        for (uint32_t i = 0; i < gep->index_count; i++) if (gep->indices[i]) fn(&gep->indices[i], ctx);
+    } else if (inst->opcode == IR_PHI) {
+        IrPhiExtra *phi = inst->extra;
+        for (uint32_t i = 0; i < phi->count; i++) if (phi->values[i]) fn(&phi->values[i], ctx);
+    } else if (inst->opcode == IR_SELECT) {
+        IrSelectExtra *sel = inst->extra;
+        if (sel->false_value) fn(&sel->false_value, ctx);
+    } else if (inst->opcode == IR_MEMSET || inst->opcode == IR_MEMCPY) {
+        IrMemExtra *mem = inst->extra;
+        if (mem->count) fn(&mem->count, ctx);
+    }
+}
+
+/* Point one operand slot of inst at value. */
+void ir__inst_set_operand(IrInstruction *inst, IrValue **slot, IrValue *value) {
+    if (!inst->parent) { *slot = value; return; }
+    for (IrUse *use = inst->uses; use; use = use->next_in_user)
+        if (use->slot == slot) {
+            use_unlink(use);
+            use_release(use);
+            break;
+        }
+    *slot = value;
+    add_use(slot, inst);
+}
+
+/* Rebuild the uses of inst after its operands were written directly. */
+void ir__inst_update_uses(IrInstruction *inst) {
+    if (!inst->parent) return;
+    drop_uses(inst);
+    add_uses(inst);
+}
+
+/* Point every use of from at to, in time linear in the number of uses. */
+void ir__replace_all_uses_with(IrValue *from, IrValue *to) {
+    if (!from || from == to) return;
+    bool tracked = tracks_uses(to);
+    while (from->uses) {
+        IrUse *use = from->uses;
+        use_unlink(use);
+        *use->slot = to;
+        if (tracked) use_link(use, to);
+        else use_release(use);
+    }
+}
+
+uint32_t ir__value_use_count(const IrValue *val) {
+    uint32_t count = 0;
+    for (const IrUse *use = val ? val->uses : NULL; use; use = use->next) count++;
+    return count;
+}
+
+bool ir__inst_is_call_to(const IrInstruction *inst, const char *callee) {
+    return inst && inst->opcode == IR_CALL && inst->operand1 &&
+           inst->operand1->kind == IR_VALUE_GLOBAL_SYMBOL &&
+           strcmp(inst->operand1->name, callee) == 0;
+}
+
+IrInstruction *ir__block_terminator(const IrBasicBlock *bb) {
+    if (!bb || !bb->last_inst) return NULL;
+    return ir__opcode_is_terminator(bb->last_inst->opcode) ? bb->last_inst : NULL;
+}
+
+void ir__block_link(IrBasicBlock *from, IrBasicBlock *to) { link_blocks(from, to); }
+
+static void remove_block_ref(IrBasicBlock **arr, uint32_t *count, IrBasicBlock *bb) {
+    for (uint32_t i = 0; i < *count; i++) {
+        if (arr[i] != bb) continue;
+        memmove(&arr[i], &arr[i + 1], (*count - i - 1) * sizeof(IrBasicBlock *));
+        (*count)--;
+        return;
+    }
+}
+
+/* Remove one from -> to edge (a conditional branch may contribute two). */
+void ir__block_unlink(IrBasicBlock *from, IrBasicBlock *to) {
+    remove_block_ref(from->successors, &from->succ_count, to);
+    remove_block_ref(to->predecessors, &to->pred_count, from);
+}
+
+/* A new empty block at the end of func's block list. */
+IrBasicBlock *ir__function_add_block(IrFunction *func, const char *label) {
+    return func ? create_block(func, label) : NULL;
+}
+
+/* Detach a block from its function; it and its instructions stay in the
+ * function arena.  The caller is responsible for having redirected every
+ * edge into it. */
+void ir__function_remove_block(IrFunction *func, IrBasicBlock *bb) {
+    while (bb->succ_count > 0) ir__block_unlink(bb, bb->successors[0]);
+    while (bb->pred_count > 0) ir__block_unlink(bb->predecessors[0], bb);
+    remove_block_ref(func->all_blocks, &func->block_count, bb);
+    while (bb->first_inst) ir__inst_destroy(bb->first_inst);
+}
+
+static void function_destroy(IrFunction *func) {
+    analysis__release(func);
+    u__arena_release(&func->arena);
+    ir_free(func->all_blocks);
+    ir_free(func);
+}
+
 IrBuilder *ir__builder_create(SemanticContext *sem_ctx) {
     IrBuilder *b = ir_alloc(sizeof(IrBuilder));
     if (!b) return NULL;
@@ -318,57 +870,37 @@ void ir__builder_destroy(IrBuilder *b) {
     ir_free(b);
 }
 
+/* The new function has param_count parameter slots for the caller to fill
+ * with ir__value_param. */
 IrFunction *ir__builder_start_function
     ( IrBuilder *b
     , const char *name
     , DataType return_type
     , Type *return_type_info
-    , IrValue **params
     , uint32_t param_count
 ) {
     if (!b || !name) return NULL;
+    IrModule *mod = b->module;
+    if (mod->func_count >= mod->func_capacity &&
+        !grow_ptr_array((void ***)&mod->functions, &mod->func_count, &mod->func_capacity))
+        return NULL;
     IrFunction *func = ir_alloc(sizeof(IrFunction));
     if (!func) return NULL;
-    func->name = u__strdup_safe(name);
+    func->name = intern(mod, name);
     func->return_type = return_type;
     func->return_type_info = return_type_info;
-    func->next_temp_id = func->next_block_id = 0;
-    func->entry_block = NULL;
-    func->all_blocks = NULL; func->block_count = func->block_capacity = 0;
-    func->parameters = NULL; func->param_count = func->param_capacity = 0;
-    func->module = b->module;
-    if (params && param_count > 0) {
-        func->param_capacity = param_count;
-        func->parameters = ir_alloc(param_count * sizeof(IrValue *));
-        if (!func->parameters) { ir_free(func->name); ir_free(func); return NULL; }
-        memcpy(func->parameters, params, param_count * sizeof(IrValue *));
-        func->param_count = param_count;
-    }
-    IrBasicBlock *entry = create_block(func, "entry");
-    if (!entry) { ir_free(func->name); ir_free(func->parameters); ir_free(func); return NULL; }
-    func->entry_block = entry;
-    b->current_function = func;
-    b->current_block = entry;
-    IrModule *mod = b->module;
-    if (mod->func_count >= mod->func_capacity) {
-        if (!grow_ptr_array((void ***)&mod->functions, &mod->func_count, &mod->func_capacity)) {
-            ir_free(func->name);
-            ir_free(func->parameters);
-            ir_free(func->all_blocks);
-            ir_free(func);
-            return NULL;
-        }
-    } else if (mod->functions == NULL) {
-        mod->func_capacity = 4;
-        mod->functions = ir_alloc(4 * sizeof(IrFunction *));
-        if (!mod->functions) {
-            ir_free(func->name);
-            ir_free(func->parameters);
-            ir_free(func->all_blocks);
-            ir_free(func);
-            return NULL;
-        }
+    func->module = mod;
+    if (param_count > 0) {
+        func->parameters = arena_alloc(&func->arena, param_count * sizeof(IrValue *));
+        func->param_count = func->parameters ? param_count : 0;
     }
+    func->entry_block = create_block(func, "entry");
+    if (!func->name || !func->entry_block || func->param_count != param_count) {
+        function_destroy(func);
+        return NULL;
+    }
+    b->current_function = func;
+    b->current_block = func->entry_block;
     mod->functions[mod->func_count++] = func;
     return func;
 }
@@ -414,12 +946,6 @@ void ir__builder_set_local(IrBuilder *b, const char *name, IrValue *alloca) {
     b->local_count++;
 }
 
-char *ir__builder_temp_name(IrFunction *func, char *buf, size_t bufsize) {
-    uint32_t id = func->next_temp_id++;
-    snprintf(buf, bufsize, "%%t%u", id);
-    return buf;
-}
-
 /* AST → IR translation – only IR, no assembly. */
 static IrValue *ir_visit_expr(IrBuilder *b, ASTNode *node);
 static void ir_visit_stmt(IrBuilder *b, ASTNode *node);
@@ -430,17 +956,17 @@ static IrValue *ir_get_variable(IrBuilder *b, const char *name, uint16_t line, u
     return ptr;
 }
 
-static IrValue *ir_literal_to_value(ASTNode *node) {
+static IrValue *ir_literal_to_value(IrBuilder *b, ASTNode *node) {
     if (!node) return NULL;
     TokenType tt = node->operation_type;
     if (tt == TOKEN_NUMBER) {
         const char *s = node->value;
-        if (strchr(s, '.') || strchr(s, 'e') || strchr(s, 'E')) return ir__value_const_real(atof(s));
-        else return ir__value_const_int(atoll(s));
+        if (strchr(s, '.') || strchr(s, 'e') || strchr(s, 'E')) return ir__value_const_real(b->module, atof(s));
+        else return ir__value_const_int(b->module, atoll(s));
     } else if (tt == TOKEN_CHAR)
-        return node->value && node->value[0] ? ir__value_const_char(node->value[0])
-                                             : ir__value_const_int(0);
-    return ir__value_const_int(0);
+        return node->value && node->value[0] ? ir__value_const_char(b->module, node->value[0])
+                                             : ir__value_const_int(b->module, 0);
+    return ir__value_const_int(b->module, 0);
 }
 
 static IrOpcode map_binary_op(TokenType tt) {
@@ -455,23 +981,142 @@ static IrOpcode map_binary_op(TokenType tt) {
         case TOKEN_CARET: return IR_XOR;
         case TOKEN_SHL: return IR_SHL;
         case TOKEN_SHR: return IR_SHR;
+        case TOKEN_SAR: return IR_SAR;
+        case TOKEN_DOUBLE_EQ: return IR_EQ;
+        case TOKEN_NE: return IR_NEQ;
+        case TOKEN_LT: return IR_LT;
+        case TOKEN_LE: return IR_LE;
+        case TOKEN_GT: return IR_GT;
+        case TOKEN_GE: return IR_GE;
+        case TOKEN_PLUS_EQ: return IR_ADD;
+        case TOKEN_MINUS_EQ: return IR_SUB;
+        case TOKEN_STAR_EQ: return IR_MUL;
+        case TOKEN_SLASH_EQ: return IR_DIV;
+        case TOKEN_PERCENT_EQ: return IR_MOD;
+        case TOKEN_AMPERSAND_EQ: return IR_AND;
+        case TOKEN_PIPE_EQ: return IR_OR;
+        case TOKEN_CARET_EQ: return IR_XOR;
+        case TOKEN_SHL_EQ: return IR_SHL;
+        case TOKEN_SHR_EQ: return IR_SHR;
+        case TOKEN_SAR_EQ: return IR_SAR;
         default: return IR_ADD;
     }
 }
 
+/* True if evaluating the expression can neither trap nor write memory, so it
+ * may be executed even when its result ends up unused. */
+static bool ir_expr_is_speculatable(ASTNode *node) {
+    if (!node) return false;
+    switch (node->type) {
+        case AST_LITERAL_VALUE:
+        case AST_IDENTIFIER:
+            return true;
+        case AST_UNARY_OPERATION:
+            /* The parser keeps the operand of a prefix operator on the
+             * right. A dereference may fault, so only the arithmetic
+             * operators qualify. */
+            if (node->operation_type != TOKEN_BANG && node->operation_type != TOKEN_TILDE &&
+                node->operation_type != TOKEN_MINUS)
+                return false;
+            return ir_expr_is_speculatable(node->right);
+        case AST_CAST:
+            return ir_expr_is_speculatable(node->left);
+        case AST_BINARY_OPERATION:
+            if (node->operation_type == TOKEN_SLASH || node->operation_type == TOKEN_PERCENT)
+                return false;
+            return ir_expr_is_speculatable(node->left) && ir_expr_is_speculatable(node->right);
+        case AST_TERNARY_OPERATION:
+            return ir_expr_is_speculatable(node->left) &&
+                   ir_expr_is_speculatable(node->right) &&
+                   ir_expr_is_speculatable((ASTNode *)node->extra);
+        default:
+            return false;
+    }
+}
+
 static IrValue *ir_load_variable(IrBuilder *b, IrValue *ptr, DataType type, Type *type_info) {
     IrValue *temp = ir__value_temp(b->current_function, type, type_info);
     ir__emit_load(b, temp, ptr);
     return temp;
 }
 
+static void ir_set_location(IrBuilder *b, const ASTNode *node) {
+    if (!node->line) return;
+    b->line = node->line;
+    b->column = node->column;
+}
+
+/* alloc(size, align, type) and realloc(ptr, size) become calls into the
+ * runtime; the type operand of alloc only informs the front end. */
+static IrValue *ir_emit_runtime_alloc(IrBuilder *b, ASTNode *node) {
+    AST *list = node->left ? (AST *)node->left->extra : NULL;
+    if (!list || list->count < 2) return ir__value_const_int(b->module, 0);
+    IrValue *args[2];
+    for (uint32_t i = 0; i < 2; i++) {
+        args[i] = ir_visit_expr(b, list->nodes[i]);
+        if (!args[i]) return NULL;
+    }
+    ir_set_location(b, node);
+    const char *fn = node->type == AST_ALLOC ? IR_RUNTIME_ALLOC : IR_RUNTIME_REALLOC;
+    IrValue *res = ir__value_temp(b->current_function, TYPE_POINTER, NULL);
+    ir__emit_call(b, res, ir__value_global(b->module, fn, TYPE_FUNCTION, NULL), args, 2);
+    return res;
+}
+
+/* Address of an assignable expression, or NULL after reporting why not.
+ * Array elements are addressed with a GEP whose result keeps the pointer
+ * type, so later passes can recover the element size. */
+static IrValue *ir_lvalue_address(IrBuilder *b, ASTNode *lhs) {
+    switch (lhs->type) {
+        case AST_IDENTIFIER:
+            return ir_get_variable(b, lhs->value, lhs->line, lhs->column);
+        case AST_ARRAY_ACCESS: {
+            IrValue *base = ir_visit_expr(b, lhs->left);
+            IrValue *idx = ir_visit_expr(b, lhs->right);
+            if (!base || !idx) return NULL;
+            IrValue *elem_ptr = ir__value_temp(b->current_function, TYPE_POINTER, base->type_info);
+            ir__emit_gep(b, elem_ptr, base, &idx, 1);
+            return elem_ptr;
+        }
+        case AST_FIELD_ACCESS: {
+            IrValue *base = ir_visit_expr(b, lhs->left);
+            if (!base) return NULL;
+            uint32_t idx = 0; /* simplified */
+            IrValue *idx_val = ir__value_struct_field(b->module, idx);
+            IrValue *field_ptr = ir__value_temp(b->current_function, TYPE_POINTER, NULL);
+            ir__emit_gep(b, field_ptr, base, &idx_val, 1);
+            return field_ptr;
+        }
+        default:
+            errhandler__report_error
+                ( ERROR_CODE_IR_UNSUPPORTED_NODE
+                , lhs->line
+                , lhs->column
+                , "ir"
+                , "Complex lvalue"
+            );
+            return NULL;
+    }
+}
+
+/* Type of the value read through an lvalue address. */
+static DataType ir_lvalue_type(const IrValue *addr, bool is_slot) {
+    if (!addr->type_info) return TYPE_INT;
+    if (is_slot) return ir__datatype_of(addr->type_info);
+    DataType t = ir__element_datatype(addr->type_info);
+    return t == TYPE_UNKNOWN ? TYPE_INT : t;
+}
+
 static IrValue *ir_visit_expr(IrBuilder *b, ASTNode *node) {
     if (!node) return NULL;
+    ir_set_location(b, node);
     switch (node->type) {
-        case AST_LITERAL_VALUE: return ir_literal_to_value(node);
+        case AST_LITERAL_VALUE: return ir_literal_to_value(b, node);
         case AST_IDENTIFIER: {
             IrValue *ptr = ir_get_variable(b, node->value, node->line, node->column);
-            return ptr ? ir_load_variable(b, ptr, ptr->type, ptr->type_info) : ir__value_const_int(0);
+            if (!ptr) return ir__value_const_int(b->module, 0);
+            DataType type = ptr->type_info ? ir__datatype_of(ptr->type_info) : ptr->type;
+            return ir_load_variable(b, ptr, type, ptr->type_info);
         }
         case AST_BINARY_OPERATION: {
             IrValue *left = ir_visit_expr(b, node->left), *right = ir_visit_expr(b, node->right);
@@ -484,8 +1129,19 @@ static IrValue *ir_visit_expr(IrBuilder *b, ASTNode *node) {
             return res;
         }
         case AST_UNARY_OPERATION: {
-            IrValue *opd = ir_visit_expr(b, node->left);
+            /* The parser keeps the operand of a prefix operator on the right. */
+            TokenType t = node->operation_type;
+            bool prefix = t == TOKEN_BANG || t == TOKEN_TILDE || t == TOKEN_MINUS;
+            IrValue *opd = ir_visit_expr(b, prefix && node->right ? node->right : node->left);
             if (!opd) return NULL;
+            if (node->operation_type == TOKEN_BANG) {
+                /* Logical not is a comparison with zero; IR_NOT is bitwise. */
+                IrValue *res = ir__value_temp(b->current_function, TYPE_INT, NULL);
+                IrValue *zero = opd->type == TYPE_REAL ? ir__value_const_real(b->module, 0.0)
+                                                       : ir__value_const_int(b->module, 0);
+                ir__emit_op2(b, IR_EQ, res, opd, zero);
+                return res;
+            }
             IrValue *res = ir__value_temp(b->current_function, opd->type, NULL);
             IrOpcode op = (node->operation_type == TOKEN_MINUS) ? IR_NEG : IR_NOT;
             ir__emit_op1(b, op, res, opd);
@@ -495,34 +1151,43 @@ static IrValue *ir_visit_expr(IrBuilder *b, ASTNode *node) {
         case AST_COMPOUND_ASSIGNMENT: {
             IrValue *rval = ir_visit_expr(b, node->right);
             if (!rval) return NULL;
-            ASTNode *lhs = node->left;
-            if (lhs->type == AST_IDENTIFIER) {
-                IrValue *ptr = ir_get_variable(b, lhs->value, lhs->line, lhs->column);
-                if (ptr) ir__emit_store(b, ptr, rval);
-            } else if (lhs->type == AST_FIELD_ACCESS) {
-                IrValue *base = ir_visit_expr(b, lhs->left);
-                if (!base) return NULL;
-                uint32_t idx = 0; /* simplified */
-                IrValue *idx_val = ir__value_struct_field(idx);
-                IrValue *field_ptr = ir__value_temp(b->current_function, TYPE_POINTER, NULL);
-                ir__emit_gep(b, field_ptr, base, &idx_val, 1);
-                ir__emit_store(b, field_ptr, rval);
-            } else {
-                errhandler__report_error
-                    ( ERROR_CODE_IR_UNSUPPORTED_NODE
-                    , node->line
-                    , node->column
-                    , "ir"
-                    , "Complex lvalue"
-                );
+            IrValue *ptr = ir_lvalue_address(b, node->left);
+            if (!ptr) return rval;
+            if (node->type == AST_COMPOUND_ASSIGNMENT) {
+                DataType type = ir_lvalue_type(ptr, node->left->type == AST_IDENTIFIER);
+                IrValue *old = ir_load_variable(b, ptr, type, NULL);
+                IrValue *res = ir__value_temp(b->current_function, type, NULL);
+                ir__emit_op2(b, map_binary_op(node->operation_type), res, old, rval);
+                rval = res;
             }
+            ir__emit_store(b, ptr, rval);
             return rval;
         }
+        case AST_POSTFIX_INCREMENT:
+        case AST_POSTFIX_DECREMENT:
+        case AST_PREFIX_INCREMENT:
+        case AST_PREFIX_DECREMENT: {
+            IrValue *ptr = node->left ? ir_lvalue_address(b, node->left) : NULL;
+            if (!ptr) return ir__value_const_int(b->module, 0);
+            DataType type = ir_lvalue_type(ptr, node->left->type == AST_IDENTIFIER);
+            IrValue *old = ir_load_variable(b, ptr, type, NULL);
+            IrValue *res = ir__value_temp(b->current_function, type, NULL);
+            bool inc = node->type == AST_POSTFIX_INCREMENT || node->type == AST_PREFIX_INCREMENT;
+            ir__emit_op2(b, inc ? IR_ADD : IR_SUB, res, old, ir__value_const_int(b->module, 1));
+            ir__emit_store(b, ptr, res);
+            bool postfix = node->type == AST_POSTFIX_INCREMENT || node->type == AST_POSTFIX_DECREMENT;
+            return postfix ? old : res;
+        }
+        case AST_ARRAY_ACCESS: {
+            IrValue *ptr = ir_lvalue_address(b, node);
+            if (!ptr) return ir__value_const_int(b->module, 0);
+            return ir_load_variable(b, ptr, ir_lvalue_type(ptr, false), NULL);
+        }
         case AST_FIELD_ACCESS: {
             IrValue *base = ir_visit_expr(b, node->left);
             if (!base) return NULL;
             uint32_t idx = 0;
-            IrValue *idx_val = ir__value_struct_field(idx);
+            IrValue *idx_val = ir__value_struct_field(b->module, idx);
             IrValue *field_ptr = ir__value_temp(b->current_function, TYPE_POINTER, NULL);
             ir__emit_gep(b, field_ptr, base, &idx_val, 1);
             IrValue *res = ir__value_temp(b->current_function, TYPE_INT, NULL);
@@ -530,9 +1195,19 @@ static IrValue *ir_visit_expr(IrBuilder *b, ASTNode *node) {
             return res;
         }
         case AST_TERNARY_OPERATION: {
-            /* Generate IR for ternary: cond ? true : false using phi node. */
+            /* Side-effect-free arms are evaluated unconditionally and merged
+             * with a select; anything else needs a branch diamond and a phi. */
             IrValue *cond = ir_visit_expr(b, node->left);
             if (!cond) return NULL;
+            if (ir_expr_is_speculatable(node->right) &&
+                ir_expr_is_speculatable((ASTNode *)node->extra)) {
+                IrValue *then_val = ir_visit_expr(b, node->right);
+                IrValue *else_val = ir_visit_expr(b, (ASTNode *)node->extra);
+                if (!then_val || !else_val) return NULL;
+                IrValue *res = ir__value_temp(b->current_function, then_val->type, then_val->type_info);
+                ir__emit_select(b, res, cond, then_val, else_val);
+                return res;
+            }
             IrBasicBlock *then_bb = ir__builder_add_block(b, "tern.then", false);
             IrBasicBlock *else_bb = ir__builder_add_block(b, "tern.else", false);
             IrBasicBlock *merge_bb = ir__builder_add_block(b, "tern.end", false);
@@ -555,7 +1230,7 @@ static IrValue *ir_visit_expr(IrBuilder *b, ASTNode *node) {
         case AST_FUNCTION_CALL: {
             ASTNode *callee_node = node->left;
             if (!callee_node) return NULL;
-            IrValue *callee = ir__value_global(callee_node->value, TYPE_FUNCTION, NULL);
+            IrValue *callee = ir__value_global(b->module, callee_node->value, TYPE_FUNCTION, NULL);
             AST *arg_list = (AST *)node->extra;
             uint32_t argc = arg_list ? arg_list->count : 0;
             IrValue **args = ir_alloc(sizeof(IrValue *) * argc);
@@ -565,6 +1240,16 @@ static IrValue *ir_visit_expr(IrBuilder *b, ASTNode *node) {
             ir_free(args);
             return res;
         }
+        case AST_ALLOC:
+        case AST_REALLOC:
+            return ir_emit_runtime_alloc(b, node);
+        case AST_FREE: {
+            IrValue *ptr = ir_visit_expr(b, node->left);
+            if (!ptr) return NULL;
+            ir_set_location(b, node);
+            ir__emit_call(b, NULL, ir__value_global(b->module, IR_RUNTIME_FREE, TYPE_FUNCTION, NULL), &ptr, 1);
+            return NULL;
+        }
         case AST_CAST: {
             IrValue *src = ir_visit_expr(b, node->left);
             if (!src) return NULL;
@@ -574,7 +1259,7 @@ static IrValue *ir_visit_expr(IrBuilder *b, ASTNode *node) {
         }
         case AST_MULTI_INITIALIZER: {
             AST *list = (AST *)node->extra;
-            if (!list || list->count == 0) return ir__value_const_int(0);
+            if (!list || list->count == 0) return ir__value_const_int(b->module, 0);
             IrValue *first = ir_visit_expr(b, list->nodes[0]);
             DataType elem_type = first ? first->type : TYPE_INT;
             IrValue *temp_alloca = ir__value_temp(b->current_function, TYPE_POINTER, NULL);
@@ -582,7 +1267,7 @@ static IrValue *ir_visit_expr(IrBuilder *b, ASTNode *node) {
             for (uint16_t i = 0; i < list->count; i++) {
                 IrValue *elem = ir_visit_expr(b, list->nodes[i]);
                 if (!elem) continue;
-                IrValue *idx = ir__value_const_int(i);
+                IrValue *idx = ir__value_const_int(b->module, i);
                 IrValue *elem_ptr = ir__value_temp(b->current_function, TYPE_POINTER, NULL);
                 ir__emit_gep(b, elem_ptr, temp_alloca, &idx, 1);
                 ir__emit_store(b, elem_ptr, elem);
@@ -598,19 +1283,32 @@ static IrValue *ir_visit_expr(IrBuilder *b, ASTNode *node) {
                 , "Unsupported expr %d"
                 , node->type
             );
-            return ir__value_const_int(0);
+            return ir__value_const_int(b->module, 0);
     }
 }
+/* A declaration is const through `def const` or a const type. */
+static bool declared_const(const ASTNode *node) {
+    if (node->is_const) return true;
+    const Type *t = node->variable_type;
+    if (t) for (uint8_t i = 0; i < t->modifier_count; i++)
+        if (t->modifiers[i] && strcmp(t->modifiers[i], "const") == 0) return true;
+    return false;
+}
+
 static void ir_visit_stmt(IrBuilder *b, ASTNode *node) {
     if (!node) return;
+    ir_set_location(b, node);
     switch (node->type) {
         case AST_VARIABLE_DECLARATION: {
             if (!node->value) break;
             IrValue *alloca = ir__value_temp(b->current_function, TYPE_POINTER, NULL);
-            ir__emit_alloca(b, alloca, TYPE_INT, NULL);
+            ir__emit_alloca(b, alloca, ir__datatype_of(node->variable_type), node->variable_type);
             ir__builder_set_local(b, node->value, alloca);
             if (node->default_value) {
+                bool outer = b->const_init;
+                b->const_init = outer || declared_const(node);
                 IrValue *init = ir_visit_expr(b, node->default_value);
+                b->const_init = outer;
                 if (init) ir__emit_store(b, alloca, init);
             }
             break;
@@ -657,12 +1355,36 @@ static void ir_visit_stmt(IrBuilder *b, ASTNode *node) {
             ir__emit_ret(b, val);
             break;
         }
-        case AST_LABEL_DECLARATION:
-            ir__builder_add_block(b, node->value, true);
+        case AST_LABEL_DECLARATION: {
+            IrBasicBlock *prev = b->current_block;
+            IrBasicBlock *label_bb = ir__builder_add_block(b, node->value, false);
+            /* Make the fall-through into the label an explicit edge. */
+            if (prev && !ir__block_terminator(prev)) ir__emit_br(b, label_bb);
+            ir__builder_set_block(b, label_bb);
             break;
+        }
         case AST_NOP:
             ir__emit_nop(b);
             break;
+        case AST_SIGNAL: {
+            ASTNode *arg = node->left;
+            AST *list = arg && arg->type == AST_MULTI_INITIALIZER ? (AST *)arg->extra : NULL;
+            uint32_t count = list ? list->count : (arg ? 1 : 0);
+            IrValue **args = count ? ir_alloc(count * sizeof(IrValue *)) : NULL;
+            if (count && !args) break;
+            for (uint32_t i = 0; i < count; i++) {
+                args[i] = ir_visit_expr(b, list ? list->nodes[i] : arg);
+                if (!args[i]) args[i] = ir__value_const_int(b->module, 0);
+            }
+            ir_set_location(b, node);
+            ir__emit_call(b, NULL, ir__value_global(b->module, IR_RUNTIME_SIGNAL, TYPE_FUNCTION, NULL), args, count);
+            ir_free(args);
+            break;
+        }
+        case AST_HALT:
+            ir_set_location(b, node);
+            ir__emit_call(b, NULL, ir__value_global(b->module, IR_RUNTIME_HALT, TYPE_FUNCTION, NULL), NULL, 0);
+            break;
         default:
             ir_visit_expr(b, node);
             break;
@@ -674,34 +1396,28 @@ static void ir_convert_function(IrBuilder *b, ASTNode *func_decl) {
     ASTNode *params_node = func_decl->left;
     ASTNode *body = func_decl->right;
     DataType ret_type = func_decl->variable_type ? TYPE_INT : TYPE_VOID;
-    IrValue **params = NULL;
-    uint32_t param_count = 0;
-    if (params_node && params_node->type == AST_BLOCK && params_node->extra) {
-        AST *plist = (AST *)params_node->extra;
-        param_count = plist->count;
-        if (param_count > 0) {
-            params = ir_alloc(sizeof(IrValue *) * param_count);
-            for (uint32_t i = 0; i < param_count; i++) {
-                ASTNode *p = plist->nodes[i];
-                params[i] = ir__value_param(NULL, i, TYPE_INT, NULL);
-                if (p->value) strncpy(params[i]->name, p->value, sizeof(params[i]->name)-1);
-            }
-        }
-    }
+    AST *plist = params_node && params_node->type == AST_BLOCK ? (AST *)params_node->extra : NULL;
+    uint32_t param_count = plist ? plist->count : 0;
     IrFunction *func = ir__builder_start_function
         ( b
         , name
         , ret_type
         , func_decl->variable_type
-        , params
         , param_count
     );
+    if (!func) return;
     for (uint32_t i = 0; i < param_count; i++) {
-        if (params[i]->name[0]) {
+        ASTNode *p = plist->nodes[i];
+        DataType pt = ir__datatype_of(p->variable_type);
+        IrValue *param = ir__value_param(func, i, pt == TYPE_UNKNOWN ? TYPE_INT : pt, p->variable_type);
+        if (!param) return;
+        param->name = intern(b->module, p->value);
+        func->parameters[i] = param;
+        if (param->name) {
             IrValue *alloca = ir__value_temp(func, TYPE_POINTER, NULL);
-            ir__emit_alloca(b, alloca, TYPE_INT, NULL);
-            ir__emit_store(b, alloca, params[i]);
-            ir__builder_set_local(b, params[i]->name, alloca);
+            ir__emit_alloca(b, alloca, param->type, param->type_info);
+            ir__emit_store(b, alloca, param);
+            ir__builder_set_local(b, param->name, alloca);
         }
     }
     if (body) ir_visit_stmt(b, body);
@@ -737,52 +1453,44 @@ IrModule *ir__generate_module(SemanticContext *sem_ctx, AST *ast) {
 
 IrModule *ir__module_create(SymbolTable *global_scope) {
     IrModule *mod = ir_alloc(sizeof(IrModule));
-    if (mod) {
-        mod->functions = NULL;
-        mod->func_count = mod->func_capacity = 0;
-        mod->symbols = global_scope;
-    }
+    if (!mod) return NULL;
+    mod->pool = pool_create();
+    if (!mod->pool) { ir_free(mod); return NULL; }
+    mod->functions = NULL;
+    mod->func_count = mod->func_capacity = 0;
+    mod->symbols = global_scope;
+    mod->profile = NULL;
     return mod;
 }
 
 void ir__module_destroy(IrModule *mod) {
     if (!mod) return;
-    for (uint32_t i = 0; i < mod->func_count; i++) {
-        IrFunction *f = mod->functions[i];
-        for (uint32_t j = 0; j < f->block_count; j++) {
-            IrBasicBlock *bb = f->all_blocks[j];
-            IrInstruction *inst = bb->first_inst;
-            while (inst) {
-                IrInstruction *next = inst->next;
-                if (inst->extra) {
-                    if (inst->opcode == IR_CALL) { IrCallExtra *call = inst->extra; ir_free(call->args); }
-                    else if (inst->opcode == IR_GEP) { IrGepExtra *gep = inst->extra; if (gep) ir_free(gep->indices); }
-                    else if (inst->opcode == IR_PHI) { IrPhiExtra *phi = inst->extra; ir_free(phi->values); ir_free(phi->blocks); }
-                    ir_free(inst->extra);
-                }
-                ir_free(inst);
-                inst = next;
-            }
-            ir_free(bb->predecessors); ir_free(bb->successors); ir_free(bb->phi_nodes); ir_free(bb);
-        }
-        ir_free(f->all_blocks); ir_free(f->parameters); ir_free(f->name); ir_free(f);
+    for (uint32_t i = 0; i < mod->func_count; i++) function_destroy(mod->functions[i]);
+    if (mod->profile) {
+        for (uint32_t i = 0; i < mod->profile->func_count; i++) ir_free(mod->profile->funcs[i].name);
+        ir_free(mod->profile->funcs); ir_free(mod->profile->path); ir_free(mod->profile);
     }
+    pool_destroy(mod->pool);
     ir_free(mod->functions); ir_free(mod);
 }
 
-static void ir_print_value(FILE *f, const IrValue *v) {
-    if (!v) { fprintf(f, "void"); return; }
-    switch (v->kind) {
-        case IR_VALUE_TEMP: case IR_VALUE_PARAM: case IR_VALUE_LABEL: case IR_VALUE_GLOBAL_SYMBOL:
-            fprintf(f, "%s", v->name); break;
-        case IR_VALUE_CONST_INT: fprintf(f, "%lld", (long long)v->const_data.int_val); break;
-        case IR_VALUE_CONST_REAL: fprintf(f, "%.6g", v->const_data.real_val); break;
-        case IR_VALUE_CONST_CHAR: fprintf(f, "'%c'", v->const_data.char_val); break;
-        case IR_VALUE_STRUCT_FIELD: fprintf(f, "field%u", v->const_data.field_index); break;
-        default: fprintf(f, "?");
+/* Take func out of mod and free it; nothing else may refer to it. */
+void ir__module_remove_function(IrModule *mod, IrFunction *func) {
+    if (!mod || !func) return;
+    for (uint32_t i = 0; i < mod->func_count; i++) {
+        if (mod->functions[i] != func) continue;
+        memmove(&mod->functions[i], &mod->functions[i + 1], (mod->func_count - i - 1) * sizeof(IrFunction *));
+        mod->func_count--;
+        function_destroy(func);
+        return;
     }
 }
 
+static void ir_print_value(FILE *f, const IrValue *v) {
+    char buf[128];
+    fputs(ir__value_format(buf, sizeof(buf), v), f);
+}
+
 static void ir_print_opcode(FILE *f, IrOpcode op) {
     switch (op) {
         case IR_NOP: fprintf(f, "nop"); break; case IR_ADD: fprintf(f, "add"); break;
@@ -800,6 +1508,8 @@ static void ir_print_opcode(FILE *f, IrOpcode op) {
         case IR_BR: fprintf(f, "br"); break; case IR_BRCOND: fprintf(f, "brcond"); break;
         case IR_CALL: fprintf(f, "call"); break; case IR_RET: fprintf(f, "ret"); break;
         case IR_PHI: fprintf(f, "phi"); break; case IR_CAST: fprintf(f, "cast"); break;
+        case IR_SELECT: fprintf(f, "select"); break;
+        case IR_MEMSET: fprintf(f, "memset"); break; case IR_MEMCPY: fprintf(f, "memcpy"); break;
         default: fprintf(f, "??");
     }
 }
@@ -808,12 +1518,18 @@ void ir__print_module(FILE *f, const IrModule *mod) {
     if (!mod) return;
     for (uint32_t i = 0; i < mod->func_count; i++) {
         IrFunction *func = mod->functions[i];
-        fprintf(f, "define %s %s(", semantic__type_to_string(func->return_type), func->name);
+        fprintf(f, "define %s%s %s(", func->is_internal ? "internal " : "",
+                semantic__type_to_string(func->return_type), func->name);
         for (uint32_t j = 0; j < func->param_count; j++) { if (j) fprintf(f, ", "); ir_print_value(f, func->parameters[j]); }
         fprintf(f, ") {\n");
         for (uint32_t j = 0; j < func->block_count; j++) {
             IrBasicBlock *bb = func->all_blocks[j];
-            fprintf(f, "%s:\n", bb->label);
+            fprintf(f, "%s:", bb->label);
+            const char *sep = "    ; ";
+            if (func->has_profile) { fprintf(f, "%scount %llu", sep, (unsigned long long)bb->exec_count); sep = ", "; }
+            if (bb->is_cold) { fprintf(f, "%scold", sep); sep = ", "; }
+            if (bb->align) fprintf(f, "%salign %u", sep, bb->align);
+            fprintf(f, "\n");
             for (IrInstruction *inst = bb->first_inst; inst; inst = inst->next) {
                 fprintf(f, "  ");
                 if (inst->result) { ir_print_value(f, inst->result); fprintf(f, " = "); }
@@ -835,6 +1551,13 @@ void ir__print_module(FILE *f, const IrModule *mod) {
                     } else if (inst->opcode == IR_GEP) {
                         IrGepExtra *gep = inst->extra;
                         if (gep) for (uint32_t k = 0; k < gep->index_count; k++) { fprintf(f, ", "); ir_print_value(f, gep->indices[k]); }
+                    } else if (inst->opcode == IR_SELECT) {
+                        IrSelectExtra *sel = inst->extra;
+                        fprintf(f, ", "); ir_print_value(f, sel->false_value);
+                    } else if (inst->opcode == IR_MEMSET || inst->opcode == IR_MEMCPY) {
+                        IrMemExtra *mem = inst->extra;
+                        fprintf(f, ", "); ir_print_value(f, mem->count);
+                        fprintf(f, " x %u", mem->elem_size);
                     }
                 }
                 fprintf(f, "\n");
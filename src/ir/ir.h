@@ -7,12 +7,15 @@
 #include <stdio.h>
 #include "../semantic/semantic.h"
 #include "../parser/parser.h"
+#include "../utils/arena.h"
 
 typedef struct IrBasicBlock IrBasicBlock;
 typedef struct IrFunction   IrFunction;
 typedef struct IrModule     IrModule;
 typedef struct IrInstruction IrInstruction;
 typedef struct IrBuilder    IrBuilder;
+typedef struct IrPool       IrPool;
+typedef struct IrAnalysisCache IrAnalysisCache;
 
 /* IR opcodes – all are architecture‑independent. */
 typedef enum {
@@ -20,7 +23,8 @@ typedef enum {
     IR_EQ, IR_NEQ, IR_LT, IR_LE, IR_GT, IR_GE,
     IR_AND, IR_OR, IR_XOR, IR_SHL, IR_SHR, IR_SAR, IR_NOT,
     IR_LOAD, IR_STORE, IR_ALLOCA, IR_GEP,
-    IR_BR, IR_BRCOND, IR_CALL, IR_RET, IR_PHI, IR_CAST
+    IR_BR, IR_BRCOND, IR_CALL, IR_RET, IR_PHI, IR_CAST, IR_SELECT,
+    IR_MEMSET, IR_MEMCPY
 } IrOpcode;
 
 /* Kinds of IR values. */
@@ -30,23 +34,45 @@ typedef enum {
     IR_VALUE_LABEL, IR_VALUE_STRUCT_FIELD, IR_VALUE_STRUCT_INIT
 } IrValueKind;
 
-typedef struct IrValue {
-    IrValueKind kind;
-    DataType    type;
+typedef struct IrValue IrValue;
+
+/*
+ * One operand slot holding a temp or a parameter.  Every instruction in a
+ * block is on the use list of each temp and parameter it reads; the list
+ * follows it as it is unlinked and inserted again.  Constants, globals and
+ * labels are shared and keep no uses.
+ */
+typedef struct IrUse {
+    IrInstruction *user;
+    IrValue       *value;           /* value whose list this is on */
+    IrValue      **slot;            /* operand or extra field of user */
+    struct IrUse  *prev, *next;     /* other uses of the same value */
+    struct IrUse  *next_in_user;
+} IrUse;
+
+/*
+ * Constants, struct field indices and globals are unique per module: two
+ * requests for the same value return the same pointer, so values must never
+ * be modified once created.  Temps and parameters belong to their function.
+ */
+struct IrValue {
+    uint8_t     kind;               /* IrValueKind */
+    uint8_t     type;               /* DataType */
+    uint32_t    id;                 /* temp or parameter number */
     Type       *type_info;
     union {
-        int64_t  int_val;
-        double   real_val;
-        char     char_val;
-        uint32_t field_index;
+        int64_t       int_val;
+        double        real_val;
+        char          char_val;
+        uint32_t      field_index;
+        IrBasicBlock *block;        /* IR_VALUE_LABEL */
     } const_data;
-    char        name[64];
-    uint32_t    id;
-} IrValue;
+    const char *name;               /* interned; NULL for temps and constants */
+    IrUse      *uses;               /* temps and parameters only */
+};
 
 /* Instruction structure – no machine‑specific fields. */
 struct IrInstruction {
-    IrOpcode      opcode;
     IrValue      *result;
     IrValue      *operand1;
     IrValue      *operand2;
@@ -54,8 +80,31 @@ struct IrInstruction {
     IrBasicBlock *parent;
     struct IrInstruction *prev;
     struct IrInstruction *next;
+    IrUse        *uses;             /* while linked into a block */
+    uint16_t      opcode;           /* IrOpcode */
+    uint16_t      flags;            /* IR_INST_* */
+    uint16_t      line, column;     /* source position, 0 if synthesised */
 };
 
+/* Call in the initializer of a const declaration, which the consteval pass
+ * evaluates at compile time when its arguments are constant. */
+#define IR_INST_CONST_INIT  0x0001
+
+/* alloca: operand1 is the slot size in bytes and operand2 its alignment;
+ * both are NULL for a single scalar variable. */
+
+/* Runtime entry points that alloc/realloc/free lower to. */
+#define IR_RUNTIME_ALLOC    "alloc"
+#define IR_RUNTIME_REALLOC  "realloc"
+#define IR_RUNTIME_FREE     "free"
+/* `signal <svc>` and `halt` lower to calls of these entry points. */
+#define IR_RUNTIME_SIGNAL   "signal"
+#define IR_RUNTIME_HALT     "halt"
+/* Instrumented builds (-fprofile-generate): the table of 64-bit block
+ * counters, and the routine that writes it out before the program exits. */
+#define IR_RUNTIME_PROFILE_COUNTERS "__px_prof_counters"
+#define IR_RUNTIME_PROFILE_DUMP     "__px_prof_dump"
+
 /* Extra data for GEP, calls, branches, phi. */
 typedef struct IrGepExtra { IrValue **indices; uint32_t index_count; } IrGepExtra;
 typedef struct IrCallExtra { IrValue **args; uint32_t arg_count; } IrCallExtra;
@@ -64,42 +113,87 @@ typedef struct IrCondBranchExtra {
     IrBasicBlock *false_target;
 } IrCondBranchExtra;
 typedef struct IrPhiExtra { IrValue **values; IrBasicBlock **blocks; uint32_t count; } IrPhiExtra;
+/* select: operand1 is the condition, operand2 the value taken when it is true. */
+typedef struct IrSelectExtra { IrValue *false_value; } IrSelectExtra;
+/*
+ * memset: operand1 is the destination, operand2 the value stored into each
+ * of count elements of elem_size bytes.  memcpy: operand2 is the source and
+ * elements are copied in ascending order, exactly like the loop they
+ * replace, so overlapping ranges behave the same as that loop.
+ */
+typedef struct IrMemExtra { IrValue *count; uint32_t elem_size; } IrMemExtra;
+
+/* Edges a block holds without a separate allocation; a block ending in
+ * brcond has two successors, and most blocks have at most two predecessors. */
+#define IR_BLOCK_INLINE_EDGES 2
 
 /* Basic block – holds a list of IR instructions. */
 struct IrBasicBlock {
-    char                 label[64];
+    const char          *label;         /* interned, not unique within a function */
     IrInstruction       *first_inst;
     IrInstruction       *last_inst;
     IrFunction          *function;
-    uint32_t             id;
-    IrBasicBlock       **predecessors;
+    IrValue             *label_value;   /* shared by every branch to the block */
+    IrBasicBlock       **predecessors;  /* pred_inline until it outgrows it */
+    IrBasicBlock       **successors;    /* succ_inline until it outgrows it */
     uint32_t             pred_count, pred_capacity;
-    IrBasicBlock       **successors;
     uint32_t             succ_count, succ_capacity;
-    IrInstruction       **phi_nodes;
-    uint32_t             phi_count, phi_capacity;
+    uint32_t             id;
+    uint32_t             align;         /* requested start alignment in bytes, 0 if none */
+    bool                 is_cold;       /* block layout moved it to the cold section */
+    uint64_t             exec_count;    /* profiled executions, if has_profile */
+    IrBasicBlock        *pred_inline[IR_BLOCK_INLINE_EDGES];
+    IrBasicBlock        *succ_inline[IR_BLOCK_INLINE_EDGES];
 };
 
-/* Function – contains basic blocks and parameters. */
+/*
+ * Function – contains basic blocks and parameters.  Its blocks,
+ * instructions, instruction extras, temps and parameters all live in its
+ * arena and are freed together with the module; destroying an instruction
+ * or removing a block only unlinks it.  Functions are optimised on separate
+ * threads, so nothing may allocate from another function's arena.
+ */
 struct IrFunction {
-    char             *name;
+    const char       *name;             /* interned */
     DataType          return_type;
     Type             *return_type_info;
     IrBasicBlock     *entry_block;
     IrBasicBlock    **all_blocks;
     uint32_t          block_count, block_capacity;
     IrValue         **parameters;
-    uint32_t          param_count, param_capacity;
+    uint32_t          param_count;
     uint32_t          next_temp_id;
     uint32_t          next_block_id;
     IrModule         *module;
+    bool              has_profile;      /* block exec_count came from -fprofile-use */
+    bool              is_internal;      /* unseen outside the module: every caller is in it */
+    UArena            arena;
+    IrUse            *free_uses;        /* recycled when instructions are unlinked */
+    IrAnalysisCache  *analyses;         /* see analysis/analysis.h */
 };
 
+/* Counters owned by one function of an instrumented module: block i of the
+ * function as it was instrumented increments counter first_counter + i. */
+typedef struct IrProfileFunc {
+    char     *name;
+    uint64_t  checksum;
+    uint32_t  first_counter, block_count;
+} IrProfileFunc;
+
+typedef struct IrProfileLayout {
+    char          *path;            /* where the running program writes counts */
+    IrProfileFunc *funcs;
+    uint32_t       func_count;
+    uint32_t       counter_count;
+} IrProfileLayout;
+
 /* Module – container for functions. */
 struct IrModule {
     IrFunction      **functions;
     uint32_t          func_count, func_capacity;
     SymbolTable      *symbols;
+    IrProfileLayout  *profile;      /* set once instrumented, else NULL */
+    IrPool           *pool;         /* interned names and unique values, locked */
 };
 
 /* IR builder – state for constructing IR. */
@@ -117,23 +211,38 @@ struct IrBuilder {
     uint32_t          break_count, break_capacity;
     IrBasicBlock    **continue_stack;
     uint32_t          continue_count, continue_capacity;
+    uint16_t          line, column;   /* position stamped on new instructions */
+    bool              const_init;     /* visiting a const initializer */
 };
 
 /* Public API – IR construction only. */
 IrModule    *ir__module_create(SymbolTable *global_scope);
 void         ir__module_destroy(IrModule *mod);
+void         ir__module_remove_function(IrModule *mod, IrFunction *func);
 IrModule    *ir__generate_module(SemanticContext *sem_ctx, AST *ast);
 void         ir__print_module(FILE *f, const IrModule *mod);
 
+size_t       ir__module_bytes(const IrModule *mod);
+/* The module's single copy of str, NULL for NULL. */
+const char  *ir__module_intern(IrModule *mod, const char *str);
+/* A type owned by the module with the fields of type_info the IR reads
+ * (name, pointer level, reference, array, width); equal types share one
+ * copy.  For IR that outlives the AST, such as IR read from bitcode. */
+Type        *ir__module_type(IrModule *mod, const Type *type_info);
+
 IrValue     *ir__value_temp(IrFunction *func, DataType type, Type *type_info);
-IrValue     *ir__value_const_int(int64_t val);
-IrValue     *ir__value_const_real(double val);
-IrValue     *ir__value_const_char(char val);
-IrValue     *ir__value_global(const char *name, DataType type, Type *type_info);
+IrValue     *ir__value_const_int(IrModule *mod, int64_t val);
+IrValue     *ir__value_const_real(IrModule *mod, double val);
+IrValue     *ir__value_const_char(IrModule *mod, char val);
+IrValue     *ir__value_global(IrModule *mod, const char *name, DataType type, Type *type_info);
 IrValue     *ir__value_param(IrFunction *func, uint32_t index, DataType type, Type *type_info);
 IrValue     *ir__value_label(IrBasicBlock *block);
-IrValue     *ir__value_struct_field(uint32_t index);
-void         ir__value_free(IrValue *val);
+IrValue     *ir__value_struct_field(IrModule *mod, uint32_t index);
+const char  *ir__value_format(char *buf, size_t size, const IrValue *val);
+DataType     ir__datatype_of(const Type *type_info);
+DataType     ir__element_datatype(const Type *ptr_info);
+uint32_t     ir__type_size(const Type *type_info);
+uint32_t     ir__pointee_size(const Type *ptr_info);
 
 IrInstruction *ir__emit_op2(IrBuilder *b, IrOpcode op, IrValue *result,
                             IrValue *op1, IrValue *op2);
@@ -154,18 +263,49 @@ IrInstruction *ir__emit_gep(IrBuilder *b, IrValue *result, IrValue *base,
                             IrValue **indices, uint32_t index_count);
 IrInstruction *ir__emit_cast(IrBuilder *b, IrValue *result, IrValue *src,
                              DataType target_type, Type *target_info);
+IrInstruction *ir__emit_select(IrBuilder *b, IrValue *result, IrValue *cond,
+                               IrValue *true_val, IrValue *false_val);
 IrInstruction *ir__emit_nop(IrBuilder *b);
 
+/* Instruction and CFG mutation – used by IR transformation passes. */
+IrInstruction *ir__inst_create(IrFunction *func, IrOpcode op, IrValue *result,
+                               IrValue *op1, IrValue *op2);
+IrInstruction *ir__inst_create_select(IrFunction *func, IrValue *result, IrValue *cond,
+                                      IrValue *true_val, IrValue *false_val);
+IrInstruction *ir__inst_create_mem(IrFunction *func, IrOpcode op, IrValue *dst, IrValue *src,
+                                   IrValue *count, uint32_t elem_size);
+IrInstruction *ir__inst_create_call(IrFunction *func, IrValue *result, IrValue *callee,
+                                    IrValue **args, uint32_t arg_count);
+void           ir__inst_insert_before(IrInstruction *pos, IrInstruction *inst);
+void           ir__inst_append(IrBasicBlock *bb, IrInstruction *inst);
+void           ir__inst_unlink(IrInstruction *inst);
+void           ir__inst_destroy(IrInstruction *inst);
+IrInstruction *ir__block_terminator(const IrBasicBlock *bb);
+void           ir__block_link(IrBasicBlock *from, IrBasicBlock *to);
+void           ir__block_unlink(IrBasicBlock *from, IrBasicBlock *to);
+IrBasicBlock  *ir__function_add_block(IrFunction *func, const char *label);
+void           ir__function_remove_block(IrFunction *func, IrBasicBlock *bb);
+bool           ir__opcode_is_terminator(IrOpcode op);
+bool           ir__inst_is_call_to(const IrInstruction *inst, const char *callee);
+
+/* Operands of an instruction in a block must be changed through these, or
+ * be followed by ir__inst_update_uses, to keep the use lists right. */
+typedef void (*IrOperandFn)(IrValue **slot, void *ctx);
+void           ir__inst_for_each_operand(IrInstruction *inst, IrOperandFn fn, void *ctx);
+void           ir__inst_set_operand(IrInstruction *inst, IrValue **slot, IrValue *value);
+void           ir__inst_update_uses(IrInstruction *inst);
+void           ir__replace_all_uses_with(IrValue *from, IrValue *to);
+uint32_t       ir__value_use_count(const IrValue *val);
+
 IrBuilder    *ir__builder_create(SemanticContext *sem_ctx);
 void          ir__builder_destroy(IrBuilder *b);
 IrFunction   *ir__builder_start_function(IrBuilder *b, const char *name,
                                          DataType return_type, Type *return_type_info,
-                                         IrValue **params, uint32_t param_count);
+                                         uint32_t param_count);
 IrBasicBlock *ir__builder_add_block(IrBuilder *b, const char *label, bool set_current);
 void          ir__builder_set_block(IrBuilder *b, IrBasicBlock *block);
 IrValue      *ir__builder_get_local(IrBuilder *b, const char *name);
 void          ir__builder_set_local(IrBuilder *b, const char *name, IrValue *alloca);
-char         *ir__builder_temp_name(IrFunction *func, char *buf, size_t bufsize);
 IrModule     *ir__build_from_ast(IrBuilder *b, AST *ast);
 
 #endif
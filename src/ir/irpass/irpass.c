@@ -0,0 +1,106 @@
+#include "irpass.h"
+#include "../analysis/analysis.h"
+#include "../ifconv/ifconv.h"
+#include "../memopt/memopt.h"
+#include "../escape/escape.h"
+#include "../idiom/idiom.h"
+#include "../ipa/ipa.h"
+#include "../consteval/consteval.h"
+#include "../layout/layout.h"
+#include "../remark/remark.h"
+#include "../../errhandler/errhandler.h"
+#include "../../utils/scheduler.h"
+#include <stdlib.h>
+
+/* One function's run through the pipeline, and what it reported. */
+typedef struct {
+    IrFunction          *func;
+    const IrPassOptions *opts;
+    ErrorBuffer         *errors;
+    RemarkBuffer        *remarks;
+} FunctionJob;
+
+void irpass__default_options(IrPassOptions *opts) {
+    opts->enable_ifconv = true;
+    opts->ifconv_threshold = IFCONV_DEFAULT_THRESHOLD;
+    opts->enable_memopt = true;
+    opts->enable_idiom = true;
+    opts->enable_heap2stack = true;
+    opts->enable_layout = true;
+    opts->heap2stack_max_bytes = ESCAPE_DEFAULT_MAX_BYTES;
+    opts->threads = 0;
+    opts->whole_program = false;
+    opts->inline_threshold = IPA_DEFAULT_INLINE_THRESHOLD;
+    opts->enable_consteval = true;
+}
+
+/* After each pass that changed something, the cached analyses it did not
+ * preserve are dropped. */
+void irpass__run_function(IrFunction *func, const IrPassOptions *opts) {
+    if (opts->enable_heap2stack && escape__heap_to_stack(func, opts->heap2stack_max_bytes) > 0)
+        analysis__invalidate(func, IR_PRESERVE_CFG);
+    /* Before memopt, so values read after the loop are still loads of the
+     * induction variable rather than forwarded from inside the loop. */
+    if (opts->enable_idiom && idiom__run_function(func) > 0)
+        analysis__invalidate(func, IR_PRESERVE_NONE);
+    if (opts->enable_memopt && memopt__run_function(func, NULL) > 0)
+        analysis__invalidate(func, IR_PRESERVE_CFG);
+    if (opts->enable_ifconv && ifconv__run_function(func, opts->ifconv_threshold) > 0) {
+        analysis__invalidate(func, IR_PRESERVE_NONE);
+        /* Flattened branches leave store/load pairs in one block; clean them up. */
+        if (opts->enable_memopt && memopt__run_function(func, NULL) > 0)
+            analysis__invalidate(func, IR_PRESERVE_CFG);
+    }
+    /* Last: it only orders blocks, and every pass above may change the CFG.
+     * Edges are untouched, so everything stays valid. */
+    if (opts->enable_layout) layout__run_function(func);
+}
+
+static void run_function_task(void *arg, uint32_t worker) {
+    (void)worker;
+    FunctionJob *job = arg;
+    job->errors = errhandler__buffer_begin();
+    job->remarks = remark__buffer_begin();
+    irpass__run_function(job->func, job->opts);
+    remark__buffer_end(job->remarks);
+    errhandler__buffer_end(job->errors);
+}
+
+bool irpass__run_module(IrModule *mod, const IrPassOptions *opts) {
+    if (!mod || !opts) return false;
+    /* Module-level passes run serially, before any function is handed to
+     * a worker.  Constants go first so inlined copies carry them. */
+    if (opts->enable_consteval) consteval__fold_module(mod);
+    if (opts->whole_program) {
+        ipa__remove_dead_functions(mod);
+        ipa__propagate_constants(mod);
+        if (opts->inline_threshold > 0 && ipa__inline(mod, opts->inline_threshold) > 0)
+            ipa__remove_dead_functions(mod);
+        if (errhandler__has_errors()) return false;
+    }
+    if (mod->func_count == 0) return true;
+    uint32_t threads = opts->threads ? opts->threads : u__cpu_count();
+    if (threads > mod->func_count) threads = mod->func_count;
+    FunctionJob *jobs = calloc(mod->func_count, sizeof(FunctionJob));
+    UScheduler *sched = jobs ? u__scheduler_create(threads) : NULL;
+    if (!sched) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "irpass",
+                                 "Failed to start the optimisation workers");
+        free(jobs);
+        return false;
+    }
+    for (uint32_t i = 0; i < mod->func_count; i++) {
+        jobs[i].func = mod->functions[i];
+        jobs[i].opts = opts;
+        if (!u__scheduler_submit(sched, run_function_task, &jobs[i]))
+            run_function_task(&jobs[i], 0);
+    }
+    u__scheduler_wait(sched);
+    u__scheduler_destroy(sched);
+    for (uint32_t i = 0; i < mod->func_count; i++) {
+        remark__buffer_commit(jobs[i].remarks);
+        errhandler__buffer_commit(jobs[i].errors);
+    }
+    free(jobs);
+    return !errhandler__has_errors();
+}
@@ -0,0 +1,44 @@
+#ifndef IRPASS_H
+#define IRPASS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "../ir.h"
+
+/* Knobs for the IR optimisation pipeline. */
+typedef struct IrPassOptions {
+    bool      enable_ifconv;        /* flatten small branches into selects  */
+    uint32_t  ifconv_threshold;     /* max speculated instructions per branch */
+    bool      enable_memopt;        /* forward loads, drop dead stores       */
+    bool      enable_idiom;         /* fill/copy loops to memset/memcpy      */
+    bool      enable_heap2stack;    /* move short-lived allocations to stack */
+    bool      enable_layout;        /* order blocks for fall-through, split cold */
+    uint64_t  heap2stack_max_bytes; /* largest allocation moved              */
+    uint32_t  threads;              /* worker threads, 0 for one per processor */
+    bool      whole_program;        /* the module is every unit linked (-flto) */
+    uint32_t  inline_threshold;     /* largest callee inlined, in instructions */
+    bool      enable_consteval;     /* evaluate const initializer calls      */
+} IrPassOptions;
+
+/* Fill opts with the default pipeline configuration. */
+void irpass__default_options(IrPassOptions *opts);
+
+/*
+ * Run the function-level IR optimisation pipeline on every function of the
+ * module.  Functions are independent once the module is built, so they are
+ * optimised in parallel on opts->threads threads; diagnostics and remarks
+ * are buffered per function and printed in function order, so the output
+ * does not depend on the thread count.  Returns false if a pass reported an
+ * error.  Calls in const initializers are evaluated first.  A whole program
+ * then goes through the interprocedural passes: constant propagation,
+ * inlining and dead function elimination.
+ */
+bool irpass__run_module(IrModule *mod, const IrPassOptions *opts);
+
+/* The function-level part of the pipeline, on one function, on the calling
+ * thread; diagnostics go straight out.  The JIT uses it to optimise hot
+ * functions as it runs them. */
+void irpass__run_function(IrFunction *func, const IrPassOptions *opts);
+
+#endif
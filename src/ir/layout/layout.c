@@ -0,0 +1,211 @@
+#include "layout.h"
+#include "../analysis/analysis.h"
+#include "../profile/profile.h"
+#include "../../errhandler/errhandler.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Static weight factor of an edge per loop around it, and the deepest nest
+ * that still scales, so weights stay well inside 64 bits. */
+#define LAYOUT_LOOP_SCALE_SHIFT 3
+#define LAYOUT_MAX_LOOP_DEPTH   16
+
+typedef struct {
+    IrBasicBlock *from, *to;
+    uint64_t      weight;
+    uint32_t      order;        /* position in block/successor order, for ties */
+} Edge;
+
+/* Per-block state, indexed by block id. */
+typedef struct {
+    IrFunction       *func;
+    const IrLoopInfo *loops;        /* loop depth and headers, from the cache */
+    bool             *doomed;       /* every path from here reaches signal/halt */
+    bool             *cold;
+    bool             *placed;
+    IrBasicBlock    **next;         /* following block in its chain */
+    IrBasicBlock    **head;         /* first block of its chain */
+    IrBasicBlock    **tail;         /* last block of the chain it heads */
+    Edge             *edges;
+    uint32_t          edge_count;
+} Layout;
+
+static bool layout_init(Layout *l, IrFunction *func) {
+    memset(l, 0, sizeof(*l));
+    l->func = func;
+    uint32_t n = func->next_block_id ? func->next_block_id : 1;
+    uint32_t edges = 0;
+    for (uint32_t i = 0; i < func->block_count; i++) edges += func->all_blocks[i]->succ_count;
+    l->doomed = calloc(n, sizeof(bool));
+    l->cold = calloc(n, sizeof(bool));
+    l->placed = calloc(n, sizeof(bool));
+    l->next = calloc(n, sizeof(IrBasicBlock *));
+    l->head = calloc(n, sizeof(IrBasicBlock *));
+    l->tail = calloc(n, sizeof(IrBasicBlock *));
+    l->edges = calloc(edges ? edges : 1, sizeof(Edge));
+    return l->doomed && l->cold && l->placed &&
+           l->next && l->head && l->tail && l->edges;
+}
+
+static void layout_free(Layout *l) {
+    free(l->doomed); free(l->cold); free(l->placed);
+    free(l->next); free(l->head); free(l->tail); free(l->edges);
+}
+
+static bool ends_program(const IrBasicBlock *bb) {
+    for (IrInstruction *inst = bb->first_inst; inst; inst = inst->next)
+        if (ir__inst_is_call_to(inst, IR_RUNTIME_SIGNAL) || ir__inst_is_call_to(inst, IR_RUNTIME_HALT))
+            return true;
+    return false;
+}
+
+/* A branch edge into a doomed block whose other side is not doomed: the
+ * path taken only when the program is about to stop. */
+static bool is_cold_edge(const Layout *l, const IrBasicBlock *from, const IrBasicBlock *to) {
+    if (from->succ_count != 2 || !l->doomed[to->id]) return false;
+    const IrBasicBlock *other = from->successors[0] == to ? from->successors[1] : from->successors[0];
+    return !l->doomed[other->id];
+}
+
+static void find_cold(Layout *l) {
+    IrFunction *func = l->func;
+    if (func->has_profile) {
+        for (uint32_t i = 0; i < func->block_count; i++)
+            l->cold[func->all_blocks[i]->id] = func->all_blocks[i]->exec_count == 0;
+        return;
+    }
+    bool changed = true;
+    for (uint32_t i = 0; i < func->block_count; i++)
+        l->doomed[func->all_blocks[i]->id] = ends_program(func->all_blocks[i]);
+    while (changed) {
+        changed = false;
+        for (uint32_t i = 0; i < func->block_count; i++) {
+            IrBasicBlock *bb = func->all_blocks[i];
+            if (l->doomed[bb->id] || bb->succ_count == 0) continue;
+            bool all = true;
+            for (uint32_t j = 0; j < bb->succ_count && all; j++) all = l->doomed[bb->successors[j]->id];
+            if (all) { l->doomed[bb->id] = true; changed = true; }
+        }
+    }
+    /* Largest set closed under "every way in is cold", so that loops inside
+     * a cold region and unreachable blocks stay cold. */
+    for (uint32_t i = 0; i < func->block_count; i++)
+        l->cold[func->all_blocks[i]->id] = func->all_blocks[i] != func->entry_block;
+    changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t i = 0; i < func->block_count; i++) {
+            IrBasicBlock *bb = func->all_blocks[i];
+            if (!l->cold[bb->id]) continue;
+            for (uint32_t j = 0; j < bb->pred_count; j++) {
+                IrBasicBlock *p = bb->predecessors[j];
+                if (!l->cold[p->id] && !is_cold_edge(l, p, bb)) { l->cold[bb->id] = false; changed = true; break; }
+            }
+        }
+    }
+}
+
+static uint64_t edge_weight(const Layout *l, const IrBasicBlock *from, const IrBasicBlock *to) {
+    if (l->cold[from->id] != l->cold[to->id]) return 0;
+    if (l->func->has_profile) return profile__edge_count(from, to);
+    uint32_t df = analysis__loop_depth(l->loops, from), dt = analysis__loop_depth(l->loops, to);
+    uint32_t d = df < dt ? df : dt;
+    if (d > LAYOUT_MAX_LOOP_DEPTH) d = LAYOUT_MAX_LOOP_DEPTH;
+    return (uint64_t)1 << (d * LAYOUT_LOOP_SCALE_SHIFT);
+}
+
+static int compare_edges(const void *a, const void *b) {
+    const Edge *x = a, *y = b;
+    if (x->weight != y->weight) return x->weight > y->weight ? -1 : 1;
+    return x->order < y->order ? -1 : (x->order > y->order);
+}
+
+/* Join chains along edges, heaviest first, wherever the edge runs from the
+ * end of one chain to the start of another. */
+static void build_chains(Layout *l) {
+    IrFunction *func = l->func;
+    for (uint32_t i = 0; i < func->block_count; i++) {
+        IrBasicBlock *bb = func->all_blocks[i];
+        l->head[bb->id] = l->tail[bb->id] = bb;
+    }
+    for (uint32_t i = 0; i < l->edge_count; i++)
+        l->edges[i].weight = edge_weight(l, l->edges[i].from, l->edges[i].to);
+    qsort(l->edges, l->edge_count, sizeof(Edge), compare_edges);
+    for (uint32_t i = 0; i < l->edge_count; i++) {
+        IrBasicBlock *from = l->edges[i].from, *to = l->edges[i].to;
+        if (l->edges[i].weight == 0 || to == func->entry_block) continue;
+        if (l->next[from->id] || l->head[to->id] != to || l->head[from->id] == to) continue;
+        IrBasicBlock *h = l->head[from->id];
+        l->next[from->id] = to;
+        for (IrBasicBlock *bb = to; bb; bb = l->next[bb->id]) l->head[bb->id] = h;
+        l->tail[h->id] = l->tail[to->id];
+    }
+}
+
+static void place_chain(Layout *l, IrBasicBlock *h, IrBasicBlock **out, uint32_t *k) {
+    for (IrBasicBlock *bb = h; bb; bb = l->next[bb->id]) {
+        l->placed[bb->id] = true;
+        out[(*k)++] = bb;
+    }
+}
+
+/* The unplaced hot chain reached by the heaviest edge out of the placed
+ * blocks, else the first unplaced hot chain, else NULL. */
+static IrBasicBlock *next_hot_chain(const Layout *l) {
+    const Edge *best = NULL;
+    for (uint32_t i = 0; i < l->edge_count; i++) {
+        const Edge *e = &l->edges[i];
+        if (!l->placed[e->from->id] || l->placed[e->to->id] || l->cold[e->to->id]) continue;
+        if (!best || compare_edges(e, best) < 0) best = e;
+    }
+    if (best) return l->head[best->to->id];
+    for (uint32_t i = 0; i < l->func->block_count; i++) {
+        IrBasicBlock *bb = l->func->all_blocks[i];
+        if (!l->placed[bb->id] && !l->cold[bb->id]) return l->head[bb->id];
+    }
+    return NULL;
+}
+
+uint32_t layout__run_function(IrFunction *func) {
+    if (!func || !func->entry_block || func->block_count == 0) return 0;
+    Layout l;
+    IrBasicBlock **out = malloc(func->block_count * sizeof(IrBasicBlock *));
+    if (!layout_init(&l, func) || !out) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "layout",
+                                 "Failed to allocate block layout state");
+        layout_free(&l); free(out);
+        return 0;
+    }
+    for (uint32_t i = 0; i < func->block_count; i++) {
+        IrBasicBlock *bb = func->all_blocks[i];
+        for (uint32_t j = 0; j < bb->succ_count; j++, l.edge_count++)
+            l.edges[l.edge_count] = (Edge){ bb, bb->successors[j], 0, l.edge_count };
+    }
+    l.loops = analysis__loops(func);
+    if (!l.loops) {
+        layout_free(&l); free(out);
+        return 0;
+    }
+    find_cold(&l);
+    build_chains(&l);
+
+    uint32_t k = 0;
+    place_chain(&l, func->entry_block, out, &k);
+    for (IrBasicBlock *h; (h = next_hot_chain(&l)) != NULL; ) place_chain(&l, h, out, &k);
+    for (uint32_t i = 0; i < func->block_count; i++) {
+        IrBasicBlock *bb = func->all_blocks[i];
+        if (!l.placed[bb->id]) place_chain(&l, l.head[bb->id], out, &k);
+    }
+
+    uint32_t moved = 0;
+    for (uint32_t i = 0; i < func->block_count; i++) {
+        IrBasicBlock *bb = out[i];
+        if (func->all_blocks[i] != bb) moved++;
+        func->all_blocks[i] = bb;
+        bb->is_cold = l.cold[bb->id];
+        bb->align = analysis__loop_of_header(l.loops, bb) && !bb->is_cold ? LAYOUT_LOOP_ALIGN : 0;
+    }
+    layout_free(&l);
+    free(out);
+    return moved;
+}
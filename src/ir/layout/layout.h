@@ -0,0 +1,33 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdint.h>
+#include "../ir.h"
+
+/* Section that blocks marked is_cold are emitted into. */
+#define LAYOUT_COLD_SECTION ".text.cold"
+/* Start alignment, in bytes, requested for hot loop headers. */
+#define LAYOUT_LOOP_ALIGN   16
+
+/*
+ * Basic block placement.  Reorders func->all_blocks, which is the order the
+ * code is emitted in, so that the heaviest edges become fall-throughs:
+ * blocks are merged greedily into chains along edges in decreasing weight,
+ * and chains are then laid out starting from the entry, each followed by the
+ * unplaced chain it branches to most.
+ *
+ * Edge weights are the profiled counts when the function has a profile.
+ * Otherwise an edge weighs eight times more for each loop around it, so
+ * loop bodies and back edges win over loop exits.
+ *
+ * Blocks that a profile never saw executed, and blocks only reachable
+ * through the side of a branch that always ends in `signal` or `halt`, are
+ * marked is_cold and placed after everything else, for the backend to move
+ * to LAYOUT_COLD_SECTION.  A function never entered at all is cold as a
+ * whole.  Loop headers that are not cold get align = LAYOUT_LOOP_ALIGN.
+ *
+ * Returns the number of blocks that changed position.
+ */
+uint32_t layout__run_function(IrFunction *func);
+
+#endif
@@ -0,0 +1,181 @@
+#include "lower.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int compare_entries(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)((const struct LowerEntry *)a)->name;
+    uintptr_t y = (uintptr_t)((const struct LowerEntry *)b)->name;
+    return x < y ? -1 : x > y;
+}
+
+bool lower__module_init(LowerModule *lm, const IrModule *mod) {
+    uint32_t n = mod->func_count;
+    lm->mod = mod;
+    lm->by_name = malloc((n ? n : 1) * sizeof(struct LowerEntry));
+    if (!lm->by_name) return false;
+    for (uint32_t i = 0; i < n; i++)
+        lm->by_name[i] = (struct LowerEntry){ mod->functions[i]->name, i };
+    qsort(lm->by_name, n, sizeof(struct LowerEntry), compare_entries);
+    return true;
+}
+
+void lower__module_fini(LowerModule *lm) {
+    free(lm->by_name);
+    lm->by_name = NULL;
+}
+
+/* Names are interned, so they compare by pointer. */
+uint32_t lower__find_function(const LowerModule *lm, const char *name) {
+    struct LowerEntry key = { name, 0 };
+    const struct LowerEntry *e = bsearch(&key, lm->by_name, lm->mod->func_count,
+                                         sizeof(struct LowerEntry), compare_entries);
+    return e ? e->index : UINT32_MAX;
+}
+
+uint32_t lower__callee(const LowerModule *lm, const IrInstruction *call) {
+    const IrValue *target = call->operand1;
+    if (!target || target->kind != IR_VALUE_GLOBAL_SYMBOL || !target->name) return UINT32_MAX;
+    return lower__find_function(lm, target->name);
+}
+
+bool lower__returns_real(const IrFunction *func) {
+    return ir__datatype_of(func->return_type_info) == TYPE_REAL;
+}
+
+bool lower__param_is_real(const IrFunction *func, uint32_t index) {
+    return index < func->param_count && func->parameters[index]->type == TYPE_REAL;
+}
+
+bool lower__is_real(const LowerFunction *lf, const IrValue *v) {
+    if (!v) return false;
+    switch (v->kind) {
+        case IR_VALUE_CONST_REAL: return true;
+        case IR_VALUE_PARAM:      return v->type == TYPE_REAL;
+        case IR_VALUE_TEMP:       return v->id < lf->temp_count && lf->temp_real[v->id];
+        default:                  return false;
+    }
+}
+
+const IrInstruction *lower__def(const LowerFunction *lf, const IrValue *v) {
+    return v && v->kind == IR_VALUE_TEMP && v->id < lf->temp_count ? lf->defs[v->id] : NULL;
+}
+
+bool lower__is_scalar_slot(const LowerFunction *lf, const IrValue *ptr) {
+    const IrInstruction *def = lower__def(lf, ptr);
+    return def && def->opcode == IR_ALLOCA && !def->operand1;
+}
+
+LowerAccess lower__access(const LowerFunction *lf, const IrValue *ptr) {
+    LowerAccess acc = { false, false, true, 8 };
+    if (lower__is_scalar_slot(lf, ptr)) {
+        if (ptr->type_info) {
+            acc.typed = true;
+            acc.is_real = ir__datatype_of(ptr->type_info) == TYPE_REAL;
+        }
+        return acc;
+    }
+    const Type *t = ptr ? ptr->type_info : NULL;
+    if (!t || t->pointer_level != 1 || t->is_reference) return acc;
+    DataType elem = ir__element_datatype(t);
+    uint32_t size = ir__pointee_size(t);
+    acc.typed = true;
+    if (elem == TYPE_REAL) {
+        acc.is_real = true;
+        acc.size = size == 4 ? 4 : 8;
+    } else if (elem == TYPE_CHAR) {
+        acc.is_signed = false;
+        acc.size = 1;
+    } else {
+        acc.size = (size == 1 || size == 2 || size == 4) ? (uint8_t)size : 8;
+    }
+    return acc;
+}
+
+uint32_t lower__slot_bytes(const IrValue *slot, uint32_t limit) {
+    uint64_t bytes = 8;
+    for (const IrUse *u = slot->uses; u; u = u->next) {
+        const IrInstruction *gep = u->user;
+        if (gep->opcode != IR_GEP || gep->operand1 != slot || !gep->operand2) continue;
+        if (gep->operand2->kind != IR_VALUE_CONST_INT || gep->operand2->const_data.int_val < 0) continue;
+        uint64_t end = ((uint64_t)gep->operand2->const_data.int_val + 1) * ir__pointee_size(slot->type_info);
+        if (end > bytes && end <= limit) bytes = end;
+    }
+    return (uint32_t)bytes;
+}
+
+uint32_t lower__gep_scale(const IrInstruction *gep) {
+    const Type *ptr = gep->result && gep->result->type_info ? gep->result->type_info
+                    : gep->operand1 ? gep->operand1->type_info : NULL;
+    return ir__pointee_size(ptr);
+}
+
+/* Class of the value an instruction produces; phis and selects join. */
+static bool result_is_real(const LowerFunction *lf, const IrInstruction *inst) {
+    switch ((IrOpcode)inst->opcode) {
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+            return lower__is_real(lf, inst->operand1) || lower__is_real(lf, inst->operand2);
+        case IR_NEG:
+            return lower__is_real(lf, inst->operand1);
+        case IR_LOAD: {
+            LowerAccess acc = lower__access(lf, inst->operand1);
+            return acc.typed ? acc.is_real : inst->result->type == TYPE_REAL;
+        }
+        case IR_CAST:
+            return ir__datatype_of(inst->result->type_info) == TYPE_REAL;
+        case IR_CALL: {
+            uint32_t f = lower__callee(lf->lm, inst);
+            return f != UINT32_MAX && lower__returns_real(lf->lm->mod->functions[f]);
+        }
+        case IR_SELECT:
+            return lower__is_real(lf, inst->operand2) ||
+                   lower__is_real(lf, ((const IrSelectExtra *)inst->extra)->false_value);
+        case IR_PHI: {
+            const IrPhiExtra *phi = inst->extra;
+            for (uint32_t i = 0; i < phi->count; i++)
+                if (lower__is_real(lf, phi->values[i])) return true;
+            return false;
+        }
+        default:
+            return false;
+    }
+}
+
+bool lower__function_init(LowerFunction *lf, const LowerModule *lm, const IrFunction *func) {
+    lf->lm = lm;
+    lf->func = func;
+    lf->temp_count = func->next_temp_id;
+    lf->temp_real = calloc(lf->temp_count ? lf->temp_count : 1, 1);
+    lf->defs = calloc(lf->temp_count ? lf->temp_count : 1, sizeof(*lf->defs));
+    if (!lf->temp_real || !lf->defs) {
+        lower__function_fini(lf);
+        return false;
+    }
+    for (uint32_t b = 0; b < func->block_count; b++)
+        for (const IrInstruction *inst = func->all_blocks[b]->first_inst; inst; inst = inst->next)
+            if (inst->result && inst->result->kind == IR_VALUE_TEMP && inst->result->id < lf->temp_count)
+                lf->defs[inst->result->id] = inst;
+    /* Classes only ever change from integer to real, so this settles. */
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t b = 0; b < func->block_count; b++) {
+            for (const IrInstruction *inst = func->all_blocks[b]->first_inst; inst; inst = inst->next) {
+                const IrValue *r = inst->result;
+                if (!r || r->kind != IR_VALUE_TEMP || r->id >= lf->temp_count || lf->temp_real[r->id])
+                    continue;
+                if (result_is_real(lf, inst)) {
+                    lf->temp_real[r->id] = 1;
+                    changed = true;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void lower__function_fini(LowerFunction *lf) {
+    free(lf->temp_real);
+    free(lf->defs);
+    lf->temp_real = NULL;
+    lf->defs = NULL;
+}
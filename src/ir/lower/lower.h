@@ -0,0 +1,88 @@
+#ifndef LOWER_H
+#define LOWER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../ir.h"
+
+/*
+ * Facts every consumer of finished IR needs to turn it into something that
+ * runs: the interpreter, the JIT and the native backends.  The IR keeps
+ * only a DataType per value and leaves the rest implicit, so this derives
+ *
+ *   - the class of each value: integer (and pointer) or Real, settled by a
+ *     fixpoint since phis may join values defined later;
+ *   - how a load or store at a pointer touches memory: width, signedness
+ *     and whether it holds a float, a double or raw 64 bits;
+ *   - the element size a GEP scales its index by, and the bytes a scalar
+ *     alloca must span.
+ *
+ * Every value is 64 bits wide when held in a register or a frame slot.
+ */
+
+/* Functions of a module by interned name. */
+typedef struct {
+    const IrModule *mod;
+    struct LowerEntry {
+        const char *name;
+        uint32_t    index;
+    } *by_name;
+} LowerModule;
+
+typedef struct {
+    const LowerModule    *lm;
+    const IrFunction     *func;
+    uint32_t              temp_count;
+    uint8_t              *temp_real;    /* class of each temp */
+    const IrInstruction **defs;         /* defining instruction of each temp */
+} LowerFunction;
+
+/* How memory at a pointer is read and written.  Typed accesses have the
+ * width and class of the pointee; untyped ones move 64 raw bits. */
+typedef struct {
+    bool    typed;
+    bool    is_real;                    /* size 4 is a float, 8 a double */
+    bool    is_signed;
+    uint8_t size;
+} LowerAccess;
+
+bool     lower__module_init(LowerModule *lm, const IrModule *mod);
+void     lower__module_fini(LowerModule *lm);
+
+/* Index in mod->functions of the function named name, or UINT32_MAX. */
+uint32_t lower__find_function(const LowerModule *lm, const char *name);
+
+/* Index of the module function a call instruction calls, or UINT32_MAX
+ * for a runtime or undefined callee. */
+uint32_t lower__callee(const LowerModule *lm, const IrInstruction *call);
+
+bool     lower__function_init(LowerFunction *lf, const LowerModule *lm, const IrFunction *func);
+void     lower__function_fini(LowerFunction *lf);
+
+bool     lower__returns_real(const IrFunction *func);
+bool     lower__param_is_real(const IrFunction *func, uint32_t index);
+bool     lower__is_real(const LowerFunction *lf, const IrValue *v);
+
+/* Defining instruction of a temp, or NULL. */
+const IrInstruction *lower__def(const LowerFunction *lf, const IrValue *v);
+
+/* A scalar stack slot: an alloca of one variable, holding a whole 64-bit
+ * value whatever its declared type. */
+bool     lower__is_scalar_slot(const LowerFunction *lf, const IrValue *ptr);
+LowerAccess lower__access(const LowerFunction *lf, const IrValue *ptr);
+
+/* Bytes a scalar slot must span: more than one variable when GEPs with
+ * constant indices address past it, as array initializers do. */
+uint32_t lower__slot_bytes(const IrValue *slot, uint32_t limit);
+
+/* Element size a GEP scales its indices by.  The builder gives the result
+ * the base's type, which it keeps when passes forward an untyped value
+ * into the base. */
+uint32_t lower__gep_scale(const IrInstruction *gep);
+
+/* Byte offset of a struct field index; fields are 8-byte slots. */
+static inline int64_t lower__field_offset(const IrValue *field) {
+    return (int64_t)field->const_data.field_index * 8;
+}
+
+#endif
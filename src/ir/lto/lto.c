@@ -0,0 +1,81 @@
+#include "lto.h"
+#include "../bitcode/bitcode.h"
+#include "../ipa/ipa.h"
+#include "../../errhandler/errhandler.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* A function of the linked module and the file that defined it. */
+typedef struct {
+    const IrFunction *func;
+    uint32_t          file;
+} Definition;
+
+static int compare_definitions(const void *a, const void *b) {
+    const Definition *x = a, *y = b;
+    uintptr_t p = (uintptr_t)x->func->name, q = (uintptr_t)y->func->name;
+    if (p != q) return p < q ? -1 : 1;
+    return x->file < y->file ? -1 : x->file > y->file;
+}
+
+/* Report every name defined twice; names are interned, so equal names are
+ * the same pointer and sort next to each other. */
+static bool check_definitions(const IrModule *mod, const uint32_t *owner, const char *const *paths) {
+    Definition *defs = malloc((mod->func_count ? mod->func_count : 1) * sizeof(Definition));
+    if (!defs) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "lto",
+                                 "Failed to allocate the definition table");
+        return false;
+    }
+    for (uint32_t i = 0; i < mod->func_count; i++) {
+        defs[i].func = mod->functions[i];
+        defs[i].file = owner[i];
+    }
+    qsort(defs, mod->func_count, sizeof(Definition), compare_definitions);
+    bool ok = true;
+    for (uint32_t i = 1; i < mod->func_count; i++) {
+        if (defs[i].func->name != defs[i - 1].func->name) continue;
+        errhandler__report_error(ERROR_CODE_IR_MULTIPLE_DEFINITION, 0, 0, "lto",
+                                 "Multiple definitions of '%s' in %s and %s", defs[i].func->name,
+                                 paths[defs[i - 1].file], paths[defs[i].file]);
+        ok = false;
+    }
+    free(defs);
+    return ok;
+}
+
+IrModule *lto__link(const char *const *paths, uint32_t count) {
+    IrModule *mod = ir__module_create(NULL);
+    uint32_t *owner = NULL;
+    bool ok = mod != NULL;
+    for (uint32_t i = 0; i < count && ok; i++) {
+        uint32_t first = mod->func_count;
+        IrBitcode *bc = ir__read_bitcode(paths[i], mod);
+        ok = bc && ir__bitcode_load_all(bc);
+        ir__bitcode_close(bc);
+        if (!ok) break;
+        /* Functions are appended to the module in load order. */
+        uint32_t *grown = realloc(owner, (mod->func_count ? mod->func_count : 1) * sizeof(uint32_t));
+        if (!grown) {
+            errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "lto",
+                                     "Failed to allocate the definition table");
+            ok = false;
+            break;
+        }
+        owner = grown;
+        for (uint32_t f = first; f < mod->func_count; f++) owner[f] = i;
+    }
+    ok = ok && check_definitions(mod, owner, paths);
+    free(owner);
+    if (!ok) {
+        ir__module_destroy(mod);
+        return NULL;
+    }
+    const char *entry = LTO_ENTRY_POINT;
+    for (uint32_t i = 0; i < mod->func_count; i++) {
+        if (strcmp(mod->functions[i]->name, entry) != 0) continue;
+        ipa__internalize(mod, &entry, 1);
+        break;
+    }
+    return mod;
+}
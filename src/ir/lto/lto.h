@@ -0,0 +1,22 @@
+#ifndef LTO_H
+#define LTO_H
+
+#include <stdint.h>
+#include "../ir.h"
+
+/* The function a linked program starts at; the only one left external. */
+#define LTO_ENTRY_POINT "main"
+
+/*
+ * Link-time optimisation.  Under -flto every unit is compiled to bitcode
+ * instead of being emitted, and the bitcode files are linked here into one
+ * module.  A function defined by more than one file is an error.  When the
+ * linked units define LTO_ENTRY_POINT they are a whole program, and every
+ * other function is internalized for the interprocedural passes; otherwise
+ * they form a library and every function stays external.
+ *
+ * Returns the linked module, or NULL after reporting an error.
+ */
+IrModule *lto__link(const char *const *paths, uint32_t count);
+
+#endif
@@ -0,0 +1,228 @@
+#include "memopt.h"
+#include "../alias/alias.h"
+#include "../../errhandler/errhandler.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* A location whose current contents are known to be value. */
+typedef struct {
+    MemLoc   loc;
+    IrValue *value;
+    bool     from_store;
+} Avail;
+
+typedef struct {
+    Avail    *items;
+    uint32_t  count, capacity;
+} AvailSet;
+
+typedef struct {
+    IrFunction   *func;
+    AliasInfo    *ai;
+    bool         *visited;     /* indexed by block id */
+    MemOptStats   stats;
+} MemOpt;
+
+static bool grow(void **items, uint32_t *capacity, size_t elem_size) {
+    uint32_t new_cap = *capacity ? *capacity * 2 : 16;
+    void *p = realloc(*items, new_cap * elem_size);
+    if (!p) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "memopt",
+                                 "Failed to grow memory access table");
+        return false;
+    }
+    *items = p;
+    *capacity = new_cap;
+    return true;
+}
+
+static void avail_remove_at(AvailSet *set, uint32_t i) {
+    set->items[i] = set->items[--set->count];
+}
+
+static void avail_add(AvailSet *set, const MemLoc *loc, IrValue *value, bool from_store) {
+    if (set->count >= set->capacity &&
+        !grow((void **)&set->items, &set->capacity, sizeof(Avail)))
+        return;
+    set->items[set->count].loc = *loc;
+    set->items[set->count].value = value;
+    set->items[set->count].from_store = from_store;
+    set->count++;
+}
+
+static bool types_compatible(const MemLoc *a, const MemLoc *b) {
+    return a->access_type == b->access_type ||
+           a->access_type == TYPE_UNKNOWN || b->access_type == TYPE_UNKNOWN;
+}
+
+/* Forward known values through one block, updating avail in place. */
+static void forward_block(MemOpt *m, IrBasicBlock *bb, AvailSet *avail) {
+    IrInstruction *next;
+    for (IrInstruction *inst = bb->first_inst; inst; inst = next) {
+        next = inst->next;
+        if (inst->opcode == IR_LOAD && inst->result) {
+            MemLoc loc = alias__inst_location(m->ai, inst);
+            if (!loc.base) continue;
+            Avail *hit = NULL;
+            for (uint32_t i = 0; i < avail->count && !hit; i++)
+                if (types_compatible(&avail->items[i].loc, &loc) &&
+                    alias__query(m->ai, &avail->items[i].loc, &loc) == ALIAS_MUST)
+                    hit = &avail->items[i];
+            if (hit) {
+                if (hit->value == inst->result) continue;
+                ir__replace_all_uses_with(inst->result, hit->value);
+                if (hit->from_store) m->stats.forwarded_loads++;
+                else m->stats.redundant_loads++;
+                ir__inst_destroy(inst);
+                continue;
+            }
+            avail_add(avail, &loc, inst->result, false);
+        } else if (inst->opcode == IR_STORE) {
+            MemLoc loc = alias__inst_location(m->ai, inst);
+            for (uint32_t i = 0; i < avail->count;)
+                if (!loc.base || alias__query(m->ai, &avail->items[i].loc, &loc) != ALIAS_NO)
+                    avail_remove_at(avail, i);
+                else i++;
+            if (loc.base && inst->operand2) avail_add(avail, &loc, inst->operand2, true);
+        } else if (inst->opcode == IR_CALL) {
+            for (uint32_t i = 0; i < avail->count;)
+                if (!alias__is_private(m->ai, &avail->items[i].loc)) avail_remove_at(avail, i);
+                else i++;
+        } else if (inst->opcode == IR_MEMSET || inst->opcode == IR_MEMCPY) {
+            avail->count = 0;
+        }
+    }
+}
+
+static bool avail_copy(AvailSet *dst, const AvailSet *src) {
+    dst->count = dst->capacity = 0;
+    dst->items = NULL;
+    if (src->count == 0) return true;
+    dst->items = malloc(src->count * sizeof(Avail));
+    if (!dst->items) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "memopt",
+                                 "Failed to copy available values");
+        return false;
+    }
+    memcpy(dst->items, src->items, src->count * sizeof(Avail));
+    dst->count = dst->capacity = src->count;
+    return true;
+}
+
+/* A block with exactly one predecessor is entered only after that
+ * predecessor ran, so whatever was known at its end still holds. */
+static void forward_tree(MemOpt *m, IrBasicBlock *bb, AvailSet *avail) {
+    if (bb->id >= m->func->next_block_id || m->visited[bb->id]) return;
+    m->visited[bb->id] = true;
+    forward_block(m, bb, avail);
+    for (uint32_t i = 0; i < bb->succ_count; i++) {
+        IrBasicBlock *succ = bb->successors[i];
+        if (succ == m->func->entry_block || succ->pred_count != 1) continue;
+        AvailSet child;
+        if (!avail_copy(&child, avail)) return;
+        forward_tree(m, succ, &child);
+        free(child.items);
+    }
+}
+
+typedef struct {
+    MemLoc   *items;
+    uint32_t  count, capacity;
+} LocList;
+
+static void loc_add(LocList *list, const MemLoc *loc) {
+    if (list->count >= list->capacity &&
+        !grow((void **)&list->items, &list->capacity, sizeof(MemLoc)))
+        return;
+    list->items[list->count++] = *loc;
+}
+
+static bool loc_list_may_alias(const MemOpt *m, const LocList *list, const MemLoc *loc) {
+    for (uint32_t i = 0; i < list->count; i++)
+        if (alias__query(m->ai, &list->items[i], loc) != ALIAS_NO) return true;
+    return false;
+}
+
+/*
+ * Backwards over one block.  overwritten holds locations stored to later
+ * in the block with no read in between; read holds everything loaded after
+ * the current point.  Private slots die at a return.
+ */
+static void dse_block(MemOpt *m, IrBasicBlock *bb, LocList *overwritten, LocList *read) {
+    IrInstruction *term = ir__block_terminator(bb);
+    bool exits = term && term->opcode == IR_RET;
+    overwritten->count = read->count = 0;
+    IrInstruction *prev;
+    for (IrInstruction *inst = bb->last_inst; inst; inst = prev) {
+        prev = inst->prev;
+        if (inst->opcode == IR_STORE) {
+            MemLoc loc = alias__inst_location(m->ai, inst);
+            if (!loc.base) continue;
+            bool dead = false;
+            for (uint32_t i = 0; i < overwritten->count && !dead; i++)
+                dead = alias__query(m->ai, &overwritten->items[i], &loc) == ALIAS_MUST;
+            if (!dead && exits && alias__is_private(m->ai, &loc))
+                dead = !loc_list_may_alias(m, read, &loc);
+            if (dead) {
+                ir__inst_destroy(inst);
+                m->stats.dead_stores++;
+                continue;
+            }
+            loc_add(overwritten, &loc);
+        } else if (inst->opcode == IR_LOAD) {
+            MemLoc loc = alias__inst_location(m->ai, inst);
+            for (uint32_t i = 0; i < overwritten->count;)
+                if (!loc.base || alias__query(m->ai, &overwritten->items[i], &loc) != ALIAS_NO)
+                    overwritten->items[i] = overwritten->items[--overwritten->count];
+                else i++;
+            if (loc.base) loc_add(read, &loc);
+            else exits = false;
+        } else if (inst->opcode == IR_CALL) {
+            for (uint32_t i = 0; i < overwritten->count;)
+                if (!alias__is_private(m->ai, &overwritten->items[i]))
+                    overwritten->items[i] = overwritten->items[--overwritten->count];
+                else i++;
+        } else if (inst->opcode == IR_MEMSET || inst->opcode == IR_MEMCPY) {
+            /* Ranges are not tracked; assume it reads everything. */
+            overwritten->count = 0;
+            exits = false;
+        }
+    }
+}
+
+uint32_t memopt__run_function(IrFunction *func, MemOptStats *stats) {
+    if (stats) memset(stats, 0, sizeof(*stats));
+    if (!func || func->block_count == 0) return 0;
+    MemOpt m;
+    memset(&m, 0, sizeof(m));
+    m.func = func;
+    m.ai = alias__analyze(func);
+    m.visited = calloc(func->next_block_id, sizeof(bool));
+    if (!m.ai || !m.visited) {
+        if (!m.visited)
+            errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "memopt",
+                                     "Failed to allocate block state");
+        alias__destroy(m.ai);
+        free(m.visited);
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < func->block_count; i++) {
+        IrBasicBlock *bb = func->all_blocks[i];
+        if (bb != func->entry_block && bb->pred_count == 1) continue;
+        AvailSet avail = { NULL, 0, 0 };
+        forward_tree(&m, bb, &avail);
+        free(avail.items);
+    }
+    /* Forwarding removed loads, so the escape facts are still valid. */
+    LocList overwritten = { NULL, 0, 0 }, read = { NULL, 0, 0 };
+    for (uint32_t i = 0; i < func->block_count; i++)
+        dse_block(&m, func->all_blocks[i], &overwritten, &read);
+    free(overwritten.items);
+    free(read.items);
+
+    alias__destroy(m.ai);
+    free(m.visited);
+    if (stats) *stats = m.stats;
+    return m.stats.forwarded_loads + m.stats.redundant_loads + m.stats.dead_stores;
+}
@@ -0,0 +1,29 @@
+#ifndef MEMOPT_H
+#define MEMOPT_H
+
+#include <stdint.h>
+#include "../ir.h"
+
+/* What one run of the memory optimiser removed. */
+typedef struct MemOptStats {
+    uint32_t forwarded_loads;   /* loads replaced by the value last stored */
+    uint32_t redundant_loads;   /* loads replaced by an earlier load        */
+    uint32_t dead_stores;       /* stores overwritten or never read again   */
+} MemOptStats;
+
+/*
+ * Redundant memory access elimination driven by alias analysis.
+ *
+ * Store-to-load forwarding and redundant load elimination walk extended
+ * basic blocks (a block and its chain of single-predecessor successors),
+ * tracking which locations hold a known value until a possibly-aliasing
+ * store or a call clobbers them.  Dead store elimination then walks each
+ * block backwards and drops stores that are overwritten before being read,
+ * and stores to private stack slots that are not read before the function
+ * returns.
+ *
+ * stats may be NULL.  Returns the total number of instructions removed.
+ */
+uint32_t memopt__run_function(IrFunction *func, MemOptStats *stats);
+
+#endif
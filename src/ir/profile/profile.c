@@ -0,0 +1,277 @@
+#include "profile.h"
+#include "../../errhandler/errhandler.h"
+#include "../../utils/str_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_MAGIC   "PXPF"
+#define PROFILE_VERSION 1
+
+typedef struct {
+    char     *name;
+    uint64_t  checksum;
+    uint32_t  block_count;
+    uint64_t *counts;
+} ProfileRecord;
+
+struct ProfileData {
+    ProfileRecord *records;
+    uint32_t       count;
+};
+
+static uint64_t fnv_mix(uint64_t h, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        h ^= (v >> (i * 8)) & 0xFF;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint32_t block_index(const IrFunction *func, const IrBasicBlock *bb) {
+    for (uint32_t i = 0; i < func->block_count; i++)
+        if (func->all_blocks[i] == bb) return i;
+    return UINT32_MAX;
+}
+
+uint64_t profile__checksum(const IrFunction *func) {
+    uint64_t h = 14695981039346656037ULL;
+    h = fnv_mix(h, func->block_count);
+    for (uint32_t i = 0; i < func->block_count; i++) {
+        const IrBasicBlock *bb = func->all_blocks[i];
+        h = fnv_mix(h, bb->succ_count);
+        for (uint32_t j = 0; j < bb->succ_count; j++)
+            h = fnv_mix(h, block_index(func, bb->successors[j]));
+    }
+    return h;
+}
+
+/* counters[index]++ at the top of bb, after any phis. */
+static bool insert_counter(IrFunction *func, IrBasicBlock *bb, uint32_t index) {
+    IrInstruction *pos = bb->first_inst;
+    while (pos && pos->opcode == IR_PHI) pos = pos->next;
+    IrValue *table = ir__value_global(func->module, IR_RUNTIME_PROFILE_COUNTERS, TYPE_ARRAY, NULL);
+    IrValue *slot = ir__value_temp(func, TYPE_POINTER, NULL);
+    IrValue *old = ir__value_temp(func, TYPE_INT, NULL);
+    IrValue *inc = ir__value_temp(func, TYPE_INT, NULL);
+    if (!table || !slot || !old || !inc) return false;
+    IrInstruction *seq[4] = {
+        ir__inst_create(func, IR_GEP, slot, table, ir__value_const_int(func->module, index)),
+        ir__inst_create(func, IR_LOAD, old, slot, NULL),
+        ir__inst_create(func, IR_ADD, inc, old, ir__value_const_int(func->module, 1)),
+        ir__inst_create(func, IR_STORE, NULL, slot, inc),
+    };
+    for (int i = 0; i < 4; i++) {
+        if (!seq[i]) return false;
+        if (pos) ir__inst_insert_before(pos, seq[i]);
+        else ir__inst_append(bb, seq[i]);
+    }
+    return true;
+}
+
+static bool insert_dump_before(IrFunction *func, IrInstruction *pos) {
+    IrValue *dump = ir__value_global(func->module, IR_RUNTIME_PROFILE_DUMP, TYPE_FUNCTION, NULL);
+    IrInstruction *call = dump ? ir__inst_create_call(func, NULL, dump, NULL, 0) : NULL;
+    if (!call) return false;
+    call->line = pos->line;
+    call->column = pos->column;
+    ir__inst_insert_before(pos, call);
+    return true;
+}
+
+bool profile__instrument_module(IrModule *mod, const char *path) {
+    if (!mod || mod->profile) return false;
+    IrProfileLayout *layout = calloc(1, sizeof(IrProfileLayout));
+    if (layout) {
+        layout->path = u__strdup_safe(path ? path : PROFILE_DEFAULT_FILE);
+        layout->funcs = calloc(mod->func_count ? mod->func_count : 1, sizeof(IrProfileFunc));
+    }
+    if (!layout || !layout->path || !layout->funcs) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "profile",
+                                 "Failed to allocate profile layout");
+        if (layout) { free(layout->path); free(layout->funcs); free(layout); }
+        return false;
+    }
+    mod->profile = layout;
+    for (uint32_t i = 0; i < mod->func_count; i++) {
+        IrFunction *func = mod->functions[i];
+        IrProfileFunc *pf = &layout->funcs[layout->func_count++];
+        pf->name = u__strdup_safe(func->name ? func->name : "");
+        pf->checksum = profile__checksum(func);
+        pf->first_counter = layout->counter_count;
+        pf->block_count = func->block_count;
+        layout->counter_count += func->block_count;
+        if (!pf->name) return false;
+        for (uint32_t j = 0; j < func->block_count; j++)
+            if (!insert_counter(func, func->all_blocks[j], pf->first_counter + j)) return false;
+        bool is_main = func->name && strcmp(func->name, "main") == 0;
+        for (uint32_t j = 0; j < func->block_count; j++)
+            for (IrInstruction *inst = func->all_blocks[j]->first_inst; inst; inst = inst->next)
+                if ((is_main && inst->opcode == IR_RET) || ir__inst_is_call_to(inst, IR_RUNTIME_SIGNAL) ||
+                    ir__inst_is_call_to(inst, IR_RUNTIME_HALT))
+                    if (!insert_dump_before(func, inst)) return false;
+    }
+    return true;
+}
+
+static void put_uleb(FILE *f, uint64_t v) {
+    do {
+        uint8_t byte = v & 0x7F;
+        v >>= 7;
+        if (v) byte |= 0x80;
+        fputc(byte, f);
+    } while (v);
+}
+
+bool profile__write(const IrModule *mod, const uint64_t *counters) {
+    if (!mod || !mod->profile || !counters) return false;
+    const IrProfileLayout *layout = mod->profile;
+    FILE *f = fopen(layout->path, "wb");
+    if (!f) {
+        errhandler__report_error(ERROR_CODE_IO_WRITE, 0, 0, "profile",
+                                 "Cannot open profile for writing: %s", layout->path);
+        return false;
+    }
+    fwrite(PROFILE_MAGIC, 1, 4, f);
+    fputc(PROFILE_VERSION, f);
+    put_uleb(f, layout->func_count);
+    for (uint32_t i = 0; i < layout->func_count; i++) {
+        const IrProfileFunc *pf = &layout->funcs[i];
+        size_t len = strlen(pf->name);
+        put_uleb(f, len);
+        fwrite(pf->name, 1, len, f);
+        for (int b = 0; b < 8; b++) fputc((int)((pf->checksum >> (b * 8)) & 0xFF), f);
+        put_uleb(f, pf->block_count);
+        for (uint32_t j = 0; j < pf->block_count; j++) put_uleb(f, counters[pf->first_counter + j]);
+    }
+    bool ok = !ferror(f);
+    if (fclose(f) != 0) ok = false;
+    if (!ok)
+        errhandler__report_error(ERROR_CODE_IO_WRITE, 0, 0, "profile",
+                                 "Failed to write profile: %s", layout->path);
+    return ok;
+}
+
+typedef struct {
+    const uint8_t *p, *end;
+    bool           ok;
+} Reader;
+
+static uint64_t get_uleb(Reader *r) {
+    uint64_t v = 0;
+    for (unsigned shift = 0; r->ok; shift += 7) {
+        if (r->p >= r->end || shift > 63) { r->ok = false; break; }
+        uint8_t byte = *r->p++;
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    return v;
+}
+
+static uint64_t get_u64(Reader *r) {
+    uint64_t v = 0;
+    if (r->end - r->p < 8) { r->ok = false; return 0; }
+    for (int b = 0; b < 8; b++) v |= (uint64_t)*r->p++ << (b * 8);
+    return v;
+}
+
+static bool parse_records(Reader *r, ProfileData *prof) {
+    if (r->end - r->p < 5 || memcmp(r->p, PROFILE_MAGIC, 4) != 0 || r->p[4] != PROFILE_VERSION)
+        return false;
+    r->p += 5;
+    uint64_t count = get_uleb(r);
+    /* Every record takes at least ten bytes. */
+    if (!r->ok || count > (uint64_t)(r->end - r->p) / 10) return false;
+    prof->records = calloc(count ? count : 1, sizeof(ProfileRecord));
+    if (!prof->records) return false;
+    for (uint64_t i = 0; i < count; i++) {
+        ProfileRecord *rec = &prof->records[prof->count++];
+        uint64_t len = get_uleb(r);
+        if (!r->ok || len > (uint64_t)(r->end - r->p)) return false;
+        rec->name = malloc(len + 1);
+        if (!rec->name) return false;
+        memcpy(rec->name, r->p, len);
+        rec->name[len] = '\0';
+        r->p += len;
+        rec->checksum = get_u64(r);
+        uint64_t blocks = get_uleb(r);
+        if (!r->ok || blocks > (uint64_t)(r->end - r->p)) return false;
+        rec->block_count = (uint32_t)blocks;
+        rec->counts = calloc(blocks ? blocks : 1, sizeof(uint64_t));
+        if (!rec->counts) return false;
+        for (uint64_t j = 0; j < blocks; j++) rec->counts[j] = get_uleb(r);
+        if (!r->ok) return false;
+    }
+    return r->p == r->end;
+}
+
+ProfileData *profile__read(const char *path) {
+    FILE *f = path ? fopen(path, "rb") : NULL;
+    if (!f) {
+        errhandler__report_error(ERROR_CODE_IO_READ, 0, 0, "profile",
+                                 "Cannot open profile: %s", path ? path : "(null)");
+        return NULL;
+    }
+    uint8_t *buf = NULL;
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0) size = ftell(f);
+    if (size >= 0 && fseek(f, 0, SEEK_SET) == 0) buf = malloc(size ? (size_t)size : 1);
+    bool read_ok = buf && fread(buf, 1, (size_t)size, f) == (size_t)size;
+    fclose(f);
+    ProfileData *prof = read_ok ? calloc(1, sizeof(ProfileData)) : NULL;
+    Reader r = { buf, buf + (read_ok ? size : 0), true };
+    if (!prof || !parse_records(&r, prof)) {
+        errhandler__report_error(ERROR_CODE_IO_READ, 0, 0, "profile",
+                                 "Malformed or unreadable profile: %s", path);
+        profile__destroy(prof);
+        prof = NULL;
+    }
+    free(buf);
+    return prof;
+}
+
+void profile__destroy(ProfileData *prof) {
+    if (!prof) return;
+    for (uint32_t i = 0; i < prof->count; i++) {
+        free(prof->records[i].name);
+        free(prof->records[i].counts);
+    }
+    free(prof->records);
+    free(prof);
+}
+
+uint32_t profile__apply(const ProfileData *prof, IrModule *mod) {
+    if (!prof || !mod) return 0;
+    uint32_t applied = 0;
+    for (uint32_t i = 0; i < mod->func_count; i++) {
+        IrFunction *func = mod->functions[i];
+        const ProfileRecord *rec = NULL;
+        for (uint32_t j = 0; j < prof->count && !rec; j++)
+            if (func->name && strcmp(prof->records[j].name, func->name) == 0) rec = &prof->records[j];
+        if (!rec) continue;
+        if (rec->block_count != func->block_count || rec->checksum != profile__checksum(func)) {
+            errhandler__report_error_ex(ERROR_LEVEL_WARNING, ERROR_CODE_IR_INVALID_ARGUMENT, 0, 0, 1,
+                                        "profile", "Profile for '%s' does not match its code; ignored",
+                                        func->name);
+            continue;
+        }
+        for (uint32_t j = 0; j < func->block_count; j++)
+            func->all_blocks[j]->exec_count = rec->counts[j];
+        func->has_profile = true;
+        applied++;
+    }
+    return applied;
+}
+
+uint64_t profile__edge_count(const IrBasicBlock *from, const IrBasicBlock *to) {
+    if (!from || !to) return 0;
+    if (to->pred_count == 1) return to->exec_count;
+    if (from->succ_count == 1) return from->exec_count;
+    if (from->succ_count == 2) {
+        /* The other edge is exact when it is its target's only way in. */
+        const IrBasicBlock *other = from->successors[0] == to ? from->successors[1] : from->successors[0];
+        if (other != to && other->pred_count == 1)
+            return from->exec_count > other->exec_count ? from->exec_count - other->exec_count : 0;
+    }
+    return from->exec_count < to->exec_count ? from->exec_count : to->exec_count;
+}
@@ -0,0 +1,52 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../ir.h"
+
+/* Profile written by an instrumented program when no file is named. */
+#define PROFILE_DEFAULT_FILE "default.pxprof"
+
+/*
+ * Profile-guided optimisation.
+ *
+ * -fprofile-generate instruments every block of every function with a
+ * 64-bit counter in IR_RUNTIME_PROFILE_COUNTERS, and calls
+ * IR_RUNTIME_PROFILE_DUMP before each return from main and before each
+ * `signal` and `halt`, which writes the table to the profile file.  Each
+ * dump writes the whole table, so the last one before exit wins.
+ *
+ * -fprofile-use reads such a file back and sets exec_count on the blocks of
+ * every function whose control flow graph still matches the one that was
+ * instrumented.  Both run on freshly generated IR, before any pass.
+ *
+ * File format (little endian, ULEB128 where marked):
+ *
+ *     "PXPF" version:u8 functions:uleb
+ *     per function: name_len:uleb name checksum:u64 blocks:uleb
+ *                   blocks x count:uleb
+ */
+
+typedef struct ProfileData ProfileData;
+
+/* CFG fingerprint used to reject counts recorded for different code. */
+uint64_t profile__checksum(const IrFunction *func);
+
+/* Insert block counters and dump calls; path NULL selects the default. */
+bool profile__instrument_module(IrModule *mod, const char *path);
+
+/* Write the counter table of an instrumented module. */
+bool profile__write(const IrModule *mod, const uint64_t *counters);
+
+ProfileData *profile__read(const char *path);
+void         profile__destroy(ProfileData *prof);
+
+/* Annotate matching functions; returns how many were annotated.  Functions
+ * whose checksum no longer matches are reported and left unannotated. */
+uint32_t profile__apply(const ProfileData *prof, IrModule *mod);
+
+/* Executions of the from -> to edge, derived from block counts. */
+uint64_t profile__edge_count(const IrBasicBlock *from, const IrBasicBlock *to);
+
+#endif
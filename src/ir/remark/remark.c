@@ -0,0 +1,106 @@
+#include "remark.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Passes that can report remarks. */
+static const char *const known_passes[] = {
+    "heap2stack",
+    "loop-idiom",
+    "inline",
+    "consteval",
+};
+
+#define PASS_COUNT (sizeof(known_passes) / sizeof(known_passes[0]))
+
+static bool        enabled[PASS_COUNT];
+static const char *current_filename = NULL;
+
+struct RemarkBuffer {
+    char   *text;
+    size_t  length, capacity;
+};
+
+static _Thread_local RemarkBuffer *active_buffer = NULL;
+
+static int pass_index(const char *pass) {
+    if (!pass) return -1;
+    for (size_t i = 0; i < PASS_COUNT; i++)
+        if (strcmp(known_passes[i], pass) == 0) return (int)i;
+    return -1;
+}
+
+bool remark__enable(const char *pass) {
+    int idx = pass_index(pass);
+    if (idx < 0) return false;
+    enabled[idx] = true;
+    return true;
+}
+
+bool remark__enabled(const char *pass) {
+    int idx = pass_index(pass);
+    return idx >= 0 && enabled[idx];
+}
+
+void remark__set_filename(const char *filename) {
+    current_filename = filename;
+}
+
+/* Append to the thread's buffer, or print when there is none. */
+static void put(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    RemarkBuffer *b = active_buffer;
+    if (!b) {
+        vfprintf(stderr, format, args);
+        va_end(args);
+        return;
+    }
+    va_list copy;
+    va_copy(copy, args);
+    int n = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    if (n > 0 && b->length + (size_t)n + 1 > b->capacity) {
+        size_t new_cap = b->capacity ? b->capacity * 2 : 256;
+        while (new_cap < b->length + (size_t)n + 1) new_cap *= 2;
+        char *text = realloc(b->text, new_cap);
+        if (!text) n = 0;
+        else { b->text = text; b->capacity = new_cap; }
+    }
+    if (n > 0) {
+        vsnprintf(b->text + b->length, b->capacity - b->length, format, args);
+        b->length += (size_t)n;
+    }
+    va_end(args);
+}
+
+void remark__emit(const char *pass, const IrInstruction *inst, const char *format, ...) {
+    if (!remark__enabled(pass)) return;
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    put("%s:", current_filename ? current_filename : "<input>");
+    if (inst && inst->line) put("%u:%u:", inst->line, inst->column);
+    put(" \033[1;36mremark:\033[0m %s [-Rpass=%s]\n", message, pass);
+}
+
+RemarkBuffer *remark__buffer_begin(void) {
+    RemarkBuffer *buffer = calloc(1, sizeof(RemarkBuffer));
+    active_buffer = buffer;
+    return buffer;
+}
+
+void remark__buffer_end(RemarkBuffer *buffer) {
+    if (active_buffer == buffer) active_buffer = NULL;
+}
+
+void remark__buffer_commit(RemarkBuffer *buffer) {
+    if (!buffer) return;
+    remark__buffer_end(buffer);
+    if (buffer->length) fwrite(buffer->text, 1, buffer->length, stderr);
+    free(buffer->text);
+    free(buffer);
+}
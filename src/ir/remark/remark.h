@@ -0,0 +1,36 @@
+#ifndef REMARK_H
+#define REMARK_H
+
+#include <stdbool.h>
+#include "../ir.h"
+
+/*
+ * Optimisation remarks.  A pass reports each transformation it performs
+ * under its own name; remarks are printed to stderr only for passes
+ * enabled with -Rpass=<name>, as
+ *
+ *     file.px:12:5: remark: <message> [-Rpass=<name>]
+ */
+
+/* Enable remarks for a pass.  Returns false for an unknown pass name. */
+bool remark__enable(const char *pass);
+bool remark__enabled(const char *pass);
+
+/* Source file named in remarks; NULL clears it. */
+void remark__set_filename(const char *filename);
+
+/* Emit a remark located at inst (which may be NULL). */
+void remark__emit(const char *pass, const IrInstruction *inst, const char *format, ...);
+
+/*
+ * While a buffer is set on a thread, remarks emitted by that thread are kept
+ * in it; remark__buffer_commit prints them and frees the buffer.  Used with
+ * errhandler__buffer_begin to keep parallel output in a fixed order.
+ */
+typedef struct RemarkBuffer RemarkBuffer;
+
+RemarkBuffer *remark__buffer_begin(void);
+void          remark__buffer_end(RemarkBuffer *buffer);
+void          remark__buffer_commit(RemarkBuffer *buffer);
+
+#endif
@@ -0,0 +1,1340 @@
+#define _DEFAULT_SOURCE
+#include "jit.h"
+#include "../ir/lower/lower.h"
+#include "../ir/interp/interp.h"
+#include "../ir/profile/profile.h"
+#include "../errhandler/errhandler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(__x86_64__)
+
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define JIT_STACK_BYTES     (64U << 20)
+#define JIT_GUARD_BYTES     (64U << 10)
+#define JIT_SIGNAL_STACK    (64U << 10)
+#define JIT_STATIC_LOCALS   (1U << 20)  /* locals beyond this are allocated at run time */
+#define JIT_CODE_OFFSET     64          /* chunk header before the code */
+
+/* Address of a runtime function as an immediate. */
+#define FN(f) ((uint64_t)(uintptr_t)(f))
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11 };
+enum { XMM0, XMM1 };
+
+/* Condition codes; CC_ALWAYS makes an unconditional jump. */
+enum {
+    CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_S = 0x8,
+    CC_P = 0xA, CC_NP = 0xB, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF,
+    CC_ALWAYS = -1
+};
+
+static const int int_arg_regs[6] = { RDI, RSI, RDX, RCX, R8, R9 };
+
+/* How a run left the generated code. */
+enum { JIT_RETURNED, JIT_EXITED, JIT_TRAPPED, JIT_OVERFLOWED, JIT_FAULTED };
+
+/* Why generated code called jit_trap. */
+enum { TRAP_DIV_BY_ZERO, TRAP_UNSUPPORTED, TRAP_UNDEFINED, TRAP_STACK };
+
+/* Header of a mapping holding the code of one function. */
+typedef struct JitChunk {
+    struct JitChunk *next;
+    size_t           size;
+} JitChunk;
+
+typedef struct Jit {
+    IrModule       *mod;
+    LowerModule     lm;
+    JitOptions      opts;
+    IrPassOptions   passes;
+    InterpServices  services;
+    void          **table;          /* current entry of each function */
+    uint64_t       *calls;          /* calls to each baseline function */
+    uint64_t       *counters;       /* IR_RUNTIME_PROFILE_COUNTERS */
+    JitChunk       *chunks;
+    size_t          page;
+    uint8_t        *stack;          /* guard pages first */
+    size_t          stack_size;
+    uintptr_t       stack_limit;    /* lowest usable address of the stack */
+    sigjmp_buf      escape;
+    int64_t         exit_status;
+    uintptr_t       fault_addr;
+    JitStats        stats;
+} Jit;
+
+/* Where a parameter is passed: an integer or SSE register, or the stack. */
+typedef struct {
+    bool     real;
+    int      reg;               /* -1 on the stack */
+    uint32_t stack;             /* 8-byte slot above the return address */
+} ArgPlace;
+
+struct BlockFixup {
+    uint32_t            at;     /* rel32 to patch */
+    const IrBasicBlock *block;
+};
+
+typedef struct {
+    Jit                *jit;
+    const IrFunction   *func;
+    uint32_t            index;
+    LowerFunction       lf;
+    bool                returns_real;
+    uint8_t            *code;
+    uint32_t            len, cap;
+    bool                oom;
+    uint32_t            scratch;    /* first slot phi moves go through */
+    uint32_t            frame;      /* bytes below rbp */
+    int64_t            *local;      /* frame offset of each static alloca, by temp; -1 otherwise */
+    uint32_t           *block_at;   /* code offset of each block, by id */
+    struct BlockFixup  *fixups;
+    uint32_t            fixup_count, fixup_capacity;
+    uint32_t            pos;        /* line << 16 | column of the instruction */
+} Emitter;
+
+static Jit *volatile running;       /* the JIT whose code is running, for on_fault */
+
+static void *compile_function(Jit *jit, uint32_t index, bool count_calls);
+
+static uint64_t real_bits(double r) {
+    uint64_t u;
+    memcpy(&u, &r, sizeof u);
+    return u;
+}
+
+static double bits_real(uint64_t u) {
+    double r;
+    memcpy(&r, &u, sizeof r);
+    return r;
+}
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec end;
+    timespec_get(&end, TIME_UTC);
+    return (double)(end.tv_sec - start->tv_sec) * 1e3 + (double)(end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* ------------------------------------------------------------------ runtime */
+
+static void jit_trap(Jit *jit, uint32_t kind, uint32_t pos, const char *func, uint64_t detail) {
+    uint16_t line = (uint16_t)(pos >> 16);
+    uint8_t column = (uint8_t)pos;
+    switch (kind) {
+        case TRAP_DIV_BY_ZERO:
+            errhandler__report_error(ERROR_CODE_RUNTIME_DIV_BY_ZERO, line, column, "jit",
+                                     "Division by zero (in '%s')", func);
+            break;
+        case TRAP_UNDEFINED:
+            errhandler__report_error(ERROR_CODE_RUNTIME_UNDEFINED_CALL, line, column, "jit",
+                                     "Call to undefined function '%s' (in '%s')",
+                                     (const char *)(uintptr_t)detail, func);
+            break;
+        case TRAP_STACK:
+            errhandler__report_error(ERROR_CODE_RUNTIME_STACK_OVERFLOW, line, column, "jit",
+                                     "Stack overflow (in '%s')", func);
+            break;
+        default:
+            errhandler__report_error(ERROR_CODE_RUNTIME_UNSUPPORTED, line, column, "jit",
+                                     "Unsupported IR opcode %u (in '%s')", (unsigned)detail, func);
+            break;
+    }
+    siglongjmp(jit->escape, JIT_TRAPPED);
+}
+
+static void jit_signal(Jit *jit, const uint64_t *args, uint32_t argc, uint32_t pos, const char *func) {
+    bool exited = false;
+    int64_t status = 0;
+    if (!interp__service(&jit->services, args, argc, &exited, &status)) {
+        errhandler__report_error(ERROR_CODE_RUNTIME_UNSUPPORTED, (uint16_t)(pos >> 16), (uint8_t)pos, "jit",
+                                 "Unsupported service %llu (in '%s')", (unsigned long long)args[0], func);
+        siglongjmp(jit->escape, JIT_TRAPPED);
+    }
+    if (exited) {
+        jit->exit_status = status;
+        siglongjmp(jit->escape, JIT_EXITED);
+    }
+}
+
+static void jit_halt(Jit *jit) {
+    jit->exit_status = 0;
+    siglongjmp(jit->escape, JIT_EXITED);
+}
+
+static void jit_profile_dump(Jit *jit) {
+    if (jit->mod->profile) profile__write(jit->mod, jit->counters);
+}
+
+static void *jit_alloc(uint64_t size, uint64_t align) {
+    if (!size) size = 1;
+    if (align > 16 && (align & (align - 1)) == 0) {
+        void *p = aligned_alloc(align, (size + align - 1) & ~(align - 1));
+        if (p) memset(p, 0, size);
+        return p;
+    }
+    return calloc(1, size);
+}
+
+static void *jit_realloc(void *p, uint64_t size) {
+    return realloc(p, size ? size : 1);
+}
+
+static void jit_memset(uint8_t *p, uint64_t v, uint64_t count, uint64_t size) {
+    if (size == 1 || v == 0) memset(p, (int)(uint8_t)v, count * size);
+    else for (uint64_t i = 0; i < count; i++) memcpy(p + i * size, &v, size > 8 ? 8 : size);
+}
+
+/* Ascending copy, like the loop it replaced, even when overlapping. */
+static void jit_memcpy(uint8_t *dst, const uint8_t *src, uint64_t count, uint64_t size) {
+    uint64_t bytes = count * size;
+    if (dst <= src || dst >= src + bytes) memmove(dst, src, bytes);
+    else for (uint64_t i = 0; i < bytes; i++) dst[i] = src[i];
+}
+
+/* Called by a baseline function on the call that reaches the threshold. */
+static void jit_tier_up(Jit *jit, uint32_t index) {
+    irpass__run_function(jit->mod->functions[index], &jit->passes);
+    void *code = compile_function(jit, index, false);
+    if (!code) return;          /* keeps running the baseline code */
+    jit->table[index] = code;
+    jit->stats.recompiled++;
+}
+
+/* ----------------------------------------------------------------- encoding */
+
+static void put(Emitter *e, const void *bytes, uint32_t n) {
+    if (e->oom) return;
+    if (e->len + n > e->cap) {
+        uint32_t cap = e->cap ? e->cap : 4096;
+        while (cap < e->len + n) cap *= 2;
+        uint8_t *code = realloc(e->code, cap);
+        if (!code) { e->oom = true; return; }
+        e->code = code;
+        e->cap = cap;
+    }
+    memcpy(e->code + e->len, bytes, n);
+    e->len += n;
+}
+
+static void put8(Emitter *e, uint8_t b)   { put(e, &b, 1); }
+static void put32(Emitter *e, uint32_t v) { put(e, &v, 4); }
+static void put64(Emitter *e, uint64_t v) { put(e, &v, 8); }
+
+/* Mandatory prefix, REX and opcode; opcodes above 0xFF are 0F xx. */
+static void opcode(Emitter *e, uint8_t prefix, bool w, int reg, int rm, uint32_t op) {
+    if (prefix) put8(e, prefix);
+    uint8_t rex = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+    if (rex != 0x40) put8(e, rex);
+    if (op > 0xFF) put8(e, (uint8_t)(op >> 8));
+    put8(e, (uint8_t)op);
+}
+
+/* op reg, rm with both in registers; reg is the /digit for group opcodes. */
+static void inst_rr(Emitter *e, uint8_t prefix, bool w, uint32_t op, int reg, int rm) {
+    opcode(e, prefix, w, reg, rm, op);
+    put8(e, (uint8_t)(0xC0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+/* op reg, [base + disp]. */
+static void inst_rm(Emitter *e, uint8_t prefix, bool w, uint32_t op, int reg, int base, int32_t disp) {
+    opcode(e, prefix, w, reg, base, op);
+    uint8_t mod = disp == 0 && (base & 7) != RBP ? 0x00 : disp >= -128 && disp <= 127 ? 0x40 : 0x80;
+    put8(e, (uint8_t)(mod | (reg & 7) << 3 | (base & 7)));
+    if ((base & 7) == RSP) put8(e, 0x24);
+    if (mod == 0x40) put8(e, (uint8_t)(int8_t)disp);
+    else if (mod == 0x80) put32(e, (uint32_t)disp);
+}
+
+static void mov_rr(Emitter *e, int dst, int src) {
+    if (dst != src) inst_rr(e, 0, true, 0x89, src, dst);
+}
+
+/* May change the flags. */
+static void mov_imm(Emitter *e, int reg, uint64_t v) {
+    if (v == 0) {
+        inst_rr(e, 0, false, 0x31, reg, reg);
+    } else if (v <= UINT32_MAX) {
+        if (reg & 8) put8(e, 0x41);
+        put8(e, (uint8_t)(0xB8 + (reg & 7)));
+        put32(e, (uint32_t)v);
+    } else if ((int64_t)v >= INT32_MIN && (int64_t)v <= INT32_MAX) {
+        inst_rr(e, 0, true, 0xC7, 0, reg);
+        put32(e, (uint32_t)v);
+    } else {
+        put8(e, (uint8_t)(0x48 | ((reg & 8) ? 1 : 0)));
+        put8(e, (uint8_t)(0xB8 + (reg & 7)));
+        put64(e, v);
+    }
+}
+
+static void push(Emitter *e, int reg) {
+    if (reg & 8) put8(e, 0x41);
+    put8(e, (uint8_t)(0x50 + (reg & 7)));
+}
+
+static void pop(Emitter *e, int reg) {
+    if (reg & 8) put8(e, 0x41);
+    put8(e, (uint8_t)(0x58 + (reg & 7)));
+}
+
+static void gpr_to_xmm(Emitter *e, int xmm, int gpr) { inst_rr(e, 0x66, true, 0x0F6E, xmm, gpr); }
+static void xmm_to_gpr(Emitter *e, int gpr, int xmm) { inst_rr(e, 0x66, true, 0x0F7E, xmm, gpr); }
+
+/* setcc into the low byte of reg, then zero-extended when reg is rax. */
+static void setcc(Emitter *e, int cc, int reg) {
+    inst_rr(e, 0, false, 0x0F90 | (uint32_t)cc, 0, reg);
+}
+
+static void rsp_adjust(Emitter *e, int32_t bytes) {
+    if (bytes == 0) return;
+    inst_rr(e, 0, true, 0x81, bytes > 0 ? 0 : 5, RSP);
+    put32(e, (uint32_t)(bytes > 0 ? bytes : -bytes));
+}
+
+static void call_address(Emitter *e, uint64_t fn) {
+    mov_imm(e, RAX, fn);
+    inst_rr(e, 0, false, 0xFF, 2, RAX);
+}
+
+/* A jump to patch with bind; returns where its rel32 is. */
+static uint32_t jump(Emitter *e, int cc) {
+    if (cc == CC_ALWAYS) {
+        put8(e, 0xE9);
+    } else {
+        put8(e, 0x0F);
+        put8(e, (uint8_t)(0x80 | cc));
+    }
+    put32(e, 0);
+    return e->len - 4;
+}
+
+static void patch_rel32(Emitter *e, uint32_t at, uint32_t target) {
+    int32_t rel = (int32_t)(target - (at + 4));
+    memcpy(e->code + at, &rel, 4);
+}
+
+/* Point the jump at `at` to the current position. */
+static void bind(Emitter *e, uint32_t at) {
+    if (!e->oom) patch_rel32(e, at, e->len);
+}
+
+static void jump_block(Emitter *e, int cc, const IrBasicBlock *block) {
+    uint32_t at = jump(e, cc);
+    if (e->oom) return;
+    if (e->fixup_count == e->fixup_capacity) {
+        uint32_t cap = e->fixup_capacity ? e->fixup_capacity * 2 : 32;
+        struct BlockFixup *fixups = realloc(e->fixups, cap * sizeof(*fixups));
+        if (!fixups) { e->oom = true; return; }
+        e->fixups = fixups;
+        e->fixup_capacity = cap;
+    }
+    e->fixups[e->fixup_count++] = (struct BlockFixup){ at, block };
+}
+
+/* Multi-byte NOPs up to the next multiple of align. */
+static void emit_padding(Emitter *e, uint32_t align) {
+    static const uint8_t nops[8][8] = {
+        { 0x90 },
+        { 0x66, 0x90 },
+        { 0x0F, 0x1F, 0x00 },
+        { 0x0F, 0x1F, 0x40, 0x00 },
+        { 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    };
+    uint32_t pad = (align - e->len % align) % align;
+    while (pad > 0) {
+        uint32_t n = pad > 8 ? 8 : pad;
+        put(e, nops[n - 1], n);
+        pad -= n;
+    }
+}
+
+/* --------------------------------------------------------------- operands */
+
+static int32_t slot_disp(uint32_t slot) {
+    return -8 * (int32_t)(slot + 1);
+}
+
+/* Frame slot of a parameter or temp. */
+static bool slot_of(const Emitter *e, const IrValue *v, uint32_t *slot) {
+    if (!v) return false;
+    if (v->kind == IR_VALUE_PARAM && v->id < e->func->param_count) {
+        *slot = v->id;
+        return true;
+    }
+    if (v->kind == IR_VALUE_TEMP && v->id < e->lf.temp_count) {
+        *slot = e->func->param_count + v->id;
+        return true;
+    }
+    return false;
+}
+
+static void load_slot(Emitter *e, int reg, uint32_t slot)  { inst_rm(e, 0, true, 0x8B, reg, RBP, slot_disp(slot)); }
+static void store_slot(Emitter *e, int reg, uint32_t slot) { inst_rm(e, 0, true, 0x89, reg, RBP, slot_disp(slot)); }
+
+static void store_result(Emitter *e, const IrInstruction *inst) {
+    uint32_t slot;
+    if (slot_of(e, inst->result, &slot)) store_slot(e, RAX, slot);
+}
+
+/* rax = xmm0 converted like the interpreter: truncated, saturating at the
+ * int64 range, NaN to 0.  Uses r11. */
+static void emit_ftoi(Emitter *e) {
+    inst_rr(e, 0xF2, true, 0x0F2C, RAX, XMM0);          /* cvttsd2si rax, xmm0 */
+    mov_imm(e, R11, UINT64_C(0x8000000000000000));
+    inst_rr(e, 0, true, 0x39, R11, RAX);                /* cmp rax, r11 */
+    uint32_t exact = jump(e, CC_NE);
+    inst_rr(e, 0x66, false, 0x0F2E, XMM0, XMM0);        /* ucomisd xmm0, xmm0 */
+    uint32_t nan = jump(e, CC_P);
+    xmm_to_gpr(e, R11, XMM0);
+    inst_rr(e, 0, true, 0x85, R11, R11);
+    uint32_t negative = jump(e, CC_S);
+    inst_rr(e, 0, true, 0xF7, 2, RAX);                  /* not rax: INT64_MAX */
+    uint32_t done = jump(e, CC_ALWAYS);
+    bind(e, nan);
+    mov_imm(e, RAX, 0);
+    bind(e, exact);
+    bind(e, negative);
+    bind(e, done);
+}
+
+/*
+ * Load v into reg as a real (the bits of a double) or an integer,
+ * converting like the interpreter.  Clobbers rax, r11 and xmm0 when it
+ * converts, so when several registers are loaded rax goes last.
+ */
+static void load_value(Emitter *e, int reg, const IrValue *v, bool want_real) {
+    if (!v) {
+        mov_imm(e, reg, 0);
+        return;
+    }
+    switch (v->kind) {
+        case IR_VALUE_CONST_INT:
+            mov_imm(e, reg, want_real ? real_bits((double)v->const_data.int_val)
+                                      : (uint64_t)v->const_data.int_val);
+            return;
+        case IR_VALUE_CONST_CHAR: {
+            int64_t c = (unsigned char)v->const_data.char_val;
+            mov_imm(e, reg, want_real ? real_bits((double)c) : (uint64_t)c);
+            return;
+        }
+        case IR_VALUE_CONST_REAL:
+            mov_imm(e, reg, want_real ? real_bits(v->const_data.real_val)
+                                      : (uint64_t)(int64_t)v->const_data.real_val);
+            return;
+        case IR_VALUE_GLOBAL_SYMBOL:
+            mov_imm(e, reg, v->name && strcmp(v->name, IR_RUNTIME_PROFILE_COUNTERS) == 0
+                            ? (uint64_t)(uintptr_t)e->jit->counters : 0);
+            return;
+        case IR_VALUE_STRUCT_FIELD:
+            mov_imm(e, reg, (uint64_t)lower__field_offset(v));
+            return;
+        case IR_VALUE_PARAM:
+        case IR_VALUE_TEMP: {
+            uint32_t slot;
+            if (!slot_of(e, v, &slot)) {
+                mov_imm(e, reg, 0);
+                return;
+            }
+            load_slot(e, reg, slot);
+            if (lower__is_real(&e->lf, v) == want_real) return;
+            if (want_real) {
+                inst_rr(e, 0xF2, true, 0x0F2A, XMM0, reg);  /* cvtsi2sd xmm0, reg */
+                xmm_to_gpr(e, reg, XMM0);
+            } else {
+                gpr_to_xmm(e, XMM0, reg);
+                emit_ftoi(e);
+                mov_rr(e, reg, RAX);
+            }
+            return;
+        }
+        default:
+            mov_imm(e, reg, 0);
+            return;
+    }
+}
+
+/* rax = v as an integer that is non-zero when v is, and the flags of
+ * testing it. */
+static void emit_truth(Emitter *e, const IrValue *v) {
+    if (lower__is_real(&e->lf, v)) {
+        load_value(e, RAX, v, true);
+        gpr_to_xmm(e, XMM0, RAX);
+        inst_rr(e, 0x66, false, 0x0F57, XMM1, XMM1);    /* xorpd xmm1, xmm1 */
+        inst_rr(e, 0x66, false, 0x0F2E, XMM0, XMM1);    /* ucomisd xmm0, xmm1 */
+        setcc(e, CC_NE, RAX);
+        setcc(e, CC_P, RCX);
+        inst_rr(e, 0, false, 0x08, RCX, RAX);           /* or al, cl */
+        inst_rr(e, 0, false, 0x0FB6, RAX, RAX);         /* movzx eax, al */
+    } else {
+        load_value(e, RAX, v, false);
+    }
+    inst_rr(e, 0, true, 0x85, RAX, RAX);
+}
+
+static void emit_trap(Emitter *e, uint32_t kind, uint64_t detail) {
+    mov_imm(e, RDI, (uint64_t)(uintptr_t)e->jit);
+    mov_imm(e, RSI, kind);
+    mov_imm(e, RDX, e->pos);
+    mov_imm(e, RCX, (uint64_t)(uintptr_t)e->func->name);
+    mov_imm(e, R8, detail);
+    call_address(e, FN(jit_trap));
+}
+
+/* Trap unless the address in reg is at or above the stack limit. */
+static void emit_stack_check(Emitter *e, int reg) {
+    mov_imm(e, R11, (uint64_t)(uintptr_t)&e->jit->stack_limit);
+    inst_rm(e, 0, true, 0x3B, reg, R11, 0);             /* cmp reg, [r11] */
+    uint32_t fits = jump(e, CC_AE);
+    emit_trap(e, TRAP_STACK, 0);
+    bind(e, fits);
+}
+
+/* ------------------------------------------------------------ instructions */
+
+static void emit_int_binary(Emitter *e, IrOpcode op) {
+    switch (op) {
+        case IR_ADD: inst_rr(e, 0, true, 0x01, RCX, RAX); return;
+        case IR_SUB: inst_rr(e, 0, true, 0x29, RCX, RAX); return;
+        case IR_MUL: inst_rr(e, 0, true, 0x0FAF, RAX, RCX); return;
+        case IR_AND: inst_rr(e, 0, true, 0x21, RCX, RAX); return;
+        case IR_OR:  inst_rr(e, 0, true, 0x09, RCX, RAX); return;
+        case IR_XOR: inst_rr(e, 0, true, 0x31, RCX, RAX); return;
+        case IR_SHL: inst_rr(e, 0, true, 0xD3, 4, RAX); return;
+        case IR_SHR: inst_rr(e, 0, true, 0xD3, 5, RAX); return;
+        case IR_SAR: inst_rr(e, 0, true, 0xD3, 7, RAX); return;
+        case IR_DIV: case IR_MOD: {
+            inst_rr(e, 0, true, 0x85, RCX, RCX);
+            uint32_t nonzero = jump(e, CC_NE);
+            emit_trap(e, TRAP_DIV_BY_ZERO, 0);
+            bind(e, nonzero);
+            /* x / -1 is -x and x % -1 is 0, without faulting on INT64_MIN. */
+            inst_rr(e, 0, true, 0x83, 7, RCX);
+            put8(e, 0xFF);
+            uint32_t regular = jump(e, CC_NE);
+            if (op == IR_MOD) mov_imm(e, RAX, 0);
+            else inst_rr(e, 0, true, 0xF7, 3, RAX);
+            uint32_t done = jump(e, CC_ALWAYS);
+            bind(e, regular);
+            put8(e, 0x48);
+            put8(e, 0x99);                              /* cqo */
+            inst_rr(e, 0, true, 0xF7, 7, RCX);          /* idiv rcx */
+            if (op == IR_MOD) mov_rr(e, RAX, RDX);
+            bind(e, done);
+            return;
+        }
+        default: {
+            static const int cc[] = {
+                [IR_EQ] = CC_E, [IR_NEQ] = CC_NE, [IR_LT] = CC_L,
+                [IR_LE] = CC_LE, [IR_GT] = CC_G, [IR_GE] = CC_GE,
+            };
+            inst_rr(e, 0, true, 0x39, RCX, RAX);        /* cmp rax, rcx */
+            setcc(e, cc[op], RAX);
+            inst_rr(e, 0, false, 0x0FB6, RAX, RAX);
+            return;
+        }
+    }
+}
+
+/* Unordered operands compare false, except for NEQ. */
+static void emit_real_binary(Emitter *e, IrOpcode op) {
+    gpr_to_xmm(e, XMM0, RAX);
+    gpr_to_xmm(e, XMM1, RCX);
+    switch (op) {
+        case IR_ADD: inst_rr(e, 0xF2, false, 0x0F58, XMM0, XMM1); break;
+        case IR_SUB: inst_rr(e, 0xF2, false, 0x0F5C, XMM0, XMM1); break;
+        case IR_MUL: inst_rr(e, 0xF2, false, 0x0F59, XMM0, XMM1); break;
+        case IR_DIV: inst_rr(e, 0xF2, false, 0x0F5E, XMM0, XMM1); break;
+        case IR_MOD: call_address(e, FN(fmod)); break;
+        case IR_EQ: case IR_NEQ:
+            inst_rr(e, 0x66, false, 0x0F2E, XMM0, XMM1);
+            setcc(e, op == IR_EQ ? CC_E : CC_NE, RAX);
+            setcc(e, op == IR_EQ ? CC_NP : CC_P, RCX);
+            inst_rr(e, 0, false, op == IR_EQ ? 0x20 : 0x08, RCX, RAX);
+            inst_rr(e, 0, false, 0x0FB6, RAX, RAX);
+            return;
+        default:
+            /* a < b is b > a, so every ordering is an above test. */
+            if (op == IR_LT || op == IR_LE) inst_rr(e, 0x66, false, 0x0F2E, XMM1, XMM0);
+            else inst_rr(e, 0x66, false, 0x0F2E, XMM0, XMM1);
+            setcc(e, op == IR_GT || op == IR_LT ? CC_A : CC_AE, RAX);
+            inst_rr(e, 0, false, 0x0FB6, RAX, RAX);
+            return;
+    }
+    xmm_to_gpr(e, RAX, XMM0);
+}
+
+static void emit_binary(Emitter *e, const IrInstruction *inst) {
+    IrOpcode op = (IrOpcode)inst->opcode;
+    bool real = op <= IR_GE && (lower__is_real(&e->lf, inst->operand1) ||
+                                lower__is_real(&e->lf, inst->operand2));
+    load_value(e, RCX, inst->operand2, real);
+    load_value(e, RAX, inst->operand1, real);
+    if (real) emit_real_binary(e, op);
+    else emit_int_binary(e, op);
+    store_result(e, inst);
+}
+
+static void emit_unary(Emitter *e, const IrInstruction *inst) {
+    bool real = inst->opcode == IR_NEG && lower__is_real(&e->lf, inst->operand1);
+    load_value(e, RAX, inst->operand1, real);
+    if (real) {
+        mov_imm(e, R11, UINT64_C(0x8000000000000000));
+        inst_rr(e, 0, true, 0x31, R11, RAX);            /* flip the sign bit */
+    } else {
+        inst_rr(e, 0, true, 0xF7, inst->opcode == IR_NOT ? 2 : 3, RAX);
+    }
+    store_result(e, inst);
+}
+
+static void emit_load(Emitter *e, const IrInstruction *inst) {
+    LowerAccess acc = lower__access(&e->lf, inst->operand1);
+    load_value(e, RCX, inst->operand1, false);
+    if (!acc.typed || acc.size == 8) {
+        inst_rm(e, 0, true, 0x8B, RAX, RCX, 0);
+    } else if (acc.is_real) {
+        inst_rm(e, 0xF3, false, 0x0F5A, XMM0, RCX, 0);  /* cvtss2sd xmm0, [rcx] */
+        xmm_to_gpr(e, RAX, XMM0);
+    } else if (acc.size == 4) {
+        inst_rm(e, 0, true, 0x63, RAX, RCX, 0);         /* movsxd */
+    } else if (acc.size == 2) {
+        inst_rm(e, 0, true, 0x0FBF, RAX, RCX, 0);
+    } else {
+        inst_rm(e, 0, acc.is_signed, acc.is_signed ? 0x0FBE : 0x0FB6, RAX, RCX, 0);
+    }
+    store_result(e, inst);
+}
+
+static void emit_store(Emitter *e, const IrInstruction *inst) {
+    LowerAccess acc = lower__access(&e->lf, inst->operand1);
+    bool real = acc.typed ? acc.is_real : lower__is_real(&e->lf, inst->operand2);
+    load_value(e, RCX, inst->operand1, false);
+    load_value(e, RAX, inst->operand2, real);
+    if (!acc.typed || acc.size == 8) {
+        inst_rm(e, 0, true, 0x89, RAX, RCX, 0);
+    } else if (acc.is_real) {
+        gpr_to_xmm(e, XMM0, RAX);
+        inst_rr(e, 0xF2, false, 0x0F5A, XMM0, XMM0);    /* cvtsd2ss */
+        inst_rm(e, 0xF3, false, 0x0F11, XMM0, RCX, 0);  /* movss [rcx], xmm0 */
+    } else if (acc.size == 4) {
+        inst_rm(e, 0, false, 0x89, RAX, RCX, 0);
+    } else if (acc.size == 2) {
+        inst_rm(e, 0x66, false, 0x89, RAX, RCX, 0);
+    } else {
+        inst_rm(e, 0, false, 0x88, RAX, RCX, 0);
+    }
+}
+
+static void emit_alloca(Emitter *e, const IrInstruction *inst) {
+    if (inst->result && inst->result->kind == IR_VALUE_TEMP && inst->result->id < e->lf.temp_count &&
+        e->local[inst->result->id] >= 0) {
+        int32_t disp = (int32_t)(e->local[inst->result->id] - (int64_t)e->frame);
+        inst_rm(e, 0, true, 0x8D, RAX, RBP, disp);      /* lea rax, [rbp + disp] */
+        store_result(e, inst);
+        return;
+    }
+    /* Below the frame, until the function returns. */
+    load_value(e, RAX, inst->operand1, false);
+    mov_rr(e, RCX, RSP);
+    inst_rr(e, 0, true, 0x29, RAX, RCX);                /* sub rcx, rax */
+    uint32_t wrapped = jump(e, CC_B);
+    inst_rr(e, 0, true, 0x83, 4, RCX);
+    put8(e, 0xF0);                                      /* and rcx, -16 */
+    mov_imm(e, R11, (uint64_t)(uintptr_t)&e->jit->stack_limit);
+    inst_rm(e, 0, true, 0x3B, RCX, R11, 0);
+    uint32_t fits = jump(e, CC_AE);
+    bind(e, wrapped);
+    emit_trap(e, TRAP_STACK, 0);
+    bind(e, fits);
+    mov_rr(e, RSP, RCX);
+    mov_rr(e, RAX, RCX);
+    store_result(e, inst);
+}
+
+static void emit_gep(Emitter *e, const IrInstruction *inst) {
+    uint32_t scale = lower__gep_scale(inst);
+    load_value(e, RDX, inst->operand1, false);
+    const IrGepExtra *extra = inst->extra;
+    uint32_t n = 1 + (extra ? extra->index_count : 0);
+    for (uint32_t i = 0; i < n; i++) {
+        const IrValue *idx = i == 0 ? inst->operand2 : extra->indices[i - 1];
+        int64_t off = 0;
+        bool fixed = true;
+        if (!idx) off = 0;
+        else if (idx->kind == IR_VALUE_STRUCT_FIELD) off = lower__field_offset(idx);
+        else if (idx->kind == IR_VALUE_CONST_INT) off = idx->const_data.int_val * (int64_t)scale;
+        else fixed = false;
+        if (fixed && off >= INT32_MIN && off <= INT32_MAX) {
+            if (off == 0) continue;
+            inst_rr(e, 0, true, 0x81, 0, RDX);
+            put32(e, (uint32_t)(int32_t)off);
+            continue;
+        }
+        load_value(e, RCX, idx, false);
+        if (scale <= INT32_MAX) {
+            inst_rr(e, 0, true, 0x69, RCX, RCX);        /* imul rcx, rcx, scale */
+            put32(e, scale);
+        } else {
+            mov_imm(e, R11, scale);
+            inst_rr(e, 0, true, 0x0FAF, RCX, R11);
+        }
+        inst_rr(e, 0, true, 0x01, RCX, RDX);
+    }
+    mov_rr(e, RAX, RDX);
+    store_result(e, inst);
+}
+
+static void emit_cast(Emitter *e, const IrInstruction *inst) {
+    const Type *t = inst->result->type_info;
+    DataType to = ir__datatype_of(t);
+    if (to == TYPE_REAL) {
+        load_value(e, RAX, inst->operand1, true);
+        if (ir__type_size(t) == 4) {
+            gpr_to_xmm(e, XMM0, RAX);
+            inst_rr(e, 0xF2, false, 0x0F5A, XMM0, XMM0);    /* round to float */
+            inst_rr(e, 0xF3, false, 0x0F5A, XMM0, XMM0);
+            xmm_to_gpr(e, RAX, XMM0);
+        }
+    } else {
+        load_value(e, RAX, inst->operand1, false);
+        uint32_t size = ir__type_size(t);
+        if (to == TYPE_CHAR) inst_rr(e, 0, false, 0x0FB6, RAX, RAX);
+        else if (to == TYPE_INT && size == 1) inst_rr(e, 0, true, 0x0FBE, RAX, RAX);
+        else if (to == TYPE_INT && size == 2) inst_rr(e, 0, true, 0x0FBF, RAX, RAX);
+        else if (to == TYPE_INT && size == 4) inst_rr(e, 0, true, 0x63, RAX, RAX);
+    }
+    store_result(e, inst);
+}
+
+static void emit_select(Emitter *e, const IrInstruction *inst) {
+    if (!inst->result || inst->result->kind != IR_VALUE_TEMP || inst->result->id >= e->lf.temp_count)
+        return;
+    bool real = e->lf.temp_real[inst->result->id];
+    const IrSelectExtra *sel = inst->extra;
+    emit_truth(e, inst->operand1);
+    uint32_t otherwise = jump(e, CC_E);
+    load_value(e, RAX, inst->operand2, real);
+    uint32_t done = jump(e, CC_ALWAYS);
+    bind(e, otherwise);
+    load_value(e, RAX, sel->false_value, real);
+    bind(e, done);
+    store_result(e, inst);
+}
+
+/* System V placement of func's parameters, shared by its prologue and
+ * its callers. */
+static void place_params(const IrFunction *func, ArgPlace *places) {
+    uint32_t ints = 0, reals = 0, stack = 0;
+    for (uint32_t i = 0; i < func->param_count; i++) {
+        bool real = lower__param_is_real(func, i);
+        places[i] = (ArgPlace){ real, -1, 0 };
+        if (real && reals < 8) places[i].reg = (int)reals++;
+        else if (!real && ints < 6) places[i].reg = int_arg_regs[ints++];
+        else places[i].stack = stack++;
+    }
+}
+
+static void emit_direct_call(Emitter *e, const IrInstruction *inst, uint32_t index) {
+    const IrFunction *callee = e->jit->mod->functions[index];
+    const IrCallExtra *call = inst->extra;
+    uint32_t argc = call ? call->arg_count : 0, n = callee->param_count;
+    ArgPlace *places = malloc((n ? n : 1) * sizeof(ArgPlace));
+    if (!places) {
+        e->oom = true;
+        return;
+    }
+    place_params(callee, places);
+    uint32_t stack = 0;
+    for (uint32_t i = 0; i < n; i++)
+        if (places[i].reg < 0) stack++;
+    int32_t area = (int32_t)((stack * 8 + 15) & ~15U);
+    rsp_adjust(e, -area);
+    /* Stack arguments, then integer registers, then SSE registers last to
+     * first: only a conversion to real touches an SSE register, xmm0. */
+    for (uint32_t i = 0; i < n; i++) {
+        if (places[i].reg >= 0) continue;
+        load_value(e, RAX, i < argc ? call->args[i] : NULL, places[i].real);
+        inst_rm(e, 0, true, 0x89, RAX, RSP, (int32_t)places[i].stack * 8);
+    }
+    for (uint32_t i = 0; i < n; i++)
+        if (places[i].reg >= 0 && !places[i].real)
+            load_value(e, places[i].reg, i < argc ? call->args[i] : NULL, false);
+    for (uint32_t i = n; i-- > 0; ) {
+        if (places[i].reg < 0 || !places[i].real) continue;
+        load_value(e, RAX, i < argc ? call->args[i] : NULL, true);
+        gpr_to_xmm(e, places[i].reg, RAX);
+    }
+    free(places);
+    mov_imm(e, R11, (uint64_t)(uintptr_t)&e->jit->table[index]);
+    inst_rm(e, 0, false, 0xFF, 2, R11, 0);              /* call [r11] */
+    rsp_adjust(e, area);
+    if (lower__returns_real(callee)) xmm_to_gpr(e, RAX, XMM0);
+    store_result(e, inst);
+}
+
+static void emit_signal(Emitter *e, const IrValue *const *args, uint32_t argc) {
+    uint32_t n = argc < 8 ? argc : 8;
+    int32_t area = (int32_t)((n * 8 + 15) & ~15U);
+    if (!area) area = 16;
+    rsp_adjust(e, -area);
+    for (uint32_t i = 0; i < n; i++) {
+        load_value(e, RAX, args[i], false);
+        inst_rm(e, 0, true, 0x89, RAX, RSP, (int32_t)i * 8);
+    }
+    mov_imm(e, RDI, (uint64_t)(uintptr_t)e->jit);
+    mov_rr(e, RSI, RSP);
+    mov_imm(e, RDX, n);
+    mov_imm(e, RCX, e->pos);
+    mov_imm(e, R8, (uint64_t)(uintptr_t)e->func->name);
+    call_address(e, FN(jit_signal));
+    rsp_adjust(e, area);
+}
+
+static void emit_call(Emitter *e, const IrInstruction *inst) {
+    const IrCallExtra *call = inst->extra;
+    const IrValue *const *args = call ? (const IrValue *const *)call->args : NULL;
+    uint32_t argc = call ? call->arg_count : 0;
+    const IrValue *a0 = argc > 0 ? args[0] : NULL, *a1 = argc > 1 ? args[1] : NULL;
+    const char *name = inst->operand1 && inst->operand1->kind == IR_VALUE_GLOBAL_SYMBOL
+                     ? inst->operand1->name : NULL;
+    uint32_t f = lower__callee(&e->jit->lm, inst);
+    if (f != UINT32_MAX) {
+        emit_direct_call(e, inst, f);
+    } else if (name && strcmp(name, IR_RUNTIME_ALLOC) == 0) {
+        load_value(e, RSI, a1, false);
+        load_value(e, RDI, a0, false);
+        call_address(e, FN(jit_alloc));
+        store_result(e, inst);
+    } else if (name && strcmp(name, IR_RUNTIME_REALLOC) == 0) {
+        load_value(e, RSI, a1, false);
+        load_value(e, RDI, a0, false);
+        call_address(e, FN(jit_realloc));
+        store_result(e, inst);
+    } else if (name && strcmp(name, IR_RUNTIME_FREE) == 0) {
+        load_value(e, RDI, a0, false);
+        call_address(e, FN(free));
+    } else if (name && strcmp(name, IR_RUNTIME_SIGNAL) == 0) {
+        emit_signal(e, args, argc);
+    } else if (name && strcmp(name, IR_RUNTIME_HALT) == 0) {
+        mov_imm(e, RDI, (uint64_t)(uintptr_t)e->jit);
+        call_address(e, FN(jit_halt));
+    } else if (name && strcmp(name, IR_RUNTIME_PROFILE_DUMP) == 0) {
+        mov_imm(e, RDI, (uint64_t)(uintptr_t)e->jit);
+        call_address(e, FN(jit_profile_dump));
+    } else {
+        emit_trap(e, TRAP_UNDEFINED, (uint64_t)(uintptr_t)(name ? name : "?"));
+    }
+}
+
+static void emit_mem(Emitter *e, const IrInstruction *inst) {
+    const IrMemExtra *mem = inst->extra;
+    if (inst->opcode == IR_MEMSET) {
+        bool real = lower__is_real(&e->lf, inst->operand2);
+        if (real && mem->elem_size == 4) {
+            load_value(e, RAX, inst->operand2, true);
+            gpr_to_xmm(e, XMM0, RAX);
+            inst_rr(e, 0xF2, false, 0x0F5A, XMM0, XMM0);    /* the float's bits */
+            inst_rr(e, 0x66, false, 0x0F7E, XMM0, RSI);     /* movd esi, xmm0 */
+        } else {
+            load_value(e, RSI, inst->operand2, real);
+        }
+    } else {
+        load_value(e, RSI, inst->operand2, false);
+    }
+    load_value(e, RDX, mem->count, false);
+    load_value(e, RDI, inst->operand1, false);
+    mov_imm(e, RCX, mem->elem_size);
+    call_address(e, inst->opcode == IR_MEMSET ? FN(jit_memset) : FN(jit_memcpy));
+}
+
+static void emit_return(Emitter *e, const IrValue *value) {
+    if (value) {
+        load_value(e, RAX, value, e->returns_real);
+        if (e->returns_real) gpr_to_xmm(e, XMM0, RAX);
+    } else {
+        mov_imm(e, RAX, 0);
+        if (e->returns_real) inst_rr(e, 0x66, false, 0x0F57, XMM0, XMM0);
+    }
+    put8(e, 0xC9);                                      /* leave */
+    put8(e, 0xC3);
+}
+
+static bool has_phis(const IrBasicBlock *bb) {
+    return bb->first_inst && bb->first_inst->opcode == IR_PHI;
+}
+
+/* Moves the phis of to need on the edge from `from`.  They happen at
+ * once, so when one reads what another writes all go through scratch. */
+static void emit_edge_moves(Emitter *e, const IrBasicBlock *from, const IrBasicBlock *to) {
+    uint32_t n = 0;
+    for (const IrInstruction *p = to->first_inst; p && p->opcode == IR_PHI; p = p->next) n++;
+    if (n == 0) return;
+    struct { uint32_t dst; const IrValue *src; bool real; } *moves = malloc(n * sizeof(*moves));
+    if (!moves) {
+        e->oom = true;
+        return;
+    }
+    uint32_t k = 0;
+    for (const IrInstruction *p = to->first_inst; p && p->opcode == IR_PHI; p = p->next) {
+        const IrPhiExtra *phi = p->extra;
+        uint32_t dst;
+        if (!slot_of(e, p->result, &dst) || p->result->kind != IR_VALUE_TEMP) continue;
+        for (uint32_t i = 0; i < phi->count; i++) {
+            if (phi->blocks[i] != from) continue;
+            moves[k].dst = dst;
+            moves[k].src = phi->values[i];
+            moves[k].real = e->lf.temp_real[p->result->id];
+            k++;
+            break;
+        }
+    }
+    bool overlap = false;
+    for (uint32_t i = 0; i < k && !overlap; i++) {
+        for (uint32_t j = 0; j < k; j++) {
+            uint32_t src;
+            if (i != j && slot_of(e, moves[j].src, &src) && src == moves[i].dst) {
+                overlap = true;
+                break;
+            }
+        }
+    }
+    if (overlap) {
+        for (uint32_t i = 0; i < k; i++) {
+            load_value(e, RAX, moves[i].src, moves[i].real);
+            store_slot(e, RAX, e->scratch + i);
+        }
+        for (uint32_t i = 0; i < k; i++) {
+            load_slot(e, RAX, e->scratch + i);
+            store_slot(e, RAX, moves[i].dst);
+        }
+    } else {
+        for (uint32_t i = 0; i < k; i++) {
+            uint32_t src;
+            if (slot_of(e, moves[i].src, &src) && src == moves[i].dst) continue;
+            load_value(e, RAX, moves[i].src, moves[i].real);
+            store_slot(e, RAX, moves[i].dst);
+        }
+    }
+    free(moves);
+}
+
+/* Edges into blocks with phis go through a stub after the branch that
+ * makes the moves of that edge. */
+static void emit_brcond(Emitter *e, const IrInstruction *inst, const IrBasicBlock *next) {
+    const IrCondBranchExtra *br = inst->extra;
+    const IrBasicBlock *t = br->true_target, *f = br->false_target;
+    emit_truth(e, inst->operand1);
+    uint32_t stub = 0;
+    if (has_phis(t)) stub = jump(e, CC_NE);
+    else jump_block(e, CC_NE, t);
+    emit_edge_moves(e, inst->parent, f);
+    if (f != next || has_phis(t)) jump_block(e, CC_ALWAYS, f);
+    if (has_phis(t)) {
+        bind(e, stub);
+        emit_edge_moves(e, inst->parent, t);
+        if (t != next) jump_block(e, CC_ALWAYS, t);
+    }
+}
+
+static void emit_instruction(Emitter *e, const IrInstruction *inst, const IrBasicBlock *next) {
+    IrOpcode op = (IrOpcode)inst->opcode;
+    switch (op) {
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+        case IR_EQ: case IR_NEQ: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        case IR_AND: case IR_OR: case IR_XOR: case IR_SHL: case IR_SHR: case IR_SAR:
+            if (inst->result) emit_binary(e, inst);
+            return;
+        case IR_NEG: case IR_NOT:
+            if (inst->result) emit_unary(e, inst);
+            return;
+        case IR_LOAD:   if (inst->result) emit_load(e, inst); return;
+        case IR_STORE:  emit_store(e, inst); return;
+        case IR_ALLOCA: emit_alloca(e, inst); return;
+        case IR_GEP:    emit_gep(e, inst); return;
+        case IR_CAST:   if (inst->result) emit_cast(e, inst); return;
+        case IR_CALL:   emit_call(e, inst); return;
+        case IR_SELECT: emit_select(e, inst); return;
+        case IR_RET:    emit_return(e, inst->operand1); return;
+        case IR_BR: {
+            const IrBasicBlock *to = inst->operand1 ? inst->operand1->const_data.block : NULL;
+            if (!to) {
+                emit_return(e, NULL);
+                return;
+            }
+            emit_edge_moves(e, inst->parent, to);
+            if (to != next) jump_block(e, CC_ALWAYS, to);
+            return;
+        }
+        case IR_BRCOND: emit_brcond(e, inst, next); return;
+        case IR_MEMSET: case IR_MEMCPY: emit_mem(e, inst); return;
+        case IR_PHI: case IR_NOP:
+            return;
+        default:
+            emit_trap(e, TRAP_UNSUPPORTED, op);
+            return;
+    }
+}
+
+/* ----------------------------------------------------------------- functions */
+
+/* Frame offsets of the allocas with a size known now, and the frame: the
+ * slots of parameters, temps and phi scratch below rbp, then locals. */
+static bool plan_frame(Emitter *e) {
+    const IrFunction *func = e->func;
+    uint32_t temps = e->lf.temp_count;
+    e->local = malloc((temps ? temps : 1) * sizeof(int64_t));
+    e->block_at = malloc((func->next_block_id ? func->next_block_id : 1) * sizeof(uint32_t));
+    if (!e->local || !e->block_at) return false;
+    for (uint32_t i = 0; i < temps; i++) e->local[i] = -1;
+    memset(e->block_at, 0xFF, (func->next_block_id ? func->next_block_id : 1) * sizeof(uint32_t));
+    uint32_t max_phis = 0;
+    uint64_t locals = 0;
+    for (uint32_t b = 0; b < func->block_count; b++) {
+        uint32_t phis = 0;
+        for (const IrInstruction *inst = func->all_blocks[b]->first_inst; inst; inst = inst->next) {
+            if (inst->opcode == IR_PHI) phis++;
+            const IrValue *r = inst->result;
+            if (inst->opcode != IR_ALLOCA || !r || r->kind != IR_VALUE_TEMP || r->id >= temps) continue;
+            const IrValue *size = inst->operand1, *align = inst->operand2;
+            uint64_t bytes;
+            if (!size) bytes = lower__slot_bytes(r, JIT_STATIC_LOCALS);
+            else if (size->kind == IR_VALUE_CONST_INT && size->const_data.int_val >= 0 &&
+                     (uint64_t)size->const_data.int_val <= JIT_STATIC_LOCALS)
+                bytes = (uint64_t)size->const_data.int_val;
+            else continue;
+            uint64_t a = align && align->kind == IR_VALUE_CONST_INT ? (uint64_t)align->const_data.int_val : 8;
+            if (a < 8 || a > 16 || (a & (a - 1))) a = a > 16 ? 16 : 8;
+            uint64_t offset = (locals + a - 1) & ~(a - 1);
+            if (offset + bytes > JIT_STATIC_LOCALS) continue;
+            locals = offset + (bytes ? bytes : 1);
+            e->local[r->id] = (int64_t)offset;
+        }
+        if (phis > max_phis) max_phis = phis;
+    }
+    e->scratch = func->param_count + temps;
+    uint64_t slots = (uint64_t)e->scratch + max_phis;
+    uint64_t frame = (slots * 8 + ((locals + 15) & ~(uint64_t)15) + 15) & ~(uint64_t)15;
+    if (frame > INT32_MAX / 2) return false;
+    e->frame = (uint32_t)frame;
+    return true;
+}
+
+/*
+ * Count the call and, on the one that reaches the threshold, have
+ * jit_tier_up replace the function, then continue in the new code with
+ * the arguments as they came.
+ */
+static void emit_tier_up_check(Emitter *e) {
+    Jit *jit = e->jit;
+    mov_imm(e, R11, (uint64_t)(uintptr_t)&jit->calls[e->index]);
+    inst_rm(e, 0, true, 0xFF, 0, R11, 0);               /* inc qword [r11] */
+    inst_rm(e, 0, true, 0x81, 7, R11, 0);               /* cmp qword [r11], threshold */
+    put32(e, jit->opts.tier_up_calls);
+    uint32_t body = jump(e, CC_NE);
+    push(e, RBP);
+    mov_rr(e, RBP, RSP);
+    for (int i = 0; i < 6; i++) push(e, int_arg_regs[i]);
+    rsp_adjust(e, -64);
+    for (int i = 0; i < 8; i++) inst_rm(e, 0xF2, false, 0x0F11, i, RSP, i * 8);
+    mov_imm(e, RDI, (uint64_t)(uintptr_t)jit);
+    mov_imm(e, RSI, e->index);
+    call_address(e, FN(jit_tier_up));
+    for (int i = 0; i < 8; i++) inst_rm(e, 0xF2, false, 0x0F10, i, RSP, i * 8);
+    rsp_adjust(e, 64);
+    for (int i = 6; i-- > 0; ) pop(e, int_arg_regs[i]);
+    pop(e, RBP);
+    mov_imm(e, R11, (uint64_t)(uintptr_t)&jit->table[e->index]);
+    inst_rm(e, 0, false, 0xFF, 4, R11, 0);              /* jmp [r11] */
+    bind(e, body);
+}
+
+static void emit_prologue(Emitter *e) {
+    const IrFunction *func = e->func;
+    push(e, RBP);
+    mov_rr(e, RBP, RSP);
+    if (e->frame >= JIT_GUARD_BYTES / 2) {
+        inst_rm(e, 0, true, 0x8D, RAX, RSP, -(int32_t)e->frame);
+        emit_stack_check(e, RAX);
+    }
+    rsp_adjust(e, -(int32_t)e->frame);
+    ArgPlace *places = malloc((func->param_count ? func->param_count : 1) * sizeof(ArgPlace));
+    if (!places) {
+        e->oom = true;
+        return;
+    }
+    place_params(func, places);
+    for (uint32_t i = 0; i < func->param_count; i++) {
+        if (places[i].reg < 0) {
+            inst_rm(e, 0, true, 0x8B, RAX, RBP, 16 + (int32_t)places[i].stack * 8);
+            store_slot(e, RAX, i);
+        } else if (places[i].real) {
+            inst_rm(e, 0xF2, false, 0x0F11, places[i].reg, RBP, slot_disp(i));  /* movsd */
+        } else {
+            store_slot(e, places[i].reg, i);
+        }
+    }
+    free(places);
+}
+
+static void emit_function(Emitter *e, bool count_calls) {
+    const IrFunction *func = e->func;
+    if (count_calls) emit_tier_up_check(e);
+    emit_prologue(e);
+    if (func->block_count && func->entry_block && func->all_blocks[0] != func->entry_block)
+        jump_block(e, CC_ALWAYS, func->entry_block);
+    for (uint32_t b = 0; b < func->block_count && !e->oom; b++) {
+        const IrBasicBlock *bb = func->all_blocks[b];
+        const IrBasicBlock *next = b + 1 < func->block_count ? func->all_blocks[b + 1] : NULL;
+        if (bb->align > 1 && bb->align <= JIT_CODE_OFFSET) emit_padding(e, bb->align);
+        if (bb->id < func->next_block_id) e->block_at[bb->id] = e->len;
+        for (const IrInstruction *inst = bb->first_inst; inst; inst = inst->next) {
+            e->pos = (uint32_t)inst->line << 16 | inst->column;
+            emit_instruction(e, inst, next);
+        }
+        if (!ir__block_terminator(bb)) emit_return(e, NULL);
+    }
+    if (!func->block_count) emit_return(e, NULL);
+}
+
+static bool resolve_fixups(Emitter *e) {
+    for (uint32_t i = 0; i < e->fixup_count; i++) {
+        uint32_t id = e->fixups[i].block->id;
+        if (id >= e->func->next_block_id || e->block_at[id] == UINT32_MAX) return false;
+        patch_rel32(e, e->fixups[i].at, e->block_at[id]);
+    }
+    return true;
+}
+
+/* Copy code into pages of its own and make them executable. */
+static void *install(Jit *jit, const uint8_t *code, size_t len) {
+    size_t size = (JIT_CODE_OFFSET + len + jit->page - 1) & ~(jit->page - 1);
+    uint8_t *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return NULL;
+    JitChunk *chunk = (JitChunk *)(void *)mem;
+    chunk->next = jit->chunks;
+    chunk->size = size;
+    memcpy(mem + JIT_CODE_OFFSET, code, len);
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        return NULL;
+    }
+    jit->chunks = chunk;
+    jit->stats.code_bytes += len;
+    return mem + JIT_CODE_OFFSET;
+}
+
+static void *compile_function(Jit *jit, uint32_t index, bool count_calls) {
+    const IrFunction *func = jit->mod->functions[index];
+    Emitter e = { .jit = jit, .func = func, .index = index, .returns_real = lower__returns_real(func) };
+    void *code = NULL;
+    if (lower__function_init(&e.lf, &jit->lm, func) && plan_frame(&e)) {
+        emit_function(&e, count_calls);
+        if (!e.oom && resolve_fixups(&e)) code = install(jit, e.code, e.len);
+    }
+    lower__function_fini(&e.lf);
+    free(e.local);
+    free(e.block_at);
+    free(e.fixups);
+    free(e.code);
+    return code;
+}
+
+/* ------------------------------------------------------------------ running */
+
+/* Both return registers of main: rax and the bits of xmm0. */
+typedef struct {
+    uint64_t i, r;
+} JitResult;
+
+typedef JitResult (*JitEnter)(void *entry, void *stack_top);
+
+/* Switch to the program's stack and call entry with every argument
+ * register zeroed. */
+static JitEnter build_enter(Jit *jit) {
+    Emitter e = { .jit = jit };
+    push(&e, RBP);
+    mov_rr(&e, RBP, RSP);
+    mov_rr(&e, RAX, RDI);
+    mov_rr(&e, RSP, RSI);
+    for (int i = 0; i < 6; i++) mov_imm(&e, int_arg_regs[i], 0);
+    for (int i = 0; i < 8; i++) inst_rr(&e, 0, false, 0x0F57, i, i);    /* xorps */
+    inst_rr(&e, 0, false, 0xFF, 2, RAX);
+    xmm_to_gpr(&e, RDX, XMM0);
+    put8(&e, 0xC9);
+    put8(&e, 0xC3);
+    void *code = e.oom ? NULL : install(jit, e.code, e.len);
+    free(e.code);
+    JitEnter enter = NULL;
+    if (code) memcpy(&enter, &code, sizeof enter);
+    return enter;
+}
+
+static void on_fault(int sig, siginfo_t *info, void *context) {
+    (void)context;
+    Jit *jit = running;
+    if (!jit) {
+        signal(sig, SIG_DFL);
+        raise(sig);
+        return;
+    }
+    uintptr_t addr = (uintptr_t)info->si_addr;
+    jit->fault_addr = addr;
+    bool overflow = addr >= (uintptr_t)jit->stack && addr < jit->stack_limit;
+    siglongjmp(jit->escape, overflow ? JIT_OVERFLOWED : JIT_FAULTED);
+}
+
+static void jit_destroy(Jit *jit) {
+    if (!jit) return;
+    for (JitChunk *c = jit->chunks, *next; c; c = next) {
+        next = c->next;
+        munmap(c, c->size);
+    }
+    if (jit->stack) munmap(jit->stack, jit->stack_size);
+    lower__module_fini(&jit->lm);
+    free(jit->table);
+    free(jit->calls);
+    free(jit->counters);
+    free(jit);
+}
+
+static Jit *jit_create(IrModule *mod, const JitOptions *opts) {
+    Jit *jit = calloc(1, sizeof(Jit));
+    if (!jit) goto fail;
+    jit->mod = mod;
+    if (opts) jit->opts = *opts;
+    if (jit->opts.tier_up_calls > INT32_MAX) jit->opts.tier_up_calls = INT32_MAX;
+    if (jit->opts.passes) jit->passes = *jit->opts.passes;
+    else irpass__default_options(&jit->passes);
+    jit->services = interp__services(jit->opts.target_arch);
+    jit->page = (size_t)sysconf(_SC_PAGESIZE);
+    uint32_t n = mod->func_count;
+    jit->table = calloc(n ? n : 1, sizeof(void *));
+    jit->calls = calloc(n ? n : 1, sizeof(uint64_t));
+    if (!jit->table || !jit->calls || !lower__module_init(&jit->lm, mod)) goto fail;
+    if (mod->profile) {
+        jit->counters = calloc(mod->profile->counter_count ? mod->profile->counter_count : 1, sizeof(uint64_t));
+        if (!jit->counters) goto fail;
+    }
+    jit->stack_size = JIT_STACK_BYTES + JIT_GUARD_BYTES;
+    void *stack = mmap(NULL, jit->stack_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stack == MAP_FAILED) goto fail;
+    jit->stack = stack;
+    if (mprotect(jit->stack, JIT_GUARD_BYTES, PROT_NONE) != 0) goto fail;
+    jit->stack_limit = (uintptr_t)jit->stack + JIT_GUARD_BYTES;
+    return jit;
+fail:
+    errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "jit", "Failed to allocate the JIT");
+    jit_destroy(jit);
+    return NULL;
+}
+
+/* Run main on the program's stack; the exit status, or -1 once reported. */
+static int run(Jit *jit, JitEnter enter, uint32_t entry) {
+    stack_t alt = { 0 }, old_alt;
+    alt.ss_sp = malloc(JIT_SIGNAL_STACK);
+    alt.ss_size = JIT_SIGNAL_STACK;
+    bool alt_set = alt.ss_sp && sigaltstack(&alt, &old_alt) == 0;
+    struct sigaction sa, old_segv, old_bus;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_sigaction = on_fault;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigaction(SIGSEGV, &sa, &old_segv);
+    sigaction(SIGBUS, &sa, &old_bus);
+    volatile int status = -1;
+    bool returns_real = lower__returns_real(jit->mod->functions[entry]);
+    /* A few zeroed slots above the first frame, for stack parameters. */
+    void *top = jit->stack + jit->stack_size - 64;
+    running = jit;
+    switch (sigsetjmp(jit->escape, 1)) {
+        case JIT_RETURNED: {
+            JitResult r = enter(jit->table[entry], top);
+            int64_t v = returns_real ? (int64_t)bits_real(r.r) : (int64_t)r.i;
+            status = (int)(v & 0xFF);
+            break;
+        }
+        case JIT_EXITED:
+            status = (int)(jit->exit_status & 0xFF);
+            break;
+        case JIT_OVERFLOWED:
+            errhandler__report_error(ERROR_CODE_RUNTIME_STACK_OVERFLOW, 0, 0, "jit", "Stack overflow");
+            break;
+        case JIT_FAULTED:
+            errhandler__report_error(ERROR_CODE_RUNTIME_OUT_OF_BOUNDS, 0, 0, "jit",
+                                     "Invalid memory access at 0x%llx", (unsigned long long)jit->fault_addr);
+            break;
+        default:
+            break;
+    }
+    running = NULL;
+    sigaction(SIGSEGV, &old_segv, NULL);
+    sigaction(SIGBUS, &old_bus, NULL);
+    if (alt_set) sigaltstack(&old_alt, NULL);
+    free(alt.ss_sp);
+    return status;
+}
+
+int jit__run_main(IrModule *mod, const JitOptions *opts, JitStats *stats) {
+    if (stats) memset(stats, 0, sizeof *stats);
+    uint32_t entry = UINT32_MAX;
+    for (uint32_t i = 0; i < mod->func_count && entry == UINT32_MAX; i++)
+        if (strcmp(mod->functions[i]->name, "main") == 0) entry = i;
+    if (entry == UINT32_MAX) {
+        errhandler__report_error(ERROR_CODE_RUNTIME_NO_ENTRY, 0, 0, "jit", "No 'main' function to run");
+        return -1;
+    }
+    Jit *jit = jit_create(mod, opts);
+    if (!jit) return -1;
+    struct timespec start;
+    timespec_get(&start, TIME_UTC);
+    bool count_calls = jit->opts.tier_up_calls > 0;
+    bool ok = true;
+    for (uint32_t i = 0; i < mod->func_count && ok; i++) {
+        jit->table[i] = compile_function(jit, i, count_calls);
+        if (!jit->table[i]) {
+            errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "jit",
+                                     "Failed to compile function '%s'", mod->functions[i]->name);
+            ok = false;
+        }
+    }
+    JitEnter enter = ok ? build_enter(jit) : NULL;
+    if (ok && !enter) {
+        errhandler__report_error(ERROR_CODE_IR_MEMORY_ALLOCATION, 0, 0, "jit", "Failed to map code memory");
+        ok = false;
+    }
+    jit->stats.functions = mod->func_count;
+    jit->stats.compile_ms = elapsed_ms(&start);
+    int status = -1;
+    if (ok) {
+        timespec_get(&start, TIME_UTC);
+        status = run(jit, enter, entry);
+        jit->stats.run_ms = elapsed_ms(&start);
+        fflush(stdout);
+    }
+    if (stats) *stats = jit->stats;
+    jit_destroy(jit);
+    return status;
+}
+
+#else
+
+int jit__run_main(IrModule *mod, const JitOptions *opts, JitStats *stats) {
+    (void)mod;
+    (void)opts;
+    if (stats) memset(stats, 0, sizeof *stats);
+    errhandler__report_error(ERROR_CODE_RUNTIME_NO_JIT, 0, 0, "jit",
+                             "-jit needs an x86-64 host; use -run to interpret the program");
+    return -1;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../ir/ir.h"
+#include "../ir/irpass/irpass.h"
+
+/*
+ * In-memory x86-64 JIT, for -jit.  Every function of the module is
+ * translated at start-up by a single-pass baseline compiler: each
+ * parameter and temp lives in an 8-byte slot of the native frame, and each
+ * instruction loads its operands into scratch registers, computes and
+ * stores the result back.  Functions follow the System V calling
+ * convention, so they call each other and the runtime shims (allocation,
+ * memset/memcpy, `signal`, profile dumps) as plain native calls.
+ *
+ * Calls between functions go through an entry table.  A baseline function
+ * counts its calls, and the call that reaches the threshold first runs the
+ * function-level IR pipeline over it, recompiles the optimised IR and
+ * points its entry at the new code, where that call and every later one
+ * continue; activations already running keep their baseline code.
+ *
+ * Code is written to a buffer, then copied into pages mapped writable and
+ * turned read-execute before they run.  The program runs on a stack of its
+ * own with a guard page; overflowing it, a division by zero and calls the
+ * module cannot resolve are reported like the interpreter reports them.
+ * Only x86-64 hosts are supported; elsewhere jit__run_main reports an
+ * error.
+ */
+
+/* Calls to a baseline function before it is recompiled. */
+#define JIT_DEFAULT_TIER_UP_CALLS 1000
+
+typedef struct {
+    const char          *target_arch;   /* service numbering for signal, NULL for the host */
+    uint32_t             tier_up_calls; /* 0 never recompiles */
+    const IrPassOptions *passes;        /* pipeline of the optimising tier, NULL for the default */
+} JitOptions;
+
+typedef struct {
+    double   compile_ms;                /* baseline compilation of the module */
+    double   run_ms;                    /* running main, recompilation included */
+    uint32_t functions;
+    uint32_t recompiled;                /* functions that reached the optimising tier */
+    size_t   code_bytes;                /* machine code of both tiers */
+} JitStats;
+
+/* Compile mod, run main and return the program's exit status, or -1 after
+ * reporting why it could not run to the end.  stats may be NULL. */
+int jit__run_main(IrModule *mod, const JitOptions *opts, JitStats *stats);
+
+#endif
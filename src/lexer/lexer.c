@@ -303,7 +303,7 @@ static void add_token_to_lexer(Lexer* lexer, TokenType token_type,
     
     /* Resize token array if necessary */
     if (lexer->token_count >= lexer->token_capacity) {
-        const uint16_t new_capacity = MIN(lexer->token_capacity * 2, UINT16_MAX);
+        const uint32_t new_capacity = MIN((uint64_t)lexer->token_capacity * 2, UINT32_MAX);
         
         if (new_capacity <= lexer->token_capacity) {
             errhandler__report_error(
@@ -423,7 +423,7 @@ void lexer__free_lexer(Lexer* lexer) {
     if (is_null(lexer)) return;
     
     if (!is_null(lexer->tokens)) {
-        for (uint16_t i = 0; i < lexer->token_count; i++) {
+        for (uint64_t i = 0; i < lexer->token_count; i++) {
             memory_free_safe((void**)&lexer->tokens[i].value);
         }
         memory_free_safe((void**)&lexer->tokens);
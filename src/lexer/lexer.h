@@ -141,7 +141,7 @@ typedef struct {
     uint16_t column;        /**< Current column number (for error reporting) */
     Token* tokens;          /**< Dynamically allocated array of tokens */
     uint64_t token_count;   /**< Number of tokens currently stored */
-    uint16_t token_capacity;/**< Allocated capacity of the tokens array */
+    uint32_t token_capacity;/**< Allocated capacity of the tokens array */
 } Lexer;
 
 /**
@@ -1,39 +1,46 @@
+#define _DEFAULT_SOURCE
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
-
-/* Maximum number of input object files the linker can handle at once. */
-#define MAX_OBJECTS 256
-
-/* Maximum number of sections per object file. */
-#define MAX_SECTIONS 16
-
-/* Maximum number of symbols per object file. */
-#define MAX_SYMBOLS 1024
-
-/* Maximum number of relocations per section. */
-#define MAX_RELOCS 4096
-
-/*
- * Enumeration of supported executable formats.
- */
-typedef enum {
-    FORMAT_ELF,    /* Executable and Linking Format (Linux, BSD, etc.) */
-    FORMAT_PE,     /* Portable Executable (Windows .exe) */
-    FORMAT_MACHO   /* Mach-O (macOS, iOS) */
-} OutputFormat;
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../utils/arena.h"
+#include "../utils/scheduler.h"
+#include "linker.h"
+
+/* Section index of a symbol that is undefined, absolute, or defined in a
+ * section the linker does not load. */
+#define SECTION_NONE UINT32_MAX
 
 /*
  * Representation of a section inside an object file.
  * Each section holds raw data and metadata needed for linking.
  */
-typedef struct {
-    char name[32];              /* Section name, e.g. ".text", ".data" */
-    uint8_t *data;              /* Raw contents of the section */
-    size_t size;                /* Size of the data in bytes */
-    size_t offset_in_output;    /* Final offset after layout (set during linking) */
+typedef struct Section {
+    const char *name;           /* Section name, e.g. ".text", ".data" */
+    uint8_t *data;              /* Raw contents of the section; input sections
+                                   of a mapped object point into the mapping,
+                                   NULL for .bss */
+    uint64_t size;              /* Size of the data in bytes */
+    uint64_t offset_in_output;  /* Final offset after layout (set during linking) */
+    uint64_t file_offset;       /* Offset of a merged section in the output image */
+    uint64_t align;             /* Required alignment, a power of two; of a
+                                   merged section, the largest of its inputs */
     uint32_t flags;             /* Section attributes: read/write/execute */
+    int output_index;           /* Merged section holding it, -1 if discarded */
+    int is_live;                /* In the output: all are, unless --gc-sections drops it */
+    int first_reloc;            /* Relocations of an input section: a run of */
+    int num_relocs;             /* its object's table */
+    int is_address_taken;       /* Referenced other than by a call or jump */
+    int icf_class;              /* Class of identical sections under --icf, -1 if
+                                   not a candidate for folding */
+    const struct Section *folded_into; /* Identical section kept in its place
+                                   by --icf, or NULL */
 } Section;
 
 /*
@@ -41,12 +48,15 @@ typedef struct {
  * different object files and between the program and libraries.
  */
 typedef struct {
-    char name[64];              /* Symbol name */
+    const char *name;           /* Symbol name, in the object's string table */
     uint32_t section_index;     /* Index of the section this symbol belongs to,
-                                   or special value for undefined/absolute */
-    size_t value;               /* Offset within the section or absolute address */
+                                   or SECTION_NONE for undefined/absolute */
+    uint64_t value;             /* Offset within the section or absolute address */
     int is_defined;             /* 1 if the symbol provides a definition, 0 if undefined */
     int is_global;              /* 1 if the symbol is visible to other object files */
+    int is_weak;                /* 1 if another definition may override it */
+    int global;                 /* Entry of a global symbol in the linker's
+                                   symbol table, -1 for a local one */
 } Symbol;
 
 /*
@@ -55,7 +65,7 @@ typedef struct {
  */
 typedef struct {
     uint32_t section_index;     /* Index of the section containing the reference */
-    size_t offset;              /* Byte offset within the section where the fixup is applied */
+    uint64_t offset;            /* Byte offset within the section where the fixup is applied */
     uint32_t symbol_index;      /* Index of the symbol this relocation refers to */
     int type;                   /* Relocation type (architecture-specific) */
     int64_t addend;             /* Constant addend used in the relocation formula */
@@ -63,71 +73,94 @@ typedef struct {
 
 /*
  * Internal representation of one input object file (.o).
- * The linker fills this structure by parsing the raw file.
+ * The linker fills this structure by parsing the raw file. Its tables
+ * are sized from the file's headers and allocated from the linker's
+ * arena.
  */
-typedef struct {
-    char filename[256];         /* Original file name (for diagnostics) */
-    Section sections[MAX_SECTIONS];
+typedef struct ObjectFile {
+    const char *filename;       /* Original file name (for diagnostics) */
+    uint8_t *map;               /* The file mapped read-only, or NULL */
+    size_t map_size;
+    uint16_t machine;           /* e_machine of an ELF object */
+    Section *sections;
     int num_sections;
-    Symbol symbols[MAX_SYMBOLS];
+    Symbol *symbols;
     int num_symbols;
-    Relocation relocs[MAX_RELOCS];
+    Relocation *relocs;
     int num_relocs;
 } ObjectFile;
 
 /*
- * The central linker context. It holds all input files, the merged
- * output image and configuration parameters.
+ * A slot of an open-addressing table keyed by name. The hash is computed
+ * once, when the name is inserted, and compared before the name itself.
  */
-typedef struct {
-    ObjectFile objects[MAX_OBJECTS];
-    int num_objects;
-
-    OutputFormat output_format; /* Target executable format chosen by the user */
-
-    char entry_symbol[64];      /* Name of the entry point (e.g. "_start") */
-    size_t entry_address;       /* Final virtual address of the entry point (set during link) */
+typedef struct NameSlot {
+    const char *name;           /* NULL for an empty slot */
+    uint64_t hash;
+    int index;                  /* Entry the name stands for */
+} NameSlot;
 
-    /* Merged section table after symbol resolution and layout. */
-    Section merged_sections[MAX_SECTIONS];
-    int num_merged_sections;
-
-    /* Output buffer containing the final executable image. */
-    uint8_t *output_data;
-    size_t output_size;
-} Linker;
-
-static int parse_elf_object(const char *filename, ObjectFile *obj);
-static int parse_pe_object(const char *filename, ObjectFile *obj);
-static int parse_macho_object(const char *filename, ObjectFile *obj);
+/*
+ * A global name of the link and the definition it resolves to. The name
+ * is interned: every symbol of that name, in every object, points to
+ * this one copy.
+ */
+typedef struct GlobalSymbol {
+    const char *name;
+    int def_obj, def_sym;       /* Defining object and symbol, -1 if none */
+    int ref_obj;                /* First object referencing it, -1 if none */
+} GlobalSymbol;
+
+static int parse_elf_object(UArena *arena, const char *filename, ObjectFile *obj);
+static int parse_pe_object(UArena *arena, const char *filename, ObjectFile *obj);
+static int parse_macho_object(UArena *arena, const char *filename, ObjectFile *obj);
 static int resolve_symbols(Linker *linker);
+static void mark_all_live(Linker *linker);
+static int collect_sections(Linker *linker);
+static int fold_sections(Linker *linker);
 static int merge_sections(Linker *linker);
-static int perform_relocations(Linker *linker);
+static int write_sections(Linker *linker);
 static int layout_sections(Linker *linker);
 static int generate_elf_output(Linker *linker);
 static int generate_pe_output(Linker *linker);
 static int generate_macho_output(Linker *linker);
-static void linker_error(const char *msg);
+static void linker_error(const char *fmt, ...);
 
 /*
  * Initialize a new linker session. All fields are set to safe defaults.
- * The caller must call linker_destroy() when done.
+ * The caller must call linker__destroy() when done.
  */
-void linker_init(Linker *linker) {
+void linker__init(Linker *linker) {
     memset(linker, 0, sizeof(*linker));
     linker->output_format = FORMAT_ELF;   /* default format */
     linker->entry_address = 0;
 }
 
+/*
+ * Make room for one more element of a vector that doubles as it grows.
+ * Returns 0 on success, -1 when out of memory.
+ */
+static int reserve(void **items, int *capacity, int count, size_t item_size) {
+    if (count < *capacity) return 0;
+    if (*capacity > INT32_MAX / 2) return -1;
+    int cap = *capacity ? *capacity * 2 : 16;
+    void *grown = realloc(*items, (size_t)cap * item_size);
+    if (!grown) return -1;
+    *items = grown;
+    *capacity = cap;
+    return 0;
+}
+
 /*
  * Add an object file to the linker's internal list. The file is parsed
  * according to its format (ELF, COFF/PE object, Mach-O object) and all
  * sections, symbols and relocations are extracted into the ObjectFile
  * structure.
  */
-int linker_add_object(Linker *linker, const char *filename) {
-    if (linker->num_objects >= MAX_OBJECTS) {
-        linker_error("Too many object files");
+int linker__add_object(Linker *linker, const char *filename) {
+    if (reserve((void **)&linker->objects, &linker->objects_capacity,
+                linker->num_objects, sizeof(ObjectFile)) != 0) {
+        linker_error("Out of memory adding object file");
         return -1;
     }
 
@@ -143,11 +176,11 @@ int linker_add_object(Linker *linker, const char *filename) {
 
     int rc = -1;
     if (strcmp(ext, ".o") == 0 || strcmp(ext, ".elf") == 0) {
-        rc = parse_elf_object(filename, obj);
+        rc = parse_elf_object(&linker->arena, filename, obj);
     } else if (strcmp(ext, ".obj") == 0) {
-        rc = parse_pe_object(filename, obj);
+        rc = parse_pe_object(&linker->arena, filename, obj);
     } else if (strcmp(ext, ".macho") == 0) {
-        rc = parse_macho_object(filename, obj);
+        rc = parse_macho_object(&linker->arena, filename, obj);
     } else {
         linker_error("Unsupported object file format");
         return -1;
@@ -158,17 +191,21 @@ int linker_add_object(Linker *linker, const char *filename) {
         return -1;
     }
 
-    strncpy(obj->filename, filename, sizeof(obj->filename) - 1);
-    obj->filename[sizeof(obj->filename) - 1] = '\0';
+    obj->filename = u__arena_strdup(&linker->arena, filename);
+    if (!obj->filename) {
+        if (obj->map) munmap(obj->map, obj->map_size);
+        linker_error("Out of memory adding object file");
+        return -1;
+    }
     linker->num_objects++;
     return 0;
 }
 
 /*
  * Choose the output executable format.
- * Must be called before linker_link().
+ * Must be called before linker__link().
  */
-void linker_set_output_format(Linker *linker, OutputFormat fmt) {
+void linker__set_output_format(Linker *linker, OutputFormat fmt) {
     linker->output_format = fmt;
 }
 
@@ -177,21 +214,57 @@ void linker_set_output_format(Linker *linker, OutputFormat fmt) {
  * The linker will look for this symbol during resolution and record its
  * final address.
  */
-void linker_set_entry(Linker *linker, const char *symbol_name) {
-    strncpy(linker->entry_symbol, symbol_name, sizeof(linker->entry_symbol) - 1);
-    linker->entry_symbol[sizeof(linker->entry_symbol) - 1] = '\0';
+void linker__set_entry(Linker *linker, const char *symbol_name) {
+    linker->entry_symbol = symbol_name && symbol_name[0] ? u__arena_strdup(&linker->arena, symbol_name) : NULL;
+}
+
+/*
+ * Enable or disable garbage collection of unreferenced sections.
+ * Needs an entry symbol; objects built with -ffunction-sections give it
+ * one section per function to drop.
+ */
+void linker__set_gc_sections(Linker *linker, int enable) {
+    linker->gc_sections = enable;
+}
+
+/*
+ * Select identical code folding: ICF_SAFE folds functions whose address
+ * is never taken, ICF_ALL any identical read-only sections.
+ */
+void linker__set_icf(Linker *linker, IcfMode mode) {
+    linker->icf = mode;
+}
+
+/*
+ * Link straight into a file: the output image is a shared mapping of
+ * outpath, so sections are copied and relocated in place and
+ * linker__write_to_file() to the same path only flushes it.
+ */
+void linker__set_output_file(Linker *linker, const char *outpath) {
+    linker->output_path = outpath && outpath[0] ? u__arena_strdup(&linker->arena, outpath) : NULL;
+}
+
+/*
+ * Number of threads copying sections into the output and applying their
+ * relocations (-threads N); 0, the default, uses one per processor.
+ */
+void linker__set_threads(Linker *linker, uint32_t threads) {
+    linker->threads = threads;
 }
 
 /*
  * Main linking procedure:
  *   1. Global symbol resolution across all object files.
+ *   1b. With --gc-sections, discard sections unreachable from the entry.
+ *   1c. With --icf, fold identical sections into one.
  *   2. Section merging (combine sections with the same name from different files).
  *   3. Layout: assign final virtual addresses to every byte in every section.
- *   4. Relocation: apply all fixups using the final addresses.
- *   5. Generate the output image according to the chosen format.
+ *   4. Map the output image in the chosen format and write its headers.
+ *   5. Copy every input section into the image and apply its fixups
+ *      using the final addresses, on a pool of threads.
  * Returns 0 on success, -1 on error.
  */
-int linker_link(Linker *linker) {
+int linker__link(Linker *linker) {
     if (linker->num_objects == 0) {
         linker_error("No object files provided");
         return -1;
@@ -203,6 +276,18 @@ int linker_link(Linker *linker) {
         return -1;
     }
 
+    if (!linker->gc_sections) {
+        mark_all_live(linker);
+    } else if (collect_sections(linker) != 0) {
+        linker_error("Section garbage collection failed");
+        return -1;
+    }
+
+    if (linker->icf != ICF_NONE && fold_sections(linker) != 0) {
+        linker_error("Identical code folding failed");
+        return -1;
+    }
+
     /* Phase 2: merge sections from all objects into a unified set. */
     if (merge_sections(linker) != 0) {
         linker_error("Section merging failed");
@@ -215,44 +300,65 @@ int linker_link(Linker *linker) {
         return -1;
     }
 
-    /* Phase 4: apply relocations, patching section contents with final addresses. */
-    if (perform_relocations(linker) != 0) {
-        linker_error("Relocation failed");
-        return -1;
-    }
-
-    /* Phase 5: create the final executable image in the requested format. */
+    /* Phase 4: create the executable image in the requested format. */
+    int rc;
     switch (linker->output_format) {
         case FORMAT_ELF:
-            return generate_elf_output(linker);
+            rc = generate_elf_output(linker);
+            break;
         case FORMAT_PE:
-            return generate_pe_output(linker);
+            rc = generate_pe_output(linker);
+            break;
         case FORMAT_MACHO:
-            return generate_macho_output(linker);
+            rc = generate_macho_output(linker);
+            break;
         default:
             linker_error("Unknown output format");
             return -1;
     }
+    if (rc != 0) return -1;
+
+    /* Phase 5: fill it with the sections, patched with final addresses. */
+    if (write_sections(linker) != 0) {
+        linker_error("Relocation failed");
+        return -1;
+    }
+    return 0;
 }
 
 /*
  * Write the generated executable image to a file.
- * The file is created/truncated and the entire output data is written.
+ * The file is created/truncated, executable, and the entire output data
+ * is written, unless the image already is a mapping of that file.
  */
-int linker_write_to_file(Linker *linker, const char *outpath) {
+int linker__write_to_file(Linker *linker, const char *outpath) {
     if (linker->output_data == NULL || linker->output_size == 0) {
-        linker_error("No output data to write; call linker_link() first");
+        linker_error("No output data to write; call linker__link() first");
         return -1;
     }
 
-    FILE *fp = fopen(outpath, "wb");
-    if (!fp) {
+    if (linker->output_path && strcmp(outpath, linker->output_path) == 0) {
+        if (msync(linker->output_data, linker->output_size, MS_SYNC) != 0) {
+            linker_error("Failed to write complete output file");
+            return -1;
+        }
+        return 0;
+    }
+
+    /* Created executable, as when the image is a mapping of the file. */
+    int fd = open(outpath, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+    if (fd < 0) {
         linker_error("Cannot open output file for writing");
         return -1;
     }
 
-    size_t written = fwrite(linker->output_data, 1, linker->output_size, fp);
-    fclose(fp);
+    size_t written = 0;
+    while (written < linker->output_size) {
+        ssize_t n = write(fd, linker->output_data + written, linker->output_size - written);
+        if (n <= 0) break;
+        written += (size_t)n;
+    }
+    close(fd);
 
     if (written != linker->output_size) {
         linker_error("Failed to write complete output file");
@@ -265,56 +371,333 @@ int linker_write_to_file(Linker *linker, const char *outpath) {
 /*
  * Free all resources allocated during the link process.
  */
-void linker_destroy(Linker *linker) {
+void linker__destroy(Linker *linker) {
     for (int i = 0; i < linker->num_objects; i++) {
         ObjectFile *obj = &linker->objects[i];
-        for (int j = 0; j < obj->num_sections; j++) {
-            free(obj->sections[j].data);
-        }
+        if (obj->map) munmap(obj->map, obj->map_size);
     }
-    free(linker->output_data);
+    free(linker->objects);
+    free(linker->symbol_table.slots);
+    free(linker->globals);
+    free(linker->merged_sections);
+    free(linker->section_table.slots);
+    u__arena_release(&linker->arena);
+    if (linker->output_data) munmap(linker->output_data, linker->output_size);
     memset(linker, 0, sizeof(*linker));
 }
 
+/* ELF constants used by the object reader */
+#define ELF_CLASS64       2
+#define ELF_DATA2LSB      1
+#define ELF_ET_REL        1
+#define ELF_ET_EXEC       2
+#define ELF_EM_X86_64     62
+#define ELF_EM_AARCH64    183
+#define ELF_EHDR64_SIZE   64
+#define ELF_SHDR64_SIZE   64
+#define ELF_PHDR64_SIZE   56
+#define ELF_PT_LOAD       1
+#define ELF_PF_X          0x1
+#define ELF_PF_W          0x2
+#define ELF_PF_R          0x4
+#define ELF_SYM64_SIZE    24
+#define ELF_RELA64_SIZE   24
+#define ELF_SHT_SYMTAB    2
+#define ELF_SHT_RELA      4
+#define ELF_SHT_NOBITS    8
+#define ELF_SHT_REL       9
+#define ELF_SHF_WRITE     0x1
+#define ELF_SHF_ALLOC     0x2
+#define ELF_SHF_EXECINSTR 0x4
+#define ELF_SHN_UNDEF     0
+#define ELF_SHN_LORESERVE 0xFF00
+#define ELF_SHN_ABS       0xFFF1
+#define ELF_STB_LOCAL     0
+#define ELF_STB_WEAK      2
+
+/* Relocation types the linker applies */
+#define ELF_R_X86_64_NONE               0
+#define ELF_R_X86_64_64                 1
+#define ELF_R_X86_64_PC32               2
+#define ELF_R_X86_64_PLT32              4
+#define ELF_R_X86_64_GOTPCREL           9
+#define ELF_R_X86_64_32                 10
+#define ELF_R_X86_64_32S                11
+#define ELF_R_X86_64_GOTPCRELX          41
+#define ELF_R_X86_64_REX_GOTPCRELX      42
+#define ELF_R_AARCH64_NONE              0
+#define ELF_R_AARCH64_ADR_PREL_PG_HI21  275
+#define ELF_R_AARCH64_ADD_ABS_LO12_NC   277
+#define ELF_R_AARCH64_JUMP26            282
+#define ELF_R_AARCH64_CALL26            283
+
+/* Little-endian fields of the mapped file, which need not be aligned */
+static uint16_t rd16(const uint8_t *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t rd64(const uint8_t *p) {
+    return (uint64_t)rd32(p) | (uint64_t)rd32(p + 4) << 32;
+}
+
+/* A section header of the mapped file */
+typedef struct {
+    uint32_t name, type, link, info;
+    uint64_t flags, offset, size, addralign, entsize;
+} ElfSection;
+
+static ElfSection elf_section(const uint8_t *map, uint64_t shoff, uint32_t index) {
+    const uint8_t *h = map + shoff + (uint64_t)index * ELF_SHDR64_SIZE;
+    ElfSection sh;
+    sh.name = rd32(h);
+    sh.type = rd32(h + 4);
+    sh.flags = rd64(h + 8);
+    sh.offset = rd64(h + 24);
+    sh.size = rd64(h + 32);
+    sh.link = rd32(h + 40);
+    sh.info = rd32(h + 44);
+    sh.addralign = rd64(h + 48);
+    sh.entsize = rd64(h + 56);
+    return sh;
+}
+
+/* Whether size bytes at offset lie inside a file of file_size bytes */
+static int in_bounds(uint64_t offset, uint64_t size, uint64_t file_size) {
+    return offset <= file_size && size <= file_size - offset;
+}
+
+/* The null-terminated string at offset of a string table, or NULL */
+static const char *elf_string(const uint8_t *map, const ElfSection *strtab, uint32_t offset) {
+    if (offset >= strtab->size) return NULL;
+    const char *str = (const char *)map + strtab->offset + offset;
+    return memchr(str, '\0', strtab->size - offset) ? str : NULL;
+}
+
 /*
- * Parse an ELF object file. In a full implementation this would read
- * ELF header, section headers, symbol table and relocation tables.
- * Here it is a stub that always succeeds with empty content.
+ * Read the sections, symbols and relocations of a mapped ELF64
+ * relocatable object into tables sized from its section headers. Section
+ * contents stay in the mapping; symbol names point into its string table. Every offset and index is checked against
+ * the file before use. Returns 0 on success, -1 with a message printed.
  */
-static int parse_elf_object(const char *filename, ObjectFile *obj) {
-    (void)filename;   /* unused in stub */
-    memset(obj, 0, sizeof(*obj));
-    /* Example: create a dummy .text section and a "main" symbol */
-    obj->num_sections = 1;
-    strcpy(obj->sections[0].name, ".text");
-    obj->sections[0].size = 64;
-    obj->sections[0].data = (uint8_t *)calloc(1, 64);
-    obj->sections[0].flags = 0x5; /* read + execute */
+static int read_elf_object(UArena *arena, ObjectFile *obj, const uint8_t *map, uint64_t size) {
+    if (size < ELF_EHDR64_SIZE || memcmp(map, "\x7f" "ELF", 4) != 0) {
+        linker_error("Not an ELF file");
+        return -1;
+    }
+    if (map[4] != ELF_CLASS64 || map[5] != ELF_DATA2LSB) {
+        linker_error("Only little-endian ELF64 objects are supported");
+        return -1;
+    }
+    obj->machine = rd16(map + 18);
+    if (rd16(map + 16) != ELF_ET_REL ||
+        (obj->machine != ELF_EM_X86_64 && obj->machine != ELF_EM_AARCH64)) {
+        linker_error("Not a relocatable x86-64 or AArch64 object");
+        return -1;
+    }
+    uint64_t shoff = rd64(map + 40);
+    uint32_t shnum = rd16(map + 60), shstrndx = rd16(map + 62);
+    if (rd16(map + 58) != ELF_SHDR64_SIZE || shnum == 0 || shnum >= ELF_SHN_LORESERVE ||
+        !in_bounds(shoff, (uint64_t)shnum * ELF_SHDR64_SIZE, size) || shstrndx >= shnum) {
+        linker_error("ELF section header table out of bounds");
+        return -1;
+    }
+    for (uint32_t i = 0; i < shnum; i++) {
+        ElfSection sh = elf_section(map, shoff, i);
+        if (sh.type != ELF_SHT_NOBITS && !in_bounds(sh.offset, sh.size, size)) {
+            linker_error("ELF section contents out of bounds");
+            return -1;
+        }
+    }
+    ElfSection shstrtab = elf_section(map, shoff, shstrndx);
+
+    /* Size the tables: the allocated sections are loaded, with the
+     * relocations against them. */
+    uint32_t nsections = 0;
+    uint64_t nsyms = 0, nrelocs = 0;
+    int32_t symtab = -1;
+    for (uint32_t i = 1; i < shnum; i++) {
+        ElfSection sh = elf_section(map, shoff, i);
+        if (sh.type == ELF_SHT_REL) {
+            linker_error("ELF REL relocations are not supported; expected RELA");
+            return -1;
+        }
+        if (sh.flags & ELF_SHF_ALLOC) nsections++;
+        if (sh.type == ELF_SHT_SYMTAB) {
+            symtab = (int32_t)i;
+            nsyms = sh.size / ELF_SYM64_SIZE;
+        }
+        if (sh.type == ELF_SHT_RELA && sh.info < shnum &&
+            (elf_section(map, shoff, sh.info).flags & ELF_SHF_ALLOC))
+            nrelocs += sh.size / ELF_RELA64_SIZE;
+    }
+    if (nsyms > INT32_MAX || nrelocs > INT32_MAX) {
+        linker_error("Too many symbols or relocations in object file");
+        return -1;
+    }
+    obj->sections = u__arena_alloc(arena, nsections * sizeof(Section));
+    obj->symbols = u__arena_alloc(arena, nsyms * sizeof(Symbol));
+    obj->relocs = u__arena_alloc(arena, nrelocs * sizeof(Relocation));
+    /* loaded[i] is the index of ELF section i among the loaded ones, or -1 */
+    int *loaded = malloc(shnum * sizeof(int));
+    if (!obj->sections || !obj->symbols || !obj->relocs || !loaded) {
+        free(loaded);
+        linker_error("Out of memory reading object file");
+        return -1;
+    }
+    for (uint32_t i = 0; i < shnum; i++) {
+        ElfSection sh = elf_section(map, shoff, i);
+        loaded[i] = -1;
+        if (i == 0 || !(sh.flags & ELF_SHF_ALLOC)) continue;
+        Section *sec = &obj->sections[obj->num_sections];
+        sec->name = elf_string(map, &shstrtab, sh.name);
+        if (!sec->name) {
+            linker_error("ELF section name out of bounds");
+            goto fail;
+        }
+        sec->data = sh.type == ELF_SHT_NOBITS ? NULL : (uint8_t *)map + sh.offset;
+        if (sh.addralign & (sh.addralign - 1)) {
+            linker_error("ELF section alignment is not a power of two");
+            goto fail;
+        }
+        sec->size = sh.size;
+        sec->align = sh.addralign ? sh.addralign : 1;
+        sec->flags = 0x1 | ((sh.flags & ELF_SHF_WRITE) ? 0x2 : 0) | ((sh.flags & ELF_SHF_EXECINSTR) ? 0x4 : 0);
+        loaded[i] = obj->num_sections++;
+    }
+    if (symtab < 0) {           /* nothing to link against */
+        free(loaded);
+        return 0;
+    }
 
-    obj->num_symbols = 1;
-    strcpy(obj->symbols[0].name, "main");
-    obj->symbols[0].section_index = 0; /* .text */
-    obj->symbols[0].value = 0;
-    obj->symbols[0].is_defined = 1;
-    obj->symbols[0].is_global = 1;
+    ElfSection syms = elf_section(map, shoff, (uint32_t)symtab);
+    if (syms.entsize != ELF_SYM64_SIZE || syms.link >= shnum) {
+        linker_error("Malformed ELF symbol table");
+        goto fail;
+    }
+    ElfSection strtab = elf_section(map, shoff, syms.link);
+    /* Symbols keep their ELF indices, so relocations need no remapping. */
+    for (uint64_t i = 0; i < nsyms; i++) {
+        const uint8_t *e = map + syms.offset + i * ELF_SYM64_SIZE;
+        Symbol *sym = &obj->symbols[i];
+        uint8_t bind = e[4] >> 4;
+        uint16_t shndx = rd16(e + 6);
+        sym->name = elf_string(map, &strtab, rd32(e));
+        if (!sym->name) {
+            linker_error("ELF symbol name out of bounds");
+            goto fail;
+        }
+        sym->value = rd64(e + 8);
+        sym->is_global = bind != ELF_STB_LOCAL;
+        sym->is_weak = bind == ELF_STB_WEAK;
+        sym->is_defined = shndx != ELF_SHN_UNDEF && shndx < ELF_SHN_LORESERVE ? 1 : shndx == ELF_SHN_ABS;
+        sym->section_index = SECTION_NONE;
+        if (shndx != ELF_SHN_UNDEF && shndx < ELF_SHN_LORESERVE) {
+            if (shndx >= shnum) {
+                linker_error("ELF symbol section out of bounds");
+                goto fail;
+            }
+            if (loaded[shndx] >= 0) sym->section_index = (uint32_t)loaded[shndx];
+        }
+    }
+    obj->num_symbols = (int)nsyms;
+
+    /* Relocations of the loaded sections, decoded from the .rela tables;
+     * those of a section form one run of the table. */
+    for (uint32_t i = 0; i < shnum; i++) {
+        ElfSection sh = elf_section(map, shoff, i);
+        if (sh.type != ELF_SHT_RELA) continue;
+        if (sh.entsize != ELF_RELA64_SIZE || sh.link != (uint32_t)symtab || sh.info >= shnum) {
+            linker_error("Malformed ELF relocation section");
+            goto fail;
+        }
+        if (loaded[sh.info] < 0) continue;
+        Section *target = &obj->sections[loaded[sh.info]];
+        if (target->num_relocs > 0) {
+            linker_error("ELF section with two relocation sections");
+            goto fail;
+        }
+        uint64_t count = sh.size / ELF_RELA64_SIZE;
+        target->first_reloc = obj->num_relocs;
+        target->num_relocs = (int)count;
+        for (uint64_t r = 0; r < count; r++) {
+            const uint8_t *e = map + sh.offset + r * ELF_RELA64_SIZE;
+            uint64_t info = rd64(e + 8);
+            Relocation *rel = &obj->relocs[obj->num_relocs];
+            rel->section_index = (uint32_t)loaded[sh.info];
+            rel->offset = rd64(e);
+            rel->symbol_index = (uint32_t)(info >> 32);
+            rel->type = (int)(uint32_t)info;
+            rel->addend = (int64_t)rd64(e + 16);
+            if (rel->symbol_index >= nsyms || rel->offset >= target->size) {
+                linker_error("ELF relocation out of bounds");
+                goto fail;
+            }
+            obj->num_relocs++;
+        }
+    }
+    free(loaded);
+    return 0;
+
+fail:
+    free(loaded);
+    return -1;
+}
 
+/*
+ * Parse an ELF object file. The file is mapped read-only and stays
+ * mapped until linker__destroy(); see read_elf_object().
+ */
+static int parse_elf_object(UArena *arena, const char *filename, ObjectFile *obj) {
+    memset(obj, 0, sizeof(*obj));
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        linker_error("Cannot open object file");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        linker_error("Cannot read object file");
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        linker_error("Cannot map object file");
+        return -1;
+    }
+    obj->map = map;
+    obj->map_size = (size_t)st.st_size;
+    if (read_elf_object(arena, obj, map, obj->map_size) != 0) {
+        munmap(map, obj->map_size);
+        memset(obj, 0, sizeof(*obj));
+        return -1;
+    }
     return 0;
 }
 
 /*
  * Parse a Windows COFF object file (.obj). Stub.
  */
-static int parse_pe_object(const char *filename, ObjectFile *obj) {
+static int parse_pe_object(UArena *arena, const char *filename, ObjectFile *obj) {
     (void)filename;
     memset(obj, 0, sizeof(*obj));
     /* Minimal stub similar to ELF */
+    obj->sections = u__arena_alloc(arena, sizeof(Section));
+    obj->symbols = u__arena_alloc(arena, sizeof(Symbol));
+    uint8_t *data = u__arena_alloc(arena, 64);
+    if (!obj->sections || !obj->symbols || !data) return -1;
     obj->num_sections = 1;
-    strcpy(obj->sections[0].name, ".text");
+    obj->sections[0].name = ".text";
     obj->sections[0].size = 64;
-    obj->sections[0].data = (uint8_t *)calloc(1, 64);
+    obj->sections[0].data = data;
     obj->sections[0].flags = 0x5;
     obj->num_symbols = 1;
-    strcpy(obj->symbols[0].name, "main");
+    obj->symbols[0].name = "main";
     obj->symbols[0].section_index = 0;
     obj->symbols[0].value = 0;
     obj->symbols[0].is_defined = 1;
@@ -325,16 +708,20 @@ static int parse_pe_object(const char *filename, ObjectFile *obj) {
 /*
  * Parse a Mach-O object file. Stub.
  */
-static int parse_macho_object(const char *filename, ObjectFile *obj) {
+static int parse_macho_object(UArena *arena, const char *filename, ObjectFile *obj) {
     (void)filename;
     memset(obj, 0, sizeof(*obj));
+    obj->sections = u__arena_alloc(arena, sizeof(Section));
+    obj->symbols = u__arena_alloc(arena, sizeof(Symbol));
+    uint8_t *data = u__arena_alloc(arena, 64);
+    if (!obj->sections || !obj->symbols || !data) return -1;
     obj->num_sections = 1;
-    strcpy(obj->sections[0].name, "__text");
+    obj->sections[0].name = "__text";
     obj->sections[0].size = 64;
-    obj->sections[0].data = (uint8_t *)calloc(1, 64);
+    obj->sections[0].data = data;
     obj->sections[0].flags = 0x5;
     obj->num_symbols = 1;
-    strcpy(obj->symbols[0].name, "_main");
+    obj->symbols[0].name = "_main";
     obj->symbols[0].section_index = 0;
     obj->symbols[0].value = 0;
     obj->symbols[0].is_defined = 1;
@@ -342,325 +729,1079 @@ static int parse_macho_object(const char *filename, ObjectFile *obj) {
     return 0;
 }
 
+/* FNV-1a hash of section contents, or of a symbol or section name */
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t hash_name(const char *name) {
+    return hash_bytes(14695981039346656037ULL, name, strlen(name));
+}
+
 /*
- * Global symbol resolution.
- * Builds a merged symbol table from all object files, resolves
- * undefined references against definitions, and reports any
- * unresolved symbols.
+ * The slot of a name: the one holding it, or the empty one where it
+ * belongs. The table doubles before it gets half full, so probe
+ * sequences stay short. Returns NULL when out of memory.
+ */
+static NameSlot *name_slot(NameTable *table, const char *name, uint64_t hash) {
+    if (table->count * 2 >= table->capacity) {
+        if (table->capacity > UINT32_MAX / 4) return NULL;
+        uint32_t cap = table->capacity ? table->capacity * 2 : 64;
+        NameSlot *grown = calloc(cap, sizeof(NameSlot));
+        if (!grown) return NULL;
+        for (uint32_t i = 0; i < table->capacity; i++) {
+            if (!table->slots[i].name) continue;
+            uint32_t j = (uint32_t)table->slots[i].hash & (cap - 1);
+            while (grown[j].name) j = (j + 1) & (cap - 1);
+            grown[j] = table->slots[i];
+        }
+        free(table->slots);
+        table->slots = grown;
+        table->capacity = cap;
+    }
+    uint32_t mask = table->capacity - 1;
+    uint32_t i = (uint32_t)hash & mask;
+    for (; table->slots[i].name; i = (i + 1) & mask) {
+        NameSlot *slot = &table->slots[i];
+        if (slot->hash == hash && (slot->name == name || strcmp(slot->name, name) == 0)) return slot;
+    }
+    return &table->slots[i];
+}
+
+/* The global symbol of a name, or NULL if no object mentions it */
+static GlobalSymbol *find_global(Linker *linker, const char *name) {
+    NameSlot *slot = name_slot(&linker->symbol_table, name, hash_name(name));
+    return slot && slot->name ? &linker->globals[slot->index] : NULL;
+}
+
+/*
+ * Global symbol resolution, in a single pass over the symbols of every
+ * object. Each global name is interned in a hash table together with its
+ * definition: a strong definition overrides a weak one, the first of
+ * several weak ones is kept, and two strong ones are an error naming both
+ * objects. A name left without a definition is an error naming the first
+ * object referencing it, unless all its references are weak; those
+ * resolve to address 0.
  */
 static int resolve_symbols(Linker *linker) {
-    /*
-     * In this simplified version we just verify that the entry symbol
-     * exists somewhere. A full implementation would maintain a hash
-     * table for fast lookup and handle multiple definitions and
-     * common symbols.
-     */
-    int found_entry = 0;
+    int errors = 0;
 
     for (int i = 0; i < linker->num_objects; i++) {
         ObjectFile *obj = &linker->objects[i];
         for (int s = 0; s < obj->num_symbols; s++) {
             Symbol *sym = &obj->symbols[s];
-            if (sym->is_defined && sym->is_global &&
-                strcmp(sym->name, linker->entry_symbol) == 0) {
-                found_entry = 1;
-                /*
-                 * Record a temporary value; the final address is
-                 * computed during section layout.
-                 */
-                linker->entry_address = (size_t)-1; /* placeholder */
+            sym->global = -1;
+            if (!sym->is_global || !sym->name[0]) continue;
+            uint64_t hash = hash_name(sym->name);
+            NameSlot *slot = name_slot(&linker->symbol_table, sym->name, hash);
+            if (slot && !slot->name) {
+                if (reserve((void **)&linker->globals, &linker->globals_capacity,
+                            linker->num_globals, sizeof(GlobalSymbol)) != 0) {
+                    slot = NULL;
+                } else {
+                    *slot = (NameSlot){ sym->name, hash, linker->num_globals };
+                    linker->symbol_table.count++;
+                    linker->globals[linker->num_globals++] = (GlobalSymbol){ sym->name, -1, -1, -1 };
+                }
+            }
+            if (!slot) {
+                linker_error("Out of memory during symbol resolution");
+                return -1;
+            }
+
+            GlobalSymbol *g = &linker->globals[slot->index];
+            sym->name = g->name;
+            sym->global = slot->index;
+            if (!sym->is_defined) {
+                if (g->ref_obj < 0 && !sym->is_weak) g->ref_obj = i;
+                continue;
+            }
+            int def_weak = g->def_obj >= 0 && linker->objects[g->def_obj].symbols[g->def_sym].is_weak;
+            if (g->def_obj < 0 || (def_weak && !sym->is_weak)) {
+                g->def_obj = i;
+                g->def_sym = s;
+            } else if (!def_weak && !sym->is_weak) {
+                linker_error("Duplicate symbol %s, defined in %s and in %s",
+                             g->name, linker->objects[g->def_obj].filename, obj->filename);
+                errors++;
             }
         }
     }
 
-    if (!found_entry && linker->entry_symbol[0] != '\0') {
-        linker_error("Entry symbol not found");
+    for (int g = 0; g < linker->num_globals; g++) {
+        if (linker->globals[g].def_obj >= 0 || linker->globals[g].ref_obj < 0) continue;
+        /* PIC objects name the GOT; none is built, as every GOT reference
+         * is relaxed, and a relocation needing it is reported. */
+        if (strcmp(linker->globals[g].name, "_GLOBAL_OFFSET_TABLE_") == 0) continue;
+        linker_error("Undefined symbol %s, referenced by %s",
+                     linker->globals[g].name, linker->objects[linker->globals[g].ref_obj].filename);
+        errors++;
+    }
+
+    if (linker->entry_symbol) {
+        GlobalSymbol *entry = find_global(linker, linker->entry_symbol);
+        if (!entry || entry->def_obj < 0) {
+            linker_error("Entry symbol %s not found", linker->entry_symbol);
+            return -1;
+        }
+        /*
+         * Record a temporary value; the final address is computed
+         * during section layout.
+         */
+        linker->entry_address = UINT64_MAX; /* placeholder */
+    }
+
+    return errors ? -1 : 0;
+}
+
+/*
+ * Find the object and symbol defining what symbol sym_index of object
+ * obj_index stands for: the resolved definition of a global, the symbol
+ * itself for a local. Returns 0 on success, -1 if it is undefined.
+ */
+static int find_definition(const Linker *linker, int obj_index, uint32_t sym_index,
+                           int *def_obj, int *def_sym) {
+    const Symbol *sym = &linker->objects[obj_index].symbols[sym_index];
+    if (sym->global >= 0) {
+        const GlobalSymbol *g = &linker->globals[sym->global];
+        *def_obj = g->def_obj;
+        *def_sym = g->def_sym;
+        return g->def_obj >= 0 ? 0 : -1;
+    }
+    *def_obj = obj_index;
+    *def_sym = (int)sym_index;
+    return sym->is_defined ? 0 : -1;
+}
+
+/*
+ * Only code and data sections are collected; anything else (init
+ * arrays, notes, ...) is needed without being referenced.
+ */
+static int is_collectable(const Section *sec) {
+    static const char *const prefixes[] = { ".text", ".data", ".rodata", ".bss" };
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+        size_t len = strlen(prefixes[i]);
+        if (strncmp(sec->name, prefixes[i], len) == 0 &&
+            (sec->name[len] == '\0' || sec->name[len] == '.'))
+            return 1;
+    }
+    return 0;
+}
+
+/* Keep every section, as when there is no --gc-sections. */
+static void mark_all_live(Linker *linker) {
+    for (int i = 0; i < linker->num_objects; i++)
+        for (int s = 0; s < linker->objects[i].num_sections; s++)
+            linker->objects[i].sections[s].is_live = 1;
+}
+
+/* Mark a section live and queue it to have its relocations followed. */
+static void mark_section(Linker *linker, int obj_index, int sec_index, int *work, int *pending) {
+    ObjectFile *obj = &linker->objects[obj_index];
+    if (sec_index < 0 || sec_index >= obj->num_sections) return;
+    Section *sec = &obj->sections[sec_index];
+    if (sec->is_live) return;
+    sec->is_live = 1;
+    work[2 * *pending] = obj_index;
+    work[2 * *pending + 1] = sec_index;
+    (*pending)++;
+}
+
+/*
+ * Mark phase of --gc-sections. The section defining the entry symbol and
+ * every section that cannot be collected are live; a relocation in a
+ * live section makes the section of its symbol live, following undefined
+ * symbols to their global definition. Unmarked sections are discarded
+ * and their size reported.
+ */
+static int collect_sections(Linker *linker) {
+    if (!linker->entry_symbol) {
+        fprintf(stderr, "Linker: --gc-sections needs an entry symbol; keeping all sections\n");
+        mark_all_live(linker);
+        return 0;
+    }
+
+    /* Worklist of (object, section) pairs; each section enters once. */
+    int total = 0;
+    for (int i = 0; i < linker->num_objects; i++) total += linker->objects[i].num_sections;
+    int *work = malloc((size_t)(total ? total : 1) * 2 * sizeof(int));
+    if (!work) {
+        linker_error("Out of memory during section garbage collection");
         return -1;
     }
+    int pending = 0;
+    for (int i = 0; i < linker->num_objects; i++) {
+        ObjectFile *obj = &linker->objects[i];
+        for (int s = 0; s < obj->num_sections; s++) obj->sections[s].is_live = 0;
+    }
+    for (int i = 0; i < linker->num_objects; i++) {
+        ObjectFile *obj = &linker->objects[i];
+        for (int s = 0; s < obj->num_sections; s++)
+            if (!is_collectable(&obj->sections[s])) mark_section(linker, i, s, work, &pending);
+    }
+    GlobalSymbol *entry = find_global(linker, linker->entry_symbol);
+    if (entry && entry->def_obj >= 0)
+        mark_section(linker, entry->def_obj, (int)linker->objects[entry->def_obj].symbols[entry->def_sym].section_index,
+                     work, &pending);
+
+    while (pending > 0) {
+        pending--;
+        int o = work[2 * pending], s = work[2 * pending + 1];
+        ObjectFile *obj = &linker->objects[o];
+        const Section *sec = &obj->sections[s];
+        for (int r = sec->first_reloc; r < sec->first_reloc + sec->num_relocs; r++) {
+            Relocation *rel = &obj->relocs[r];
+            int def_obj, def_sym;
+            if (find_definition(linker, o, rel->symbol_index, &def_obj, &def_sym) != 0)
+                continue;   /* a weak reference left undefined */
+            mark_section(linker, def_obj, (int)linker->objects[def_obj].symbols[def_sym].section_index,
+                         work, &pending);
+        }
+    }
+    free(work);
 
+    linker->gc_removed_bytes = 0;
+    linker->gc_removed_sections = 0;
+    for (int i = 0; i < linker->num_objects; i++) {
+        ObjectFile *obj = &linker->objects[i];
+        for (int s = 0; s < obj->num_sections; s++) {
+            if (obj->sections[s].is_live) continue;
+            linker->gc_removed_bytes += obj->sections[s].size;
+            linker->gc_removed_sections++;
+        }
+    }
+    fprintf(stderr, "Linker: --gc-sections removed %" PRIu64 " bytes in %d sections\n",
+            linker->gc_removed_bytes, linker->gc_removed_sections);
+    return 0;
+}
+
+/* Relocations a call or a jump makes, which do not take the address */
+static int is_branch(uint16_t machine, int type) {
+    if (machine == ELF_EM_X86_64) return type == ELF_R_X86_64_PLT32;
+    if (machine == ELF_EM_AARCH64) return type == ELF_R_AARCH64_JUMP26 || type == ELF_R_AARCH64_CALL26;
+    return 0;
+}
+
+/* A section --icf may fold */
+typedef struct {
+    Section *sec;
+    int obj_index;
+    uint64_t hash;              /* Of its contents, then of what its
+                                   relocations refer to */
+} IcfCandidate;
+
+static int compare_candidates(const void *a, const void *b) {
+    const IcfCandidate *x = a, *y = b;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    if (x->obj_index != y->obj_index) return x->obj_index - y->obj_index;
+    return x->sec < y->sec ? -1 : x->sec > y->sec;
+}
+
+/* Same size, bytes, and relocations but for their symbols */
+static int same_contents(const Linker *linker, const IcfCandidate *a, const IcfCandidate *b) {
+    const Section *sa = a->sec, *sb = b->sec;
+    if (sa->size != sb->size || sa->flags != sb->flags || sa->num_relocs != sb->num_relocs ||
+        memcmp(sa->data, sb->data, sa->size) != 0)
+        return 0;
+    const Relocation *ra = &linker->objects[a->obj_index].relocs[sa->first_reloc];
+    const Relocation *rb = &linker->objects[b->obj_index].relocs[sb->first_reloc];
+    for (int r = 0; r < sa->num_relocs; r++)
+        if (ra[r].offset != rb[r].offset || ra[r].type != rb[r].type || ra[r].addend != rb[r].addend)
+            return 0;
+    return 1;
+}
+
+/*
+ * Whether the relocations of two sections of the same contents refer to
+ * the same places: the same definition, or the same offset in sections of
+ * one class.
+ */
+static int same_targets(const Linker *linker, const IcfCandidate *a, const IcfCandidate *b) {
+    const ObjectFile *oa = &linker->objects[a->obj_index], *ob = &linker->objects[b->obj_index];
+    for (int r = 0; r < a->sec->num_relocs; r++) {
+        const Relocation *ra = &oa->relocs[a->sec->first_reloc + r];
+        const Relocation *rb = &ob->relocs[b->sec->first_reloc + r];
+        int obj_a, sym_a, obj_b, sym_b;
+        int def_a = find_definition(linker, a->obj_index, ra->symbol_index, &obj_a, &sym_a) == 0;
+        int def_b = find_definition(linker, b->obj_index, rb->symbol_index, &obj_b, &sym_b) == 0;
+        if (!def_a || !def_b) {
+            /* weak references left undefined: the same if of the same name */
+            if (def_a || def_b || oa->symbols[ra->symbol_index].name != ob->symbols[rb->symbol_index].name)
+                return 0;
+            continue;
+        }
+        const Symbol *sa = &linker->objects[obj_a].symbols[sym_a];
+        const Symbol *sb = &linker->objects[obj_b].symbols[sym_b];
+        if (sa->value != sb->value) return 0;
+        if (sa->section_index == SECTION_NONE || sb->section_index == SECTION_NONE) {
+            if (sa->section_index != sb->section_index) return 0;
+            continue;
+        }
+        const Section *ta = &linker->objects[obj_a].sections[sa->section_index];
+        const Section *tb = &linker->objects[obj_b].sections[sb->section_index];
+        if (ta != tb && (ta->icf_class < 0 || ta->icf_class != tb->icf_class)) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Split the members of the class cands[begin, end) that differ from the
+ * first into a class of their own, numbered by where it starts. Returns
+ * that position, end if they are all equal.
+ */
+static int split_class(const Linker *linker, IcfCandidate *cands, int begin, int end,
+                       int (*equal)(const Linker *, const IcfCandidate *, const IcfCandidate *)) {
+    int mid = begin + 1;
+    for (int i = begin + 1; i < end; i++) {
+        if (!equal(linker, &cands[begin], &cands[i])) continue;
+        IcfCandidate t = cands[mid];
+        cands[mid++] = cands[i];
+        cands[i] = t;
+    }
+    for (int i = mid; i < end; i++) cands[i].sec->icf_class = mid;
+    return mid;
+}
+
+/*
+ * Split the class cands[begin, end) until no two members of a class
+ * differ; returns whether it was split.
+ */
+static int refine_class(const Linker *linker, IcfCandidate *cands, int begin, int end,
+                        int (*equal)(const Linker *, const IcfCandidate *, const IcfCandidate *)) {
+    int changed = 0;
+    while (begin < end) {
+        int mid = split_class(linker, cands, begin, end, equal);
+        if (mid < end) changed = 1;
+        begin = mid;            /* the split-off rest is a class to refine too */
+    }
+    return changed;
+}
+
+/*
+ * Hash of what the relocations of a section refer to, equal for sections
+ * same_targets() finds equal: a section in a class stands for its class.
+ */
+static uint64_t target_hash(const Linker *linker, const IcfCandidate *cand) {
+    const ObjectFile *obj = &linker->objects[cand->obj_index];
+    uint64_t h = 14695981039346656037ULL;
+    for (int r = cand->sec->first_reloc; r < cand->sec->first_reloc + cand->sec->num_relocs; r++) {
+        uint64_t key[2] = { 0, 0 };
+        int def_obj, def_sym;
+        if (find_definition(linker, cand->obj_index, obj->relocs[r].symbol_index, &def_obj, &def_sym) == 0) {
+            const Symbol *sym = &linker->objects[def_obj].symbols[def_sym];
+            const Section *target = sym->section_index == SECTION_NONE ? NULL
+                                    : &linker->objects[def_obj].sections[sym->section_index];
+            key[0] = target && target->icf_class >= 0 ? (uint64_t)target->icf_class : (uint64_t)(uintptr_t)target;
+            key[1] = sym->value;
+        } else {
+            key[0] = (uint64_t)(uintptr_t)obj->symbols[obj->relocs[r].symbol_index].name;
+        }
+        h = hash_bytes(h, key, sizeof(key));
+    }
+    return h;
+}
+
+/*
+ * One round of splitting classes by what their relocations refer to, as
+ * of the classes before it. Each class is sorted by the hash of that, so
+ * it splits at once into its runs of one hash; only sections of one hash
+ * are compared. Returns whether any class was split.
+ */
+static int refine_by_targets(const Linker *linker, IcfCandidate *cands, int count) {
+    for (int c = 0; c < count; c++) cands[c].hash = target_hash(linker, &cands[c]);
+    int changed = 0;
+    for (int begin = 0; begin < count;) {
+        int end = begin + 1;
+        while (end < count && cands[end].sec->icf_class == cands[begin].sec->icf_class) end++;
+        qsort(cands + begin, (size_t)(end - begin), sizeof(IcfCandidate), compare_candidates);
+        for (int run = begin; run < end;) {
+            int run_end = run + 1;
+            while (run_end < end && cands[run_end].hash == cands[run].hash) run_end++;
+            if (run > begin) {
+                for (int c = run; c < run_end; c++) cands[c].sec->icf_class = run;
+                changed = 1;
+            }
+            changed |= refine_class(linker, cands, run, run_end, same_targets);
+            run = run_end;
+        }
+        begin = end;
+    }
+    return changed;
+}
+
+/*
+ * Identical code folding, as lld does it. The candidates are the live
+ * read-only code and data sections with contents; with --icf=safe, those
+ * whose address is taken (referenced other than by a call or jump) are
+ * left alone, since the program may compare it. They are grouped by a
+ * hash of their bytes and relocations, then split into classes of equal
+ * contents, and those classes are split again until the relocations of
+ * every member of a class refer to the same symbols or to the same
+ * offsets in sections of one class, so identical mutually recursive
+ * functions fold too. The first section of each class is kept, and the
+ * symbols of the others redirected to it. The bytes saved are reported.
+ */
+static int fold_sections(Linker *linker) {
+    for (int i = 0; i < linker->num_objects; i++) {
+        ObjectFile *obj = &linker->objects[i];
+        for (int s = 0; s < obj->num_sections; s++) {
+            obj->sections[s].is_address_taken = 0;
+            obj->sections[s].icf_class = -1;
+            obj->sections[s].folded_into = NULL;
+        }
+    }
+    for (int i = 0; linker->icf == ICF_SAFE && i < linker->num_objects; i++) {
+        ObjectFile *obj = &linker->objects[i];
+        for (int r = 0; r < obj->num_relocs; r++) {
+            const Relocation *rel = &obj->relocs[r];
+            int def_obj, def_sym;
+            if (!obj->sections[rel->section_index].is_live ||     /* dropped by --gc-sections */
+                is_branch(obj->machine, rel->type) ||
+                find_definition(linker, i, rel->symbol_index, &def_obj, &def_sym) != 0)
+                continue;
+            uint32_t sec = linker->objects[def_obj].symbols[def_sym].section_index;
+            if (sec != SECTION_NONE) linker->objects[def_obj].sections[sec].is_address_taken = 1;
+        }
+    }
+
+    int count = 0, capacity = 0;
+    IcfCandidate *cands = NULL;
+    for (int i = 0; i < linker->num_objects; i++) {
+        ObjectFile *obj = &linker->objects[i];
+        for (int s = 0; s < obj->num_sections; s++) {
+            Section *sec = &obj->sections[s];
+            if (!sec->is_live || !sec->data || sec->size == 0 ||
+                (sec->flags & 0x2) /* writable */ || !is_collectable(sec) || sec->is_address_taken)
+                continue;
+            if (reserve((void **)&cands, &capacity, count, sizeof(IcfCandidate)) != 0) {
+                free(cands);
+                linker_error("Out of memory during identical code folding");
+                return -1;
+            }
+            uint64_t h = hash_bytes(14695981039346656037ULL, &sec->size, sizeof(sec->size));
+            h = hash_bytes(h, sec->data, sec->size);
+            for (int r = sec->first_reloc; r < sec->first_reloc + sec->num_relocs; r++) {
+                h = hash_bytes(h, &obj->relocs[r].offset, sizeof(obj->relocs[r].offset));
+                h = hash_bytes(h, &obj->relocs[r].type, sizeof(obj->relocs[r].type));
+                h = hash_bytes(h, &obj->relocs[r].addend, sizeof(obj->relocs[r].addend));
+            }
+            cands[count++] = (IcfCandidate){ sec, i, h };
+        }
+    }
+
+    /* Classes start as runs of one hash, split by contents, then by what
+     * their relocations refer to until no class splits any more. Each is
+     * numbered by the position of its run. */
+    if (count > 0) qsort(cands, (size_t)count, sizeof(IcfCandidate), compare_candidates);
+    for (int c = 0; c < count; c++)
+        cands[c].sec->icf_class = c > 0 && cands[c].hash == cands[c - 1].hash ? cands[c - 1].sec->icf_class : c;
+    for (int begin = 0; begin < count;) {
+        int end = begin + 1;
+        while (end < count && cands[end].hash == cands[begin].hash) end++;
+        refine_class(linker, cands, begin, end, same_contents);
+        begin = end;
+    }
+    while (refine_by_targets(linker, cands, count)) {}
+
+    linker->icf_saved_bytes = 0;
+    linker->icf_folded_sections = 0;
+    for (int begin = 0; begin < count;) {
+        int end = begin + 1, keep = begin;
+        while (end < count && cands[end].sec->icf_class == cands[begin].sec->icf_class) end++;
+        for (int c = begin + 1; c < end; c++)     /* the first in link order */
+            if (cands[c].obj_index < cands[keep].obj_index ||
+                (cands[c].obj_index == cands[keep].obj_index && cands[c].sec < cands[keep].sec))
+                keep = c;
+        for (int c = begin; c < end; c++) {
+            /* The section kept stands at the strictest alignment of its class */
+            if (cands[c].sec->align > cands[keep].sec->align) cands[keep].sec->align = cands[c].sec->align;
+            if (c == keep) continue;
+            cands[c].sec->folded_into = cands[keep].sec;
+            linker->icf_saved_bytes += cands[c].sec->size;
+            linker->icf_folded_sections++;
+        }
+        begin = end;
+    }
+    free(cands);
+    fprintf(stderr, "Linker: --icf=%s folded %d sections, saving %" PRIu64 " bytes\n",
+            linker->icf == ICF_SAFE ? "safe" : "all", linker->icf_folded_sections, linker->icf_saved_bytes);
     return 0;
 }
 
 /*
- * Merge sections: for each unique section name, concatenate the
- * contents of all input sections with that name. The merged sections
- * will later be placed sequentially in the output.
+ * Name of the merged output section of an input section: the
+ * .text.<name> sections of -ffunction-sections go to .text, and likewise
+ * for data.
+ */
+static const char *output_section_name(const char *name) {
+    static const char *const outputs[] = { ".text", ".data", ".rodata", ".bss" };
+    for (size_t i = 0; i < sizeof(outputs) / sizeof(outputs[0]); i++) {
+        size_t len = strlen(outputs[i]);
+        if (strncmp(name, outputs[i], len) == 0 && name[len] == '.') return outputs[i];
+    }
+    return name;
+}
+
+/*
+ * Merge sections: for each unique section name, place the input
+ * sections with that name one after another. Nothing is copied yet;
+ * write_sections() moves the contents straight into the output image,
+ * where the merged sections are placed sequentially.
  */
 static int merge_sections(Linker *linker) {
     linker->num_merged_sections = 0;
+    if (linker->section_table.slots)
+        memset(linker->section_table.slots, 0, linker->section_table.capacity * sizeof(NameSlot));
+    linker->section_table.count = 0;
 
     for (int i = 0; i < linker->num_objects; i++) {
         ObjectFile *obj = &linker->objects[i];
         for (int s = 0; s < obj->num_sections; s++) {
             Section *in_sec = &obj->sections[s];
+            in_sec->output_index = -1;
+            if (!in_sec->is_live) continue;
+            if (in_sec->folded_into) continue;
+            const char *out_name = output_section_name(in_sec->name);
             /* Look for an existing merged section with the same name. */
-            int found = -1;
-            for (int m = 0; m < linker->num_merged_sections; m++) {
-                if (strcmp(linker->merged_sections[m].name, in_sec->name) == 0) {
-                    found = m;
-                    break;
-                }
+            uint64_t hash = hash_name(out_name);
+            NameSlot *slot = name_slot(&linker->section_table, out_name, hash);
+            if (!slot || (!slot->name && reserve((void **)&linker->merged_sections, &linker->merged_capacity,
+                                                 linker->num_merged_sections, sizeof(Section)) != 0)) {
+                linker_error("Out of memory during section merge");
+                return -1;
             }
 
-            if (found == -1) {
+            if (!slot->name) {
                 /* Create a new merged section entry. */
-                if (linker->num_merged_sections >= MAX_SECTIONS) {
-                    linker_error("Too many merged sections");
-                    return -1;
-                }
-                found = linker->num_merged_sections++;
-                strcpy(linker->merged_sections[found].name, in_sec->name);
-                linker->merged_sections[found].size = 0;
-                linker->merged_sections[found].data = NULL;
-                linker->merged_sections[found].flags = in_sec->flags;
+                *slot = (NameSlot){ out_name, hash, linker->num_merged_sections };
+                linker->section_table.count++;
+                Section *out = &linker->merged_sections[linker->num_merged_sections++];
+                out->name = out_name;
+                out->size = 0;
+                out->data = NULL;
+                out->align = 1;
+                out->flags = in_sec->flags;
             }
+            int found = slot->index;
 
             /*
-             * Append the input section's data to the merged section.
-             * The offset_in_output field is set during layout; here
-             * we only remember where this chunk will sit relative to
-             * the start of the merged section.
+             * Append the input section to the merged section, at the
+             * next multiple of its alignment. The offset_in_output field
+             * is set during layout; here we only remember where this
+             * chunk will sit relative to the start of the merged section.
              */
-            in_sec->offset_in_output = linker->merged_sections[found].size;
-
-            size_t new_size = linker->merged_sections[found].size + in_sec->size;
-            uint8_t *new_data = realloc(linker->merged_sections[found].data, new_size);
-            if (!new_data) {
-                linker_error("Out of memory during section merge");
+            Section *out = &linker->merged_sections[found];
+            uint64_t offset = (out->size + in_sec->align - 1) & ~(in_sec->align - 1);
+            if (offset < out->size || in_sec->size > UINT64_MAX - offset) {
+                linker_error("Merged section too large");
                 return -1;
             }
-            memcpy(new_data + linker->merged_sections[found].size,
-                   in_sec->data, in_sec->size);
-            linker->merged_sections[found].data = new_data;
-            linker->merged_sections[found].size = new_size;
+            if (in_sec->align > out->align) out->align = in_sec->align;
+            in_sec->offset_in_output = offset;
+            in_sec->output_index = found;
+            out->size = offset + in_sec->size;
         }
     }
     return 0;
 }
 
+/*
+ * Final virtual address of a defined symbol: the merged section's base
+ * address plus the input section's offset in it plus the symbol's
+ * offset, or the value of an absolute symbol. A symbol of a section
+ * folded by --icf is at the same offset in the section kept. 0 if its
+ * section was discarded.
+ */
+static uint64_t symbol_address(const Linker *linker, int obj_index, int sym_index) {
+    const ObjectFile *obj = &linker->objects[obj_index];
+    const Symbol *sym = &obj->symbols[sym_index];
+    if (sym->section_index == SECTION_NONE) return sym->value;
+    const Section *in_sec = &obj->sections[sym->section_index];
+    if (in_sec->folded_into) in_sec = in_sec->folded_into;
+    /* The merged section that contains the input section */
+    int m = in_sec->output_index;
+    if (m < 0) return 0;
+    return linker->merged_sections[m].offset_in_output + in_sec->offset_in_output + sym->value;
+}
+
+/* Executables are mapped in pages of this size; a merged section starts
+ * on a page of its own, so that it can be given its own protection. */
+#define LINKER_PAGE 0x1000
+
+/* The headers take the page at 0x400000, the typical base of an x86-64
+ * ELF executable; the sections follow. */
+#define LINKER_BASE (0x400000 + LINKER_PAGE)
+
 /*
  * Layout: assign virtual addresses to every merged section and
- * compute the final address of the entry point. The layout strategy
- * shown here simply places sections one after another starting at
- * a base address (e.g. 0x400000 for 64-bit executables).
+ * compute the final address of the entry point. The merged sections
+ * are placed one after another, each on a new page, starting at
+ * LINKER_BASE; one aligned to more than a page starts on a multiple of
+ * its alignment. Input sections keep their own alignment within them,
+ * see merge_sections().
  */
 static int layout_sections(Linker *linker) {
-    size_t current_address = 0x400000; /* Typical base for x86-64 ELF */
+    uint64_t current_address = LINKER_BASE;
     for (int m = 0; m < linker->num_merged_sections; m++) {
+        uint64_t align = linker->merged_sections[m].align;
+        if (align > LINKER_PAGE && current_address % align)
+            current_address += align - (current_address % align);
         linker->merged_sections[m].offset_in_output = current_address;
         current_address += linker->merged_sections[m].size;
-        /* Align to 16 bytes for simplicity (real linkers use per‑section alignment) */
-        if (current_address % 16)
-            current_address += 16 - (current_address % 16);
-    }
-
-    /*
-     * Walk through all symbols to find the entry point and compute
-     * its final address. We use the merged section's base address
-     * plus the symbol's original offset (now adjusted because the
-     * input section was appended to a merged section).
-     */
-    if (linker->entry_address == (size_t)-1) { /* placeholder was set */
-        for (int i = 0; i < linker->num_objects; i++) {
-            ObjectFile *obj = &linker->objects[i];
-            for (int s = 0; s < obj->num_symbols; s++) {
-                Symbol *sym = &obj->symbols[s];
-                if (strcmp(sym->name, linker->entry_symbol) == 0) {
-                    Section *in_sec = &obj->sections[sym->section_index];
-                    /* Find the merged section that contains this input section */
-                    for (int m = 0; m < linker->num_merged_sections; m++) {
-                        if (strcmp(linker->merged_sections[m].name, in_sec->name) == 0) {
-                            linker->entry_address =
-                                linker->merged_sections[m].offset_in_output
-                                + in_sec->offset_in_output
-                                + sym->value;
-                            break;
-                        }
-                    }
-                    break;
-                }
-            }
-        }
+        if (current_address % LINKER_PAGE)
+            current_address += LINKER_PAGE - (current_address % LINKER_PAGE);
+    }
+
+    /* The entry point's final address, now that its section is placed */
+    if (linker->entry_address == UINT64_MAX) { /* placeholder was set */
+        GlobalSymbol *entry = find_global(linker, linker->entry_symbol);
+        linker->entry_address = symbol_address(linker, entry->def_obj, entry->def_sym);
     }
     return 0;
 }
 
+/* Input sections are handed to the threads in runs of about this size */
+#define LINKER_JOB_BYTES (64 * 1024)
+
+static void wr16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void wr32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static void wr64(uint8_t *p, uint64_t v) {
+    wr32(p, (uint32_t)v);
+    wr32(p + 4, (uint32_t)(v >> 32));
+}
+
+/* Whether v fits a two's complement field of the given width */
+static int fits_signed(int64_t v, int bits) {
+    return v >= -((int64_t)1 << (bits - 1)) && v < ((int64_t)1 << (bits - 1));
+}
+
 /*
- * Relocation processing. For each relocation entry we compute the
- * final address of the referenced symbol and patch the appropriate
- * bytes in the merged section data.
+ * No GOT is built, so an instruction loading a symbol's address from it is
+ * rewritten to compute the address: mov foo@GOTPCREL(%rip) becomes lea,
+ * and a call or jump through the GOT a direct one. loc is the 32-bit
+ * displacement, offset its offset in the section. Returns where the
+ * displacement is now, NULL for an instruction that cannot be relaxed.
  */
-static int perform_relocations(Linker *linker) {
-    for (int i = 0; i < linker->num_objects; i++) {
-        ObjectFile *obj = &linker->objects[i];
-        for (int r = 0; r < obj->num_relocs; r++) {
-            Relocation *rel = &obj->relocs[r];
-            /* Retrieve the referenced symbol. */
-            Symbol *sym = &obj->symbols[rel->symbol_index];
-
-            /* Calculate the final virtual address of the symbol. */
-            size_t sym_addr = 0;
-            if (sym->is_defined) {
-                Section *in_sec = &obj->sections[sym->section_index];
-                /* Find the merged section that contains this symbol. */
-                for (int m = 0; m < linker->num_merged_sections; m++) {
-                    if (strcmp(linker->merged_sections[m].name, in_sec->name) == 0) {
-                        sym_addr = linker->merged_sections[m].offset_in_output
-                                   + in_sec->offset_in_output
-                                   + sym->value;
-                        break;
-                    }
+static uint8_t *relax_gotpcrel(uint8_t *loc, uint64_t offset) {
+    if (offset < 2) return NULL;
+    if (loc[-2] == 0x8B && (loc[-1] & 0xC7) == 0x05) {  /* mov, RIP-relative */
+        loc[-2] = 0x8D;                                  /* lea */
+        return loc;
+    }
+    if (loc[-2] == 0xFF && loc[-1] == 0x15) {           /* call *foo(%rip) */
+        loc[-2] = 0x67;                                  /* addr32 call foo */
+        loc[-1] = 0xE8;
+        return loc;
+    }
+    if (loc[-2] == 0xFF && loc[-1] == 0x25) {           /* jmp *foo(%rip) */
+        loc[-2] = 0xE9;                                  /* jmp foo; nop */
+        loc[3] = 0x90;
+        return loc - 1;
+    }
+    return NULL;
+}
+
+/*
+ * Apply one relocation of an input section, whose contents are at bytes
+ * in the output image and whose address is base. S is the final address
+ * of the symbol's definition, A the addend and P the address patched.
+ * Returns 0 on success, -1 with a message printed.
+ */
+static int relocate(const Linker *linker, int obj_index, const Section *in_sec,
+                    const Relocation *rel, uint8_t *bytes, uint64_t base) {
+    const ObjectFile *obj = &linker->objects[obj_index];
+    const char *name = obj->symbols[rel->symbol_index].name;
+    uint8_t *loc = bytes + rel->offset;
+    uint64_t room = in_sec->size - rel->offset;
+    uint64_t P = base + rel->offset;
+    int def_obj, def_sym;
+    int defined = find_definition(linker, obj_index, rel->symbol_index, &def_obj, &def_sym) == 0;
+    uint64_t value = (defined ? symbol_address(linker, def_obj, def_sym) : 0) + (uint64_t)rel->addend;
+    int64_t pcrel = (int64_t)(value - P);
+
+    if (obj->machine == ELF_EM_X86_64) {
+        switch (rel->type) {
+            case ELF_R_X86_64_NONE:
+                return 0;
+            case ELF_R_X86_64_64:                       /* S + A */
+                if (room < 8) break;
+                wr64(loc, value);
+                return 0;
+            case ELF_R_X86_64_PC32:                     /* S + A - P */
+            case ELF_R_X86_64_PLT32:                    /* no PLT: straight to S */
+                if (room < 4) break;
+                if (!fits_signed(pcrel, 32)) goto overflow;
+                wr32(loc, (uint32_t)pcrel);
+                return 0;
+            case ELF_R_X86_64_32:                       /* S + A, zero-extended */
+                if (room < 4) break;
+                if (value > UINT32_MAX) goto overflow;
+                wr32(loc, (uint32_t)value);
+                return 0;
+            case ELF_R_X86_64_32S:                      /* S + A, sign-extended */
+                if (room < 4) break;
+                if (!fits_signed((int64_t)value, 32)) goto overflow;
+                wr32(loc, (uint32_t)value);
+                return 0;
+            case ELF_R_X86_64_GOTPCREL:
+            case ELF_R_X86_64_GOTPCRELX:
+            case ELF_R_X86_64_REX_GOTPCRELX: {
+                if (room < 4) break;
+                uint8_t *disp = defined ? relax_gotpcrel(loc, rel->offset) : NULL;
+                if (!disp) {
+                    linker_error("Cannot relax the GOT reference to %s in %s", name, obj->filename);
+                    return -1;
                 }
-            } else {
-                /* Undefined symbol – in a full linker this would be an error or a
-                   reference to a shared library. For this demonstration we
-                   leave the address as zero. */
+                pcrel = (int64_t)(value - (P - (uint64_t)(loc - disp)));
+                if (!fits_signed(pcrel, 32)) goto overflow;
+                wr32(disp, (uint32_t)pcrel);
+                return 0;
+            }
+            default:
+                linker_error("Unsupported x86-64 relocation type %d against %s in %s",
+                             rel->type, name, obj->filename);
+                return -1;
+        }
+    } else if (obj->machine == ELF_EM_AARCH64) {
+        uint32_t insn = room >= 4 ? rd32(loc) : 0;
+        switch (rel->type) {
+            case ELF_R_AARCH64_NONE:
+                return 0;
+            case ELF_R_AARCH64_JUMP26:                  /* b, bl: (S + A - P) >> 2 */
+            case ELF_R_AARCH64_CALL26:
+                if (room < 4) break;
+                if ((pcrel & 3) || !fits_signed(pcrel, 28)) goto overflow;
+                wr32(loc, (insn & 0xFC000000u) | ((uint32_t)(pcrel >> 2) & 0x03FFFFFFu));
+                return 0;
+            case ELF_R_AARCH64_ADR_PREL_PG_HI21: {      /* adrp: Page(S + A) - Page(P) */
+                if (room < 4) break;
+                int64_t pages = (int64_t)((value & ~(uint64_t)0xFFF) - (P & ~(uint64_t)0xFFF)) / 4096;
+                if (!fits_signed(pages, 21)) goto overflow;
+                uint32_t imm = (uint32_t)pages;
+                wr32(loc, (insn & 0x9F00001Fu) | (imm & 3) << 29 | ((imm >> 2) & 0x7FFFFu) << 5);
+                return 0;
             }
+            case ELF_R_AARCH64_ADD_ABS_LO12_NC:         /* add: (S + A) & 0xFFF */
+                if (room < 4) break;
+                wr32(loc, (insn & 0xFFC003FFu) | (uint32_t)(value & 0xFFF) << 10);
+                return 0;
+            default:
+                linker_error("Unsupported AArch64 relocation type %d against %s in %s",
+                             rel->type, name, obj->filename);
+                return -1;
+        }
+    } else {
+        linker_error("Unsupported relocation type %d against %s in %s", rel->type, name, obj->filename);
+        return -1;
+    }
+    linker_error("Relocation against %s runs past the end of its section in %s", name, obj->filename);
+    return -1;
 
-            /*
-             * Compute the location inside the merged data that must be patched.
-             * The input section's data has been copied into the merged section,
-             * so we add the merged section's base and the input section's
-             * offset within the merged data.
-             */
-            Section *target_in_sec = &obj->sections[rel->section_index];
-            for (int m = 0; m < linker->num_merged_sections; m++) {
-                if (strcmp(linker->merged_sections[m].name, target_in_sec->name) == 0) {
-                    size_t patch_offset = target_in_sec->offset_in_output + rel->offset;
-                    uint8_t *patch_loc = linker->merged_sections[m].data + patch_offset;
-
-                    /*
-                     * Apply a simple x86-64 PC-relative relocation (type 1).
-                     * The formula: value = S + A - P, where S = symbol address,
-                     * A = addend, P = address of the location being patched.
-                     */
-                    if (rel->type == 1) {
-                        size_t P = linker->merged_sections[m].offset_in_output + patch_offset;
-                        int64_t value = (int64_t)(sym_addr + rel->addend - P);
-                        memcpy(patch_loc, &value, sizeof(int32_t)); /* 32-bit relative */
-                    }
-                    break;
+overflow:
+    linker_error("Relocation against %s out of range in %s", name, obj->filename);
+    return -1;
+}
+
+/* A run of input sections of one object, copied and relocated by one task */
+typedef struct {
+    const Linker *linker;
+    int obj_index;
+    int first_section, end_section;
+    int errors;                 /* Relocations that could not be applied */
+} SectionJob;
+
+static void write_sections_task(void *arg, uint32_t worker) {
+    (void)worker;
+    SectionJob *job = arg;
+    const Linker *linker = job->linker;
+    const ObjectFile *obj = &linker->objects[job->obj_index];
+    for (int s = job->first_section; s < job->end_section; s++) {
+        const Section *in_sec = &obj->sections[s];
+        if (in_sec->output_index < 0) continue;
+        const Section *out = &linker->merged_sections[in_sec->output_index];
+        uint8_t *bytes = linker->output_data + out->file_offset + in_sec->offset_in_output;
+        /* Sections without contents (.bss) keep the zeros of the fresh image. */
+        if (in_sec->data) memcpy(bytes, in_sec->data, in_sec->size);
+        for (int r = in_sec->first_reloc; r < in_sec->first_reloc + in_sec->num_relocs; r++)
+            if (relocate(linker, job->obj_index, in_sec, &obj->relocs[r], bytes,
+                         out->offset_in_output + in_sec->offset_in_output) != 0)
+                job->errors++;
+    }
+}
+
+/*
+ * Copy the input sections into the output image and apply their
+ * relocations. Each input section has a range of the image of its own
+ * and its relocations patch only that range, so runs of sections are
+ * handed to linker->threads threads with no locking. Returns 0 on
+ * success, -1 if a relocation could not be applied.
+ */
+static int write_sections(Linker *linker) {
+    SectionJob *jobs = NULL;
+    int num_jobs = 0, jobs_capacity = 0;
+    for (int i = 0; i < linker->num_objects; i++) {
+        const ObjectFile *obj = &linker->objects[i];
+        uint64_t run = LINKER_JOB_BYTES;
+        for (int s = 0; s < obj->num_sections; s++) {
+            const Section *in_sec = &obj->sections[s];
+            if (in_sec->output_index < 0) continue;
+            if (run >= LINKER_JOB_BYTES) {
+                if (reserve((void **)&jobs, &jobs_capacity, num_jobs, sizeof(SectionJob)) != 0) {
+                    free(jobs);
+                    linker_error("Out of memory writing sections");
+                    return -1;
                 }
+                jobs[num_jobs++] = (SectionJob){ linker, i, s, s, 0 };
+                run = 0;
             }
+            jobs[num_jobs - 1].end_section = s + 1;
+            run += in_sec->size + (uint64_t)in_sec->num_relocs * sizeof(Relocation);
         }
     }
-    return 0;
+    if (num_jobs == 0) return 0;
+
+    uint32_t threads = linker->threads ? linker->threads : u__cpu_count();
+    if (threads > (uint32_t)num_jobs) threads = (uint32_t)num_jobs;
+    UScheduler *sched = u__scheduler_create(threads);
+    if (!sched) {
+        free(jobs);
+        linker_error("Failed to start the linker threads");
+        return -1;
+    }
+    for (int j = 0; j < num_jobs; j++)
+        if (!u__scheduler_submit(sched, write_sections_task, &jobs[j]))
+            write_sections_task(&jobs[j], 0);
+    u__scheduler_wait(sched);
+    u__scheduler_destroy(sched);
+
+    int errors = 0;
+    for (int j = 0; j < num_jobs; j++) errors += jobs[j].errors;
+    free(jobs);
+    return errors ? -1 : 0;
 }
 
 /*
- * Build an ELF executable. This stub creates a minimal ELF file
- * containing the merged section data and an ELF header. In a
- * complete linker it would also generate program headers, a
- * section header table, and proper alignment.
+ * Map a zero-filled output image: header_size bytes of headers followed
+ * by the merged sections, as far apart as layout placed their addresses.
+ * Their file offsets are set here. It is a shared mapping of the output
+ * file when one was given, so the sections are written to it in place,
+ * and anonymous memory otherwise. Returns the image, or NULL with a
+ * message printed.
  */
-static int generate_elf_output(Linker *linker) {
-    /* Simple estimation: ELF header + all merged sections. */
-    size_t elf_header_size = 64; /* minimal ELF header */
-    size_t total_size = elf_header_size;
+static uint8_t *map_output(Linker *linker, uint64_t header_size) {
+    uint64_t total_size = header_size;
     for (int m = 0; m < linker->num_merged_sections; m++) {
-        total_size += linker->merged_sections[m].size;
+        Section *out = &linker->merged_sections[m];
+        out->file_offset = header_size + (out->offset_in_output - linker->merged_sections[0].offset_in_output);
+        if (out->file_offset < header_size || out->size > SIZE_MAX - out->file_offset) {
+            linker_error("Output image too large");
+            return NULL;
+        }
+        total_size = out->file_offset + out->size;
     }
 
-    linker->output_data = (uint8_t *)calloc(1, total_size);
-    if (!linker->output_data) {
-        linker_error("Out of memory for ELF output");
-        return -1;
+    if (linker->output_data) munmap(linker->output_data, linker->output_size);
+    linker->output_data = NULL;
+    linker->output_size = 0;
+    void *map = MAP_FAILED;
+    if (linker->output_path) {
+        int fd = open(linker->output_path, O_RDWR | O_CREAT | O_TRUNC, 0777);
+        if (fd < 0) {
+            linker_error("Cannot open output file for writing");
+            return NULL;
+        }
+        if (ftruncate(fd, (off_t)total_size) == 0)
+            map = mmap(NULL, total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    } else {
+        map = mmap(NULL, total_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (map == MAP_FAILED) {
+        linker_error("Cannot map the output image");
+        return NULL;
     }
+    linker->output_data = map;
     linker->output_size = total_size;
+    return map;
+}
 
-    /* Write a minimal ELF header (magic, class, etc.). */
-    uint8_t *p = linker->output_data;
-    memcpy(p, "\x7f" "ELF", 4); p += 4; /* ELF magic */
-    *p++ = 2;  /* 64-bit */
-    *p++ = 1;  /* little endian */
-    *p++ = 1;  /* ELF version */
-    /* ... many fields omitted ... */
+/*
+ * Start of a program whose entry is main: call it, then exit_group()
+ * with the status it returned. The call's displacement is filled in.
+ */
+static const uint8_t x86_64_start[] = {
+    0x31, 0xED,                         /* xor ebp, ebp */
+    0x48, 0x83, 0xE4, 0xF0,             /* and rsp, -16 */
+    0xE8, 0x00, 0x00, 0x00, 0x00,       /* call main */
+    0x89, 0xC7,                         /* mov edi, eax */
+    0xB8, 0xE7, 0x00, 0x00, 0x00,       /* mov eax, 231 */
+    0x0F, 0x05                          /* syscall */
+};
+#define X86_64_START_CALL 6             /* offset of the call */
+
+static const uint32_t aarch64_start[] = {
+    0xD280001D,                         /* mov x29, #0 */
+    0xD280001E,                         /* mov x30, #0 */
+    0x94000000,                         /* bl main */
+    0xD2800BC8,                         /* mov x8, #94 */
+    0xD4000001                          /* svc #0 */
+};
+#define AARCH64_START_CALL 8            /* offset of the call */
 
-    /* Copy merged section data sequentially. */
-    size_t data_offset = elf_header_size;
-    for (int m = 0; m < linker->num_merged_sections; m++) {
-        memcpy(linker->output_data + data_offset,
-               linker->merged_sections[m].data,
-               linker->merged_sections[m].size);
-        data_offset += linker->merged_sections[m].size;
+/*
+ * Write the start stub at p, whose address is addr, calling main at
+ * target. Returns 0, or -1 if main is out of the call's reach.
+ */
+static int write_start(uint16_t machine, uint8_t *p, uint64_t addr, uint64_t target) {
+    if (machine == ELF_EM_X86_64) {
+        int64_t disp = (int64_t)(target - (addr + X86_64_START_CALL + 5));
+        if (!fits_signed(disp, 32)) return -1;
+        memcpy(p, x86_64_start, sizeof(x86_64_start));
+        wr32(p + X86_64_START_CALL + 1, (uint32_t)disp);
+        return 0;
     }
-
+    int64_t disp = (int64_t)(target - (addr + AARCH64_START_CALL));
+    if (!fits_signed(disp, 28)) return -1;
+    for (size_t i = 0; i < sizeof(aarch64_start) / sizeof(aarch64_start[0]); i++)
+        wr32(p + 4 * i, aarch64_start[i]);
+    wr32(p + AARCH64_START_CALL, aarch64_start[AARCH64_START_CALL / 4] | ((uint32_t)(disp >> 2) & 0x03FFFFFFu));
     return 0;
 }
 
 /*
- * Build a Windows PE (.exe) file. Stub that creates a minimal PE
- * header and copies the merged sections.
+ * Build a static ELF executable: the ELF header and the program headers,
+ * followed by the merged sections, each loaded by a PT_LOAD segment of its
+ * own with its permissions. The headers are loaded too, by a first
+ * segment. When the entry symbol is main, the start stub follows the
+ * program headers and is the entry point; otherwise the entry symbol is.
  */
-static int generate_pe_output(Linker *linker) {
-    size_t pe_header_size = 512; /* rough size for DOS + PE headers */
-    size_t total_size = pe_header_size;
-    for (int m = 0; m < linker->num_merged_sections; m++) {
-        total_size += linker->merged_sections[m].size;
+static int generate_elf_output(Linker *linker) {
+    uint16_t machine = linker->objects[0].machine;
+    for (int i = 1; i < linker->num_objects; i++) {
+        if (linker->objects[i].machine != machine) {
+            linker_error("Cannot link %s with objects for another machine", linker->objects[i].filename);
+            return -1;
+        }
+    }
+    int phnum = 1;
+    for (int m = 0; m < linker->num_merged_sections; m++)
+        if (linker->merged_sections[m].size) phnum++;
+    int start = linker->entry_symbol && strcmp(linker->entry_symbol, "main") == 0;
+    uint64_t start_offset = ELF_EHDR64_SIZE + (uint64_t)phnum * ELF_PHDR64_SIZE;
+    uint64_t start_size = !start ? 0 : machine == ELF_EM_X86_64 ? sizeof(x86_64_start) : sizeof(aarch64_start);
+    uint64_t header_size = (start_offset + start_size + LINKER_PAGE - 1) / LINKER_PAGE * LINKER_PAGE;
+    uint64_t base = (linker->num_merged_sections ? linker->merged_sections[0].offset_in_output
+                                                 : LINKER_BASE) - header_size;
+
+    uint8_t *p = map_output(linker, header_size);
+    if (!p) return -1;
+    uint64_t entry = linker->entry_address;
+    if (start) {
+        entry = base + start_offset;
+        if (write_start(machine, p + start_offset, entry, linker->entry_address) != 0) {
+            linker_error("Entry symbol %s out of range of the start code", linker->entry_symbol);
+            return -1;
+        }
     }
 
-    linker->output_data = (uint8_t *)calloc(1, total_size);
-    if (!linker->output_data) {
-        linker_error("Out of memory for PE output");
-        return -1;
+    memcpy(p, "\x7f" "ELF", 4);
+    p[4] = ELF_CLASS64;
+    p[5] = ELF_DATA2LSB;
+    p[6] = 1;                                   /* EV_CURRENT */
+    wr16(p + 16, ELF_ET_EXEC);
+    wr16(p + 18, machine);
+    wr32(p + 20, 1);                            /* EV_CURRENT */
+    wr64(p + 24, entry);
+    wr64(p + 32, ELF_EHDR64_SIZE);              /* program headers follow */
+    wr16(p + 52, ELF_EHDR64_SIZE);
+    wr16(p + 54, ELF_PHDR64_SIZE);
+    wr16(p + 56, (uint16_t)phnum);
+
+    uint8_t *ph = p + ELF_EHDR64_SIZE;
+    wr32(ph, ELF_PT_LOAD);
+    wr32(ph + 4, ELF_PF_R | ELF_PF_X);
+    wr64(ph + 16, base);
+    wr64(ph + 24, base);
+    wr64(ph + 32, header_size);
+    wr64(ph + 40, header_size);
+    wr64(ph + 48, LINKER_PAGE);
+    for (int m = 0; m < linker->num_merged_sections; m++) {
+        const Section *out = &linker->merged_sections[m];
+        if (!out->size) continue;
+        ph += ELF_PHDR64_SIZE;
+        wr32(ph, ELF_PT_LOAD);
+        wr32(ph + 4, ELF_PF_R | ((out->flags & 0x2) ? ELF_PF_W : 0) | ((out->flags & 0x4) ? ELF_PF_X : 0));
+        wr64(ph + 8, out->file_offset);
+        wr64(ph + 16, out->offset_in_output);
+        wr64(ph + 24, out->offset_in_output);
+        wr64(ph + 32, out->size);
+        wr64(ph + 40, out->size);
+        wr64(ph + 48, LINKER_PAGE);
     }
-    linker->output_size = total_size;
+    return 0;
+}
+
+/*
+ * Build a Windows PE (.exe) file. Stub that creates a minimal PE
+ * header; the merged sections follow it.
+ */
+static int generate_pe_output(Linker *linker) {
+    uint8_t *p = map_output(linker, 512); /* rough size for DOS + PE headers */
+    if (!p) return -1;
 
     /* DOS header "MZ" */
-    linker->output_data[0] = 'M';
-    linker->output_data[1] = 'Z';
+    p[0] = 'M';
+    p[1] = 'Z';
     /* PE signature "PE\0\0" at offset 0x3C (typically) */
     /* ... many fields omitted ... */
 
-    size_t data_offset = pe_header_size;
-    for (int m = 0; m < linker->num_merged_sections; m++) {
-        memcpy(linker->output_data + data_offset,
-               linker->merged_sections[m].data,
-               linker->merged_sections[m].size);
-        data_offset += linker->merged_sections[m].size;
-    }
-
     return 0;
 }
 
 /*
  * Build a Mach-O executable. Stub that creates a minimal Mach-O
- * header and appends the merged sections.
+ * header; the merged sections follow it.
  */
 static int generate_macho_output(Linker *linker) {
-    size_t mach_header_size = 256; /* approximate */
-    size_t total_size = mach_header_size;
-    for (int m = 0; m < linker->num_merged_sections; m++) {
-        total_size += linker->merged_sections[m].size;
-    }
-
-    linker->output_data = (uint8_t *)calloc(1, total_size);
-    if (!linker->output_data) {
-        linker_error("Out of memory for Mach-O output");
-        return -1;
-    }
-    linker->output_size = total_size;
+    uint8_t *p = map_output(linker, 256); /* approximate */
+    if (!p) return -1;
 
     /* Mach-O magic number (64-bit, little endian): 0xFEEDFACF */
     uint32_t magic = 0xFEEDFACF;
-    memcpy(linker->output_data, &magic, sizeof(magic));
+    memcpy(p, &magic, sizeof(magic));
     /* ... remaining header fields omitted ... */
 
-    size_t data_offset = mach_header_size;
-    for (int m = 0; m < linker->num_merged_sections; m++) {
-        memcpy(linker->output_data + data_offset,
-               linker->merged_sections[m].data,
-               linker->merged_sections[m].size);
-        data_offset += linker->merged_sections[m].size;
-    }
-
     return 0;
 }
 
 /*
- * Print an error message. In a real tool this would be more
- * elaborate, perhaps including file and line information.
+ * Print an error message, formatted as by printf(). In a real tool
+ * this would be more elaborate, perhaps including file and line
+ * information. The stream is locked, so messages from the threads of
+ * write_sections() come out whole.
  */
-static void linker_error(const char *msg) {
-    fprintf(stderr, "Linker error: %s\n", msg);
+static void linker_error(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    flockfile(stderr);
+    fputs("Linker error: ", stderr);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    funlockfile(stderr);
+    va_end(args);
 }
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "../utils/arena.h"
 
 /*
  * Supported executable output formats.
@@ -15,6 +16,25 @@ typedef enum {
     FORMAT_MACHO   /* Mach-O (macOS, iOS, ...) */
 } OutputFormat;
 
+/*
+ * Identical code folding (--icf=safe|all). Safe mode leaves alone the
+ * functions whose address is taken, which the program may compare.
+ */
+typedef enum {
+    ICF_NONE,
+    ICF_SAFE,
+    ICF_ALL
+} IcfMode;
+
+/*
+ * Open-addressing table of names; its slots are defined in linker.c.
+ */
+typedef struct {
+    struct NameSlot *slots;          /* Capacity a power of two, at most half full */
+    uint32_t capacity;
+    uint32_t count;
+} NameTable;
+
 /*
  * Opaque linker context. All state is maintained inside this
  * structure and must be initialised with linker__init() before use.
@@ -23,15 +43,51 @@ typedef enum {
  */
 typedef struct {
     /* Internal fields - do not access directly. */
-    struct ObjectFile objects[256];  /* max objects, defined in .c */
+
+    /* Records of the input objects: file names, section, symbol and
+     * relocation tables. Released at once by linker__destroy(). */
+    UArena arena;
+
+    struct ObjectFile *objects;      /* Grows as objects are added */
     int num_objects;
-    OutputFormat output_format;
-    char entry_symbol[64];
-    size_t entry_address;
-    struct Section merged_sections[16];
+    int objects_capacity;
+
+    OutputFormat output_format;      /* Target executable format chosen by the user */
+
+    const char *entry_symbol;        /* Name of the entry point (e.g. "_start"), or NULL */
+    uint64_t entry_address;          /* Final virtual address of the entry point (set during link) */
+
+    /* Global symbol table, built when symbols are resolved. */
+    NameTable symbol_table;
+    struct GlobalSymbol *globals;
+    int num_globals;
+    int globals_capacity;
+
+    /* Merged section table after symbol resolution and layout, indexed
+     * by section name. */
+    struct Section *merged_sections;
     int num_merged_sections;
+    int merged_capacity;
+    NameTable section_table;
+
+    /* Output image: a mapping of output_path when set, else of anonymous
+     * memory. */
+    const char *output_path;
     uint8_t *output_data;
     size_t output_size;
+
+    /* Threads copying and relocating sections, 0 for one per processor. */
+    uint32_t threads;
+
+    /* --gc-sections: drop sections the entry point cannot reach. */
+    int gc_sections;
+    uint64_t gc_removed_bytes;
+    int gc_removed_sections;
+
+    /* --icf: fold identical sections into one. */
+    IcfMode icf;
+    uint64_t icf_saved_bytes;
+    int icf_folded_sections;
 } Linker;
 
 /*
@@ -45,6 +101,8 @@ void linker__init(Linker *linker);
  * is guessed from the extension (.o for ELF objects, .obj for
  * COFF/PE objects, .macho for Mach-O objects). All sections,
  * symbols and relocations are extracted and stored internally.
+ * ELF64 objects (x86-64, AArch64) are mapped read-only and their
+ * section contents used in place until linker__destroy().
  *
  * Returns 0 on success, -1 on error (e.g. unsupported format,
  * too many input files, or parse failure).
@@ -61,14 +119,68 @@ void linker__set_output_format(Linker *linker, OutputFormat fmt);
  * Specify the name of the entry point symbol (e.g. "_start",
  * "main", "WinMain"). The linker will resolve this symbol during
  * the linking phase and record its final address. If not set, no
- * entry point is forced.
+ * entry point is forced. An ELF executable whose entry is "main" starts
+ * in a stub that calls it and exits with the status it returns.
  */
 void linker__set_entry(Linker *linker, const char *symbol_name);
 
+/*
+ * Enable (--gc-sections) or disable garbage collection of sections.
+ * Sections no relocation path from the entry symbol reaches are left
+ * out of the output and their total size is reported. Objects compiled
+ * with -ffunction-sections/-fdata-sections give it one section per
+ * function or data object to drop.
+ */
+void linker__set_gc_sections(Linker *linker, int enable);
+
+/*
+ * Select identical code folding. Read-only code and data sections with
+ * the same bytes, whose relocations refer to the same symbols or to
+ * sections folded together, are kept once and the symbols of the others
+ * redirected to that copy; the bytes saved are reported. ICF_SAFE skips
+ * sections referenced other than by a call or jump from a section left
+ * in the output, ICF_ALL folds them too. Like --gc-sections, it works
+ * on the sections of -ffunction-sections objects. The default is
+ * ICF_NONE.
+ */
+void linker__set_icf(Linker *linker, IcfMode mode);
+
+/*
+ * Link into outpath directly: the output image is a shared mapping of
+ * the file, which the sections are copied and relocated into, and
+ * linker__write_to_file() to the same path only flushes it. By default
+ * the image is anonymous memory and is written out by
+ * linker__write_to_file().
+ */
+void linker__set_output_file(Linker *linker, const char *outpath);
+
+/*
+ * Number of threads (-threads N) copying the input sections into the
+ * output image and applying their relocations; every section is
+ * written to a range of its own. 0, the default, uses one thread per
+ * processor.
+ */
+void linker__set_threads(Linker *linker, uint32_t threads);
+
 /*
  * Run all linking phases in sequence: symbol resolution, section
- * merging, layout, relocation, and output generation. After this
- * call, the final executable image is available for writing.
+ * merging, layout, output generation, and the copying and relocation
+ * of sections. After this call, the final executable image is
+ * available for writing.
+ *
+ * FORMAT_ELF produces a static ELF64 executable: each merged section
+ * starts a page of its own, loaded by a PT_LOAD segment with the
+ * section's permissions, after a page of headers at 0x400000.
+ *
+ * x86-64 relocations R_X86_64_64, 32, 32S, PC32 and PLT32 are applied
+ * directly; no GOT is built, so GOTPCREL loads, calls and jumps are
+ * relaxed to compute the address. AArch64 takes the CALL26, JUMP26,
+ * ADR_PREL_PG_HI21 and ADD_ABS_LO12_NC relocations of paxsy's own
+ * assembler.
+ *
+ * Global symbols are resolved through a hash table: a strong definition
+ * overrides weak ones. Every symbol defined strongly by two objects, and
+ * every symbol only referenced, is reported with the objects involved.
  *
  * Returns 0 on success, -1 if any phase fails (unresolved symbols,
  * unsupported relocations, etc.).
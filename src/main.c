@@ -20,10 +20,13 @@
  * SOFTWARE.
  */
 
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "preprocessor/preprocessor.h"
 #include "preprocessor/defmacros/defmacros.h"
@@ -33,6 +36,16 @@
 #include "semantic/semantic.h"
 #include "optimizer/optimizer.h"
 #include "ir/ir.h"
+#include "ir/irpass/irpass.h"
+#include "utils/scheduler.h"
+#include "ir/remark/remark.h"
+#include "ir/profile/profile.h"
+#include "ir/bitcode/bitcode.h"
+#include "ir/lto/lto.h"
+#include "ir/interp/interp.h"
+#include "jit/jit.h"
+#include "codegen/codegen.h"
+#include "linker/linker.h"
 #include "errhandler/errhandler.h"
 #include "utils/str_utils.h"
 #include "utils/char_utils.h"
@@ -80,7 +93,17 @@ enum {
     F_WIGNOR             = 1U << 16,
     F_DEBUG_SYMBOLS      = 1U << 17,
     F_OUTPUT_ASSEMBLY    = 1U << 18,
-    F_MODE_STATIC_LIB    = 1U << 19
+    F_MODE_STATIC_LIB    = 1U << 19,
+    F_EMIT_BITCODE       = 1U << 20,
+    F_LTO                = 1U << 21,
+    F_RUN                = 1U << 22,
+    F_JIT                = 1U << 23,
+    F_FUNCTION_SECTIONS  = 1U << 24,
+    F_DATA_SECTIONS      = 1U << 25,
+    F_MODE_LINK          = 1U << 26,
+    F_GC_SECTIONS        = 1U << 27,
+    F_EXECUTE            = F_RUN | F_JIT,
+    F_IR_OUTPUT          = F_MODE_COMPILE | F_OUTPUT_ASSEMBLY | F_EMIT_BITCODE | F_LTO | F_EXECUTE
 };
 
 #define FILENAMES_BLOCK 8
@@ -101,6 +124,12 @@ typedef struct {
     const char* target_arch;
     const char* target_core;
     const char* target_bits;
+    char*   profile_generate;
+    char*   profile_use;
+    uint32_t threads;           /* 0 selects one per processor */
+    uint32_t tier_up_calls;     /* -jit-tier-up */
+    const char* link_format;    /* --c */
+    const char* icf;            /* --icf, NULL when not folding */
 } Arguments;
 
 static int dynamic_string_push(char*** array, size_t* count, size_t* capacity,
@@ -113,22 +142,34 @@ static const char** split_into_lines(const char* text, size_t* out_count);
 static void free_lines(const char** lines, size_t count);
 static char* derive_assembly_filename(const char* source);
 static char* derive_optimized_ast_filename(const char* source);
+static char* derive_bitcode_filename(const char* source);
 static void lexer_output_writer(FILE* f, void* data);
 static void parser_output_writer(FILE* f, void* data);
 static void semantic_output_writer(FILE* f, void* data);
 static void optimizer_output_writer(FILE* f, void* data);
 static void ir_output_writer(FILE* f, void* data);
+static void ir_time_writer(FILE* f, void* data);
 static const char* detect_target_os(void);
 static const char* detect_target_arch(void);
 static const char* detect_target_bits(void);
 static int process_one_file(const char* filename, const char* output_file,
                             FlagSet flags, const Arguments* args,
-                            SemanticContext** semantic_ctx);
+                            SemanticContext** semantic_ctx, int* run_status);
+static int link_time_optimize(char** inputs, size_t count, const char* output_file,
+                              FlagSet flags, const Arguments* args, int* run_status);
+static void write_output(IrModule* mod, const char* source,
+                         const char* output_file, FlagSet flags, const Arguments* args);
+static int run_program(IrModule* mod, FlagSet flags, const Arguments* args, int* run_status);
+static char* link_object_filename(const char* temp_dir, size_t index, const char* source);
+static int link_executable(char** objects, size_t count, const char* output_file,
+                           FlagSet flags, const Arguments* args);
 static int arg_matches(const char* arg, const char* prefix, const char** out_rest);
 static void parse_debug_info(const char* value, FlagSet* flags);
-static int validate_target_arch(const char* value);
-static int validate_target_core(const char* value);
-static int validate_target_bits(const char* value);
+static const char* validate_target_arch(const char* value);
+static const char* validate_target_core(const char* value);
+static const char* validate_link_format(const char* value);
+static const char* validate_icf(const char* value);
+static const char* validate_target_bits(const char* value);
 static void print_usage(void);
 static void print_version(void);
 static int parse_arguments(int argc, char* argv[], Arguments* args);
@@ -200,26 +241,38 @@ static void parse_debug_info(const char* value, FlagSet* flags) {
     }
 }
 
-static int validate_target_arch(const char* value) {
-    if (!value) return 0;
-    return (u__streq(value, "x86") || u__streq(value, "x86_64") ||
-            u__streq(value, "amd64") || u__streq(value, "arm") ||
-            u__streq(value, "nativ"));
+/* The known value equal to value, or NULL.  The known strings outlive the
+ * argument vector, which is freed once the arguments are parsed. */
+static const char* known_value(const char* value, const char* const* known, size_t count) {
+    if (!value) return NULL;
+    for (size_t i = 0; i < count; ++i)
+        if (u__streq(value, known[i])) return known[i];
+    return NULL;
+}
+
+static const char* validate_target_arch(const char* value) {
+    static const char* const known[] = { "x86", "x86_64", "amd64", "arm", "aarch64", "nativ" };
+    return known_value(value, known, sizeof(known) / sizeof(known[0]));
+}
+
+static const char* validate_link_format(const char* value) {
+    static const char* const known[] = { "elf", "exe", "app", "nativ" };
+    return known_value(value, known, sizeof(known) / sizeof(known[0]));
+}
+
+static const char* validate_icf(const char* value) {
+    static const char* const known[] = { "safe", "all" };
+    return known_value(value, known, sizeof(known) / sizeof(known[0]));
 }
 
-static int validate_target_core(const char* value) {
-    if (!value) return 0;
-    return (u__streq(value, "UNIX") || u__streq(value, "BSD") ||
-            u__streq(value, "GNUHurd") || u__streq(value, "Linux") ||
-            u__streq(value, "Darwin") || u__streq(value, "NT") ||
-            u__streq(value, "nativ"));
+static const char* validate_target_core(const char* value) {
+    static const char* const known[] = { "UNIX", "BSD", "GNUHurd", "Linux", "Darwin", "NT", "nativ" };
+    return known_value(value, known, sizeof(known) / sizeof(known[0]));
 }
 
-static int validate_target_bits(const char* value) {
-    if (!value) return 0;
-    return (u__streq(value, "64") || u__streq(value, "32") ||
-            u__streq(value, "16") || u__streq(value, "8") ||
-            u__streq(value, "nativ"));
+static const char* validate_target_bits(const char* value) {
+    static const char* const known[] = { "64", "32", "16", "8", "nativ" };
+    return known_value(value, known, sizeof(known) / sizeof(known[0]));
 }
 
 static void print_usage(void) {
@@ -230,7 +283,17 @@ static void print_usage(void) {
            "  \033[1m--c=<format>\033[0m            Compile files into an executable file with the\n"
            "                          specified format.\n"
            "                           --c={{elf|exe|app}|nativ}\n"
+           "                          Sources are compiled to objects first; .o inputs\n"
+           "                          are linked as they are. The entry point is main.\n"
+           "  \033[1m--gc-sections\033[0m           Leave out of the executable the sections main\n"
+           "                          does not reach, with -ffunction-sections objects.\n"
+           "  \033[1m--icf=<mode>\033[0m            Keep one copy of identical functions and read-only\n"
+           "                          data, with -ffunction-sections objects; safe\n"
+           "                          leaves those whose address is taken.\n"
+           "                           --icf={safe|all}\n"
            "  \033[1m-o\033[0m                      Compile a binary file (overrides output file).\n"
+           "                          Without -S this is an object file from the\n"
+           "                          integrated assembler.\n"
            "  \033[1m-S\033[0m                      Compile to assembly only (generates .s files).\n"
            "  \033[1m-shared\033[0m                 Compile shared object file.\n"
            "  \033[1m-state\033[0m                  Create a static library archive (.a file).\n"
@@ -242,12 +305,33 @@ static void print_usage(void) {
            "  \033[1m-Werror\033[0m                 Turns all warnings into errors.\n"
            "  \033[1m-Wignor\033[0m                 Turns off warnings.\n"
            "  \033[1m--tarch=<arch>\033[0m          Specify the target processor architecture.\n"
-           "                           --tarch={{x86|x86_64|amd64|arm}|nativ}\n"
+           "                           --tarch={{x86|x86_64|amd64|arm|aarch64}|nativ}\n"
            "  \033[1m--tcore=<core>\033[0m          Specify the target core of the system.\n"
            "                           --tcore={{UNIX|BSD|GNUHurd|Linux|Darwin|NT}|\n"
            "                             |nativ}\n"
            "  \033[1m--tbits=<bits>\033[0m          Specify the target bit size of the processor.\n"
            "                           --tbits={{64/32/16/8}|nativ}\n"
+           "  \033[1m-fprofile-generate[=<file>]\033[0m\n"
+           "                           Instrument the program to record block counts.\n"
+           "  \033[1m-fprofile-use=<file>\033[0m    Optimise using counts recorded by -fprofile-generate.\n"
+           "  \033[1m-emit-bitcode\033[0m           Write the optimised IR of each source to <name>.pxbc;\n"
+           "                           .pxbc inputs are read instead of compiled.\n"
+           "  \033[1m-flto\033[0m                   Write each source as <name>.pxbc, then link every\n"
+           "                           input and optimise the whole program at once.\n"
+           "  \033[1m-ffunction-sections\033[0m     Place each function of an object file in its own\n"
+           "                           .text.<name> section, for --gc-sections.\n"
+           "  \033[1m-fdata-sections\033[0m         Likewise a .data.<name> section per data object.\n"
+           "  \033[1m-run\033[0m                    Run the program in the IR interpreter instead of\n"
+           "                           writing output; its exit status is paxsy's.\n"
+           "  \033[1m-jit\033[0m                    Like -run, but compile the program to native code\n"
+           "                           in memory first (x86-64 hosts).\n"
+           "  \033[1m-jit-tier-up=<n>\033[0m        Recompile a function optimised after n calls\n"
+           "                           under -jit; 0 never does (default: 1000).\n"
+           "  \033[1m-threads=<n>\033[0m            Optimise and compile functions, and copy and\n"
+           "                           relocate the sections of --c, on n threads\n"
+           "                           (default: all processors); also -threads <n>.\n"
+           "  \033[1m-Rpass=<pass>\033[0m           Report transformations made by a pass.\n"
+           "                           -Rpass={heap2stack|loop-idiom|inline|consteval}\n"
            "  \033[1m--debug-info=<mod>\033[0m      Debug output (off by default).\n"
            "                           --debug-info={{preprocess|lexical|syntax|\n"
            "                             |semantic|ir|optim|compile|build|linker}|all}\n"
@@ -420,6 +504,7 @@ static int expand_at_files(int* argc, char*** argv) {
 
 static int parse_arguments(int argc, char* argv[], Arguments* args) {
     memset(args, 0, sizeof(*args));
+    args->tier_up_calls = JIT_DEFAULT_TIER_UP_CALLS;
     args->file_capacity = (argc / 2) + FILENAMES_BLOCK;
     args->filenames = (char**)memory_allocate_zero(args->file_capacity * sizeof(char*));
     if (!args->filenames) {
@@ -478,38 +563,112 @@ static int parse_arguments(int argc, char* argv[], Arguments* args) {
             continue;
         }
         if (u__streq(arg, "-shared")) { args->flags |= F_MODE_COMPILE; continue; }
-        if (arg_matches(arg, "--c", &rest)) { args->flags |= F_MODE_COMPILE; continue; }
+        if (arg_matches(arg, "--c", &rest)) {
+            const char* known = validate_link_format(rest ? rest : "nativ");
+            if (!known) {
+                errhandler__report_error(ERROR_CODE_INPUT_INVALID_FLAG, 0, 0, "input",
+                                         "Invalid value for --c: %s", rest);
+                continue;
+            }
+            args->link_format = known;
+            args->flags |= F_MODE_COMPILE | F_MODE_LINK;
+            continue;
+        }
+        if (u__streq(arg, "--gc-sections")) { args->flags |= F_GC_SECTIONS; continue; }
+        if (arg_matches(arg, "--icf", &rest)) {
+            const char* known = validate_icf(rest);
+            if (!known) {
+                errhandler__report_error(ERROR_CODE_INPUT_INVALID_FLAG, 0, 0, "input",
+                                         "Invalid value for --icf: %s", rest ? rest : "(null)");
+                continue;
+            }
+            args->icf = known;
+            continue;
+        }
         if (u__streq(arg, "-time")) { args->flags |= F_TIME; continue; }
+        if (u__streq(arg, "-emit-bitcode")) { args->flags |= F_EMIT_BITCODE; continue; }
+        if (u__streq(arg, "-flto")) { args->flags |= F_LTO; continue; }
+        if (u__streq(arg, "-ffunction-sections")) { args->flags |= F_FUNCTION_SECTIONS; continue; }
+        if (u__streq(arg, "-fdata-sections")) { args->flags |= F_DATA_SECTIONS; continue; }
+        if (u__streq(arg, "-run")) { args->flags |= F_RUN; continue; }
+        if (u__streq(arg, "-jit")) { args->flags |= F_JIT; continue; }
         if (u__streq(arg, "-g")) { args->flags |= F_DEBUG_SYMBOLS; continue; }
         if (u__streq(arg, "-Wall")) { args->flags |= F_WALL; continue; }
         if (u__streq(arg, "-Wextra")) { args->flags |= F_WEXTRA; continue; }
         if (u__streq(arg, "-Werror")) { args->flags |= F_WERROR; continue; }
         if (u__streq(arg, "-Wignor")) { args->flags |= F_WIGNOR; continue; }
         if (arg_matches(arg, "--tarch", &rest)) {
-            if (!validate_target_arch(rest)) {
+            const char* known = validate_target_arch(rest);
+            if (!known) {
                 errhandler__report_error(ERROR_CODE_INPUT_INVALID_FLAG, 0, 0, "input",
                                          "Invalid value for --tarch: %s", rest ? rest : "(null)");
                 continue;
             }
-            args->target_arch = rest;
+            args->target_arch = known;
             continue;
         }
         if (arg_matches(arg, "--tcore", &rest)) {
-            if (!validate_target_core(rest)) {
+            const char* known = validate_target_core(rest);
+            if (!known) {
                 errhandler__report_error(ERROR_CODE_INPUT_INVALID_FLAG, 0, 0, "input",
                                          "Invalid value for --tcore: %s", rest ? rest : "(null)");
                 continue;
             }
-            args->target_core = rest;
+            args->target_core = known;
             continue;
         }
         if (arg_matches(arg, "--tbits", &rest)) {
-            if (!validate_target_bits(rest)) {
+            const char* known = validate_target_bits(rest);
+            if (!known) {
                 errhandler__report_error(ERROR_CODE_INPUT_INVALID_FLAG, 0, 0, "input",
                                          "Invalid value for --tbits: %s", rest ? rest : "(null)");
                 continue;
             }
-            args->target_bits = rest;
+            args->target_bits = known;
+            continue;
+        }
+        if (arg_matches(arg, "-fprofile-generate", &rest)) {
+            memory_free_safe((void**)&args->profile_generate);
+            args->profile_generate = u__strdup_safe((rest && *rest) ? rest : PROFILE_DEFAULT_FILE);
+            continue;
+        }
+        if (arg_matches(arg, "-fprofile-use", &rest)) {
+            if (!rest || !*rest) {
+                errhandler__report_error(ERROR_CODE_INPUT_INVALID_FLAG, 0, 0, "input",
+                                         "Missing profile file after -fprofile-use=");
+                continue;
+            }
+            memory_free_safe((void**)&args->profile_use);
+            args->profile_use = u__strdup_safe(rest);
+            continue;
+        }
+        if (arg_matches(arg, "-threads", &rest)) {
+            if (!rest && i + 1 < argc) rest = argv[++i];  /* -threads <n> */
+            char* end = NULL;
+            unsigned long n = (rest && *rest) ? strtoul(rest, &end, 10) : 0;
+            if (!end || *end != '\0' || n == 0 || n > U__SCHEDULER_MAX_THREADS) {
+                errhandler__report_error(ERROR_CODE_INPUT_INVALID_FLAG, 0, 0, "input",
+                                         "Invalid value for -threads: %s", rest ? rest : "(null)");
+                continue;
+            }
+            args->threads = (uint32_t)n;
+            continue;
+        }
+        if (arg_matches(arg, "-jit-tier-up", &rest)) {
+            char* end = NULL;
+            unsigned long n = (rest && *rest) ? strtoul(rest, &end, 10) : 0;
+            if (!end || *end != '\0' || n > INT32_MAX) {
+                errhandler__report_error(ERROR_CODE_INPUT_INVALID_FLAG, 0, 0, "input",
+                                         "Invalid value for -jit-tier-up: %s", rest ? rest : "(null)");
+                continue;
+            }
+            args->tier_up_calls = (uint32_t)n;
+            continue;
+        }
+        if (arg_matches(arg, "-Rpass", &rest)) {
+            if (!remark__enable(rest))
+                errhandler__report_error(ERROR_CODE_INPUT_INVALID_FLAG, 0, 0, "input",
+                                         "Invalid value for -Rpass: %s", rest ? rest : "(null)");
             continue;
         }
         if (arg_matches(arg, "--debug-info", &rest)) {
@@ -668,6 +827,34 @@ static char* derive_optimized_ast_filename(const char* source) {
     return opt_name;
 }
 
+static char* derive_bitcode_filename(const char* source) {
+    if (!source) return NULL;
+    const char* last_slash = strrchr(source, '/');
+    const char* last_backslash = strrchr(source, '\\');
+    const char* file_start = source;
+    if (last_slash) file_start = last_slash + 1;
+    if (last_backslash && last_backslash > last_slash) file_start = last_backslash + 1;
+    const char* last_dot = strrchr(file_start, '.');
+    size_t base_len = last_dot ? (size_t)(last_dot - source) : strlen(source);
+    size_t ext_len = strlen(BITCODE_EXTENSION);
+    char* bc_name = (char*)memory_allocate_zero(base_len + ext_len + 1);
+    if (!bc_name) return NULL;
+    memcpy(bc_name, source, base_len);
+    memcpy(bc_name + base_len, BITCODE_EXTENSION, ext_len + 1);
+    return bc_name;
+}
+
+/* A module holding every function of a bitcode file, or NULL on error. */
+static IrModule* read_bitcode_module(const char* filename) {
+    IrModule* mod = ir__module_create(NULL);
+    if (!mod) return NULL;
+    IrBitcode* bc = ir__read_bitcode(filename, mod);
+    bool ok = bc && ir__bitcode_load_all(bc);
+    ir__bitcode_close(bc);
+    if (!ok) { ir__module_destroy(mod); return NULL; }
+    return mod;
+}
+
 static void lexer_output_writer(FILE* f, void* data) {
     Lexer* lexer = (Lexer*)data;
     print_tokens_in_lines(lexer, f);
@@ -693,6 +880,17 @@ static void ir_output_writer(FILE* f, void* data) {
     output__print_ir_module(mod, f);
 }
 
+typedef struct {
+    IrModule* mod;
+    double    pass_ms;
+} IrTiming;
+
+static void ir_time_writer(FILE* f, void* data) {
+    IrTiming* timing = (IrTiming*)data;
+    fprintf(f, "IR passes: %.3f ms\n", timing->pass_ms);
+    output__print_ir_analysis_statistics(timing->mod, f);
+}
+
 static const char* detect_target_os(void) {
 #if defined(_WIN32) || defined(_WIN64)
     return "NT";
@@ -749,7 +947,7 @@ static const char* detect_target_bits(void) {
 
 static int process_one_file(const char* filename, const char* output_file,
                             FlagSet flags, const Arguments* args,
-                            SemanticContext** semantic_ctx) {
+                            SemanticContext** semantic_ctx, int* run_status) {
     int err = 0;
     size_t file_size = 0;
     char* raw = NULL;
@@ -760,6 +958,14 @@ static int process_one_file(const char* filename, const char* output_file,
     const char** lines = NULL;
     size_t line_count = 0;
     errhandler__set_current_filename(filename);
+    remark__set_filename(filename);
+    if (u__str_endw(filename, BITCODE_EXTENSION)) {
+        /* Already optimised: straight to the output stage. */
+        ir_mod = read_bitcode_module(filename);
+        if (!ir_mod) { err = 1; goto cleanup; }
+        write_debug_output(flags, F_DEBUG_IR, ir_output_writer, ir_mod);
+        goto emit;
+    }
     raw = read_file_contents(filename, &file_size);
     if (!raw) { err = 1; goto cleanup; }
     processed = preprocess(raw, filename, NULL);
@@ -780,19 +986,54 @@ static int process_one_file(const char* filename, const char* output_file,
     }
     if (*semantic_ctx && ast && !errhandler__has_errors()) {
         if (flags & F_WEXTRA) semantic__set_extra_warnings(*semantic_ctx, true);
+        /* Under -flto or --c, main and the callees of a prototype may be in
+         * another unit. */
+        if (flags & (F_LTO | F_MODE_LINK)) semantic__set_partial_unit(*semantic_ctx, true);
         semantic__analyze(*semantic_ctx, ast);
         write_debug_output(flags, F_DEBUG_SEMANTIC, semantic_output_writer, *semantic_ctx);
         if (!errhandler__has_errors()) {
             ir_mod = ir__generate_module(*semantic_ctx, ast);
             if (ir_mod) {
+                /* Profiles describe the CFG as generated, before any pass. */
+                if (args->profile_use) {
+                    ProfileData* prof = profile__read(args->profile_use);
+                    if (prof) profile__apply(prof, ir_mod);
+                    profile__destroy(prof);
+                }
+                if (args->profile_generate && !profile__instrument_module(ir_mod, args->profile_generate))
+                    err = 1;
                 write_debug_output(flags, F_DEBUG_IR, ir_output_writer, ir_mod);
+                IrPassOptions ir_opts;
+                irpass__default_options(&ir_opts);
+                ir_opts.threads = args->threads;
+                /* Blocks are laid out once the program is linked. */
+                if (flags & F_LTO) ir_opts.enable_layout = false;
+                struct timespec start, end;
+                timespec_get(&start, TIME_UTC);
+                /* -jit optimises a function once it is called often. */
+                if (!(flags & F_JIT) || (flags & F_LTO))
+                    if (!irpass__run_module(ir_mod, &ir_opts)) err = 1;
+                timespec_get(&end, TIME_UTC);
+                IrTiming timing = {
+                    ir_mod,
+                    (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6
+                };
+                write_debug_output(flags, F_TIME, ir_time_writer, &timing);
+                write_debug_output(flags, F_DEBUG_OPTIM, ir_output_writer, ir_mod);
+                if ((flags & (F_EMIT_BITCODE | F_LTO)) && !err) {
+                    char* bc_filename = derive_bitcode_filename(filename);
+                    if (!bc_filename || !ir__write_bitcode(ir_mod, bc_filename)) err = 1;
+                    memory_free_safe((void**)&bc_filename);
+                }
             } else {
                 errhandler__report_error(ERROR_CODE_MEMORY_ALLOCATION, 0, 0, "ir",
                                          "IR module generation failed");
                 err = 1;
             }
         }
-        if (!errhandler__has_errors()) {
+        /* The IR is generated before the AST optimizer runs, so the outputs
+         * built from it do not need the optimized AST. */
+        if (!errhandler__has_errors() && !(flags & F_IR_OUTPUT)) {
             if (flags & F_DEBUG_OPTIM) {
                 optimizer__enable_debug(true);
                 optimizer__set_debug_file(stdout);
@@ -818,16 +1059,12 @@ static int process_one_file(const char* filename, const char* output_file,
             write_debug_output(flags, F_DEBUG_OPTIM, optimizer_output_writer, ast);
         }
     }
-    if ((flags & F_OUTPUT_ASSEMBLY) && ir_mod && !errhandler__has_errors() && output_file) {
-        FILE *asm_out = fopen(output_file, "w");
-        if (asm_out) {
-            fprintf(asm_out, "; ARM AArch64 assembly placeholder for %s\n", filename);
-            fclose(asm_out);
-        } else {
-            errhandler__report_error(ERROR_CODE_IO_WRITE, 0, 0, "file",
-                                     "Cannot open assembly output: %s", output_file);
-        }
-    }
+emit:
+    if ((flags & (F_OUTPUT_ASSEMBLY | F_MODE_COMPILE)) && !(flags & F_LTO) && ir_mod && !errhandler__has_errors())
+        write_output(ir_mod, filename, output_file, flags, args);
+    if ((flags & F_EXECUTE) && !(flags & F_LTO) && ir_mod && !err && !errhandler__has_errors() &&
+        run_program(ir_mod, flags, args, run_status))
+        err = 1;
 cleanup:
     errhandler__clear_source_code();
     if (lines) free_lines(lines, line_count);
@@ -837,6 +1074,157 @@ cleanup:
     memory_free_safe((void**)&processed);
     memory_free_safe((void**)&raw);
     errhandler__set_current_filename(NULL);
+    remark__set_filename(NULL);
+    return err || errhandler__has_errors();
+}
+
+typedef struct {
+    double   run_ms;
+    uint64_t steps;
+} RunTiming;
+
+static void run_time_writer(FILE* f, void* data) {
+    RunTiming* timing = (RunTiming*)data;
+    fprintf(f, "Run: %.3f ms, %llu steps\n", timing->run_ms, (unsigned long long)timing->steps);
+}
+
+static void jit_time_writer(FILE* f, void* data) {
+    JitStats* stats = (JitStats*)data;
+    fprintf(f, "JIT: compile %.3f ms, run %.3f ms, %u/%u functions recompiled, %zu bytes of code\n",
+            stats->compile_ms, stats->run_ms, stats->recompiled, stats->functions, stats->code_bytes);
+}
+
+/* Interpret the optimised module for -run, or compile it in memory for
+ * -jit; the program's exit status is left in run_status. */
+static int run_program(IrModule* mod, FlagSet flags, const Arguments* args, int* run_status) {
+    RunTiming timing = { 0.0, 0 };
+    struct timespec start, end;
+    fflush(stdout);
+    if (flags & F_JIT) {
+        IrPassOptions passes;
+        irpass__default_options(&passes);
+        JitOptions opts = { args->target_arch, args->tier_up_calls, &passes };
+        JitStats stats;
+        int status = jit__run_main(mod, &opts, &stats);
+        write_debug_output(flags, F_TIME, jit_time_writer, &stats);
+        if (status < 0) return 1;
+        *run_status = status;
+        return 0;
+    }
+    timespec_get(&start, TIME_UTC);
+    int status = interp__run_main(mod, args->target_arch, &timing.steps);
+    timespec_get(&end, TIME_UTC);
+    timing.run_ms = (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+    write_debug_output(flags, F_TIME, run_time_writer, &timing);
+    if (status < 0) return 1;
+    *run_status = status;
+    return 0;
+}
+
+/* Assembly text with -S, otherwise an object file from the integrated
+ * assembler. */
+static void write_output(IrModule* mod, const char* source,
+                         const char* output_file, FlagSet flags, const Arguments* args) {
+    if (!output_file) return;
+    CodegenOptions opts = { args->target_arch, (flags & F_DEBUG_COMPILE) ? stdout : NULL,
+                            (flags & F_FUNCTION_SECTIONS) != 0, (flags & F_DATA_SECTIONS) != 0,
+                            args->threads };
+    if (!(flags & F_OUTPUT_ASSEMBLY)) {
+        codegen__write_object(mod, &opts, output_file);
+        return;
+    }
+    FILE *asm_out = fopen(output_file, "w");
+    if (!asm_out) {
+        errhandler__report_error(ERROR_CODE_IO_WRITE, 0, 0, "file",
+                                 "Cannot open assembly output: %s", output_file);
+        return;
+    }
+    codegen__write_assembly(mod, &opts, source, asm_out);
+    if (fclose(asm_out) != 0)
+        errhandler__report_error(ERROR_CODE_IO_WRITE, 0, 0, "file",
+                                 "Cannot write assembly output: %s", output_file);
+}
+
+/* Name of the index-th object of an executable, compiled from source:
+ * <temp_dir>/<index>-<source name>.o, which the linker's diagnostics
+ * show. */
+static char* link_object_filename(const char* temp_dir, size_t index, const char* source) {
+    const char* base = strrchr(source, '/');
+    base = base ? base + 1 : source;
+    const char* dot = strrchr(base, '.');
+    int base_len = dot && dot != base ? (int)(dot - base) : (int)strlen(base);
+    size_t len = strlen(temp_dir) + (size_t)base_len + 28;
+    char* name = (char*)memory_allocate_zero(len);
+    if (!name) {
+        errhandler__report_error(ERROR_CODE_MEMORY_ALLOCATION, 0, 0, "memory",
+                                 "Failed to allocate object filename");
+        return NULL;
+    }
+    snprintf(name, len, "%s/%zu-%.*s.o", temp_dir, index, base_len, base);
+    return name;
+}
+
+/* Link the objects of an executable (--c) into output_file. The linker
+ * reports its own errors. */
+static int link_executable(char** objects, size_t count, const char* output_file,
+                           FlagSet flags, const Arguments* args) {
+    if (count == 0) {
+        errhandler__report_error(ERROR_CODE_INPUT_NO_SOURCE, 0, 0, "input",
+                                 "no objects to link");
+        return 1;
+    }
+    OutputFormat format = FORMAT_ELF;
+    if (u__streq(args->link_format, "exe") ||
+        (u__streq(args->link_format, "nativ") && u__streq(args->target_core, "NT")))
+        format = FORMAT_PE;
+    else if (u__streq(args->link_format, "app") ||
+             (u__streq(args->link_format, "nativ") && u__streq(args->target_core, "Darwin")))
+        format = FORMAT_MACHO;
+    Linker linker;
+    linker__init(&linker);
+    linker__set_output_format(&linker, format);
+    linker__set_entry(&linker, "main");
+    linker__set_gc_sections(&linker, (flags & F_GC_SECTIONS) != 0);
+    if (args->icf)
+        linker__set_icf(&linker, u__streq(args->icf, "all") ? ICF_ALL : ICF_SAFE);
+    linker__set_output_file(&linker, output_file);
+    linker__set_threads(&linker, args->threads);
+    int err = 0;
+    for (size_t i = 0; i < count && !err; ++i)
+        if (linker__add_object(&linker, objects[i]) != 0) err = 1;
+    if (!err && linker__link(&linker) != 0) err = 1;
+    if (!err && linker__write_to_file(&linker, output_file) != 0) err = 1;
+    linker__destroy(&linker);
+    return err;
+}
+
+/* Link the bitcode written for every input and run the pipeline over the
+ * whole program. */
+static int link_time_optimize(char** inputs, size_t count, const char* output_file,
+                              FlagSet flags, const Arguments* args, int* run_status) {
+    int err = 0;
+    IrModule* ir_mod = lto__link((const char* const*)inputs, (uint32_t)count);
+    if (!ir_mod) return 1;
+    IrPassOptions ir_opts;
+    irpass__default_options(&ir_opts);
+    ir_opts.threads = args->threads;
+    ir_opts.whole_program = true;
+    struct timespec start, end;
+    timespec_get(&start, TIME_UTC);
+    if (!irpass__run_module(ir_mod, &ir_opts)) err = 1;
+    timespec_get(&end, TIME_UTC);
+    IrTiming timing = {
+        ir_mod,
+        (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6
+    };
+    write_debug_output(flags, F_TIME, ir_time_writer, &timing);
+    write_debug_output(flags, F_DEBUG_OPTIM, ir_output_writer, ir_mod);
+    if ((flags & (F_OUTPUT_ASSEMBLY | F_MODE_COMPILE)) && !err && !errhandler__has_errors())
+        write_output(ir_mod, inputs[0], output_file, flags, args);
+    if ((flags & F_EXECUTE) && !err && !errhandler__has_errors() &&
+        run_program(ir_mod, flags, args, run_status))
+        err = 1;
+    ir__module_destroy(ir_mod);
     return err || errhandler__has_errors();
 }
 
@@ -865,6 +1253,8 @@ int main(int argc, char* argv[]) {
         for (size_t i = 0; i < args.lib_count; ++i) memory_free_safe((void**)&args.libraries[i]);
         memory_free_safe((void**)&args.filenames);
         memory_free_safe((void**)&args.libraries);
+        memory_free_safe((void**)&args.profile_generate);
+        memory_free_safe((void**)&args.profile_use);
         return args.exit_code;
     }
     if (parse_result == 0) {
@@ -873,8 +1263,24 @@ int main(int argc, char* argv[]) {
         for (size_t i = 0; i < args.lib_count; ++i) memory_free_safe((void**)&args.libraries[i]);
         memory_free_safe((void**)&args.filenames);
         memory_free_safe((void**)&args.libraries);
+        memory_free_safe((void**)&args.profile_generate);
+        memory_free_safe((void**)&args.profile_use);
         return 1;
     }
+    if ((args.flags & F_EXECUTE) && args.output_file) {
+        /* Nothing is written under -run or -jit, so the first positional argument
+         * is an input too. */
+        if (!dynamic_string_push(&args.filenames, &args.file_count, &args.file_capacity,
+                                 args.output_file, "filename")) {
+            errhandler__report_error(ERROR_CODE_MEMORY_ALLOCATION, 0, 0, "memory",
+                                     "Failed to allocate filename array");
+        } else {
+            memmove(args.filenames + 1, args.filenames, (args.file_count - 1) * sizeof(char*));
+            args.filenames[0] = args.output_file;
+            args.output_file = NULL;
+        }
+        args.flags &= ~(FlagSet)F_MODE_COMPILE;
+    }
     errhandler__set_warnings_as_errors((args.flags & F_WERROR) != 0);
     errhandler__set_suppress_warnings((args.flags & F_WIGNOR) != 0);
     if (u__streq(args.target_arch, "nativ")) args.target_arch = detect_target_arch();
@@ -893,6 +1299,15 @@ int main(int argc, char* argv[]) {
                                      "compilation or static library requested but no output file specified");
         }
     }
+    if ((args.flags & F_EXECUTE) && !(args.flags & F_LTO) && args.file_count > 1) {
+        errhandler__report_error(ERROR_CODE_INPUT_INVALID_FLAG, 0, 0, "input",
+                                 "%s takes a single source file unless -flto links several",
+                                 (args.flags & F_JIT) ? "-jit" : "-run");
+    }
+    if ((args.flags & F_LTO) && args.profile_generate) {
+        errhandler__report_error(ERROR_CODE_INPUT_INVALID_FLAG, 0, 0, "input",
+                                 "-flto cannot be combined with -fprofile-generate");
+    }
     if (args.file_count == 0 && args.flags) {
         errhandler__report_error(ERROR_CODE_INPUT_NO_SOURCE, 0, 0, "input",
                                  "no input source files specified");
@@ -903,7 +1318,7 @@ int main(int argc, char* argv[]) {
         goto cleanup_args;
     }
     SemanticContext* semantic_ctx = NULL;
-    if ((args.flags & (F_MODE_COMPILE | F_OUTPUT_ASSEMBLY | F_MODE_STATIC_LIB)) ||
+    if ((args.flags & (F_MODE_COMPILE | F_OUTPUT_ASSEMBLY | F_MODE_STATIC_LIB | F_EXECUTE)) ||
         (args.flags & F_DEBUG_SEMANTIC)) {
         semantic_ctx = semantic__create_context();
         if (!semantic_ctx) {
@@ -912,14 +1327,46 @@ int main(int argc, char* argv[]) {
         } else {
             semantic_ctx->exit_on_error = ((args.flags & F_MODE_COMPILE) ||
                                            (args.flags & F_MODE_STATIC_LIB) ||
-                                           (args.flags & F_OUTPUT_ASSEMBLY)) != 0;
+                                           (args.flags & F_OUTPUT_ASSEMBLY) ||
+                                           (args.flags & F_EXECUTE)) != 0;
             if (args.flags & F_WEXTRA) semantic__set_extra_warnings(semantic_ctx, true);
         }
     }
     int exit_code = 0;
+    int run_status = 0;
+    char** link_inputs = NULL;
+    size_t link_count = 0, link_capacity = 0;
+    /* Objects of an executable (--c): those given, and the ones compiled
+     * from sources into temp_dir. */
+    char** link_objects = NULL;
+    size_t object_count = 0, object_capacity = 0;
+    char temp_dir[] = "/tmp/paxsy-XXXXXX";
+    if ((args.flags & F_MODE_LINK) && !mkdtemp(temp_dir)) {
+        errhandler__report_error(ERROR_CODE_IO_WRITE, 0, 0, "file",
+                                 "Cannot create a directory for the objects to link");
+        exit_code = 1;
+    }
     for (size_t i = 0; i < args.file_count; ++i) {
         const char* out_name = NULL;
-        if (args.flags & F_OUTPUT_ASSEMBLY) {
+        if ((args.flags & F_MODE_LINK) && u__str_endw(args.filenames[i], ".o")) {
+            if (!dynamic_string_push(&link_objects, &object_count, &object_capacity,
+                                     args.filenames[i], "link object"))
+                exit_code = 1;
+            continue;
+        }
+        if (args.flags & F_LTO) {
+            /* Bitcode inputs are linked as they are; sources are compiled to
+             * bitcode first. */
+            bool is_bitcode = u__str_endw(args.filenames[i], BITCODE_EXTENSION);
+            char* bc_name = is_bitcode ? u__strdup_safe(args.filenames[i])
+                                       : derive_bitcode_filename(args.filenames[i]);
+            if (!bc_name || !dynamic_string_push(&link_inputs, &link_count, &link_capacity,
+                                                 bc_name, "link input"))
+                exit_code = 1;
+            memory_free_safe((void**)&bc_name);
+            if (is_bitcode) continue;
+        }
+        if ((args.flags & F_OUTPUT_ASSEMBLY) && !(args.flags & F_LTO)) {
             out_name = derive_assembly_filename(args.filenames[i]);
             if (!out_name) {
                 errhandler__report_error(ERROR_CODE_MEMORY_ALLOCATION, 0, 0, "memory",
@@ -927,19 +1374,29 @@ int main(int argc, char* argv[]) {
                 exit_code = 1;
                 continue;
             }
+        } else if ((args.flags & F_MODE_LINK) && !(args.flags & F_LTO)) {
+            out_name = link_object_filename(temp_dir, object_count, args.filenames[i]);
+            if (!out_name || !dynamic_string_push(&link_objects, &object_count, &object_capacity,
+                                                  out_name, "link object")) {
+                memory_free_safe((void**)&out_name);
+                exit_code = 1;
+                continue;
+            }
         } else {
             out_name = args.output_file;
         }
-        if (process_one_file(args.filenames[i], out_name, args.flags, &args, &semantic_ctx))
+        if (process_one_file(args.filenames[i], out_name, args.flags, &args, &semantic_ctx, &run_status))
             exit_code = 1;
-        if ((args.flags & F_OUTPUT_ASSEMBLY) && out_name) memory_free_safe((void**)&out_name);
+        if (((args.flags & F_OUTPUT_ASSEMBLY) || (args.flags & F_MODE_LINK)) && !(args.flags & F_LTO) && out_name)
+            memory_free_safe((void**)&out_name);
         if (semantic_ctx && i + 1 < args.file_count) {
             semantic__destroy_context(semantic_ctx);
             semantic_ctx = semantic__create_context();
             if (semantic_ctx) {
                 semantic_ctx->exit_on_error = ((args.flags & F_MODE_COMPILE) ||
                                                (args.flags & F_MODE_STATIC_LIB) ||
-                                               (args.flags & F_OUTPUT_ASSEMBLY)) != 0;
+                                               (args.flags & F_OUTPUT_ASSEMBLY) ||
+                                               (args.flags & F_EXECUTE)) != 0;
                 if (args.flags & F_WEXTRA) semantic__set_extra_warnings(semantic_ctx, true);
             } else {
                 errhandler__report_error(ERROR_CODE_COM_FAILCREATE, 0, 0, "syntax",
@@ -948,9 +1405,36 @@ int main(int argc, char* argv[]) {
             }
         }
     }
+    if ((args.flags & F_LTO) && !exit_code && link_count > 0) {
+        char* out_name = args.output_file;
+        if (!out_name && (args.flags & F_OUTPUT_ASSEMBLY))
+            out_name = derive_assembly_filename(args.filenames[0]);
+        if (args.flags & F_MODE_LINK) {
+            out_name = link_object_filename(temp_dir, object_count, "lto");
+            if (!out_name || !dynamic_string_push(&link_objects, &object_count, &object_capacity,
+                                                  out_name, "link object"))
+                exit_code = 1;
+        }
+        if (!exit_code && link_time_optimize(link_inputs, link_count, out_name, args.flags, &args, &run_status))
+            exit_code = 1;
+        if (out_name != args.output_file) memory_free_safe((void**)&out_name);
+    }
+    for (size_t i = 0; i < link_count; ++i) memory_free_safe((void**)&link_inputs[i]);
+    memory_free_safe((void**)&link_inputs);
+    if ((args.flags & F_MODE_LINK) && !exit_code &&
+        link_executable(link_objects, object_count, args.output_file, args.flags, &args))
+        exit_code = 1;
+    for (size_t i = 0; i < object_count; ++i) {
+        if (strncmp(link_objects[i], temp_dir, sizeof(temp_dir) - 1) == 0) remove(link_objects[i]);
+        memory_free_safe((void**)&link_objects[i]);
+    }
+    memory_free_safe((void**)&link_objects);
+    if (args.flags & F_MODE_LINK) rmdir(temp_dir);
     if ((args.flags & F_MODE_STATIC_LIB) && !exit_code) {
         /* output_create_static_library(args.output_file, ...); */
     }
+    /* A program run with -run or -jit exits with its own status. */
+    if (!exit_code && run_status) exit_code = run_status;
     errhandler__print_errors();
     errhandler__print_warnings();
     if (semantic_ctx) semantic__destroy_context(semantic_ctx);
@@ -960,6 +1444,8 @@ cleanup_args:
     for (size_t i = 0; i < args.lib_count; ++i) memory_free_safe((void**)&args.libraries[i]);
     memory_free_safe((void**)&args.filenames);
     memory_free_safe((void**)&args.libraries);
+    memory_free_safe((void**)&args.profile_generate);
+    memory_free_safe((void**)&args.profile_use);
     errhandler__free_error_manager();
     return exit_code;
 }
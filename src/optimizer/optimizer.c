@@ -129,15 +129,6 @@ static bool is_pure_expression(ASTNode *node) {
     }
 }
 
-static bool ast_contains_read_of(ASTNode *node, const char *varname) {
-    if (!node || !varname) return false;
-    if (node->type == AST_IDENTIFIER && node->value && strcmp(node->value, varname) == 0) return true;
-    return ast_contains_read_of(node->left, varname) ||
-           ast_contains_read_of(node->right, varname) ||
-           ast_contains_read_of(node->extra, varname) ||
-           ast_contains_read_of(node->default_value, varname);
-}
-
 static bool ast_nodes_identical(ASTNode *a, ASTNode *b) {
     if (!a || !b) return a == b;
     if (a->type != b->type) return false;
@@ -659,70 +650,6 @@ static void pass_copy_propagation(ASTNode *node, SymbolTable *global_scope, ASTN
     pass_copy_propagation(node->extra, global_scope, pool);
 }
 
-typedef struct { char *name; uint16_t def_idx; bool may_have_read; } DefInfo;
-
-static void dead_store_elim_in_block(ASTNode *block, ASTNodePool *pool) {
-    if (!block || block->type != AST_BLOCK || !block->extra) return;
-    AST *list = (AST *)block->extra;
-    if (!list->nodes || list->count == 0) return;
-    DefInfo *defs = NULL;
-    size_t def_cnt = 0, def_cap = 0;
-    for (uint16_t i = 0; i < list->count; i++) {
-        ASTNode *stmt = list->nodes[i];
-        if (!stmt) continue;
-        if (stmt->type == AST_BLOCK) dead_store_elim_in_block(stmt, pool);
-        if ((stmt->type == AST_ASSIGNMENT || stmt->type == AST_COMPOUND_ASSIGNMENT) &&
-            stmt->left && stmt->left->type == AST_IDENTIFIER) {
-            const char *varname = stmt->left->value;
-            bool eliminated = false;
-            for (size_t d = 0; d < def_cnt; d++) {
-                if (strcmp(defs[d].name, varname) == 0) {
-                    if (!defs[d].may_have_read) {
-                        ASTNode *prev = list->nodes[defs[d].def_idx];
-                        parser__free_ast_node(prev, pool);
-                        list->nodes[defs[d].def_idx] = NULL;
-                        eliminated = true;
-                    }
-                    free(defs[d].name);
-                    memmove(&defs[d], &defs[d+1], (def_cnt - d - 1) * sizeof(DefInfo));
-                    def_cnt--;
-                    break;
-                }
-            }
-            if (def_cnt >= def_cap) {
-                def_cap = def_cap ? def_cap * 2 : 4;
-                defs = realloc(defs, def_cap * sizeof(DefInfo));
-                if (!defs) {
-                    errhandler__report_error(ERROR_CODE_OPTIM_MEMORY_ALLOCATION, 0, 0, "optimizer",
-                                             "realloc failed in dead_store_elim_in_block");
-                    return;
-                }
-            }
-            defs[def_cnt].name = STR_DUP(varname);
-            defs[def_cnt].def_idx = i;
-            defs[def_cnt].may_have_read = false;
-            def_cnt++;
-        } else {
-            for (size_t d = 0; d < def_cnt; d++) {
-                if (ast_contains_read_of(stmt, defs[d].name)) defs[d].may_have_read = true;
-            }
-        }
-    }
-    uint16_t write = 0;
-    for (uint16_t i = 0; i < list->count; i++) if (list->nodes[i] != NULL) list->nodes[write++] = list->nodes[i];
-    list->count = write;
-    for (size_t i = 0; i < def_cnt; i++) free(defs[i].name);
-    free(defs);
-}
-
-static void pass_dead_store_elimination(ASTNode *node, ASTNodePool *pool) {
-    if (!node) return;
-    if (node->type == AST_BLOCK) dead_store_elim_in_block(node, pool);
-    pass_dead_store_elimination(node->left, pool);
-    pass_dead_store_elimination(node->right, pool);
-    pass_dead_store_elimination(node->extra, pool);
-}
-
 static void merge_identical_in_block(ASTNode *block) {
     if (!block || block->type != AST_BLOCK || !block->extra) return;
     AST *list = (AST *)block->extra;
@@ -1101,8 +1028,6 @@ bool optimizer__optimize(AST *ast, SymbolTable *global_scope) {
         optimizer_debug_print_ast("After pass_inline_variables", ast);
         pass_copy_propagation(stmt, global_scope, pool);
         optimizer_debug_print_ast("After pass_copy_propagation", ast);
-        pass_dead_store_elimination(stmt, pool);
-        optimizer_debug_print_ast("After pass_dead_store_elimination", ast);
         pass_merge_identical_statements(stmt);
         optimizer_debug_print_ast("After pass_merge_identical_statements", ast);
         pass_cse(stmt, pool);
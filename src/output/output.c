@@ -1,8 +1,11 @@
 #include "output.h"
 #include "../errhandler/errhandler.h"
+#include "../ir/analysis/analysis.h"
+#include <inttypes.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <inttypes.h>
 
 static bool parser_trace_enabled = false;
 static FILE* trace_file          = NULL;
@@ -263,9 +266,9 @@ void print_section_header(const char* title, FILE* out) {
 
 void print_all_tokens(Lexer* lexer, FILE* out) {
     if (!lexer || !lexer->tokens) { fputs("No tokens to display\n", out); return; }
-    for (uint16_t i = 0; i < lexer->token_count; i++) {
+    for (uint64_t i = 0; i < lexer->token_count; i++) {
         Token* token = &lexer->tokens[i];
-        fprintf(out, "%4u: %-20s", i, get_token_type_name(token->type));
+        fprintf(out, "%4" PRIu64 ": %-20s", i, get_token_type_name(token->type));
         if (token->value && token->value[0]) fprintf(out, " = '%s'", token->value);
         fprintf(out, " [line %u, col %u]\n", token->line, token->column);
     }
@@ -274,7 +277,7 @@ void print_all_tokens(Lexer* lexer, FILE* out) {
 void print_tokens_in_lines(Lexer* lexer, FILE* out) {
     if (!lexer || !lexer->tokens) { fputs("No tokens to display\n", out); return; }
     uint16_t current_line = 0;
-    for (uint16_t i = 0; i < lexer->token_count; i++) {
+    for (uint64_t i = 0; i < lexer->token_count; i++) {
         Token* token = &lexer->tokens[i];
         if (token->type == TOKEN_EOF) continue;
         if (token->line != current_line) {
@@ -291,12 +294,12 @@ void print_tokens_in_lines(Lexer* lexer, FILE* out) {
 void print_token_statistics(Lexer* lexer, FILE* out) {
     if (!lexer || !lexer->tokens) { fputs("No tokens to analyze\n", out); return; }
     uint32_t counts[TOKEN_TYPE_COUNT] = {0};
-    for (uint16_t i = 0; i < lexer->token_count; i++) {
+    for (uint64_t i = 0; i < lexer->token_count; i++) {
         TokenType type = lexer->tokens[i].type;
         if (IS_VALID_TOKEN_TYPE(type)) counts[type]++;
     }
-    fprintf(out, "Total: %u\n", lexer->token_count);
-    fprintf(out, "Non-EOF: %u\n\n", lexer->token_count - counts[TOKEN_EOF]);
+    fprintf(out, "Total: %" PRIu64 "\n", lexer->token_count);
+    fprintf(out, "Non-EOF: %" PRIu64 "\n\n", lexer->token_count - counts[TOKEN_EOF]);
     fputs("Distribution:\n", out);
     for (uint32_t i = 0; i < TOKEN_TYPE_COUNT; i++) {
         if (counts[i]) fprintf(out, "  %-20s: %u\n", get_token_type_name(i), counts[i]);
@@ -580,7 +583,7 @@ ParseStatistics* collect_parse_statistics(Lexer* lexer, AST* ast, SemanticContex
     if (!stats) return NULL;
     if (lexer && lexer->tokens) {
         stats->total_tokens = lexer->token_count;
-        for (uint16_t i = 0; i < lexer->token_count; i++) {
+        for (uint64_t i = 0; i < lexer->token_count; i++) {
             TokenType type = lexer->tokens[i].type;
             if (type < 256) stats->token_types[type]++;
         }
@@ -674,4 +677,18 @@ void output__print_ir_statistics(IrModule* mod, FILE* out) {
     fprintf(out, "  Functions: %u\n", mod->func_count);
     fprintf(out, "  Basic blocks: %u\n", total_blocks);
     fprintf(out, "  Instructions: %u\n", total_insts);
+    size_t bytes = ir__module_bytes(mod);
+    fprintf(out, "  Memory: %zu bytes", bytes);
+    if (total_insts) fprintf(out, " (%zu per instruction)", bytes / total_insts);
+    fprintf(out, "\n");
+}
+
+void output__print_ir_analysis_statistics(IrModule* mod, FILE* out) {
+    if (!mod || !out) return;
+    IrAnalysisStats stats;
+    analysis__module_stats(mod, &stats);
+    fprintf(out, "IR ANALYSIS CACHE:\n");
+    for (uint32_t k = 0; k < IR_ANALYSIS_COUNT; k++)
+        fprintf(out, "  %-12s hits: %" PRIu64 ", misses: %" PRIu64 ", invalidated: %" PRIu64 "\n",
+                analysis__name((IrAnalysisKind)k), stats.hits[k], stats.misses[k], stats.invalidations[k]);
 }
@@ -64,5 +64,6 @@ void log_parser_step(ParserState* parser, const char* action, ASTNode* node);
 void print_optimized_ast(AST* ast, FILE* out);
 void output__print_ir_module(IrModule* mod, FILE* out);
 void output__print_ir_statistics(IrModule* mod, FILE* out);
+void output__print_ir_analysis_statistics(IrModule* mod, FILE* out);
 
 #endif
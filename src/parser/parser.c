@@ -489,7 +489,7 @@ static void skip_to_sync_token(ParserState *state) {
         if (t == TOKEN_IF || t == TOKEN_DO || t == TOKEN_RETURN ||
             t == TOKEN_ELSE || t == TOKEN_BREAK || t == TOKEN_CONTINUE ||
             t == TOKEN_FREE || t == TOKEN_JUMP || t == TOKEN_SIGNAL ||
-            t == TOKEN_NOP || t == TOKEN_ASM ||
+            t == TOKEN_NOP || t == TOKEN_HALT || t == TOKEN_ASM ||
             t == TOKEN_LCURLY || t == TOKEN_STATE ||
             t == TOKEN_TYPEMOD || t == TOKEN_STATEMOD)
             break;
@@ -1786,6 +1786,7 @@ static ASTNode *parse_statement(ParserState *state) {
         case TOKEN_JUMP:        return parse_jump_statement(state);
         case TOKEN_SIGNAL:      return parse_signal_statement(state);
         case TOKEN_NOP:         return parse_nop_statement(state);
+        case TOKEN_HALT:        return parse_halt_statement(state);
         case TOKEN_ASM:         return parse_asm_statement(state);
         case TOKEN_ELSE:        return parse_else_statement(state);
         default: break;
@@ -1872,7 +1873,7 @@ static void parse_semicolon(ParserState *state) {
     }
 }
 
-AST *parse(Token *tokens, uint16_t token_count) {
+AST *parse(Token *tokens, uint32_t token_count) {
     ParserState state;
     state.current_token_position = 0;
     state.token_stream           = tokens;
@@ -99,9 +99,9 @@ typedef struct AST {
 
 /* Parser state – holds token stream, pool, error flags and pushback buffer */
 typedef struct ParserState {
-    uint16_t     current_token_position; /* Index into token_stream            */
+    uint32_t     current_token_position; /* Index into token_stream            */
     Token       *token_stream;       /* Array of tokens (lexer output)          */
-    uint16_t     total_tokens;       /* Number of tokens in the stream          */
+    uint32_t     total_tokens;       /* Number of tokens in the stream          */
     ASTNodePool *pool;               /* Current node pool                       */
     bool         panic_mode;         /* Set when performing error recovery      */
     bool         fatal_error;        /* Set on memory allocation failure        */
@@ -133,7 +133,7 @@ void         parser__free_ast(AST *ast);
 void         parser__free_type(Type *type);
 
 /* Main entry point – returns a fully parsed AST (or NULL on fatal error) */
-AST *parse(Token *tokens, uint16_t token_count);
+AST *parse(Token *tokens, uint32_t token_count);
 
 /* Special error code for empty parentheses in function calls etc. */
 #define ERROR_CODE_SYNTAX_EMPTY_PARENS  0x7A08
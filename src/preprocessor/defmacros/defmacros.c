@@ -135,7 +135,7 @@ void builtin_macros_init(MacroTable* table, const char* filename) {
         else if (strcmp(arch, "x86_64") == 0 || strcmp(arch, "amd64") == 0) {
             add_int_macro(table, "__x86_64__", 1);
         }
-        else if (strncmp(arch, "arm", 3) == 0) {
+        else if (strncmp(arch, "arm", 3) == 0 || strcmp(arch, "aarch64") == 0) {
             /* ARM family */
             add_int_macro(table, "__arm__", 1);
             int arm_ver = extract_arm_version(arch);
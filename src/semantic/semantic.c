@@ -486,7 +486,9 @@ static bool check_function_call_arguments(SemanticContext *ctx,
 /* Type‑checks a function call node, producing the result type and init state. */
 static bool check_function_call(SemanticContext *ctx, ASTNode *node, TypeCheckResult *out) {
     if (!node || !out) return false;
+    /* The parser keeps the callee as the left operand. */
     const char *fname = node->value;
+    if (!fname && node->left && node->left->type == AST_IDENTIFIER) fname = node->left->value;
     if (!fname) {
         SEM_ERROR(ctx, ERROR_CODE_SEM_TYPE_ERROR, node->line, node->column, 0,
                   "Function call missing name");
@@ -1137,11 +1139,13 @@ static bool process_function_declaration(SemanticContext *ctx, ASTNode *node) {
                 return false;
             }
         }
+        /* An extern prototype is defined by another unit (-flto links them). */
+        bool is_extern = node->access_modifier && STR_EQUAL(node->access_modifier, "extern");
         if (!semantic__add_function_ex(ctx, ctx->current_scope, name,
                                        ret_type, ret_tinfo,
                                        params, pcount, reqcount,
                                        false, node->line, node->column, NULL,
-                                       false, false)) {
+                                       false, is_extern)) {
             return false;
         }
         SymbolEntry *fentry = semantic__find_symbol(ctx, name);
@@ -1519,7 +1523,7 @@ TypeCheckResult semantic__check_type(SemanticContext *ctx, ASTNode *node) {
             if (!HAS_LEFT(node) || !node->right) { res.valid = false; break; }
             TypeCheckResult left_res = semantic__check_type(ctx, node->left);
             BREAK_IF_INVALID(left_res);
-            if (left_res.type != TYPE_ARRAY) {
+            if (left_res.type != TYPE_ARRAY && left_res.type != TYPE_POINTER) {
                 SEM_ERROR(ctx, ERROR_CODE_SEM_TYPE_ERROR, node->line, node->column, 0,
                           "Cannot index a non‑array value");
                 break;
@@ -1532,12 +1536,90 @@ TypeCheckResult semantic__check_type(SemanticContext *ctx, ASTNode *node) {
                 break;
             }
             res.type = TYPE_INT;
+            /* Indexing a pointer yields its pointee. */
+            Type *pt = left_res.type == TYPE_POINTER ? left_res.type_info : NULL;
+            if (pt && pt->pointer_level > 1) res.type = TYPE_POINTER;
+            else if (pt && string_to_datatype(pt->name) != TYPE_UNKNOWN)
+                res.type = string_to_datatype(pt->name);
             res.type_info = NULL;
             res.init_state = INIT_UNINITIALIZED;
             res.valid = true;
             break;
         }
 
+        case AST_BINARY_OPERATION: {
+            TypeCheckResult lr = semantic__check_type(ctx, node->left);
+            TypeCheckResult rr = semantic__check_type(ctx, node->right);
+            BREAK_IF_INVALID(lr);
+            BREAK_IF_INVALID(rr);
+            bool l_arith = IS_NUMERIC(lr.type) || lr.type == TYPE_CHAR;
+            bool r_arith = IS_NUMERIC(rr.type) || rr.type == TYPE_CHAR;
+            switch (node->operation_type) {
+                case TOKEN_LT: case TOKEN_GT: case TOKEN_LE: case TOKEN_GE:
+                case TOKEN_DOUBLE_EQ: case TOKEN_NE: case TOKEN_LOGICAL:
+                    if (!(l_arith || lr.type == TYPE_POINTER) || !(r_arith || rr.type == TYPE_POINTER)) break;
+                    res.type = TYPE_INT;
+                    res.valid = true;
+                    break;
+                case TOKEN_PLUS: case TOKEN_MINUS:
+                    /* Pointer offsets keep the pointer's type. */
+                    if (lr.type == TYPE_POINTER && r_arith) {
+                        res.type = TYPE_POINTER;
+                        res.type_info = lr.type_info;
+                        res.valid = true;
+                        break;
+                    }
+                    /* fall through */
+                default:
+                    if (!l_arith || !r_arith) break;
+                    res.type = promote_numeric(lr.type, rr.type);
+                    res.valid = true;
+                    break;
+            }
+            if (!res.valid) {
+                SEM_ERROR(ctx, ERROR_CODE_SEM_TYPE_ERROR, node->line, node->column, 0,
+                          "Invalid operands to binary operator: %s and %s",
+                          semantic__type_to_string(lr.type),
+                          semantic__type_to_string(rr.type));
+                break;
+            }
+            res.init_state = (lr.init_state == INIT_CONSTANT && rr.init_state == INIT_CONSTANT)
+                           ? INIT_CONSTANT : INIT_FULL;
+            break;
+        }
+
+        case AST_UNARY_OPERATION: {
+            ASTNode *opd = node->right ? node->right : node->left;
+            TypeCheckResult or = semantic__check_type(ctx, opd);
+            BREAK_IF_INVALID(or);
+            if (node->operation_type == TOKEN_BANG) {
+                res.type = TYPE_INT;
+            } else {
+                res.type = or.type;
+                res.type_info = or.type_info;
+            }
+            res.init_state = or.init_state == INIT_CONSTANT ? INIT_CONSTANT : INIT_FULL;
+            res.valid = true;
+            break;
+        }
+
+        case AST_POSTFIX_INCREMENT: case AST_POSTFIX_DECREMENT:
+        case AST_PREFIX_INCREMENT:  case AST_PREFIX_DECREMENT: {
+            TypeCheckResult or = semantic__check_type(ctx, node->left ? node->left : node->right);
+            BREAK_IF_INVALID(or);
+            if (!IS_NUMERIC(or.type) && or.type != TYPE_CHAR && or.type != TYPE_POINTER) {
+                SEM_ERROR(ctx, ERROR_CODE_SEM_TYPE_ERROR, node->line, node->column, 0,
+                          "Cannot increment or decrement a %s value",
+                          semantic__type_to_string(or.type));
+                break;
+            }
+            res.type = or.type;
+            res.type_info = or.type_info;
+            res.init_state = INIT_FULL;
+            res.valid = true;
+            break;
+        }
+
         case AST_MULTI_INITIALIZER: {
             res.type = TYPE_COMPOUND;
             res.type_info = NULL;
@@ -1565,6 +1647,29 @@ TypeCheckResult semantic__check_type(SemanticContext *ctx, ASTNode *node) {
             check_function_call(ctx, node, &res);
             break;
 
+        case AST_ALLOC:
+        case AST_REALLOC: {
+            AST *args = node->left ? (AST *)node->left->extra : NULL;
+            bool ok = true;
+            /* alloc(size, align, type) / realloc(ptr, size): the type
+             * operand of alloc is not an expression. */
+            for (uint16_t i = 0; args && i < args->count && i < 2; i++)
+                if (!semantic__check_type(ctx, args->nodes[i]).valid) ok = false;
+            res.type = TYPE_POINTER;
+            res.init_state = INIT_FULL;
+            res.valid = ok;
+            break;
+        }
+
+        case AST_FREE: {
+            TypeCheckResult pr = semantic__check_type(ctx, node->left);
+            BREAK_IF_INVALID(pr);
+            res.type = TYPE_VOID;
+            res.init_state = INIT_FULL;
+            res.valid = true;
+            break;
+        }
+
         case AST_TERNARY_OPERATION: {
             ASTNode *cond = node->left, *tru = node->right;
             ASTNode *fls = node->extra ? (ASTNode *)node->extra : NULL;
@@ -1804,8 +1909,9 @@ bool semantic__check_expression(SemanticContext *ctx, ASTNode *node) {
 }
 
 /* Performs final verification after the whole AST has been processed:
-   – checks that every used function has a body
-   – ensures that a main function exists (unless -Wextra)
+   – checks that every used function has a body (unless a partial unit,
+     whose prototypes another unit defines)
+   – ensures that a main function exists (unless -Wextra or a partial unit)
    – reports unused symbols under -Wextra. */
 static bool final_verification(SemanticContext *ctx) {
     bool ok = true;
@@ -1816,7 +1922,7 @@ static bool final_verification(SemanticContext *ctx) {
         for (SymbolEntry *entry = global->entries[i]; entry; entry = entry->next) {
             if (entry->type == TYPE_FUNCTION) {
                 FunctionSignature *sig = entry->extra.func_sig;
-                if (entry->is_used && !sig->has_body && !sig->is_none_body) {
+                if (entry->is_used && !sig->has_body && !sig->is_none_body && !ctx->partial_unit) {
                     SEM_ERROR(ctx, ERROR_CODE_SEM_UNDEFINED_VAR,
                               entry->line, entry->column,
                               (uint8_t)strlen(entry->name),
@@ -1841,7 +1947,7 @@ static bool final_verification(SemanticContext *ctx) {
         }
     }
 
-    if (main_count == 0) {
+    if (main_count == 0 && !ctx->partial_unit) {
         if (ctx->extra_warnings) {
             SEM_WARNING(ctx, ERROR_CODE_SEM_UNDEFINED_VAR, 0, 0, 0,
                         "No 'main' function with a body defined (warning under -Wextra)");
@@ -1885,6 +1991,7 @@ SemanticContext *semantic__create_context(void) {
     ctx->exit_on_error = false;
     ctx->strict_type_check = false;
     ctx->extra_warnings = false;
+    ctx->partial_unit = false;
     ctx->abort_compilation = false;
     ctx->in_loop = false;
     ctx->in_function = false;
@@ -1905,6 +2012,10 @@ void semantic__set_extra_warnings(SemanticContext *ctx, bool enable) {
     if (ctx) ctx->extra_warnings = enable;
 }
 
+void semantic__set_partial_unit(SemanticContext *ctx, bool enable) {
+    if (ctx) ctx->partial_unit = enable;
+}
+
 /* Returns whether the compilation should be aborted due to a fatal error. */
 bool semantic__should_abort(const SemanticContext *ctx) {
     return ctx ? ctx->abort_compilation : false;
@@ -117,6 +117,7 @@ typedef struct SemanticContext {
     bool exit_on_error;             /* Reserved – currently unused           */
     bool strict_type_check;         /* Reject implicit numeric conversions   */
     bool extra_warnings;            /* Enable extra warnings (-Wextra)       */
+    bool partial_unit;              /* One of several linked units (-flto)   */
     bool abort_compilation;         /* Set when compilation cannot continue  */
     bool in_loop;                   /* True while inside a loop body         */
     bool in_function;               /* True while inside a function body     */
@@ -175,6 +176,8 @@ bool semantic__analyze(SemanticContext *ctx, AST *ast);
 
 /* Utilities. */
 void        semantic__set_extra_warnings(SemanticContext *ctx, bool enable);
+/* The unit is linked with others, so it need not define 'main'. */
+void        semantic__set_partial_unit(SemanticContext *ctx, bool enable);
 bool        semantic__should_abort(const SemanticContext *ctx);
 const char *semantic__type_to_string(DataType type);
 size_t      semantic__get_symbol_count(SemanticContext *ctx);
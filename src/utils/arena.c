@@ -0,0 +1,66 @@
+#include "arena.h"
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct UArenaChunk {
+    UArenaChunk* next;
+    size_t       size;          /* usable bytes after the header */
+    size_t       offset;        /* first free byte */
+    alignas(max_align_t) unsigned char data[];
+};
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static UArenaChunk* new_chunk(UArena* arena, size_t need) {
+    size_t size = arena->head ? arena->head->size * 2 : U__ARENA_MIN_CHUNK;
+    if (size > U__ARENA_MAX_CHUNK) size = U__ARENA_MAX_CHUNK;
+    if (size < need) size = need;
+    UArenaChunk* chunk = calloc(1, sizeof(UArenaChunk) + size);
+    if (!chunk) return NULL;
+    chunk->size = size;
+    chunk->offset = 0;
+    chunk->next = arena->head;
+    arena->head = chunk;
+    arena->reserved += sizeof(UArenaChunk) + size;
+    return chunk;
+}
+
+void* u__arena_alloc(UArena* arena, size_t size) {
+    if (!arena) return NULL;
+    size = align_up(size ? size : 1);
+    UArenaChunk* chunk = arena->head;
+    if (!chunk || chunk->size - chunk->offset < size) {
+        chunk = new_chunk(arena, size);
+        if (!chunk) return NULL;
+    }
+    void* p = chunk->data + chunk->offset;
+    chunk->offset += size;
+    arena->used += size;
+    return p;
+}
+
+char* u__arena_strdup(UArena* arena, const char* str) {
+    if (!str) return NULL;
+    size_t len = strlen(str);
+    char* copy = u__arena_alloc(arena, len + 1);
+    if (copy) memcpy(copy, str, len + 1);
+    return copy;
+}
+
+void u__arena_release(UArena* arena) {
+    if (!arena) return;
+    UArenaChunk* chunk = arena->head;
+    while (chunk) {
+        UArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+    arena->used = 0;
+    arena->reserved = 0;
+}
@@ -0,0 +1,46 @@
+#ifndef U__ARENA_H
+#define U__ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Size of the first chunk; later chunks double up to U__ARENA_MAX_CHUNK. */
+#define U__ARENA_MIN_CHUNK  4096
+#define U__ARENA_MAX_CHUNK  (1u << 20)
+
+typedef struct UArenaChunk UArenaChunk;
+
+/**
+ * Bump allocator.  Allocations are carved out of large chunks and are only
+ * released all at once, by u__arena_release.  An arena is not thread safe;
+ * a zero-initialised UArena is an empty arena.
+ */
+typedef struct UArena {
+    UArenaChunk* head;          /* chunk being carved, newest first */
+    size_t       used;          /* bytes handed out, including padding */
+    size_t       reserved;      /* bytes obtained from malloc */
+} UArena;
+
+/**
+ * Allocate zero-initialised memory aligned for any type
+ * @param arena: Arena to allocate from
+ * @param size: Number of bytes
+ * @return: Pointer valid until the arena is released, NULL on failure
+ */
+void* u__arena_alloc(UArena* arena, size_t size);
+
+/**
+ * Copy a string into the arena
+ * @param arena: Arena to allocate from
+ * @param str: String to copy
+ * @return: Copy valid until the arena is released, NULL on failure
+ */
+char* u__arena_strdup(UArena* arena, const char* str);
+
+/**
+ * Free every chunk and leave the arena empty and reusable
+ * @param arena: Arena to release
+ */
+void u__arena_release(UArena* arena);
+
+#endif
@@ -0,0 +1,222 @@
+#define _POSIX_C_SOURCE 200809L
+#include "scheduler.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEQUE_INITIAL_CAPACITY 64
+
+typedef struct {
+    UTaskFn fn;
+    void*   arg;
+} Task;
+
+/* Ring buffer; the owner works at the back, thieves take from the front. */
+typedef struct {
+    pthread_mutex_t lock;
+    Task*           items;
+    uint32_t        head, count, capacity;
+} Deque;
+
+typedef struct {
+    UScheduler* sched;
+    uint32_t    index;
+} Worker;
+
+struct UScheduler {
+    uint32_t        threads;
+    Deque*          deques;         /* one per thread */
+    Worker*         workers;
+    pthread_t*      handles;        /* threads - 1 started threads */
+    uint32_t        started;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;           /* work queued, or everything finished */
+    atomic_uint     queued;         /* tasks sitting in a deque */
+    atomic_uint     pending;        /* tasks submitted and not yet finished */
+    atomic_uint     next;           /* deque for the next outside submission */
+    bool            shutdown;
+};
+
+/* Scheduler and worker index of the calling thread, while it runs tasks. */
+static _Thread_local UScheduler* tls_sched = NULL;
+static _Thread_local uint32_t    tls_worker = 0;
+
+uint32_t u__cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) return 1;
+    return n > U__SCHEDULER_MAX_THREADS ? U__SCHEDULER_MAX_THREADS : (uint32_t)n;
+}
+
+static bool deque_push_back(Deque* d, Task t) {
+    pthread_mutex_lock(&d->lock);
+    if (d->count == d->capacity) {
+        uint32_t new_cap = d->capacity ? d->capacity * 2 : DEQUE_INITIAL_CAPACITY;
+        Task* items = malloc(new_cap * sizeof(Task));
+        if (!items) {
+            pthread_mutex_unlock(&d->lock);
+            return false;
+        }
+        for (uint32_t i = 0; i < d->count; i++)
+            items[i] = d->items[(d->head + i) % d->capacity];
+        free(d->items);
+        d->items = items;
+        d->head = 0;
+        d->capacity = new_cap;
+    }
+    d->items[(d->head + d->count++) % d->capacity] = t;
+    pthread_mutex_unlock(&d->lock);
+    return true;
+}
+
+static bool deque_pop(Deque* d, bool back, Task* out) {
+    pthread_mutex_lock(&d->lock);
+    bool ok = d->count > 0;
+    if (ok && back) {
+        *out = d->items[(d->head + --d->count) % d->capacity];
+    } else if (ok) {
+        *out = d->items[d->head];
+        d->head = (d->head + 1) % d->capacity;
+        d->count--;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+/* Own deque first, newest task; then steal the oldest from the others. */
+static bool find_task(UScheduler* s, uint32_t self, Task* out) {
+    bool ok = deque_pop(&s->deques[self], true, out);
+    for (uint32_t i = 1; i < s->threads && !ok; i++)
+        ok = deque_pop(&s->deques[(self + i) % s->threads], false, out);
+    if (ok) atomic_fetch_sub(&s->queued, 1);
+    return ok;
+}
+
+static void run_task(UScheduler* s, uint32_t self, Task t) {
+    t.fn(t.arg, self);
+    if (atomic_fetch_sub(&s->pending, 1) == 1) {
+        pthread_mutex_lock(&s->lock);
+        pthread_cond_broadcast(&s->wake);
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+static void* worker_main(void* arg) {
+    Worker* w = arg;
+    UScheduler* s = w->sched;
+    tls_sched = s;
+    tls_worker = w->index;
+    for (;;) {
+        Task t;
+        if (find_task(s, w->index, &t)) {
+            run_task(s, w->index, t);
+            continue;
+        }
+        pthread_mutex_lock(&s->lock);
+        while (!s->shutdown && atomic_load(&s->queued) == 0)
+            pthread_cond_wait(&s->wake, &s->lock);
+        bool stop = s->shutdown;
+        pthread_mutex_unlock(&s->lock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+UScheduler* u__scheduler_create(uint32_t threads) {
+    if (threads == 0) threads = u__cpu_count();
+    if (threads > U__SCHEDULER_MAX_THREADS) threads = U__SCHEDULER_MAX_THREADS;
+    UScheduler* s = calloc(1, sizeof(UScheduler));
+    if (!s) return NULL;
+    s->threads = threads;
+    s->deques = calloc(threads, sizeof(Deque));
+    s->workers = calloc(threads, sizeof(Worker));
+    s->handles = calloc(threads, sizeof(pthread_t));
+    if (!s->deques || !s->workers || !s->handles) {
+        free(s->deques); free(s->workers); free(s->handles); free(s);
+        return NULL;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+    atomic_init(&s->queued, 0);
+    atomic_init(&s->pending, 0);
+    atomic_init(&s->next, 0);
+    for (uint32_t i = 0; i < threads; i++) {
+        pthread_mutex_init(&s->deques[i].lock, NULL);
+        s->workers[i].sched = s;
+        s->workers[i].index = i;
+    }
+    /* Worker 0 is whoever calls u__scheduler_wait. */
+    for (uint32_t i = 1; i < threads; i++) {
+        if (pthread_create(&s->handles[s->started], NULL, worker_main, &s->workers[i]) != 0) {
+            u__scheduler_destroy(s);
+            return NULL;
+        }
+        s->started++;
+    }
+    return s;
+}
+
+void u__scheduler_destroy(UScheduler* s) {
+    if (!s) return;
+    pthread_mutex_lock(&s->lock);
+    s->shutdown = true;
+    pthread_cond_broadcast(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+    for (uint32_t i = 0; i < s->started; i++) pthread_join(s->handles[i], NULL);
+    for (uint32_t i = 0; i < s->threads; i++) {
+        pthread_mutex_destroy(&s->deques[i].lock);
+        free(s->deques[i].items);
+    }
+    pthread_cond_destroy(&s->wake);
+    pthread_mutex_destroy(&s->lock);
+    free(s->deques);
+    free(s->workers);
+    free(s->handles);
+    free(s);
+}
+
+uint32_t u__scheduler_threads(const UScheduler* s) {
+    return s ? s->threads : 1;
+}
+
+bool u__scheduler_submit(UScheduler* s, UTaskFn fn, void* arg) {
+    if (!s || !fn) return false;
+    uint32_t target = tls_sched == s ? tls_worker : atomic_fetch_add(&s->next, 1) % s->threads;
+    /* Count the task before it becomes visible, so no waiter can see zero
+     * pending while it is queued. */
+    atomic_fetch_add(&s->pending, 1);
+    atomic_fetch_add(&s->queued, 1);
+    if (!deque_push_back(&s->deques[target], (Task){ fn, arg })) {
+        atomic_fetch_sub(&s->queued, 1);
+        atomic_fetch_sub(&s->pending, 1);
+        return false;
+    }
+    pthread_mutex_lock(&s->lock);
+    pthread_cond_broadcast(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+    return true;
+}
+
+void u__scheduler_wait(UScheduler* s) {
+    if (!s) return;
+    UScheduler* saved_sched = tls_sched;
+    uint32_t saved_worker = tls_worker;
+    tls_sched = s;
+    tls_worker = 0;
+    for (;;) {
+        Task t;
+        if (find_task(s, 0, &t)) {
+            run_task(s, 0, t);
+            continue;
+        }
+        pthread_mutex_lock(&s->lock);
+        while (atomic_load(&s->pending) > 0 && atomic_load(&s->queued) == 0)
+            pthread_cond_wait(&s->wake, &s->lock);
+        bool done = atomic_load(&s->pending) == 0;
+        pthread_mutex_unlock(&s->lock);
+        if (done) break;
+    }
+    tls_sched = saved_sched;
+    tls_worker = saved_worker;
+}
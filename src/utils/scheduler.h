@@ -0,0 +1,70 @@
+#ifndef U__SCHEDULER_H
+#define U__SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Upper bound on worker threads, whatever the machine reports. */
+#define U__SCHEDULER_MAX_THREADS 64
+
+/**
+ * Task body
+ * @param arg: Argument given to u__scheduler_submit
+ * @param worker: Index of the thread running the task, 0 being the thread
+ *                that calls u__scheduler_wait
+ */
+typedef void (*UTaskFn)(void* arg, uint32_t worker);
+
+/**
+ * Work-stealing task scheduler.  Every thread owns a deque: it pushes and
+ * pops its own tasks at the back (newest first, while they are still in
+ * cache) and, when it runs dry, steals the oldest task from the front of
+ * another thread's deque.  The thread calling u__scheduler_wait is worker 0
+ * and runs tasks too, so a scheduler with one thread starts no threads and
+ * runs everything in submission order.
+ */
+typedef struct UScheduler UScheduler;
+
+/**
+ * Number of online processors
+ * @return: Processor count, at least 1
+ */
+uint32_t u__cpu_count(void);
+
+/**
+ * Create a scheduler and start its worker threads
+ * @param threads: Total threads including the caller, 0 for u__cpu_count()
+ * @return: Scheduler, NULL on failure
+ */
+UScheduler* u__scheduler_create(uint32_t threads);
+
+/**
+ * Stop the worker threads and free the scheduler
+ * @param s: Scheduler with no tasks outstanding
+ */
+void u__scheduler_destroy(UScheduler* s);
+
+/**
+ * Number of threads tasks run on, including the waiting caller
+ * @param s: Scheduler
+ * @return: Thread count
+ */
+uint32_t u__scheduler_threads(const UScheduler* s);
+
+/**
+ * Queue a task.  May be called from a running task, which queues it on that
+ * worker's own deque.
+ * @param s: Scheduler
+ * @param fn: Task body
+ * @param arg: Argument passed to fn
+ * @return: false if the task could not be queued
+ */
+bool u__scheduler_submit(UScheduler* s, UTaskFn fn, void* arg);
+
+/**
+ * Run tasks on the calling thread until every submitted task has finished
+ * @param s: Scheduler
+ */
+void u__scheduler_wait(UScheduler* s);
+
+#endif
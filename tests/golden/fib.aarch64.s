@@ -0,0 +1,55 @@
+// fib.px
+	.arch armv8-a
+	.text
+	.globl fib
+	.globl main
+
+	.p2align 4
+	.type fib, %function
+fib:
+	stp x29, x30, [sp, #-16]!
+	mov x29, sp
+	sub sp, sp, #32
+	stur x19, [x29, #-16]
+	stur x20, [x29, #-24]
+.Lfib_1:
+	stur x0, [x29, #-8]
+	cmp x0, #2
+	b.ge .Lfib_3
+.Lfib_2:
+	ldur x19, [x29, #-16]
+	ldur x20, [x29, #-24]
+	mov sp, x29
+	ldp x29, x30, [sp], #16
+	ret
+.Lfib_3:
+	ldur x19, [x29, #-8]
+	sub x0, x19, #1
+	bl fib
+	mov x20, x0
+	sub x0, x19, #2
+	bl fib
+	add x0, x20, x0
+	ldur x19, [x29, #-16]
+	ldur x20, [x29, #-24]
+	mov sp, x29
+	ldp x29, x30, [sp], #16
+	ret
+	.size fib, .-fib
+
+	.p2align 4
+	.type main, %function
+main:
+	stp x29, x30, [sp, #-16]!
+	mov x29, sp
+	sub sp, sp, #16
+.Lmain_1:
+	movz x0, #25
+	bl fib
+	movz x1, #256
+	sdiv x2, x0, x1
+	msub x0, x2, x1, x0
+	mov sp, x29
+	ldp x29, x30, [sp], #16
+	ret
+	.size main, .-main
@@ -0,0 +1,54 @@
+; fib.px
+format ELF64
+
+section '.text' executable align 16
+
+public fib
+public main
+
+align 16
+fib:
+    push rbp
+    mov rbp, rsp
+    sub rsp, 32
+    mov qword [rbp-16], rbx
+    mov qword [rbp-24], r12
+    mov rax, rdi
+.L1:
+    mov qword [rbp-8], rax
+    cmp rax, 2
+    jge .L3
+.L2:
+    mov rbx, qword [rbp-16]
+    mov r12, qword [rbp-24]
+    leave
+    ret
+.L3:
+    mov rbx, qword [rbp-8]
+    mov rdi, rbx
+    sub rdi, 1
+    call fib
+    mov r12, rax
+    mov rdi, rbx
+    sub rdi, 2
+    call fib
+    lea rax, [r12+rax]
+    mov rbx, qword [rbp-16]
+    mov r12, qword [rbp-24]
+    leave
+    ret
+
+align 16
+main:
+    push rbp
+    mov rbp, rsp
+    sub rsp, 16
+.L1:
+    mov rdi, 25
+    call fib
+    mov rcx, 256
+    cqo
+    idiv rcx
+    mov rax, rdx
+    leave
+    ret
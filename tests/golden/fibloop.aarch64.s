@@ -0,0 +1,100 @@
+// fibloop.px
+	.arch armv8-a
+	.text
+	.globl fib
+	.globl main
+
+	.p2align 4
+	.type fib, %function
+fib:
+	stp x29, x30, [sp, #-16]!
+	mov x29, sp
+	sub sp, sp, #32
+	stur x19, [x29, #-16]
+	stur x20, [x29, #-24]
+.Lfib_1:
+	stur x0, [x29, #-8]
+	cmp x0, #2
+	b.ge .Lfib_3
+.Lfib_2:
+	ldur x19, [x29, #-16]
+	ldur x20, [x29, #-24]
+	mov sp, x29
+	ldp x29, x30, [sp], #16
+	ret
+.Lfib_3:
+	ldur x19, [x29, #-8]
+	sub x0, x19, #1
+	bl fib
+	mov x20, x0
+	sub x0, x19, #2
+	bl fib
+	add x0, x20, x0
+	ldur x19, [x29, #-16]
+	ldur x20, [x29, #-24]
+	mov sp, x29
+	ldp x29, x30, [sp], #16
+	ret
+	.size fib, .-fib
+
+	.p2align 4
+	.type main, %function
+main:
+	stp x29, x30, [sp, #-16]!
+	mov x29, sp
+	sub sp, sp, #112
+	stur x19, [x29, #-112]
+.Lmain_1:
+	sub x0, x29, #80
+	stur x0, [x29, #-88]
+	movz x0, #0
+	stur x0, [x29, #-96]
+	.p2align 4
+.Lmain_2:
+	ldur x19, [x29, #-96]
+	cmp x19, #10
+	b.ge .Lmain_4
+.Lmain_3:
+	add x0, x19, #10
+	bl fib
+	ldur x1, [x29, #-88]
+	str x0, [x1, x19, lsl #3]
+	add x0, x19, #1
+	stur x0, [x29, #-96]
+	b .Lmain_2
+.Lmain_4:
+	movz x0, #0
+	stur x0, [x29, #-104]
+	movz x0, #0
+	stur x0, [x29, #-96]
+	.p2align 4
+.Lmain_5:
+	ldur x0, [x29, #-96]
+	cmp x0, #10
+	b.ge .Lmain_7
+.Lmain_6:
+	ldur x1, [x29, #-104]
+	ldur x2, [x29, #-88]
+	ldr x2, [x2, x0, lsl #3]
+	movz x3, #7
+	sdiv x4, x2, x3
+	msub x2, x4, x3, x2
+	add x1, x1, x2
+	stur x1, [x29, #-104]
+	add x0, x0, #1
+	stur x0, [x29, #-96]
+	b .Lmain_5
+.Lmain_7:
+	ldur x0, [x29, #-88]
+	ldur x19, [x29, #-104]
+	movz x0, #20
+	bl fib
+	add x0, x19, x0
+	movz x1, #256
+	sdiv x2, x0, x1
+	msub x0, x2, x1, x0
+	ldur x19, [x29, #-112]
+	mov sp, x29
+	ldp x29, x30, [sp], #16
+	ret
+	.size main, .-main
@@ -0,0 +1,96 @@
+; fibloop.px
+format ELF64
+
+section '.text' executable align 16
+
+public fib
+public main
+
+align 16
+fib:
+    push rbp
+    mov rbp, rsp
+    sub rsp, 32
+    mov qword [rbp-16], rbx
+    mov qword [rbp-24], r12
+    mov rax, rdi
+.L1:
+    mov qword [rbp-8], rax
+    cmp rax, 2
+    jge .L3
+.L2:
+    mov rbx, qword [rbp-16]
+    mov r12, qword [rbp-24]
+    leave
+    ret
+.L3:
+    mov rbx, qword [rbp-8]
+    mov rdi, rbx
+    sub rdi, 1
+    call fib
+    mov r12, rax
+    mov rdi, rbx
+    sub rdi, 2
+    call fib
+    lea rax, [r12+rax]
+    mov rbx, qword [rbp-16]
+    mov r12, qword [rbp-24]
+    leave
+    ret
+
+align 16
+main:
+    push rbp
+    mov rbp, rsp
+    sub rsp, 112
+    mov qword [rbp-112], rbx
+.L1:
+    lea rax, [rbp-80]
+    mov qword [rbp-88], rax
+    mov qword [rbp-96], 0
+align 16
+.L2:
+    mov rbx, qword [rbp-96]
+    cmp rbx, 10
+    jge .L4
+.L3:
+    lea rdi, [rbx+10]
+    call fib
+    mov rcx, qword [rbp-88]
+    mov qword [rcx+rbx*8], rax
+    lea rax, [rbx+1]
+    mov qword [rbp-96], rax
+    jmp .L2
+.L4:
+    mov qword [rbp-104], 0
+    mov qword [rbp-96], 0
+align 16
+.L5:
+    mov rcx, qword [rbp-96]
+    cmp rcx, 10
+    jge .L7
+.L6:
+    mov rsi, qword [rbp-104]
+    mov rax, qword [rbp-88]
+    mov rax, qword [rax+rcx*8]
+    mov rdi, 7
+    cqo
+    idiv rdi
+    lea rax, [rsi+rdx]
+    mov qword [rbp-104], rax
+    lea rax, [rcx+1]
+    mov qword [rbp-96], rax
+    jmp .L5
+.L7:
+    mov rax, qword [rbp-88]
+    mov rbx, qword [rbp-104]
+    mov rdi, 20
+    call fib
+    lea rax, [rbx+rax]
+    mov rcx, 256
+    cqo
+    idiv rcx
+    mov rax, rdx
+    mov rbx, qword [rbp-112]
+    leave
+    ret
@@ -0,0 +1,48 @@
+# Helpers sourced by the tests. Every test runs in its own scratch
+# directory, $WORK.
+
+PROGRAMS="$(pwd)/programs"
+
+fail() {
+    echo "$@"
+    exit 1
+}
+
+skip() {
+    echo "$@"
+    exit 77
+}
+
+need() {
+    command -v "$1" > /dev/null 2>&1 || skip "$1 not found"
+}
+
+# Compile a program of tests/programs to $WORK/<name>.o.
+compile() {
+    local name=$1
+    shift
+    "$PAXSY" "$@" -o "$WORK/$name.o" "$PROGRAMS/$name.px" || fail "paxsy $* -o $name.o failed"
+}
+
+# Link $WORK/<name>.o with the C runtime and the alloc() of
+# programs/runtime.c into $WORK/<name>.
+link_native() {
+    local name=$1
+    "$CC" -no-pie -Wl,-z,noexecstack "$WORK/$name.o" "$PROGRAMS/runtime.c" -o "$WORK/$name" \
+        || fail "$CC could not link $name.o"
+}
+
+# Build a C test driver with the paxsy sources it exercises.
+build_unit() {
+    local out=$1
+    shift
+    "$CC" -std=c11 -O2 -pthread -I"$SRCDIR" "$@" -o "$WORK/$out" -lm || fail "could not build $out"
+}
+
+expect_status() {
+    local want=$1
+    shift
+    "$@"
+    local got=$?
+    [ $got -eq $want ] || fail "$*: exit status $got, expected $want"
+}
@@ -0,0 +1,11 @@
+/* Two data sections: a few bytes, then a table that wants 64-byte
+ * alignment. main returns the table's misalignment, which the compiler
+ * must not assume is 0. */
+char pad[3] = { 1, 2, 3 };
+__attribute__((aligned(64))) long table[4] = { 1, 2, 3, 4 };
+
+int main(void) {
+    unsigned long address = (unsigned long)table;
+    __asm__("" : "+r"(address));
+    return (int)(address & 63) + (table[3] != 4 || pad[2] != 3);
+}
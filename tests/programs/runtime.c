@@ -0,0 +1,8 @@
+/* The allocation entry point paxsy programs call, for linking their
+ * objects with the C runtime. */
+#include <stdlib.h>
+
+void *alloc(unsigned long size, unsigned long align) {
+    if (align < 16) align = 16;
+    return aligned_alloc(align, (size + align - 1) / align * align);
+}
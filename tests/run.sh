@@ -0,0 +1,26 @@
+#!/bin/bash
+# Run every tests/test_*.sh against the paxsy binary in $PAXSY and report
+# the ones that fail. A test exits 0 on success, 77 when it is skipped.
+
+cd "$(dirname "$0")"
+export PAXSY="$(cd .. && pwd)/${PAXSY:-paxsy}"
+export CC="${CC:-gcc}"
+export SRCDIR="$(cd ../src && pwd)"
+
+passed=0
+failed=0
+skipped=0
+for t in test_*.sh; do
+    work="$(mktemp -d)"
+    out="$(WORK="$work" bash "$t" 2>&1)"
+    status=$?
+    rm -rf "$work"
+    case $status in
+        0)  passed=$((passed + 1)); echo "PASS: ${t%.sh}"
+            [ -n "$out" ] && echo "$out" | sed 's/^/    /' ;;
+        77) skipped=$((skipped + 1)); echo "SKIP: ${t%.sh} ($out)" ;;
+        *)  failed=$((failed + 1)); echo "FAIL: ${t%.sh}"; echo "$out" | sed 's/^/    /' ;;
+    esac
+done
+echo "$passed passed, $failed failed, $skipped skipped"
+[ $failed -eq 0 ]
@@ -0,0 +1,10 @@
+# Link an object whose .data.table wants 64-byte alignment after a
+# 3-byte .data.pad: the merged .data must place the table on a multiple
+# of 64. The program exits with the table's misalignment.
+. ./lib.sh
+need "$CC"
+
+"$CC" -O2 -fno-pie -fno-toplevel-reorder -fdata-sections -fno-asynchronous-unwind-tables \
+    -c "$PROGRAMS/align.c" -o "$WORK/align.o" || fail "$CC could not compile align.c"
+"$PAXSY" --c=elf "$WORK/align" "$WORK/align.o" || fail "link failed"
+expect_status 0 "$WORK/align"
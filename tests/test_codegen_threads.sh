@@ -0,0 +1,43 @@
+# Compile 10000 functions on one thread and on four: the functions are
+# compiled in parallel and taken back in module order, so the objects and
+# the --debug-info=compile reports are the same. Reports the speedup.
+. ./lib.sh
+need cmp
+
+FUNCTIONS=10000
+{
+    for ((i = 0; i < FUNCTIONS; i++)); do
+        echo "def f$i(n: Int<8>): Int<8> {"
+        echo "    def i: Int<8> = 0;"
+        echo "    def s: Int<8> = 0;"
+        echo "    DO(i < n) {"
+        echo "        s = s * 3 + i % $((i % 7 + 2));"
+        echo "        i++;"
+        echo "    }"
+        echo "    return s + $i;"
+        echo "}"
+    done
+    echo "def main(Void): Int<32> { return f0(4) % 256; }"
+} > "$WORK/many.px"
+
+now() { date +%s%N; }
+
+start=$(now)
+"$PAXSY" -threads=1 -o "$WORK/serial.o" "$WORK/many.px" || fail "compile on one thread failed"
+serial=$(( ($(now) - start) / 1000000 ))
+start=$(now)
+"$PAXSY" -threads=4 -o "$WORK/parallel.o" "$WORK/many.px" || fail "compile on four threads failed"
+parallel=$(( ($(now) - start) / 1000000 ))
+cmp "$WORK/serial.o" "$WORK/parallel.o" || fail "the objects compiled on one and on four threads differ"
+
+"$PAXSY" -threads=1 --debug-info=compile -o "$WORK/serial.o" "$WORK/many.px" > "$WORK/serial.log" \
+    || fail "compile on one thread failed"
+"$PAXSY" -threads=4 --debug-info=compile -o "$WORK/parallel.o" "$WORK/many.px" > "$WORK/parallel.log" \
+    || fail "compile on four threads failed"
+cmp "$WORK/serial.log" "$WORK/parallel.log" || fail "the reports on one and on four threads differ"
+[ $(grep -c "^codegen f" "$WORK/serial.log") -eq $FUNCTIONS ] || fail "not every function was reported"
+
+[ $parallel -gt 0 ] || parallel=1
+speedup=$((serial * 100 / parallel))
+printf "compiled %d functions in %d ms on one thread, %d ms on four: %d.%02dx on %s processors\n" \
+    $FUNCTIONS $serial $parallel $((speedup / 100)) $((speedup % 100)) "$(nproc 2> /dev/null || echo 1)"
@@ -0,0 +1,31 @@
+# Under -fprofile-use the branch of hot.px the training run never took
+# is laid out cold and emitted to .text.cold, reached from main and
+# returning to it through relocations. The object runs linked by the C
+# compiler and by paxsy; with -ffunction-sections the cold part is
+# .text.cold.main. The AArch64 object branches to it with a b.
+. ./lib.sh
+need "$CC"
+need readelf
+
+cp "$PROGRAMS/hot.px" "$WORK/hot.px"
+expect_status 156 "$PAXSY" -fprofile-generate="$WORK/hot.prof" -run "$WORK/hot.px"
+
+"$PAXSY" -S "$WORK/hot.s" "$WORK/hot.px" || fail "paxsy -S without a profile failed"
+grep -q "text.cold" "$WORK/hot.s" && fail ".text.cold without a profile"
+"$PAXSY" -fprofile-use="$WORK/hot.prof" -S "$WORK/hot.s" "$WORK/hot.px" || fail "paxsy -S failed"
+grep -q "^section '.text.cold' executable" "$WORK/hot.s" || fail "no .text.cold in hot.s"
+
+compile hot -fprofile-use="$WORK/hot.prof"
+readelf -SW "$WORK/hot.o" | grep -q ' \.text\.cold ' || fail "no .text.cold section in hot.o"
+readelf -sW "$WORK/hot.o" | grep -q ' main\.cold$' || fail "no main.cold symbol in hot.o"
+readelf -rW "$WORK/hot.o" | grep -q 'R_X86_64_PC32 .* main\.cold' || fail "no branch from main to main.cold"
+link_native hot
+expect_status 156 "$WORK/hot"
+"$PAXSY" --c=elf "$WORK/linked" "$WORK/hot.o" || fail "paxsy could not link hot.o"
+expect_status 156 "$WORK/linked"
+
+compile hot -ffunction-sections -fprofile-use="$WORK/hot.prof"
+readelf -SW "$WORK/hot.o" | grep -q ' \.text\.cold\.main ' || fail "no .text.cold.main section"
+
+"$PAXSY" --tarch=aarch64 -fprofile-use="$WORK/hot.prof" -o "$WORK/a64.o" "$WORK/hot.px" || fail "paxsy --tarch=aarch64 failed"
+readelf -rW "$WORK/a64.o" | grep -q 'R_AARCH64_JUMP26 .* main\.cold' || fail "no b from main to main.cold on AArch64"
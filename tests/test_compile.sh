@@ -0,0 +1,19 @@
+# Compile a source through every output built from the IR: assembly,
+# an object, bitcode and -flto. The objects are linked and run.
+. ./lib.sh
+need "$CC"
+
+cp "$PROGRAMS/fib.px" "$WORK/fib.px"
+"$PAXSY" -S "$WORK/fib.s" "$WORK/fib.px" || fail "paxsy -S failed"
+grep -q '^main:' "$WORK/fib.s" || fail "no main in fib.s"
+
+compile fib
+link_native fib
+expect_status 17 "$WORK/fib"
+
+"$PAXSY" -emit-bitcode -o "$WORK/fib.o" "$WORK/fib.px" || fail "paxsy -emit-bitcode failed"
+[ -s "$WORK/fib.pxbc" ] || fail "no bitcode written"
+
+"$PAXSY" -flto -o "$WORK/fib.o" "$WORK/fib.px" || fail "paxsy -flto failed"
+link_native fib
+expect_status 17 "$WORK/fib"
@@ -0,0 +1,22 @@
+# The interpreter (-run), the JIT (-jit) and the native object must agree
+# on the exit status of a program with recursion, loops and allocation.
+. ./lib.sh
+
+"$PAXSY" -run "$PROGRAMS/fibloop.px"
+run=$?
+[ $run -eq 137 ] || fail "-run: exit status $run, expected 137"
+
+if [ "$(uname -m)" = x86_64 ]; then
+    for tier_up in 0 1 1000; do
+        "$PAXSY" -jit -jit-tier-up=$tier_up "$PROGRAMS/fibloop.px"
+        jit=$?
+        [ $jit -eq $run ] || fail "-jit -jit-tier-up=$tier_up: exit status $jit, -run gave $run"
+    done
+fi
+
+need "$CC"
+compile fibloop
+link_native fibloop
+"$WORK/fibloop"
+native=$?
+[ $native -eq $run ] || fail "native: exit status $native, -run gave $run"
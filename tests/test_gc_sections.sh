@@ -0,0 +1,25 @@
+# Link an object compiled with -ffunction-sections, with and without
+# --gc-sections: the two functions main does not reach are removed, and
+# the bytes reported are the sizes of their sections.
+. ./lib.sh
+need readelf
+
+compile unused -ffunction-sections
+size() {
+    local hex=$(readelf -SW "$WORK/unused.o" | awk -v name="$1" '{ for (i = 1; i < NF; i++) if ($i == name) print $(i + 4) }')
+    echo $((16#${hex:-0}))
+}
+want=$(( $(size .text.square) + $(size .text.cube) ))
+[ $want -gt 0 ] || fail "no .text.square and .text.cube sections in unused.o"
+
+"$PAXSY" --c=elf --gc-sections "$WORK/gc" "$WORK/unused.o" 2> "$WORK/gc.log" || fail "link with --gc-sections failed"
+grep -q "removed $want bytes in 2 sections" "$WORK/gc.log" || fail "report: $(cat "$WORK/gc.log"), expected $want bytes in 2 sections"
+
+"$PAXSY" --c=elf "$WORK/all" "$WORK/unused.o" 2> "$WORK/all.log" || fail "link without --gc-sections failed"
+grep -q "removed" "$WORK/all.log" && fail "sections removed without --gc-sections"
+[ $(stat -c %s "$WORK/gc") -lt $(stat -c %s "$WORK/all") ] || fail "--gc-sections did not shrink the executable"
+
+# Sources are compiled to objects and linked the same way.
+"$PAXSY" -ffunction-sections --c=elf --gc-sections "$WORK/src" "$PROGRAMS/unused.px" 2> "$WORK/src.log" \
+    || fail "link from the source failed"
+grep -q "removed $want bytes in 2 sections" "$WORK/src.log" || fail "report from the source: $(cat "$WORK/src.log")"
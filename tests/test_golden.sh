@@ -0,0 +1,13 @@
+# The assembly of the test programs for both targets, compared with the
+# files in golden/. After an intended change to the code generators,
+# regenerate them with paxsy --tarch=<arch> -S in a copy of programs/.
+. ./lib.sh
+
+cd "$WORK"
+for arch in x86_64 aarch64; do
+    for name in fib fibloop; do
+        cp "$PROGRAMS/$name.px" .
+        "$PAXSY" --tarch=$arch -S $name.s $name.px || fail "paxsy --tarch=$arch -S $name.px failed"
+        diff -u "$OLDPWD/golden/$name.$arch.s" $name.s || fail "$name.$arch.s differs from the golden file"
+    done
+done
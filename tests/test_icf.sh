@@ -0,0 +1,29 @@
+# Identical code folding: --icf=safe leaves a function whose address is
+# taken, unless the section taking it is dropped by --gc-sections. The
+# driver folds identical functions of a program, which still runs.
+. ./lib.sh
+need "$CC"
+
+build_unit icf unit/icf.c "$SRCDIR/build/build.c" "$SRCDIR/utils/arena.c" "$SRCDIR/utils/scheduler.c"
+"$WORK/icf" "$WORK/icf.o" 2> "$WORK/icf.log" || fail "folding: $(cat "$WORK/icf.log")"
+
+cp "$PROGRAMS/calltwice.px" "$PROGRAMS/twice.px" "$WORK"
+sed 's/twice/double/g' "$WORK/twice.px" > "$WORK/double.px"
+sed 's/return twice(21);/return twice(20) + double(1);/; 1a pro double(n: Int<8>): Int<8>;' \
+    "$WORK/calltwice.px" > "$WORK/both.px"
+for mode in safe all; do
+    "$PAXSY" -ffunction-sections --c=elf --icf=$mode "$WORK/$mode" "$WORK/both.px" "$WORK/twice.px" \
+        "$WORK/double.px" 2> "$WORK/$mode.log" || fail "link with --icf=$mode failed: $(cat "$WORK/$mode.log")"
+    grep -q "icf=$mode folded 1 sections" "$WORK/$mode.log" || fail "--icf=$mode: $(cat "$WORK/$mode.log")"
+done
+"$PAXSY" --c=elf --icf=some "$WORK/x" "$WORK/both.px" 2>&1 | grep -q "Invalid value for --icf: some" \
+    || fail "--icf=some not reported"
+
+case "$(uname -m)" in
+    x86_64) machine="X86-64" ;;
+    aarch64) machine="AArch64" ;;
+    *) exit 0 ;;
+esac
+need readelf
+readelf -h "$WORK/safe" 2> /dev/null | grep -q "$machine" || exit 0
+expect_status 42 "$WORK/safe"
@@ -0,0 +1,17 @@
+# A fill loop with a small constant count becomes inline vector stores;
+# a large one keeps rep stos. The small one is linked and run.
+. ./lib.sh
+need "$CC"
+
+cp "$PROGRAMS/fill.px" "$WORK/fill.px"
+"$PAXSY" -S "$WORK/fill.s" "$WORK/fill.px" || fail "paxsy -S failed"
+grep -q 'movdqu' "$WORK/fill.s" || fail "no movdqu in fill.s"
+grep -q 'rep stos' "$WORK/fill.s" && fail "small fill kept rep stos"
+
+sed -e 's/11/1000/g; s/88/8000/; s/\[10\]/[999]/' "$WORK/fill.px" > "$WORK/big.px"
+"$PAXSY" -S "$WORK/big.s" "$WORK/big.px" || fail "paxsy -S failed on big.px"
+grep -q 'rep stosq' "$WORK/big.s" || fail "large fill lost rep stosq"
+
+compile fill
+link_native fill
+expect_status 7 "$WORK/fill"
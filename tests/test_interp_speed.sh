@@ -0,0 +1,40 @@
+# The interpreter (-run) against native code on examples/*.px and the
+# programs with a main: each is run both ways, the exit statuses must
+# agree, and the times are reported. Examples that do not compile are
+# reported and left out. Times are of whole runs, process start included.
+. ./lib.sh
+need "$CC"
+
+RUNS=5
+EXAMPLES="$(cd ../examples && pwd)"
+
+now() { date +%s%N; }
+
+# Milliseconds for RUNS runs of a command; its exit status in $status.
+timed() {
+    local start=$(now)
+    for ((r = 0; r < RUNS; r++)); do
+        "$@" > /dev/null 2>&1 < /dev/null
+        status=$?
+    done
+    elapsed=$(( ($(now) - start) / 1000000 ))
+}
+
+for src in "$EXAMPLES"/*.px "$PROGRAMS"/{fib,fibloop,fill,hot}.px; do
+    name=$(basename "$src" .px)
+    if ! "$PAXSY" -o "$WORK/$name.o" "$src" > /dev/null 2>&1; then
+        echo "$name: does not compile, not timed"
+        continue
+    fi
+    "$CC" -no-pie -Wl,-z,noexecstack "$WORK/$name.o" "$PROGRAMS/runtime.c" -o "$WORK/$name" \
+        || fail "$CC could not link $name.o"
+    timed "$WORK/$name"
+    native=$elapsed native_status=$status
+    timed "$PAXSY" -run "$src"
+    run=$elapsed
+    [ $status -eq $native_status ] || fail "$name: -run exit status $status, native gave $native_status"
+    [ $native -gt 0 ] || native=1
+    ratio=$((run * 10 / native))
+    printf "%s: %d ms interpreted, %d ms native over %d runs, %d.%dx\n" \
+        "$name" $run $native $RUNS $((ratio / 10)) $((ratio % 10))
+done
@@ -0,0 +1,53 @@
+# Link many sources on one thread and on four: the sections are copied and
+# relocated in parallel, into ranges of their own, so the executables are
+# the same file. The executable runs where it was built for the host.
+. ./lib.sh
+need cmp
+
+OBJECTS=100
+FUNCTIONS=50
+sources=("$WORK/main.px")
+for ((i = 0; i < OBJECTS; i++)); do
+    {
+        for ((j = 0; j < FUNCTIONS; j++)); do
+            echo "def f${i}_$j(n: Int<8>): Int<8> { return n * 3 + $j; }"
+        done
+        echo "def g$i(n: Int<8>): Int<8> {"
+        echo "    def s: Int<8> = 0;"
+        for ((j = 0; j < FUNCTIONS; j++)); do
+            echo "    s = s + f${i}_$j(n);"
+        done
+        echo "    return s;"
+        echo "}"
+    } > "$WORK/o$i.px"
+    sources+=("$WORK/o$i.px")
+done
+{
+    for ((i = 0; i < OBJECTS; i++)); do
+        echo "pro g$i(n: Int<8>): Int<8>;"
+    done
+    echo "def main(Void): Int<32> {"
+    echo "    def s: Int<8> = 0;"
+    for ((i = 0; i < OBJECTS; i++)); do
+        echo "    s = s + g$i($i);"
+    done
+    echo "    return s % 256;"
+    echo "}"
+} > "$WORK/main.px"
+
+"$PAXSY" -ffunction-sections --c=elf -threads=1 "$WORK/serial" "${sources[@]}" || fail "link on one thread failed"
+"$PAXSY" -ffunction-sections --c=elf -threads 4 "$WORK/parallel" "${sources[@]}" || fail "link on four threads failed"
+cmp "$WORK/serial" "$WORK/parallel" || fail "the executables linked on one and on four threads differ"
+[ $(stat -c %s "$WORK/serial") -gt $((2 * 65536)) ] || fail "the executable is too small to be split across threads"
+
+# sum over i, j of 3i + j, for i < OBJECTS and j < FUNCTIONS
+want=$(( (3 * FUNCTIONS * OBJECTS * (OBJECTS - 1) / 2 + OBJECTS * FUNCTIONS * (FUNCTIONS - 1) / 2) % 256 ))
+case "$(uname -m)" in
+    x86_64) machine="X86-64" ;;
+    aarch64) machine="AArch64" ;;
+    *) machine="" ;;
+esac
+need readelf
+[ -n "$machine" ] && readelf -h "$WORK/serial" 2> /dev/null | grep -q "$machine" || exit 0
+[ -x "$WORK/serial" ] || fail "the executable is not executable"
+expect_status $want "$WORK/serial"
@@ -0,0 +1,43 @@
+# The ELF64 object written from a source by the integrated assembler:
+# its .text holds the bytes -S prints after each instruction under
+# --debug-info=compile, function after function at 16-byte alignment,
+# and every call has a relocation. The x86-64 object is linked and run;
+# an AArch64 one is written too.
+. ./lib.sh
+need readelf
+need llvm-objcopy
+need xxd
+need "$CC"
+
+cd "$WORK"
+cp "$PROGRAMS/fib.px" .
+"$PAXSY" --tarch=x86_64 --debug-info=compile -S fib.s fib.px > /dev/null || fail "paxsy -S fib.px failed"
+"$PAXSY" --tarch=x86_64 -o fib.o fib.px || fail "paxsy -o fib.o failed"
+elf="$(readelf -hsr fib.o)"
+for want in "ELF64" "REL (Relocatable file)" "X86-64" "FUNC    GLOBAL DEFAULT .* fib$" \
+            "FUNC    GLOBAL DEFAULT .* main$" "R_X86_64_PLT32 .* fib - 4"; do
+    echo "$elf" | grep -q -- "$want" || fail "fib.o: no \"$want\" in readelf output"
+done
+
+llvm-objcopy -O binary --only-section=.text fib.o fib.text
+text=$(xxd -p fib.text | tr -d '\n')
+pos=0
+while read -r code; do
+    pos=$(( (pos + 31) / 32 * 32 ))     # 16 bytes, in hex digits
+    [ "${text:pos:${#code}}" = "$code" ] || fail "fib.o: .text differs from the bytes of fib.s at offset $((pos / 2))"
+    pos=$((pos + ${#code}))
+done < <(awk '/^[A-Za-z_][A-Za-z0-9_]*:$/ { if (code != "") print code; code = "" }
+              /\t; [0-9a-f][0-9a-f]( [0-9a-f][0-9a-f])*$/ { sub(/.*\t; /, ""); gsub(/ /, ""); code = code $0 }
+              END { print code }' fib.s)
+[ $pos -eq ${#text} ] || fail "fib.o: .text has $(( (${#text} - pos) / 2 )) bytes after the last function"
+
+calls=$(grep -c '^ *call ' fib.s)
+relocs=$(readelf -r fib.o | grep -c 'PLT32')
+[ $calls -eq $relocs ] || fail "fib.o: $relocs PLT32 relocations for $calls calls"
+
+link_native fib
+expect_status 17 "$WORK/fib"
+
+compile fib --tarch=aarch64
+readelf -h "$WORK/fib.o" | grep -q "AArch64" || fail "fib.o: not an AArch64 object"
+readelf -s "$WORK/fib.o" | grep -q "FUNC    GLOBAL DEFAULT .* main$" || fail "fib.o: no main"
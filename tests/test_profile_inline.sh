@@ -0,0 +1,24 @@
+# Inlining under -fprofile-use: mix is over the threshold but called 100
+# times per run of main, so the call in the loop is inlined; the calls
+# in the branch the training run never took are not, though tiny would
+# be inlined without a profile.
+. ./lib.sh
+need "$CC"
+
+cp "$PROGRAMS/hot.px" "$WORK/hot.px"
+expect_status 156 "$PAXSY" -fprofile-generate="$WORK/hot.prof" -run "$WORK/hot.px"
+[ -s "$WORK/hot.prof" ] || fail "no profile written"
+
+"$PAXSY" -flto -Rpass=inline -S "$WORK/plain.s" "$WORK/hot.px" 2> "$WORK/plain.log" || fail "paxsy -flto failed"
+grep -q "inlined 'tiny'" "$WORK/plain.log" || fail "tiny not inlined without a profile: $(cat "$WORK/plain.log")"
+grep -q "inlined 'mix'" "$WORK/plain.log" && fail "mix inlined without a profile"
+
+"$PAXSY" -flto -fprofile-use="$WORK/hot.prof" -Rpass=inline -S "$WORK/hot.s" "$WORK/hot.px" 2> "$WORK/hot.log" \
+    || fail "paxsy -flto -fprofile-use failed"
+[ "$(grep -c "inlined 'mix' into 'main'" "$WORK/hot.log")" -eq 1 ] || fail "hot call not inlined once: $(cat "$WORK/hot.log")"
+grep -q ":19:.*inlined 'mix'" "$WORK/hot.log" || fail "inlined the wrong call of mix: $(cat "$WORK/hot.log")"
+grep -q "inlined 'tiny'" "$WORK/hot.log" && fail "cold call of tiny inlined"
+
+"$PAXSY" -flto -fprofile-use="$WORK/hot.prof" -o "$WORK/hot.o" "$WORK/hot.px" || fail "paxsy -flto -o failed"
+link_native hot
+expect_status 156 "$WORK/hot"
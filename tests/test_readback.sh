@@ -0,0 +1,6 @@
+# Objects written by build.c, read back by the linker's object reader.
+. ./lib.sh
+need "$CC"
+
+build_unit readback unit/readback.c "$SRCDIR/build/build.c" "$SRCDIR/utils/arena.c" "$SRCDIR/utils/scheduler.c"
+"$WORK/readback" "$WORK/x86_64.o" "$WORK/aarch64.o" || fail "objects read back differently"
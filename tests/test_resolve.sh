@@ -0,0 +1,33 @@
+# Symbol resolution: 500 objects linked with every reference checked,
+# and the reports of a symbol defined twice and of an undefined one.
+. ./lib.sh
+need "$CC"
+
+build_unit resolve unit/resolve.c "$SRCDIR/build/build.c" "$SRCDIR/utils/arena.c" "$SRCDIR/utils/scheduler.c"
+mkdir "$WORK/many" "$WORK/dup" "$WORK/undef"
+"$WORK/resolve" resolve "$WORK/many" 2> /dev/null || fail "500 objects did not resolve"
+
+"$WORK/resolve" resolve-duplicate "$WORK/dup" 2> "$WORK/dup.log" || fail "duplicate symbols linked"
+for f in f0_0 f0_1; do
+    grep -q "Duplicate symbol $f, defined in $WORK/dup/a.o and in $WORK/dup/b.o" "$WORK/dup.log" \
+        || fail "no duplicate report for $f: $(cat "$WORK/dup.log")"
+done
+
+"$WORK/resolve" resolve-undefined "$WORK/undef" 2> "$WORK/undef.log" || fail "undefined symbols linked"
+for f in f7_0 f7_1; do
+    grep -q "Undefined symbol $f, referenced by $WORK/undef/a.o" "$WORK/undef.log" \
+        || fail "no undefined report for $f: $(cat "$WORK/undef.log")"
+done
+
+# The same reports for sources linked by the driver.
+cp "$PROGRAMS/fib.px" "$PROGRAMS/twice.px" "$PROGRAMS/calltwice.px" "$WORK"
+cp "$WORK/twice.px" "$WORK/again.px"
+"$PAXSY" --c=elf "$WORK/x" "$WORK/fib.px" "$WORK/twice.px" "$WORK/again.px" 2> "$WORK/x.log" \
+    && fail "the driver linked a symbol defined twice"
+grep -q "Duplicate symbol twice, defined in .*/1-twice.o and in .*/2-again.o" "$WORK/x.log" \
+    || fail "no duplicate report from the driver: $(cat "$WORK/x.log")"
+"$PAXSY" --c=elf "$WORK/x" "$WORK/calltwice.px" 2> "$WORK/x.log" \
+    && fail "the driver linked an undefined symbol"
+grep -q "Undefined symbol twice, referenced by .*/0-calltwice.o" "$WORK/x.log" \
+    || fail "no undefined report from the driver: $(cat "$WORK/x.log")"
+"$PAXSY" --c=elf "$WORK/x" "$WORK/calltwice.px" "$WORK/twice.px" || fail "the driver could not link calltwice"
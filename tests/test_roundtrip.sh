@@ -0,0 +1,28 @@
+# The AArch64 encoder against an external assembler: the word printed
+# after each instruction under --debug-info=compile must be the one
+# llvm-mc makes of the same -S output, leaving out the nops llvm-mc pads
+# functions with, and the .text and relocations paxsy writes with -o
+# must be those of llvm-mc's object.
+. ./lib.sh
+need llvm-mc
+need llvm-objcopy
+need readelf
+
+cd "$WORK"
+for name in fib fibloop; do
+    cp "$PROGRAMS/$name.px" .
+    "$PAXSY" --tarch=aarch64 --debug-info=compile -S $name.s $name.px > /dev/null \
+        || fail "paxsy -S $name.px failed"
+    "$PAXSY" --tarch=aarch64 -o $name.o $name.px || fail "paxsy -o $name.o failed"
+    llvm-mc -triple=aarch64 -filetype=obj $name.s -o $name.mc.o || fail "llvm-mc rejected $name.s"
+    for o in $name.o $name.mc.o; do
+        llvm-objcopy -O binary --only-section=.text $o $o.text
+        readelf -rW $o | awk '/R_AARCH64/ { print $1, $3, $5 }' > $o.rel
+    done
+    od -An -v -w4 -tx4 $name.mc.o.text | tr -d ' ' | grep -v '^d503201f$' > $name.mc.words
+    sed -n 's|.*// \([0-9a-f]\{8\}\)$|\1|p' $name.s > $name.words
+    [ -s $name.words ] || fail "$name.s: no encodings printed"
+    diff -u $name.mc.words $name.words || fail "$name: encodings differ from llvm-mc's"
+    cmp $name.o.text $name.mc.o.text || fail "$name: .text differs from llvm-mc's"
+    diff -u $name.mc.o.rel $name.o.rel || fail "$name: relocations differ from llvm-mc's"
+done
@@ -0,0 +1,21 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+/*
+ * Assertions of the C test drivers. A failed check is reported with its
+ * line and counted; the driver returns check_failures != 0 from main().
+ */
+static int check_failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                    \
+                    __FILE__, __LINE__, #cond);                             \
+            check_failures++;                                               \
+        }                                                                   \
+    } while (0)
+
+#endif
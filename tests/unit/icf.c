@@ -0,0 +1,82 @@
+/*
+ * Identical code folding of two identical functions, a and b, both
+ * called by main. A pointer to a sits in .data.ptr, which main does not
+ * reach. --icf=safe must not take a's address from it once --gc-sections
+ * has dropped it, so a and b fold; with the pointer kept, a's address is
+ * taken and only --icf=all folds them.
+ * Sections are static, so linker.c is included here.
+ */
+#include "linker/linker.c"
+#include "build/build.h"
+#include "check.h"
+
+#define R_X86_64_64 1
+#define R_X86_64_PLT32 4
+
+static uint8_t main_code[16] = {
+    0xE8, 0, 0, 0, 0,                   /* call a */
+    0xE8, 0, 0, 0, 0,                   /* call b */
+    0x31, 0xC0,                         /* xor eax, eax */
+    0xC3                                /* ret */
+};
+static uint8_t function_code[16] = {
+    0xB8, 42, 0, 0, 0,                  /* mov eax, 42 */
+    0xC3                                /* ret */
+};
+static uint8_t pointer[8];
+
+static int write_object(const char *path) {
+    BuildObjectWriter *w = build__create(path, BUILD_MACHINE_X86_64);
+    if (!w) return -1;
+    uint32_t text_main = build__add_section(w, SECTION_TEXT, ".text.main", main_code, sizeof(main_code), 16);
+    uint32_t text_a = build__add_section(w, SECTION_TEXT, ".text.a", function_code, sizeof(function_code), 16);
+    uint32_t text_b = build__add_section(w, SECTION_TEXT, ".text.b", function_code, sizeof(function_code), 16);
+    uint32_t data = build__add_section(w, SECTION_DATA, ".data.ptr", pointer, sizeof(pointer), 8);
+    BuildSymbol main_sym = { "main", 0, sizeof(main_code), text_main, SYMBOL_GLOBAL };
+    BuildSymbol a_sym = { "a", 0, sizeof(function_code), text_a, SYMBOL_GLOBAL };
+    BuildSymbol b_sym = { "b", 0, sizeof(function_code), text_b, SYMBOL_GLOBAL };
+    BuildSymbol ptr_sym = { "ptr", 0, sizeof(pointer), data, SYMBOL_GLOBAL };
+    if (!text_main || !text_a || !text_b || !data || build__add_symbol(w, &main_sym) < 0 ||
+        build__add_symbol(w, &ptr_sym) < 0)
+        goto fail;
+    int a = build__add_symbol(w, &a_sym), b = build__add_symbol(w, &b_sym);
+    BuildRelocation call_a = { 1, a, R_X86_64_PLT32, -4 };
+    BuildRelocation call_b = { 6, b, R_X86_64_PLT32, -4 };
+    BuildRelocation address_a = { 0, a, R_X86_64_64, 0 };
+    if (a < 0 || b < 0 || build__add_relocation(w, text_main, &call_a) != 0 ||
+        build__add_relocation(w, text_main, &call_b) != 0 ||
+        build__add_relocation(w, data, &address_a) != 0)
+        goto fail;
+    return build__finalize(w);
+fail:
+    build__destroy(w);
+    return -1;
+}
+
+/* Link the object and return how many sections were folded. */
+static int folded(const char *path, IcfMode mode, int gc_sections) {
+    Linker linker;
+    linker__init(&linker);
+    linker__set_entry(&linker, "main");
+    linker__set_gc_sections(&linker, gc_sections);
+    linker__set_icf(&linker, mode);
+    CHECK(linker__add_object(&linker, path) == 0);
+    CHECK(linker__link(&linker) == 0);
+    int n = linker.icf_folded_sections;
+    if (n == 1) CHECK(linker.icf_saved_bytes == sizeof(function_code));
+    linker__destroy(&linker);
+    return n;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <object>\n", argv[0]);
+        return 2;
+    }
+    CHECK(write_object(argv[1]) == 0);
+    CHECK(folded(argv[1], ICF_SAFE, 1) == 1);
+    CHECK(folded(argv[1], ICF_SAFE, 0) == 0);
+    CHECK(folded(argv[1], ICF_ALL, 1) == 1);
+    CHECK(folded(argv[1], ICF_ALL, 0) == 1);
+    return check_failures != 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * Write objects with the ELF writer of build.c and read them back with
+ * the linker's object reader: sections, symbols and relocations must
+ * come back as they were written. The reader is static, so linker.c is
+ * included here.
+ */
+#include "linker/linker.c"
+#include "build/build.h"
+#include "check.h"
+
+#define R_X86_64_64       1
+#define R_X86_64_PC32     2
+#define R_X86_64_PLT32    4
+#define R_AARCH64_CALL26  283
+
+static const Section *find_section(const ObjectFile *obj, const char *name) {
+    for (int i = 0; i < obj->num_sections; i++)
+        if (strcmp(obj->sections[i].name, name) == 0) return &obj->sections[i];
+    return NULL;
+}
+
+static const Symbol *find_symbol(const ObjectFile *obj, const char *name) {
+    for (int i = 0; i < obj->num_symbols; i++)
+        if (strcmp(obj->symbols[i].name, name) == 0) return &obj->symbols[i];
+    return NULL;
+}
+
+static uint32_t section_index(const ObjectFile *obj, const char *name) {
+    const Section *sec = find_section(obj, name);
+    return sec ? (uint32_t)(sec - obj->sections) : SECTION_NONE;
+}
+
+/* The relocation of sec at offset, or NULL. */
+static const Relocation *find_reloc(const ObjectFile *obj, const Section *sec, uint64_t offset) {
+    for (int i = sec->first_reloc; i < sec->first_reloc + sec->num_relocs; i++)
+        if (obj->relocs[i].offset == offset) return &obj->relocs[i];
+    return NULL;
+}
+
+static void check_reloc(const ObjectFile *obj, const char *section, uint64_t offset,
+                        const char *symbol, int type, int64_t addend) {
+    const Section *sec = find_section(obj, section);
+    const Relocation *rel = sec ? find_reloc(obj, sec, offset) : NULL;
+    CHECK(rel != NULL);
+    if (!rel) return;
+    CHECK(rel->section_index == section_index(obj, section));
+    CHECK(rel->symbol_index < (uint32_t)obj->num_symbols);
+    CHECK(strcmp(obj->symbols[rel->symbol_index].name, symbol) == 0);
+    CHECK(rel->type == type);
+    CHECK(rel->addend == addend);
+}
+
+static void x86_64_object(const char *path) {
+    static uint8_t code[32], data[16];
+    for (int i = 0; i < 32; i++) code[i] = (uint8_t)(0x90 + i);
+    BuildObjectWriter *w = build__create(path, BUILD_MACHINE_X86_64);
+    CHECK(w != NULL);
+    if (!w) return;
+    uint32_t text = build__add_section(w, SECTION_TEXT, ".text", code, sizeof(code), 16);
+    uint32_t dat = build__add_section(w, SECTION_DATA, ".data", data, sizeof(data), 8);
+    uint32_t bss = build__add_section(w, SECTION_BSS, ".bss", NULL, 64, 8);
+    BuildSymbol func = { "func", 0, sizeof(code), text, SYMBOL_GLOBAL };
+    BuildSymbol table = { "table", 0, sizeof(data), dat, SYMBOL_LOCAL };
+    BuildSymbol counter = { "counter", 8, 8, bss, SYMBOL_LOCAL };
+    BuildSymbol ext = { "ext", 0, 0, 0, SYMBOL_GLOBAL };
+    int f = build__add_symbol(w, &func);
+    build__add_symbol(w, &table);
+    int c = build__add_symbol(w, &counter);
+    int e = build__add_symbol(w, &ext);
+    BuildRelocation pc = { 4, c, R_X86_64_PC32, -4 };
+    BuildRelocation call = { 12, e, R_X86_64_PLT32, -4 };
+    BuildRelocation abs = { 0, f, R_X86_64_64, 8 };
+    CHECK(build__add_relocation(w, text, &pc) == 0);
+    CHECK(build__add_relocation(w, text, &call) == 0);
+    CHECK(build__add_relocation(w, dat, &abs) == 0);
+    CHECK(build__finalize(w) == 0);
+
+    Linker linker;
+    linker__init(&linker);
+    CHECK(linker__add_object(&linker, path) == 0);
+    CHECK(linker.num_objects == 1);
+    if (linker.num_objects == 1) {
+        const ObjectFile *obj = &linker.objects[0];
+        CHECK(obj->machine == ELF_EM_X86_64);
+        CHECK(obj->num_sections == 3);
+
+        const Section *t = find_section(obj, ".text");
+        const Section *d = find_section(obj, ".data");
+        const Section *b = find_section(obj, ".bss");
+        CHECK(t && t->size == sizeof(code) && t->flags == 0x5 && t->data &&
+              memcmp(t->data, code, sizeof(code)) == 0);
+        CHECK(d && d->size == sizeof(data) && d->flags == 0x3 && d->data);
+        CHECK(b && b->size == 64 && b->flags == 0x3 && b->data == NULL);
+
+        const Symbol *sf = find_symbol(obj, "func");
+        const Symbol *st = find_symbol(obj, "table");
+        const Symbol *sc = find_symbol(obj, "counter");
+        const Symbol *se = find_symbol(obj, "ext");
+        CHECK(sf && sf->is_global && sf->is_defined && !sf->is_weak &&
+              sf->section_index == section_index(obj, ".text") && sf->value == 0);
+        CHECK(st && !st->is_global && st->is_defined && st->section_index == section_index(obj, ".data"));
+        CHECK(sc && !sc->is_global && sc->is_defined &&
+              sc->section_index == section_index(obj, ".bss") && sc->value == 8);
+        CHECK(se && se->is_global && !se->is_defined && se->section_index == SECTION_NONE);
+
+        CHECK(obj->num_relocs == 3);
+        CHECK(t && t->num_relocs == 2);
+        CHECK(d && d->num_relocs == 1);
+        check_reloc(obj, ".text", 4, "counter", R_X86_64_PC32, -4);
+        check_reloc(obj, ".text", 12, "ext", R_X86_64_PLT32, -4);
+        check_reloc(obj, ".data", 0, "func", R_X86_64_64, 8);
+    }
+    linker__destroy(&linker);
+}
+
+static void aarch64_object(const char *path) {
+    static uint8_t code[16];
+    BuildObjectWriter *w = build__create(path, BUILD_MACHINE_AARCH64);
+    CHECK(w != NULL);
+    if (!w) return;
+    uint32_t text = build__add_section(w, SECTION_TEXT, ".text.main", code, sizeof(code), 4);
+    BuildSymbol main_sym = { "main", 0, sizeof(code), text, SYMBOL_GLOBAL };
+    BuildSymbol callee = { "callee", 0, 0, 0, SYMBOL_GLOBAL };
+    build__add_symbol(w, &main_sym);
+    int c = build__add_symbol(w, &callee);
+    BuildRelocation call = { 8, c, R_AARCH64_CALL26, 0 };
+    CHECK(build__add_relocation(w, text, &call) == 0);
+    CHECK(build__finalize(w) == 0);
+
+    Linker linker;
+    linker__init(&linker);
+    CHECK(linker__add_object(&linker, path) == 0);
+    if (linker.num_objects == 1) {
+        const ObjectFile *obj = &linker.objects[0];
+        CHECK(obj->machine == ELF_EM_AARCH64);
+        CHECK(obj->num_sections == 1);
+        CHECK(find_section(obj, ".text.main") != NULL);
+        const Symbol *sm = find_symbol(obj, "main");
+        CHECK(sm && sm->is_global && sm->is_defined && sm->section_index == 0);
+        CHECK(obj->num_relocs == 1);
+        check_reloc(obj, ".text.main", 8, "callee", R_AARCH64_CALL26, 0);
+    }
+    linker__destroy(&linker);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <x86-64 object> <aarch64 object>\n", argv[0]);
+        return 2;
+    }
+    x86_64_object(argv[1]);
+    aarch64_object(argv[2]);
+    return check_failures != 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * Symbol resolution over many objects. "resolve <dir>" writes 500
+ * objects to dir, each defining 20 functions that call the functions of
+ * the same number in the next object, links them and checks that every
+ * reference resolved to the object defining it; the time of the link is
+ * printed. "resolve-duplicate <dir>" and "resolve-undefined <dir>" link
+ * two objects defining the same symbol, and one referencing a symbol no
+ * object defines, which must fail with the linker's report on stderr.
+ * Symbol tables are static, so linker.c is included here.
+ */
+#include "linker/linker.c"
+#include <time.h>
+#include "build/build.h"
+#include "check.h"
+
+#define OBJECTS 500
+#define FUNCTIONS 20
+#define R_X86_64_PLT32 4
+
+static uint8_t code[32];
+
+/* An object of one section per function. Function s calls function s of
+ * object callee_obj, or nothing when callee_obj is -1. */
+static int write_object(const char *path, int obj, int callee_obj, int functions, int with_main) {
+    BuildObjectWriter *w = build__create(path, BUILD_MACHINE_X86_64);
+    if (!w) return -1;
+    char name[64];
+    for (int s = 0; s < functions; s++) {
+        snprintf(name, sizeof(name), ".text.f%d_%d", obj, s);
+        uint32_t text = build__add_section(w, SECTION_TEXT, name, code, sizeof(code), 16);
+        snprintf(name, sizeof(name), "f%d_%d", obj, s);
+        BuildSymbol def = { name, 0, sizeof(code), text, SYMBOL_GLOBAL };
+        if (!text || build__add_symbol(w, &def) < 0) goto fail;
+        if (with_main && s == 0) {
+            BuildSymbol main_sym = { "main", 0, sizeof(code), text, SYMBOL_GLOBAL };
+            if (build__add_symbol(w, &main_sym) < 0) goto fail;
+        }
+        if (callee_obj < 0) continue;
+        snprintf(name, sizeof(name), "f%d_%d", callee_obj, s);
+        BuildSymbol ref = { name, 0, 0, 0, SYMBOL_GLOBAL };
+        int r = build__add_symbol(w, &ref);
+        BuildRelocation call = { 1, r, R_X86_64_PLT32, -4 };
+        if (r < 0 || build__add_relocation(w, text, &call) != 0) goto fail;
+    }
+    return build__finalize(w);
+fail:
+    build__destroy(w);
+    return -1;
+}
+
+static void resolve_many(const char *dir) {
+    char path[4096];
+    for (int o = 0; o < OBJECTS; o++) {
+        snprintf(path, sizeof(path), "%s/o%d.o", dir, o);
+        CHECK(write_object(path, o, (o + 1) % OBJECTS, FUNCTIONS, o == 0) == 0);
+    }
+    Linker linker;
+    linker__init(&linker);
+    linker__set_entry(&linker, "main");
+    linker__set_gc_sections(&linker, 1);
+    for (int o = 0; o < OBJECTS; o++) {
+        snprintf(path, sizeof(path), "%s/o%d.o", dir, o);
+        CHECK(linker__add_object(&linker, path) == 0);
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int rc = linker__link(&linker);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    CHECK(rc == 0);
+    CHECK(linker.num_globals == OBJECTS * FUNCTIONS + 1);
+    /* Only the functions numbered 0 are reached from main. */
+    CHECK(linker.gc_removed_sections == OBJECTS * (FUNCTIONS - 1));
+    for (int o = 0; o < linker.num_objects; o++) {
+        const ObjectFile *obj = &linker.objects[o];
+        for (int s = 0; s < obj->num_symbols; s++) {
+            const Symbol *sym = &obj->symbols[s];
+            if (!sym->is_global || sym->is_defined || !sym->name[0]) continue;
+            CHECK(sym->global >= 0 && linker.globals[sym->global].def_obj == (o + 1) % OBJECTS);
+        }
+    }
+    printf("linked %d objects, %d symbols in %.1f ms\n", linker.num_objects, linker.num_globals,
+           (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6);
+    linker__destroy(&linker);
+}
+
+/* Link the objects, which must fail. */
+static void link_fails(char **paths, int count) {
+    Linker linker;
+    linker__init(&linker);
+    for (int i = 0; i < count; i++) CHECK(linker__add_object(&linker, paths[i]) == 0);
+    CHECK(linker__link(&linker) != 0);
+    linker__destroy(&linker);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s resolve|resolve-duplicate|resolve-undefined <dir>\n", argv[0]);
+        return 2;
+    }
+    char a[4096], b[4096];
+    char *paths[] = { a, b };
+    snprintf(a, sizeof(a), "%s/a.o", argv[2]);
+    snprintf(b, sizeof(b), "%s/b.o", argv[2]);
+    if (strcmp(argv[1], "resolve") == 0) {
+        resolve_many(argv[2]);
+    } else if (strcmp(argv[1], "resolve-duplicate") == 0) {
+        /* Both define f0_0 and f0_1. */
+        CHECK(write_object(a, 0, -1, 2, 1) == 0);
+        CHECK(write_object(b, 0, -1, 2, 0) == 0);
+        link_fails(paths, 2);
+    } else if (strcmp(argv[1], "resolve-undefined") == 0) {
+        /* a calls f7_0 and f7_1, which b does not define. */
+        CHECK(write_object(a, 0, 7, 2, 1) == 0);
+        CHECK(write_object(b, 1, -1, 2, 0) == 0);
+        link_fails(paths, 2);
+    } else {
+        fprintf(stderr, "unknown test %s\n", argv[1]);
+        return 2;
+    }
+    return check_failures != 0;
+}